@@ -34,6 +34,8 @@
 #include <unistd.h>
 #include <sys/file.h>
 #include <time.h>
+#include <pthread.h>
+#include <signal.h>
 #include "base.h"
 //#include "hardware.h"
 //#include "hw_procs.h"
@@ -159,19 +161,260 @@ void reset_counters(type_u32_couters* pCounters)
    pCounters->uValueNow = 0;
 }
 
-u32 base_compute_crc32(u8 *buf, int length)
+// CRC32 (IEEE 802.3, reflected) implementations. All of them are bit compatible with crc32_table.
+// They work on the running (inverted) crc value. The fastest one supported by the CPU is
+// selected once, at process start.
+
+typedef u32 (*base_crc32_func_t)(u32 uCRC, const u8* pBuffer, int iLength);
+
+static u32 s_uCRC32SliceTables[8][256] __attribute__((aligned (64)));
+
+static u32 _base_crc32_table(u32 uCRC, const u8* pBuffer, int iLength)
+{
+   while ( iLength-- > 0 )
+      uCRC = crc32_table[(uCRC ^ *pBuffer++) & 0xFF] ^ (uCRC >> 8);
+   return uCRC;
+}
+
+// Slicing-by-8: 8 input bytes per step, using 8 tables derived from crc32_table
+
+static u32 _base_crc32_slice8(u32 uCRC, const u8* pBuffer, int iLength)
+{
+   while ( iLength >= 8 )
+   {
+      u32 uLow, uHigh;
+      memcpy(&uLow, pBuffer, sizeof(u32));
+      memcpy(&uHigh, pBuffer + sizeof(u32), sizeof(u32));
+      uLow = le32toh(uLow) ^ uCRC;
+      uHigh = le32toh(uHigh);
+      uCRC = s_uCRC32SliceTables[7][uLow & 0xFF] ^
+             s_uCRC32SliceTables[6][(uLow >> 8) & 0xFF] ^
+             s_uCRC32SliceTables[5][(uLow >> 16) & 0xFF] ^
+             s_uCRC32SliceTables[4][uLow >> 24] ^
+             s_uCRC32SliceTables[3][uHigh & 0xFF] ^
+             s_uCRC32SliceTables[2][(uHigh >> 8) & 0xFF] ^
+             s_uCRC32SliceTables[1][(uHigh >> 16) & 0xFF] ^
+             s_uCRC32SliceTables[0][uHigh >> 24];
+      pBuffer += 8;
+      iLength -= 8;
+   }
+   return _base_crc32_table(uCRC, pBuffer, iLength);
+}
+
+#if defined(__aarch64__) && defined(__GNUC__)
+
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#define BASE_CRC32_HAS_ARMV8 1
+
+// ARMv8 CRC32 instructions (CRC32B/CRC32X use the same polynomial as crc32_table)
+
+__attribute__((target("+crc")))
+static u32 _base_crc32_armv8(u32 uCRC, const u8* pBuffer, int iLength)
+{
+   while ( (iLength > 0) && (((unsigned long)pBuffer) & 7) )
+   {
+      uCRC = __crc32b(uCRC, *pBuffer++);
+      iLength--;
+   }
+   while ( iLength >= 8 )
+   {
+      uint64_t uValue;
+      memcpy(&uValue, pBuffer, sizeof(uValue));
+      uCRC = __crc32d(uCRC, uValue);
+      pBuffer += 8;
+      iLength -= 8;
+   }
+   while ( iLength-- > 0 )
+      uCRC = __crc32b(uCRC, *pBuffer++);
+   return uCRC;
+}
+
+#elif (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+
+#include <immintrin.h>
+#define BASE_CRC32_HAS_PCLMUL 1
+
+// Carry-less multiplication folding (Intel, "Fast CRC Computation for Generic Polynomials Using
+// PCLMULQDQ Instruction"), constants for the reflected 0x04C11DB7 polynomial.
+// Folds 64 bytes per step, then 16 bytes, then reduces to 32 bits (Barrett).
+// iLength must be at least 64 and a multiple of 16.
+
+__attribute__((target("pclmul,sse4.1")))
+static u32 _base_crc32_pclmul_blocks(u32 uCRC, const u8* pBuffer, int iLength)
+{
+   static const uint64_t k1k2[2] __attribute__((aligned (16))) = { 0x0154442bd4ULL, 0x01c6e41596ULL };
+   static const uint64_t k3k4[2] __attribute__((aligned (16))) = { 0x01751997d0ULL, 0x00ccaa009eULL };
+   static const uint64_t k5k0[2] __attribute__((aligned (16))) = { 0x0163cd6124ULL, 0x0000000000ULL };
+   static const uint64_t poly[2] __attribute__((aligned (16))) = { 0x01db710641ULL, 0x01f7011641ULL };
+
+   __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+   x1 = _mm_loadu_si128((const __m128i*)(pBuffer + 0x00));
+   x2 = _mm_loadu_si128((const __m128i*)(pBuffer + 0x10));
+   x3 = _mm_loadu_si128((const __m128i*)(pBuffer + 0x20));
+   x4 = _mm_loadu_si128((const __m128i*)(pBuffer + 0x30));
+   x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)uCRC));
+   x0 = _mm_load_si128((const __m128i*)k1k2);
+   pBuffer += 64;
+   iLength -= 64;
+
+   while ( iLength >= 64 )
+   {
+      x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+      x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+      x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+      x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+      x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+      x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+      x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+      y5 = _mm_loadu_si128((const __m128i*)(pBuffer + 0x00));
+      y6 = _mm_loadu_si128((const __m128i*)(pBuffer + 0x10));
+      y7 = _mm_loadu_si128((const __m128i*)(pBuffer + 0x20));
+      y8 = _mm_loadu_si128((const __m128i*)(pBuffer + 0x30));
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+      x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+      x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+      x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+      pBuffer += 64;
+      iLength -= 64;
+   }
+
+   // Fold the 4 lanes into one
+
+   x0 = _mm_load_si128((const __m128i*)k3k4);
+   x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+   x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+   x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+   x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+   x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+   x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+   while ( iLength >= 16 )
+   {
+      x2 = _mm_loadu_si128((const __m128i*)pBuffer);
+      x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+      pBuffer += 16;
+      iLength -= 16;
+   }
+
+   // Fold 128 bits to 64 bits
+
+   x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+   x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+   x1 = _mm_srli_si128(x1, 8);
+   x1 = _mm_xor_si128(x1, x2);
+   x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+   x2 = _mm_srli_si128(x1, 4);
+   x1 = _mm_and_si128(x1, x3);
+   x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+   x1 = _mm_xor_si128(x1, x2);
+
+   // Barrett reduction to 32 bits
+
+   x0 = _mm_load_si128((const __m128i*)poly);
+   x2 = _mm_and_si128(x1, x3);
+   x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+   x2 = _mm_and_si128(x2, x3);
+   x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+   x1 = _mm_xor_si128(x1, x2);
+   return (u32)_mm_extract_epi32(x1, 1);
+}
+
+static u32 _base_crc32_pclmul(u32 uCRC, const u8* pBuffer, int iLength)
+{
+   if ( iLength >= 64 )
+   {
+      int iBlocksLength = iLength & (~15);
+      uCRC = _base_crc32_pclmul_blocks(uCRC, pBuffer, iBlocksLength);
+      pBuffer += iBlocksLength;
+      iLength -= iBlocksLength;
+   }
+   return _base_crc32_slice8(uCRC, pBuffer, iLength);
+}
+
+#endif
+
+static base_crc32_func_t s_pfBaseCRC32 = _base_crc32_table;
+static const char* s_szBaseCRC32Name = "table";
+
+int base_crc32_select_implementation(int iImplementation)
 {
-   u8* p = buf;
-   u32 crc;
-   crc = ~0U;
+   if ( iImplementation == BASE_CRC32_IMPL_TABLE )
+   {
+      s_pfBaseCRC32 = _base_crc32_table;
+      s_szBaseCRC32Name = "table";
+      return 1;
+   }
+   if ( iImplementation == BASE_CRC32_IMPL_SLICE8 )
+   {
+      s_pfBaseCRC32 = _base_crc32_slice8;
+      s_szBaseCRC32Name = "slice8";
+      return 1;
+   }
+   if ( iImplementation != BASE_CRC32_IMPL_HARDWARE )
+      return 0;
 
-   while (length--)
+   #if defined(BASE_CRC32_HAS_ARMV8)
+   if ( getauxval(AT_HWCAP) & HWCAP_CRC32 )
+   {
+      s_pfBaseCRC32 = _base_crc32_armv8;
+      s_szBaseCRC32Name = "armv8-crc";
+      return 1;
+   }
+   #elif defined(BASE_CRC32_HAS_PCLMUL)
+   __builtin_cpu_init();
+   if ( __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1") )
    {
-      crc = crc32_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+      s_pfBaseCRC32 = _base_crc32_pclmul;
+      s_szBaseCRC32Name = "pclmul";
+      return 1;
    }
-   return crc ^ ~0U;
+   #endif
+   return 0;
+}
+
+const char* base_crc32_get_implementation_name()
+{
+   return s_szBaseCRC32Name;
+}
+
+__attribute__((constructor))
+static void _base_crc32_init()
+{
+   for( int i=0; i<256; i++ )
+      s_uCRC32SliceTables[0][i] = crc32_table[i];
+   for( int k=1; k<8; k++ )
+   for( int i=0; i<256; i++ )
+      s_uCRC32SliceTables[k][i] = (s_uCRC32SliceTables[k-1][i] >> 8) ^ crc32_table[s_uCRC32SliceTables[k-1][i] & 0xFF];
+
+   if ( NULL != getenv("RUBY_CRC32_NO_HW") )
+      base_crc32_select_implementation(BASE_CRC32_IMPL_SLICE8);
+   else if ( ! base_crc32_select_implementation(BASE_CRC32_IMPL_HARDWARE) )
+      base_crc32_select_implementation(BASE_CRC32_IMPL_SLICE8);
+}
+
+u32 base_compute_crc32(u8 *buf, int length)
+{
+   if ( length <= 0 )
+      return 0;
+   return s_pfBaseCRC32(~0U, buf, length) ^ ~0U;
 } 
 
+u32 base_update_crc32(u32 uCRC, u8* pBuffer, int iLength)
+{
+   if ( (NULL == pBuffer) || (iLength <= 0) )
+      return uCRC;
+   return s_pfBaseCRC32(uCRC ^ ~0U, pBuffer, iLength) ^ ~0U;
+}
+
 u8 base_compute_crc8(u8* pBuffer, int iLength)
 {
    u8 uCrc = 0xFF;
@@ -636,84 +879,391 @@ void _log_format_time_mstens(char* szOutTime)
    sprintf(szOutTime,"%d-%d:%02d:%02d.%03d", s_bootCount, (int)(uMilisTens/1000/60/60/10), (int)(uMilisTens/1000/60/10)%60, (int)((uMilisTens/1000/10)%60), (int)((uMilisTens/10)%1000));
 }
 
-void log_line(const char* format, ...)
+// Asynchronous log writes.
+// Log lines are formatted on the calling thread and queued in a bounded multi producer ring
+// (no locks on the log_* calls); a background thread drains the ring and appends the lines to
+// the log files in batches, opening each file once per batch.
+// In memory only mode the lines are kept in the ring and written only every few seconds
+// (or when the ring gets half full).
+// Error lines are written right away (after the pending lines); soft error lines wake up the writer.
+// On a crash signal the pending lines are written before the signal is handled as before.
+
+#define LOG_TARGET_SYSTEM 0x01
+#define LOG_TARGET_ERRORS 0x02
+#define LOG_TARGET_ERRORS_SOFT 0x04
+#define LOG_TARGET_ADDITIONAL 0x08
+
+#define LOG_ASYNC_RING_SLOTS 512
+#define LOG_ASYNC_LINE_LENGTH 500
+#define LOG_ASYNC_FLUSH_INTERVAL_MS 100
+#define LOG_ASYNC_MEMORY_ONLY_FLUSH_INTERVAL_MS 5000
+
+typedef struct
 {
-   if ( s_logDisabled || s_logOnlyErrors )
-      return;
+   u32 uSequence;
+   u8 uTargets;
+   u16 uLength;
+   char szText[LOG_ASYNC_LINE_LENGTH];
+} type_log_async_slot;
+
+static type_log_async_slot* s_pLogAsyncSlots = NULL;
+static u32 s_uLogAsyncEnqueuePos = 0;
+static u32 s_uLogAsyncDequeuePos = 0;
+static u32 s_uLogAsyncDroppedLines = 0;
+static volatile int s_iLogAsyncActive = 0;
+static volatile int s_iLogAsyncMemoryOnly = 0;
+static pthread_t s_pThreadLogAsync;
+static pthread_mutex_t s_MutexLogAsyncDrain = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t s_MutexLogAsyncWake = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_CondLogAsyncWake = PTHREAD_COND_INITIALIZER;
+static int s_iLogAsyncWakeRequested = 0;
+
+static const int s_iLogAsyncCrashSignals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+#define LOG_ASYNC_CRASH_SIGNALS_COUNT ((int)(sizeof(s_iLogAsyncCrashSignals)/sizeof(s_iLogAsyncCrashSignals[0])))
+static struct sigaction s_LogAsyncPrevSignalActions[LOG_ASYNC_CRASH_SIGNALS_COUNT];
+
+static void _log_write_to_files(FILE** pFiles, u8 uTargets, const char* szText, int iLength)
+{
+   const char* szFileNames[3] = { LOG_FILE_SYSTEM, LOG_FILE_ERRORS, LOG_FILE_ERRORS_SOFT };
+   for( int i=0; i<4; i++ )
+   {
+      if ( ! (uTargets & (1<<i)) )
+         continue;
+      if ( NULL == pFiles[i] )
+      {
+         char szFile[MAX_FILE_PATH_SIZE];
+         if ( i < 3 )
+         {
+            strcpy(szFile, FOLDER_LOGS);
+            strcat(szFile, szFileNames[i]);
+         }
+         else
+            strcpy(szFile, s_szAdditionalLogFile);
+         pFiles[i] = fopen(szFile, "a+");
+         if ( NULL == pFiles[i] )
+            continue;
+      }
+      fwrite(szText, 1, iLength, pFiles[i]);
+   }
+}
 
-   va_list args;
-   va_start(args, format);
+static void _log_close_files(FILE** pFiles)
+{
+   for( int i=0; i<4; i++ )
+   {
+      if ( NULL != pFiles[i] )
+         fclose(pFiles[i]);
+      pFiles[i] = NULL;
+   }
+}
 
-   s_szTimeLog[0] = 0;
-   if ( s_logAddTime )
-      _log_format_time_mstens(s_szTimeLog);
- 
-   if ( _log_check_for_service_log_access() )
+static int _log_async_enqueue(u8 uTargets, const char* szText, int iLength)
+{
+   u32 uPos = __atomic_load_n(&s_uLogAsyncEnqueuePos, __ATOMIC_RELAXED);
+   type_log_async_slot* pSlot = NULL;
+   while ( 1 )
    {
-      char szBuff[MAX_SERVICE_LOG_ENTRY_LENGTH];
-      vsnprintf(szBuff,MAX_SERVICE_LOG_ENTRY_LENGTH-1, format, args);
-      szBuff[MAX_SERVICE_LOG_ENTRY_LENGTH-1] = 0;
-      _log_service_entry(szBuff);
-      va_end(args);
-      return;
+      pSlot = &s_pLogAsyncSlots[uPos % LOG_ASYNC_RING_SLOTS];
+      u32 uSequence = __atomic_load_n(&pSlot->uSequence, __ATOMIC_ACQUIRE);
+      int iDiff = (int)(uSequence - uPos);
+      if ( 0 == iDiff )
+      {
+         if ( __atomic_compare_exchange_n(&s_uLogAsyncEnqueuePos, &uPos, uPos+1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+            break;
+      }
+      else if ( iDiff < 0 )
+      {
+         // Ring is full, never block the caller
+         __atomic_add_fetch(&s_uLogAsyncDroppedLines, 1, __ATOMIC_RELAXED);
+         return 0;
+      }
+      else
+         uPos = __atomic_load_n(&s_uLogAsyncEnqueuePos, __ATOMIC_RELAXED);
    }
 
-   char szFile[MAX_FILE_PATH_SIZE];
-   strcpy(szFile, FOLDER_LOGS);
-   strcat(szFile, LOG_FILE_SYSTEM);
-   FILE* fd = fopen(szFile, "a+");
-   //int lock = flock(fileno(fd), LOCK_EX);
+   memcpy(pSlot->szText, szText, iLength);
+   pSlot->uLength = (u16)iLength;
+   pSlot->uTargets = uTargets;
+   __atomic_store_n(&pSlot->uSequence, uPos+1, __ATOMIC_RELEASE);
+   return 1;
+}
 
-   if ( 0 != s_szAdditionalLogFile[0] )
+static void _log_async_wake_writer()
+{
+   pthread_mutex_lock(&s_MutexLogAsyncWake);
+   s_iLogAsyncWakeRequested = 1;
+   pthread_cond_signal(&s_CondLogAsyncWake);
+   pthread_mutex_unlock(&s_MutexLogAsyncWake);
+}
+
+// Returns the number of lines written. Must be called with s_MutexLogAsyncDrain locked
+
+static int _log_async_drain_locked()
+{
+   FILE* pFiles[4] = { NULL, NULL, NULL, NULL };
+   int iCount = 0;
+
+   while ( 1 )
    {
-      FILE* fdAux = fopen(s_szAdditionalLogFile, "a+");
-      if ( NULL != fdAux )
+      type_log_async_slot* pSlot = &s_pLogAsyncSlots[s_uLogAsyncDequeuePos % LOG_ASYNC_RING_SLOTS];
+      u32 uSequence = __atomic_load_n(&pSlot->uSequence, __ATOMIC_ACQUIRE);
+      if ( uSequence != s_uLogAsyncDequeuePos + 1 )
+         break;
+      u8 uTargets = pSlot->uTargets;
+      if ( 0 == s_szAdditionalLogFile[0] )
+         uTargets &= ~LOG_TARGET_ADDITIONAL;
+      _log_write_to_files(pFiles, uTargets, pSlot->szText, pSlot->uLength);
+      __atomic_store_n(&pSlot->uSequence, s_uLogAsyncDequeuePos + LOG_ASYNC_RING_SLOTS, __ATOMIC_RELEASE);
+      s_uLogAsyncDequeuePos++;
+      iCount++;
+   }
+
+   u32 uDropped = __atomic_exchange_n(&s_uLogAsyncDroppedLines, 0, __ATOMIC_RELAXED);
+   if ( uDropped > 0 )
+   {
+      char szLine[128];
+      int iLen = snprintf(szLine, sizeof(szLine), "%s: [Log] Log ring full, %u log lines were dropped.\n", sszComponentName, uDropped);
+      _log_write_to_files(pFiles, LOG_TARGET_SYSTEM | LOG_TARGET_ERRORS_SOFT, szLine, iLen);
+   }
+   _log_close_files(pFiles);
+   return iCount;
+}
+
+static int _log_async_drain()
+{
+   if ( NULL == s_pLogAsyncSlots )
+      return 0;
+   pthread_mutex_lock(&s_MutexLogAsyncDrain);
+   int iCount = _log_async_drain_locked();
+   pthread_mutex_unlock(&s_MutexLogAsyncDrain);
+   return iCount;
+}
+
+// Sleeps until the flush interval ends or until it is woken up (ring half full, soft error, stop)
+
+static void* _thread_log_async_writer(void *argument)
+{
+   while ( s_iLogAsyncActive )
+   {
+      u32 uInterval = s_iLogAsyncMemoryOnly?LOG_ASYNC_MEMORY_ONLY_FLUSH_INTERVAL_MS:LOG_ASYNC_FLUSH_INTERVAL_MS;
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_sec += uInterval / 1000;
+      ts.tv_nsec += (long)(uInterval % 1000) * 1000000L;
+      if ( ts.tv_nsec >= 1000000000L )
       {
-         fprintf(fdAux, "%s %s: ", s_szTimeLog, sszComponentName);  
-         fclose(fdAux);
+         ts.tv_sec++;
+         ts.tv_nsec -= 1000000000L;
+      }
+      pthread_mutex_lock(&s_MutexLogAsyncWake);
+      while ( s_iLogAsyncActive && (! s_iLogAsyncWakeRequested) )
+      {
+         if ( 0 != pthread_cond_timedwait(&s_CondLogAsyncWake, &s_MutexLogAsyncWake, &ts) )
+            break;
       }
+      s_iLogAsyncWakeRequested = 0;
+      pthread_mutex_unlock(&s_MutexLogAsyncWake);
+      _log_async_drain();
    }
+   return NULL;
+}
 
-   if ( ! s_logDisabledStdout )
-      printf("%s %s: ", s_szTimeLog, sszComponentName);
-   if ( NULL != fd )
-     fprintf(fd, "%s %s: ", s_szTimeLog, sszComponentName);
+static void _log_async_at_exit()
+{
+   _log_async_drain();
+}
 
-   if ( 0 != s_szAdditionalLogFile[0] )
+// Writes the pending lines on a crash, then lets the signal be handled as before (default action: core dump).
+// Skips the write if the crash happened while the lines were being written.
+
+static void _log_async_crash_signal_handler(int iSignal)
+{
+   if ( 0 == pthread_mutex_trylock(&s_MutexLogAsyncDrain) )
    {
-      FILE* fdAux = fopen(s_szAdditionalLogFile, "a+");
-      if ( NULL != fdAux )
+      _log_async_drain_locked();
+      pthread_mutex_unlock(&s_MutexLogAsyncDrain);
+   }
+   for( int i=0; i<LOG_ASYNC_CRASH_SIGNALS_COUNT; i++ )
+   {
+      if ( s_iLogAsyncCrashSignals[i] == iSignal )
+         sigaction(iSignal, &s_LogAsyncPrevSignalActions[i], NULL);
+   }
+   raise(iSignal);
+}
+
+// The writer thread does not exist in a forked child and the pending lines belong to the parent:
+// start the child with an empty ring and direct writes.
+
+static void _log_async_at_fork_child()
+{
+   s_iLogAsyncActive = 0;
+   s_iLogAsyncWakeRequested = 0;
+   pthread_mutex_init(&s_MutexLogAsyncDrain, NULL);
+   pthread_mutex_init(&s_MutexLogAsyncWake, NULL);
+   pthread_cond_init(&s_CondLogAsyncWake, NULL);
+   for( u32 i=0; i<LOG_ASYNC_RING_SLOTS; i++ )
+      s_pLogAsyncSlots[i].uSequence = i;
+   s_uLogAsyncEnqueuePos = 0;
+   s_uLogAsyncDequeuePos = 0;
+   s_uLogAsyncDroppedLines = 0;
+}
+
+// Writes pending async log lines, so that direct writes to the log files stay in order
+
+static void _log_async_flush_if_active()
+{
+   if ( s_iLogAsyncActive )
+      _log_async_drain();
+}
+
+void log_enable_async_writes()
+{
+   if ( s_iLogAsyncActive || s_logUseService )
+      return;
+
+   char szFile[MAX_FILE_PATH_SIZE];
+   strcpy(szFile, FOLDER_CONFIG);
+   strcat(szFile, LOG_ASYNC_MEMORY_ONLY);
+   s_iLogAsyncMemoryOnly = (access(szFile, R_OK) != -1)?1:0;
+
+   if ( NULL == s_pLogAsyncSlots )
+   {
+      s_pLogAsyncSlots = (type_log_async_slot*) malloc(LOG_ASYNC_RING_SLOTS * sizeof(type_log_async_slot));
+      if ( NULL == s_pLogAsyncSlots )
       {
-         vfprintf(fdAux, format, args);
-         fclose(fdAux);
+         log_softerror_and_alarm("[Log] Failed to allocate async log ring.");
+         return;
       }
+      for( u32 i=0; i<LOG_ASYNC_RING_SLOTS; i++ )
+         s_pLogAsyncSlots[i].uSequence = i;
+      s_uLogAsyncEnqueuePos = 0;
+      s_uLogAsyncDequeuePos = 0;
+      atexit(_log_async_at_exit);
+      pthread_atfork(NULL, NULL, _log_async_at_fork_child);
+
+      struct sigaction action;
+      memset(&action, 0, sizeof(action));
+      action.sa_handler = _log_async_crash_signal_handler;
+      sigemptyset(&action.sa_mask);
+      for( int i=0; i<LOG_ASYNC_CRASH_SIGNALS_COUNT; i++ )
+         sigaction(s_iLogAsyncCrashSignals[i], &action, &s_LogAsyncPrevSignalActions[i]);
    }
 
-   if ( NULL != fd )
-      vfprintf(fd, format, args);
-   if ( ! s_logDisabledStdout )
-      vprintf(format, args);
+   s_iLogAsyncActive = 1;
+   if ( 0 != pthread_create(&s_pThreadLogAsync, NULL, &_thread_log_async_writer, NULL) )
+   {
+      s_iLogAsyncActive = 0;
+      log_softerror_and_alarm("[Log] Failed to create async log writer thread.");
+      return;
+   }
+   log_line("[Log] Started async log writes (%s, %d lines ring).", s_iLogAsyncMemoryOnly?"memory only, periodic flush":"batched writes", LOG_ASYNC_RING_SLOTS);
+}
 
-   if ( 0 != s_szAdditionalLogFile[0] )
+void log_disable_async_writes()
+{
+   if ( ! s_iLogAsyncActive )
+      return;
+   s_iLogAsyncActive = 0;
+   _log_async_wake_writer();
+   pthread_join(s_pThreadLogAsync, NULL);
+   _log_async_drain();
+   log_line("[Log] Stopped async log writes.");
+}
+
+void log_flush()
+{
+   _log_async_drain();
+}
+
+// Formats the log line once (szTime is already formatted by the caller) and sends it to the log targets, directly or through the async ring
+
+static void _log_output_line(u8 uTargets, const char* szTime, const char* szType, const char* format, va_list args)
+{
+   char szLine[LOG_ASYNC_LINE_LENGTH];
+   char* pLine = szLine;
+   int iHeaderLength = snprintf(szLine, sizeof(szLine), "%s %s: %s", szTime, sszComponentName, szType);
+   if ( (iHeaderLength < 0) || (iHeaderLength >= (int)sizeof(szLine)) )
+      return;
+
+   va_list argsCopy;
+   va_copy(argsCopy, args);
+   int iTextLength = vsnprintf(szLine + iHeaderLength, sizeof(szLine) - iHeaderLength - 1, format, argsCopy);
+   va_end(argsCopy);
+   if ( iTextLength < 0 )
+      iTextLength = 0;
+
+   if ( iHeaderLength + iTextLength >= (int)sizeof(szLine) - 1 )
    {
-      FILE* fdAux = fopen(s_szAdditionalLogFile, "a+");
-      if ( NULL != fdAux )
+      pLine = (char*) malloc(iHeaderLength + iTextLength + 2);
+      if ( NULL == pLine )
       {
-         fprintf(fdAux, "\n");
-         fclose(fdAux);
+         pLine = szLine;
+         iTextLength = sizeof(szLine) - iHeaderLength - 2;
+      }
+      else
+      {
+         memcpy(pLine, szLine, iHeaderLength);
+         va_copy(argsCopy, args);
+         vsnprintf(pLine + iHeaderLength, iTextLength + 1, format, argsCopy);
+         va_end(argsCopy);
       }
    }
-   va_end(args);
+   int iLength = iHeaderLength + iTextLength;
+   pLine[iLength++] = '\n';
+   pLine[iLength] = 0;
 
    if ( ! s_logDisabledStdout )
-      printf("\n");
-   if ( NULL != fd )
-     fprintf(fd, "\n");  
+      fputs(pLine, stdout);
 
-   //if ( 0 == lock )
-   //   flock(fileno(fd), LOCK_UN);
-   if ( NULL != fd )
-      fclose(fd);
+   if ( 0 != s_szAdditionalLogFile[0] )
+      uTargets |= LOG_TARGET_ADDITIONAL;
+
+   // Error lines are written right away, so they are not lost if the process dies next
+   if ( s_iLogAsyncActive && (pLine == szLine) && (! (uTargets & LOG_TARGET_ERRORS)) )
+   {
+      _log_async_enqueue(uTargets, pLine, iLength);
+      if ( (uTargets & LOG_TARGET_ERRORS_SOFT) ||
+           (__atomic_load_n(&s_uLogAsyncEnqueuePos, __ATOMIC_RELAXED) - s_uLogAsyncDequeuePos >= LOG_ASYNC_RING_SLOTS/2) )
+         _log_async_wake_writer();
+   }
+   else
+   {
+      _log_async_flush_if_active();
+      FILE* pFiles[4] = { NULL, NULL, NULL, NULL };
+      _log_write_to_files(pFiles, uTargets, pLine, iLength);
+      _log_close_files(pFiles);
+   }
+
+   if ( pLine != szLine )
+      free(pLine);
+}
+
+void log_line(const char* format, ...)
+{
+   if ( s_logDisabled || s_logOnlyErrors )
+      return;
+
+   va_list args;
+   va_start(args, format);
+
+   char szTime[64];
+   szTime[0] = 0;
+   if ( s_logAddTime )
+      _log_format_time_mstens(szTime);
+ 
+   if ( _log_check_for_service_log_access() )
+   {
+      char szBuff[MAX_SERVICE_LOG_ENTRY_LENGTH];
+      vsnprintf(szBuff,MAX_SERVICE_LOG_ENTRY_LENGTH-1, format, args);
+      szBuff[MAX_SERVICE_LOG_ENTRY_LENGTH-1] = 0;
+      strcpy(s_szTimeLog, szTime);
+      _log_service_entry(szBuff);
+      va_end(args);
+      return;
+   }
+
+   _log_output_line(LOG_TARGET_SYSTEM, szTime, "", format, args);
+   va_end(args);
 }
 
 
@@ -726,6 +1276,8 @@ void log_line_forced_to_file(const char* format, ...)
    if ( s_logAddTime )
       _log_format_time_mstens(s_szTimeLog);
 
+   _log_async_flush_if_active();
+
    char szFile[MAX_FILE_PATH_SIZE];
    strcpy(szFile, FOLDER_LOGS);
    strcat(szFile, LOG_FILE_SYSTEM);
@@ -806,6 +1358,8 @@ void log_line_watchdog(const char* format, ...)
       return;
    }
 
+   _log_async_flush_if_active();
+
    char szFile[MAX_FILE_PATH_SIZE];
    strcpy(szFile, FOLDER_LOGS);
    strcat(szFile, LOG_FILE_SYSTEM);
@@ -871,6 +1425,8 @@ void log_line_commands(const char* format, ...)
       return;
    }
 
+   _log_async_flush_if_active();
+
    char szFile[MAX_FILE_PATH_SIZE];
    strcpy(szFile, FOLDER_LOGS);
    strcat(szFile, LOG_FILE_SYSTEM);
@@ -1005,6 +1561,8 @@ void log_buffer5(const u8* buffer, int size, int delim1, int delim2, int delim3,
       return;
    }
 
+   _log_async_flush_if_active();
+
    char szFile[MAX_FILE_PATH_SIZE];
    strcpy(szFile, FOLDER_LOGS);
    strcat(szFile, LOG_FILE_SYSTEM);
@@ -1095,6 +1653,8 @@ void log_dword(const char* szText, u32 value)
       return;
    }
 
+   _log_async_flush_if_active();
+
    char szFile[MAX_FILE_PATH_SIZE];
    strcpy(szFile, FOLDER_LOGS);
    strcat(szFile, LOG_FILE_SYSTEM);
@@ -1153,6 +1713,8 @@ void log_dword_bits(const char* szText, u32 value)
       return;
    }
 
+   _log_async_flush_if_active();
+
    char szFile[MAX_FILE_PATH_SIZE];
    strcpy(szFile, FOLDER_LOGS);
    strcat(szFile, LOG_FILE_SYSTEM);
@@ -1203,94 +1765,24 @@ void log_error_and_alarm(const char* format, ...)
    va_list args;
    va_start(args, format);
 
-   s_szTimeLog[0] = 0;
+   char szTime[64];
+   szTime[0] = 0;
    if ( s_logAddTime )
-      _log_format_time_mstens(s_szTimeLog);
+      _log_format_time_mstens(szTime);
 
    if ( _log_check_for_service_log_access() )
    {
       char szBuff[MAX_SERVICE_LOG_ENTRY_LENGTH];
       vsnprintf(szBuff, MAX_SERVICE_LOG_ENTRY_LENGTH-1, format, args);
       szBuff[MAX_SERVICE_LOG_ENTRY_LENGTH-1] = 0;
+      strcpy(s_szTimeLog, szTime);
       _log_service_entry_error(szBuff);
       va_end(args);
       return;
    }
 
-   char szFile[MAX_FILE_PATH_SIZE];
-   strcpy(szFile, FOLDER_LOGS);
-   strcat(szFile, LOG_FILE_SYSTEM);
-
-   char szFile2[MAX_FILE_PATH_SIZE];
-   strcpy(szFile2, FOLDER_LOGS);
-   strcat(szFile2, LOG_FILE_ERRORS);
-
-   FILE* fd = fopen(szFile, "a+");
-   FILE* fd2 = fopen(szFile2, "a+");
-   //int lock = flock(fileno(fd), LOCK_EX);
-   //int lock2 = flock(fileno(fd2), LOCK_EX);
- 
-   if ( 0 != s_szAdditionalLogFile[0] )
-   {
-      FILE* fdAux = fopen(s_szAdditionalLogFile, "a+");
-      if ( NULL != fdAux )
-      {
-         fprintf(fdAux, "%s %s: ", s_szTimeLog, sszComponentName);
-         fclose(fdAux);
-      }
-   }
-
-   if ( ! s_logDisabledStdout )
-      printf("%s %s: ERROR: ", s_szTimeLog, sszComponentName);
-   if ( NULL != fd )
-     fprintf(fd, "%s %s: ERROR: ", s_szTimeLog, sszComponentName);  
-   if ( NULL != fd2 )
-     fprintf(fd2, "%s %s: ERROR: ", s_szTimeLog, sszComponentName);  
-
-   if ( 0 != s_szAdditionalLogFile[0] )
-   {
-      FILE* fdAux = fopen(s_szAdditionalLogFile, "a+");
-      if ( NULL != fdAux )
-      {
-         vfprintf(fdAux, format, args);
-         fclose(fdAux);
-      }
-   }
-
-   if ( ! s_logDisabledStdout )
-      vprintf(format, args);
-   if ( NULL != fd )
-      vfprintf(fd, format, args);
-   if ( NULL != fd2 )
-      vfprintf(fd2, format, args);
-
-   if ( 0 != s_szAdditionalLogFile[0] )
-   {
-      FILE* fdAux = fopen(s_szAdditionalLogFile, "a+");
-      if ( NULL != fdAux )
-      {
-         fprintf(fdAux, "\n");
-         fclose(fdAux);
-      }
-   }
-
-   if ( ! s_logDisabledStdout )
-      printf("\n");
-   if ( NULL != fd )
-     fprintf(fd, "\n");  
-   if ( NULL != fd2 )
-     fprintf(fd2, "\n");  
-
+   _log_output_line(LOG_TARGET_SYSTEM | LOG_TARGET_ERRORS, szTime, "ERROR: ", format, args);
    va_end(args);
-   //if ( 0 == lock )
-   //   flock(fileno(fd), LOCK_UN);
-   //if ( 0 == lock2 )
-   //   flock(fileno(fd2), LOCK_UN);
-
-   if ( NULL != fd )
-      fclose(fd);
-   if ( NULL != fd2 )
-      fclose(fd2);
 }
 
 void log_softerror_and_alarm(const char* format, ...)
@@ -1303,94 +1795,24 @@ void log_softerror_and_alarm(const char* format, ...)
    va_list args;
    va_start(args, format);
 
-   s_szTimeLog[0] = 0;
+   char szTime[64];
+   szTime[0] = 0;
    if ( s_logAddTime )
-      _log_format_time_mstens(s_szTimeLog);
+      _log_format_time_mstens(szTime);
 
    if ( _log_check_for_service_log_access() )
    {
       char szBuff[MAX_SERVICE_LOG_ENTRY_LENGTH];
       vsnprintf(szBuff, MAX_SERVICE_LOG_ENTRY_LENGTH-1, format, args);
       szBuff[MAX_SERVICE_LOG_ENTRY_LENGTH-1] = 0;
+      strcpy(s_szTimeLog, szTime);
       _log_service_entry_softerror(szBuff);
       va_end(args);
       return;
    }
 
-   char szFile[MAX_FILE_PATH_SIZE];
-   strcpy(szFile, FOLDER_LOGS);
-   strcat(szFile, LOG_FILE_SYSTEM);
-
-   char szFile2[MAX_FILE_PATH_SIZE];
-   strcpy(szFile2, FOLDER_LOGS);
-   strcat(szFile2, LOG_FILE_ERRORS_SOFT);
-
-   FILE* fd = fopen(szFile, "a+");
-   FILE* fd2 = fopen(szFile2, "a+");
-   //int lock = flock(fileno(fd), LOCK_EX);
-   //int lock2 = flock(fileno(fd2), LOCK_EX);
- 
-   if ( 0 != s_szAdditionalLogFile[0] )
-   {
-      FILE* fdAux = fopen(s_szAdditionalLogFile, "a+");
-      if ( NULL != fdAux )
-      {
-         fprintf(fdAux, "%s %s: ", s_szTimeLog, sszComponentName);
-         fclose(fdAux);
-      }
-   }
-
-   if ( ! s_logDisabledStdout )
-      printf("%s %s: SOFT_ERROR: ", s_szTimeLog, sszComponentName);
-   if ( NULL != fd )
-     fprintf(fd, "%s %s: SOFT_ERROR: ", s_szTimeLog, sszComponentName);  
-   if ( NULL != fd2 )
-     fprintf(fd2, "%s %s: SOFT_ERROR: ", s_szTimeLog, sszComponentName);  
-
-   if ( 0 != s_szAdditionalLogFile[0] )
-   {
-      FILE* fdAux = fopen(s_szAdditionalLogFile, "a+");
-      if ( NULL != fdAux )
-      {
-         vfprintf(fdAux, format, args);
-         fclose(fdAux);
-      }
-   }
-
-   if ( ! s_logDisabledStdout )
-      vprintf(format, args);
-   if ( NULL != fd )
-      vfprintf(fd, format, args);
-   if ( NULL != fd2 )
-      vfprintf(fd2, format, args);
-
-   if ( 0 != s_szAdditionalLogFile[0] )
-   {
-      FILE* fdAux = fopen(s_szAdditionalLogFile, "a+");
-      if ( NULL != fdAux )
-      {
-         fprintf(fdAux, "\n");  
-         fclose(fdAux);
-      }
-   }
-
-   if ( ! s_logDisabledStdout )
-      printf("\n");
-   if ( NULL != fd )
-     fprintf(fd, "\n");  
-   if ( NULL != fd2 )
-     fprintf(fd2, "\n");  
-
+   _log_output_line(LOG_TARGET_SYSTEM | LOG_TARGET_ERRORS_SOFT, szTime, "SOFT_ERROR: ", format, args);
    va_end(args);
-   //if ( 0 == lock )
-   //   flock(fileno(fd), LOCK_UN);
-   //if ( 0 == lock2 )
-   //   flock(fileno(fd2), LOCK_UN);
-
-   if ( NULL != fd )
-      fclose(fd);
-   if ( NULL != fd2 )
-      fclose(fd2);
 }
 
 
@@ -77,9 +77,18 @@ u32 revert_word(u32 input);
 void reset_counters(type_u32_couters* pCounters);
 
 u32 base_compute_crc32(u8 *buf, int length);
+// Continues a CRC32 over more data: base_update_crc32(base_compute_crc32(A), B) == base_compute_crc32(A+B). Start with 0.
+u32 base_update_crc32(u32 uCRC, u8* pBuffer, int iLength);
 u8 base_compute_crc8(u8* pBuffer, int iLength);
 int base_check_crc32(u8* pBuffer, int iLength);
 
+#define BASE_CRC32_IMPL_TABLE 0
+#define BASE_CRC32_IMPL_SLICE8 1
+#define BASE_CRC32_IMPL_HARDWARE 2
+// Returns 0 if the implementation is not supported on this CPU
+int base_crc32_select_implementation(int iImplementation);
+const char* base_crc32_get_implementation_name();
+
 void hardware_sleep_sec(u32 uSeconds);
 void hardware_sleep_ms(u32 miliSeconds);
 void hardware_sleep_micros(u32 microSeconds);
@@ -105,6 +114,9 @@ void log_disable_stdout();
 void log_enable_stdout();
 void log_only_errors();
 void log_enable_full();
+void log_enable_async_writes();
+void log_disable_async_writes();
+void log_flush();
 void log_format_time(u32 miliseconds, char* szOutTime);
 void log_line(const char* format, ...);
 void log_line_forced_to_file(const char* format, ...);
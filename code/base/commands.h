@@ -241,6 +241,20 @@ typedef struct
    u32 uSegmentSize; // must be less that max packet size minus all the headers. Last segment will probablly be smaller.
 } __attribute__((packed)) command_packet_upload_file_segment;
 
+// Windowed uploads: the segments are sent as one way commands and the vehicle answers each one
+// with this selective ack as the response extra data.
+#define UPLOAD_FILE_SEGMENT_ACK_FLAG_COMPLETE 0x01
+#define UPLOAD_FILE_SEGMENT_ACK_FLAG_FAILED 0x02
+
+typedef struct
+{
+   u32 uFileId;
+   u32 uSegmentIndex; // the segment this ack answers
+   u32 uNextMissingSegment; // all segments before it were received
+   u32 uReceivedMask; // bit i: segment uNextMissingSegment+1+i was received
+   u8 uFlags;
+} __attribute__((packed)) command_packet_upload_file_segment_ack;
+
 
 #define COMMAND_ID_UPLOAD_SW_TO_VEHICLE63 209
 typedef struct
@@ -252,6 +266,43 @@ typedef struct
    int block_length; // total_size and block_length are zero to cancel an upload
 } __attribute__((packed)) command_packet_sw_package;
 
+// Software update archive sent as FEC protected generations (see base/sw_upload_fec.h)
+// command_param: one of SW_UPLOAD_FEC_PARAM_*
+// Blocks are sent as one way commands; status requests get a command_packet_sw_package_fec_status response
+#define COMMAND_ID_UPLOAD_SW_TO_VEHICLE_FEC 214
+
+#define SW_UPLOAD_FEC_PARAM_BLOCK 0 // command_packet_sw_package_fec, then the block
+#define SW_UPLOAD_FEC_PARAM_STATUS 1 // command_packet_sw_package_fec only
+#define SW_UPLOAD_FEC_PARAM_CANCEL 2 // command_packet_sw_package_fec only
+
+typedef struct
+{
+   u32 uTransferId;
+   u8 uType; // 0: update zip, 1: generated tar file from controller
+   u32 uTotalSize;
+   u32 uArchiveCRC;
+   u16 uBlockSize;
+   u8 uGenerationDataBlocks;
+   u32 uGenerationIndex;
+   u32 uGenerationCRC; // of the archive bytes in this generation
+   u8 uBlockIndex; // 0...uGenerationDataBlocks-1: data blocks, then EC blocks
+} __attribute__((packed)) command_packet_sw_package_fec;
+
+#define SW_UPLOAD_FEC_STATUS_FLAG_COMPLETE 0x01 // archive received and verified
+#define SW_UPLOAD_FEC_STATUS_FLAG_FAILED 0x02
+#define SW_UPLOAD_FEC_STATUS_MAX_GENERATIONS 64
+
+typedef struct
+{
+   u32 uTransferId;
+   u8 uFlags;
+   u32 uGenerationsComplete;
+   u32 uBlocksReceived; // all the blocks received for this transfer, including not needed ones
+   u8 uCountGenerations; // incomplete generations listed below (the first ones)
+   u32 uGenerationIndex[SW_UPLOAD_FEC_STATUS_MAX_GENERATIONS];
+   u8 uBlocksNeeded[SW_UPLOAD_FEC_STATUS_MAX_GENERATIONS];
+} __attribute__((packed)) command_packet_sw_package_fec_status;
+
 
 #define COMMAND_ID_DOWNLOAD_FILE 211 // has as param the ID of the file to download (high bit: request just status); has a response info about the file: t_packet_header_download_file_info
 
@@ -87,6 +87,7 @@
 
 #define DEFAULT_USE_PPCAP_FOR_TX 0
 #define DEFAULT_BYPASS_SOCKET_BUFFERS 1
+#define DEFAULT_USE_RX_RING 0
 #define DEFAULT_RADIO_TX_POWER_CONTROLLER 20
 #define DEFAULT_RADIO_TX_POWER 20
 #define DEFAULT_RADIO_SIK_TX_POWER 11
@@ -133,6 +134,7 @@
 #define RAW_TELEMETRY_MAX_BUFFER 512  // bytes
 #define RAW_TELEMETRY_SEND_TIMEOUT 200 // miliseconds. how much to wait until to send whatever is in a telemetry serial buffer to the radio
 #define RAW_TELEMETRY_MIN_SEND_LENGTH 255 // minimum data length to send right away to radio
+#define RAW_TELEMETRY_FRAME_FLUSH_MS 2 // miliseconds. once the telemetry serial buffer ends on a complete MAVLink/LTM frame, send it when its oldest byte waited this long (merges back to back frames)
 
 #define AUXILIARY_DATA_LINK_SEND_TIMEOUT 100 // miliseconds. how much to wait until to send whatever is in a data link serial buffer to the radio
 #define AUXILIARY_DATA_LINK_MIN_SEND_LENGTH 255 // minimum data length to send right away to radio
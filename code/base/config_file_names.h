@@ -11,6 +11,8 @@
 #define LOG_FILE_COMMANDS "log_commands.txt"
 #define LOG_FILE_WATCHDOG "log_watchdog.txt"
 #define LOG_FILE_VIDEO "log_video.txt"
+#define LOG_FILE_VIDEO_TRACE "log_video_trace.txt"
+#define LOG_FILE_ADAPTIVE_VIDEO_TRACE "log_adaptive_video_trace.txt"
 #define LOG_FILE_CAPTURE_VEYE "log_capture_veye.txt"
 #define LOG_FILE_VEHICLE "log_vehicle_%s.txt"
 
@@ -18,6 +20,8 @@
 #define FILE_FORMAT_VIDEO_INFO "video-%s-%d-%d-%d.info"
 
 #define LOG_USE_PROCESS "use_log_process"
+#define LOG_ASYNC_MEMORY_ONLY "log_memory_only"
+#define FILE_CONFIG_IPC_USE_SHM_RINGS "ipc_use_shm_rings"
 #define CONFIG_FILENAME_DEBUG "debug"
 #define FILE_INFO_VERSION "version_ruby_base.txt"
 #define FILE_INFO_SHORT_LAST_UPDATE "ruby_update.log"
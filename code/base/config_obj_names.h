@@ -16,9 +16,8 @@
 #define SEMAPHORE_VIDEO_STREAMER_OVERLOAD "RUBY_SEM_VIDEO_STREAMER_OVERLOAD"
 
 #define SEMAPHORE_STOP_RX_RC "RUBY_SEM_STOP_RX_RC"
-
-#define RUBY_SEM_RX_RADIO_HIGH_PRIORITY "RUBY_SEM_RX_RADIO_HIGH_PRIORITY"
-#define RUBY_SEM_RX_RADIO_REG_PRIORITY "RUBY_SEM_RX_RADIO_REG_PRIORITY"
+// One byte is written to it for each RC frame received on the vehicle, to wake up the telemetry process that outputs it to the FC
+#define FIFO_RUBY_RC_FRAMES_NOTIFY "/tmp/ruby/fiforcframes"
 
 #define SEMAPHORE_SM_VIDEO_DATA_AVAILABLE "RUBY_SEM_SM_VIDEO_DATA_AVAILABLE"
 #define SEMAPHORE_MPP_DISPLAY_FRAME_READY "RUBY_SEM_MPP_DISPLAY_FRAME_READY"
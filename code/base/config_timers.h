@@ -3,6 +3,9 @@
 #define DEFAULT_MAX_LOOP_TIME_MILISECONDS 30
 #define DEFAULT_MAX_RX_LOOP_TIMEOUT_MILISECONDS 49
 #define DEFAULT_MAX_RX_LOOP_TIMEOUT_MILISECONDS_VEHICLE 60
+#define DEFAULT_VEHICLE_ROUTER_USE_EVENT_LOOP 1
+#define DEFAULT_CONTROLLER_ROUTER_USE_EVENT_LOOP 1
+#define DEFAULT_CONTROLLER_ROUTER_LOOP_TICK_MICROSEC 2000
 
 #define DEFAULT_DELAY_WIFI_CHANGE 60
 
@@ -10,6 +10,7 @@
 #define DEFAULT_VIDEO_END_FRAME_DETECTION_TIMEOUT 5
 #define DEFAULT_MINIMUM_OK_INTERVAL_MS_TO_SWITCH_VIDEO_PROFILE_UP 1500
 #define DEFAULT_VIDEO_PARAMS_ADJUSTMENT_STRENGTH 5
+#define DEFAULT_ADAPTIVE_VIDEO_CONTROLLER 0 // 0 - thresholds, 1 - link model
 #define DEFAULT_MINIMUM_INTERVALS_FOR_VIDEO_LINK_ADJUSTMENT 3
 #define DEFAULT_CONTROLLER_LINK_MILISECONDS_TIMEOUT_TO_DISABLE_RETRANSMISSIONS 3000
 
@@ -115,6 +115,11 @@ void reset_ControllerSettings()
    s_CtrlSettings.iStreamerOutputMode = 0;
    s_CtrlSettings.iVideoMPPBuffersSize = DEFAULT_MPP_BUFFERS_SIZE;
    s_CtrlSettings.iHDMIVSync = 1;
+   s_CtrlSettings.iVideoRxFECWorkers = -1;
+   s_CtrlSettings.iRadioRxUsesRing = DEFAULT_USE_RX_RING;
+   s_CtrlSettings.iRouterUseEventLoop = DEFAULT_CONTROLLER_ROUTER_USE_EVENT_LOOP;
+   s_CtrlSettings.iRouterPinRxOutputCores = 0;
+   s_CtrlSettings.iAdaptiveVideoController = DEFAULT_ADAPTIVE_VIDEO_CONTROLLER;
    if ( s_CtrlSettingsLoaded )
       log_line("Reseted controller settings.");
 }
@@ -170,6 +175,10 @@ int save_ControllerSettings()
    fprintf(fd, "%d %d\n", s_CtrlSettings.iCoresAdjustment, s_CtrlSettings.iPrioritiesAdjustment);
    fprintf(fd, "%d %d\n", s_CtrlSettings.iStreamerOutputMode, s_CtrlSettings.iVideoMPPBuffersSize);
    fprintf(fd, "%d\n", s_CtrlSettings.iHDMIVSync);
+   fprintf(fd, "%d\n", s_CtrlSettings.iVideoRxFECWorkers);
+   fprintf(fd, "%d\n", s_CtrlSettings.iRadioRxUsesRing);
+   fprintf(fd, "%d %d\n", s_CtrlSettings.iRouterUseEventLoop, s_CtrlSettings.iRouterPinRxOutputCores);
+   fprintf(fd, "%d\n", s_CtrlSettings.iAdaptiveVideoController);
    fclose(fd);
 
    log_line("Saved controller settings to file: %s", szFile);
@@ -304,6 +313,31 @@ int load_ControllerSettings()
       s_CtrlSettings.iHDMIVSync = 1;
       iWriteOptionalValues = 1;
    }
+
+   if ( 1 != fscanf(fd, "%d", &s_CtrlSettings.iVideoRxFECWorkers) )
+   {
+      s_CtrlSettings.iVideoRxFECWorkers = -1;
+      iWriteOptionalValues = 1;
+   }
+
+   if ( 1 != fscanf(fd, "%d", &s_CtrlSettings.iRadioRxUsesRing) )
+   {
+      s_CtrlSettings.iRadioRxUsesRing = DEFAULT_USE_RX_RING;
+      iWriteOptionalValues = 1;
+   }
+
+   if ( 2 != fscanf(fd, "%d %d", &s_CtrlSettings.iRouterUseEventLoop, &s_CtrlSettings.iRouterPinRxOutputCores) )
+   {
+      s_CtrlSettings.iRouterUseEventLoop = DEFAULT_CONTROLLER_ROUTER_USE_EVENT_LOOP;
+      s_CtrlSettings.iRouterPinRxOutputCores = 0;
+      iWriteOptionalValues = 1;
+   }
+
+   if ( 1 != fscanf(fd, "%d", &s_CtrlSettings.iAdaptiveVideoController) )
+   {
+      s_CtrlSettings.iAdaptiveVideoController = DEFAULT_ADAPTIVE_VIDEO_CONTROLLER;
+      iWriteOptionalValues = 1;
+   }
    fclose(fd);
 
    //--------------------------------------------------------
@@ -346,6 +380,16 @@ int load_ControllerSettings()
 
    if ( (s_CtrlSettings.iHDMIVSync != 0) && (s_CtrlSettings.iHDMIVSync != 1) )
       s_CtrlSettings.iHDMIVSync = 1;
+   if ( (s_CtrlSettings.iVideoRxFECWorkers < -1) || (s_CtrlSettings.iVideoRxFECWorkers > 4) )
+      s_CtrlSettings.iVideoRxFECWorkers = -1;
+   if ( (s_CtrlSettings.iRadioRxUsesRing != 0) && (s_CtrlSettings.iRadioRxUsesRing != 1) )
+      s_CtrlSettings.iRadioRxUsesRing = DEFAULT_USE_RX_RING;
+   if ( (s_CtrlSettings.iRouterUseEventLoop != 0) && (s_CtrlSettings.iRouterUseEventLoop != 1) )
+      s_CtrlSettings.iRouterUseEventLoop = DEFAULT_CONTROLLER_ROUTER_USE_EVENT_LOOP;
+   if ( (s_CtrlSettings.iRouterPinRxOutputCores != 0) && (s_CtrlSettings.iRouterPinRxOutputCores != 1) )
+      s_CtrlSettings.iRouterPinRxOutputCores = 0;
+   if ( (s_CtrlSettings.iAdaptiveVideoController != 0) && (s_CtrlSettings.iAdaptiveVideoController != 1) )
+      s_CtrlSettings.iAdaptiveVideoController = DEFAULT_ADAPTIVE_VIDEO_CONTROLLER;
    if ( failed )
    {
       log_line("Invalid settings file %s, error code: %d. Reseted to default.", szFile, failed);
@@ -78,6 +78,11 @@ typedef struct
    int iStreamerOutputMode; // 0 - sm, 1 - pipe, 2 - udp
    int iVideoMPPBuffersSize;
    int iHDMIVSync;
+   int iVideoRxFECWorkers; // -1 - auto (by CPU cores count), 0 - decode inline on router thread, n - worker threads
+   int iRadioRxUsesRing; // 1 - read wifi radio interfaces using a mmap packet ring instead of pcap
+   int iRouterUseEventLoop; // 1 - router main loop waits on radio rx/streamer output/timer events instead of polling
+   int iRouterPinRxOutputCores; // 1 - pin the router radio rx thread and the router main (video output) thread to separate CPU cores
+   int iAdaptiveVideoController; // 0 - thresholds, 1 - link model (see r_station/adaptive_video_controller.h)
 } ControllerSettings;
 
 int save_ControllerSettings();
@@ -35,12 +35,41 @@
 #include "encr.h"
 #include "../radio/radiopackets2.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 #define ENC_BLOCK_SIZE 8
 #define ENC_KEY_INIT_SEED 23
 
+// Pass phrase repeated over a whole packet, so that packets are XOR-ed 16 bytes at a time
+// instead of one byte and one modulo at a time. Built when the pass phrase is set (lpp, spp, upp, rpp),
+// never on the encrypt/decrypt path, which runs on the radio rx and tx threads at the same time.
+#define ENC_KEYSTREAM_SIZE (MAX_PACKET_TOTAL_SIZE + 2*MAX_PASS_LENGTH)
+
 u8 s_epp[MAX_PASS_LENGTH+1];
 u8 s_eppl = 0;
 
+static u8 s_uKeyStream[ENC_KEYSTREAM_SIZE] __attribute__((aligned(16)));
+static int s_iKeyStreamPassLength = 0;
+// Keystream length, multiple of the pass phrase length; 0 while the keystream is not valid.
+// Published after the keystream is filled in.
+static int s_iKeyStreamLength = 0;
+
+static void _build_keystream()
+{
+   __atomic_store_n(&s_iKeyStreamLength, 0, __ATOMIC_RELEASE);
+   s_iKeyStreamPassLength = s_eppl;
+   if ( (0 == s_eppl) || (s_eppl > MAX_PASS_LENGTH) )
+      return;
+   int iLength = (ENC_KEYSTREAM_SIZE / s_eppl) * s_eppl;
+   for( int i=0; i<iLength; i++ )
+      s_uKeyStream[i] = s_epp[i % s_eppl];
+   __atomic_store_n(&s_iKeyStreamLength, iLength, __ATOMIC_RELEASE);
+}
+
 int lpp(char* szOutputBuffer, int maxLength)
 {
    char szFile[128];
@@ -91,6 +120,7 @@ int lpp(char* szOutputBuffer, int maxLength)
    s_eppl = pos;
    strncpy((char*)s_epp, szBuffer, MAX_PASS_LENGTH);
    s_epp[MAX_PASS_LENGTH] = 0;
+   _build_keystream();
 
    if ( NULL != szOutputBuffer )
       strncpy(szOutputBuffer, szBuffer, maxLength);
@@ -113,6 +143,7 @@ int spp(char* szBuffer)
    s_eppl = strlen(szBuffer);
    strncpy((char*)s_epp, szBuffer, MAX_PASS_LENGTH);
    s_epp[MAX_PASS_LENGTH] = 0;
+   _build_keystream();
 
    u8 sBlockSeed[ENC_BLOCK_SIZE];
    u8 sBlockInput[ENC_BLOCK_SIZE];
@@ -165,6 +196,7 @@ void rpp()
 {
    s_eppl = 0;
    s_epp[0] = 0;
+   _build_keystream();
 }
 
 u8* gpp(int* pLen)
@@ -181,6 +213,67 @@ int hpp()
    return 0;
 }
 
+static void _xor_buffer(u8* pData, const u8* pKey, int len)
+{
+   int pos = 0;
+   #if defined(__SSE2__)
+   for( ; pos + 16 <= len; pos += 16 )
+   {
+      __m128i d = _mm_loadu_si128((const __m128i*)(pData + pos));
+      __m128i k = _mm_loadu_si128((const __m128i*)(pKey + pos));
+      _mm_storeu_si128((__m128i*)(pData + pos), _mm_xor_si128(d, k));
+   }
+   #elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+   for( ; pos + 16 <= len; pos += 16 )
+      vst1q_u8(pData + pos, veorq_u8(vld1q_u8(pData + pos), vld1q_u8(pKey + pos)));
+   #endif
+   for( ; pos + 8 <= len; pos += 8 )
+   {
+      uint64_t d, k;
+      memcpy(&d, pData + pos, 8);
+      memcpy(&k, pKey + pos, 8);
+      d ^= k;
+      memcpy(pData + pos, &d, 8);
+   }
+   for( ; pos < len; pos++ )
+      pData[pos] ^= pKey[pos];
+}
+
+// Same result as XOR-ing each byte with s_epp[pos % s_eppl]. Only reads the keystream.
+
+static void _xor_with_pass(u8* pData, int len)
+{
+   int iKeyStreamLength = __atomic_load_n(&s_iKeyStreamLength, __ATOMIC_ACQUIRE);
+   if ( (0 == iKeyStreamLength) || (s_iKeyStreamPassLength != s_eppl) )
+   {
+      for(int pos=0; pos < len; pos++ )
+         pData[pos] ^= s_epp[pos%s_eppl];
+      return;
+   }
+
+   // The keystream length is a multiple of the pass length, so each chunk starts at pass offset 0
+   while ( len > 0 )
+   {
+      int iChunk = (len < iKeyStreamLength)?len:iKeyStreamLength;
+      _xor_buffer(pData, s_uKeyStream, iChunk);
+      pData += iChunk;
+      len -= iChunk;
+   }
+}
+
+// Uses a pass phrase in memory only, without saving it
+
+int upp(const u8* pPass, int iLength)
+{
+   if ( (NULL == pPass) || (iLength <= 0) || (iLength > MAX_PASS_LENGTH) )
+      return 0;
+   memcpy(s_epp, pPass, iLength);
+   s_epp[iLength] = 0;
+   s_eppl = iLength;
+   _build_keystream();
+   return 1;
+}
+
 int epp(u8* pData, int len)
 {
    if ( NULL == pData || len <= 0 )
@@ -188,12 +281,7 @@ int epp(u8* pData, int len)
    if ( 0 == s_eppl )
       return 1;
 
-   for(int pos=0; pos < len; pos++ )
-   {
-      //*pData = (*pData)+1;
-      *pData = (*pData) ^ s_epp[pos%s_eppl];
-      pData++;
-   }
+   _xor_with_pass(pData, len);
    return 1;
 }
 
@@ -204,11 +292,6 @@ int dpp(u8* pData, int len)
    if ( 0 == s_eppl )
       return 1;
 
-   for(int pos=0; pos < len; pos++ )
-   {
-      //*pData = (*pData)-1;
-      *pData = (*pData) ^ s_epp[pos%s_eppl];
-      pData++;
-   }
+   _xor_with_pass(pData, len);
    return 1;
 }
@@ -18,6 +18,7 @@ int spp(char* szBuffer);
 void rpp();
 u8* gpp(int* pLen);
 int hpp();
+int upp(const u8* pPass, int iLength);
 
 int epp(u8* pData, int len);
 int dpp(u8* pData, int len);
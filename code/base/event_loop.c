@@ -0,0 +1,252 @@
+/*
+    Ruby Licence
+    Copyright (c) 2025 Petru Soroaga
+    All rights reserved.
+
+    Redistribution and/or use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions and/or use of the source code (partially or complete) must retain
+        the above copyright notice, this list of conditions and the following disclaimer
+        in the documentation and/or other materials provided with the distribution.
+        * Redistributions in binary form (partially or complete) must reproduce
+        the above copyright notice, this list of conditions and the following disclaimer
+        in the documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permitted.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "base.h"
+#include "event_loop.h"
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+int event_loop_init(type_event_loop* pLoop)
+{
+   if ( NULL == pLoop )
+      return 0;
+   memset(pLoop, 0, sizeof(type_event_loop));
+   pLoop->iEpollFd = epoll_create1(EPOLL_CLOEXEC);
+   if ( pLoop->iEpollFd < 0 )
+   {
+      log_softerror_and_alarm("[EventLoop] Failed to create epoll fd, error: %d (%s)", errno, strerror(errno));
+      return 0;
+   }
+   pLoop->uTimeStatsStart = get_current_timestamp_ms();
+   return 1;
+}
+
+void event_loop_close(type_event_loop* pLoop)
+{
+   if ( NULL == pLoop )
+      return;
+   for( int i=0; i<pLoop->iSourcesCount; i++ )
+   {
+      if ( pLoop->sources[i].iOwnsFd && (pLoop->sources[i].iFd >= 0) )
+         close(pLoop->sources[i].iFd);
+      pLoop->sources[i].iFd = -1;
+   }
+   if ( pLoop->iEpollFd >= 0 )
+      close(pLoop->iEpollFd);
+   pLoop->iEpollFd = -1;
+   pLoop->iSourcesCount = 0;
+}
+
+static int _event_loop_register_fd(type_event_loop* pLoop, int iSourceId, int iFd)
+{
+   struct epoll_event ev;
+   memset(&ev, 0, sizeof(ev));
+   ev.events = EPOLLIN;
+   if ( pLoop->sources[iSourceId].uFlags & EVENT_LOOP_SOURCE_FLAG_WRITE )
+      ev.events = EPOLLOUT;
+   ev.data.u32 = (u32)iSourceId;
+   if ( 0 != epoll_ctl(pLoop->iEpollFd, EPOLL_CTL_ADD, iFd, &ev) )
+   {
+      log_softerror_and_alarm("[EventLoop] Failed to add fd %d for source %s, error: %d (%s)", iFd, pLoop->sources[iSourceId].szName, errno, strerror(errno));
+      return 0;
+   }
+   return 1;
+}
+
+int event_loop_add_source(type_event_loop* pLoop, const char* szName, int iFd, u32 uFlags)
+{
+   if ( (NULL == pLoop) || (pLoop->iEpollFd < 0) || (pLoop->iSourcesCount >= EVENT_LOOP_MAX_SOURCES) )
+      return -1;
+
+   int iSourceId = pLoop->iSourcesCount;
+   type_event_loop_source* pSource = &pLoop->sources[iSourceId];
+   memset(pSource, 0, sizeof(type_event_loop_source));
+   strncpy(pSource->szName, (NULL != szName)?szName:"N/A", sizeof(pSource->szName)-1);
+   pSource->iFd = -1;
+   pSource->uFlags = uFlags;
+   pLoop->iSourcesCount++;
+
+   if ( iFd >= 0 )
+   if ( _event_loop_register_fd(pLoop, iSourceId, iFd) )
+      pSource->iFd = iFd;
+   log_line("[EventLoop] Added source %d: %s, fd: %d", iSourceId, pSource->szName, pSource->iFd);
+   return iSourceId;
+}
+
+int event_loop_add_timer_source(type_event_loop* pLoop, const char* szName, u32 uIntervalMicroSec)
+{
+   int iFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+   if ( iFd < 0 )
+   {
+      log_softerror_and_alarm("[EventLoop] Failed to create timer for source %s, error: %d (%s)", szName, errno, strerror(errno));
+      return -1;
+   }
+   struct itimerspec its;
+   memset(&its, 0, sizeof(its));
+   its.it_interval.tv_sec = uIntervalMicroSec / 1000000;
+   its.it_interval.tv_nsec = (uIntervalMicroSec % 1000000) * 1000;
+   its.it_value = its.it_interval;
+   if ( 0 != timerfd_settime(iFd, 0, &its, NULL) )
+   {
+      log_softerror_and_alarm("[EventLoop] Failed to set timer for source %s, error: %d (%s)", szName, errno, strerror(errno));
+      close(iFd);
+      return -1;
+   }
+   int iSourceId = event_loop_add_source(pLoop, szName, iFd, EVENT_LOOP_SOURCE_FLAG_READ_COUNTER);
+   if ( iSourceId < 0 )
+   {
+      close(iFd);
+      return -1;
+   }
+   pLoop->sources[iSourceId].iOwnsFd = 1;
+   return iSourceId;
+}
+
+int event_loop_set_source_fd(type_event_loop* pLoop, int iSourceId, int iFd)
+{
+   if ( (NULL == pLoop) || (iSourceId < 0) || (iSourceId >= pLoop->iSourcesCount) )
+      return 0;
+   type_event_loop_source* pSource = &pLoop->sources[iSourceId];
+   if ( pSource->iFd == iFd )
+      return 1;
+
+   // A closed fd is removed from the epoll set by the kernel, so errors here are expected
+   if ( pSource->iFd >= 0 )
+      epoll_ctl(pLoop->iEpollFd, EPOLL_CTL_DEL, pSource->iFd, NULL);
+   pSource->iFd = -1;
+   pSource->iIsReady = 0;
+   if ( iFd < 0 )
+      return 1;
+   if ( ! _event_loop_register_fd(pLoop, iSourceId, iFd) )
+      return 0;
+   pSource->iFd = iFd;
+   log_line("[EventLoop] Source %s uses now fd %d", pSource->szName, iFd);
+   return 1;
+}
+
+int event_loop_wait(type_event_loop* pLoop, int iTimeoutMs)
+{
+   if ( (NULL == pLoop) || (pLoop->iEpollFd < 0) )
+      return -1;
+
+   for( int i=0; i<pLoop->iSourcesCount; i++ )
+      pLoop->sources[i].iIsReady = 0;
+
+   if ( iTimeoutMs <= 0 )
+   {
+      iTimeoutMs = 0;
+      pLoop->uCountNoWaits++;
+   }
+   else
+      pLoop->uCountWaits++;
+
+   struct epoll_event events[EVENT_LOOP_MAX_SOURCES];
+   int iCount = epoll_wait(pLoop->iEpollFd, events, EVENT_LOOP_MAX_SOURCES, iTimeoutMs);
+   if ( iCount < 0 )
+   {
+      if ( errno == EINTR )
+         return 0;
+      log_softerror_and_alarm("[EventLoop] Failed to wait for events, error: %d (%s)", errno, strerror(errno));
+      return -1;
+   }
+   if ( 0 == iCount )
+   {
+      if ( iTimeoutMs > 0 )
+         pLoop->uCountTimeouts++;
+      return 0;
+   }
+
+   for( int i=0; i<iCount; i++ )
+   {
+      int iSourceId = (int)events[i].data.u32;
+      if ( (iSourceId < 0) || (iSourceId >= pLoop->iSourcesCount) )
+         continue;
+      type_event_loop_source* pSource = &pLoop->sources[iSourceId];
+      pSource->iIsReady = 1;
+      pSource->uCountWakeups++;
+      if ( (pSource->uFlags & EVENT_LOOP_SOURCE_FLAG_READ_COUNTER) && (pSource->iFd >= 0) )
+      {
+         uint64_t uValue = 0;
+         if ( read(pSource->iFd, &uValue, sizeof(uValue)) < 0 )
+         if ( errno != EAGAIN )
+            log_softerror_and_alarm("[EventLoop] Failed to read counter of source %s, error: %d (%s)", pSource->szName, errno, strerror(errno));
+      }
+   }
+   return iCount;
+}
+
+int event_loop_source_is_ready(type_event_loop* pLoop, int iSourceId)
+{
+   if ( (NULL == pLoop) || (iSourceId < 0) || (iSourceId >= pLoop->iSourcesCount) )
+      return 0;
+   return pLoop->sources[iSourceId].iIsReady;
+}
+
+void event_loop_on_source_processed(type_event_loop* pLoop, int iSourceId, int iCountItems, int iBudget)
+{
+   if ( (NULL == pLoop) || (iSourceId < 0) || (iSourceId >= pLoop->iSourcesCount) || (iCountItems <= 0) )
+      return;
+   type_event_loop_source* pSource = &pLoop->sources[iSourceId];
+   pSource->uCountItems += (u32)iCountItems;
+   if ( (u32)iCountItems > pSource->uMaxItemsPerWakeup )
+      pSource->uMaxItemsPerWakeup = (u32)iCountItems;
+   if ( (iBudget > 0) && (iCountItems >= iBudget) )
+      pSource->uCountBudgetExhausted++;
+}
+
+void event_loop_log_and_reset_stats(type_event_loop* pLoop, const char* szLoopName)
+{
+   if ( NULL == pLoop )
+      return;
+   u32 uTimeNow = get_current_timestamp_ms();
+   u32 uDuration = uTimeNow - pLoop->uTimeStatsStart;
+   if ( 0 == uDuration )
+      uDuration = 1;
+
+   log_line("[EventLoop] %s stats for last %u ms: %u waits (%u/sec), %u timeouts, %u loops without wait:",
+      szLoopName, uDuration, pLoop->uCountWaits, (pLoop->uCountWaits*1000)/uDuration, pLoop->uCountTimeouts, pLoop->uCountNoWaits);
+   for( int i=0; i<pLoop->iSourcesCount; i++ )
+   {
+      type_event_loop_source* pSource = &pLoop->sources[i];
+      log_line("[EventLoop]   %s: %u wakeups, %u items (max %u at once), budget exhausted %u times",
+         pSource->szName, pSource->uCountWakeups, pSource->uCountItems, pSource->uMaxItemsPerWakeup, pSource->uCountBudgetExhausted);
+      pSource->uCountWakeups = 0;
+      pSource->uCountItems = 0;
+      pSource->uCountBudgetExhausted = 0;
+      pSource->uMaxItemsPerWakeup = 0;
+   }
+   pLoop->uCountWaits = 0;
+   pLoop->uCountTimeouts = 0;
+   pLoop->uCountNoWaits = 0;
+   pLoop->uTimeStatsStart = uTimeNow;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "base.h"
+
+// Wait set (epoll) over the sources a processing loop reacts to: file descriptors
+// (sockets, pipes, eventfds) and periodic timers (timerfd).
+// The loop waits until any source is ready, then checks each source in its own priority
+// order. Each source keeps counters of how often it woke up the loop, how many items were
+// processed and how many times the processing stopped because the per wakeup budget ran out.
+
+#define EVENT_LOOP_MAX_SOURCES 16
+
+// The source counter (eventfd/timerfd) is read (reset) by the event loop after the wait
+#define EVENT_LOOP_SOURCE_FLAG_READ_COUNTER 0x01
+// The source is ready when its fd can be written to (i.e. output pipes with pending data)
+#define EVENT_LOOP_SOURCE_FLAG_WRITE 0x02
+
+typedef struct
+{
+   char szName[24];
+   int iFd;
+   u32 uFlags;
+   int iIsReady;
+   int iOwnsFd;
+
+   u32 uCountWakeups;
+   u32 uCountItems;
+   u32 uCountBudgetExhausted;
+   u32 uMaxItemsPerWakeup;
+} type_event_loop_source;
+
+typedef struct
+{
+   int iEpollFd;
+   int iSourcesCount;
+   type_event_loop_source sources[EVENT_LOOP_MAX_SOURCES];
+
+   u32 uCountWaits;
+   u32 uCountTimeouts;
+   u32 uCountNoWaits;
+   u32 uTimeStatsStart;
+} type_event_loop;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns 1 on success, 0 on failure
+int event_loop_init(type_event_loop* pLoop);
+void event_loop_close(type_event_loop* pLoop);
+
+// Returns the source id, or -1 on error. The fd can be -1 for sources that have no fd yet
+// (or never have one, just to keep the processing counters)
+int event_loop_add_source(type_event_loop* pLoop, const char* szName, int iFd, u32 uFlags);
+// Periodic timer source, in microseconds
+int event_loop_add_timer_source(type_event_loop* pLoop, const char* szName, u32 uIntervalMicroSec);
+// Changes (or removes, with -1) the fd of a source. Does nothing if the fd did not change.
+int event_loop_set_source_fd(type_event_loop* pLoop, int iSourceId, int iFd);
+
+// Returns the number of ready sources, 0 on timeout, -1 on error
+int event_loop_wait(type_event_loop* pLoop, int iTimeoutMs);
+int event_loop_source_is_ready(type_event_loop* pLoop, int iSourceId);
+void event_loop_on_source_processed(type_event_loop* pLoop, int iSourceId, int iCountItems, int iBudget);
+
+void event_loop_log_and_reset_stats(type_event_loop* pLoop, const char* szLoopName);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,459 @@
+/*
+    Ruby Licence
+    Copyright (c) 2025 Petru Soroaga
+    All rights reserved.
+
+    Redistribution and/or use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions and/or use of the source code (partially or complete) must retain
+        the above copyright notice, this list of conditions and the following disclaimer
+        in the documentation and/or other materials provided with the distribution.
+        * Redistributions in binary form (partially or complete) must reproduce
+        the above copyright notice, this list of conditions and the following disclaimer
+        in the documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permitted.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "base.h"
+#include "file_upload.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+static void _file_upload_sender_update_rtt(type_file_upload_sender* pSender, u32 uRTTMs)
+{
+   if ( (! pSender->bHasRTT) || (uRTTMs < pSender->uMinRTTMs) )
+      pSender->uMinRTTMs = uRTTMs;
+   if ( ! pSender->bHasRTT )
+   {
+      pSender->uSRTTMs = uRTTMs;
+      pSender->uRTTVarMs = uRTTMs/2;
+      pSender->bHasRTT = true;
+   }
+   else
+   {
+      u32 uDelta = (pSender->uSRTTMs > uRTTMs)?(pSender->uSRTTMs - uRTTMs):(uRTTMs - pSender->uSRTTMs);
+      pSender->uRTTVarMs = (3*pSender->uRTTVarMs + uDelta)/4;
+      pSender->uSRTTMs = (7*pSender->uSRTTMs + uRTTMs)/8;
+   }
+   u32 uVar = 4*pSender->uRTTVarMs;
+   if ( uVar < 20 )
+      uVar = 20;
+   pSender->uRTOMs = pSender->uSRTTMs + uVar;
+   if ( pSender->uRTOMs < FILE_UPLOAD_MIN_RTO_MS )
+      pSender->uRTOMs = FILE_UPLOAD_MIN_RTO_MS;
+   if ( pSender->uRTOMs > FILE_UPLOAD_MAX_RTO_MS )
+      pSender->uRTOMs = FILE_UPLOAD_MAX_RTO_MS;
+}
+
+// Called for each newly acked segment: about one segment more (or less) per round trip
+
+static void _file_upload_sender_update_window(type_file_upload_sender* pSender)
+{
+   float fQueued = 0.0;
+   if ( pSender->bHasRTT && (pSender->uSRTTMs > pSender->uMinRTTMs) )
+      fQueued = pSender->fWindow * (float)(pSender->uSRTTMs - pSender->uMinRTTMs) / (float)pSender->uSRTTMs;
+
+   if ( pSender->bSlowStart )
+   {
+      if ( fQueued > FILE_UPLOAD_QUEUED_HIGH )
+         pSender->bSlowStart = false;
+      else
+         pSender->fWindow += 1.0;
+   }
+   else if ( fQueued < FILE_UPLOAD_QUEUED_LOW )
+      pSender->fWindow += 1.0/pSender->fWindow;
+   else if ( fQueued > FILE_UPLOAD_QUEUED_HIGH )
+      pSender->fWindow -= 1.0/pSender->fWindow;
+
+   if ( pSender->fWindow < FILE_UPLOAD_MIN_WINDOW )
+      pSender->fWindow = FILE_UPLOAD_MIN_WINDOW;
+   if ( pSender->fWindow > FILE_UPLOAD_MAX_WINDOW )
+      pSender->fWindow = FILE_UPLOAD_MAX_WINDOW;
+   if ( pSender->fWindow > pSender->fMaxWindow )
+      pSender->fMaxWindow = pSender->fWindow;
+}
+
+static void _file_upload_sender_set_lost(type_file_upload_sender* pSender, u32 uSegmentIndex)
+{
+   pSender->pSegments[uSegmentIndex].uState = FILE_UPLOAD_SEGMENT_LOST;
+   pSender->iInFlight--;
+}
+
+static void _file_upload_sender_set_acked(type_file_upload_sender* pSender, u32 uSegmentIndex)
+{
+   type_file_upload_segment* pSegment = &pSender->pSegments[uSegmentIndex];
+   if ( pSegment->uState == FILE_UPLOAD_SEGMENT_ACKED )
+      return;
+   if ( pSegment->uState == FILE_UPLOAD_SEGMENT_IN_FLIGHT )
+      pSender->iInFlight--;
+   pSegment->uState = FILE_UPLOAD_SEGMENT_ACKED;
+   pSender->uCountAcked++;
+   _file_upload_sender_update_window(pSender);
+}
+
+static void _file_upload_sender_check_timeouts(type_file_upload_sender* pSender, u32 uTimeNow)
+{
+   u32 uMaxTimedOutSendSeq = 0;
+   for( u32 u=pSender->uFirstNotAcked; u<pSender->uFirstNotSent; u++ )
+   {
+      if ( pSender->pSegments[u].uState != FILE_UPLOAD_SEGMENT_IN_FLIGHT )
+         continue;
+      if ( uTimeNow < pSender->pSegments[u].uSendTime + pSender->uRTOMs )
+         continue;
+      _file_upload_sender_set_lost(pSender, u);
+      pSender->uCountTimeouts++;
+      if ( pSender->pSegments[u].uSendSeq > uMaxTimedOutSendSeq )
+         uMaxTimedOutSendSeq = pSender->pSegments[u].uSendSeq;
+   }
+
+   // Back off once per flight of segments (not for each segment that timed out)
+   if ( uMaxTimedOutSendSeq <= pSender->uSendSeqAtLastBackoff )
+      return;
+   pSender->uSendSeqAtLastBackoff = pSender->uSendSeq;
+   pSender->uRTOMs *= 2;
+   if ( pSender->uRTOMs > FILE_UPLOAD_MAX_RTO_MS )
+      pSender->uRTOMs = FILE_UPLOAD_MAX_RTO_MS;
+   // Nothing got through for a whole timeout (link outage): start probing the link again
+   if ( 0 == pSender->iInFlight )
+   {
+      pSender->fWindow = FILE_UPLOAD_MIN_WINDOW;
+      pSender->bSlowStart = true;
+   }
+}
+
+bool file_upload_sender_init(type_file_upload_sender* pSender, u32 uTotalSegments, u32 uTimeNow)
+{
+   if ( NULL == pSender )
+      return false;
+   file_upload_sender_close(pSender);
+   memset(pSender, 0, sizeof(type_file_upload_sender));
+   if ( 0 == uTotalSegments )
+      return false;
+
+   pSender->pSegments = (type_file_upload_segment*) malloc(uTotalSegments * sizeof(type_file_upload_segment));
+   if ( NULL == pSender->pSegments )
+   {
+      log_softerror_and_alarm("[FileUpload] Failed to allocate memory for %u segments.", uTotalSegments);
+      return false;
+   }
+   memset(pSender->pSegments, 0, uTotalSegments * sizeof(type_file_upload_segment));
+   pSender->uTotalSegments = uTotalSegments;
+   pSender->fWindow = FILE_UPLOAD_INITIAL_WINDOW;
+   pSender->fMaxWindow = pSender->fWindow;
+   pSender->bSlowStart = true;
+   pSender->uRTOMs = FILE_UPLOAD_INITIAL_RTO_MS;
+   pSender->uTimeStart = uTimeNow;
+   pSender->uTimeLastAck = uTimeNow;
+   return true;
+}
+
+void file_upload_sender_close(type_file_upload_sender* pSender)
+{
+   if ( NULL == pSender )
+      return;
+   if ( NULL != pSender->pSegments )
+      free(pSender->pSegments);
+   pSender->pSegments = NULL;
+   pSender->uTotalSegments = 0;
+}
+
+int file_upload_sender_get_segment_to_send(type_file_upload_sender* pSender, u32 uTimeNow)
+{
+   if ( (NULL == pSender) || (NULL == pSender->pSegments) )
+      return -1;
+
+   _file_upload_sender_check_timeouts(pSender, uTimeNow);
+
+   if ( pSender->iInFlight >= (int)pSender->fWindow )
+      return -1;
+
+   for( u32 u=pSender->uFirstNotAcked; u<pSender->uFirstNotSent; u++ )
+   {
+      if ( pSender->pSegments[u].uState == FILE_UPLOAD_SEGMENT_LOST )
+         return (int)u;
+   }
+   if ( pSender->uFirstNotSent < pSender->uTotalSegments )
+      return (int)pSender->uFirstNotSent;
+   return -1;
+}
+
+void file_upload_sender_on_segment_sent(type_file_upload_sender* pSender, u32 uSegmentIndex, u32 uTimeNow)
+{
+   if ( (NULL == pSender) || (NULL == pSender->pSegments) || (uSegmentIndex >= pSender->uTotalSegments) )
+      return;
+
+   type_file_upload_segment* pSegment = &pSender->pSegments[uSegmentIndex];
+   if ( pSegment->uState == FILE_UPLOAD_SEGMENT_ACKED )
+      return;
+   if ( pSegment->uState != FILE_UPLOAD_SEGMENT_IN_FLIGHT )
+      pSender->iInFlight++;
+   if ( pSegment->uSendCount > 0 )
+      pSender->uCountResent++;
+   if ( pSegment->uSendCount < 255 )
+      pSegment->uSendCount++;
+   pSender->uCountSent++;
+   pSender->uSendSeq++;
+   pSegment->uState = FILE_UPLOAD_SEGMENT_IN_FLIGHT;
+   pSegment->uSendSeq = pSender->uSendSeq;
+   pSegment->uSendTime = uTimeNow;
+   pSegment->uLaterAcks = 0;
+
+   while ( (pSender->uFirstNotSent < pSender->uTotalSegments) && (pSender->pSegments[pSender->uFirstNotSent].uState != FILE_UPLOAD_SEGMENT_NOT_SENT) )
+      pSender->uFirstNotSent++;
+}
+
+void file_upload_sender_on_ack(type_file_upload_sender* pSender, command_packet_upload_file_segment_ack* pAck, u32 uTimeNow)
+{
+   if ( (NULL == pSender) || (NULL == pSender->pSegments) || (NULL == pAck) )
+      return;
+
+   pSender->uCountAcks++;
+   pSender->uTimeLastAck = uTimeNow;
+
+   u32 uAckedSendSeq = 0;
+   if ( pAck->uSegmentIndex < pSender->uTotalSegments )
+   {
+      type_file_upload_segment* pSegment = &pSender->pSegments[pAck->uSegmentIndex];
+      // Round trip samples only from segments sent once (the ack of a resent segment is ambiguous)
+      if ( (pSegment->uState != FILE_UPLOAD_SEGMENT_ACKED) && (pSegment->uState != FILE_UPLOAD_SEGMENT_NOT_SENT) )
+      {
+         uAckedSendSeq = pSegment->uSendSeq;
+         if ( (1 == pSegment->uSendCount) && (uTimeNow >= pSegment->uSendTime) )
+            _file_upload_sender_update_rtt(pSender, uTimeNow - pSegment->uSendTime);
+         _file_upload_sender_set_acked(pSender, pAck->uSegmentIndex);
+      }
+   }
+
+   u32 uNextMissing = pAck->uNextMissingSegment;
+   if ( (pAck->uFlags & UPLOAD_FILE_SEGMENT_ACK_FLAG_COMPLETE) || (uNextMissing > pSender->uTotalSegments) )
+      uNextMissing = pSender->uTotalSegments;
+   for( u32 u=pSender->uFirstNotAcked; u<uNextMissing; u++ )
+      _file_upload_sender_set_acked(pSender, u);
+   for( u32 i=0; i<32; i++ )
+   {
+      if ( ! (pAck->uReceivedMask & (((u32)1)<<i)) )
+         continue;
+      u32 uIndex = uNextMissing + 1 + i;
+      if ( uIndex < pSender->uTotalSegments )
+         _file_upload_sender_set_acked(pSender, uIndex);
+   }
+
+   while ( (pSender->uFirstNotAcked < pSender->uTotalSegments) && (pSender->pSegments[pSender->uFirstNotAcked].uState == FILE_UPLOAD_SEGMENT_ACKED) )
+      pSender->uFirstNotAcked++;
+
+   // Segments sent before the acked one and still not acked are lost after a few such acks
+   if ( 0 == uAckedSendSeq )
+      return;
+   for( u32 u=pSender->uFirstNotAcked; u<pSender->uFirstNotSent; u++ )
+   {
+      type_file_upload_segment* pSegment = &pSender->pSegments[u];
+      if ( (pSegment->uState != FILE_UPLOAD_SEGMENT_IN_FLIGHT) || (pSegment->uSendSeq >= uAckedSendSeq) )
+         continue;
+      pSegment->uLaterAcks++;
+      if ( pSegment->uLaterAcks >= FILE_UPLOAD_LOSS_LATER_ACKS )
+      {
+         _file_upload_sender_set_lost(pSender, u);
+         pSender->uCountLost++;
+      }
+   }
+}
+
+int file_upload_sender_on_response(type_file_upload_sender* pSender, u32 uFileId, u8* pPacketBuffer, int iLength, u32 uTimeNow)
+{
+   int iHeadersLength = sizeof(t_packet_header) + sizeof(t_packet_header_command_response);
+   if ( (NULL == pPacketBuffer) || (iLength < iHeadersLength) )
+      return FILE_UPLOAD_RESPONSE_NOT_AN_ACK;
+
+   t_packet_header* pPH = (t_packet_header*)pPacketBuffer;
+   t_packet_header_command_response* pPHCR = (t_packet_header_command_response*)(pPacketBuffer + sizeof(t_packet_header));
+   if ( pPHCR->origin_command_type != COMMAND_ID_UPLOAD_FILE_SEGMENT )
+      return FILE_UPLOAD_RESPONSE_NOT_AN_ACK;
+
+   int iDataLength = (int)pPH->total_length;
+   if ( iDataLength > iLength )
+      iDataLength = iLength;
+   iDataLength -= iHeadersLength;
+   if ( (NULL == pSender) || (NULL == pSender->pSegments) || (iDataLength < (int)sizeof(command_packet_upload_file_segment_ack)) )
+      return FILE_UPLOAD_RESPONSE_ACK_IGNORED;
+
+   command_packet_upload_file_segment_ack ack;
+   memcpy((u8*)&ack, pPacketBuffer + iHeadersLength, sizeof(command_packet_upload_file_segment_ack));
+   if ( ack.uFlags & UPLOAD_FILE_SEGMENT_ACK_FLAG_FAILED )
+      return FILE_UPLOAD_RESPONSE_ACK_FAILED;
+   if ( ack.uFileId != uFileId )
+      return FILE_UPLOAD_RESPONSE_ACK_IGNORED;
+   file_upload_sender_on_ack(pSender, &ack, uTimeNow);
+   return FILE_UPLOAD_RESPONSE_ACK_USED;
+}
+
+int file_upload_sender_check_acks(type_file_upload_sender* pSender, u32 uTimeNow)
+{
+   if ( (NULL == pSender) || (NULL == pSender->pSegments) )
+      return FILE_UPLOAD_SENDER_ACKS_OK;
+   if ( (0 == pSender->uCountAcks) && (uTimeNow > pSender->uTimeStart + FILE_UPLOAD_NO_ACK_FALLBACK_MS) )
+      return FILE_UPLOAD_SENDER_NO_ACKS_FALLBACK;
+   if ( uTimeNow > pSender->uTimeLastAck + FILE_UPLOAD_NO_ACK_ABORT_MS )
+      return FILE_UPLOAD_SENDER_NO_ACKS_ABORT;
+   return FILE_UPLOAD_SENDER_ACKS_OK;
+}
+
+bool file_upload_sender_is_complete(type_file_upload_sender* pSender)
+{
+   if ( (NULL == pSender) || (0 == pSender->uTotalSegments) )
+      return false;
+   return (pSender->uCountAcked >= pSender->uTotalSegments);
+}
+
+void file_upload_sender_log_stats(type_file_upload_sender* pSender, u32 uTimeNow)
+{
+   if ( NULL == pSender )
+      return;
+   log_line("[FileUpload] %u of %u segments acked in %u ms; %u sent (%u resent), %u acks, %u lost, %u timed out; window: %.1f (max %.1f), RTT: %u ms (min %u ms, var %u ms), RTO: %u ms",
+      pSender->uCountAcked, pSender->uTotalSegments, uTimeNow - pSender->uTimeStart,
+      pSender->uCountSent, pSender->uCountResent, pSender->uCountAcks, pSender->uCountLost, pSender->uCountTimeouts,
+      pSender->fWindow, pSender->fMaxWindow, pSender->uSRTTMs, pSender->uMinRTTMs, pSender->uRTTVarMs, pSender->uRTOMs);
+}
+
+void file_upload_receiver_init(type_file_upload_receiver* pReceiver)
+{
+   if ( NULL == pReceiver )
+      return;
+   memset(pReceiver, 0, sizeof(type_file_upload_receiver));
+   pReceiver->iFile = -1;
+}
+
+bool file_upload_receiver_is_current_file(type_file_upload_receiver* pReceiver, u32 uFileId, u32 uTotalSegments, u32 uFileSize)
+{
+   if ( (NULL == pReceiver) || (NULL == pReceiver->pReceived) )
+      return false;
+   return ( (pReceiver->uFileId == uFileId) && (pReceiver->uTotalSegments == uTotalSegments) && (pReceiver->uFileSize == uFileSize) );
+}
+
+bool file_upload_receiver_start(type_file_upload_receiver* pReceiver, u32 uFileId, u32 uTotalSegments, u32 uFileSize, const char* szFileName)
+{
+   if ( NULL == pReceiver )
+      return false;
+   file_upload_receiver_close(pReceiver);
+   if ( NULL != pReceiver->pReceived )
+      free(pReceiver->pReceived);
+   file_upload_receiver_init(pReceiver);
+
+   if ( (0 == uTotalSegments) || (0 == uFileSize) || (uTotalSegments > uFileSize) || (NULL == szFileName) || (0 == szFileName[0]) )
+      return false;
+
+   pReceiver->pReceived = (u8*) malloc(uTotalSegments);
+   if ( NULL == pReceiver->pReceived )
+   {
+      log_softerror_and_alarm("[FileUpload] Failed to allocate memory for %u segments.", uTotalSegments);
+      return false;
+   }
+   memset(pReceiver->pReceived, 0, uTotalSegments);
+
+   pReceiver->iFile = open(szFileName, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+   if ( pReceiver->iFile < 0 )
+   {
+      log_softerror_and_alarm("[FileUpload] Failed to create file [%s] for upload, error: %d", szFileName, errno);
+      free(pReceiver->pReceived);
+      pReceiver->pReceived = NULL;
+      return false;
+   }
+   pReceiver->uFileId = uFileId;
+   pReceiver->uTotalSegments = uTotalSegments;
+   pReceiver->uFileSize = uFileSize;
+   strncpy(pReceiver->szFileName, szFileName, sizeof(pReceiver->szFileName)-1);
+   pReceiver->szFileName[sizeof(pReceiver->szFileName)-1] = 0;
+   log_line("[FileUpload] Started receiving file id %u, %u bytes, %u segments, to [%s]", uFileId, uFileSize, uTotalSegments, pReceiver->szFileName);
+   return true;
+}
+
+int file_upload_receiver_add_segment(type_file_upload_receiver* pReceiver, u32 uSegmentIndex, u8* pData, u32 uSegmentSize)
+{
+   if ( (NULL == pReceiver) || (NULL == pReceiver->pReceived) || (NULL == pData) || (0 == uSegmentSize) )
+      return -1;
+   if ( uSegmentIndex >= pReceiver->uTotalSegments )
+      return -1;
+   if ( pReceiver->pReceived[uSegmentIndex] )
+      return 0;
+   if ( pReceiver->iFile < 0 )
+      return -1;
+
+   // All segments have the same size, except the last one that ends the file
+   if ( uSegmentSize > pReceiver->uFileSize )
+      return -1;
+   u32 uOffset = pReceiver->uFileSize - uSegmentSize;
+   if ( uSegmentIndex < pReceiver->uTotalSegments-1 )
+   {
+      if ( uSegmentIndex > (pReceiver->uFileSize - uSegmentSize) / uSegmentSize )
+         return -1;
+      uOffset = uSegmentIndex * uSegmentSize;
+   }
+
+   if ( (int)uSegmentSize != pwrite(pReceiver->iFile, pData, uSegmentSize, (off_t)uOffset) )
+   {
+      log_softerror_and_alarm("[FileUpload] Failed to write segment %u to file [%s], error: %d", uSegmentIndex, pReceiver->szFileName, errno);
+      return -1;
+   }
+
+   pReceiver->pReceived[uSegmentIndex] = 1;
+   pReceiver->uCountReceived++;
+   while ( (pReceiver->uNextMissingSegment < pReceiver->uTotalSegments) && pReceiver->pReceived[pReceiver->uNextMissingSegment] )
+      pReceiver->uNextMissingSegment++;
+   return 1;
+}
+
+bool file_upload_receiver_is_complete(type_file_upload_receiver* pReceiver)
+{
+   if ( (NULL == pReceiver) || (NULL == pReceiver->pReceived) )
+      return false;
+   return (pReceiver->uCountReceived >= pReceiver->uTotalSegments);
+}
+
+void file_upload_receiver_get_ack(type_file_upload_receiver* pReceiver, u32 uSegmentIndex, command_packet_upload_file_segment_ack* pAck)
+{
+   if ( NULL == pAck )
+      return;
+   memset(pAck, 0, sizeof(command_packet_upload_file_segment_ack));
+   pAck->uSegmentIndex = uSegmentIndex;
+   if ( (NULL == pReceiver) || (NULL == pReceiver->pReceived) )
+   {
+      pAck->uFlags = UPLOAD_FILE_SEGMENT_ACK_FLAG_FAILED;
+      return;
+   }
+   pAck->uFileId = pReceiver->uFileId;
+   pAck->uNextMissingSegment = pReceiver->uNextMissingSegment;
+   for( u32 i=0; i<32; i++ )
+   {
+      u32 uIndex = pReceiver->uNextMissingSegment + 1 + i;
+      if ( uIndex >= pReceiver->uTotalSegments )
+         break;
+      if ( pReceiver->pReceived[uIndex] )
+         pAck->uReceivedMask |= ((u32)1)<<i;
+   }
+   if ( file_upload_receiver_is_complete(pReceiver) )
+      pAck->uFlags |= UPLOAD_FILE_SEGMENT_ACK_FLAG_COMPLETE;
+}
+
+void file_upload_receiver_close(type_file_upload_receiver* pReceiver)
+{
+   if ( NULL == pReceiver )
+      return;
+   if ( pReceiver->iFile >= 0 )
+      close(pReceiver->iFile);
+   pReceiver->iFile = -1;
+}
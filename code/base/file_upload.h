@@ -0,0 +1,124 @@
+#pragma once
+
+#include "base.h"
+#include "config_file_names.h"
+#include "commands.h"
+#include "../radio/radiopackets2.h"
+
+// Windowed file upload, from the controller to the vehicle, over the commands link.
+// The controller (sender) keeps up to a window of segments in flight, each one sent as a one way
+// COMMAND_ID_UPLOAD_FILE_SEGMENT. The vehicle (receiver) writes each segment at its offset in the
+// target file and answers it with a selective ack (first missing segment and a bitmap of the
+// segments received after it).
+// The window follows the measured link capacity: the segments queued on the link are estimated
+// from the minimum and the smoothed round trip (window * (1 - min RTT / RTT)); the window grows
+// while few are queued (doubling each round trip at start) and shrinks when the queue builds up.
+// Radio losses are not taken as congestion: a segment is resent when three segments sent after it
+// were acked, or when its retransmission timeout (from the measured round trip) expires.
+// No router or UI state is used, so the same code runs in the loopback link simulator (r_tests/test_file_upload).
+
+#define FILE_UPLOAD_MAX_WINDOW 32
+#define FILE_UPLOAD_MIN_WINDOW 2
+#define FILE_UPLOAD_INITIAL_WINDOW 4
+// Segments queued on the link to keep (window grows below low, shrinks above high)
+#define FILE_UPLOAD_QUEUED_LOW 2.0
+#define FILE_UPLOAD_QUEUED_HIGH 4.0
+#define FILE_UPLOAD_INITIAL_RTO_MS 500
+#define FILE_UPLOAD_MIN_RTO_MS 60
+#define FILE_UPLOAD_MAX_RTO_MS 3000
+#define FILE_UPLOAD_LOSS_LATER_ACKS 3
+// Older vehicles process one way segments but do not ack them: the controller uploads one segment per command
+#define FILE_UPLOAD_NO_ACK_FALLBACK_MS 3000
+#define FILE_UPLOAD_NO_ACK_ABORT_MS 15000
+
+#define FILE_UPLOAD_RESPONSE_NOT_AN_ACK 0 // not a segment ack, a regular command response
+#define FILE_UPLOAD_RESPONSE_ACK_USED 1
+#define FILE_UPLOAD_RESPONSE_ACK_IGNORED 2 // too short, other file or no upload in progress
+#define FILE_UPLOAD_RESPONSE_ACK_FAILED 3 // the vehicle could not store the segment
+
+#define FILE_UPLOAD_SENDER_ACKS_OK 0
+#define FILE_UPLOAD_SENDER_NO_ACKS_FALLBACK 1
+#define FILE_UPLOAD_SENDER_NO_ACKS_ABORT 2
+
+#define FILE_UPLOAD_SEGMENT_NOT_SENT 0
+#define FILE_UPLOAD_SEGMENT_IN_FLIGHT 1
+#define FILE_UPLOAD_SEGMENT_LOST 2
+#define FILE_UPLOAD_SEGMENT_ACKED 3
+
+typedef struct
+{
+   u8 uState;
+   u8 uSendCount;
+   u8 uLaterAcks;
+   u32 uSendSeq; // of the last send
+   u32 uSendTime;
+} type_file_upload_segment;
+
+typedef struct
+{
+   u32 uTotalSegments;
+   type_file_upload_segment* pSegments;
+   u32 uFirstNotAcked;
+   u32 uFirstNotSent;
+   u32 uCountAcked;
+   int iInFlight;
+   u32 uSendSeq;
+   u32 uSendSeqAtLastBackoff;
+
+   float fWindow;
+   bool bSlowStart;
+   bool bHasRTT;
+   u32 uMinRTTMs;
+   u32 uSRTTMs;
+   u32 uRTTVarMs;
+   u32 uRTOMs;
+
+   u32 uTimeStart;
+   u32 uTimeLastAck;
+
+   // Stats
+   u32 uCountAcks;
+   u32 uCountSent;
+   u32 uCountResent;
+   u32 uCountLost; // detected from the acks
+   u32 uCountTimeouts;
+   float fMaxWindow;
+} type_file_upload_sender;
+
+typedef struct
+{
+   u32 uFileId;
+   u32 uTotalSegments;
+   u32 uFileSize;
+   u32 uCountReceived;
+   u32 uNextMissingSegment;
+   u8* pReceived; // one byte per segment
+   int iFile;
+   char szFileName[MAX_FILE_PATH_SIZE];
+} type_file_upload_receiver;
+
+bool file_upload_sender_init(type_file_upload_sender* pSender, u32 uTotalSegments, u32 uTimeNow);
+void file_upload_sender_close(type_file_upload_sender* pSender);
+// Returns the segment to send now (lost segments first), or -1 if the window is full or nothing is left to send
+int file_upload_sender_get_segment_to_send(type_file_upload_sender* pSender, u32 uTimeNow);
+void file_upload_sender_on_segment_sent(type_file_upload_sender* pSender, u32 uSegmentIndex, u32 uTimeNow);
+void file_upload_sender_on_ack(type_file_upload_sender* pSender, command_packet_upload_file_segment_ack* pAck, u32 uTimeNow);
+// Checks a command response packet (with its radio headers) from the vehicle for a segment ack of file uFileId.
+// Returns one of FILE_UPLOAD_RESPONSE_*
+int file_upload_sender_on_response(type_file_upload_sender* pSender, u32 uFileId, u8* pPacketBuffer, int iLength, u32 uTimeNow);
+// Returns one of FILE_UPLOAD_SENDER_*: no acks at all since start (fallback), or for too long (abort)
+int file_upload_sender_check_acks(type_file_upload_sender* pSender, u32 uTimeNow);
+bool file_upload_sender_is_complete(type_file_upload_sender* pSender);
+void file_upload_sender_log_stats(type_file_upload_sender* pSender, u32 uTimeNow);
+
+void file_upload_receiver_init(type_file_upload_receiver* pReceiver);
+// Returns true if the receiver is writing this file
+bool file_upload_receiver_is_current_file(type_file_upload_receiver* pReceiver, u32 uFileId, u32 uTotalSegments, u32 uFileSize);
+// Creates (truncates) the target file. Returns false on failure.
+bool file_upload_receiver_start(type_file_upload_receiver* pReceiver, u32 uFileId, u32 uTotalSegments, u32 uFileSize, const char* szFileName);
+// Returns 1 if the segment was written, 0 if it was already received, -1 if it is invalid or can't be written
+int file_upload_receiver_add_segment(type_file_upload_receiver* pReceiver, u32 uSegmentIndex, u8* pData, u32 uSegmentSize);
+bool file_upload_receiver_is_complete(type_file_upload_receiver* pReceiver);
+void file_upload_receiver_get_ack(type_file_upload_receiver* pReceiver, u32 uSegmentIndex, command_packet_upload_file_segment_ack* pAck);
+// Closes the target file (it is kept on disk)
+void file_upload_receiver_close(type_file_upload_receiver* pReceiver);
@@ -944,6 +944,46 @@ int hardware_is_joystick_opened(int joystickIndex)
 // Returns the count of new events
 // Return -1 on error
 
+#ifdef HW_PLATFORM_RASPBERRY
+// Returns the number of events read, 0 if none available now, -1 on error
+
+static int _hardware_read_joystick_events(int joystickIndex)
+{
+   struct js_event joystickEvent[8];
+   int iRead = read(s_HardwareJoystickInfo[joystickIndex].fd, &joystickEvent[0], sizeof(joystickEvent));
+   if ( iRead == 0 )
+      return 0;
+   if ( iRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) )
+      return 0;
+   if ( iRead < 0 )
+   {
+      log_softerror_and_alarm("[Hardware] Error on reading joystick data, joystick index: %d, error: %d", joystickIndex, errno);
+      hardware_close_joystick(joystickIndex);
+      return -1;
+   }
+   int countEvents = 0;
+   int count = iRead / sizeof(joystickEvent[0]);
+   for( int i=0; i<count; i++ )
+   {
+      if ( (joystickEvent[i].type & ~JS_EVENT_INIT) == JS_EVENT_BUTTON )
+      if ( joystickEvent[i].number >= 0 && joystickEvent[i].number < MAX_JOYSTICK_BUTTONS )
+      {
+         s_HardwareJoystickInfo[joystickIndex].buttonsValues[joystickEvent[i].number] = joystickEvent[i].value;
+         countEvents++;
+      }
+      if ( (joystickEvent[i].type & ~JS_EVENT_INIT) == JS_EVENT_AXIS )
+      if ( joystickEvent[i].number >= 0 && joystickEvent[i].number < MAX_JOYSTICK_AXES )
+      {
+         s_HardwareJoystickInfo[joystickIndex].axesValues[joystickEvent[i].number] = joystickEvent[i].value;
+         countEvents++;
+      }
+   }
+   return countEvents;
+}
+#endif
+
+// miliSec: how long to keep reading events; 0: read only the events available now (i.e. when the joystick fd is readable)
+
 int hardware_read_joystick(int joystickIndex, int miliSec)
 {
    #ifdef HW_PLATFORM_RASPBERRY
@@ -958,6 +998,20 @@ int hardware_read_joystick(int joystickIndex, int miliSec)
    memcpy( &s_HardwareJoystickInfo[joystickIndex].axesValuesPrev, &s_HardwareJoystickInfo[joystickIndex].axesValues, MAX_JOYSTICK_AXES*sizeof(int));
 
    int countEvents = 0;
+   if ( miliSec <= 0 )
+   {
+      while ( true )
+      {
+         int iCount = _hardware_read_joystick_events(joystickIndex);
+         if ( iCount < 0 )
+            return -1;
+         if ( 0 == iCount )
+            break;
+         countEvents += iCount;
+      }
+      return countEvents;
+   }
+
    u32 timeStart = get_current_timestamp_micros();
    u32 timeEnd = timeStart + miliSec*1000;
    if ( timeEnd < timeStart )
@@ -966,34 +1020,10 @@ int hardware_read_joystick(int joystickIndex, int miliSec)
    while ( get_current_timestamp_micros() < timeEnd )
    { 
       hardware_sleep_micros(200);
-      struct js_event joystickEvent[8];
-      int iRead = read(s_HardwareJoystickInfo[joystickIndex].fd, &joystickEvent[0], sizeof(joystickEvent));
-      if ( iRead == 0 )
-         continue;
-      if ( iRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) )
-         continue;
-      if ( iRead < 0 )
-      {
-         log_softerror_and_alarm("[Hardware] Error on reading joystick data, joystick index: %d, error: %d", joystickIndex, errno);
-         hardware_close_joystick(joystickIndex);
+      int iCount = _hardware_read_joystick_events(joystickIndex);
+      if ( iCount < 0 )
          return -1;
-      }
-      int count = iRead / sizeof(joystickEvent[0]);
-      for( int i=0; i<count; i++ )
-      {
-         if ( (joystickEvent[i].type & ~JS_EVENT_INIT) == JS_EVENT_BUTTON )
-         if ( joystickEvent[i].number >= 0 && joystickEvent[i].number < MAX_JOYSTICK_BUTTONS )
-         {
-            s_HardwareJoystickInfo[joystickIndex].buttonsValues[joystickEvent[i].number] = joystickEvent[i].value;
-            countEvents++;
-         }
-         if ( (joystickEvent[i].type & ~JS_EVENT_INIT) == JS_EVENT_AXIS )
-         if ( joystickEvent[i].number >= 0 && joystickEvent[i].number < MAX_JOYSTICK_AXES )
-         {
-            s_HardwareJoystickInfo[joystickIndex].axesValues[joystickEvent[i].number] = joystickEvent[i].value;
-            countEvents++;
-         }
-      }
+      countEvents += iCount;
    }
    return countEvents;
    #else
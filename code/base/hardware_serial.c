@@ -32,6 +32,8 @@
 
 #include <fcntl.h>        // serialport
 #include <termios.h>      // serialport
+#include <sys/ioctl.h>
+#include <linux/serial.h>
 #include <ctype.h>
 #include <stdio.h>
 #include <errno.h>
@@ -556,6 +558,23 @@ int hardware_open_serial_port(const char* szDevName, long baudRate)
    return fPort;
 }
 
+int hardware_serial_set_low_latency(int iSerialPortFD)
+{
+   if ( iSerialPortFD < 0 )
+      return 0;
+
+   struct serial_struct serialInfo;
+   memset(&serialInfo, 0, sizeof(serialInfo));
+   if ( 0 != ioctl(iSerialPortFD, TIOCGSERIAL, &serialInfo) )
+      return 0;
+   if ( serialInfo.flags & ASYNC_LOW_LATENCY )
+      return 1;
+   serialInfo.flags |= ASYNC_LOW_LATENCY;
+   if ( 0 != ioctl(iSerialPortFD, TIOCSSERIAL, &serialInfo) )
+      return 0;
+   return 1;
+}
+
 int hardware_serial_is_sik_radio(const char* szDevName)
 {
    if ( ! s_iHardwareSerialPortsWasInitialized )
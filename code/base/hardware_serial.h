@@ -45,6 +45,9 @@ hw_serial_port_info_t* hardware_get_serial_port_info_from_serial_port_name(char*
 
 int hardware_configure_serial(const char* szDevName, long baudRate);
 int hardware_open_serial_port(const char* szDevName, long baudRate);
+// Asks the serial driver to hand over received bytes right away (no rx FIFO/latency timer batching).
+// Returns 1 if the driver accepted it, 0 if not supported.
+int hardware_serial_set_low_latency(int iSerialPortFD);
 
 int hardware_serial_is_sik_radio(const char* szDevName);
 int hardware_serial_send_sik_command(int iSerialPortFD, const char* szCommand);
@@ -1,8 +1,13 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/resource.h>
 #include <ctype.h>
 #include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 
 #include "base.h"
 #include "config.h"
@@ -824,4 +829,70 @@ int hw_increase_current_thread_priority(const char* szLogPrefix, int iNewPriorit
    log_line("%s Current new thread policy/priority: %d/%d", szPrefix, policy, params.sched_priority);
 
    return iRetValue;
-}
\ No newline at end of file
+}
+
+int hw_get_cpu_cores_count()
+{
+   long lCount = sysconf(_SC_NPROCESSORS_ONLN);
+   if ( lCount < 1 )
+      return 1;
+   return (int)lCount;
+}
+
+// iCore is zero based. Returns 1 on success, 0 on error
+// CPU cores the threads could use before the first thread was pinned to a core
+static cpu_set_t s_CPUSetBeforeThreadPinning;
+static int s_iCPUSetBeforeThreadPinningSaved = 0;
+
+int hw_set_current_thread_affinity(const char* szLogPrefix, int iCore)
+{
+   char szTmp[2];
+   szTmp[0] = 0;
+   char* szPrefix = szTmp;
+   if ( (NULL != szLogPrefix) && (0 != szLogPrefix[0]) )
+     szPrefix = (char*)szLogPrefix;
+
+   if ( (iCore < 0) || (iCore >= hw_get_cpu_cores_count()) || (iCore >= CPU_SETSIZE) )
+   {
+      log_softerror_and_alarm("%s Invalid CPU core (%d) to set thread affinity to (%d cores).", szPrefix, iCore, hw_get_cpu_cores_count());
+      return 0;
+   }
+   if ( ! s_iCPUSetBeforeThreadPinningSaved )
+   if ( 0 == pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &s_CPUSetBeforeThreadPinning) )
+      s_iCPUSetBeforeThreadPinningSaved = 1;
+
+   cpu_set_t cpuSet;
+   CPU_ZERO(&cpuSet);
+   CPU_SET(iCore, &cpuSet);
+   int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet);
+   if ( ret != 0 )
+   {
+      log_softerror_and_alarm("%s Failed to set thread affinity to CPU core %d, error: %d", szPrefix, iCore, ret);
+      return 0;
+   }
+   log_line("%s Set thread affinity to CPU core %d", szPrefix, iCore);
+   return 1;
+}
+
+// New threads inherit the CPU affinity of the thread that creates them: threads created by a pinned thread
+// call this to run again on all the CPU cores the process could use. Does nothing if no thread was pinned.
+
+int hw_reset_current_thread_affinity(const char* szLogPrefix)
+{
+   if ( ! s_iCPUSetBeforeThreadPinningSaved )
+      return 0;
+   char szTmp[2];
+   szTmp[0] = 0;
+   char* szPrefix = szTmp;
+   if ( (NULL != szLogPrefix) && (0 != szLogPrefix[0]) )
+     szPrefix = (char*)szLogPrefix;
+
+   int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &s_CPUSetBeforeThreadPinning);
+   if ( ret != 0 )
+   {
+      log_softerror_and_alarm("%s Failed to reset thread affinity, error: %d", szPrefix, ret);
+      return 0;
+   }
+   log_line("%s Reset thread affinity to all %d available CPU cores", szPrefix, CPU_COUNT(&s_CPUSetBeforeThreadPinning));
+   return 1;
+}
@@ -0,0 +1,277 @@
+/*
+    Ruby Licence
+    Copyright (c) 2025 Petru Soroaga
+    All rights reserved.
+
+    Redistribution and/or use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions and/or use of the source code (partially or complete) must retain
+        the above copyright notice, this list of conditions and the following disclaimer
+        in the documentation and/or other materials provided with the distribution.
+        * Redistributions in binary form (partially or complete) must reproduce
+        the above copyright notice, this list of conditions and the following disclaimer
+        in the documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permitted.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "base.h"
+#include "latency_stats.h"
+#include <sys/mman.h>
+
+static type_latency_stats* s_pLatencyStats = NULL;
+static const char* s_szLatencyStagesNames[LATENCY_STAGES_COUNT] =
+{
+   "radio read",
+   "rx queue wait",
+   "dedup",
+   "fec decode",
+   "video output",
+   "ipc send",
+   "ipc recv",
+   "camera read",
+   "tx inject",
+   "fc serial->ipc",
+   "fc frame->ipc",
+   "rc input->send",
+   "rc recv->fc"
+};
+
+static const char* _latency_stats_get_shared_mem_name(int iProcessType)
+{
+   if ( iProcessType == LATENCY_STATS_PROCESS_ROUTER_VEHICLE )
+      return SHARED_MEM_LATENCY_STATS_VEHICLE;
+   if ( iProcessType == LATENCY_STATS_PROCESS_TELEMETRY_VEHICLE )
+      return SHARED_MEM_LATENCY_STATS_TELEMETRY_VEHICLE;
+   return SHARED_MEM_LATENCY_STATS_STATION;
+}
+
+static void _latency_stats_setup(type_latency_stats* pStats, int iProcessType)
+{
+   memset(pStats, 0, sizeof(type_latency_stats));
+   pStats->uVersion = LATENCY_STATS_VERSION;
+   pStats->uStagesCount = LATENCY_STAGES_COUNT;
+   pStats->uBucketsCount = LATENCY_HISTOGRAM_BUCKETS;
+   pStats->uProcessType = (u32)iProcessType;
+   pStats->uProcessId = (u32)getpid();
+   pStats->uTimeStartSeconds = (u32)time(NULL);
+   __atomic_store_n(&pStats->uMagic, LATENCY_STATS_MAGIC, __ATOMIC_RELEASE);
+   s_pLatencyStats = pStats;
+}
+
+int latency_stats_init_for_write(int iProcessType)
+{
+   if ( NULL != s_pLatencyStats )
+      return 1;
+   const char* szName = _latency_stats_get_shared_mem_name(iProcessType);
+   int fd = shm_open(szName, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+   if ( fd < 0 )
+   {
+      log_softerror_and_alarm("[LatencyStats] Failed to open shared memory %s, error: %d (%s)", szName, errno, strerror(errno));
+      return 0;
+   }
+   if ( ftruncate(fd, sizeof(type_latency_stats)) == -1 )
+   {
+      log_softerror_and_alarm("[LatencyStats] Failed to init (ftruncate) shared memory %s", szName);
+      close(fd);
+      return 0;
+   }
+   void* pRet = mmap(NULL, sizeof(type_latency_stats), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+   if ( pRet == MAP_FAILED )
+   {
+      log_softerror_and_alarm("[LatencyStats] Failed to map shared memory %s", szName);
+      return 0;
+   }
+   _latency_stats_setup((type_latency_stats*)pRet, iProcessType);
+   log_line("[LatencyStats] Opened latency stats shared memory %s (%d bytes, %d stages)", szName, (int)sizeof(type_latency_stats), LATENCY_STAGES_COUNT);
+   return 1;
+}
+
+int latency_stats_init_local(int iProcessType)
+{
+   if ( NULL != s_pLatencyStats )
+      return 1;
+   void* pRet = mmap(NULL, sizeof(type_latency_stats), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if ( pRet == MAP_FAILED )
+   {
+      log_softerror_and_alarm("[LatencyStats] Failed to allocate local latency stats");
+      return 0;
+   }
+   _latency_stats_setup((type_latency_stats*)pRet, iProcessType);
+   log_line("[LatencyStats] Using local (not shared) latency stats (%d stages)", LATENCY_STAGES_COUNT);
+   return 1;
+}
+
+type_latency_stats* latency_stats_get_current()
+{
+   return s_pLatencyStats;
+}
+
+void latency_stats_close()
+{
+   if ( NULL == s_pLatencyStats )
+      return;
+   type_latency_stats* pStats = s_pLatencyStats;
+   s_pLatencyStats = NULL;
+   munmap(pStats, sizeof(type_latency_stats));
+}
+
+int latency_stats_is_active()
+{
+   return (NULL != s_pLatencyStats)?1:0;
+}
+
+u32 latency_stats_start()
+{
+   if ( NULL == s_pLatencyStats )
+      return 0;
+   u32 uTime = get_current_timestamp_micros();
+   // 0 means not active
+   if ( 0 == uTime )
+      uTime = 1;
+   return uTime;
+}
+
+void latency_stats_end(int iStage, u32 uStartTimeMicros)
+{
+   if ( (0 == uStartTimeMicros) || (NULL == s_pLatencyStats) )
+      return;
+   latency_stats_add(iStage, get_current_timestamp_micros() - uStartTimeMicros);
+}
+
+// Can be called from any thread: counters are updated atomically. Min/max are best effort.
+
+void latency_stats_add(int iStage, u32 uMicros)
+{
+   type_latency_stats* pStats = s_pLatencyStats;
+   if ( (NULL == pStats) || (iStage < 0) || (iStage >= LATENCY_STAGES_COUNT) )
+      return;
+   type_latency_stage_histogram* pHistogram = &pStats->stages[iStage];
+   __atomic_fetch_add(&pHistogram->uBuckets[latency_stats_get_bucket_index(uMicros)], 1, __ATOMIC_RELAXED);
+   __atomic_fetch_add(&pHistogram->uSumMicros, (unsigned long long)uMicros, __ATOMIC_RELAXED);
+   if ( uMicros > pHistogram->uMaxMicros )
+      pHistogram->uMaxMicros = uMicros;
+   if ( (0 == pHistogram->uCount) || (uMicros < pHistogram->uMinMicros) )
+      pHistogram->uMinMicros = uMicros;
+   __atomic_fetch_add(&pHistogram->uCount, 1, __ATOMIC_RELEASE);
+}
+
+type_latency_stats* latency_stats_open_for_read(int iProcessType)
+{
+   const char* szName = _latency_stats_get_shared_mem_name(iProcessType);
+   int fd = shm_open(szName, O_RDONLY, S_IRUSR | S_IWUSR);
+   if ( fd < 0 )
+      return NULL;
+   void* pRet = mmap(NULL, sizeof(type_latency_stats), PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if ( pRet == MAP_FAILED )
+      return NULL;
+   type_latency_stats* pStats = (type_latency_stats*)pRet;
+   if ( (__atomic_load_n(&pStats->uMagic, __ATOMIC_ACQUIRE) != LATENCY_STATS_MAGIC) ||
+        (pStats->uVersion != LATENCY_STATS_VERSION) || (pStats->uStagesCount != LATENCY_STAGES_COUNT) || (pStats->uBucketsCount != LATENCY_HISTOGRAM_BUCKETS) )
+   {
+      munmap(pRet, sizeof(type_latency_stats));
+      return NULL;
+   }
+   return pStats;
+}
+
+void latency_stats_close_read(type_latency_stats* pStats)
+{
+   if ( NULL != pStats )
+      munmap(pStats, sizeof(type_latency_stats));
+}
+
+const char* latency_stats_get_stage_name(int iStage)
+{
+   if ( (iStage < 0) || (iStage >= LATENCY_STAGES_COUNT) )
+      return "N/A";
+   return s_szLatencyStagesNames[iStage];
+}
+
+int latency_stats_get_bucket_index(u32 uMicros)
+{
+   if ( uMicros < LATENCY_HISTOGRAM_LINEAR_BUCKETS )
+      return (int)uMicros;
+   int iExponent = 31 - __builtin_clz(uMicros);
+   int iSubBucket = (int)((uMicros >> (iExponent-3)) & (LATENCY_HISTOGRAM_SUB_BUCKETS-1));
+   return LATENCY_HISTOGRAM_LINEAR_BUCKETS + (iExponent-4)*LATENCY_HISTOGRAM_SUB_BUCKETS + iSubBucket;
+}
+
+u32 latency_stats_get_bucket_max_value(int iBucket)
+{
+   if ( iBucket < 0 )
+      return 0;
+   if ( iBucket < LATENCY_HISTOGRAM_LINEAR_BUCKETS )
+      return (u32)iBucket;
+   if ( iBucket >= LATENCY_HISTOGRAM_BUCKETS )
+      return MAX_U32;
+   int iExponent = 4 + (iBucket - LATENCY_HISTOGRAM_LINEAR_BUCKETS) / LATENCY_HISTOGRAM_SUB_BUCKETS;
+   int iSubBucket = (iBucket - LATENCY_HISTOGRAM_LINEAR_BUCKETS) % LATENCY_HISTOGRAM_SUB_BUCKETS;
+   unsigned long long uMax = ((unsigned long long)(LATENCY_HISTOGRAM_SUB_BUCKETS + iSubBucket + 1) << (iExponent-3)) - 1;
+   if ( uMax > MAX_U32 )
+      return MAX_U32;
+   return (u32)uMax;
+}
+
+u32 latency_stats_get_percentile(type_latency_stage_histogram* pHistogram, int iPerMille)
+{
+   if ( (NULL == pHistogram) || (0 == pHistogram->uCount) )
+      return 0;
+   unsigned long long uTotal = 0;
+   for( int i=0; i<LATENCY_HISTOGRAM_BUCKETS; i++ )
+      uTotal += pHistogram->uBuckets[i];
+   if ( 0 == uTotal )
+      return 0;
+   unsigned long long uTarget = (uTotal * (unsigned long long)iPerMille + 999) / 1000;
+   if ( uTarget < 1 )
+      uTarget = 1;
+   unsigned long long uSum = 0;
+   for( int i=0; i<LATENCY_HISTOGRAM_BUCKETS; i++ )
+   {
+      uSum += pHistogram->uBuckets[i];
+      if ( uSum >= uTarget )
+      {
+         u32 uValue = latency_stats_get_bucket_max_value(i);
+         if ( (0 != pHistogram->uMaxMicros) && (uValue > pHistogram->uMaxMicros) )
+            uValue = pHistogram->uMaxMicros;
+         return uValue;
+      }
+   }
+   return pHistogram->uMaxMicros;
+}
+
+void latency_stats_compute_delta(type_latency_stage_histogram* pNow, type_latency_stage_histogram* pBefore, type_latency_stage_histogram* pOutput)
+{
+   if ( (NULL == pNow) || (NULL == pOutput) )
+      return;
+   if ( NULL == pBefore )
+   {
+      memcpy(pOutput, pNow, sizeof(type_latency_stage_histogram));
+      return;
+   }
+   pOutput->uCount = pNow->uCount - pBefore->uCount;
+   pOutput->uSumMicros = pNow->uSumMicros - pBefore->uSumMicros;
+   // Min/max are since the router start, not per interval
+   pOutput->uMinMicros = pNow->uMinMicros;
+   pOutput->uMaxMicros = pNow->uMaxMicros;
+   pOutput->uReserved = 0;
+   for( int i=0; i<LATENCY_HISTOGRAM_BUCKETS; i++ )
+      pOutput->uBuckets[i] = pNow->uBuckets[i] - pBefore->uBuckets[i];
+}
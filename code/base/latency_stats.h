@@ -0,0 +1,101 @@
+#pragma once
+
+#include "base.h"
+#include "config.h"
+
+// Per pipeline stage latency histograms, published in shared memory by the routers
+// (and by the vehicle telemetry process, for the FC telemetry stages).
+// Histograms are log-linear (HDR style), in microseconds: values below 16 us have one bucket
+// each, then each power of two is split into 8 buckets (at most 12.5% error).
+// Written by the routers (any thread), read by ruby_latency_stats. Readers compute
+// percentiles over deltas of two snapshots; the writer never resets the counters.
+
+#define SHARED_MEM_LATENCY_STATS_STATION "/SYSTEM_SHARED_MEM_LATENCY_STATS_STATION"
+#define SHARED_MEM_LATENCY_STATS_VEHICLE "/SYSTEM_SHARED_MEM_LATENCY_STATS_VEHICLE"
+#define SHARED_MEM_LATENCY_STATS_TELEMETRY_VEHICLE "/SYSTEM_SHARED_MEM_LATENCY_STATS_TELEMETRY_VEHICLE"
+
+#define LATENCY_STATS_PROCESS_ROUTER_STATION 0
+#define LATENCY_STATS_PROCESS_ROUTER_VEHICLE 1
+#define LATENCY_STATS_PROCESS_TELEMETRY_VEHICLE 2
+
+#define LATENCY_STATS_MAGIC 0x4C415453
+#define LATENCY_STATS_VERSION 3
+
+#define LATENCY_STAGE_RADIO_READ 0
+#define LATENCY_STAGE_RX_QUEUE_WAIT 1
+#define LATENCY_STAGE_DEDUP 2
+#define LATENCY_STAGE_FEC_DECODE 3
+#define LATENCY_STAGE_VIDEO_OUTPUT 4
+#define LATENCY_STAGE_IPC_SEND 5
+#define LATENCY_STAGE_IPC_RECV 6
+#define LATENCY_STAGE_CAMERA_READ 7
+#define LATENCY_STAGE_TX_INJECT 8
+// FC telemetry (vehicle telemetry process): from reading the first/last byte of a raw telemetry packet from the FC serial port, to sending it to the router
+#define LATENCY_STAGE_FC_SERIAL_TO_ROUTER 9
+#define LATENCY_STAGE_FC_FRAME_TO_ROUTER 10
+// RC (vehicle telemetry process): from reading the stick input on the controller to sending the RC frame (as measured by the controller),
+// and from receiving the RC frame from the router (RC rx process) to writing it to the FC
+#define LATENCY_STAGE_RC_INPUT_TO_SEND 11
+#define LATENCY_STAGE_RC_RECV_TO_FC 12
+#define LATENCY_STAGES_COUNT 13
+
+#define LATENCY_HISTOGRAM_SUB_BUCKETS 8
+#define LATENCY_HISTOGRAM_LINEAR_BUCKETS 16
+#define LATENCY_HISTOGRAM_BUCKETS (LATENCY_HISTOGRAM_LINEAR_BUCKETS + (32-4)*LATENCY_HISTOGRAM_SUB_BUCKETS)
+
+typedef struct
+{
+   u32 uCount;
+   u32 uMinMicros;
+   u32 uMaxMicros;
+   u32 uReserved;
+   unsigned long long uSumMicros;
+   u32 uBuckets[LATENCY_HISTOGRAM_BUCKETS];
+} ALIGN_STRUCT_SPEC_INFO type_latency_stage_histogram;
+
+typedef struct
+{
+   u32 uMagic;
+   u32 uVersion;
+   u32 uStagesCount;
+   u32 uBucketsCount;
+   u32 uProcessType;
+   u32 uProcessId;
+   u32 uTimeStartSeconds; // Wall clock time
+   u32 uReserved;
+   type_latency_stage_histogram stages[LATENCY_STAGES_COUNT];
+} ALIGN_STRUCT_SPEC_INFO type_latency_stats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Writer side (routers)
+int latency_stats_init_for_write(int iProcessType);
+// Same, but the stats are private to this process, not published (offline tools and tests)
+int latency_stats_init_local(int iProcessType);
+void latency_stats_close();
+int latency_stats_is_active();
+// The stats this process writes to, or NULL if not active
+type_latency_stats* latency_stats_get_current();
+
+// Returns the start time to pass to latency_stats_end(), or 0 if the stats are not active
+u32 latency_stats_start();
+void latency_stats_end(int iStage, u32 uStartTimeMicros);
+void latency_stats_add(int iStage, u32 uMicros);
+
+// Reader side
+type_latency_stats* latency_stats_open_for_read(int iProcessType);
+void latency_stats_close_read(type_latency_stats* pStats);
+
+const char* latency_stats_get_stage_name(int iStage);
+int latency_stats_get_bucket_index(u32 uMicros);
+u32 latency_stats_get_bucket_max_value(int iBucket);
+// Value (microseconds) under which iPerMille of the samples are (i.e. 990 for p99)
+u32 latency_stats_get_percentile(type_latency_stage_histogram* pHistogram, int iPerMille);
+// pOutput = pNow - pBefore
+void latency_stats_compute_delta(type_latency_stage_histogram* pNow, type_latency_stage_histogram* pBefore, type_latency_stage_histogram* pOutput);
+
+#ifdef __cplusplus
+}
+#endif
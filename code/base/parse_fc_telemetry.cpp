@@ -137,6 +137,7 @@ mavlink_status_t statusMav;
 mavlink_message_t msgMav;
 u32 s_vehicleMavId = 1;
 int s_iAllowAnyVehicleSysId = 0;
+int s_iParseLastFrameEnd = -1;
 
 
 void _rotate_point(float x, float y, float xCenter, float yCenter, float angle, float* px, float* py)
@@ -714,8 +715,13 @@ void _process_mav_message(t_packet_header_fc_telemetry* pdpfct, t_packet_header_
 
 bool parse_telemetry_from_fc( u8* buffer, int length, t_packet_header_fc_telemetry* pphfct, t_packet_header_ruby_telemetry_extended_v4* pPHRTE, u8 vehicleType, int telemetry_type )
 {
+   s_iParseLastFrameEnd = -1;
    if ( telemetry_type == TELEMETRY_TYPE_LTM )
-      return parse_telemetry_from_fc_ltm(buffer, length, pphfct, pPHRTE, vehicleType);
+   {
+      bool bRet = parse_telemetry_from_fc_ltm(buffer, length, pphfct, pPHRTE, vehicleType);
+      s_iParseLastFrameEnd = parse_telemetry_ltm_get_last_frame_end();
+      return bRet;
+   }
 
    bool ret = false;
    uint8_t c;
@@ -725,6 +731,7 @@ bool parse_telemetry_from_fc( u8* buffer, int length, t_packet_header_fc_telemet
       buffer++;
       if (mavlink_parse_char(0, c, &msgMav, &statusMav))
       {
+         s_iParseLastFrameEnd = i+1;
          if ( 0 == s_uTimeLastMAVLinkMessageFromFC )
             log_line("Started receiving valid MAVLink telemetry from FC");
          s_uTimeLastMAVLinkMessageFromFC = get_current_timestamp_ms();
@@ -759,6 +766,11 @@ char* get_last_message()
    return s_szLastMessages[s_iNextMessageIndex-1];
 }
 
+int parse_telemetry_get_last_frame_end()
+{
+   return s_iParseLastFrameEnd;
+}
+
 u32 get_time_last_mavlink_message_from_fc()
 {
    return s_uTimeLastMAVLinkMessageFromFC;
@@ -10,6 +10,8 @@ void parse_telemetry_remove_duplicate_messages(bool bRemove);
 void parse_telemetry_force_always_armed(bool bForce);
 
 bool parse_telemetry_from_fc( u8* buffer, int length, t_packet_header_fc_telemetry* pphfct, t_packet_header_ruby_telemetry_extended_v4* pPHRTE, u8 vehicleType, int telemetry_type );
+// Offset in the last buffer parsed right after the last complete frame (MAVLink or LTM) in it, -1 if no frame ended in it
+int parse_telemetry_get_last_frame_end();
 bool has_received_gps_info();
 bool has_received_flight_mode();
 u32  get_last_message_time();
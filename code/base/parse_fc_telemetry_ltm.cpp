@@ -75,6 +75,7 @@ static u8 s_StateLTMPayloadAddIndex = 0;
 
 static u8 s_LTMPayloadBuffer[1024];
 static u8 s_LTMPayloadReadIndex = 0;
+static int s_iLTMParseLastFrameEnd = -1;
 
 static u32 s_LTMLastCurrentComputeTime = 0;
 static u16 s_LTMLastConsumedCurrent = 0;
@@ -283,6 +284,7 @@ bool parse_telemetry_from_fc_ltm( u8* buffer, int length, t_packet_header_fc_tel
 {
    bool ret = false;
    u8 c;
+   s_iLTMParseLastFrameEnd = -1;
    for( int i=0; i<length; i++)
    {
       c = *buffer;
@@ -349,7 +351,7 @@ bool parse_telemetry_from_fc_ltm( u8* buffer, int length, t_packet_header_fc_tel
                  //printf("\nrecv %c ltm frame, %d bytes", s_LTMExpectedFrameType, s_StateLTMPayloadAddIndex );
               }
               s_StateLTMParser = LTM_PARSE_STATE_IDLE;
-
+              s_iLTMParseLastFrameEnd = i+1;
            }
            else
               s_LTMPayloadBuffer[s_StateLTMPayloadAddIndex++] = c;
@@ -357,3 +359,8 @@ bool parse_telemetry_from_fc_ltm( u8* buffer, int length, t_packet_header_fc_tel
    }
    return ret;
 }
+
+int parse_telemetry_ltm_get_last_frame_end()
+{
+   return s_iLTMParseLastFrameEnd;
+}
@@ -6,3 +6,5 @@
 #include "../radio/radiopackets2.h"
 
 bool parse_telemetry_from_fc_ltm( u8* buffer, int length, t_packet_header_fc_telemetry* pphfct, t_packet_header_ruby_telemetry_extended_v4* pPHRTE, u8 vehicleType );
+// Offset in the last buffer parsed right after the last complete LTM frame in it, -1 if no frame ended in it
+int parse_telemetry_ltm_get_last_frame_end();
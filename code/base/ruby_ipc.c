@@ -34,13 +34,18 @@
 #include "ruby_ipc.h"
 #include "hardware.h"
 #include "hw_procs.h"
+#include "latency_stats.h"
 #include "../common/string_utils.h"
 #include "../radio/radiopackets2.h"
 
 #include <sys/types.h>
 #include <sys/ipc.h>
 #include <sys/msg.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #include <errno.h>
+#include <signal.h>
 
 //#define RUBY_USE_FIFO_PIPES 1
 #define RUBY_USES_MSGQUEUES 1
@@ -65,12 +70,18 @@ int s_iRubyIPCChannelsFd[MAX_CHANNELS];
 int s_iRubyIPCChannelsType[MAX_CHANNELS];
 u8  s_uRubyIPCChannelsMsgId[MAX_CHANNELS];
 key_t s_uRubyIPCChannelsKeys[MAX_CHANNELS];
+u32 s_uRubyIPCChannelsDroppedMessages[MAX_CHANNELS];
+void* s_pRubyIPCChannelsRing[MAX_CHANNELS];
+void* s_pRubyIPCChannelsRetiredRing[MAX_CHANNELS];
+int s_iRubyIPCChannelsIsReadEndpoint[MAX_CHANNELS];
+u32 s_uRubyIPCChannelsStuckSlotTime[MAX_CHANNELS];
 
 static int s_iRubyIPCChannelsUniqueIdCounter = 1;
 
 int s_iRubyIPCChannelsCount = 0;
 
 static int s_iRubyIPCCountReadErrors = 0;
+static int s_iRubyIPCUseShmRings = -1;
 
 typedef struct
 {
@@ -160,20 +171,6 @@ void _ruby_ipc_log_channels()
    }
 }
 
-void _ruby_ipc_log_channel_info(int iChannelType, int iChannelId, int iChannelFd)
-{
-   if ( iChannelFd < 0 )
-      return;
-   struct msqid_ds msg_stats;
-   if ( 0 != msgctl(iChannelFd, IPC_STAT, &msg_stats) )
-      log_softerror_and_alarm("[IPC] Failed to get statistics on ICP message queue %s, id %d, fd %d",
-        _ruby_ipc_get_channel_name(iChannelType), iChannelId, iChannelFd );
-   else
-      log_line("[IPC] Channel %s (id: %d, fd: %d) info: %u pending messages, %u used bytes, max bytes in the IPC channel: %u bytes",
-         _ruby_ipc_get_channel_name(iChannelType), iChannelId,
-         iChannelFd, (u32)msg_stats.msg_qnum, (u32)msg_stats.msg_cbytes, (u32)msg_stats.msg_qbytes);
-}
-
 void _check_ruby_ipc_consistency()
 {
    for( int i=0; i<s_iRubyIPCChannelsCount-1; i++ )
@@ -193,6 +190,422 @@ void _check_ruby_ipc_consistency()
 }
 
 
+// Shared memory ring transport.
+// Used instead of the message queues when the FILE_CONFIG_IPC_USE_SHM_RINGS flag file is present.
+// Each channel is a shared memory object holding a fixed size ring of message slots.
+// Multiple writers (threads or processes) and one reader are supported, without locks:
+// each slot has a sequence number that tells if it's free for the writers or ready for the reader.
+// The reader can block on a futex in the ring header until a message is added to the ring.
+// Recovery:
+//  * The reader owns the ring: when it closes the channel, or when it opens a ring left by a reader that died,
+//    the ring is marked as closed and unlinked, so stale messages do not survive restarts. Writers see the
+//    closed flag on the next send and reopen the channel (a new ring).
+//  * A ring left half initialized by a process that died is unlinked and created again.
+//  * A slot claimed by a writer that died before publishing it is skipped by the reader.
+// Messages on rings have no CRC: the shared memory does not corrupt them (see ruby_ipc_message_crc_is_valid).
+
+#define IPC_SHM_RING_SLOTS 64
+#define IPC_SHM_RING_MAGIC 0x52494E47
+#define IPC_SHM_RING_STATE_READY 2
+#define IPC_SHM_RING_INIT_TIMEOUT_MS 100
+#define IPC_SHM_RING_STUCK_SLOT_MIN_MS 20
+#define IPC_SHM_RING_STUCK_SLOT_TIMEOUT_MS 500
+
+typedef struct
+{
+   u32 uSequence;
+   u32 uWriterPid;
+   u16 uLength;
+   u8  uMsgId;
+   u8  uDummy;
+   u8  uData[IPC_CHANNEL_MAX_MSG_SIZE];
+} type_ipc_shm_ring_slot;
+
+typedef struct
+{
+   u32 uInitState;
+   u32 uInitPid;
+   u32 uMagic;
+   u32 uSlotsCount;
+   u32 uSlotSize;
+   u32 uWritePos;
+   u32 uReadPos;
+   u32 uFutexCounter;
+   u32 uReaderWaiting;
+   u32 uMaxPendingMessages;
+   u32 uSentMessages;
+   u32 uDroppedMessages;
+   u32 uReaderPid;
+   u32 uClosed;
+   u32 uDummy[2];
+   type_ipc_shm_ring_slot slots[IPC_SHM_RING_SLOTS];
+} type_ipc_shm_ring;
+
+static int _ruby_ipc_uses_shm_rings()
+{
+   if ( -1 == s_iRubyIPCUseShmRings )
+   {
+      char szFile[MAX_FILE_PATH_SIZE];
+      strcpy(szFile, FOLDER_CONFIG);
+      strcat(szFile, FILE_CONFIG_IPC_USE_SHM_RINGS);
+      s_iRubyIPCUseShmRings = (access(szFile, R_OK) != -1)?1:0;
+      log_line("[IPC] Using %s for IPC channels.", s_iRubyIPCUseShmRings?"shared memory rings":"message queues");
+   }
+   return s_iRubyIPCUseShmRings;
+}
+
+static void _ruby_ipc_get_shm_ring_name(int nChannelType, char* szOutName)
+{
+   sprintf(szOutName, "/ruby_ipc_ring_%d", nChannelType);
+}
+
+static int _ruby_ipc_process_is_alive(u32 uPid)
+{
+   if ( 0 == uPid )
+      return 0;
+   if ( (0 == kill((pid_t)uPid, 0)) || (errno != ESRCH) )
+      return 1;
+   return 0;
+}
+
+// Marks the ring as closed (writers will reopen the channel) and removes its name, so the next open creates a new ring
+
+static void _ruby_ipc_discard_shm_ring(type_ipc_shm_ring* pRing, const char* szName)
+{
+   if ( NULL != pRing )
+      __atomic_store_n(&pRing->uClosed, 1, __ATOMIC_RELEASE);
+   shm_unlink(szName);
+}
+
+static type_ipc_shm_ring* _ruby_ipc_open_shm_ring(int nChannelType, int bReadEndpoint, int* pOutFd, int iRetriesLeft)
+{
+   char szName[64];
+   _ruby_ipc_get_shm_ring_name(nChannelType, szName);
+   *pOutFd = -1;
+
+   int fd = shm_open(szName, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+   if ( fd < 0 )
+   {
+      log_softerror_and_alarm("[IPC] Failed to open shared memory ring for channel %s, error: %s", _ruby_ipc_get_channel_name(nChannelType), strerror(errno));
+      return NULL;
+   }
+   // Does not change the content if the ring was already created by the other endpoint
+   if ( ftruncate(fd, sizeof(type_ipc_shm_ring)) == -1 )
+   {
+      log_softerror_and_alarm("[IPC] Failed to init (ftruncate) shared memory ring for channel %s", _ruby_ipc_get_channel_name(nChannelType));
+      close(fd);
+      return NULL;
+   }
+   type_ipc_shm_ring* pRing = (type_ipc_shm_ring*) mmap(NULL, sizeof(type_ipc_shm_ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   if ( pRing == MAP_FAILED )
+   {
+      log_softerror_and_alarm("[IPC] Failed to map shared memory ring for channel %s", _ruby_ipc_get_channel_name(nChannelType));
+      close(fd);
+      return NULL;
+   }
+
+   // First endpoint to open the ring initializes it (the other one waits for it to be ready)
+
+   u32 uState = 0;
+   if ( __atomic_compare_exchange_n(&pRing->uInitState, &uState, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ||
+        ((IPC_SHM_RING_STATE_READY == uState) && ((pRing->uMagic != IPC_SHM_RING_MAGIC) || (pRing->uSlotsCount != IPC_SHM_RING_SLOTS) || (pRing->uSlotSize != sizeof(type_ipc_shm_ring_slot)))) )
+   {
+      pRing->uInitPid = (u32)getpid();
+      pRing->uMagic = IPC_SHM_RING_MAGIC;
+      pRing->uSlotsCount = IPC_SHM_RING_SLOTS;
+      pRing->uSlotSize = sizeof(type_ipc_shm_ring_slot);
+      pRing->uWritePos = 0;
+      pRing->uReadPos = 0;
+      pRing->uFutexCounter = 0;
+      pRing->uReaderWaiting = 0;
+      pRing->uMaxPendingMessages = 0;
+      pRing->uSentMessages = 0;
+      pRing->uDroppedMessages = 0;
+      pRing->uReaderPid = 0;
+      pRing->uClosed = 0;
+      for( int i=0; i<IPC_SHM_RING_SLOTS; i++ )
+      {
+         pRing->slots[i].uSequence = i;
+         pRing->slots[i].uWriterPid = 0;
+      }
+      __atomic_store_n(&pRing->uInitState, IPC_SHM_RING_STATE_READY, __ATOMIC_RELEASE);
+      log_line("[IPC] Created shared memory ring %s for channel %s (%d slots, %d bytes)", szName, _ruby_ipc_get_channel_name(nChannelType), IPC_SHM_RING_SLOTS, (int)sizeof(type_ipc_shm_ring));
+   }
+   else
+   {
+      int iWait = IPC_SHM_RING_INIT_TIMEOUT_MS;
+      while ( (IPC_SHM_RING_STATE_READY != __atomic_load_n(&pRing->uInitState, __ATOMIC_ACQUIRE)) && (iWait > 0) )
+      {
+         // The process that started the init died: do not wait for it
+         u32 uInitPid = __atomic_load_n(&pRing->uInitPid, __ATOMIC_ACQUIRE);
+         if ( (0 != uInitPid) && (! _ruby_ipc_process_is_alive(uInitPid)) )
+            break;
+         hardware_sleep_ms(1);
+         iWait--;
+      }
+      if ( IPC_SHM_RING_STATE_READY != __atomic_load_n(&pRing->uInitState, __ATOMIC_ACQUIRE) )
+      {
+         log_softerror_and_alarm("[IPC] Shared memory ring for channel %s was not initialized by the other endpoint (pid %u). Creating it again.",
+            _ruby_ipc_get_channel_name(nChannelType), pRing->uInitPid);
+         _ruby_ipc_discard_shm_ring(pRing, szName);
+         munmap(pRing, sizeof(type_ipc_shm_ring));
+         close(fd);
+         if ( iRetriesLeft > 0 )
+            return _ruby_ipc_open_shm_ring(nChannelType, bReadEndpoint, pOutFd, iRetriesLeft-1);
+         return NULL;
+      }
+
+      // The previous reader died without closing the channel: its pending messages are stale
+      u32 uReaderPid = __atomic_load_n(&pRing->uReaderPid, __ATOMIC_ACQUIRE);
+      if ( bReadEndpoint && (0 != uReaderPid) && (uReaderPid != (u32)getpid()) && (! _ruby_ipc_process_is_alive(uReaderPid)) )
+      {
+         log_line("[IPC] Shared memory ring %s for channel %s was left by a reader that stopped (pid %u), discarding its %u pending messages.",
+            szName, _ruby_ipc_get_channel_name(nChannelType), uReaderPid, pRing->uWritePos - pRing->uReadPos);
+         _ruby_ipc_discard_shm_ring(pRing, szName);
+         munmap(pRing, sizeof(type_ipc_shm_ring));
+         close(fd);
+         if ( iRetriesLeft > 0 )
+            return _ruby_ipc_open_shm_ring(nChannelType, bReadEndpoint, pOutFd, iRetriesLeft-1);
+         return NULL;
+      }
+      log_line("[IPC] Opened existing shared memory ring %s for channel %s, %u pending messages.", szName, _ruby_ipc_get_channel_name(nChannelType), pRing->uWritePos - pRing->uReadPos);
+   }
+   if ( bReadEndpoint )
+      __atomic_store_n(&pRing->uReaderPid, (u32)getpid(), __ATOMIC_RELEASE);
+   *pOutFd = fd;
+   return pRing;
+}
+
+static int _ruby_ipc_open_shm_ring_endpoint(int nChannelType, int bWriteEndpoint)
+{
+   int fd = -1;
+   type_ipc_shm_ring* pRing = _ruby_ipc_open_shm_ring(nChannelType, bWriteEndpoint?0:1, &fd, 1);
+   if ( NULL == pRing )
+      return 0;
+
+   s_iRubyIPCChannelsType[s_iRubyIPCChannelsCount] = nChannelType;
+   s_uRubyIPCChannelsMsgId[s_iRubyIPCChannelsCount] = 0;
+   s_uRubyIPCChannelsKeys[s_iRubyIPCChannelsCount] = generate_msgqueue_key(nChannelType);
+   s_iRubyIPCChannelsFd[s_iRubyIPCChannelsCount] = fd;
+   s_uRubyIPCChannelsDroppedMessages[s_iRubyIPCChannelsCount] = 0;
+   s_pRubyIPCChannelsRing[s_iRubyIPCChannelsCount] = pRing;
+   s_pRubyIPCChannelsRetiredRing[s_iRubyIPCChannelsCount] = NULL;
+   s_iRubyIPCChannelsIsReadEndpoint[s_iRubyIPCChannelsCount] = bWriteEndpoint?0:1;
+   s_uRubyIPCChannelsStuckSlotTime[s_iRubyIPCChannelsCount] = 0;
+   s_iRubyIPCChannelsUniqueIds[s_iRubyIPCChannelsCount] = s_iRubyIPCChannelsUniqueIdCounter;
+   s_iRubyIPCChannelsUniqueIdCounter++;
+   s_iRubyIPCChannelsCount++;
+
+   log_line("[IPC] Opened IPC channel %s %s endpoint (shared memory ring): success, fd: %d, id: %d. (%d channels currently opened).",
+      _ruby_ipc_get_channel_name(nChannelType), bWriteEndpoint?"write":"read", fd, s_iRubyIPCChannelsUniqueIds[s_iRubyIPCChannelsCount-1], s_iRubyIPCChannelsCount);
+   _check_ruby_ipc_consistency();
+   _ruby_ipc_log_channels();
+   return s_iRubyIPCChannelsUniqueIds[s_iRubyIPCChannelsCount-1];
+}
+
+// The reader endpoint (or a full IPC cleanup) discards the ring: writers reopen the channel on the next send
+
+static void _ruby_ipc_close_shm_ring(int iChannelIndex, int bDiscard)
+{
+   if ( NULL == s_pRubyIPCChannelsRing[iChannelIndex] )
+      return;
+   if ( bDiscard )
+   {
+      char szName[64];
+      _ruby_ipc_get_shm_ring_name(s_iRubyIPCChannelsType[iChannelIndex], szName);
+      type_ipc_shm_ring* pRing = (type_ipc_shm_ring*) s_pRubyIPCChannelsRing[iChannelIndex];
+      __atomic_store_n(&pRing->uReaderPid, 0, __ATOMIC_RELEASE);
+      _ruby_ipc_discard_shm_ring(pRing, szName);
+   }
+   munmap(s_pRubyIPCChannelsRing[iChannelIndex], sizeof(type_ipc_shm_ring));
+   s_pRubyIPCChannelsRing[iChannelIndex] = NULL;
+   if ( NULL != s_pRubyIPCChannelsRetiredRing[iChannelIndex] )
+      munmap(s_pRubyIPCChannelsRetiredRing[iChannelIndex], sizeof(type_ipc_shm_ring));
+   s_pRubyIPCChannelsRetiredRing[iChannelIndex] = NULL;
+   close(s_iRubyIPCChannelsFd[iChannelIndex]);
+}
+
+// Called by a writer when the reader discarded the ring. The old ring stays mapped until the next reopen
+// or until the channel is closed, as other threads of this process can still be using it.
+
+static int _ruby_ipc_reopen_shm_ring(int iChannelIndex)
+{
+   int fd = -1;
+   type_ipc_shm_ring* pRing = _ruby_ipc_open_shm_ring(s_iRubyIPCChannelsType[iChannelIndex], 0, &fd, 1);
+   if ( NULL == pRing )
+      return 0;
+   if ( NULL != s_pRubyIPCChannelsRetiredRing[iChannelIndex] )
+      munmap(s_pRubyIPCChannelsRetiredRing[iChannelIndex], sizeof(type_ipc_shm_ring));
+   s_pRubyIPCChannelsRetiredRing[iChannelIndex] = s_pRubyIPCChannelsRing[iChannelIndex];
+   close(s_iRubyIPCChannelsFd[iChannelIndex]);
+   s_iRubyIPCChannelsFd[iChannelIndex] = fd;
+   s_pRubyIPCChannelsRing[iChannelIndex] = pRing;
+   log_line("[IPC] Reopened IPC channel %s (shared memory ring), the reader discarded the previous ring.", _ruby_ipc_get_channel_name(s_iRubyIPCChannelsType[iChannelIndex]));
+   return 1;
+}
+
+static int _ruby_ipc_shm_ring_send(int iChannelIndex, u8* pMessage, int iLength)
+{
+   type_ipc_shm_ring* pRing = (type_ipc_shm_ring*) s_pRubyIPCChannelsRing[iChannelIndex];
+   if ( __atomic_load_n(&pRing->uClosed, __ATOMIC_ACQUIRE) )
+   {
+      if ( ! _ruby_ipc_reopen_shm_ring(iChannelIndex) )
+         return 0;
+      pRing = (type_ipc_shm_ring*) s_pRubyIPCChannelsRing[iChannelIndex];
+   }
+
+   u32 uPos = __atomic_load_n(&pRing->uWritePos, __ATOMIC_RELAXED);
+   type_ipc_shm_ring_slot* pSlot = NULL;
+
+   while ( 1 )
+   {
+      pSlot = &pRing->slots[uPos % IPC_SHM_RING_SLOTS];
+      u32 uSequence = __atomic_load_n(&pSlot->uSequence, __ATOMIC_ACQUIRE);
+      int iDiff = (int)(uSequence - uPos);
+      if ( 0 == iDiff )
+      {
+         if ( __atomic_compare_exchange_n(&pRing->uWritePos, &uPos, uPos+1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+            break;
+      }
+      else if ( iDiff < 0 )
+      {
+         // Ring is full, the reader is not keeping up. Never block the writer.
+         __atomic_add_fetch(&pRing->uDroppedMessages, 1, __ATOMIC_RELAXED);
+         s_uRubyIPCChannelsDroppedMessages[iChannelIndex]++;
+         log_softerror_and_alarm("[IPC] Failed to write to IPC %s, shared memory ring is full (%d messages). Dropped messages: %u",
+            _ruby_ipc_get_channel_name(s_iRubyIPCChannelsType[iChannelIndex]), IPC_SHM_RING_SLOTS, s_uRubyIPCChannelsDroppedMessages[iChannelIndex]);
+         return 0;
+      }
+      else
+         uPos = __atomic_load_n(&pRing->uWritePos, __ATOMIC_RELAXED);
+   }
+
+   pSlot->uWriterPid = (u32)getpid();
+   memcpy(pSlot->uData, pMessage, iLength);
+   pSlot->uLength = (u16)iLength;
+   pSlot->uMsgId = s_uRubyIPCChannelsMsgId[iChannelIndex];
+   __atomic_store_n(&pSlot->uSequence, uPos+1, __ATOMIC_RELEASE);
+
+   __atomic_add_fetch(&pRing->uSentMessages, 1, __ATOMIC_RELAXED);
+   u32 uPending = uPos + 1 - __atomic_load_n(&pRing->uReadPos, __ATOMIC_RELAXED);
+   if ( uPending > __atomic_load_n(&pRing->uMaxPendingMessages, __ATOMIC_RELAXED) )
+      __atomic_store_n(&pRing->uMaxPendingMessages, uPending, __ATOMIC_RELAXED);
+
+   // Wake up the reader if it's blocked waiting for messages
+   __atomic_add_fetch(&pRing->uFutexCounter, 1, __ATOMIC_SEQ_CST);
+   if ( __atomic_load_n(&pRing->uReaderWaiting, __ATOMIC_SEQ_CST) )
+      syscall(SYS_futex, &pRing->uFutexCounter, FUTEX_WAKE, 1, NULL, NULL, 0);
+   return iLength;
+}
+
+static int _ruby_ipc_shm_ring_has_message(type_ipc_shm_ring* pRing)
+{
+   u32 uPos = pRing->uReadPos;
+   type_ipc_shm_ring_slot* pSlot = &pRing->slots[uPos % IPC_SHM_RING_SLOTS];
+   return (__atomic_load_n(&pSlot->uSequence, __ATOMIC_ACQUIRE) == uPos + 1)?1:0;
+}
+
+// Called by the reader when there is no message to read at the read position:
+// skips the slot if a writer claimed it and did not publish it in time (i.e. the writer died after claiming it),
+// and repairs the slot if a writer that was skipped published it later.
+
+static void _ruby_ipc_shm_ring_check_stuck_slot(int iChannelIndex, type_ipc_shm_ring* pRing)
+{
+   u32 uPos = pRing->uReadPos;
+   type_ipc_shm_ring_slot* pSlot = &pRing->slots[uPos % IPC_SHM_RING_SLOTS];
+   if ( __atomic_load_n(&pRing->uWritePos, __ATOMIC_ACQUIRE) == uPos )
+   {
+      s_uRubyIPCChannelsStuckSlotTime[iChannelIndex] = 0;
+      u32 uSequence = __atomic_load_n(&pSlot->uSequence, __ATOMIC_ACQUIRE);
+      if ( uSequence != uPos )
+      {
+         log_softerror_and_alarm("[IPC] Repaired slot %u on channel %s (late write from a skipped writer).", uPos % IPC_SHM_RING_SLOTS, _ruby_ipc_get_channel_name(s_iRubyIPCChannelsType[iChannelIndex]));
+         __atomic_store_n(&pSlot->uSequence, uPos, __ATOMIC_RELEASE);
+      }
+      return;
+   }
+
+   u32 uTimeNow = get_current_timestamp_ms();
+   if ( 0 == s_uRubyIPCChannelsStuckSlotTime[iChannelIndex] )
+   {
+      s_uRubyIPCChannelsStuckSlotTime[iChannelIndex] = uTimeNow;
+      return;
+   }
+   u32 uStuckTime = uTimeNow - s_uRubyIPCChannelsStuckSlotTime[iChannelIndex];
+   if ( uStuckTime < IPC_SHM_RING_STUCK_SLOT_MIN_MS )
+      return;
+   if ( (uStuckTime < IPC_SHM_RING_STUCK_SLOT_TIMEOUT_MS) && _ruby_ipc_process_is_alive(pSlot->uWriterPid) )
+      return;
+   if ( _ruby_ipc_shm_ring_has_message(pRing) )
+      return;
+
+   log_softerror_and_alarm("[IPC] Skipped slot %u on channel %s, the writer (pid %u) did not finish writing it in %u ms.",
+      uPos % IPC_SHM_RING_SLOTS, _ruby_ipc_get_channel_name(s_iRubyIPCChannelsType[iChannelIndex]), pSlot->uWriterPid, uStuckTime);
+   __atomic_store_n(&pSlot->uSequence, uPos + IPC_SHM_RING_SLOTS, __ATOMIC_RELEASE);
+   __atomic_store_n(&pRing->uReadPos, uPos+1, __ATOMIC_RELEASE);
+   s_uRubyIPCChannelsStuckSlotTime[iChannelIndex] = 0;
+}
+
+static u8* _ruby_ipc_shm_ring_read(int iChannelIndex, u8* pOutputBuffer)
+{
+   type_ipc_shm_ring* pRing = (type_ipc_shm_ring*) s_pRubyIPCChannelsRing[iChannelIndex];
+   if ( ! _ruby_ipc_shm_ring_has_message(pRing) )
+   {
+      _ruby_ipc_shm_ring_check_stuck_slot(iChannelIndex, pRing);
+      return NULL;
+   }
+   s_uRubyIPCChannelsStuckSlotTime[iChannelIndex] = 0;
+
+   u32 uPos = pRing->uReadPos;
+   type_ipc_shm_ring_slot* pSlot = &pRing->slots[uPos % IPC_SHM_RING_SLOTS];
+   u8* pReturn = NULL;
+   int iMsgLen = pSlot->uLength;
+   if ( (iMsgLen <= 0) || (iMsgLen >= IPC_CHANNEL_MAX_MSG_SIZE - 6) )
+      log_softerror_and_alarm("[IPC] Received invalid message on channel %s, id: %d, length: %d", _ruby_ipc_get_channel_name(s_iRubyIPCChannelsType[iChannelIndex]), pSlot->uMsgId, iMsgLen );
+   else
+   {
+      memcpy(pOutputBuffer, pSlot->uData, iMsgLen);
+      pReturn = pOutputBuffer;
+   }
+   __atomic_store_n(&pSlot->uSequence, uPos + IPC_SHM_RING_SLOTS, __ATOMIC_RELEASE);
+   __atomic_store_n(&pRing->uReadPos, uPos+1, __ATOMIC_RELEASE);
+   return pReturn;
+}
+
+static int _ruby_ipc_find_channel_index(int iChannelUniqueId)
+{
+   for( int i=0; i<s_iRubyIPCChannelsCount; i++ )
+   {
+      if ( s_iRubyIPCChannelsUniqueIds[i] == iChannelUniqueId )
+         return i;
+   }
+   return -1;
+}
+
+
+void _ruby_ipc_log_channel_info(int iChannelType, int iChannelId, int iChannelFd)
+{
+   if ( iChannelFd < 0 )
+      return;
+   int iIndex = _ruby_ipc_find_channel_index(iChannelId);
+   if ( (iIndex >= 0) && (NULL != s_pRubyIPCChannelsRing[iIndex]) )
+   {
+      type_ipc_shm_ring* pRing = (type_ipc_shm_ring*) s_pRubyIPCChannelsRing[iIndex];
+      log_line("[IPC] Channel %s (id: %d, fd: %d) info: shared memory ring, %u pending messages, max pending: %u, %d slots, %u sent messages, %u dropped messages",
+         _ruby_ipc_get_channel_name(iChannelType), iChannelId, iChannelFd,
+         pRing->uWritePos - pRing->uReadPos, pRing->uMaxPendingMessages, IPC_SHM_RING_SLOTS, pRing->uSentMessages, pRing->uDroppedMessages);
+      return;
+   }
+   struct msqid_ds msg_stats;
+   if ( 0 != msgctl(iChannelFd, IPC_STAT, &msg_stats) )
+      log_softerror_and_alarm("[IPC] Failed to get statistics on ICP message queue %s, id %d, fd %d",
+        _ruby_ipc_get_channel_name(iChannelType), iChannelId, iChannelFd );
+   else
+      log_line("[IPC] Channel %s (id: %d, fd: %d) info: %u pending messages, %u used bytes, max bytes in the IPC channel: %u bytes",
+         _ruby_ipc_get_channel_name(iChannelType), iChannelId,
+         iChannelFd, (u32)msg_stats.msg_qnum, (u32)msg_stats.msg_cbytes, (u32)msg_stats.msg_qbytes);
+}
+
 int ruby_init_ipc_channels()
 {
    #if defined(HW_PLATFORM_RASPBERRY) || defined(HW_PLATFORM_RADXA)
@@ -258,6 +671,11 @@ void ruby_clear_all_ipc_channels()
 
    for( int i=0; i<s_iRubyIPCChannelsCount; i++ )
    {
+      if ( NULL != s_pRubyIPCChannelsRing[i] )
+      {
+         _ruby_ipc_close_shm_ring(i, 1);
+         continue;
+      }
       int iRes = msgctl(s_iRubyIPCChannelsFd[i],IPC_RMID,NULL);
       if ( iRes < 0 )
          log_softerror_and_alarm("[IPC] Failed to remove msgque [%s], error code: %d, error: %s",
@@ -284,8 +702,13 @@ int ruby_open_ipc_channel_write_endpoint(int nChannelType)
       return 0;
    }
 
+   if ( _ruby_ipc_uses_shm_rings() )
+      return _ruby_ipc_open_shm_ring_endpoint(nChannelType, 1);
+
    s_iRubyIPCChannelsType[s_iRubyIPCChannelsCount] = nChannelType;
    s_uRubyIPCChannelsMsgId[s_iRubyIPCChannelsCount] = 0;
+   s_uRubyIPCChannelsDroppedMessages[s_iRubyIPCChannelsCount] = 0;
+   s_pRubyIPCChannelsRing[s_iRubyIPCChannelsCount] = NULL;
 
    #ifdef RUBY_USE_FIFO_PIPES
 
@@ -374,8 +797,13 @@ int ruby_open_ipc_channel_read_endpoint(int nChannelType)
       return 0;
    }
 
+   if ( _ruby_ipc_uses_shm_rings() )
+      return _ruby_ipc_open_shm_ring_endpoint(nChannelType, 0);
+
    s_iRubyIPCChannelsType[s_iRubyIPCChannelsCount] = nChannelType;
    s_uRubyIPCChannelsMsgId[s_iRubyIPCChannelsCount] = 0;
+   s_uRubyIPCChannelsDroppedMessages[s_iRubyIPCChannelsCount] = 0;
+   s_pRubyIPCChannelsRing[s_iRubyIPCChannelsCount] = NULL;
 
    #ifdef RUBY_USE_FIFO_PIPES
 
@@ -470,6 +898,13 @@ int ruby_close_ipc_channel(int iChannelUniqueId)
       log_softerror_and_alarm("[IPC] Warning: closing invalid fd 0 for unique channel %d, channel index %d, (%s)",
        iChannelUniqueId, iChannelIndex, _ruby_ipc_get_channel_name(s_iRubyIPCChannelsType[iChannelIndex]));
 
+   if ( NULL != s_pRubyIPCChannelsRing[iChannelIndex] )
+   {
+      _ruby_ipc_log_channel_info(s_iRubyIPCChannelsType[iChannelIndex], iChannelUniqueId, fdToClose);
+      _ruby_ipc_close_shm_ring(iChannelIndex, s_iRubyIPCChannelsIsReadEndpoint[iChannelIndex]);
+   }
+   else
+   {
    #ifdef RUBY_USE_FIFO_PIPES
    close(fdToClose);
    #endif
@@ -477,6 +912,7 @@ int ruby_close_ipc_channel(int iChannelUniqueId)
    #ifdef RUBY_USES_MSGQUEUES
    msgctl(fdToClose,IPC_RMID,NULL);
    #endif
+   }
 
 
    log_line("[IPC] Closed IPC channel %s, channel index %d, unique id %d, fd %d",
@@ -489,6 +925,11 @@ int ruby_close_ipc_channel(int iChannelUniqueId)
       s_iRubyIPCChannelsType[k] = s_iRubyIPCChannelsType[k+1];
       s_iRubyIPCChannelsUniqueIds[k] = s_iRubyIPCChannelsUniqueIds[k+1];
       s_uRubyIPCChannelsMsgId[k] = s_uRubyIPCChannelsMsgId[k+1];
+      s_uRubyIPCChannelsDroppedMessages[k] = s_uRubyIPCChannelsDroppedMessages[k+1];
+      s_pRubyIPCChannelsRing[k] = s_pRubyIPCChannelsRing[k+1];
+      s_pRubyIPCChannelsRetiredRing[k] = s_pRubyIPCChannelsRetiredRing[k+1];
+      s_iRubyIPCChannelsIsReadEndpoint[k] = s_iRubyIPCChannelsIsReadEndpoint[k+1];
+      s_uRubyIPCChannelsStuckSlotTime[k] = s_uRubyIPCChannelsStuckSlotTime[k+1];
 
    }
    s_iRubyIPCChannelsCount--;
@@ -497,7 +938,7 @@ int ruby_close_ipc_channel(int iChannelUniqueId)
    return 1;
 }
 
-int ruby_ipc_channel_send_message(int iChannelUniqueId, u8* pMessage, int iLength)
+static int _ruby_ipc_channel_send_message(int iChannelUniqueId, u8* pMessage, int iLength)
 {
    if ( iChannelUniqueId < 0 || s_iRubyIPCChannelsCount == 0 )
    {
@@ -545,6 +986,12 @@ int ruby_ipc_channel_send_message(int iChannelUniqueId, u8* pMessage, int iLengt
       return 0;
    }
 
+   s_uRubyIPCChannelsMsgId[iFoundIndex]++;
+
+   // No CRC on shared memory rings
+   if ( NULL != s_pRubyIPCChannelsRing[iFoundIndex] )
+      return _ruby_ipc_shm_ring_send(iFoundIndex, pMessage, iLength);
+
    u32 crc = base_compute_crc32(pMessage + sizeof(u32), iLength-sizeof(u32)); 
    u32* pTmp = (u32*)pMessage;
    *pTmp = crc;
@@ -555,8 +1002,6 @@ int ruby_ipc_channel_send_message(int iChannelUniqueId, u8* pMessage, int iLengt
    u32 uTimeStart = get_current_timestamp_ms();
    #endif
 
-   s_uRubyIPCChannelsMsgId[iFoundIndex]++;
-
    #ifdef RUBY_USE_FIFO_PIPES
    res = write(iChannelFd, pMessage, iLength);
    #endif
@@ -650,6 +1095,9 @@ int ruby_ipc_channel_send_message(int iChannelUniqueId, u8* pMessage, int iLengt
       hardware_sleep_ms(10);
 
    } while (iRetryCounter > 0);
+
+   if ( 0 == res )
+      s_uRubyIPCChannelsDroppedMessages[iFoundIndex]++;
    #endif
 
    #ifdef PROFILE_IPC
@@ -665,7 +1113,7 @@ int ruby_ipc_channel_send_message(int iChannelUniqueId, u8* pMessage, int iLengt
 }
 
 
-u8* ruby_ipc_try_read_message(int iChannelUniqueId, u8* pTempBuffer, int* pTempBufferPos, u8* pOutputBuffer)
+static u8* _ruby_ipc_try_read_message(int iChannelUniqueId, u8* pTempBuffer, int* pTempBufferPos, u8* pOutputBuffer)
 {
    if ( iChannelUniqueId < 0 || s_iRubyIPCChannelsCount == 0 )
    {
@@ -699,6 +1147,9 @@ u8* ruby_ipc_try_read_message(int iChannelUniqueId, u8* pTempBuffer, int* pTempB
       return NULL;
    }
 
+   if ( NULL != s_pRubyIPCChannelsRing[iFoundIndex] )
+      return _ruby_ipc_shm_ring_read(iFoundIndex, pOutputBuffer);
+
    u8* pReturn = NULL;
    int lenReadIPCMsgQueue = 0;
 
@@ -828,7 +1279,97 @@ u8* ruby_ipc_try_read_message(int iChannelUniqueId, u8* pTempBuffer, int* pTempB
    return pReturn;
 }
 
+int ruby_ipc_channel_send_message(int iChannelUniqueId, u8* pMessage, int iLength)
+{
+   u32 uTimeStart = latency_stats_start();
+   int iRes = _ruby_ipc_channel_send_message(iChannelUniqueId, pMessage, iLength);
+   latency_stats_end(LATENCY_STAGE_IPC_SEND, uTimeStart);
+   return iRes;
+}
+
+// Only the reads that returned a message are added to the latency stats
+
+u8* ruby_ipc_try_read_message(int iChannelUniqueId, u8* pTempBuffer, int* pTempBufferPos, u8* pOutputBuffer)
+{
+   u32 uTimeStart = latency_stats_start();
+   u8* pRes = _ruby_ipc_try_read_message(iChannelUniqueId, pTempBuffer, pTempBufferPos, pOutputBuffer);
+   if ( NULL != pRes )
+      latency_stats_end(LATENCY_STAGE_IPC_RECV, uTimeStart);
+   return pRes;
+}
+
 int ruby_ipc_get_read_continous_error_count()
 {
    return s_iRubyIPCCountReadErrors;
-}
\ No newline at end of file
+}
+
+// Blocks until a message is available on the channel or the timeout expires.
+// Returns 1 if a message is available, 0 on timeout, -1 if the channel does not support blocking waits
+// (message queues channels), in which case the caller should keep polling the channel.
+
+int ruby_ipc_wait_for_message(int iChannelUniqueId, u32 uTimeoutMs)
+{
+   int iIndex = _ruby_ipc_find_channel_index(iChannelUniqueId);
+   if ( (iIndex < 0) || (NULL == s_pRubyIPCChannelsRing[iIndex]) )
+      return -1;
+
+   type_ipc_shm_ring* pRing = (type_ipc_shm_ring*) s_pRubyIPCChannelsRing[iIndex];
+   __atomic_store_n(&pRing->uReaderWaiting, 1, __ATOMIC_SEQ_CST);
+   u32 uFutexCounter = __atomic_load_n(&pRing->uFutexCounter, __ATOMIC_SEQ_CST);
+   if ( ! _ruby_ipc_shm_ring_has_message(pRing) )
+   {
+      struct timespec ts;
+      ts.tv_sec = uTimeoutMs/1000;
+      ts.tv_nsec = (uTimeoutMs%1000)*1000000;
+      syscall(SYS_futex, &pRing->uFutexCounter, FUTEX_WAIT, uFutexCounter, &ts, NULL, 0);
+   }
+   __atomic_store_n(&pRing->uReaderWaiting, 0, __ATOMIC_SEQ_CST);
+   return _ruby_ipc_shm_ring_has_message(pRing);
+}
+
+// Messages read from shared memory rings have no CRC (it is not computed on send); the others must have a valid one
+
+int ruby_ipc_message_crc_is_valid(u8* pMessage, int iLength)
+{
+   if ( (NULL == pMessage) || (iLength < (int)sizeof(u32)) )
+      return 0;
+   if ( _ruby_ipc_uses_shm_rings() )
+      return 1;
+   return radio_packet_check_crc(pMessage, iLength);
+}
+
+int ruby_ipc_get_channel_stats(int iChannelUniqueId, type_ruby_ipc_channel_stats* pStats)
+{
+   if ( NULL == pStats )
+      return 0;
+   memset(pStats, 0, sizeof(type_ruby_ipc_channel_stats));
+   int iIndex = _ruby_ipc_find_channel_index(iChannelUniqueId);
+   if ( iIndex < 0 )
+      return 0;
+
+   pStats->uDroppedMessagesLocal = s_uRubyIPCChannelsDroppedMessages[iIndex];
+   if ( NULL != s_pRubyIPCChannelsRing[iIndex] )
+   {
+      type_ipc_shm_ring* pRing = (type_ipc_shm_ring*) s_pRubyIPCChannelsRing[iIndex];
+      pStats->uIsSharedMemoryRing = 1;
+      pStats->uPendingMessages = pRing->uWritePos - pRing->uReadPos;
+      pStats->uMaxPendingMessages = pRing->uMaxPendingMessages;
+      pStats->uMaxMessages = IPC_SHM_RING_SLOTS;
+      pStats->uSentMessages = pRing->uSentMessages;
+      pStats->uDroppedMessages = pRing->uDroppedMessages;
+      return 1;
+   }
+
+   #ifdef RUBY_USES_MSGQUEUES
+   struct msqid_ds msg_stats;
+   if ( 0 == msgctl(s_iRubyIPCChannelsFd[iIndex], IPC_STAT, &msg_stats) )
+   {
+      pStats->uPendingMessages = (u32)msg_stats.msg_qnum;
+      pStats->uMaxPendingMessages = (u32)msg_stats.msg_qnum;
+      if ( msg_stats.msg_qbytes > 0 )
+         pStats->uMaxMessages = (u32)msg_stats.msg_qbytes / IPC_CHANNEL_MAX_MSG_SIZE;
+   }
+   #endif
+   pStats->uDroppedMessages = pStats->uDroppedMessagesLocal;
+   return 1;
+}
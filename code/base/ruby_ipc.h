@@ -16,6 +16,17 @@
 
 #define RUBY_PIPES_EXTRA_FLAGS O_NONBLOCK
 
+typedef struct
+{
+   u32 uIsSharedMemoryRing;
+   u32 uPendingMessages;
+   u32 uMaxPendingMessages;
+   u32 uMaxMessages;
+   u32 uSentMessages; // Total for all the writers (shared memory rings only)
+   u32 uDroppedMessages; // Total for all the writers (shared memory rings only)
+   u32 uDroppedMessagesLocal; // Dropped by this process
+} type_ruby_ipc_channel_stats;
+
 #ifdef __cplusplus
 extern "C" {
 #endif 
@@ -33,6 +44,10 @@ int ruby_close_ipc_channel(int iChannelUniqueId);
 int ruby_ipc_channel_send_message(int iChannelUniqueId, u8* pMessage, int iLength);
 u8* ruby_ipc_try_read_message(int iChannelUniqueId, u8* pTempBuffer, int* pTempBufferPos, u8* pOutputBuffer);
 
+int ruby_ipc_wait_for_message(int iChannelUniqueId, u32 uTimeoutMs);
+int ruby_ipc_message_crc_is_valid(u8* pMessage, int iLength);
+int ruby_ipc_get_channel_stats(int iChannelUniqueId, type_ruby_ipc_channel_stats* pStats);
+
 int ruby_ipc_get_read_continous_error_count();
 
 #ifdef __cplusplus
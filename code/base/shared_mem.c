@@ -289,6 +289,26 @@ void shared_mem_rc_upstream_frame_close(t_packet_header_rc_full_frame_upstream*
    //shm_unlink(SHARED_MEM_RC_UPSTREAM_FRAME);
 }
 
+shared_mem_rc_last_frame_info* shared_mem_rc_last_frame_info_open_read()
+{
+   void *retVal =  open_shared_mem(SHARED_MEM_RC_LAST_FRAME_INFO, sizeof(shared_mem_rc_last_frame_info), 1);
+   shared_mem_rc_last_frame_info *tretval = (shared_mem_rc_last_frame_info*)retVal;
+   return tretval;
+}
+
+shared_mem_rc_last_frame_info* shared_mem_rc_last_frame_info_open_write()
+{
+   void *retVal =  open_shared_mem(SHARED_MEM_RC_LAST_FRAME_INFO, sizeof(shared_mem_rc_last_frame_info), 0);
+   shared_mem_rc_last_frame_info *tretval = (shared_mem_rc_last_frame_info*)retVal;
+   return tretval;
+}
+
+void shared_mem_rc_last_frame_info_close(shared_mem_rc_last_frame_info* pRCLastFrameInfo)
+{
+   if ( NULL != pRCLastFrameInfo )
+      munmap(pRCLastFrameInfo, sizeof(shared_mem_rc_last_frame_info));
+}
+
 void update_shared_mem_video_frames_stats(shared_mem_video_frames_stats* pSMVIStats, u32 uTimeNow)
 {
    if ( NULL == pSMVIStats )
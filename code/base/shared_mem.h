@@ -18,6 +18,7 @@
 #define SHARED_MEM_VIDEO_LINK_GRAPHS "/SYSTEM_SHARED_MEM_STATION_VIDEO_LINK_GRAPHS"
 #define SHARED_MEM_RC_DOWNLOAD_INFO "R_SHARED_MEM_VEHICLE_RC_DOWNLOAD_INFO"
 #define SHARED_MEM_RC_UPSTREAM_FRAME "R_SHARED_MEM_RC_UPSTREAM_FRAME"
+#define SHARED_MEM_RC_LAST_FRAME_INFO "R_SHARED_MEM_VEHICLE_RC_LAST_FRAME_INFO"
 
 #define SHARED_MEM_WATCHDOG_CENTRAL "/SYSTEM_SHARED_MEM_WATCHDOG_CENTRAL"
 #define SHARED_MEM_WATCHDOG_ROUTER_RX "/SYSTEM_SHARED_MEM_WATCHDOG_ROUTER_RX"
@@ -76,6 +77,14 @@ typedef struct
    u32 uInBlockingOperation;
 } shared_mem_player_process_stats;
 
+// Vehicle only: last RC frame received by the RC rx process, for the telemetry process (that writes the RC frames to the FC)
+typedef struct
+{
+   u32 uLastFrameRecvTimeMicros;
+   u8 uLastFrameIndex;
+   u8 uLastFrameInputAge; // RC_FULL_FRAME_INPUT_AGE_UNIT_MICROS units
+} shared_mem_rc_last_frame_info;
+
 #define MAX_INTERVALS_VIDEO_LINK_SWITCHES 50
 #define MAX_INTERVALS_VIDEO_LINK_STATS 24
 #define VIDEO_LINK_STATS_REFRESH_INTERVAL_MS 80
@@ -228,6 +237,10 @@ t_packet_header_rc_full_frame_upstream* shared_mem_rc_upstream_frame_open_read()
 t_packet_header_rc_full_frame_upstream* shared_mem_rc_upstream_frame_open_write();
 void shared_mem_rc_upstream_frame_close(t_packet_header_rc_full_frame_upstream* pRCFrame);
 
+shared_mem_rc_last_frame_info* shared_mem_rc_last_frame_info_open_read();
+shared_mem_rc_last_frame_info* shared_mem_rc_last_frame_info_open_write();
+void shared_mem_rc_last_frame_info_close(shared_mem_rc_last_frame_info* pRCLastFrameInfo);
+
 void update_shared_mem_video_frames_stats(shared_mem_video_frames_stats* pSMVIStats, u32 uTimeNow);
 void update_shared_mem_video_frames_stats_on_new_frame(shared_mem_video_frames_stats* pSMVFStats, u32 uLastFrameSizeBytes, int iFrameType, int iDetectedSlices, int iDetectedFPS, u32 uTimeNow);
 
@@ -34,6 +34,18 @@ typedef struct
    shared_mem_video_stream_stats video_streams[MAX_VIDEO_PROCESSORS];
 } ALIGN_STRUCT_SPEC_INFO shared_mem_video_stream_stats_rx_processors;
 
+// Video latency trace summary (vehicle in developer mode), averages over the last second, in miliseconds
+typedef struct
+{
+   u32 uFramesTraced; // 0 if no traced frames in the last second
+   u16 uAvgCaptureToEncodedMs; // vehicle: camera read to packets ready (FEC encoded)
+   u16 uAvgEncodedToInjectMs;  // vehicle: packets ready to radio inject
+   u16 uAvgAirMs;              // vehicle radio inject to station radio read (uses the link clock delta)
+   u16 uAvgStationMs;          // station radio read (first packet) to video output (last packet of the frame)
+   u16 uAvgTotalMs;            // camera read to video output
+   u16 uMaxTotalMs;
+} ALIGN_STRUCT_SPEC_INFO type_video_trace_summary;
+
 typedef struct
 {
    u32 uVehiclesIds[MAX_CONCURENT_VEHICLES];
@@ -47,6 +59,7 @@ typedef struct
    u32 uAverageCommandRoundtripMiliseconds[MAX_CONCURENT_VEHICLES];
    u32 uMaxCommandRoundtripMiliseconds[MAX_CONCURENT_VEHICLES];
    u32 uMinCommandRoundtripMiliseconds[MAX_CONCURENT_VEHICLES];
+   type_video_trace_summary videoTraceSummary[MAX_CONCURENT_VEHICLES];
 } ALIGN_STRUCT_SPEC_INFO shared_mem_router_vehicles_runtime_info;
 
 
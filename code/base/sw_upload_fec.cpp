@@ -0,0 +1,673 @@
+/*
+    Ruby Licence
+    Copyright (c) 2025 Petru Soroaga
+    All rights reserved.
+
+    Redistribution and/or use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions and/or use of the source code (partially or complete) must retain
+        the above copyright notice, this list of conditions and the following disclaimer
+        in the documentation and/or other materials provided with the distribution.
+        * Redistributions in binary form (partially or complete) must reproduce
+        the above copyright notice, this list of conditions and the following disclaimer
+        in the documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permitted.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "base.h"
+#include "sw_upload_fec.h"
+#include "../radio/fec.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+#define SW_UPLOAD_FEC_GENERATION_SIZE (SW_UPLOAD_FEC_DATA_BLOCKS * SW_UPLOAD_FEC_BLOCK_SIZE)
+#define SW_UPLOAD_FEC_MAX_BLOCKS (SW_UPLOAD_FEC_DATA_BLOCKS + SW_UPLOAD_FEC_MAX_EC_BLOCKS)
+
+static u32 _sw_upload_fec_get_generation_size(u32 uTotalSize, u32 uGeneration)
+{
+   u32 uOffset = uGeneration * SW_UPLOAD_FEC_GENERATION_SIZE;
+   if ( uOffset >= uTotalSize )
+      return 0;
+   if ( uTotalSize - uOffset < SW_UPLOAD_FEC_GENERATION_SIZE )
+      return uTotalSize - uOffset;
+   return SW_UPLOAD_FEC_GENERATION_SIZE;
+}
+
+// Data blocks past the end of the archive (in the last generation) are all zeros: they are never sent
+
+static u32 _sw_upload_fec_get_generation_data_blocks(u32 uTotalSize, u32 uGeneration)
+{
+   return (_sw_upload_fec_get_generation_size(uTotalSize, uGeneration) + SW_UPLOAD_FEC_BLOCK_SIZE - 1) / SW_UPLOAD_FEC_BLOCK_SIZE;
+}
+
+// Computes at least uCount EC blocks for the generation (in steps of 8)
+
+static bool _sw_upload_fec_sender_compute_ec_blocks(type_sw_upload_fec_sender* pSender, u32 uGeneration, u32 uCount)
+{
+   type_sw_upload_fec_sender_generation* pGeneration = &pSender->pGenerations[uGeneration];
+   if ( uCount <= pGeneration->uECBlocksComputed )
+      return true;
+
+   uCount = ((uCount + 7)/8)*8;
+   if ( uCount > SW_UPLOAD_FEC_MAX_EC_BLOCKS )
+      uCount = SW_UPLOAD_FEC_MAX_EC_BLOCKS;
+
+   u8* pECBlocks = (u8*) realloc(pGeneration->pECBlocks, uCount * SW_UPLOAD_FEC_BLOCK_SIZE);
+   if ( NULL == pECBlocks )
+   {
+      log_softerror_and_alarm("[SWUploadFEC] Failed to allocate memory for %u EC blocks.", uCount);
+      return false;
+   }
+   pGeneration->pECBlocks = pECBlocks;
+
+   unsigned char* pDataBlocks[SW_UPLOAD_FEC_DATA_BLOCKS];
+   unsigned char* pFECBlocks[SW_UPLOAD_FEC_MAX_EC_BLOCKS];
+   u8* pGenerationData = pSender->pArchive + uGeneration * SW_UPLOAD_FEC_GENERATION_SIZE;
+   for( int i=0; i<SW_UPLOAD_FEC_DATA_BLOCKS; i++ )
+      pDataBlocks[i] = pGenerationData + i * SW_UPLOAD_FEC_BLOCK_SIZE;
+   for( u32 u=0; u<uCount; u++ )
+      pFECBlocks[u] = pECBlocks + u * SW_UPLOAD_FEC_BLOCK_SIZE;
+   fec_encode(SW_UPLOAD_FEC_BLOCK_SIZE, pDataBlocks, SW_UPLOAD_FEC_DATA_BLOCKS, pFECBlocks, uCount);
+   pGeneration->uECBlocksComputed = uCount;
+   return true;
+}
+
+static void _sw_upload_fec_sender_free_ec_blocks(type_sw_upload_fec_sender* pSender, u32 uGeneration)
+{
+   type_sw_upload_fec_sender_generation* pGeneration = &pSender->pGenerations[uGeneration];
+   if ( NULL != pGeneration->pECBlocks )
+      free(pGeneration->pECBlocks);
+   pGeneration->pECBlocks = NULL;
+   pGeneration->uECBlocksComputed = 0;
+}
+
+bool sw_upload_fec_sender_init(type_sw_upload_fec_sender* pSender, u32 uTransferId, u8 uType, u8* pArchive, u32 uSize)
+{
+   if ( NULL == pSender )
+      return false;
+   memset(pSender, 0, sizeof(type_sw_upload_fec_sender));
+   if ( (NULL == pArchive) || (0 == uSize) || (uSize > SW_UPLOAD_FEC_MAX_ARCHIVE_SIZE) )
+      return false;
+
+   fec_init();
+
+   pSender->uTransferId = uTransferId;
+   pSender->uType = uType;
+   pSender->uTotalSize = uSize;
+   pSender->uBlockIntervalMs = SW_UPLOAD_FEC_INITIAL_BLOCK_INTERVAL_MS;
+   pSender->uGenerations = (uSize + SW_UPLOAD_FEC_GENERATION_SIZE - 1) / SW_UPLOAD_FEC_GENERATION_SIZE;
+   pSender->pArchive = (u8*) malloc(pSender->uGenerations * SW_UPLOAD_FEC_GENERATION_SIZE);
+   pSender->pGenerationCRC = (u32*) malloc(pSender->uGenerations * sizeof(u32));
+   pSender->pGenerations = (type_sw_upload_fec_sender_generation*) malloc(pSender->uGenerations * sizeof(type_sw_upload_fec_sender_generation));
+   pSender->pPassGenerations = (u32*) malloc(pSender->uGenerations * sizeof(u32));
+   pSender->pPassBlocks = (u8*) malloc(pSender->uGenerations * sizeof(u8));
+   if ( (NULL == pSender->pArchive) || (NULL == pSender->pGenerationCRC) || (NULL == pSender->pGenerations) || (NULL == pSender->pPassGenerations) || (NULL == pSender->pPassBlocks) )
+   {
+      log_softerror_and_alarm("[SWUploadFEC] Failed to allocate memory for %u generations.", pSender->uGenerations);
+      sw_upload_fec_sender_close(pSender);
+      return false;
+   }
+
+   memset(pSender->pArchive, 0, pSender->uGenerations * SW_UPLOAD_FEC_GENERATION_SIZE);
+   memcpy(pSender->pArchive, pArchive, uSize);
+   memset(pSender->pGenerations, 0, pSender->uGenerations * sizeof(type_sw_upload_fec_sender_generation));
+   pSender->uArchiveCRC = base_compute_crc32(pSender->pArchive, uSize);
+   for( u32 u=0; u<pSender->uGenerations; u++ )
+      pSender->pGenerationCRC[u] = base_compute_crc32(pSender->pArchive + u * SW_UPLOAD_FEC_GENERATION_SIZE, _sw_upload_fec_get_generation_size(uSize, u));
+
+   log_line("[SWUploadFEC] Sending archive of %u bytes (CRC: %08X) as %u generations of %d blocks of %d bytes, transfer id %u",
+      uSize, pSender->uArchiveCRC, pSender->uGenerations, SW_UPLOAD_FEC_DATA_BLOCKS, SW_UPLOAD_FEC_BLOCK_SIZE, uTransferId);
+   return true;
+}
+
+void sw_upload_fec_sender_close(type_sw_upload_fec_sender* pSender)
+{
+   if ( NULL == pSender )
+      return;
+   if ( NULL != pSender->pGenerations )
+   {
+      for( u32 u=0; u<pSender->uGenerations; u++ )
+         _sw_upload_fec_sender_free_ec_blocks(pSender, u);
+      free(pSender->pGenerations);
+   }
+   if ( NULL != pSender->pArchive )
+      free(pSender->pArchive);
+   if ( NULL != pSender->pGenerationCRC )
+      free(pSender->pGenerationCRC);
+   if ( NULL != pSender->pPassGenerations )
+      free(pSender->pPassGenerations);
+   if ( NULL != pSender->pPassBlocks )
+      free(pSender->pPassBlocks);
+   pSender->pGenerations = NULL;
+   pSender->pArchive = NULL;
+   pSender->pGenerationCRC = NULL;
+   pSender->pPassGenerations = NULL;
+   pSender->pPassBlocks = NULL;
+   pSender->uGenerations = 0;
+}
+
+void sw_upload_fec_sender_get_header(type_sw_upload_fec_sender* pSender, command_packet_sw_package_fec* pHeader)
+{
+   if ( (NULL == pSender) || (NULL == pHeader) )
+      return;
+   memset(pHeader, 0, sizeof(command_packet_sw_package_fec));
+   pHeader->uTransferId = pSender->uTransferId;
+   pHeader->uType = pSender->uType;
+   pHeader->uTotalSize = pSender->uTotalSize;
+   pHeader->uArchiveCRC = pSender->uArchiveCRC;
+   pHeader->uBlockSize = SW_UPLOAD_FEC_BLOCK_SIZE;
+   pHeader->uGenerationDataBlocks = SW_UPLOAD_FEC_DATA_BLOCKS;
+}
+
+static void _sw_upload_fec_sender_add_to_pass(type_sw_upload_fec_sender* pSender, u32 uGeneration, u32 uBlocks)
+{
+   if ( 0 == uBlocks )
+      return;
+   if ( uBlocks > SW_UPLOAD_FEC_MAX_BLOCKS )
+      uBlocks = SW_UPLOAD_FEC_MAX_BLOCKS;
+   pSender->pPassGenerations[pSender->uPassCount] = uGeneration;
+   pSender->pPassBlocks[pSender->uPassCount] = (u8)uBlocks;
+   pSender->uPassCount++;
+   pSender->uPassBlocksLeft += uBlocks;
+}
+
+u32 sw_upload_fec_sender_start_pass(type_sw_upload_fec_sender* pSender, command_packet_sw_package_fec_status* pStatus)
+{
+   if ( (NULL == pSender) || (NULL == pSender->pGenerations) )
+      return 0;
+
+   pSender->uPassCount = 0;
+   pSender->uPassGroupStart = 0;
+   pSender->uPassCursor = 0;
+   pSender->uPassBlocksLeft = 0;
+
+   if ( NULL == pStatus )
+   {
+      for( u32 u=0; u<pSender->uGenerations; u++ )
+         _sw_upload_fec_sender_add_to_pass(pSender, u, _sw_upload_fec_get_generation_data_blocks(pSender->uTotalSize, u) + SW_UPLOAD_FEC_INITIAL_EC_BLOCKS);
+   }
+   else
+   {
+      // Loss on the last pass, from the blocks the vehicle got during it
+      u32 uSent = pSender->uCountBlocksSent - pSender->uBlocksSentAtPassStart;
+      u32 uReceived = pStatus->uBlocksReceived - pSender->uBlocksReceivedAtPassStart;
+      if ( (uSent > 0) && (pStatus->uBlocksReceived >= pSender->uBlocksReceivedAtPassStart) )
+      {
+         float fLoss = 0.0;
+         if ( uReceived < uSent )
+            fLoss = 1.0 - (float)uReceived/(float)uSent;
+         if ( fLoss > 0.9 )
+            fLoss = 0.9;
+         if ( pSender->iPassIndex <= 1 )
+            pSender->fLoss = fLoss;
+         else
+            pSender->fLoss = 0.5 * pSender->fLoss + 0.5 * fLoss;
+
+         // Too many lost: send at about the rate the blocks got through. Most of the loss was
+         // from sending too fast, so expect less of it on the next pass.
+         if ( fLoss > 0.2 )
+         {
+            pSender->uBlockIntervalMs = (u32)((float)pSender->uBlockIntervalMs / (1.0 - fLoss)) + 1;
+            if ( pSender->fLoss > 0.2 )
+               pSender->fLoss = 0.2;
+         }
+         else if ( (fLoss < 0.05) && (pSender->uBlockIntervalMs > 1) )
+            pSender->uBlockIntervalMs--;
+         if ( pSender->uBlockIntervalMs > SW_UPLOAD_FEC_MAX_BLOCK_INTERVAL_MS )
+            pSender->uBlockIntervalMs = SW_UPLOAD_FEC_MAX_BLOCK_INTERVAL_MS;
+      }
+
+      // Listed generations are the first incomplete ones: the ones before them (and all the ones
+      // not listed, if the list is not full) are complete and don't need their EC blocks anymore
+      u32 uCount = pStatus->uCountGenerations;
+      if ( uCount > SW_UPLOAD_FEC_STATUS_MAX_GENERATIONS )
+         uCount = SW_UPLOAD_FEC_STATUS_MAX_GENERATIONS;
+      u32 uCompleteUpTo = pSender->uGenerations;
+      if ( uCount == SW_UPLOAD_FEC_STATUS_MAX_GENERATIONS )
+         uCompleteUpTo = pStatus->uGenerationIndex[uCount-1];
+      u32 uListIndex = 0;
+      for( u32 u=0; u<uCompleteUpTo; u++ )
+      {
+         if ( (uListIndex < uCount) && (pStatus->uGenerationIndex[uListIndex] == u) )
+            uListIndex++;
+         else
+            _sw_upload_fec_sender_free_ec_blocks(pSender, u);
+      }
+
+      for( u32 u=0; u<uCount; u++ )
+      {
+         if ( pStatus->uGenerationIndex[u] >= pSender->uGenerations )
+            continue;
+         u32 uNeeded = pStatus->uBlocksNeeded[u];
+         if ( 0 == uNeeded )
+            continue;
+         u32 uBlocks = (u32)((float)uNeeded / (1.0 - pSender->fLoss) + 0.999);
+         if ( pSender->fLoss > 0.01 )
+            uBlocks++;
+         _sw_upload_fec_sender_add_to_pass(pSender, pStatus->uGenerationIndex[u], uBlocks);
+      }
+      pSender->uBlocksReceivedAtPassStart = pStatus->uBlocksReceived;
+   }
+   pSender->uBlocksSentAtPassStart = pSender->uCountBlocksSent;
+   pSender->iPassIndex++;
+   return pSender->uPassBlocksLeft;
+}
+
+int sw_upload_fec_sender_get_next_block(type_sw_upload_fec_sender* pSender, u8* pOutput, int iMaxLength)
+{
+   if ( (NULL == pSender) || (NULL == pSender->pGenerations) || (NULL == pOutput) )
+      return 0;
+   if ( iMaxLength < (int)(sizeof(command_packet_sw_package_fec) + SW_UPLOAD_FEC_BLOCK_SIZE) )
+      return 0;
+
+   // Round robin over a group of generations, then move to the next group
+   int iEntry = -1;
+   while ( (iEntry < 0) && (pSender->uPassGroupStart < pSender->uPassCount) )
+   {
+      u32 uGroupSize = pSender->uPassCount - pSender->uPassGroupStart;
+      if ( uGroupSize > SW_UPLOAD_FEC_INTERLEAVE_GENERATIONS )
+         uGroupSize = SW_UPLOAD_FEC_INTERLEAVE_GENERATIONS;
+      for( u32 u=0; u<uGroupSize; u++ )
+      {
+         u32 uEntry = pSender->uPassGroupStart + pSender->uPassCursor;
+         pSender->uPassCursor = (pSender->uPassCursor + 1) % uGroupSize;
+         if ( pSender->pPassBlocks[uEntry] > 0 )
+         {
+            iEntry = (int)uEntry;
+            break;
+         }
+      }
+      if ( iEntry < 0 )
+      {
+         pSender->uPassGroupStart += uGroupSize;
+         pSender->uPassCursor = 0;
+      }
+   }
+   if ( iEntry < 0 )
+      return 0;
+
+   pSender->pPassBlocks[iEntry]--;
+   pSender->uPassBlocksLeft--;
+   u32 uGeneration = pSender->pPassGenerations[iEntry];
+   type_sw_upload_fec_sender_generation* pGeneration = &pSender->pGenerations[uGeneration];
+
+   // Next block of this generation: data blocks first, then new EC blocks; wraps around when all were sent
+   u32 uDataBlocks = _sw_upload_fec_get_generation_data_blocks(pSender->uTotalSize, uGeneration);
+   u32 uBlockIndex = pGeneration->uNextBlockToSend;
+   if ( (uBlockIndex >= uDataBlocks) && (uBlockIndex < SW_UPLOAD_FEC_DATA_BLOCKS) )
+      uBlockIndex = SW_UPLOAD_FEC_DATA_BLOCKS;
+   if ( uBlockIndex >= SW_UPLOAD_FEC_MAX_BLOCKS )
+      uBlockIndex = 0;
+   pGeneration->uNextBlockToSend = (u8)((uBlockIndex + 1) % SW_UPLOAD_FEC_MAX_BLOCKS);
+
+   u8* pBlock = NULL;
+   if ( uBlockIndex < SW_UPLOAD_FEC_DATA_BLOCKS )
+      pBlock = pSender->pArchive + uGeneration * SW_UPLOAD_FEC_GENERATION_SIZE + uBlockIndex * SW_UPLOAD_FEC_BLOCK_SIZE;
+   else
+   {
+      u32 uECIndex = uBlockIndex - SW_UPLOAD_FEC_DATA_BLOCKS;
+      if ( ! _sw_upload_fec_sender_compute_ec_blocks(pSender, uGeneration, uECIndex + 1) )
+      {
+         // Out of memory: send a data block instead
+         uBlockIndex = uBlockIndex % uDataBlocks;
+         pBlock = pSender->pArchive + uGeneration * SW_UPLOAD_FEC_GENERATION_SIZE + uBlockIndex * SW_UPLOAD_FEC_BLOCK_SIZE;
+      }
+      else
+      {
+         pBlock = pGeneration->pECBlocks + uECIndex * SW_UPLOAD_FEC_BLOCK_SIZE;
+         pSender->uCountECBlocksSent++;
+      }
+   }
+
+   command_packet_sw_package_fec header;
+   sw_upload_fec_sender_get_header(pSender, &header);
+   header.uGenerationIndex = uGeneration;
+   header.uGenerationCRC = pSender->pGenerationCRC[uGeneration];
+   header.uBlockIndex = (u8)uBlockIndex;
+   memcpy(pOutput, (u8*)&header, sizeof(command_packet_sw_package_fec));
+   memcpy(pOutput + sizeof(command_packet_sw_package_fec), pBlock, SW_UPLOAD_FEC_BLOCK_SIZE);
+   pSender->uCountBlocksSent++;
+   return (int)(sizeof(command_packet_sw_package_fec) + SW_UPLOAD_FEC_BLOCK_SIZE);
+}
+
+void sw_upload_fec_sender_log_stats(type_sw_upload_fec_sender* pSender)
+{
+   if ( NULL == pSender )
+      return;
+   u32 uDataBlocks = (pSender->uTotalSize + SW_UPLOAD_FEC_BLOCK_SIZE - 1) / SW_UPLOAD_FEC_BLOCK_SIZE;
+   log_line("[SWUploadFEC] Sent %u blocks (%u EC blocks) for %u data blocks (%.1f%% overhead) in %d passes, loss: %.1f%%, block interval: %u ms",
+      pSender->uCountBlocksSent, pSender->uCountECBlocksSent, uDataBlocks,
+      (uDataBlocks > 0)?(100.0*(float)pSender->uCountBlocksSent/(float)uDataBlocks - 100.0):0.0,
+      pSender->iPassIndex, 100.0*pSender->fLoss, pSender->uBlockIntervalMs);
+}
+
+void sw_upload_fec_receiver_init(type_sw_upload_fec_receiver* pReceiver)
+{
+   if ( NULL == pReceiver )
+      return;
+   memset(pReceiver, 0, sizeof(type_sw_upload_fec_receiver));
+   pReceiver->iFile = -1;
+}
+
+bool sw_upload_fec_receiver_is_current_transfer(type_sw_upload_fec_receiver* pReceiver, command_packet_sw_package_fec* pHeader)
+{
+   if ( (NULL == pReceiver) || (NULL == pHeader) || (NULL == pReceiver->pGenerations) )
+      return false;
+   if ( (pReceiver->uTransferId != pHeader->uTransferId) || (pReceiver->uTotalSize != pHeader->uTotalSize) || (pReceiver->uArchiveCRC != pHeader->uArchiveCRC) )
+      return false;
+   return true;
+}
+
+bool sw_upload_fec_receiver_start(type_sw_upload_fec_receiver* pReceiver, command_packet_sw_package_fec* pHeader, const char* szFileName)
+{
+   if ( (NULL == pReceiver) || (NULL == pHeader) )
+      return false;
+   sw_upload_fec_receiver_close(pReceiver);
+   sw_upload_fec_receiver_init(pReceiver);
+
+   if ( (0 == pHeader->uTotalSize) || (pHeader->uTotalSize > SW_UPLOAD_FEC_MAX_ARCHIVE_SIZE) || (NULL == szFileName) || (0 == szFileName[0]) )
+      return false;
+   if ( (pHeader->uBlockSize != SW_UPLOAD_FEC_BLOCK_SIZE) || (pHeader->uGenerationDataBlocks != SW_UPLOAD_FEC_DATA_BLOCKS) )
+   {
+      log_softerror_and_alarm("[SWUploadFEC] Unsupported transfer format: %d blocks of %d bytes per generation (supported: %d blocks of %d bytes).",
+         pHeader->uGenerationDataBlocks, pHeader->uBlockSize, SW_UPLOAD_FEC_DATA_BLOCKS, SW_UPLOAD_FEC_BLOCK_SIZE);
+      return false;
+   }
+
+   fec_init();
+
+   pReceiver->uGenerations = (pHeader->uTotalSize + SW_UPLOAD_FEC_GENERATION_SIZE - 1) / SW_UPLOAD_FEC_GENERATION_SIZE;
+   pReceiver->pGenerations = (type_sw_upload_fec_receiver_generation*) malloc(pReceiver->uGenerations * sizeof(type_sw_upload_fec_receiver_generation));
+   if ( NULL == pReceiver->pGenerations )
+   {
+      log_softerror_and_alarm("[SWUploadFEC] Failed to allocate memory for %u generations.", pReceiver->uGenerations);
+      pReceiver->uGenerations = 0;
+      return false;
+   }
+   memset(pReceiver->pGenerations, 0, pReceiver->uGenerations * sizeof(type_sw_upload_fec_receiver_generation));
+
+   pReceiver->iFile = open(szFileName, O_RDWR | O_CREAT | O_TRUNC, 0666);
+   if ( pReceiver->iFile < 0 )
+   {
+      log_softerror_and_alarm("[SWUploadFEC] Failed to create file [%s] for the archive, error: %d", szFileName, errno);
+      free(pReceiver->pGenerations);
+      pReceiver->pGenerations = NULL;
+      pReceiver->uGenerations = 0;
+      return false;
+   }
+   pReceiver->uTransferId = pHeader->uTransferId;
+   pReceiver->uType = pHeader->uType;
+   pReceiver->uTotalSize = pHeader->uTotalSize;
+   pReceiver->uArchiveCRC = pHeader->uArchiveCRC;
+   strncpy(pReceiver->szFileName, szFileName, sizeof(pReceiver->szFileName)-1);
+   pReceiver->szFileName[sizeof(pReceiver->szFileName)-1] = 0;
+   log_line("[SWUploadFEC] Started receiving archive, transfer id %u, %u bytes (CRC: %08X), %u generations, to [%s]",
+      pReceiver->uTransferId, pReceiver->uTotalSize, pReceiver->uArchiveCRC, pReceiver->uGenerations, pReceiver->szFileName);
+   return true;
+}
+
+static bool _sw_upload_fec_receiver_alloc_generation(type_sw_upload_fec_receiver* pReceiver, u32 uGeneration)
+{
+   type_sw_upload_fec_receiver_generation* pGeneration = &pReceiver->pGenerations[uGeneration];
+   if ( NULL != pGeneration->pBlocks )
+      return true;
+
+   // Room for all the data blocks and for as many EC blocks (a generation never needs more)
+   pGeneration->pBlocks = (u8*) malloc(2 * SW_UPLOAD_FEC_GENERATION_SIZE);
+   if ( NULL == pGeneration->pBlocks )
+   {
+      log_softerror_and_alarm("[SWUploadFEC] Failed to allocate memory for generation %u.", uGeneration);
+      return false;
+   }
+   memset(pGeneration->pBlocks, 0, SW_UPLOAD_FEC_GENERATION_SIZE);
+   memset(pGeneration->uReceivedMask, 0, sizeof(pGeneration->uReceivedMask));
+   pGeneration->uReceivedECBlocks = 0;
+   pGeneration->uReceivedDataBlocks = 0;
+
+   // Data blocks past the end of the archive are zeros
+   for( u32 u=_sw_upload_fec_get_generation_data_blocks(pReceiver->uTotalSize, uGeneration); u<SW_UPLOAD_FEC_DATA_BLOCKS; u++ )
+   {
+      pGeneration->uReceivedMask[u/8] |= (1<<(u%8));
+      pGeneration->uReceivedDataBlocks++;
+   }
+   return true;
+}
+
+static void _sw_upload_fec_receiver_free_generation(type_sw_upload_fec_receiver* pReceiver, u32 uGeneration)
+{
+   type_sw_upload_fec_receiver_generation* pGeneration = &pReceiver->pGenerations[uGeneration];
+   if ( NULL != pGeneration->pBlocks )
+      free(pGeneration->pBlocks);
+   pGeneration->pBlocks = NULL;
+   pGeneration->uReceivedDataBlocks = 0;
+   pGeneration->uReceivedECBlocks = 0;
+   memset(pGeneration->uReceivedMask, 0, sizeof(pGeneration->uReceivedMask));
+}
+
+// Adds the completed generations, in archive order, to the archive CRC
+
+static void _sw_upload_fec_receiver_update_hash(type_sw_upload_fec_receiver* pReceiver, u32 uGeneration, u8* pGenerationData)
+{
+   if ( uGeneration == pReceiver->uGenerationsHashed )
+   {
+      pReceiver->uHashCRC = base_update_crc32(pReceiver->uHashCRC, pGenerationData, _sw_upload_fec_get_generation_size(pReceiver->uTotalSize, uGeneration));
+      pReceiver->uGenerationsHashed++;
+   }
+
+   // Generations completed before this one (out of order) are read back from the archive file
+   u8* pBuffer = NULL;
+   while ( (pReceiver->uGenerationsHashed < pReceiver->uGenerations) && pReceiver->pGenerations[pReceiver->uGenerationsHashed].bComplete )
+   {
+      if ( NULL == pBuffer )
+         pBuffer = (u8*) malloc(SW_UPLOAD_FEC_GENERATION_SIZE);
+      u32 uSize = _sw_upload_fec_get_generation_size(pReceiver->uTotalSize, pReceiver->uGenerationsHashed);
+      if ( (NULL == pBuffer) || ((ssize_t)uSize != pread(pReceiver->iFile, pBuffer, uSize, pReceiver->uGenerationsHashed * SW_UPLOAD_FEC_GENERATION_SIZE)) )
+      {
+         log_softerror_and_alarm("[SWUploadFEC] Failed to read back generation %u from the archive file [%s].", pReceiver->uGenerationsHashed, pReceiver->szFileName);
+         pReceiver->bFailed = true;
+         break;
+      }
+      pReceiver->uHashCRC = base_update_crc32(pReceiver->uHashCRC, pBuffer, uSize);
+      pReceiver->uGenerationsHashed++;
+   }
+   if ( NULL != pBuffer )
+      free(pBuffer);
+
+   if ( pReceiver->bFailed || (pReceiver->uGenerationsHashed < pReceiver->uGenerations) )
+      return;
+   if ( pReceiver->uHashCRC == pReceiver->uArchiveCRC )
+   {
+      pReceiver->bVerified = true;
+      log_line("[SWUploadFEC] Archive received and verified (CRC: %08X).", pReceiver->uHashCRC);
+   }
+   else
+   {
+      pReceiver->bFailed = true;
+      log_softerror_and_alarm("[SWUploadFEC] Archive CRC mismatch: received %08X, expected %08X.", pReceiver->uHashCRC, pReceiver->uArchiveCRC);
+   }
+}
+
+// Rebuilds the missing data blocks (if any), verifies and writes the generation. Returns false if the archive can't be written.
+
+static bool _sw_upload_fec_receiver_complete_generation(type_sw_upload_fec_receiver* pReceiver, u32 uGeneration, u32 uGenerationCRC)
+{
+   type_sw_upload_fec_receiver_generation* pGeneration = &pReceiver->pGenerations[uGeneration];
+   if ( pGeneration->uReceivedDataBlocks < SW_UPLOAD_FEC_DATA_BLOCKS )
+   {
+      unsigned char* pDataBlocks[SW_UPLOAD_FEC_DATA_BLOCKS];
+      unsigned char* pFECBlocks[SW_UPLOAD_FEC_DATA_BLOCKS];
+      unsigned int uFECIndexes[SW_UPLOAD_FEC_DATA_BLOCKS];
+      unsigned int uErasedIndexes[SW_UPLOAD_FEC_DATA_BLOCKS];
+      unsigned int uCountErased = 0;
+      for( int i=0; i<SW_UPLOAD_FEC_DATA_BLOCKS; i++ )
+      {
+         pDataBlocks[i] = pGeneration->pBlocks + i * SW_UPLOAD_FEC_BLOCK_SIZE;
+         if ( ! (pGeneration->uReceivedMask[i/8] & (1<<(i%8))) )
+            uErasedIndexes[uCountErased++] = i;
+      }
+      for( u32 u=0; u<uCountErased; u++ )
+      {
+         pFECBlocks[u] = pGeneration->pBlocks + SW_UPLOAD_FEC_GENERATION_SIZE + u * SW_UPLOAD_FEC_BLOCK_SIZE;
+         uFECIndexes[u] = pGeneration->uECBlockIndexes[u];
+      }
+      fec_decode(SW_UPLOAD_FEC_BLOCK_SIZE, pDataBlocks, SW_UPLOAD_FEC_DATA_BLOCKS, pFECBlocks, uFECIndexes, uErasedIndexes, (unsigned short)uCountErased);
+      pReceiver->uCountGenerationsDecoded++;
+   }
+
+   u32 uSize = _sw_upload_fec_get_generation_size(pReceiver->uTotalSize, uGeneration);
+   u32 uCRC = base_compute_crc32(pGeneration->pBlocks, uSize);
+   if ( uCRC != uGenerationCRC )
+   {
+      // Start over on this generation
+      log_softerror_and_alarm("[SWUploadFEC] Generation %u CRC mismatch (%08X, expected %08X), dropping its %d data and %d EC blocks.",
+         uGeneration, uCRC, uGenerationCRC, pGeneration->uReceivedDataBlocks, pGeneration->uReceivedECBlocks);
+      pReceiver->uCountGenerationsBadCRC++;
+      _sw_upload_fec_receiver_free_generation(pReceiver, uGeneration);
+      return true;
+   }
+
+   if ( (ssize_t)uSize != pwrite(pReceiver->iFile, pGeneration->pBlocks, uSize, uGeneration * SW_UPLOAD_FEC_GENERATION_SIZE) )
+   {
+      log_softerror_and_alarm("[SWUploadFEC] Failed to write generation %u to file [%s], error: %d", uGeneration, pReceiver->szFileName, errno);
+      pReceiver->bFailed = true;
+      return false;
+   }
+   pGeneration->bComplete = true;
+   pReceiver->uGenerationsComplete++;
+   _sw_upload_fec_receiver_update_hash(pReceiver, uGeneration, pGeneration->pBlocks);
+   _sw_upload_fec_receiver_free_generation(pReceiver, uGeneration);
+   return ! pReceiver->bFailed;
+}
+
+int sw_upload_fec_receiver_add_block(type_sw_upload_fec_receiver* pReceiver, command_packet_sw_package_fec* pHeader, u8* pData, int iDataLength)
+{
+   if ( (NULL == pReceiver) || (NULL == pHeader) || (NULL == pData) || (NULL == pReceiver->pGenerations) || (pReceiver->iFile < 0) )
+      return -1;
+   if ( pReceiver->bFailed )
+      return -1;
+   if ( (pHeader->uGenerationIndex >= pReceiver->uGenerations) || (pHeader->uBlockIndex >= SW_UPLOAD_FEC_MAX_BLOCKS) || (iDataLength < SW_UPLOAD_FEC_BLOCK_SIZE) )
+      return -1;
+
+   pReceiver->uCountBlocksReceived++;
+   u32 uGeneration = pHeader->uGenerationIndex;
+   u32 uBlockIndex = pHeader->uBlockIndex;
+   type_sw_upload_fec_receiver_generation* pGeneration = &pReceiver->pGenerations[uGeneration];
+   if ( pGeneration->bComplete || (pGeneration->uReceivedMask[uBlockIndex/8] & (1<<(uBlockIndex%8))) )
+   {
+      pReceiver->uCountBlocksNotNeeded++;
+      return 0;
+   }
+   if ( ! _sw_upload_fec_receiver_alloc_generation(pReceiver, uGeneration) )
+      return -1;
+   if ( pGeneration->uReceivedMask[uBlockIndex/8] & (1<<(uBlockIndex%8)) )
+   {
+      pReceiver->uCountBlocksNotNeeded++;
+      return 0;
+   }
+
+   if ( uBlockIndex < SW_UPLOAD_FEC_DATA_BLOCKS )
+   {
+      memcpy(pGeneration->pBlocks + uBlockIndex * SW_UPLOAD_FEC_BLOCK_SIZE, pData, SW_UPLOAD_FEC_BLOCK_SIZE);
+      pGeneration->uReceivedDataBlocks++;
+   }
+   else
+   {
+      memcpy(pGeneration->pBlocks + SW_UPLOAD_FEC_GENERATION_SIZE + pGeneration->uReceivedECBlocks * SW_UPLOAD_FEC_BLOCK_SIZE, pData, SW_UPLOAD_FEC_BLOCK_SIZE);
+      pGeneration->uECBlockIndexes[pGeneration->uReceivedECBlocks] = (u8)(uBlockIndex - SW_UPLOAD_FEC_DATA_BLOCKS);
+      pGeneration->uReceivedECBlocks++;
+   }
+   pGeneration->uReceivedMask[uBlockIndex/8] |= (1<<(uBlockIndex%8));
+
+   if ( pGeneration->uReceivedDataBlocks + pGeneration->uReceivedECBlocks >= SW_UPLOAD_FEC_DATA_BLOCKS )
+   if ( ! _sw_upload_fec_receiver_complete_generation(pReceiver, uGeneration, pHeader->uGenerationCRC) )
+      return -1;
+   return 1;
+}
+
+bool sw_upload_fec_receiver_is_complete(type_sw_upload_fec_receiver* pReceiver)
+{
+   if ( NULL == pReceiver )
+      return false;
+   return pReceiver->bVerified;
+}
+
+bool sw_upload_fec_receiver_has_failed(type_sw_upload_fec_receiver* pReceiver)
+{
+   if ( NULL == pReceiver )
+      return false;
+   return pReceiver->bFailed;
+}
+
+void sw_upload_fec_receiver_get_status(type_sw_upload_fec_receiver* pReceiver, command_packet_sw_package_fec_status* pStatus)
+{
+   if ( NULL == pStatus )
+      return;
+   memset(pStatus, 0, sizeof(command_packet_sw_package_fec_status));
+   if ( NULL == pReceiver )
+      return;
+   pStatus->uTransferId = pReceiver->uTransferId;
+   if ( pReceiver->bVerified )
+      pStatus->uFlags |= SW_UPLOAD_FEC_STATUS_FLAG_COMPLETE;
+   if ( pReceiver->bFailed )
+      pStatus->uFlags |= SW_UPLOAD_FEC_STATUS_FLAG_FAILED;
+   pStatus->uGenerationsComplete = pReceiver->uGenerationsComplete;
+   pStatus->uBlocksReceived = pReceiver->uCountBlocksReceived;
+
+   for( u32 u=0; u<pReceiver->uGenerations; u++ )
+   {
+      if ( pStatus->uCountGenerations >= SW_UPLOAD_FEC_STATUS_MAX_GENERATIONS )
+         break;
+      type_sw_upload_fec_receiver_generation* pGeneration = &pReceiver->pGenerations[u];
+      if ( pGeneration->bComplete )
+         continue;
+      u32 uNeeded = _sw_upload_fec_get_generation_data_blocks(pReceiver->uTotalSize, u);
+      if ( NULL != pGeneration->pBlocks )
+         uNeeded = SW_UPLOAD_FEC_DATA_BLOCKS - pGeneration->uReceivedDataBlocks - pGeneration->uReceivedECBlocks;
+      pStatus->uGenerationIndex[pStatus->uCountGenerations] = u;
+      pStatus->uBlocksNeeded[pStatus->uCountGenerations] = (u8)uNeeded;
+      pStatus->uCountGenerations++;
+   }
+}
+
+void sw_upload_fec_receiver_log_stats(type_sw_upload_fec_receiver* pReceiver)
+{
+   if ( NULL == pReceiver )
+      return;
+   log_line("[SWUploadFEC] Transfer id %u: %u of %u generations complete (%u rebuilt with EC blocks, %u failed CRC); %u blocks received, %u not needed.",
+      pReceiver->uTransferId, pReceiver->uGenerationsComplete, pReceiver->uGenerations,
+      pReceiver->uCountGenerationsDecoded, pReceiver->uCountGenerationsBadCRC,
+      pReceiver->uCountBlocksReceived, pReceiver->uCountBlocksNotNeeded);
+}
+
+void sw_upload_fec_receiver_close(type_sw_upload_fec_receiver* pReceiver)
+{
+   if ( NULL == pReceiver )
+      return;
+   if ( pReceiver->iFile >= 0 )
+      close(pReceiver->iFile);
+   pReceiver->iFile = -1;
+   if ( NULL != pReceiver->pGenerations )
+   {
+      for( u32 u=0; u<pReceiver->uGenerations; u++ )
+         _sw_upload_fec_receiver_free_generation(pReceiver, u);
+      free(pReceiver->pGenerations);
+   }
+   pReceiver->pGenerations = NULL;
+   pReceiver->uGenerations = 0;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "base.h"
+#include "config_file_names.h"
+#include "commands.h"
+
+// Software update archive transfer, from the controller to the vehicle, as FEC protected generations.
+// The archive is split in generations of SW_UPLOAD_FEC_DATA_BLOCKS blocks; for each generation the
+// controller can send the data blocks and up to SW_UPLOAD_FEC_MAX_EC_BLOCKS EC blocks (radio/fec.c).
+// The vehicle rebuilds a generation from any SW_UPLOAD_FEC_DATA_BLOCKS different blocks of it.
+// Blocks are sent as one way commands, in passes, with no per block acks:
+//  - the first pass sends all the data blocks plus SW_UPLOAD_FEC_INITIAL_EC_BLOCKS EC blocks for each generation;
+//  - after each pass the controller asks the vehicle for the status (how many blocks each incomplete
+//    generation still needs) and sends only that many new blocks (more EC blocks), scaled up by the
+//    loss measured in the last pass; the blocks are sent slower if the last pass lost too many.
+// Generations are interleaved (SW_UPLOAD_FEC_INTERLEAVE_GENERATIONS at a time) so a burst of lost
+// packets is spread over several generations.
+// The vehicle writes each generation at its offset in the archive file as soon as it is rebuilt,
+// checks it against the generation CRC and computes the archive CRC while the generations arrive.
+// No router or UI state is used, so the same code runs in the loopback simulator (r_tests/test_sw_upload_fec).
+
+#define SW_UPLOAD_FEC_BLOCK_SIZE 1024
+#define SW_UPLOAD_FEC_DATA_BLOCKS 16
+#define SW_UPLOAD_FEC_MAX_EC_BLOCKS 48
+#define SW_UPLOAD_FEC_INITIAL_EC_BLOCKS 4
+#define SW_UPLOAD_FEC_INTERLEAVE_GENERATIONS 4
+#define SW_UPLOAD_FEC_MAX_ARCHIVE_SIZE 50000000
+// Pause between blocks sent: grows when a pass loses a lot of blocks (link or tx queues overloaded)
+#define SW_UPLOAD_FEC_INITIAL_BLOCK_INTERVAL_MS 2
+#define SW_UPLOAD_FEC_MAX_BLOCK_INTERVAL_MS 20
+// Status requests are small and cheap to resend: keep trying through link outages
+#define SW_UPLOAD_FEC_STATUS_MAX_RETRIES 30
+
+typedef struct
+{
+   u8* pECBlocks; // NULL until needed
+   u8 uECBlocksComputed;
+   u8 uNextBlockToSend; // data blocks, then EC blocks, then wraps around
+} type_sw_upload_fec_sender_generation;
+
+typedef struct
+{
+   u32 uTransferId;
+   u8 uType;
+   u32 uTotalSize;
+   u32 uArchiveCRC;
+   u32 uGenerations;
+   u8* pArchive; // padded with zeros to full generations
+   u32* pGenerationCRC;
+   type_sw_upload_fec_sender_generation* pGenerations;
+
+   // Current pass: generations and how many blocks to send for each
+   u32* pPassGenerations;
+   u8* pPassBlocks;
+   u32 uPassCount;
+   u32 uPassGroupStart;
+   u32 uPassCursor;
+   u32 uPassBlocksLeft;
+   int iPassIndex;
+
+   float fLoss; // smoothed over the passes
+   u32 uBlockIntervalMs;
+   u32 uBlocksSentAtPassStart;
+   u32 uBlocksReceivedAtPassStart; // as reported by the vehicle
+
+   // Stats
+   u32 uCountBlocksSent;
+   u32 uCountECBlocksSent;
+} type_sw_upload_fec_sender;
+
+typedef struct
+{
+   u8* pBlocks; // data blocks (by index) followed by the received EC blocks; NULL when not needed
+   u8 uReceivedMask[(SW_UPLOAD_FEC_DATA_BLOCKS + SW_UPLOAD_FEC_MAX_EC_BLOCKS + 7)/8];
+   u8 uReceivedDataBlocks;
+   u8 uReceivedECBlocks;
+   u8 uECBlockIndexes[SW_UPLOAD_FEC_DATA_BLOCKS];
+   bool bComplete;
+} type_sw_upload_fec_receiver_generation;
+
+typedef struct
+{
+   u32 uTransferId;
+   u8 uType;
+   u32 uTotalSize;
+   u32 uArchiveCRC;
+   u32 uGenerations;
+   type_sw_upload_fec_receiver_generation* pGenerations;
+   u32 uGenerationsComplete;
+   u32 uGenerationsHashed; // the archive CRC is computed over these first generations
+   u32 uHashCRC;
+   bool bVerified;
+   bool bFailed;
+   int iFile;
+   char szFileName[MAX_FILE_PATH_SIZE];
+
+   // Stats
+   u32 uCountBlocksReceived;
+   u32 uCountBlocksNotNeeded;
+   u32 uCountGenerationsDecoded; // rebuilt using EC blocks
+   u32 uCountGenerationsBadCRC;
+} type_sw_upload_fec_receiver;
+
+// Takes a copy of the archive. Returns false on failure.
+bool sw_upload_fec_sender_init(type_sw_upload_fec_sender* pSender, u32 uTransferId, u8 uType, u8* pArchive, u32 uSize);
+void sw_upload_fec_sender_close(type_sw_upload_fec_sender* pSender);
+// Header for status requests and cancel commands
+void sw_upload_fec_sender_get_header(type_sw_upload_fec_sender* pSender, command_packet_sw_package_fec* pHeader);
+// Starts the next pass, from the last status received from the vehicle (NULL for the first pass).
+// Returns the number of blocks to send in this pass.
+u32 sw_upload_fec_sender_start_pass(type_sw_upload_fec_sender* pSender, command_packet_sw_package_fec_status* pStatus);
+// Puts the next block of the current pass (header and block) in pOutput. Returns its length, 0 if the pass is done.
+int sw_upload_fec_sender_get_next_block(type_sw_upload_fec_sender* pSender, u8* pOutput, int iMaxLength);
+void sw_upload_fec_sender_log_stats(type_sw_upload_fec_sender* pSender);
+
+void sw_upload_fec_receiver_init(type_sw_upload_fec_receiver* pReceiver);
+bool sw_upload_fec_receiver_is_current_transfer(type_sw_upload_fec_receiver* pReceiver, command_packet_sw_package_fec* pHeader);
+// Creates (truncates) the archive file. Returns false on failure.
+bool sw_upload_fec_receiver_start(type_sw_upload_fec_receiver* pReceiver, command_packet_sw_package_fec* pHeader, const char* szFileName);
+// Returns 1 if the block was used, 0 if it was not needed, -1 if it is invalid or the archive can't be written
+int sw_upload_fec_receiver_add_block(type_sw_upload_fec_receiver* pReceiver, command_packet_sw_package_fec* pHeader, u8* pData, int iDataLength);
+// All generations received and the archive CRC matches
+bool sw_upload_fec_receiver_is_complete(type_sw_upload_fec_receiver* pReceiver);
+bool sw_upload_fec_receiver_has_failed(type_sw_upload_fec_receiver* pReceiver);
+void sw_upload_fec_receiver_get_status(type_sw_upload_fec_receiver* pReceiver, command_packet_sw_package_fec_status* pStatus);
+void sw_upload_fec_receiver_log_stats(type_sw_upload_fec_receiver* pReceiver);
+// Closes the archive file (it is kept on disk)
+void sw_upload_fec_receiver_close(type_sw_upload_fec_receiver* pReceiver);
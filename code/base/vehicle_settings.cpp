@@ -44,6 +44,7 @@ void reset_VehicleSettings()
 {
    memset(&s_VehicleSettings, 0, sizeof(s_VehicleSettings));
    s_VehicleSettings.iDevRxLoopTimeout = DEFAULT_MAX_RX_LOOP_TIMEOUT_MILISECONDS_VEHICLE;
+   s_VehicleSettings.iRouterUseEventLoop = DEFAULT_VEHICLE_ROUTER_USE_EVENT_LOOP;
    
    log_line("Reseted vehicle settings.");
 }
@@ -61,6 +62,7 @@ int save_VehicleSettings()
    }
    fprintf(fd, "%s\n", VEHICLE_SETTINGS_STAMP_ID);
    fprintf(fd, "%d\n", s_VehicleSettings.iDevRxLoopTimeout);
+   fprintf(fd, "%d\n", s_VehicleSettings.iRouterUseEventLoop);
    fclose(fd);
 
    log_line("Saved vehicle settings to file: %s", szFile);
@@ -106,6 +108,10 @@ int load_VehicleSettings()
       failed = 1;
    }
 
+   // Optional (added later)
+   if ( 1 != fscanf(fd, "%d", &s_VehicleSettings.iRouterUseEventLoop) )
+      s_VehicleSettings.iRouterUseEventLoop = DEFAULT_VEHICLE_ROUTER_USE_EVENT_LOOP;
+
    fclose(fd);
 
    if ( failed )
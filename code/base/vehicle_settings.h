@@ -8,6 +8,7 @@
 typedef struct
 {
    int iDevRxLoopTimeout;
+   int iRouterUseEventLoop; // 0: poll the rx queues, camera and IPC in a loop, 1: wait for them in a wait set (epoll)
 } VehicleSettings;
 
 int save_VehicleSettings();
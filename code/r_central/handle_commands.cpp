@@ -53,6 +53,7 @@
 #include "launchers_controller.h"
 #include "../radio/radiopackets2.h"
 #include "../radio/radiolink.h"
+#include "../base/file_upload.h"
 #include "menu_update_vehicle.h"
 #include "menu_confirmation.h"
 #include "menu_diagnose_radio_link.h"
@@ -107,6 +108,11 @@ static u8* s_pListFileSegments[MAX_FILE_SEGMENTS_TO_DOWNLOAD];
 static u32 s_uCountFileSegmentsToDownload = 0;
 static u32 s_uCountFileSegmentsDownloaded = 0;
 static u32 s_uLastFileSegmentRequestTime = 0;
+
+// File uploads: windowed (one way segments, selective acks from vehicle), or one segment per
+// command for vehicles that do not ack one way segments
+static type_file_upload_sender s_FileUploadSender;
+static bool s_bFileUploadWindowed = false;
 static u32 s_uLastTimeDownloadProgress = 0;
 
 Menu* s_pMenuVehicleHWInfo = NULL;
@@ -2144,6 +2150,68 @@ bool _commands_check_download_file_segments()
 }
 
 
+static void _commands_on_file_upload_finished()
+{
+   for( u32 u=0; u<g_CurrentUploadingFile.uTotalSegments; u++ )
+      g_CurrentUploadingFile.bSegmentsUploaded[u] = true;
+   warnings_add(0, "Finished uploading core plugins to vehicle.");
+   g_bHasFileUploadInProgress = false;
+}
+
+static void _commands_on_file_upload_failed()
+{
+   g_CurrentUploadingFile.uTotalSegments = 0;
+   g_bHasFileUploadInProgress = false;
+   s_bFileUploadWindowed = false;
+   file_upload_sender_close(&s_FileUploadSender);
+}
+
+static bool _commands_upload_file_segments_windowed()
+{
+   if ( file_upload_sender_is_complete(&s_FileUploadSender) )
+   {
+      file_upload_sender_log_stats(&s_FileUploadSender, g_TimeNow);
+      file_upload_sender_close(&s_FileUploadSender);
+      _commands_on_file_upload_finished();
+      return false;
+   }
+
+   int iAcksCheck = file_upload_sender_check_acks(&s_FileUploadSender, g_TimeNow);
+   if ( FILE_UPLOAD_SENDER_NO_ACKS_FALLBACK == iAcksCheck )
+   {
+      log_line("[Commands] Vehicle does not ack windowed file uploads. Uploading one segment per command.");
+      file_upload_sender_close(&s_FileUploadSender);
+      s_bFileUploadWindowed = false;
+      return false;
+   }
+   if ( FILE_UPLOAD_SENDER_NO_ACKS_ABORT == iAcksCheck )
+   {
+      log_softerror_and_alarm("[Commands] No file upload acks from vehicle for %d ms. Abandon file upload.", FILE_UPLOAD_NO_ACK_ABORT_MS);
+      file_upload_sender_log_stats(&s_FileUploadSender, g_TimeNow);
+      _commands_on_file_upload_failed();
+      return false;
+   }
+
+   bool bSentAnySegment = false;
+   int iSegment = -1;
+   while ( (iSegment = file_upload_sender_get_segment_to_send(&s_FileUploadSender, g_TimeNow)) >= 0 )
+   {
+      g_CurrentUploadingFile.currentUploadSegment.uSegmentSize = g_CurrentUploadingFile.uSegmentsSize[iSegment];
+      g_CurrentUploadingFile.currentUploadSegment.uSegmentIndex = iSegment;
+
+      u8 buffer[MAX_PACKET_TOTAL_SIZE];
+      memcpy(buffer, (u8*)&g_CurrentUploadingFile.currentUploadSegment, sizeof(command_packet_upload_file_segment));
+      memcpy(buffer + sizeof(command_packet_upload_file_segment), g_CurrentUploadingFile.pSegments[iSegment], g_CurrentUploadingFile.uSegmentsSize[iSegment]);
+      if ( ! handle_commands_send_single_oneway_command(0, COMMAND_ID_UPLOAD_FILE_SEGMENT, 0, buffer, sizeof(command_packet_upload_file_segment) + g_CurrentUploadingFile.uSegmentsSize[iSegment], 0) )
+         break;
+      file_upload_sender_on_segment_sent(&s_FileUploadSender, iSegment, g_TimeNow);
+      g_CurrentUploadingFile.uTimeLastUploadSegment = g_TimeNow;
+      g_CurrentUploadingFile.uLastSegmentIndexUploaded = iSegment;
+      bSentAnySegment = true;
+   }
+   return bSentAnySegment;
+}
+
 bool _commands_check_upload_file_segments()
 {
    if ( s_bHasCommandInProgress )
@@ -2164,6 +2232,9 @@ bool _commands_check_upload_file_segments()
       return false;    
    }
 
+   if ( s_bFileUploadWindowed )
+      return _commands_upload_file_segments_windowed();
+
    if ( g_TimeNow < g_CurrentUploadingFile.uTimeLastUploadSegment + 100 )
       return false;
 
@@ -2317,6 +2388,21 @@ void handle_commands_on_response_received(u8* pPacketBuffer, int iLength)
       return;
    }
 
+   // Acks for windowed file upload segments (sent as one way commands)
+   if ( s_bFileUploadWindowed )
+   {
+      type_file_upload_sender* pSender = g_bHasFileUploadInProgress?&s_FileUploadSender:NULL;
+      int iResult = file_upload_sender_on_response(pSender, g_CurrentUploadingFile.uFileId, pPacketBuffer, iLength, g_TimeNow);
+      if ( FILE_UPLOAD_RESPONSE_ACK_FAILED == iResult )
+      {
+         log_softerror_and_alarm("[Commands] Vehicle failed to store an uploaded file segment. Abandon file upload.");
+         file_upload_sender_log_stats(&s_FileUploadSender, g_TimeNow);
+         _commands_on_file_upload_failed();
+      }
+      if ( FILE_UPLOAD_RESPONSE_NOT_AN_ACK != iResult )
+         return;
+   }
+
    // Received a response to an old command? Ignore it
    if ( pPHCR->origin_command_counter != s_CommandCounter )
    {
@@ -2706,6 +2792,8 @@ void handle_commands_initiate_file_upload(u32 uFileId, const char* szFileName)
    g_CurrentUploadingFile.szFileName[0] = 0;
  
    g_bHasFileUploadInProgress = false;
+   s_bFileUploadWindowed = false;
+   file_upload_sender_close(&s_FileUploadSender);
  
    if ( NULL == szFileName || 0 == szFileName[0] )
       return;
@@ -2789,6 +2877,7 @@ void handle_commands_initiate_file_upload(u32 uFileId, const char* szFileName)
    strncpy(g_CurrentUploadingFile.currentUploadSegment.szFileName, szFileName, 127);
 
    g_CurrentUploadingFile.uLastSegmentIndexUploaded = 0xFFFFFFFF;
+   s_bFileUploadWindowed = file_upload_sender_init(&s_FileUploadSender, g_CurrentUploadingFile.uTotalSegments, g_TimeNow);
    g_bHasFileUploadInProgress = true;
 }
 
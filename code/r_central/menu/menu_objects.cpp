@@ -48,6 +48,7 @@
 #include "../keyboard.h"
 #include "../link_watch.h"
 #include "../../base/tx_powers.h"
+#include "../../base/sw_upload_fec.h"
 
 #define MENU_ALFA_WHEN_IN_BG 0.5
 
@@ -2597,6 +2598,210 @@ void Menu::selectMenuItemTxPowersValue(MenuItemSelect* pMenuItem, bool bHasAutoO
    }
 }
 
+static void _menu_render_upload_progress(int iPercent)
+{
+   render_commands_set_progress_percent(iPercent, true);
+   g_pRenderEngine->startFrame();
+   popups_render();
+   render_commands();
+   popups_render_topmost();
+   g_pRenderEngine->endFrame();
+}
+
+static void _menu_cancel_upload_fec(command_packet_sw_package_fec* pHeader)
+{
+   for( int i=0; i<5; i++ )
+   {
+      handle_commands_increment_command_counter();
+      handle_commands_send_command_once_to_vehicle(COMMAND_ID_UPLOAD_SW_TO_VEHICLE_FEC, 0, SW_UPLOAD_FEC_PARAM_CANCEL, (u8*)pHeader, sizeof(command_packet_sw_package_fec));
+      hardware_sleep_ms(20);
+   }
+   send_control_message_to_router(PACKET_TYPE_LOCAL_CONTROL_UPDATE_STOPED,0);
+}
+
+// Returns 1 if the archive was uploaded, 0 on failure or cancel,
+// -1 if the vehicle does not support FEC uploads (the 6.3 method should be used)
+
+int Menu::_uploadVehicleUpdateFEC(const char* szFile, long lSize)
+{
+   if ( (lSize <= 0) || (lSize > SW_UPLOAD_FEC_MAX_ARCHIVE_SIZE) )
+      return -1;
+
+   u8* pArchive = (u8*) malloc(lSize);
+   if ( NULL == pArchive )
+      return -1;
+   FILE* fd = fopen(szFile, "rb");
+   if ( NULL == fd )
+   {
+      free(pArchive);
+      return -1;
+   }
+   long lRead = fread(pArchive, 1, lSize, fd);
+   fclose(fd);
+
+   type_sw_upload_fec_sender sender;
+   if ( (lRead != lSize) || (! sw_upload_fec_sender_init(&sender, get_current_timestamp_ms(), 1, pArchive, (u32)lSize)) )
+   {
+      free(pArchive);
+      return -1;
+   }
+   free(pArchive);
+
+   command_packet_sw_package_fec header;
+   sw_upload_fec_sender_get_header(&sender, &header);
+   u32 uFirstPassBlocks = 0;
+   u32 uLastGenerationsComplete = 0;
+   int iPassesWithoutProgress = 0;
+   bool bFirstPass = true;
+   u32 uTimeLastRender = 0;
+   u8 uBlock[MAX_PACKET_PAYLOAD];
+
+   log_line("Sending to vehicle the update archive (FEC method): [%s], size: %d bytes", szFile, (int)lSize);
+   ruby_signal_alive();
+   send_control_message_to_router(PACKET_TYPE_LOCAL_CONTROL_UPDATE_STARTED,0);
+
+   while ( true )
+   {
+      // Ask the vehicle for the status (first time: check it supports FEC uploads)
+
+      u32 commandUID = handle_commands_increment_command_counter();
+      u8 resendCounter = 0;
+      int waitReplyTime = 100;
+      bool gotResponse = false;
+      bool responseOk = false;
+      do
+      {
+         g_TimeNow = get_current_timestamp_ms();
+         g_TimeNowMicros = get_current_timestamp_micros();
+         ruby_signal_alive();
+         if ( ! handle_commands_send_command_once_to_vehicle(COMMAND_ID_UPLOAD_SW_TO_VEHICLE_FEC, resendCounter, SW_UPLOAD_FEC_PARAM_STATUS, (u8*)&header, sizeof(command_packet_sw_package_fec)) )
+            break;
+         resendCounter++;
+         u32 timeToWaitReply = g_TimeNow + waitReplyTime;
+         while ( (g_TimeNow < timeToWaitReply) && (! gotResponse) )
+         {
+            if ( checkCancelUpload() )
+            {
+               _menu_cancel_upload_fec(&header);
+               sw_upload_fec_sender_close(&sender);
+               return 0;
+            }
+            g_TimeNow = get_current_timestamp_ms();
+            g_TimeNowMicros = get_current_timestamp_micros();
+            if ( try_read_messages_from_router(waitReplyTime) )
+            if ( handle_commands_get_last_command_id_response_received() == commandUID )
+            {
+               gotResponse = true;
+               responseOk = handle_commands_last_command_succeeded();
+            }
+         }
+         if ( ! gotResponse )
+         {
+            waitReplyTime += 50;
+            if ( waitReplyTime > 500 )
+               waitReplyTime = 500;
+         }
+      }
+      while ( (resendCounter < SW_UPLOAD_FEC_STATUS_MAX_RETRIES) && (! gotResponse) );
+
+      u8* pResponse = handle_commands_get_last_command_response();
+      t_packet_header* pPH = (t_packet_header*)pResponse;
+      t_packet_header_command_response* pPHCR = (t_packet_header_command_response*)(pResponse + sizeof(t_packet_header));
+      int iHeadersLength = sizeof(t_packet_header) + sizeof(t_packet_header_command_response);
+
+      if ( bFirstPass && ((! gotResponse) || (pPHCR->command_response_flags & COMMAND_RESPONSE_FLAGS_UNKNOWN_COMMAND)) )
+      {
+         log_line("Vehicle does not support FEC uploads (%s). Using the 6.3 upload method.", gotResponse?"unknown command":"no response");
+         sw_upload_fec_sender_close(&sender);
+         return -1;
+      }
+
+      command_packet_sw_package_fec_status status;
+      memset(&status, 0, sizeof(command_packet_sw_package_fec_status));
+      if ( gotResponse && responseOk && (pPH->total_length >= iHeadersLength + (int)sizeof(command_packet_sw_package_fec_status)) )
+         memcpy(&status, pResponse + iHeadersLength, sizeof(command_packet_sw_package_fec_status));
+      else
+         status.uFlags = SW_UPLOAD_FEC_STATUS_FLAG_FAILED;
+
+      if ( (status.uTransferId == header.uTransferId) && (status.uFlags & SW_UPLOAD_FEC_STATUS_FLAG_COMPLETE) )
+      {
+         sw_upload_fec_sender_log_stats(&sender);
+         sw_upload_fec_sender_close(&sender);
+         _menu_render_upload_progress(100);
+         return 1;
+      }
+
+      if ( status.uGenerationsComplete > uLastGenerationsComplete )
+      {
+         uLastGenerationsComplete = status.uGenerationsComplete;
+         iPassesWithoutProgress = 0;
+      }
+      else if ( ! bFirstPass )
+         iPassesWithoutProgress++;
+
+      if ( (status.uTransferId != header.uTransferId) || (status.uFlags & SW_UPLOAD_FEC_STATUS_FLAG_FAILED) || (iPassesWithoutProgress > 10) )
+      {
+         log_softerror_and_alarm("The software upload failed on the vehicle (got response: %s, status flags: %d, passes without progress: %d).", gotResponse?"yes":"no", status.uFlags, iPassesWithoutProgress);
+         sw_upload_fec_sender_log_stats(&sender);
+         sw_upload_fec_sender_close(&sender);
+         g_nFailedOTAUpdates++;
+         _menu_cancel_upload_fec(&header);
+         g_bUpdateInProgress = false;
+         return 0;
+      }
+
+      // Send the next pass of blocks, no acks
+
+      u32 uPassBlocks = sw_upload_fec_sender_start_pass(&sender, bFirstPass?NULL:&status);
+      if ( bFirstPass )
+         uFirstPassBlocks = uPassBlocks;
+      bFirstPass = false;
+      log_line("Sending %u sw package blocks (pass %d), %u of %u generations complete, block interval: %u ms",
+         uPassBlocks, sender.iPassIndex, status.uGenerationsComplete, sender.uGenerations, sender.uBlockIntervalMs);
+
+      int iLength = 0;
+      u32 uBlocksNotSent = 0;
+      while ( (iLength = sw_upload_fec_sender_get_next_block(&sender, uBlock, sizeof(uBlock))) > 0 )
+      {
+         g_TimeNow = get_current_timestamp_ms();
+         g_TimeNowMicros = get_current_timestamp_micros();
+         // No extra delay in the command sender, the block interval paces the blocks.
+         // Sending fails while another command is in progress: retry a few times.
+         bool bSent = false;
+         for( int iRetry=0; iRetry<5; iRetry++ )
+         {
+            bSent = handle_commands_send_single_oneway_command(0, COMMAND_ID_UPLOAD_SW_TO_VEHICLE_FEC, SW_UPLOAD_FEC_PARAM_BLOCK, uBlock, iLength, 0);
+            if ( bSent )
+               break;
+            hardware_sleep_ms(5);
+         }
+         // Generations missing blocks that were not sent get more blocks in the next pass
+         if ( ! bSent )
+            uBlocksNotSent++;
+         hardware_sleep_ms(sender.uBlockIntervalMs);
+
+         if ( g_TimeNow > (uTimeLastRender+100) )
+         {
+            uTimeLastRender = g_TimeNow;
+            ruby_signal_alive();
+            if ( checkCancelUpload() )
+            {
+               _menu_cancel_upload_fec(&header);
+               sw_upload_fec_sender_close(&sender);
+               return 0;
+            }
+            int iPercent = 99;
+            if ( (uFirstPassBlocks > 0) && (sender.uCountBlocksSent < uFirstPassBlocks) )
+               iPercent = (sender.uCountBlocksSent * 100) / uFirstPassBlocks;
+            _menu_render_upload_progress(iPercent);
+         }
+      }
+      if ( 0 != uBlocksNotSent )
+         log_softerror_and_alarm("Failed to send %u sw package blocks in pass %d (another command was in progress).", uBlocksNotSent, sender.iPassIndex);
+   }
+   return 0;
+}
+
 bool Menu::_uploadVehicleUpdate(const char* szArchiveToUpload)
 {
    command_packet_sw_package cpswp_cancel;
@@ -2621,6 +2826,14 @@ bool Menu::_uploadVehicleUpdate(const char* szArchiveToUpload)
       fclose(fd);
    }
 
+   int iResultFEC = _uploadVehicleUpdateFEC(szFile, lSize);
+   if ( iResultFEC >= 0 )
+   {
+      if ( 0 == iResultFEC )
+         g_bUpdateInProgress = false;
+      return (iResultFEC > 0);
+   }
+
    log_line("Sending to vehicle the update archive (method 6.3): [%s], size: %d bytes", szFile, (int)lSize);
 
    fd = fopen(szFile, "rb");
@@ -256,6 +256,7 @@ class Menu
      bool uploadSoftware();
      bool _generate_upload_archive(char* szArchiveName);
      bool _uploadVehicleUpdate(const char* szArchiveToUpload);
+     int _uploadVehicleUpdateFEC(const char* szFile, long lSize);
      bool checkCancelUpload();
 
      MenuItemSelect* createMenuItemCardModelSelector(const char* szTitle);
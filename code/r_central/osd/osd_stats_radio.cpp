@@ -1188,6 +1188,7 @@ float osd_render_stats_local_radio_links_get_height(shared_mem_radio_stats* pRad
    {
       height += 3 * height_text*s_OSDStatsLineSpacing + 0.3*height_text;
       height += height_text_small*s_OSDStatsLineSpacing; // Ping frequency
+      height += height_text_small*s_OSDStatsLineSpacing; // Video latency trace
       height += height_text_small*s_OSDStatsLineSpacing; // Last response recv from vehicle
 
       height += hGraph + height_text_small*s_OSDStatsLineSpacing; // Radio rx queue graph
@@ -1563,6 +1564,19 @@ float osd_render_stats_local_radio_links( float xPos, float yPos, const char* sz
          sprintf(szBuff, "%d ms", ping_interval_ms);
          g_pRenderEngine->setColors(get_Color_Dev());
          _osd_stats_draw_line(xPos, rightMargin, y, s_idFontStatsSmall, "Clock Sync Freq:", szBuff);
+
+         strcpy(szBuff, "N/A");
+         for( int i=0; i<MAX_CONCURENT_VEHICLES; i++ )
+         {
+            if ( g_SM_RouterVehiclesRuntimeInfo.uVehiclesIds[i] != pActiveModel->uVehicleId )
+               continue;
+            type_video_trace_summary* pTrace = &g_SM_RouterVehiclesRuntimeInfo.videoTraceSummary[i];
+            if ( pTrace->uFramesTraced > 0 )
+               sprintf(szBuff, "%d/%d/%d/%d (%d, max %d) ms", pTrace->uAvgCaptureToEncodedMs, pTrace->uAvgEncodedToInjectMs, pTrace->uAvgAirMs, pTrace->uAvgStationMs, pTrace->uAvgTotalMs, pTrace->uMaxTotalMs);
+            break;
+         }
+         y += height_text_small*s_OSDStatsLineSpacing;
+         _osd_stats_draw_line(xPos, rightMargin, y, s_idFontStatsSmall, "Video Lat (enc/tx/air/rx):", szBuff);
          osd_set_colors();
          y += height_text_small*s_OSDStatsLineSpacing;
       }
@@ -1438,7 +1438,7 @@ int try_read_messages_from_router(u32 uMaxMiliseconds)
       {
          t_packet_header* pPH = (t_packet_header*) pResult;
          iCountMessagesProcessed++;
-         if ( ! radio_packet_check_crc(pResult, pPH->total_length) )
+         if ( ! ruby_ipc_message_crc_is_valid(pResult, pPH->total_length) )
              log_softerror_and_alarm("[Router COMM] Received invalid message (invalid CRC) from router. Ignoring it.");
          else
              _process_received_message_from_router(pResult);
@@ -1467,6 +1467,9 @@ void * _router_ipc_thread_func(void *ignored_argument)
          pResult = ruby_ipc_try_read_message(s_fIPCFromRouter, s_BufferTmpOutputRouterMessage, &s_BufferTmpOutputRouterMessagePos, s_BufferPipeFromRouter);
       if ( NULL == pResult )
       {
+         // Shared memory rings channels can block until the router sends a message
+         if ( (-1 != s_fIPCFromRouter) && (ruby_ipc_wait_for_message(s_fIPCFromRouter, 100) >= 0) )
+            continue;
          if ( uWaitTimeMs < 30 )
             uWaitTimeMs += 5;
          hardware_sleep_ms(uWaitTimeMs);
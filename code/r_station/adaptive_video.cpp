@@ -39,6 +39,7 @@
 #include "../radio/radiopacketsqueue.h"
 
 #include "adaptive_video.h"
+#include "adaptive_video_controller.h"
 #include "test_link_params.h"
 #include "shared_vars.h"
 #include "shared_vars_state.h"
@@ -48,6 +49,13 @@ extern t_packet_queue s_QueueRadioPacketsHighPrio;
 
 u32 s_uTimePauseAdaptiveVideoUntil = 0;
 
+#define ADAPTIVE_VIDEO_TRACE_MAX_LOG_FILE_SIZE (4*1024*1024)
+
+static type_adaptive_video_controller_state s_AdaptiveVideoControllerState[MAX_CONCURENT_VEHICLES];
+static type_adaptive_video_slice s_AdaptiveVideoNewSlices[SYSTEM_RT_INFO_INTERVALS];
+static FILE* s_pAdaptiveVideoTraceFile = NULL;
+static int s_iAdaptiveVideoTraceFileSize = 0;
+
 void adaptive_video_pause(u32 uMilisec)
 {
    if ( 0 == uMilisec )
@@ -65,26 +73,47 @@ void adaptive_video_pause(u32 uMilisec)
    }
 }
 
-int _adaptive_video_get_lower_video_profile(int iVideoProfile)
+void adaptive_video_init()
 {
-   if ( iVideoProfile == VIDEO_PROFILE_BEST_PERF ||
-        iVideoProfile == VIDEO_PROFILE_HIGH_QUALITY ||
-        iVideoProfile == VIDEO_PROFILE_USER )
-     return VIDEO_PROFILE_MQ;
-
-   return VIDEO_PROFILE_LQ;
+   for( int i=0; i<MAX_CONCURENT_VEHICLES; i++ )
+      adaptive_video_controller_reset(&s_AdaptiveVideoControllerState[i], 0, g_SMControllerRTInfo.uUpdateIntervalMs);
+   int iController = ADAPTIVE_VIDEO_CONTROLLER_THRESHOLDS;
+   if ( NULL != g_pControllerSettings )
+      iController = g_pControllerSettings->iAdaptiveVideoController;
+   log_line("[AdaptiveVideo] Init, using %s controller", adaptive_video_controller_get_name(iController));
 }
 
-int _adaptive_video_get_higher_video_profile(Model* pModel, int iVideoProfile)
-{
-   if ( iVideoProfile == VIDEO_PROFILE_LQ )
-      return VIDEO_PROFILE_MQ;
-   return pModel->video_params.user_selected_video_link_profile;
-}
+// Slices traces, for replaying them offline in the adaptive video simulator (r_tests/test_adaptive_video_sim)
 
-void adaptive_video_init()
+static void _adaptive_video_write_trace_slices(u32 uVehicleId, type_adaptive_video_slice* pSlices, int iCountSlices)
 {
-   log_line("[AdaptiveVideo] Init");
+   if ( NULL == s_pAdaptiveVideoTraceFile )
+   {
+      char szFile[MAX_FILE_PATH_SIZE];
+      strcpy(szFile, FOLDER_LOGS);
+      strcat(szFile, LOG_FILE_ADAPTIVE_VIDEO_TRACE);
+      s_pAdaptiveVideoTraceFile = fopen(szFile, "w");
+      if ( NULL == s_pAdaptiveVideoTraceFile )
+         return;
+      log_line("[AdaptiveVideo] Started adaptive video trace log file: %s", szFile);
+      s_iAdaptiveVideoTraceFileSize = fprintf(s_pAdaptiveVideoTraceFile, "# Controller runtime info slices, %u ms each\n# time_ms vehicle_id video_profile ec_scheme rx_packets rx_missing outputed_packets max_ec_used skipped_blocks req_retransmissions ack_time_ms dbm\n", g_SMControllerRTInfo.uUpdateIntervalMs);
+   }
+
+   char szLine[256];
+   for( int i=0; i<iCountSlices; i++ )
+   {
+      adaptive_video_controller_format_trace_slice(uVehicleId, &pSlices[i], szLine, sizeof(szLine)/sizeof(szLine[0]));
+      int iLen = fprintf(s_pAdaptiveVideoTraceFile, "%s\n", szLine);
+      if ( iLen > 0 )
+         s_iAdaptiveVideoTraceFileSize += iLen;
+   }
+
+   // Keep only the latest traces
+   if ( s_iAdaptiveVideoTraceFileSize > ADAPTIVE_VIDEO_TRACE_MAX_LOG_FILE_SIZE )
+   {
+      fclose(s_pAdaptiveVideoTraceFile);
+      s_pAdaptiveVideoTraceFile = NULL;
+   }
 }
 
 void adaptive_video_on_new_vehicle(int iRuntimeIndex)
@@ -96,6 +125,7 @@ void adaptive_video_on_new_vehicle(int iRuntimeIndex)
   if ( (NULL == pModel) || (! pModel->hasCamera()) )
      return;
 
+  adaptive_video_controller_reset(&s_AdaptiveVideoControllerState[iRuntimeIndex], pModel->uVehicleId, g_SMControllerRTInfo.uUpdateIntervalMs);
   g_State.vehiclesRuntimeInfo[iRuntimeIndex].bIsDoingAdaptive = false;
   if ( pModel->video_link_profiles[pModel->video_params.user_selected_video_link_profile].uProfileEncodingFlags & VIDEO_PROFILE_ENCODING_FLAG_ENABLE_ADAPTIVE_VIDEO_KEYFRAME )
   {
@@ -198,136 +228,36 @@ void adaptive_video_received_video_profile_switch_confirmation(u32 uRequestId, u
    }
 }
 
-bool _adaptive_video_should_switch_lower(Model* pModel, type_global_state_vehicle_runtime_info* pRuntimeInfo, shared_mem_video_stream_stats* pSMVideoStreamInfo)
+void _adaptive_video_check_vehicle(Model* pModel, type_global_state_vehicle_runtime_info* pRuntimeInfo, shared_mem_video_stream_stats* pSMVideoStreamInfo, type_adaptive_video_controller_state* pControllerState)
 {
-   // Adaptive adjustment strength is in: pModel->video_params.videoAdjustmentStrength
-   // 1: lowest (slower) adjustment strength;
-   // 10: highest (fastest) adjustment strength;
-
-   u32 uTimeToLookBack = 50 + 10 * pModel->video_params.videoAdjustmentStrength;
-   int iIntervalsToCheck = 1 + uTimeToLookBack/g_SMControllerRTInfo.uUpdateIntervalMs;
-   if ( iIntervalsToCheck >= SYSTEM_RT_INFO_INTERVALS )
-      iIntervalsToCheck = SYSTEM_RT_INFO_INTERVALS - 1;
-   int iRTInfoIndex = g_SMControllerRTInfo.iCurrentIndex;
-   
-   int iECScheme = pModel->video_link_profiles[pSMVideoStreamInfo->PHVS.uCurrentVideoLinkProfile].iBlockECs;
-   
-   if ( iECScheme > 0 )
-   {
-      int iECThreshold = iECScheme-1;
-      if (iECThreshold < 1 )
-         iECThreshold = 1;
-      int iECCountThreshold = 0;
-    
-      u32 uTime = g_TimeNow;
-      while ( iIntervalsToCheck > 0 )
-      {
-         // Do not go past the last video profile change
-         if ( uTime <= pRuntimeInfo->uLastTimeRecvVideoProfileAck )
-            break;
-
-         if ( g_SMControllerRTInfo.uOutputedVideoPacketsMaxECUsed[iRTInfoIndex] >= iECScheme )
-            iECCountThreshold++;
-         if ( g_SMControllerRTInfo.uOutputedVideoPacketsMaxECUsed[iRTInfoIndex] >= iECThreshold )
-            iECCountThreshold++;
-         else if ( g_SMControllerRTInfo.uOutputedVideoPacketsSkippedBlocks[iRTInfoIndex] > 0 )
-            iECCountThreshold+=2;
-
-         // Go to prev (older) slice
-         uTime -= g_SMControllerRTInfo.uUpdateIntervalMs;
-         iIntervalsToCheck--;
-         iRTInfoIndex--;
-         if ( iRTInfoIndex < 0 )
-            iRTInfoIndex = SYSTEM_RT_INFO_INTERVALS-1;
-      }
-      if ( iECCountThreshold > (10-pModel->video_params.videoAdjustmentStrength)/2 )
-      {
-         return true;
-      }
-   }
-   return false;
-}
-
-bool _adaptive_video_should_switch_higher(Model* pModel, type_global_state_vehicle_runtime_info* pRuntimeInfo, shared_mem_video_stream_stats* pSMVideoStreamInfo)
-{
-   // Adaptive adjustment strength is in: pModel->video_params.videoAdjustmentStrength
-   // 1: lowest (slower) adjustment strength;
-   // 10: highest (fastest) adjustment strength;
-
-   u32 uTimeToLookBack = 1000 + 10 * pModel->video_params.videoAdjustmentStrength;
-   int iIntervalsToCheck = 1 + uTimeToLookBack/g_SMControllerRTInfo.uUpdateIntervalMs;
-   if ( iIntervalsToCheck >= SYSTEM_RT_INFO_INTERVALS )
-      iIntervalsToCheck = SYSTEM_RT_INFO_INTERVALS - 1;
-   int iRTInfoIndex = g_SMControllerRTInfo.iCurrentIndex;
-   
-   int iECScheme = pModel->video_link_profiles[pSMVideoStreamInfo->PHVS.uCurrentVideoLinkProfile].iBlockECs;
-   if ( iECScheme > 0 )
-   {
-      int iECThreshold = iECScheme-1;
-      if (iECThreshold < 1 )
-         iECThreshold = 1;
-
-      int iECCountThreshold = 0;
-      u32 uTime = g_TimeNow;
-      while ( iIntervalsToCheck > 0 )
-      {
-         if ( g_SMControllerRTInfo.uOutputedVideoPacketsMaxECUsed[iRTInfoIndex] >= iECThreshold )
-            iECCountThreshold++;
-         else if ( g_SMControllerRTInfo.uOutputedVideoPacketsSkippedBlocks[iRTInfoIndex] > 0 )
-            iECCountThreshold+=2;
-
-         // Go to prev (older) slice
-         uTime -= g_SMControllerRTInfo.uUpdateIntervalMs;
-         iIntervalsToCheck--;
-         iRTInfoIndex--;
-         if ( iRTInfoIndex < 0 )
-            iRTInfoIndex = SYSTEM_RT_INFO_INTERVALS-1;
-      }
-
-      if ( iECCountThreshold < (10-pModel->video_params.videoAdjustmentStrength)/3 + 1 )
-      {
-         return true; 
-      }
-   }
-   return false;
-}
-
-void _adaptive_video_check_vehicle(Model* pModel, type_global_state_vehicle_runtime_info* pRuntimeInfo, shared_mem_video_stream_stats* pSMVideoStreamInfo)
-{
-   if ( (NULL == pRuntimeInfo) || (NULL == pSMVideoStreamInfo) || (NULL == pModel) )
+   if ( (NULL == pRuntimeInfo) || (NULL == pSMVideoStreamInfo) || (NULL == pModel) || (NULL == pControllerState) )
       return;
 
-   // Adaptive adjustment strength is in: pModel->video_params.videoAdjustmentStrength
-   // 1: lowest (slower) adjustment strength;
-   // 10: highest (fastest) adjustment strength;
+   type_adaptive_video_controller_input input;
+   input.uTimeNow = g_TimeNow;
+   input.uTimeStart = g_TimeStart;
+   input.iCurrentVideoProfile = pSMVideoStreamInfo->PHVS.uCurrentVideoLinkProfile;
+   input.iPendingVideoProfile = pRuntimeInfo->uPendingVideoProfileToSet;
+   input.uLastTimeSentVideoProfileRequest = pRuntimeInfo->uLastTimeSentVideoProfileRequest;
+   input.uLastTimeRecvVideoProfileAck = pRuntimeInfo->uLastTimeRecvVideoProfileAck;
+   input.uCurrentKeyframeMs = pSMVideoStreamInfo->PHVS.uCurrentVideoKeyframeIntervalMs;
+   input.bAdaptiveKeyframe = (pModel->video_link_profiles[pModel->video_params.user_selected_video_link_profile].uProfileEncodingFlags & VIDEO_PROFILE_ENCODING_FLAG_ENABLE_ADAPTIVE_VIDEO_KEYFRAME)?true:false;
 
-   int iLowestProfile = VIDEO_PROFILE_LQ;
-   if ( (pModel->video_link_profiles[pModel->video_params.user_selected_video_link_profile].uProfileEncodingFlags) & VIDEO_PROFILE_ENCODING_FLAG_USE_MEDIUM_ADAPTIVE_VIDEO )
-      iLowestProfile = VIDEO_PROFILE_MQ;
+   int iController = ADAPTIVE_VIDEO_CONTROLLER_THRESHOLDS;
+   if ( NULL != g_pControllerSettings )
+      iController = g_pControllerSettings->iAdaptiveVideoController;
 
-   if ( pSMVideoStreamInfo->PHVS.uCurrentVideoLinkProfile != iLowestProfile )
-   if ( pRuntimeInfo->uPendingVideoProfileToSet != iLowestProfile )
-   if ( pRuntimeInfo->uLastTimeSentVideoProfileRequest < g_TimeNow - 30 )
-   if ( _adaptive_video_should_switch_lower(pModel, pRuntimeInfo, pSMVideoStreamInfo) )
-   {
-      int iVideoProfile = _adaptive_video_get_lower_video_profile(pSMVideoStreamInfo->PHVS.uCurrentVideoLinkProfile);
-      pRuntimeInfo->uPendingVideoProfileToSet = iVideoProfile;
-      pRuntimeInfo->uPendingVideoProfileToSetRequestedBy = CTRL_RT_INFO_FLAG_VIDEO_PROF_SWITCH_REQ_BY_ADAPTIVE_LOWER;
-      _adaptive_video_send_video_profile_to_vehicle(iVideoProfile, pModel->uVehicleId);
-   }
+   type_adaptive_video_controller_decision decision;
+   adaptive_video_controller_decide(iController, pControllerState, pModel, &input, &decision);
 
-   u32 uMinTimeToSwitchHigher = 3000 + (10 - pModel->video_params.videoAdjustmentStrength) * 400;
-   if ( pSMVideoStreamInfo->PHVS.uCurrentVideoLinkProfile != pModel->video_params.user_selected_video_link_profile )
-   if ( pRuntimeInfo->uPendingVideoProfileToSet != pModel->video_params.user_selected_video_link_profile )
-   if ( g_TimeNow > g_TimeStart + uMinTimeToSwitchHigher )
-   if ( pRuntimeInfo->uLastTimeSentVideoProfileRequest < g_TimeNow - uMinTimeToSwitchHigher )
-   if ( _adaptive_video_should_switch_higher(pModel, pRuntimeInfo, pSMVideoStreamInfo) )
+   if ( -1 != decision.iVideoProfile )
    {
-      int iVideoProfile = _adaptive_video_get_higher_video_profile(pModel, pSMVideoStreamInfo->PHVS.uCurrentVideoLinkProfile);
-      pRuntimeInfo->uPendingVideoProfileToSet = iVideoProfile;
-      pRuntimeInfo->uPendingVideoProfileToSetRequestedBy = CTRL_RT_INFO_FLAG_VIDEO_PROF_SWITCH_REQ_BY_ADAPTIVE_HIGHER;
-      _adaptive_video_send_video_profile_to_vehicle(iVideoProfile, pModel->uVehicleId);
+      pRuntimeInfo->uPendingVideoProfileToSet = decision.iVideoProfile;
+      pRuntimeInfo->uPendingVideoProfileToSetRequestedBy = decision.uRequestedBy;
+      _adaptive_video_send_video_profile_to_vehicle(decision.iVideoProfile, pModel->uVehicleId);
    }
+   if ( 0 != decision.uKeyframeMs )
+      pRuntimeInfo->uPendingKeyFrameToSet = decision.uKeyframeMs;
 }
 
 void _adaptive_keyframe_check_vehicle(Model* pModel, type_global_state_vehicle_runtime_info* pRuntimeInfo, shared_mem_video_stream_stats* pSMVideoStreamInfo)
@@ -420,10 +350,18 @@ void adaptive_video_periodic_loop(bool bForceSyncNow)
          g_State.vehiclesRuntimeInfo[i].bIsDoingAdaptive = false;
          continue;
       }
+
+      type_adaptive_video_controller_state* pControllerState = &s_AdaptiveVideoControllerState[i];
+      if ( pControllerState->uVehicleId != pModel->uVehicleId )
+         adaptive_video_controller_reset(pControllerState, pModel->uVehicleId, g_SMControllerRTInfo.uUpdateIntervalMs);
+      int iCountNewSlices = adaptive_video_controller_add_rt_info_slices(pControllerState, &g_SMControllerRTInfo, pModel, pSMVideoStreamInfo->PHVS.uCurrentVideoLinkProfile, s_AdaptiveVideoNewSlices, SYSTEM_RT_INFO_INTERVALS);
+      if ( (iCountNewSlices > 0) && (NULL != g_pControllerSettings) && g_pControllerSettings->iDeveloperMode )
+         _adaptive_video_write_trace_slices(pModel->uVehicleId, s_AdaptiveVideoNewSlices, iCountNewSlices);
+
       if ( (pModel->video_link_profiles[pModel->video_params.user_selected_video_link_profile].uProfileEncodingFlags) & VIDEO_PROFILE_ENCODING_FLAG_ENABLE_ADAPTIVE_VIDEO_LINK )
       {
          g_State.vehiclesRuntimeInfo[i].bIsDoingAdaptive = true;
-         _adaptive_video_check_vehicle(pModel, pRuntimeInfo, pSMVideoStreamInfo);
+         _adaptive_video_check_vehicle(pModel, pRuntimeInfo, pSMVideoStreamInfo, pControllerState);
       }
       if ( (pModel->video_link_profiles[pModel->video_params.user_selected_video_link_profile].uProfileEncodingFlags) & VIDEO_PROFILE_ENCODING_FLAG_ENABLE_ADAPTIVE_VIDEO_KEYFRAME )
          _adaptive_keyframe_check_vehicle(pModel, pRuntimeInfo, pSMVideoStreamInfo);
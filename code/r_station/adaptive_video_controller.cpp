@@ -0,0 +1,763 @@
+/*
+    Ruby Licence
+    Copyright (c) 2025 Petru Soroaga
+    All rights reserved.
+
+    Redistribution and/or use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions and/or use of the source code (partially or complete) must retain
+        the above copyright notice, this list of conditions and the following disclaimer
+        in the documentation and/or other materials provided with the distribution.
+        * Redistributions in binary form (partially or complete) must reproduce
+        the above copyright notice, this list of conditions and the following disclaimer
+        in the documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permitted.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/models.h"
+#include "../base/utils.h"
+#include "../base/controller_rt_info.h"
+#include <math.h>
+
+#include "adaptive_video_controller.h"
+
+#define ADAPTIVE_VIDEO_MAX_CANDIDATE_PROFILES 3
+#define ADAPTIVE_VIDEO_MIN_BLOCK_FAILURES_PER_SEC 0.05
+// A keyframe costs about as much bitrate as this many ms of non keyframe video
+#define ADAPTIVE_VIDEO_KEYFRAME_COST_MS 100
+
+const char* adaptive_video_controller_get_name(int iController)
+{
+   if ( iController == ADAPTIVE_VIDEO_CONTROLLER_THRESHOLDS )
+      return "thresholds";
+   if ( iController == ADAPTIVE_VIDEO_CONTROLLER_MODEL )
+      return "model";
+   return "unknown";
+}
+
+static void _adaptive_video_estimate_reset_window(type_adaptive_video_link_estimate* pEstimate, u32 uTime)
+{
+   pEstimate->uWindowStartTime = uTime;
+   pEstimate->iWindowSlices = 0;
+   pEstimate->iWindowRxPackets = 0;
+   pEstimate->iWindowMissingPackets = 0;
+   pEstimate->iWindowSkippedBlocks = 0;
+   pEstimate->iWindowReqRetransmissions = 0;
+   pEstimate->iWindowAckTimeMs = 0;
+   pEstimate->iWindowDbmSum = 0;
+   pEstimate->iWindowDbmCount = 0;
+   pEstimate->fWindowMaxECUsage = 0.0;
+}
+
+void adaptive_video_controller_reset(type_adaptive_video_controller_state* pState, u32 uVehicleId, u32 uSliceDurationMs)
+{
+   if ( NULL == pState )
+      return;
+   memset(pState, 0, sizeof(type_adaptive_video_controller_state));
+   pState->uVehicleId = uVehicleId;
+   pState->iLastRTInfoSliceIndex = -1;
+   pState->uSliceDurationMs = uSliceDurationMs;
+   if ( 0 == pState->uSliceDurationMs )
+      pState->uSliceDurationMs = SYSTEM_RT_INFO_UPDATE_INTERVAL_MS;
+   pState->iHistoryIndex = -1;
+   pState->iHistoryCount = 0;
+   pState->estimate.iLastVideoProfile = -1;
+   pState->estimate.fDbm = ADAPTIVE_VIDEO_NO_DBM;
+   pState->iHigherCandidateProfile = -1;
+}
+
+// EWMA mean and mean deviation, same gains as the retransmissions round trip estimator
+static void _adaptive_video_ewma_update(float* pfMean, float* pfDev, float fSample, bool bFirst)
+{
+   if ( bFirst )
+   {
+      *pfMean = fSample;
+      *pfDev = fSample/2.0;
+      return;
+   }
+   *pfDev = 0.75 * (*pfDev) + 0.25 * fabs(fSample - (*pfMean));
+   *pfMean = 0.875 * (*pfMean) + 0.125 * fSample;
+}
+
+static void _adaptive_video_estimate_close_window(type_adaptive_video_link_estimate* pEstimate, u32 uSliceDurationMs)
+{
+   if ( 0 == pEstimate->iWindowSlices )
+      return;
+
+   float fSeconds = (float)(pEstimate->iWindowSlices * uSliceDurationMs) / 1000.0;
+   bool bFirst = (0 == pEstimate->iWindows);
+
+   // No packets received or lost: no video sent, nothing to learn about the loss
+   int iTotalPackets = pEstimate->iWindowRxPackets + pEstimate->iWindowMissingPackets;
+   if ( iTotalPackets > 0 )
+      _adaptive_video_ewma_update(&pEstimate->fLoss, &pEstimate->fLossDev, (float)pEstimate->iWindowMissingPackets/(float)iTotalPackets, bFirst);
+
+   float fECUsage = pEstimate->fWindowMaxECUsage;
+   if ( pEstimate->iWindowSkippedBlocks > 0 )
+      fECUsage = 1.0;
+   _adaptive_video_ewma_update(&pEstimate->fECUsage, &pEstimate->fECUsageDev, fECUsage, bFirst);
+
+   float fSkipped = (float)pEstimate->iWindowSkippedBlocks / fSeconds;
+   float fRetr = (float)pEstimate->iWindowReqRetransmissions / fSeconds;
+   float fRx = (float)pEstimate->iWindowRxPackets / fSeconds;
+   if ( bFirst )
+   {
+      pEstimate->fSkippedBlocksPerSec = fSkipped;
+      pEstimate->fRetransmissionsPerSec = fRetr;
+      pEstimate->fRxPacketsPerSec = fRx;
+   }
+   else
+   {
+      pEstimate->fSkippedBlocksPerSec = 0.75 * pEstimate->fSkippedBlocksPerSec + 0.25 * fSkipped;
+      pEstimate->fRetransmissionsPerSec = 0.75 * pEstimate->fRetransmissionsPerSec + 0.25 * fRetr;
+      pEstimate->fRxPacketsPerSec = 0.75 * pEstimate->fRxPacketsPerSec + 0.25 * fRx;
+   }
+
+   if ( pEstimate->iWindowAckTimeMs > 0 )
+   {
+      if ( pEstimate->fRTTMs <= 0.0 )
+         pEstimate->fRTTMs = pEstimate->iWindowAckTimeMs;
+      else
+         pEstimate->fRTTMs = 0.875 * pEstimate->fRTTMs + 0.125 * (float)pEstimate->iWindowAckTimeMs;
+   }
+
+   if ( pEstimate->iWindowDbmCount > 0 )
+   {
+      float fDbm = (float)pEstimate->iWindowDbmSum / (float)pEstimate->iWindowDbmCount;
+      if ( pEstimate->fDbm >= ADAPTIVE_VIDEO_NO_DBM )
+      {
+         pEstimate->fDbm = fDbm;
+         pEstimate->fDbmTrend = 0.0;
+      }
+      else
+      {
+         float fNewDbm = 0.75 * pEstimate->fDbm + 0.25 * fDbm;
+         pEstimate->fDbmTrend = 0.875 * pEstimate->fDbmTrend + 0.125 * (fNewDbm - pEstimate->fDbm) / fSeconds;
+         pEstimate->fDbm = fNewDbm;
+      }
+   }
+
+   pEstimate->bCurrentProfileFailing = (pEstimate->iWindowSkippedBlocks > 0) || (pEstimate->fWindowMaxECUsage >= 1.0);
+   pEstimate->iWindows++;
+}
+
+static void _adaptive_video_estimate_add_slice(type_adaptive_video_link_estimate* pEstimate, type_adaptive_video_slice* pSlice, u32 uSliceDurationMs)
+{
+   // EC usage is relative to the EC scheme, so a profile change only starts a new window
+   if ( pEstimate->iLastVideoProfile != (int)pSlice->uVideoProfile )
+   {
+      _adaptive_video_estimate_close_window(pEstimate, uSliceDurationMs);
+      _adaptive_video_estimate_reset_window(pEstimate, pSlice->uTime);
+      pEstimate->iLastVideoProfile = pSlice->uVideoProfile;
+   }
+
+   pEstimate->iWindowSlices++;
+   pEstimate->iWindowRxPackets += pSlice->uRxPackets;
+   pEstimate->iWindowMissingPackets += pSlice->uRxMissingPackets;
+   pEstimate->iWindowSkippedBlocks += pSlice->uSkippedBlocks;
+   pEstimate->iWindowReqRetransmissions += pSlice->uReqRetransmissions;
+   if ( pSlice->uAckTimeMs > 0 )
+   if ( (0 == pEstimate->iWindowAckTimeMs) || (pSlice->uAckTimeMs < pEstimate->iWindowAckTimeMs) )
+      pEstimate->iWindowAckTimeMs = pSlice->uAckTimeMs;
+   if ( pSlice->iDbm < ADAPTIVE_VIDEO_NO_DBM )
+   {
+      pEstimate->iWindowDbmSum += pSlice->iDbm;
+      pEstimate->iWindowDbmCount++;
+   }
+   if ( pSlice->uECScheme > 0 )
+   {
+      float fECUsage = (float)pSlice->uMaxECUsed / (float)pSlice->uECScheme;
+      if ( fECUsage > 1.0 )
+         fECUsage = 1.0;
+      if ( fECUsage > pEstimate->fWindowMaxECUsage )
+         pEstimate->fWindowMaxECUsage = fECUsage;
+   }
+
+   if ( (u32)pEstimate->iWindowSlices * uSliceDurationMs >= ADAPTIVE_VIDEO_ESTIMATE_WINDOW_MS )
+   {
+      _adaptive_video_estimate_close_window(pEstimate, uSliceDurationMs);
+      _adaptive_video_estimate_reset_window(pEstimate, pSlice->uTime + uSliceDurationMs);
+   }
+}
+
+void adaptive_video_controller_add_slice(type_adaptive_video_controller_state* pState, type_adaptive_video_slice* pSlice)
+{
+   if ( (NULL == pState) || (NULL == pSlice) )
+      return;
+
+   pState->iHistoryIndex++;
+   if ( pState->iHistoryIndex >= ADAPTIVE_VIDEO_HISTORY_SLICES )
+      pState->iHistoryIndex = 0;
+   memcpy(&pState->history[pState->iHistoryIndex], pSlice, sizeof(type_adaptive_video_slice));
+   if ( pState->iHistoryCount < ADAPTIVE_VIDEO_HISTORY_SLICES )
+      pState->iHistoryCount++;
+
+   _adaptive_video_estimate_add_slice(&pState->estimate, pSlice, pState->uSliceDurationMs);
+}
+
+static void _adaptive_video_slice_from_rt_info(controller_runtime_info* pRTInfo, controller_runtime_info_vehicle* pRTInfoVehicle, int iIndex, type_adaptive_video_slice* pSlice)
+{
+   int iBestInterface = 0;
+   int iBestRx = -1;
+   for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
+   {
+      int iRx = (int)pRTInfo->uRxDataPackets[iIndex][i] + (int)pRTInfo->uRxHighPriorityPackets[iIndex][i];
+      if ( iRx > iBestRx )
+      {
+         iBestRx = iRx;
+         iBestInterface = i;
+      }
+   }
+   if ( iBestRx > 255 )
+      iBestRx = 255;
+   pSlice->uRxPackets = (u8)iBestRx;
+   pSlice->uRxMissingPackets = pRTInfo->uRxMissingPackets[iIndex][iBestInterface];
+   pSlice->uOutputedVideoPackets = pRTInfo->uOutputedVideoPackets[iIndex];
+   pSlice->uMaxECUsed = pRTInfo->uOutputedVideoPacketsMaxECUsed[iIndex];
+   pSlice->uSkippedBlocks = pRTInfo->uOutputedVideoPacketsSkippedBlocks[iIndex];
+
+   pSlice->iDbm = ADAPTIVE_VIDEO_NO_DBM;
+   controller_runtime_info_radio_interface_rx_signal* pSignal = &(pRTInfo->radioInterfacesDbm[iIndex][iBestInterface]);
+   for( int k=0; (k<pSignal->iCountAntennas) && (k<MAX_RADIO_ANTENNAS); k++ )
+   {
+      if ( pSignal->iDbmLast[k] >= ADAPTIVE_VIDEO_NO_DBM )
+         continue;
+      if ( (pSlice->iDbm >= ADAPTIVE_VIDEO_NO_DBM) || (pSignal->iDbmLast[k] > pSlice->iDbm) )
+         pSlice->iDbm = pSignal->iDbmLast[k];
+   }
+
+   pSlice->uReqRetransmissions = 0;
+   pSlice->uAckTimeMs = 0;
+   if ( NULL == pRTInfoVehicle )
+      return;
+   pSlice->uReqRetransmissions = pRTInfoVehicle->uCountReqRetransmissions[iIndex];
+   for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
+   {
+      if ( 0 == pRTInfoVehicle->uMinAckTime[iIndex][i] )
+         continue;
+      if ( (0 == pSlice->uAckTimeMs) || (pRTInfoVehicle->uMinAckTime[iIndex][i] < pSlice->uAckTimeMs) )
+         pSlice->uAckTimeMs = pRTInfoVehicle->uMinAckTime[iIndex][i];
+   }
+}
+
+int adaptive_video_controller_add_rt_info_slices(type_adaptive_video_controller_state* pState, controller_runtime_info* pRTInfo, Model* pModel, int iCurrentVideoProfile, type_adaptive_video_slice* pAddedSlices, int iMaxAddedSlices)
+{
+   if ( (NULL == pState) || (NULL == pRTInfo) || (NULL == pModel) )
+      return 0;
+   if ( (iCurrentVideoProfile < 0) || (iCurrentVideoProfile >= MAX_VIDEO_LINK_PROFILES) )
+      return 0;
+
+   controller_runtime_info_vehicle* pRTInfoVehicle = controller_rt_info_get_vehicle_info(pRTInfo, pState->uVehicleId);
+   int iECScheme = pModel->video_link_profiles[iCurrentVideoProfile].iBlockECs;
+   if ( iECScheme < 0 )
+      iECScheme = 0;
+   if ( iECScheme > 255 )
+      iECScheme = 255;
+
+   // The slice in progress is updated on each call; it goes to the history once completed
+   pState->currentSlice.uTime = pRTInfo->uCurrentSliceStartTime;
+   pState->currentSlice.uVideoProfile = (u8)iCurrentVideoProfile;
+   pState->currentSlice.uECScheme = (u8)iECScheme;
+   _adaptive_video_slice_from_rt_info(pRTInfo, pRTInfoVehicle, pRTInfo->iCurrentIndex, &pState->currentSlice);
+   pState->bHasCurrentSlice = true;
+
+   // Start from the current slice, the older ones were from before this vehicle (re)started
+   if ( pState->iLastRTInfoSliceIndex < 0 )
+   {
+      pState->iLastRTInfoSliceIndex = pRTInfo->iCurrentIndex;
+      return 0;
+   }
+
+   // Only the completed slices (the ones before the current index)
+   int iCountSlicesToAdd = pRTInfo->iCurrentIndex - pState->iLastRTInfoSliceIndex;
+   if ( iCountSlicesToAdd < 0 )
+      iCountSlicesToAdd += SYSTEM_RT_INFO_INTERVALS;
+
+   int iCountAdded = 0;
+   int iIndex = pState->iLastRTInfoSliceIndex;
+   for( int i=0; i<iCountSlicesToAdd; i++ )
+   {
+      type_adaptive_video_slice slice;
+      slice.uTime = pRTInfo->uCurrentSliceStartTime - (u32)(iCountSlicesToAdd - i) * pRTInfo->uUpdateIntervalMs;
+      slice.uVideoProfile = (u8)iCurrentVideoProfile;
+      slice.uECScheme = (u8)iECScheme;
+      _adaptive_video_slice_from_rt_info(pRTInfo, pRTInfoVehicle, iIndex, &slice);
+      adaptive_video_controller_add_slice(pState, &slice);
+      if ( (NULL != pAddedSlices) && (iCountAdded < iMaxAddedSlices) )
+         memcpy(&pAddedSlices[iCountAdded], &slice, sizeof(type_adaptive_video_slice));
+      iCountAdded++;
+
+      iIndex++;
+      if ( iIndex >= SYSTEM_RT_INFO_INTERVALS )
+         iIndex = 0;
+   }
+   pState->iLastRTInfoSliceIndex = pRTInfo->iCurrentIndex;
+   return iCountAdded;
+}
+
+// Candidate video profiles the adaptive video can switch to, from lowest to highest
+
+static int _adaptive_video_get_candidate_profiles(Model* pModel, int* piProfiles)
+{
+   int iCount = 0;
+   int iUserProfile = pModel->video_params.user_selected_video_link_profile;
+   // Nothing lower than the LQ profile
+   if ( iUserProfile == VIDEO_PROFILE_LQ )
+   {
+      piProfiles[iCount++] = iUserProfile;
+      return iCount;
+   }
+   if ( ! ((pModel->video_link_profiles[iUserProfile].uProfileEncodingFlags) & VIDEO_PROFILE_ENCODING_FLAG_USE_MEDIUM_ADAPTIVE_VIDEO) )
+      piProfiles[iCount++] = VIDEO_PROFILE_LQ;
+   if ( iUserProfile != VIDEO_PROFILE_MQ )
+      piProfiles[iCount++] = VIDEO_PROFILE_MQ;
+   piProfiles[iCount++] = iUserProfile;
+   return iCount;
+}
+
+static int _adaptive_video_get_lower_video_profile(int iVideoProfile)
+{
+   if ( iVideoProfile == VIDEO_PROFILE_BEST_PERF ||
+        iVideoProfile == VIDEO_PROFILE_HIGH_QUALITY ||
+        iVideoProfile == VIDEO_PROFILE_USER )
+     return VIDEO_PROFILE_MQ;
+
+   return VIDEO_PROFILE_LQ;
+}
+
+static int _adaptive_video_get_higher_video_profile(Model* pModel, int iVideoProfile)
+{
+   if ( iVideoProfile == VIDEO_PROFILE_LQ )
+      return VIDEO_PROFILE_MQ;
+   return pModel->video_params.user_selected_video_link_profile;
+}
+
+//-----------------------------------------------------------
+// Thresholds controller
+
+// Look back slices, newest first: the slice in progress (if any), then the history.
+// Returns NULL once there are no more slices.
+static type_adaptive_video_slice* _adaptive_video_thresholds_get_slice(type_adaptive_video_controller_state* pState, int iBackIndex)
+{
+   if ( pState->bHasCurrentSlice )
+   {
+      if ( 0 == iBackIndex )
+         return &pState->currentSlice;
+      iBackIndex--;
+   }
+   if ( iBackIndex >= pState->iHistoryCount )
+      return NULL;
+   int iHistoryIndex = pState->iHistoryIndex - iBackIndex;
+   if ( iHistoryIndex < 0 )
+      iHistoryIndex += ADAPTIVE_VIDEO_HISTORY_SLICES;
+   return &pState->history[iHistoryIndex];
+}
+
+static bool _adaptive_video_thresholds_should_switch_lower(type_adaptive_video_controller_state* pState, Model* pModel, type_adaptive_video_controller_input* pInput)
+{
+   // Adaptive adjustment strength is in: pModel->video_params.videoAdjustmentStrength
+   // 1: lowest (slower) adjustment strength;
+   // 10: highest (fastest) adjustment strength;
+
+   u32 uTimeToLookBack = 50 + 10 * pModel->video_params.videoAdjustmentStrength;
+   int iIntervalsToCheck = 1 + uTimeToLookBack/pState->uSliceDurationMs;
+
+   int iECScheme = pModel->video_link_profiles[pInput->iCurrentVideoProfile].iBlockECs;
+   if ( iECScheme <= 0 )
+      return false;
+
+   int iECThreshold = iECScheme-1;
+   if (iECThreshold < 1 )
+      iECThreshold = 1;
+   int iECCountThreshold = 0;
+
+   for( int i=0; i<iIntervalsToCheck; i++ )
+   {
+      type_adaptive_video_slice* pSlice = _adaptive_video_thresholds_get_slice(pState, i);
+      if ( NULL == pSlice )
+         break;
+      // Do not go past the last video profile change
+      u32 uTime = pSlice->uTime;
+      if ( pSlice == &pState->currentSlice )
+         uTime = pInput->uTimeNow;
+      if ( uTime <= pInput->uLastTimeRecvVideoProfileAck )
+         break;
+
+      if ( pSlice->uMaxECUsed >= iECScheme )
+         iECCountThreshold++;
+      if ( pSlice->uMaxECUsed >= iECThreshold )
+         iECCountThreshold++;
+      else if ( pSlice->uSkippedBlocks > 0 )
+         iECCountThreshold+=2;
+   }
+   return ( iECCountThreshold > (10-pModel->video_params.videoAdjustmentStrength)/2 );
+}
+
+static bool _adaptive_video_thresholds_should_switch_higher(type_adaptive_video_controller_state* pState, Model* pModel, type_adaptive_video_controller_input* pInput)
+{
+   u32 uTimeToLookBack = 1000 + 10 * pModel->video_params.videoAdjustmentStrength;
+   int iIntervalsToCheck = 1 + uTimeToLookBack/pState->uSliceDurationMs;
+
+   int iECScheme = pModel->video_link_profiles[pInput->iCurrentVideoProfile].iBlockECs;
+   if ( iECScheme <= 0 )
+      return false;
+
+   int iECThreshold = iECScheme-1;
+   if (iECThreshold < 1 )
+      iECThreshold = 1;
+   int iECCountThreshold = 0;
+
+   for( int i=0; i<iIntervalsToCheck; i++ )
+   {
+      type_adaptive_video_slice* pSlice = _adaptive_video_thresholds_get_slice(pState, i);
+      if ( NULL == pSlice )
+         break;
+      if ( pSlice->uMaxECUsed >= iECThreshold )
+         iECCountThreshold++;
+      else if ( pSlice->uSkippedBlocks > 0 )
+         iECCountThreshold+=2;
+   }
+   return ( iECCountThreshold < (10-pModel->video_params.videoAdjustmentStrength)/3 + 1 );
+}
+
+static void _adaptive_video_thresholds_decide(type_adaptive_video_controller_state* pState, Model* pModel, type_adaptive_video_controller_input* pInput, type_adaptive_video_controller_decision* pDecision)
+{
+   int iProfiles[ADAPTIVE_VIDEO_MAX_CANDIDATE_PROFILES];
+   _adaptive_video_get_candidate_profiles(pModel, iProfiles);
+   int iLowestProfile = iProfiles[0];
+   int iUserProfile = pModel->video_params.user_selected_video_link_profile;
+
+   if ( pInput->iCurrentVideoProfile != iLowestProfile )
+   if ( pInput->iPendingVideoProfile != iLowestProfile )
+   if ( pInput->uLastTimeSentVideoProfileRequest < pInput->uTimeNow - 30 )
+   if ( _adaptive_video_thresholds_should_switch_lower(pState, pModel, pInput) )
+   {
+      pDecision->iVideoProfile = _adaptive_video_get_lower_video_profile(pInput->iCurrentVideoProfile);
+      pDecision->uRequestedBy = CTRL_RT_INFO_FLAG_VIDEO_PROF_SWITCH_REQ_BY_ADAPTIVE_LOWER;
+      return;
+   }
+
+   u32 uMinTimeToSwitchHigher = 3000 + (10 - pModel->video_params.videoAdjustmentStrength) * 400;
+   if ( pInput->iCurrentVideoProfile != iUserProfile )
+   if ( pInput->iPendingVideoProfile != iUserProfile )
+   if ( pInput->uTimeNow > pInput->uTimeStart + uMinTimeToSwitchHigher )
+   if ( pInput->uLastTimeSentVideoProfileRequest < pInput->uTimeNow - uMinTimeToSwitchHigher )
+   if ( _adaptive_video_thresholds_should_switch_higher(pState, pModel, pInput) )
+   {
+      pDecision->iVideoProfile = _adaptive_video_get_higher_video_profile(pModel, pInput->iCurrentVideoProfile);
+      pDecision->uRequestedBy = CTRL_RT_INFO_FLAG_VIDEO_PROF_SWITCH_REQ_BY_ADAPTIVE_HIGHER;
+   }
+}
+
+//-----------------------------------------------------------
+// Model controller
+
+// Probability that a block of iTotalPackets loses more than iECPackets packets
+static float _adaptive_video_block_failure_probability(int iTotalPackets, int iECPackets, float fLoss)
+{
+   if ( fLoss <= 0.0 )
+      return 0.0;
+   if ( fLoss >= 1.0 )
+      return 1.0;
+   double dTerm = pow(1.0 - fLoss, iTotalPackets);
+   double dSum = dTerm;
+   for( int k=1; k<=iECPackets; k++ )
+   {
+      dTerm = dTerm * (double)(iTotalPackets - k + 1) / (double)k * fLoss / (1.0 - fLoss);
+      dSum += dTerm;
+   }
+   if ( dSum > 1.0 )
+      dSum = 1.0;
+   return (float)(1.0 - dSum);
+}
+
+typedef struct
+{
+   int iVideoProfile;
+   bool bFeasible;
+   float fVideoBitrate;
+   float fBlocksPerSec;
+   float fBlockFailure;
+   u32 uKeyframeMs;
+   float fStallMsPerSec;
+   float fDelivered;
+} type_adaptive_video_candidate;
+
+// Keyframe interval for a block failures rate: as long as possible (less bitrate spent on keyframes),
+// while the video stalls stay under the budget. A failed block stalls the video for
+// fRecoveryFixedMs + fRecoveryKeyframeFactor * keyframe/2 (the retransmission, or the wait for the next keyframe).
+static u32 _adaptive_video_model_get_keyframe(float fFailuresPerSec, float fStallBudgetMs, float fRecoveryFixedMs, float fRecoveryKeyframeFactor)
+{
+   // The independent losses model misses the rare loss bursts
+   if ( fFailuresPerSec < ADAPTIVE_VIDEO_MIN_BLOCK_FAILURES_PER_SEC )
+      fFailuresPerSec = ADAPTIVE_VIDEO_MIN_BLOCK_FAILURES_PER_SEC;
+   float fKeyframeMs = 2.0 * (fStallBudgetMs / fFailuresPerSec - fRecoveryFixedMs) / fRecoveryKeyframeFactor;
+   if ( fKeyframeMs < (float)DEFAULT_VIDEO_MIN_AUTO_KEYFRAME_INTERVAL )
+      return DEFAULT_VIDEO_MIN_AUTO_KEYFRAME_INTERVAL;
+   if ( fKeyframeMs > (float)DEFAULT_VIDEO_MAX_AUTO_KEYFRAME_INTERVAL )
+      return DEFAULT_VIDEO_MAX_AUTO_KEYFRAME_INTERVAL;
+   u32 uKeyframeMs = (((u32)fKeyframeMs) / 50) * 50;
+   if ( uKeyframeMs < DEFAULT_VIDEO_MIN_AUTO_KEYFRAME_INTERVAL )
+      uKeyframeMs = DEFAULT_VIDEO_MIN_AUTO_KEYFRAME_INTERVAL;
+   return uKeyframeMs;
+}
+
+static void _adaptive_video_model_decide(type_adaptive_video_controller_state* pState, Model* pModel, type_adaptive_video_controller_input* pInput, type_adaptive_video_controller_decision* pDecision)
+{
+   type_adaptive_video_link_estimate* pEstimate = &pState->estimate;
+   if ( pEstimate->iWindows < 4 )
+      return;
+
+   int iStrength = pModel->video_params.videoAdjustmentStrength;
+   if ( iStrength < 1 )
+      iStrength = 1;
+   if ( iStrength > 10 )
+      iStrength = 10;
+
+   // Targets: stalled video time per second and max block fill time (added latency)
+   int iUserProfile = pModel->video_params.user_selected_video_link_profile;
+   float fStallBudgetMs = 5.0 * (11 - iStrength);
+   float fLatencyTargetMs = 5.0 * (float)((pModel->video_link_profiles[iUserProfile].uProfileEncodingFlags & VIDEO_PROFILE_ENCODING_FLAG_MAX_RETRANSMISSION_WINDOW_MASK) >> 8);
+   if ( fLatencyTargetMs < 5.0 * DEFAULT_VIDEO_RETRANS_MS5_HQ )
+      fLatencyTargetMs = 5.0 * DEFAULT_VIDEO_RETRANS_MS5_HQ;
+
+   int iProfiles[ADAPTIVE_VIDEO_MAX_CANDIDATE_PROFILES];
+   int iCountProfiles = _adaptive_video_get_candidate_profiles(pModel, iProfiles);
+   int iCurrentIndex = iCountProfiles-1;
+   for( int i=0; i<iCountProfiles; i++ )
+   {
+      if ( iProfiles[i] == pInput->iCurrentVideoProfile )
+         iCurrentIndex = i;
+   }
+
+   // Conservative loss estimate for the current profile
+   int iCurrentData = 0, iCurrentEC = 0;
+   pModel->get_video_profile_ec_scheme(pInput->iCurrentVideoProfile, &iCurrentData, &iCurrentEC);
+   float fLoss = pEstimate->fLoss + pEstimate->fLossDev;
+   // Falling radio signal: expect about 1% more loss for each dB/sec
+   if ( (pEstimate->fDbm < ADAPTIVE_VIDEO_NO_DBM) && (pEstimate->fDbmTrend < 0.0) )
+      fLoss += -pEstimate->fDbmTrend * 0.01;
+   if ( iCurrentData + iCurrentEC > 0 )
+   {
+      // Bursty losses show up in the EC usage before they show up in the average loss
+      float fECUsage = pEstimate->fECUsage + pEstimate->fECUsageDev;
+      if ( fECUsage > 1.0 )
+         fECUsage = 1.0;
+      float fLossFromEC = 0.5 * fECUsage * (float)iCurrentEC / (float)(iCurrentData + iCurrentEC);
+      if ( fLossFromEC > fLoss )
+         fLoss = fLossFromEC;
+      if ( pEstimate->bCurrentProfileFailing || (pEstimate->fSkippedBlocksPerSec > 0.5) )
+      if ( fLoss < (float)iCurrentEC / (float)(iCurrentData + iCurrentEC) )
+         fLoss = (float)iCurrentEC / (float)(iCurrentData + iCurrentEC);
+   }
+   if ( fLoss > 0.9 )
+      fLoss = 0.9;
+
+   // Stall of a failed block: the retransmission if possible, else the wait for the next keyframe
+   float fRecoveryFixedMs = 0.0;
+   float fRecoveryKeyframeFactor = 1.0;
+   if ( pModel->video_link_profiles[iUserProfile].uProfileEncodingFlags & VIDEO_PROFILE_ENCODING_FLAG_ENABLE_RETRANSMISSIONS )
+   if ( (pEstimate->fRTTMs > 0.0) && (pEstimate->fRTTMs < fLatencyTargetMs) )
+   {
+      fRecoveryFixedMs = pEstimate->fRTTMs;
+      fRecoveryKeyframeFactor = fLoss;
+      if ( fRecoveryKeyframeFactor < 0.01 )
+         fRecoveryKeyframeFactor = 0.01;
+   }
+
+   float fCurrentRadioRate = (float)utils_get_max_radio_datarate_for_profile(pModel, pInput->iCurrentVideoProfile);
+
+   // Pick the profile and keyframe interval that deliver the most video bitrate
+   type_adaptive_video_candidate candidates[ADAPTIVE_VIDEO_MAX_CANDIDATE_PROFILES];
+   int iBestIndex = -1;
+   for( int i=0; i<iCountProfiles; i++ )
+   {
+      type_adaptive_video_candidate* pCandidate = &candidates[i];
+      memset(pCandidate, 0, sizeof(type_adaptive_video_candidate));
+      pCandidate->iVideoProfile = iProfiles[i];
+      pCandidate->uKeyframeMs = pInput->uCurrentKeyframeMs;
+      if ( 0 == pCandidate->uKeyframeMs )
+         pCandidate->uKeyframeMs = DEFAULT_VIDEO_KEYFRAME;
+
+      int iData = 0, iEC = 0;
+      pModel->get_video_profile_ec_scheme(iProfiles[i], &iData, &iEC);
+      if ( iData <= 0 )
+         continue;
+      int iPacketBits = 8 * pModel->video_link_profiles[iProfiles[i]].video_data_length;
+      if ( iPacketBits <= 0 )
+         iPacketBits = 8 * DEFAULT_VIDEO_DATA_LENGTH;
+      pCandidate->fVideoBitrate = (float)utils_get_max_allowed_video_bitrate_for_profile_or_user_video_bitrate(pModel, iProfiles[i]);
+      if ( pCandidate->fVideoBitrate <= 0.0 )
+         continue;
+
+      // Lower radio datarates are more robust: scale the loss with the datarate
+      float fRadioRate = (float)utils_get_max_radio_datarate_for_profile(pModel, iProfiles[i]);
+      float fCandidateLoss = fLoss;
+      if ( (fRadioRate > 0.0) && (fRadioRate < fCurrentRadioRate) )
+         fCandidateLoss = fLoss * fRadioRate / fCurrentRadioRate;
+
+      // Usable throughput of the radio link: max video load of the radio datarate, minus the lost packets
+      float fAirBitrate = pCandidate->fVideoBitrate * (float)(iData + iEC) / (float)iData;
+      float fUsableThroughput = fRadioRate * (float)DEFAULT_VIDEO_LINK_MAX_LOAD_PERCENT / 100.0 * (1.0 - fCandidateLoss);
+
+      pCandidate->fBlockFailure = _adaptive_video_block_failure_probability(iData + iEC, iEC, fCandidateLoss);
+      pCandidate->fBlocksPerSec = pCandidate->fVideoBitrate / (float)(iData * iPacketBits);
+      float fFailuresPerSec = pCandidate->fBlocksPerSec * pCandidate->fBlockFailure;
+      if ( (i == iCurrentIndex) && (fFailuresPerSec < pEstimate->fSkippedBlocksPerSec) )
+         fFailuresPerSec = pEstimate->fSkippedBlocksPerSec;
+      if ( pInput->bAdaptiveKeyframe )
+         pCandidate->uKeyframeMs = _adaptive_video_model_get_keyframe(fFailuresPerSec, fStallBudgetMs, fRecoveryFixedMs, fRecoveryKeyframeFactor);
+
+      pCandidate->fStallMsPerSec = fFailuresPerSec * (fRecoveryFixedMs + fRecoveryKeyframeFactor * (float)pCandidate->uKeyframeMs / 2.0);
+      if ( pCandidate->fStallMsPerSec > 1000.0 )
+         pCandidate->fStallMsPerSec = 1000.0;
+      pCandidate->fDelivered = pCandidate->fVideoBitrate * (1.0 - pCandidate->fStallMsPerSec/1000.0) *
+         (float)pCandidate->uKeyframeMs / (float)(pCandidate->uKeyframeMs + ADAPTIVE_VIDEO_KEYFRAME_COST_MS);
+      float fBlockFillMs = 1000.0 / pCandidate->fBlocksPerSec;
+
+      pCandidate->bFeasible = (pCandidate->fStallMsPerSec <= fStallBudgetMs) && (fBlockFillMs <= fLatencyTargetMs);
+      if ( (fRadioRate > 0.0) && (fAirBitrate > fUsableThroughput) )
+         pCandidate->bFeasible = false;
+      if ( pCandidate->bFeasible )
+      if ( (iBestIndex < 0) || (pCandidate->fDelivered >= candidates[iBestIndex].fDelivered) )
+         iBestIndex = i;
+   }
+   if ( iBestIndex < 0 )
+      iBestIndex = 0;
+
+   int iTargetIndex = iCurrentIndex;
+   if ( iBestIndex < iCurrentIndex )
+   {
+      pState->iHigherCandidateProfile = -1;
+      if ( (pInput->iPendingVideoProfile != iProfiles[iBestIndex]) && (pInput->uLastTimeSentVideoProfileRequest < pInput->uTimeNow - 30) )
+      {
+         iTargetIndex = iBestIndex;
+         pDecision->iVideoProfile = iProfiles[iBestIndex];
+         pDecision->uRequestedBy = CTRL_RT_INFO_FLAG_VIDEO_PROF_SWITCH_REQ_BY_ADAPTIVE_LOWER;
+      }
+   }
+   else if ( (iBestIndex > iCurrentIndex) && (! pEstimate->bCurrentProfileFailing) )
+   {
+      // Go up one profile at a time, once the estimate stays good for a while
+      int iHigherProfile = iProfiles[iCurrentIndex+1];
+      u32 uStableTime = 500 + (10 - iStrength) * 150;
+      if ( pState->iHigherCandidateProfile != iHigherProfile )
+      {
+         pState->iHigherCandidateProfile = iHigherProfile;
+         pState->uHigherCandidateSince = pInput->uTimeNow;
+      }
+      else if ( (pInput->uTimeNow >= pState->uHigherCandidateSince + uStableTime) &&
+                (pInput->uTimeNow > pInput->uTimeStart + 3000) &&
+                (pInput->iPendingVideoProfile != iHigherProfile) &&
+                (pInput->uLastTimeSentVideoProfileRequest < pInput->uTimeNow - 1000) )
+      {
+         iTargetIndex = iCurrentIndex+1;
+         pState->iHigherCandidateProfile = -1;
+         pDecision->iVideoProfile = iHigherProfile;
+         pDecision->uRequestedBy = CTRL_RT_INFO_FLAG_VIDEO_PROF_SWITCH_REQ_BY_ADAPTIVE_HIGHER;
+      }
+   }
+   else
+      pState->iHigherCandidateProfile = -1;
+
+   if ( -1 != pDecision->iVideoProfile )
+      log_line("[AdaptiveVideo] Model: loss %.3f (dev %.3f, used %.3f), EC usage %.2f, skipped %.1f/s, retr %.1f/s, RTT %.1f ms, dBm %.1f (%.1f/s): profile %d -> %d (stall %.1f ms/s, budget %.1f ms/s, keyframe %u ms)",
+         pEstimate->fLoss, pEstimate->fLossDev, fLoss, pEstimate->fECUsage, pEstimate->fSkippedBlocksPerSec, pEstimate->fRetransmissionsPerSec,
+         pEstimate->fRTTMs, pEstimate->fDbm, pEstimate->fDbmTrend,
+         pInput->iCurrentVideoProfile, pDecision->iVideoProfile, candidates[iTargetIndex].fStallMsPerSec, fStallBudgetMs, candidates[iTargetIndex].uKeyframeMs);
+
+   // Keyframe interval of the selected profile: shorter right away, longer only after a while
+   if ( ! pInput->bAdaptiveKeyframe )
+      return;
+   u32 uNewKeyframeMs = candidates[iTargetIndex].uKeyframeMs;
+   u32 uCurrentKeyframeMs = pInput->uCurrentKeyframeMs;
+   if ( (0 != uCurrentKeyframeMs) && (uNewKeyframeMs * 5 >= uCurrentKeyframeMs * 4) && (uNewKeyframeMs * 4 <= uCurrentKeyframeMs * 5) )
+      return;
+   if ( (0 != uCurrentKeyframeMs) && (uNewKeyframeMs > uCurrentKeyframeMs) )
+   if ( pInput->uTimeNow < pState->uLastTimeKeyframeChange + 3000 )
+      return;
+   if ( pInput->uTimeNow < pState->uLastTimeKeyframeChange + 200 )
+      return;
+   pDecision->uKeyframeMs = uNewKeyframeMs;
+   pState->uLastTimeKeyframeChange = pInput->uTimeNow;
+}
+
+void adaptive_video_controller_decide(int iController, type_adaptive_video_controller_state* pState, Model* pModel, type_adaptive_video_controller_input* pInput, type_adaptive_video_controller_decision* pDecision)
+{
+   if ( NULL == pDecision )
+      return;
+   pDecision->iVideoProfile = -1;
+   pDecision->uRequestedBy = 0;
+   pDecision->uKeyframeMs = 0;
+   if ( (NULL == pState) || (NULL == pModel) || (NULL == pInput) )
+      return;
+   if ( (pInput->iCurrentVideoProfile < 0) || (pInput->iCurrentVideoProfile >= MAX_VIDEO_LINK_PROFILES) )
+      return;
+   if ( (0 == pState->iHistoryCount) && (! pState->bHasCurrentSlice) )
+      return;
+
+   if ( iController == ADAPTIVE_VIDEO_CONTROLLER_MODEL )
+      _adaptive_video_model_decide(pState, pModel, pInput, pDecision);
+   else
+      _adaptive_video_thresholds_decide(pState, pModel, pInput, pDecision);
+}
+
+void adaptive_video_controller_format_trace_slice(u32 uVehicleId, type_adaptive_video_slice* pSlice, char* szOutput, int iMaxLength)
+{
+   if ( (NULL == pSlice) || (NULL == szOutput) || (iMaxLength <= 0) )
+      return;
+   snprintf(szOutput, iMaxLength, "%u %u %d %d %d %d %d %d %d %d %d %d",
+      pSlice->uTime, uVehicleId, (int)pSlice->uVideoProfile, (int)pSlice->uECScheme,
+      (int)pSlice->uRxPackets, (int)pSlice->uRxMissingPackets, (int)pSlice->uOutputedVideoPackets,
+      (int)pSlice->uMaxECUsed, (int)pSlice->uSkippedBlocks, (int)pSlice->uReqRetransmissions,
+      (int)pSlice->uAckTimeMs, pSlice->iDbm);
+}
+
+bool adaptive_video_controller_parse_trace_slice(const char* szLine, u32* puVehicleId, type_adaptive_video_slice* pSlice)
+{
+   if ( (NULL == szLine) || (NULL == pSlice) || ('#' == szLine[0]) )
+      return false;
+
+   u32 uTime = 0, uVehicleId = 0;
+   int iValues[10];
+   if ( 12 != sscanf(szLine, "%u %u %d %d %d %d %d %d %d %d %d %d", &uTime, &uVehicleId,
+         &iValues[0], &iValues[1], &iValues[2], &iValues[3], &iValues[4], &iValues[5], &iValues[6], &iValues[7], &iValues[8], &iValues[9]) )
+      return false;
+   for( int i=0; i<9; i++ )
+   {
+      if ( (iValues[i] < 0) || (iValues[i] > 255) )
+         return false;
+   }
+   pSlice->uTime = uTime;
+   pSlice->uVideoProfile = (u8)iValues[0];
+   pSlice->uECScheme = (u8)iValues[1];
+   pSlice->uRxPackets = (u8)iValues[2];
+   pSlice->uRxMissingPackets = (u8)iValues[3];
+   pSlice->uOutputedVideoPackets = (u8)iValues[4];
+   pSlice->uMaxECUsed = (u8)iValues[5];
+   pSlice->uSkippedBlocks = (u8)iValues[6];
+   pSlice->uReqRetransmissions = (u8)iValues[7];
+   pSlice->uAckTimeMs = (u8)iValues[8];
+   pSlice->iDbm = iValues[9];
+   if ( NULL != puVehicleId )
+      *puVehicleId = uVehicleId;
+   return true;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/models.h"
+#include "../base/controller_rt_info.h"
+
+// Adaptive video controllers: decide the video profile (and so the EC scheme) and the keyframe
+// interval the vehicle should use, from the controller runtime info history.
+// They do not use any router global state, so the same code runs in the router and in the
+// offline simulator (r_tests/test_adaptive_video_sim), against recorded slices traces.
+//
+// Controllers:
+//  thresholds: counts the slices with high EC usage or skipped blocks in a look back window;
+//  model: estimates the link loss (EWMA mean and deviation), EC usage, skipped blocks,
+//         retransmissions and radio signal trend, then picks the profile that delivers the most
+//         video bitrate while the expected block fill time and video stalls stay under the target.
+
+#define ADAPTIVE_VIDEO_CONTROLLER_THRESHOLDS 0
+#define ADAPTIVE_VIDEO_CONTROLLER_MODEL 1
+#define ADAPTIVE_VIDEO_CONTROLLERS_COUNT 2
+
+#define ADAPTIVE_VIDEO_HISTORY_SLICES SYSTEM_RT_INFO_INTERVALS
+#define ADAPTIVE_VIDEO_ESTIMATE_WINDOW_MS 50
+#define ADAPTIVE_VIDEO_NO_DBM 1000
+
+// One controller runtime info slice, for one vehicle
+typedef struct
+{
+   u32 uTime; // slice start time
+   u8 uVideoProfile;
+   u8 uECScheme; // EC packets per block of the video profile used in this slice
+   u8 uRxPackets; // on the radio interface that received the most packets
+   u8 uRxMissingPackets; // on the same radio interface
+   u8 uOutputedVideoPackets;
+   u8 uMaxECUsed;
+   u8 uSkippedBlocks;
+   u8 uReqRetransmissions;
+   u8 uAckTimeMs; // 0: no ack in this slice
+   int iDbm; // ADAPTIVE_VIDEO_NO_DBM: no value
+} type_adaptive_video_slice;
+
+typedef struct
+{
+   int iWindows; // estimate windows processed so far
+   int iLastVideoProfile;
+
+   // Current window accumulators
+   u32 uWindowStartTime;
+   int iWindowSlices;
+   int iWindowRxPackets;
+   int iWindowMissingPackets;
+   int iWindowSkippedBlocks;
+   int iWindowReqRetransmissions;
+   int iWindowAckTimeMs;
+   int iWindowDbmSum;
+   int iWindowDbmCount;
+   float fWindowMaxECUsage;
+
+   // Estimates
+   float fLoss; // packets loss, 0..1
+   float fLossDev;
+   float fECUsage; // max EC packets used by a block / EC scheme, 0..1
+   float fECUsageDev;
+   float fSkippedBlocksPerSec;
+   float fRetransmissionsPerSec;
+   float fRxPacketsPerSec;
+   float fRTTMs; // 0: unknown
+   float fDbm; // ADAPTIVE_VIDEO_NO_DBM: unknown
+   float fDbmTrend; // dBm per second
+   bool bCurrentProfileFailing; // last window had skipped blocks or used all the EC packets
+} type_adaptive_video_link_estimate;
+
+typedef struct
+{
+   u32 uVehicleId;
+   int iLastRTInfoSliceIndex; // -1: nothing read yet from the controller runtime info
+   u32 uSliceDurationMs;
+   type_adaptive_video_slice history[ADAPTIVE_VIDEO_HISTORY_SLICES];
+   int iHistoryIndex; // newest slice
+   int iHistoryCount;
+   type_adaptive_video_slice currentSlice; // controller runtime info slice still in progress
+   bool bHasCurrentSlice;
+   type_adaptive_video_link_estimate estimate;
+
+   int iHigherCandidateProfile; // -1: none
+   u32 uHigherCandidateSince;
+   u32 uLastTimeKeyframeChange;
+} type_adaptive_video_controller_state;
+
+typedef struct
+{
+   u32 uTimeNow;
+   u32 uTimeStart;
+   int iCurrentVideoProfile;
+   int iPendingVideoProfile; // 0xFF: none
+   u32 uLastTimeSentVideoProfileRequest;
+   u32 uLastTimeRecvVideoProfileAck;
+   u32 uCurrentKeyframeMs;
+   bool bAdaptiveKeyframe;
+} type_adaptive_video_controller_input;
+
+typedef struct
+{
+   int iVideoProfile; // -1: no change
+   u32 uRequestedBy; // CTRL_RT_INFO_FLAG_VIDEO_PROF_SWITCH_REQ_BY_ADAPTIVE_LOWER/HIGHER
+   u32 uKeyframeMs; // 0: no change
+} type_adaptive_video_controller_decision;
+
+const char* adaptive_video_controller_get_name(int iController);
+
+void adaptive_video_controller_reset(type_adaptive_video_controller_state* pState, u32 uVehicleId, u32 uSliceDurationMs);
+void adaptive_video_controller_add_slice(type_adaptive_video_controller_state* pState, type_adaptive_video_slice* pSlice);
+// Adds the controller runtime info slices completed since the last call and updates the slice in progress
+// (used only by the thresholds controller). Returns the number of slices added.
+int adaptive_video_controller_add_rt_info_slices(type_adaptive_video_controller_state* pState, controller_runtime_info* pRTInfo, Model* pModel, int iCurrentVideoProfile, type_adaptive_video_slice* pAddedSlices, int iMaxAddedSlices);
+
+void adaptive_video_controller_decide(int iController, type_adaptive_video_controller_state* pState, Model* pModel, type_adaptive_video_controller_input* pInput, type_adaptive_video_controller_decision* pDecision);
+
+// Slices traces: one text line per slice
+void adaptive_video_controller_format_trace_slice(u32 uVehicleId, type_adaptive_video_slice* pSlice, char* szOutput, int iMaxLength);
+bool adaptive_video_controller_parse_trace_slice(const char* szLine, u32* puVehicleId, type_adaptive_video_slice* pSlice);
@@ -34,6 +34,7 @@
 #include "../base/config.h"
 #include "../base/models.h"
 #include "../base/utils.h"
+#include "../base/latency_stats.h"
 #include "../radio/fec.h" 
 #include "shared_vars.h"
 #include "generic_rx_ecbuffers.h"
@@ -223,7 +224,9 @@ void GenericRxECBuffers::_computeECDataOnBlock(int iBufferIndex)
       }
    }
 
+   u32 uTimeStartDecode = latency_stats_start();
    int iRes = fec_decode(m_iBlockPacketLength, m_p_ec_decode_data_packets, (unsigned int)m_uBlockDataPackets, m_p_ec_decode_ec_packets, m_ec_decode_ec_indexes, m_ec_decode_missing_packets_indexes, m_missing_packets_count_for_ec );
+   latency_stats_end(LATENCY_STAGE_FEC_DECODE, uTimeStartDecode);
    if ( iRes < 0 )
    {
       log_softerror_and_alarm("[GenericRxEcBuffer] Failed to decode block type %u/%u/%d bytes; recv: %d/%d packets, missing count: %d",
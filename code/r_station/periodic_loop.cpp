@@ -56,6 +56,7 @@
 #include "packets_utils.h"
 #include "rx_video_output.h"
 #include "processor_rx_audio.h"
+#include "video_trace.h"
 
 u32 s_debugLastFPSTime = 0;
 u32 s_debugFramesCount = 0; 
@@ -77,6 +78,8 @@ void _synchronize_shared_mems()
       s_TimeLastVideoStatsUpdate = g_TimeNow;
       memcpy((u8*)g_pSM_VideoDecodeStats, (u8*)(&g_SM_VideoDecodeStats), sizeof(shared_mem_video_stream_stats_rx_processors));
    
+      video_trace_periodic_loop();
+
       if ( NULL != g_pSM_RouterVehiclesRuntimeInfo )
       {
          for( int i=0; i<MAX_CONCURENT_VEHICLES; i++ )
@@ -92,6 +95,7 @@ void _synchronize_shared_mems()
             g_SM_RouterVehiclesRuntimeInfo.uAverageCommandRoundtripMiliseconds[i] = g_State.vehiclesRuntimeInfo[i].uAverageCommandRoundtripMiliseconds;
             g_SM_RouterVehiclesRuntimeInfo.uMaxCommandRoundtripMiliseconds[i] = g_State.vehiclesRuntimeInfo[i].uMaxCommandRoundtripMiliseconds;
             g_SM_RouterVehiclesRuntimeInfo.uMinCommandRoundtripMiliseconds[i] = g_State.vehiclesRuntimeInfo[i].uMinCommandRoundtripMiliseconds;
+            video_trace_get_summary(g_State.vehiclesRuntimeInfo[i].uVehicleId, &g_SM_RouterVehiclesRuntimeInfo.videoTraceSummary[i]);
          }
          memcpy((u8*)g_pSM_RouterVehiclesRuntimeInfo, (u8*)&g_SM_RouterVehiclesRuntimeInfo, sizeof(shared_mem_router_vehicles_runtime_info));
       }
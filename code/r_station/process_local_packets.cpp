@@ -982,6 +982,7 @@ void process_local_control_packet(t_packet_header* pPH)
       g_pControllerSettings = get_ControllerSettings();
       int iOldTxMode = g_pControllerSettings->iRadioTxUsesPPCAP;
       int iOldSocketBuffers = g_pControllerSettings->iRadioBypassSocketBuffers;
+      int iOldRxRing = g_pControllerSettings->iRadioRxUsesRing;
       #if defined (HW_PLATFORM_RADXA)
       int iOldHDMIVSync = g_pControllerSettings->iHDMIVSync;
       #endif
@@ -1017,6 +1018,11 @@ void process_local_control_packet(t_packet_header* pPH)
          log_line("Radio bypass socket buffers changed. Reinit radio interfaces...");
          reasign_radio_links(true);       
       }
+      if ( g_pControllerSettings->iRadioRxUsesRing != iOldRxRing )
+      {
+         log_line("Radio Rx mode (PPCAP/Ring) changed. Reinit radio interfaces...");
+         reasign_radio_links(true);
+      }
 
       if ( NULL != g_pControllerSettings )
          radio_rx_set_timeout_interval(g_pControllerSettings->iDevRxLoopTimeout);
@@ -89,6 +89,7 @@ void* _thread_audio_queueing_playback(void *argument)
 {
    s_bThreadAudioQueueingStarted = true;
    log_line("[AudioRx-ThdQue] Created audio playback queue thread.");
+   hw_reset_current_thread_affinity("[AudioRx-ThdQue]");
    int iCountReads = 0;
    fd_set readSet;
    fd_set exceSet;
@@ -171,6 +172,7 @@ void* _thread_audio_buffering_playback(void *argument)
 {
    s_bThreadAudioBufferingStarted = true;
    log_line("[AudioRx-ThdBuf] Created audio playback buffering thread.");
+   hw_reset_current_thread_affinity("[AudioRx-ThdBuf]");
    fd_set readSet;
    fd_set exceSet;
    struct timeval timePipeInput;
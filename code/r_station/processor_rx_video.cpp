@@ -69,6 +69,7 @@
 #include "rx_video_output.h"
 #include "packets_utils.h"
 #include "video_rx_buffers.h"
+#include "video_trace.h"
 #include "timers.h"
 #include "ruby_rt_station.h"
 #include "test_link_params.h"
@@ -135,6 +136,9 @@ ProcessorRxVideo::ProcessorRxVideo(u32 uVehicleId, u8 uVideoStreamIndex)
    m_uLastTimeRequestedRetransmission = 0;
    m_uLastTimeCheckedForMissingPackets = 0;
    m_uRequestRetransmissionUniqueId = 0;
+   m_uRequestRetransmissionIdRTTSampled = 0;
+   m_uRetransmissionsSmoothedRTTMs = 0;
+   m_uRetransmissionsRTTVariationMs = 0;
    m_TimeLastHistoryStatsUpdate = 0;
    m_TimeLastRetransmissionsStatsUpdate = 0;
    m_uLatestVideoPacketReceiveTime = 0;
@@ -183,6 +187,11 @@ ProcessorRxVideo::~ProcessorRxVideo()
 
    m_siInstancesCount--;
 
+   // The last video rx buffer deleted also stops the FEC decode worker threads
+   if ( NULL != m_pVideoRxBuffer )
+      delete m_pVideoRxBuffer;
+   m_pVideoRxBuffer = NULL;
+
    if ( 0 == m_siInstancesCount )
    {
       if ( m_fdLogFile != NULL )
@@ -278,6 +287,9 @@ void ProcessorRxVideo::resetStateOnVehicleRestart()
    resetReceiveState();
    resetOutputState();
    m_uRequestRetransmissionUniqueId = 0;
+   m_uRequestRetransmissionIdRTTSampled = 0;
+   m_uRetransmissionsSmoothedRTTMs = 0;
+   m_uRetransmissionsRTTVariationMs = 0;
    m_uLastVideoBlockIndexResolutionChange = 0;
    m_uLastVideoBlockPacketIndexResolutionChange = 0;
 }
@@ -317,6 +329,40 @@ void ProcessorRxVideo::resumeProcessing()
    log_line("[ProcessorRxVideo] VID %u, video stream %u: resumed processing.", m_uVehicleId, m_uVideoStreamIndex);
 }      
 
+// Same smoothing as TCP does for its round trip time (RFC 6298): 1/8 gain for the mean, 1/4 for the deviation
+
+void ProcessorRxVideo::updateRetransmissionsRTT(u32 uRTTMs)
+{
+   if ( uRTTMs > 1000 )
+      return;
+   if ( 0 == m_uRetransmissionsSmoothedRTTMs )
+   {
+      m_uRetransmissionsSmoothedRTTMs = (uRTTMs > 0)?uRTTMs:1;
+      m_uRetransmissionsRTTVariationMs = uRTTMs/2;
+      return;
+   }
+   u32 uDelta = (uRTTMs > m_uRetransmissionsSmoothedRTTMs)?(uRTTMs - m_uRetransmissionsSmoothedRTTMs):(m_uRetransmissionsSmoothedRTTMs - uRTTMs);
+   m_uRetransmissionsRTTVariationMs = (3*m_uRetransmissionsRTTVariationMs + uDelta)/4;
+   m_uRetransmissionsSmoothedRTTMs = (7*m_uRetransmissionsSmoothedRTTMs + uRTTMs)/8;
+   if ( 0 == m_uRetransmissionsSmoothedRTTMs )
+      m_uRetransmissionsSmoothedRTTMs = 1;
+}
+
+// How long to wait for a requested packet before requesting it again
+
+u32 ProcessorRxVideo::getRetransmissionRetryTimeout()
+{
+   u32 uTimeout = m_uRetryRetransmissionAfterTimeoutMiliseconds;
+   if ( 0 != m_uRetransmissionsSmoothedRTTMs )
+   if ( m_uRetransmissionsSmoothedRTTMs + 4*m_uRetransmissionsRTTVariationMs > uTimeout )
+      uTimeout = m_uRetransmissionsSmoothedRTTMs + 4*m_uRetransmissionsRTTVariationMs;
+   if ( (m_iMilisecondsMaxRetransmissionWindow > 0) && (uTimeout > (u32)m_iMilisecondsMaxRetransmissionWindow/2) )
+      uTimeout = (u32)m_iMilisecondsMaxRetransmissionWindow/2;
+   if ( uTimeout < DEFAULT_VIDEO_RETRANS_MINIMUM_RETRY_INTERVAL )
+      uTimeout = DEFAULT_VIDEO_RETRANS_MINIMUM_RETRY_INTERVAL;
+   return uTimeout;
+}
+
 void ProcessorRxVideo::checkAndDiscardBlocksTooOld()
 {
    if ( (NULL == m_pVideoRxBuffer) || (0 == m_pVideoRxBuffer->getBlocksCountInBuffer()) )
@@ -425,6 +471,11 @@ int ProcessorRxVideo::periodicLoop(u32 uTimeNow, bool bForceSyncNow)
    if ( (NULL != pCtrlRTInfo) && (NULL != m_pVideoRxBuffer) )
       pCtrlRTInfo->iCountBlocksInVideoRxBuffers = m_pVideoRxBuffer->getBlocksCountInBuffer();
 
+   // Output video blocks reconstructed meanwhile by the FEC worker threads
+   if ( (! m_bPaused) && (NULL != m_pVideoRxBuffer) && pRuntimeInfo->bIsPairingDone )
+   if ( m_pVideoRxBuffer->checkCompletedECDecodes() > 0 )
+      outputAvailableVideoPackets(! pRuntimeInfo->bIsDoingRetransmissions);
+
    checkUpdateRetransmissionsState();
    return checkAndRequestMissingPackets(bForceSyncNow);
 }
@@ -497,6 +548,12 @@ void ProcessorRxVideo::handleReceivedVideoPacket(int interfaceNb, u8* pBuffer, i
       if ( pPHVS->uStreamInfo == m_uRequestRetransmissionUniqueId )
       {
          u32 uDeltaTime = g_TimeNow - m_uLastTimeRequestedRetransmission;
+         // One RTT sample per request, from its first answer; the rest of the burst arrives later
+         if ( m_uRequestRetransmissionIdRTTSampled != m_uRequestRetransmissionUniqueId )
+         {
+            m_uRequestRetransmissionIdRTTSampled = m_uRequestRetransmissionUniqueId;
+            updateRetransmissionsRTT(uDeltaTime);
+         }
          controller_rt_info_update_ack_rt_time(&g_SMControllerRTInfo, pPH->vehicle_id_src, g_SM_RadioStats.radio_interfaces[interfaceNb].assignedLocalRadioLinkId, uDeltaTime);
       }
    }
@@ -510,8 +567,12 @@ void ProcessorRxVideo::handleReceivedVideoPacket(int interfaceNb, u8* pBuffer, i
 
    checkUpdateRetransmissionsState();
 
-   bool bSkipIncompleteBlocks = ! pRuntimeInfo->bIsDoingRetransmissions;
+   m_pVideoRxBuffer->checkCompletedECDecodes();
+   outputAvailableVideoPackets(! pRuntimeInfo->bIsDoingRetransmissions);
+}
 
+void ProcessorRxVideo::outputAvailableVideoPackets(bool bSkipIncompleteBlocks)
+{
    // Output available video packets
    type_rx_video_block_info* pVideoBlock = NULL;
    type_rx_video_packet_info* pVideoPacket = NULL;
@@ -538,6 +599,8 @@ void ProcessorRxVideo::handleReceivedVideoPacket(int interfaceNb, u8* pBuffer, i
          int iVideoHeight = getVideoHeight();
 
          rx_video_output_video_data(m_uVehicleId, (pVideoPacket->pPHVS->uVideoStreamIndexAndType >> 4) & 0x0F , iVideoWidth, iVideoHeight, pVideoRawStreamData, pPHVSImp->uVideoDataLength, pVideoPacket->pPH->total_length);
+         if ( 0 != pVideoPacket->pPHVS->uTraceId )
+            video_trace_on_packet_output(m_uVehicleId, pVideoPacket->pPHVS);
 
          pVideoPacket->bOutputed = true;
 
@@ -573,6 +636,9 @@ void ProcessorRxVideo::handleReceivedVideoPacket(int interfaceNb, u8* pBuffer, i
 
       if ( pVideoPacket->bEmpty && (! bSkipIncompleteBlocks) )
          break;
+      // Block is still being reconstructed on the FEC worker threads
+      if ( pVideoPacket->bEmpty && (-1 != pVideoBlock->iECDecodeJobIndex) )
+         break;
       // Skip, except top block if it could still EC in the future
       if ( m_pVideoRxBuffer->getBufferTopReceivedVideoBlockIndex() == pVideoBlock->uVideoBlockIndex )
       {
@@ -739,9 +805,12 @@ int ProcessorRxVideo::checkAndRequestMissingPackets(bool bForceSyncNow)
       return -1;
 
    if ( g_TimeNow >= m_uLastTimeRequestedRetransmission + m_iMilisecondsMaxRetransmissionWindow )
-      m_uTimeIntervalMsForRequestingRetransmissions = 10;
+      m_uTimeIntervalMsForRequestingRetransmissions = DEFAULT_VIDEO_RETRANS_MINIMUM_RETRY_INTERVAL;
 
-   // Request all missing packets except current block
+   // Request, for each block, only the packets still needed to reconstruct it (data packets
+   // count minus received data/EC packets minus packets already requested and not timed out),
+   // most urgent blocks first (closest to being discarded), all in a single request packet.
+   // Blocks that would be discarded before the retransmission can arrive are not requested.
 
    //#define PACKET_TYPE_VIDEO_REQ_MULTIPLE_PACKETS 20
    // params after header:
@@ -776,6 +845,12 @@ int ProcessorRxVideo::checkAndRequestMissingPackets(bool bForceSyncNow)
 
    int iCountPacketsRequested = 0;
    int iCountBlocks = m_pVideoRxBuffer->getBlocksCountInBuffer();
+   u32 uRetryTimeout = getRetransmissionRetryTimeout();
+
+   type_rx_video_block_info* pBlocksToRequest[MAX_RXTX_BLOCKS_BUFFER];
+   int iCountToRequestFromBlocks[MAX_RXTX_BLOCKS_BUFFER];
+   u32 uBlocksDeadlines[MAX_RXTX_BLOCKS_BUFFER];
+   int iCountBlocksToRequest = 0;
 
    //if ( 0 == iCountBlocks )
    //   log_line("DBG check retr: empty buff, req %u ms ago", g_TimeNow - m_uLastTimeRequestedRetransmission);
@@ -798,11 +873,16 @@ int ProcessorRxVideo::checkAndRequestMissingPackets(bool bForceSyncNow)
          sprintf(szTmp, "[%u: %d/%d pckts]", pVideoBlock->uVideoBlockIndex, pVideoBlock->iRecvDataPackets, pVideoBlock->iRecvECPackets);
          strcat(szBufferBlocks, szTmp);
       }
+      // Block is being reconstructed on the FEC worker threads
+      if ( -1 != pVideoBlock->iECDecodeJobIndex )
+         continue;
+
       int iCountToRequestFromBlock = pVideoBlock->iBlockDataPackets - pVideoBlock->iRecvDataPackets - pVideoBlock->iRecvECPackets;
+      if ( iCountToRequestFromBlock <= 0 )
+         continue;
 
       // Ignore current last video block if it's still receiving packets now or has not received any packet at all
       if ( i == iCountBlocks-1 )
-      if ( iCountToRequestFromBlock > 0 )
       {
          uTopVideoBlockIndexInBuffer = pVideoBlock->uVideoBlockIndex;
          uTopVideoBlockLastRecvTime = pVideoBlock->uReceivedTime;
@@ -828,32 +908,72 @@ int ProcessorRxVideo::checkAndRequestMissingPackets(bool bForceSyncNow)
 
          if ( ! bRequestData )
             continue;
-         log_line("[AdaptiveVideo] Top block (%u) has %d/%d recv data/ec packets, eof: %d, will request %d packets.", pVideoBlock->uVideoBlockIndex, pVideoBlock->iRecvDataPackets, pVideoBlock->iRecvECPackets, pVideoBlock->iEndOfFrameDetectedAtPacketIndex, iCountToRequestFromBlock);
+         log_line("[AdaptiveVideo] Top block (%u) has %d/%d recv data/ec packets, eof: %d, needs %d packets.", pVideoBlock->uVideoBlockIndex, pVideoBlock->iRecvDataPackets, pVideoBlock->iRecvECPackets, pVideoBlock->iEndOfFrameDetectedAtPacketIndex, iCountToRequestFromBlock);
       }
-      if ( iCountToRequestFromBlock > 0 )
-      {
-         for( int k=0; k<pVideoBlock->iBlockDataPackets; k++ )
-         {
-            if ( NULL == pVideoBlock->packets[k].pRawData )
-               continue;
-            if ( ! pVideoBlock->packets[k].bEmpty )
-               continue;
-
-            uLastRequestedVideoBlockIndex = pVideoBlock->uVideoBlockIndex;
-            iLastRequestedVideoBlockPacketIndex = k;
-            memcpy(pDataInfo, &pVideoBlock->uVideoBlockIndex, sizeof(u32));
-            pDataInfo += sizeof(u32);
-            u8 uPacketIndex = k;
-            memcpy(pDataInfo, &uPacketIndex, sizeof(u8));
-            pDataInfo += sizeof(u8);
 
+      // Packets requested recently are still on their way, they count as received
+      for( int k=0; k<pVideoBlock->iBlockDataPackets; k++ )
+      {
+         if ( (NULL == pVideoBlock->packets[k].pRawData) || (! pVideoBlock->packets[k].bEmpty) )
+            continue;
+         if ( (0 != pVideoBlock->packets[k].uRequestedTime) && (g_TimeNow < pVideoBlock->packets[k].uRequestedTime + uRetryTimeout) )
             iCountToRequestFromBlock--;
-            iCountPacketsRequested++;
-            if ( iCountToRequestFromBlock == 0 )
-               break;
-            if ( iCountPacketsRequested >= DEFAULT_VIDEO_RETRANS_MAX_PCOUNT )
-              break;
-         }
+      }
+      if ( iCountToRequestFromBlock <= 0 )
+         continue;
+
+      // The block gets discarded once it's older than the retransmission window
+      u32 uDeadline = pVideoBlock->uReceivedTime + (u32)m_iMilisecondsMaxRetransmissionWindow;
+      if ( (0 != m_uRetransmissionsSmoothedRTTMs) && (m_iMilisecondsMaxRetransmissionWindow > 0) )
+      if ( g_TimeNow + m_uRetransmissionsSmoothedRTTMs > uDeadline )
+         continue;
+
+      if ( iCountBlocksToRequest >= MAX_RXTX_BLOCKS_BUFFER )
+         break;
+
+      // Keep the list sorted by deadline (stable, blocks are mostly in deadline order already)
+      int iPos = iCountBlocksToRequest;
+      while ( (iPos > 0) && (uBlocksDeadlines[iPos-1] > uDeadline) )
+      {
+         pBlocksToRequest[iPos] = pBlocksToRequest[iPos-1];
+         iCountToRequestFromBlocks[iPos] = iCountToRequestFromBlocks[iPos-1];
+         uBlocksDeadlines[iPos] = uBlocksDeadlines[iPos-1];
+         iPos--;
+      }
+      pBlocksToRequest[iPos] = pVideoBlock;
+      iCountToRequestFromBlocks[iPos] = iCountToRequestFromBlock;
+      uBlocksDeadlines[iPos] = uDeadline;
+      iCountBlocksToRequest++;
+   }
+
+   for( int i=0; i<iCountBlocksToRequest; i++ )
+   {
+      type_rx_video_block_info* pVideoBlock = pBlocksToRequest[i];
+      int iCountToRequestFromBlock = iCountToRequestFromBlocks[i];
+      for( int k=0; k<pVideoBlock->iBlockDataPackets; k++ )
+      {
+         if ( NULL == pVideoBlock->packets[k].pRawData )
+            continue;
+         if ( ! pVideoBlock->packets[k].bEmpty )
+            continue;
+         if ( (0 != pVideoBlock->packets[k].uRequestedTime) && (g_TimeNow < pVideoBlock->packets[k].uRequestedTime + uRetryTimeout) )
+            continue;
+
+         uLastRequestedVideoBlockIndex = pVideoBlock->uVideoBlockIndex;
+         iLastRequestedVideoBlockPacketIndex = k;
+         memcpy(pDataInfo, &pVideoBlock->uVideoBlockIndex, sizeof(u32));
+         pDataInfo += sizeof(u32);
+         u8 uPacketIndex = k;
+         memcpy(pDataInfo, &uPacketIndex, sizeof(u8));
+         pDataInfo += sizeof(u8);
+         pVideoBlock->packets[k].uRequestedTime = g_TimeNow;
+
+         iCountToRequestFromBlock--;
+         iCountPacketsRequested++;
+         if ( iCountToRequestFromBlock == 0 )
+            break;
+         if ( iCountPacketsRequested >= DEFAULT_VIDEO_RETRANS_MAX_PCOUNT )
+           break;
       }
       if ( iCountPacketsRequested >= DEFAULT_VIDEO_RETRANS_MAX_PCOUNT )
         break;
@@ -871,7 +991,17 @@ int ProcessorRxVideo::checkAndRequestMissingPackets(bool bForceSyncNow)
    PH.total_length += iCountPacketsRequested*(sizeof(u32) + sizeof(u8)); 
    memcpy(packet, (u8*)&PH, sizeof(t_packet_header));
 
-   if ( g_TimeNow < m_uLastTimeRequestedRetransmission + m_iMilisecondsMaxRetransmissionWindow )
+   // Once the round trip is known, check about twice per round trip: more often only
+   // finds packets that are still on their way
+   if ( 0 != m_uRetransmissionsSmoothedRTTMs )
+   {
+      m_uTimeIntervalMsForRequestingRetransmissions = m_uRetransmissionsSmoothedRTTMs/2;
+      if ( m_uTimeIntervalMsForRequestingRetransmissions < DEFAULT_VIDEO_RETRANS_MINIMUM_RETRY_INTERVAL )
+         m_uTimeIntervalMsForRequestingRetransmissions = DEFAULT_VIDEO_RETRANS_MINIMUM_RETRY_INTERVAL;
+      if ( m_uTimeIntervalMsForRequestingRetransmissions > 40 )
+         m_uTimeIntervalMsForRequestingRetransmissions = 40;
+   }
+   else if ( g_TimeNow < m_uLastTimeRequestedRetransmission + m_iMilisecondsMaxRetransmissionWindow )
    if ( m_uTimeIntervalMsForRequestingRetransmissions < 40 )
        m_uTimeIntervalMsForRequestingRetransmissions += 5;
 
@@ -890,9 +1020,10 @@ int ProcessorRxVideo::checkAndRequestMissingPackets(bool bForceSyncNow)
    pDataInfo = packet + sizeof(t_packet_header) + sizeof(u32) + 2*sizeof(u8);
    u32 uFirstReqBlockIndex =0;
    memcpy(&uFirstReqBlockIndex, pDataInfo, sizeof(u32));
-   log_line("[AdaptiveVideo] * Requested retr id %u from vehicle for %d packets ([%u/%d]...[%u/%d])",
-      m_uRequestRetransmissionUniqueId, iCountPacketsRequested,
-      uFirstReqBlockIndex, (int)pDataInfo[sizeof(u32)], uLastRequestedVideoBlockIndex, iLastRequestedVideoBlockPacketIndex);
+   log_line("[AdaptiveVideo] * Requested retr id %u from vehicle for %d packets of %d blocks ([%u/%d]...[%u/%d]), rtt: %u ms (+/-%u), retry after %u ms, next check in %u ms",
+      m_uRequestRetransmissionUniqueId, iCountPacketsRequested, iCountBlocksToRequest,
+      uFirstReqBlockIndex, (int)pDataInfo[sizeof(u32)], uLastRequestedVideoBlockIndex, iLastRequestedVideoBlockPacketIndex,
+      m_uRetransmissionsSmoothedRTTMs, m_uRetransmissionsRTTVariationMs, uRetryTimeout, m_uTimeIntervalMsForRequestingRetransmissions);
    
    log_line("[AdaptiveVideo] * Video blocks in buffer: %d (%s), top/max video block index in buffer: [%u/%u] / [%u/%d]",
       iCountBlocks, szBufferBlocks, uTopVideoBlockIndexInBuffer, uTopVideoBlockPacketIndexInBuffer, m_pVideoRxBuffer->getBufferTopReceivedVideoBlockIndex(), m_pVideoRxBuffer->getTopBufferMaxReceivedVideoBlockPacketIndex());
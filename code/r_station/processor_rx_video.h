@@ -107,12 +107,15 @@ class ProcessorRxVideo
       void resetOutputState();
       
       void updateControllerRTInfoAndVideoDecodingStats(u8* pRadioPacket, int iPacketLength);
+      void outputAvailableVideoPackets(bool bSkipIncompleteBlocks);
       
       void _checkUpdateRetransmissionsState();
       void checkUpdateRetransmissionsState();
       // Returns how many retransmission packets where requested, if any
       int checkAndRequestMissingPackets(bool bForceSyncNow);
       void checkAndDiscardBlocksTooOld();
+      void updateRetransmissionsRTT(u32 uRTTMs);
+      u32 getRetransmissionRetryTimeout();
 
       bool m_bInitialized;
       int m_iInstanceIndex;
@@ -123,6 +126,9 @@ class ProcessorRxVideo
       u32 m_uRetryRetransmissionAfterTimeoutMiliseconds;
       int m_iMilisecondsMaxRetransmissionWindow;
       u32 m_uTimeIntervalMsForRequestingRetransmissions;
+      // Measured retransmissions round trip (smoothed, and mean deviation), 0 if not measured yet
+      u32 m_uRetransmissionsSmoothedRTTMs;
+      u32 m_uRetransmissionsRTTVariationMs;
 
       // Output state
 
@@ -139,6 +145,7 @@ class ProcessorRxVideo
       u32 m_uLastTimeCheckedForMissingPackets;
       u32 m_uLastTimeRequestedRetransmission;
       u32 m_uRequestRetransmissionUniqueId;
+      u32 m_uRequestRetransmissionIdRTTSampled; // last request id used for a RTT sample
 
       u32 m_uEncodingsChangeCount;
       u32 m_uTimeLastVideoStreamChanged;
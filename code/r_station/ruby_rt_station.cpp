@@ -47,6 +47,8 @@
 #include "../base/hardware_files.h"
 #include "../base/hw_procs.h"
 #include "../base/ruby_ipc.h"
+#include "../base/event_loop.h"
+#include "../base/latency_stats.h"
 #include "../base/parse_fc_telemetry.h"
 #include "../common/string_utils.h"
 #include "../common/radio_stats.h"
@@ -68,6 +70,7 @@
 #include "processor_rx_video.h"
 #include "rx_video_output.h"
 #include "rx_video_recording.h"
+#include "video_trace.h"
 #include "process_radio_in_packets.h"
 #include "process_radio_out_packets.h"
 #include "process_local_packets.h"
@@ -105,6 +108,14 @@ int s_iSearchSikMCSTR = -1;
 
 u32 s_uTimeLastTryReadIPCMessages = 0;
 
+static type_event_loop s_StationEventLoop;
+static bool s_bUseStationEventLoop = false;
+static int s_iStationEventLoopSourceRxHighPrio = -1;
+static int s_iStationEventLoopSourceRxRegPrio = -1;
+static int s_iStationEventLoopSourceStreamerOut = -1;
+static int s_iStationEventLoopSourceTick = -1;
+static int s_iStationEventLoopSourceIPC = -1;
+
 u32 s_uAlarmIndexToCentral = 0;
 
 
@@ -861,6 +872,11 @@ void reasign_radio_links(bool bSilent)
    else
       radio_set_bypass_socket_buffers(0);
 
+   if ( g_pControllerSettings->iRadioRxUsesRing )
+      radio_set_use_rx_ring(1);
+   else
+      radio_set_use_rx_ring(0);
+
    _compute_radio_interfaces_assignment();
    links_set_cards_frequencies_and_params(-1);
    radio_links_open_rxtx_radio_interfaces();
@@ -1260,6 +1276,8 @@ int _consume_ipc_messages()
       log_line("Done handling received local packet from central, type: %s", str_get_packet_type(pPH->packet_type));
       iConsumed++;
    }
+   if ( s_bUseStationEventLoop )
+      event_loop_on_source_processed(&s_StationEventLoop, s_iStationEventLoopSourceIPC, iConsumed, 20);
    return iConsumed;
 }
 
@@ -1297,6 +1315,8 @@ int _try_read_consume_rx_packets(bool bHighPriority, int iCountMax, u32 uTimeout
                g_SMControllerRTInfo.uRxVideoECPackets[g_SMControllerRTInfo.iCurrentIndex][0]++;
             else
                g_SMControllerRTInfo.uRxVideoPackets[g_SMControllerRTInfo.iCurrentIndex][0]++;
+            if ( 0 != pPHVS->uTraceId )
+               video_trace_on_radio_packet(pPH, pPHVS, radio_rx_get_current_packet_rx_time_micros(bHighPriority?1:0));
          }
       }
       if ( g_bSearching )
@@ -1327,12 +1347,99 @@ int _try_read_consume_rx_packets(bool bHighPriority, int iCountMax, u32 uTimeout
          }
          if ( 0 == s_uTimeFirstRecvFrameVideoPacket )
             s_uTimeFirstRecvFrameVideoPacket = g_TimeNow;
-      }      
+      }
+      if ( bHighPriority )
+         radio_rx_release_high_prio_packet();
+      else
+         radio_rx_release_reg_prio_packet();
    }
 
    return iCountConsumed;
 }
 
+// Pins the radio rx thread and the router main thread (video reconstruction and output) to the last two CPU cores.
+// The worker threads the router main thread creates afterwards (FEC decode, recording, audio) inherit its core:
+// they reset their affinity to all the cores when they start (see hw_reset_current_thread_affinity).
+
+static void _main_loop_pin_rx_and_output_cores()
+{
+   if ( ! g_pControllerSettings->iRouterPinRxOutputCores )
+      return;
+   int iCores = hw_get_cpu_cores_count();
+   if ( iCores < 2 )
+   {
+      log_line("Main loop: single CPU core, no pinning of rx and output threads.");
+      return;
+   }
+   log_line("Main loop: pin radio rx thread to core %d and router output thread to core %d (%d cores).", iCores-2, iCores-1, iCores);
+   radio_rx_set_thread_cpu_core(iCores-2);
+   hw_set_current_thread_affinity("Main thread", iCores-1);
+}
+
+static void _main_loop_init_event_loop()
+{
+   s_bUseStationEventLoop = false;
+   if ( ! g_pControllerSettings->iRouterUseEventLoop )
+   {
+      log_line("Main loop: event loop is disabled, using polling main loop.");
+      return;
+   }
+   if ( ! event_loop_init(&s_StationEventLoop) )
+   {
+      log_softerror_and_alarm("Main loop: failed to create event loop, using polling main loop.");
+      return;
+   }
+   s_iStationEventLoopSourceRxHighPrio = event_loop_add_source(&s_StationEventLoop, "rx-high-prio", radio_rx_get_queue_event_fd(1), 0);
+   s_iStationEventLoopSourceRxRegPrio = event_loop_add_source(&s_StationEventLoop, "rx-reg-prio", radio_rx_get_queue_event_fd(0), 0);
+   s_iStationEventLoopSourceStreamerOut = event_loop_add_source(&s_StationEventLoop, "streamer-out", -1, EVENT_LOOP_SOURCE_FLAG_WRITE);
+   // Periodic work (video retransmissions, radio tx sync, IPC) runs on this timer when there is no radio data
+   s_iStationEventLoopSourceTick = event_loop_add_timer_source(&s_StationEventLoop, "tick", DEFAULT_CONTROLLER_ROUTER_LOOP_TICK_MICROSEC);
+   // IPC channels have no fd to wait on, they are read on each loop. Used just for the counters.
+   s_iStationEventLoopSourceIPC = event_loop_add_source(&s_StationEventLoop, "ipc", -1, 0);
+   if ( s_iStationEventLoopSourceTick < 0 )
+   {
+      log_softerror_and_alarm("Main loop: failed to create event loop timer, using polling main loop.");
+      event_loop_close(&s_StationEventLoop);
+      return;
+   }
+   s_bUseStationEventLoop = true;
+   log_line("Main loop: using event loop, tick: %d microsec.", DEFAULT_CONTROLLER_ROUTER_LOOP_TICK_MICROSEC);
+}
+
+// Blocks until radio rx packets are received, the streamer pipe can take pending output or the tick timer fires
+// Returns the time spent waiting, in miliseconds
+
+static u32 _main_loop_wait_for_events()
+{
+   if ( ! s_bUseStationEventLoop )
+      return 0;
+
+   // Fds can change while running (radio interfaces reasigned, streamer restarted)
+   event_loop_set_source_fd(&s_StationEventLoop, s_iStationEventLoopSourceRxHighPrio, radio_rx_get_queue_event_fd(1));
+   event_loop_set_source_fd(&s_StationEventLoop, s_iStationEventLoopSourceRxRegPrio, radio_rx_get_queue_event_fd(0));
+   event_loop_set_source_fd(&s_StationEventLoop, s_iStationEventLoopSourceStreamerOut, rx_video_output_get_pending_streamer_pipe_fd());
+
+   u32 uTimeStart = get_current_timestamp_ms();
+   int iTimeoutMs = 5;
+   if ( radio_rx_begin_wait_on_queues() )
+      iTimeoutMs = 0;
+   event_loop_wait(&s_StationEventLoop, iTimeoutMs);
+   radio_rx_end_wait_on_queues();
+
+   if ( event_loop_source_is_ready(&s_StationEventLoop, s_iStationEventLoopSourceStreamerOut) )
+      rx_video_output_flush_pending_streamer_output();
+
+   static u32 s_uTimeLastStationEventLoopStats = 0;
+   u32 uTimeNow = get_current_timestamp_ms();
+   if ( uTimeNow >= s_uTimeLastStationEventLoopStats + 60000 )
+   {
+      if ( 0 != s_uTimeLastStationEventLoopStats )
+         event_loop_log_and_reset_stats(&s_StationEventLoop, "Router main loop");
+      s_uTimeLastStationEventLoopStats = uTimeNow;
+   }
+   return uTimeNow - uTimeStart;
+}
+
 void _main_loop_searching();
 void _main_loop_simple(bool bDoBasicTxSync);
 void _main_loop_adv_sync();
@@ -1360,6 +1467,9 @@ int main(int argc, char *argv[])
    }
       
    log_init("Router");
+   log_enable_async_writes();
+   latency_stats_init_for_write(LATENCY_STATS_PROCESS_ROUTER_STATION);
+   video_trace_init();
    
    hardware_detectBoardAndSystemType();
 
@@ -1435,6 +1545,11 @@ int main(int argc, char *argv[])
    else
       radio_set_bypass_socket_buffers(0);
 
+   if ( g_pControllerSettings->iRadioRxUsesRing )
+      radio_set_use_rx_ring(1);
+   else
+      radio_set_use_rx_ring(0);
+
    if ( g_pControllerSettings->iRadioTxUsesPPCAP )
       radio_set_use_pcap_for_tx(1);
    else
@@ -1578,7 +1693,9 @@ int main(int argc, char *argv[])
    load_CorePlugins(0);
 
    radio_duplicate_detection_init();
+   _main_loop_pin_rx_and_output_cores();
    radio_rx_start_rx_thread(&g_SM_RadioStats, (int)g_bSearching, g_uAcceptedFirmwareType);
+   _main_loop_init_event_loop();
    
    log_line("Broadcasting that router is ready.");
    broadcast_router_ready();
@@ -1620,6 +1737,8 @@ int main(int argc, char *argv[])
 
    while ( !g_bQuit )
    {
+      // Time spent idle waiting for events is not part of the loop processing time
+      uLastLoopTime += _main_loop_wait_for_events();
       g_TimeNow = get_current_timestamp_ms();
       g_pProcessStats->lastActiveTime = g_TimeNow;
       g_pProcessStats->uLoopCounter++;
@@ -1664,6 +1783,8 @@ int main(int argc, char *argv[])
 
    radio_rx_stop_rx_thread();
    radio_link_cleanup();
+   if ( s_bUseStationEventLoop )
+      event_loop_close(&s_StationEventLoop);
    unload_CorePlugins();
 
    video_processors_cleanup();
@@ -1685,6 +1806,8 @@ int main(int argc, char *argv[])
    shared_mem_video_frames_stats_close(g_pSM_VideoFramesStatsOutput);
    //shared_mem_video_frames_stats_radio_in_close(g_pSM_VideoInfoStatsRadioIn);
    shared_mem_router_vehicles_runtime_info_close(g_pSM_RouterVehiclesRuntimeInfo);
+   latency_stats_close();
+   video_trace_uninit();
 
    radio_links_close_rxtx_radio_interfaces(); 
   
@@ -1767,6 +1890,9 @@ void _main_loop_try_recevive_video_data()
    u32 uTimeStart = g_TimeNow;
    u32 uMaxWait = 2;
    u32 uReadTimeoutMicros = 600;
+   // The event loop already waited for packets, so do not block here too
+   if ( s_bUseStationEventLoop )
+      uReadTimeoutMicros = 0;
    int iMaxCountToConsume = 5;
    int iTotalConsumedHighPriority = 0;
    int iTotalConsumedRegPriority = 0;
@@ -1790,10 +1916,19 @@ void _main_loop_try_recevive_video_data()
       // No more received regular data (video packets)
       if ( (0 == iConsumedReg) && (iTotalConsumedRegPriority > 0) )
          break;
+      // Nothing received: the event loop wakes up the router when new packets arrive
+      if ( s_bUseStationEventLoop && (0 == iConsumedReg) && (0 == iConsumedHigh) )
+         break;
 
       g_TimeNow = get_current_timestamp_ms();
    }
 
+   if ( s_bUseStationEventLoop )
+   {
+      event_loop_on_source_processed(&s_StationEventLoop, s_iStationEventLoopSourceRxHighPrio, iTotalConsumedHighPriority, iMaxCountToConsume);
+      event_loop_on_source_processed(&s_StationEventLoop, s_iStationEventLoopSourceRxRegPrio, iTotalConsumedRegPriority, iMaxCountToConsume);
+   }
+
    static int s_iCountConsumePacketsLogError = 0;
    if ( g_TimeNow > uTimeStart + uMaxWait + 5 )
    {
@@ -233,8 +233,19 @@ void process_data_telemetry_raw_download(u8* pBuffer, int length)
 
 void _process_data_rc_telemetry(u8* pBuffer, int length)
 {
+   // Older vehicles send a shorter RC info (no latency info), the missing fields are zero
    if ( NULL != s_pPHDownstreamInfoRC )
-      memcpy((u8*)s_pPHDownstreamInfoRC, pBuffer + sizeof(t_packet_header), sizeof(t_packet_header_rc_info_downstream));
+   {
+      int iLength = length - (int)sizeof(t_packet_header);
+      if ( iLength > (int)sizeof(t_packet_header_rc_info_downstream) )
+         iLength = sizeof(t_packet_header_rc_info_downstream);
+      if ( iLength < 0 )
+         iLength = 0;
+      if ( iLength < (int)sizeof(t_packet_header_rc_info_downstream) )
+         memset(((u8*)s_pPHDownstreamInfoRC) + iLength, 0, sizeof(t_packet_header_rc_info_downstream) - iLength);
+      if ( iLength > 0 )
+         memcpy((u8*)s_pPHDownstreamInfoRC, pBuffer + sizeof(t_packet_header), iLength);
+   }
 
    if ( NULL != g_pProcessStats )
       g_pProcessStats->timeLastReceivedPacket = g_TimeNow;
@@ -480,7 +491,7 @@ void try_read_messages_from_router()
          continue;
       }
 
-      if ( ! radio_packet_check_crc(s_BufferTelemetryDownlink, pPH->total_length) )
+      if ( ! ruby_ipc_message_crc_is_valid(s_BufferTelemetryDownlink, pPH->total_length) )
       {
          if ( maxMessagesToRead <= 0 )
             break;
@@ -57,6 +57,7 @@
 #include "../base/ctrl_settings.h"
 #include "../utils/utils_controller.h"
 #include "../base/ruby_ipc.h"
+#include "../base/event_loop.h"
 #include "../common/string_utils.h"
 
 #include "timers.h"
@@ -68,6 +69,10 @@
 
 #define MAX_SERIAL_BUFFER_SIZE 512
 
+// The loop wakes up on joystick input and on the next RC frame deadline; these bound the wait otherwise
+#define RC_TX_MAIN_LOOP_MAX_WAIT_MS 20
+#define RC_TX_MAIN_LOOP_RC_IN_CHECK_INTERVAL_MS 2 // RC in (SBUS/IBUS) is read from shared memory, so it's polled
+
 u32 g_iFPSFramesCount = 0;
 int g_iFPSMaxJoystickEvents = 0;
 int g_iFPSTotalJoystickEvents = 0;
@@ -97,6 +102,16 @@ u8 s_uLastFrameIndexRCIn = 0;
 u32 s_uTimeLastRCFrameSent = 0;
 u32 s_uTimeBetweenRCFramesOutput = 100000;
 
+static type_event_loop s_MainEventLoop;
+static bool s_bUseMainEventLoop = false;
+static int s_iMainEventLoopSourceJoystick = -1;
+static int s_iMainEventLoopSourceIPC = -1;
+
+u32 s_uTimeFirstUnsentInputMicros = 0; // when the oldest stick input not yet sent in a RC frame was read, 0 if none
+// Joystick state when the last RC frame was computed, so button presses read between frames are not lost
+int s_iJoystickButtonsAtLastFrame[MAX_JOYSTICK_BUTTONS];
+int s_iJoystickAxesAtLastFrame[MAX_JOYSTICK_AXES];
+
 void init_controller_settings();
 
 void populate_rc_data( t_packet_header_rc_full_frame_upstream* pPHRCF )
@@ -144,6 +159,9 @@ bool handle_joysticks()
       {
          if ( 0 == hardware_open_joystick(s_pCII->currentHardwareIndex) )
             s_pJoystick = NULL;
+         // Reopened joysticks can get the same fd number as before: re-register it
+         if ( s_bUseMainEventLoop )
+            event_loop_set_source_fd(&s_MainEventLoop, s_iMainEventLoopSourceJoystick, -1);
       }
       return false;  
    }
@@ -151,13 +169,16 @@ bool handle_joysticks()
    if ( NULL == s_pJoystick || NULL == s_pCII )
       return false;
    
-   int countEvents = hardware_read_joystick(s_pCII->currentHardwareIndex, 5);
+   // Reads just the pending events: the main loop waits on the joystick fd
+   int countEvents = hardware_read_joystick(s_pCII->currentHardwareIndex, 0);
    if ( countEvents < 0 )
    {
       log_line("Hardware: failed to read joystick.");
       hardware_close_joystick(s_pCII->currentHardwareIndex);
       return false;
    }
+   if ( (countEvents > 0) && (0 == s_uTimeFirstUnsentInputMicros) )
+      s_uTimeFirstUnsentInputMicros = get_current_timestamp_micros();
 
    g_iJoystickCheckFailureCount = 0;
    g_iFPSTotalJoystickEvents += countEvents;
@@ -165,9 +186,82 @@ bool handle_joysticks()
       g_iFPSMaxJoystickEvents = countEvents;
 
    memcpy(&s_JoystickLocalInfo, s_pJoystick, sizeof(hw_joystick_info_t));
+   memcpy(s_JoystickLocalInfo.buttonsValuesPrev, s_iJoystickButtonsAtLastFrame, sizeof(s_iJoystickButtonsAtLastFrame));
+   memcpy(s_JoystickLocalInfo.axesValuesPrev, s_iJoystickAxesAtLastFrame, sizeof(s_iJoystickAxesAtLastFrame));
    return true;
 }
 
+static int _get_joystick_fd()
+{
+   // The joystick is read only while sending RC frames: don't wake up on it otherwise
+   if ( g_bSearching || g_bUpdateInProgress || (NULL == g_pCurrentModel) )
+      return -1;
+   if ( (! g_pCurrentModel->rc_params.rc_enabled) || g_pCurrentModel->is_spectator )
+      return -1;
+   if ( g_pCurrentModel->rc_params.inputType != RC_INPUT_TYPE_USB )
+      return -1;
+   if ( (NULL == s_pCII) || (NULL == s_pJoystick) || (!hardware_is_joystick_opened(s_pCII->currentHardwareIndex)) )
+      return -1;
+   return s_pJoystick->fd;
+}
+
+static void _main_loop_init_event_loop()
+{
+   s_bUseMainEventLoop = false;
+   if ( ! event_loop_init(&s_MainEventLoop) )
+   {
+      log_softerror_and_alarm("Main loop: failed to create event loop, using polling main loop.");
+      return;
+   }
+   s_iMainEventLoopSourceJoystick = event_loop_add_source(&s_MainEventLoop, "joystick", -1, 0);
+   // Used just for the counters
+   s_iMainEventLoopSourceIPC = event_loop_add_source(&s_MainEventLoop, "ipc", -1, 0);
+   s_bUseMainEventLoop = true;
+   log_line("Main loop: using event loop.");
+}
+
+// Blocks until there is joystick input or the next RC frame is due, at most iMaxWaitMs
+
+static void _main_loop_wait_for_events(int iMaxWaitMs)
+{
+   if ( ! s_bUseMainEventLoop )
+   {
+      hardware_sleep_ms(iMaxWaitMs);
+      return;
+   }
+   event_loop_set_source_fd(&s_MainEventLoop, s_iMainEventLoopSourceJoystick, _get_joystick_fd());
+   event_loop_wait(&s_MainEventLoop, iMaxWaitMs);
+
+   static u32 s_uTimeLastMainEventLoopStats = 0;
+   u32 uTimeNow = get_current_timestamp_ms();
+   if ( uTimeNow >= s_uTimeLastMainEventLoopStats + 60000 )
+   {
+      if ( 0 != s_uTimeLastMainEventLoopStats )
+         event_loop_log_and_reset_stats(&s_MainEventLoop, "RC tx main loop");
+      s_uTimeLastMainEventLoopStats = uTimeNow;
+   }
+}
+
+static int _main_loop_get_wait_time_ms()
+{
+   if ( g_bSearching || g_bUpdateInProgress || (NULL == g_pCurrentModel) )
+      return RC_TX_MAIN_LOOP_MAX_WAIT_MS;
+   if ( (! g_pCurrentModel->rc_params.rc_enabled) || g_pCurrentModel->is_spectator )
+      return RC_TX_MAIN_LOOP_MAX_WAIT_MS;
+
+   int iWaitMs = RC_TX_MAIN_LOOP_MAX_WAIT_MS;
+   u32 uTimeNow = get_current_timestamp_ms();
+   if ( uTimeNow >= s_uTimeLastRCFrameSent + s_uTimeBetweenRCFramesOutput )
+      return 0;
+   u32 uTimeToNextFrame = s_uTimeLastRCFrameSent + s_uTimeBetweenRCFramesOutput - uTimeNow;
+   if ( uTimeToNextFrame < (u32)iWaitMs )
+      iWaitMs = (int)uTimeToNextFrame;
+   if ( g_pCurrentModel->rc_params.inputType == RC_INPUT_TYPE_RC_IN_SBUS_IBUS )
+   if ( iWaitMs > RC_TX_MAIN_LOOP_RC_IN_CHECK_INTERVAL_MS )
+      iWaitMs = RC_TX_MAIN_LOOP_RC_IN_CHECK_INTERVAL_MS;
+   return iWaitMs;
+}
+
 
 void try_read_pipes()
 {
@@ -177,7 +271,7 @@ void try_read_pipes()
    {
       maxMsgToRead--;
       t_packet_header* pPH = (t_packet_header*)&s_BufferRCDownlink[0];
-      if ( ! radio_packet_check_crc(s_BufferRCDownlink, pPH->total_length) )
+      if ( ! ruby_ipc_message_crc_is_valid(s_BufferRCDownlink, pPH->total_length) )
       {
          continue;
       }
@@ -223,6 +317,8 @@ void try_read_pipes()
          g_bUpdateInProgress = false;
 
    }
+   if ( s_bUseMainEventLoop )
+      event_loop_on_source_processed(&s_MainEventLoop, s_iMainEventLoopSourceIPC, 5 - maxMsgToRead, 5);
 }
 
 void init_controller_settings()
@@ -346,17 +442,23 @@ int main (int argc, char *argv[])
    if ( NULL != s_pPHRCFUpstream )
       memcpy(s_pPHRCFUpstream, &g_PHRCFUpstream, sizeof(t_packet_header_rc_full_frame_upstream) );
 
+   for( int i=0; i<MAX_JOYSTICK_BUTTONS; i++ )
+      s_iJoystickButtonsAtLastFrame[i] = 0;
+   for( int i=0; i<MAX_JOYSTICK_AXES; i++ )
+      s_iJoystickAxesAtLastFrame[i] = 0;
+
    g_TimeStart = get_current_timestamp_ms(); 
 
-   int iSleepTime = 50;
-   #ifdef FEATURE_ENABLE_RC
-   iSleepTime = 10;
-   #endif
+   _main_loop_init_event_loop();
 
    while ( !g_bQuit )
    { 
       g_iFPSFramesCount++;
-      hardware_sleep_ms(iSleepTime);
+      #ifdef FEATURE_ENABLE_RC
+      _main_loop_wait_for_events(_main_loop_get_wait_time_ms());
+      #else
+      _main_loop_wait_for_events(50);
+      #endif
 
       g_TimeNow = get_current_timestamp_ms();
       u32 tTime0 = g_TimeNow;
@@ -396,14 +498,18 @@ int main (int argc, char *argv[])
    
       #ifdef FEATURE_ENABLE_RC
 
+      // Always drain the joystick events, so the loop does not keep waking up on them
+      bool bHasJoystickInput = false;
+      if ( g_pCurrentModel->rc_params.inputType == RC_INPUT_TYPE_USB )
+      {
+         bHasJoystickInput = handle_joysticks();
+         if ( s_bUseMainEventLoop && event_loop_source_is_ready(&s_MainEventLoop, s_iMainEventLoopSourceJoystick) )
+            event_loop_on_source_processed(&s_MainEventLoop, s_iMainEventLoopSourceJoystick, 1, 0);
+      }
+
       if ( g_TimeNow < s_uTimeLastRCFrameSent + s_uTimeBetweenRCFramesOutput )
       {
          _update_loop_info(tTime0);
-
-         u32 uDelta = s_uTimeLastRCFrameSent + s_uTimeBetweenRCFramesOutput - g_TimeNow;
-         if ( uDelta > 40 )
-            uDelta = 40;
-         hardware_sleep_ms(uDelta/2);
          continue;
       }
 
@@ -411,13 +517,15 @@ int main (int argc, char *argv[])
 
       if ( g_pCurrentModel->rc_params.inputType == RC_INPUT_TYPE_USB )
       {
-         if ( handle_joysticks() )
+         if ( bHasJoystickInput )
             g_PHRCFUpstream.flags |= RC_FULL_FRAME_FLAGS_HAS_INPUT;
          else
             g_PHRCFUpstream.flags &= (~RC_FULL_FRAME_FLAGS_HAS_INPUT);
 
          for( int i=0; i<(int)(g_pCurrentModel->rc_params.channelsCount); i++ )
             s_ComputedRCValues[i] = (u16) compute_controller_rc_value(g_pCurrentModel, i, (float)(s_ComputedRCValues[i]), NULL, &s_JoystickLocalInfo, s_pCII, miliSec);
+         memcpy(s_iJoystickButtonsAtLastFrame, s_JoystickLocalInfo.buttonsValues, sizeof(s_iJoystickButtonsAtLastFrame));
+         memcpy(s_iJoystickAxesAtLastFrame, s_JoystickLocalInfo.axesValues, sizeof(s_iJoystickAxesAtLastFrame));
       }
 
       if ( g_pCurrentModel->rc_params.inputType == RC_INPUT_TYPE_RC_IN_SBUS_IBUS )
@@ -432,6 +540,9 @@ int main (int argc, char *argv[])
             g_PHRCFUpstream.flags |= RC_FULL_FRAME_FLAGS_HAS_INPUT;
             if ( (s_uLastTimeStampRCInFrame != s_pSM_RCIn->uTimeStamp) && (s_uLastFrameIndexRCIn != s_pSM_RCIn->uFrameIndex) )
             {
+               // The RC in frame time is on the same (boot based) clock as ours
+               if ( (0 == s_uTimeFirstUnsentInputMicros) && (s_pSM_RCIn->uTimeStamp <= g_TimeNow) )
+                  s_uTimeFirstUnsentInputMicros = s_pSM_RCIn->uTimeStamp * 1000;
                s_uLastTimeStampRCInFrame = s_pSM_RCIn->uTimeStamp;
                s_uLastFrameIndexRCIn = s_pSM_RCIn->uFrameIndex;
                int nCh = g_pCurrentModel->rc_params.channelsCount;
@@ -454,6 +565,17 @@ int main (int argc, char *argv[])
 
       populate_rc_data(&g_PHRCFUpstream);
 
+      g_PHRCFUpstream.flags |= RC_FULL_FRAME_FLAGS_HAS_INPUT_AGE;
+      g_PHRCFUpstream.extra_info1 = RC_FULL_FRAME_INPUT_AGE_NONE;
+      if ( 0 != s_uTimeFirstUnsentInputMicros )
+      {
+         u32 uInputAge = (get_current_timestamp_micros() - s_uTimeFirstUnsentInputMicros) / RC_FULL_FRAME_INPUT_AGE_UNIT_MICROS;
+         if ( uInputAge > RC_FULL_FRAME_INPUT_AGE_MAX )
+            uInputAge = RC_FULL_FRAME_INPUT_AGE_MAX;
+         g_PHRCFUpstream.extra_info1 = (u8)uInputAge;
+         s_uTimeFirstUnsentInputMicros = 0;
+      }
+
       if ( NULL != s_pPHRCFUpstream )
          memcpy(s_pPHRCFUpstream, &g_PHRCFUpstream, sizeof(t_packet_header_rc_full_frame_upstream) );
 
@@ -474,6 +596,9 @@ int main (int argc, char *argv[])
       _update_loop_info(tTime0);
    }
 
+   if ( s_bUseMainEventLoop )
+      event_loop_close(&s_MainEventLoop);
+
    if ( NULL != s_pCII )
       hardware_close_joystick(s_pCII->currentHardwareIndex);
 
@@ -55,6 +55,7 @@
 #include "../base/radio_utils.h"
 #include "../base/hardware.h"
 #include "../base/hw_procs.h"
+#include "../base/latency_stats.h"
 #include "../base/ruby_ipc.h"
 #include "../base/parser_h264.h"
 #include "../base/camera_utils.h"
@@ -98,6 +99,19 @@ u32 s_uLastIOErrorAlarmFlagsVideoStreamer = 0;
 u32 s_uLastIOErrorAlarmFlagsUSBPlayer = 0;
 u32 s_uTimeLastOkVideoStreamerOutputToPipe = 0;
 u32 s_uTimeStartGettingVideoIOErrors = 0;
+
+// When the router uses the event loop, the streamer pipe is non blocking: data that does not
+// fit in the pipe is kept here and written when the pipe becomes writable again
+#define STREAMER_PIPE_PENDING_BUFFER_SIZE (512*1024)
+bool s_bStreamerPipeNonBlocking = false;
+u8 s_uStreamerPipePendingBuffer[STREAMER_PIPE_PENDING_BUFFER_SIZE];
+int s_iStreamerPipePendingBytes = 0;
+u32 s_uStreamerPipeDroppedBytes = 0;
+
+// Totals of the video data handed to the outputs, and the optional raw stream file output
+u32 s_uRxVideoOutputTotalPackets = 0;
+unsigned long long s_uRxVideoOutputTotalBytes = 0;
+int s_fRxVideoOutputFile = -1;
          
 typedef struct
 {
@@ -525,6 +539,19 @@ void _rx_video_output_open_pipe_to_streamer()
    log_line("[VideoOutput] Opened video output pipe to streamer write endpoint: %s", FIFO_RUBY_STATION_VIDEO_STREAM_DISPLAY);
    log_line("[VideoOutput] Video output pipe to streamer flags: %s", str_get_pipe_flags(fcntl(s_fPipeVideoOutToStreamer, F_GETFL)));
 
+   s_iStreamerPipePendingBytes = 0;
+   s_bStreamerPipeNonBlocking = false;
+   if ( get_ControllerSettings()->iRouterUseEventLoop )
+   {
+      if ( 0 != fcntl(s_fPipeVideoOutToStreamer, F_SETFL, fcntl(s_fPipeVideoOutToStreamer, F_GETFL) | O_NONBLOCK) )
+         log_softerror_and_alarm("[VideoOutput] Failed to set nonblock flag on video output pipe to streamer.");
+      else
+      {
+         s_bStreamerPipeNonBlocking = true;
+         log_line("[VideoOutput] Video output pipe to streamer is non blocking, new flags: %s", str_get_pipe_flags(fcntl(s_fPipeVideoOutToStreamer, F_GETFL)));
+      }
+   }
+
    //if ( RUBY_PIPES_EXTRA_FLAGS & O_NONBLOCK )
    //if ( 0 != fcntl(s_fPipeVideoOutToStreamer, F_SETFL, O_NONBLOCK) )
    //   log_softerror_and_alarm("[IPC] Failed to set nonblock flag on PIC channel %s write endpoint.", FIFO_RUBY_STATION_VIDEO_STREAM_DISPLAY);
@@ -726,6 +753,7 @@ void rx_video_output_uninit()
       close( s_fPipeVideoOutToStreamer );
    }
    s_fPipeVideoOutToStreamer = -1;
+   s_iStreamerPipePendingBytes = 0;
    s_bDidSentAnyDataToVideoStreamerPipe = false;
    s_bDidSentAnyDataToVideoStreamerSM = false;
 
@@ -736,6 +764,7 @@ void rx_video_output_uninit()
    s_VideoUSBOutputInfo.usbBufferPos = 0;
 
    rx_video_recording_uninit();
+   rx_video_output_disable_file_output();
 
    if ( NULL != s_pSemaphoreVideoStreamerOverloadAlarm )
       sem_close(s_pSemaphoreVideoStreamerOverloadAlarm);
@@ -793,13 +822,48 @@ void rx_video_output_disable_streamer_output()
       log_line("[VideoOutput] Closed video output to pipe to streamer.");
    }
    s_fPipeVideoOutToStreamer = -1;
+   s_iStreamerPipePendingBytes = 0;
    s_bDidSentAnyDataToVideoStreamerPipe = false;
    s_bDidSentAnyDataToVideoStreamerSM = false;
 }
 
+bool rx_video_output_enable_file_output(const char* szFile)
+{
+   rx_video_output_disable_file_output();
+   if ( (NULL == szFile) || (0 == szFile[0]) )
+      return false;
+   s_fRxVideoOutputFile = open(szFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   if ( -1 == s_fRxVideoOutputFile )
+   {
+      log_softerror_and_alarm("[VideoOutput] Failed to open video output file (%s).", szFile);
+      return false;
+   }
+   log_line("[VideoOutput] Enabled video output to file (%s).", szFile);
+   return true;
+}
+
+void rx_video_output_disable_file_output()
+{
+   if ( -1 == s_fRxVideoOutputFile )
+      return;
+   close(s_fRxVideoOutputFile);
+   s_fRxVideoOutputFile = -1;
+   log_line("[VideoOutput] Disabled video output to file.");
+}
+
+void rx_video_output_get_output_counters(u32* puOutputPackets, unsigned long long* puOutputBytes)
+{
+   if ( NULL != puOutputPackets )
+      *puOutputPackets = s_uRxVideoOutputTotalPackets;
+   if ( NULL != puOutputBytes )
+      *puOutputBytes = s_uRxVideoOutputTotalBytes;
+}
+
+// The file output consumes the video too (offline tools)
+
 bool rx_video_out_is_stream_output_disabled()
 {
-   return ! s_bEnableVideoStreamerOutput;
+   return (! s_bEnableVideoStreamerOutput) && (-1 == s_fRxVideoOutputFile);
 }
 
 void rx_video_output_enable_local_player_udp_output()
@@ -926,6 +990,95 @@ void _rx_video_output_to_sharedmem(u8* pBuffer, u32 uLength)
    }
 }
 
+static void _rx_video_output_on_streamer_pipe_write_ok(int iBytes)
+{
+   s_uOutputBitrateToLocalVideoStreamerPipe += iBytes*8;
+   s_uTimeStartGettingVideoIOErrors = 0;
+   if ( 0 != s_uLastIOErrorAlarmFlagsVideoStreamer )
+   {
+      s_uTimeLastOkVideoStreamerOutputToPipe = g_TimeNow;
+      s_uLastIOErrorAlarmFlagsVideoStreamer = 0;
+      send_alarm_to_central(ALARM_ID_CONTROLLER_IO_ERROR, 0,0);
+   }
+}
+
+// Returns the number of bytes written, or -1 on pipe error (other than pipe full)
+static int _rx_video_output_write_streamer_pipe_nonblocking(u8* pBuffer, int length)
+{
+   int iWritten = 0;
+   while ( iWritten < length )
+   {
+      int iRes = write(s_fPipeVideoOutToStreamer, pBuffer + iWritten, length - iWritten);
+      if ( iRes > 0 )
+      {
+         iWritten += iRes;
+         continue;
+      }
+      if ( (iRes < 0) && (errno == EINTR) )
+         continue;
+      if ( (iRes < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) )
+         return -1;
+      break;
+   }
+   return iWritten;
+}
+
+// Returns false if the data could not be written or buffered (pending buffer full or pipe error)
+static bool _rx_video_output_to_video_streamer_pipe_nonblocking(u8* pBuffer, int length)
+{
+   rx_video_output_flush_pending_streamer_output();
+
+   int iWritten = 0;
+   if ( 0 == s_iStreamerPipePendingBytes )
+   {
+      iWritten = _rx_video_output_write_streamer_pipe_nonblocking(pBuffer, length);
+      if ( iWritten < 0 )
+         return false;
+      if ( iWritten > 0 )
+         _rx_video_output_on_streamer_pipe_write_ok(iWritten);
+      if ( iWritten == length )
+         return true;
+   }
+
+   // Keep the rest for when the pipe is writable again. Drop all of it if it does not fit.
+   if ( s_iStreamerPipePendingBytes + (length - iWritten) > STREAMER_PIPE_PENDING_BUFFER_SIZE )
+   {
+      s_uStreamerPipeDroppedBytes += (u32)(length - iWritten);
+      errno = EAGAIN;
+      return false;
+   }
+   memcpy(&s_uStreamerPipePendingBuffer[s_iStreamerPipePendingBytes], pBuffer + iWritten, length - iWritten);
+   s_iStreamerPipePendingBytes += length - iWritten;
+   return true;
+}
+
+int rx_video_output_get_pending_streamer_pipe_fd()
+{
+   if ( (0 == s_iStreamerPipePendingBytes) || (-1 == s_fPipeVideoOutToStreamer) )
+      return -1;
+   return s_fPipeVideoOutToStreamer;
+}
+
+void rx_video_output_flush_pending_streamer_output()
+{
+   if ( (0 == s_iStreamerPipePendingBytes) || (-1 == s_fPipeVideoOutToStreamer) )
+      return;
+   int iWritten = _rx_video_output_write_streamer_pipe_nonblocking(s_uStreamerPipePendingBuffer, s_iStreamerPipePendingBytes);
+   if ( iWritten < 0 )
+   {
+      log_softerror_and_alarm("[VideoOutput] Failed to write pending data (%d bytes) to streamer pipe, error: %d (%s). Discard it.", s_iStreamerPipePendingBytes, errno, strerror(errno));
+      s_uStreamerPipeDroppedBytes += (u32)s_iStreamerPipePendingBytes;
+      s_iStreamerPipePendingBytes = 0;
+      return;
+   }
+   if ( 0 == iWritten )
+      return;
+   _rx_video_output_on_streamer_pipe_write_ok(iWritten);
+   if ( iWritten < s_iStreamerPipePendingBytes )
+      memmove(s_uStreamerPipePendingBuffer, &s_uStreamerPipePendingBuffer[iWritten], s_iStreamerPipePendingBytes - iWritten);
+   s_iStreamerPipePendingBytes -= iWritten;
+}
+
 void _rx_video_output_to_video_streamer_pipe(u8* pBuffer, int length)
 {
    if ( (NULL == pBuffer) || (length == 0) )
@@ -940,20 +1093,23 @@ void _rx_video_output_to_video_streamer_pipe(u8* pBuffer, int length)
       s_bDidSentAnyDataToVideoStreamerPipe = true;
    }
    
-   g_pProcessStats->uInBlockingOperation = 1;
-   int iRes = write(s_fPipeVideoOutToStreamer, pBuffer, length);
-   g_pProcessStats->uInBlockingOperation = 0;
+   int iRes = -1;
+   if ( s_bStreamerPipeNonBlocking )
+   {
+      // On failure errno is set by the failed write, or EAGAIN when the pending buffer is full
+      if ( _rx_video_output_to_video_streamer_pipe_nonblocking(pBuffer, length) )
+         return;
+   }
+   else
+   {
+      g_pProcessStats->uInBlockingOperation = 1;
+      iRes = write(s_fPipeVideoOutToStreamer, pBuffer, length);
+      g_pProcessStats->uInBlockingOperation = 0;
+   }
 
    if ( iRes == length )
    {
-      s_uOutputBitrateToLocalVideoStreamerPipe += iRes*8;
-      s_uTimeStartGettingVideoIOErrors = 0;
-      if ( 0 != s_uLastIOErrorAlarmFlagsVideoStreamer )
-      {
-         s_uTimeLastOkVideoStreamerOutputToPipe = g_TimeNow;
-         s_uLastIOErrorAlarmFlagsVideoStreamer = 0;
-         send_alarm_to_central(ALARM_ID_CONTROLLER_IO_ERROR, 0,0);
-      }
+      _rx_video_output_on_streamer_pipe_write_ok(iRes);
       //fsync(s_fPipeVideoOutToStreamer);
       return;
    }
@@ -1090,6 +1246,9 @@ void rx_video_output_video_data(u32 uVehicleId, u8 uVideoStreamType, int width,
    if ( g_bSearching )
       return;
 
+   s_uRxVideoOutputTotalPackets++;
+   s_uRxVideoOutputTotalBytes += (unsigned long long)video_data_length;
+
    // To fix
    //if ( g_pCurrentModel->bDeveloperMode )
    //if ( packet_length > video_data_length + sizeof(t_packet_header) + sizeof(t_packet_header_video_full_98) + sizeof(u16) )
@@ -1171,6 +1330,8 @@ void rx_video_output_video_data(u32 uVehicleId, u8 uVideoStreamType, int width,
       }
    }
 
+   u32 uTimeStartOutput = latency_stats_start();
+
    if ( s_bEnableVideoStreamerOutput && s_bRxVideoOutputUseSM )
       _rx_video_output_to_sharedmem(pBuffer, (u32)video_data_length);
 
@@ -1183,6 +1344,13 @@ void rx_video_output_video_data(u32 uVehicleId, u8 uVideoStreamType, int width,
    if ( s_VideoETHOutputInfo.s_bForwardETHPipeEnabled && (-1 != s_VideoETHOutputInfo.s_ForwardETHVideoPipeFile) )
       write(s_VideoETHOutputInfo.s_ForwardETHVideoPipeFile, pBuffer, video_data_length);
 
+   if ( -1 != s_fRxVideoOutputFile )
+   if ( video_data_length != write(s_fRxVideoOutputFile, pBuffer, video_data_length) )
+   {
+      log_softerror_and_alarm("[VideoOutput] Failed to write to video output file. Disable file output.");
+      rx_video_output_disable_file_output();
+   }
+
    rx_video_recording_on_new_data(pBuffer, video_data_length);
 
    if ( s_VideoETHOutputInfo.s_bForwardIsETHForwardEnabled && (-1 != s_VideoETHOutputInfo.s_ForwardETHSocketVideo ) )
@@ -1190,6 +1358,8 @@ void rx_video_output_video_data(u32 uVehicleId, u8 uVideoStreamType, int width,
 
    if ( s_VideoUSBOutputInfo.bVideoUSBTethering && 0 != s_VideoUSBOutputInfo.szIPUSBVideo[0] )
       _rx_video_output_to_usb(pBuffer, video_data_length);
+
+   latency_stats_end(LATENCY_STAGE_VIDEO_OUTPUT, uTimeStartOutput);
 }
 
 
@@ -1302,7 +1472,8 @@ void rx_video_output_periodic_loop()
    if ( g_bDebugState )
    if ( g_TimeNow >= s_uLastTimeComputedOutputBitrate + 1000 )
    {
-      log_line("[VideoOutput] Output to pipe: %u bps, output to UDP: %u bps", s_uOutputBitrateToLocalVideoStreamerPipe, s_uOutputBitrateToLocalVideoPlayerUDP );
+      log_line("[VideoOutput] Output to pipe: %u bps, output to UDP: %u bps, pending pipe output: %d bytes, dropped pipe output: %u bytes",
+         s_uOutputBitrateToLocalVideoStreamerPipe, s_uOutputBitrateToLocalVideoPlayerUDP, s_iStreamerPipePendingBytes, s_uStreamerPipeDroppedBytes);
       s_uLastTimeComputedOutputBitrate = g_TimeNow;
       s_uOutputBitrateToLocalVideoStreamerPipe = 0;
       s_uOutputBitrateToLocalVideoPlayerUDP = 0;
@@ -15,9 +15,19 @@ void rx_video_output_disable_local_player_udp_output();
 
 void rx_video_output_enable_stream_parsing(bool bEnable);
 
+// Raw video stream copy to a file (offline tools), works without rx_video_output_init
+bool rx_video_output_enable_file_output(const char* szFile);
+void rx_video_output_disable_file_output();
+void rx_video_output_get_output_counters(u32* puOutputPackets, unsigned long long* puOutputBytes);
+
 void rx_video_output_video_data(u32 uVehicleId, u8 uVideoStreamType, int width, int height, u8* pBuffer, int video_data_length, int packet_length);
 void rx_video_output_on_controller_settings_changed();
 
 void rx_video_output_signal_restart_streamer();
 void rx_video_output_periodic_loop();
 
+// Non blocking streamer pipe output (router event loop): returns the pipe fd to wait for
+// writability on, only when there is pending output, or -1
+int rx_video_output_get_pending_streamer_pipe_fd();
+void rx_video_output_flush_pending_streamer_output();
+
@@ -111,6 +111,7 @@ void _recording_write_error(const char* szError)
 void* _thread_video_recording(void *argument)
 {
    log_line("[VideoRecording-Th] Thread to record started.");
+   hw_reset_current_thread_affinity("[VideoRecording-Th]");
 
    char szComm[256];
    sprintf(szComm, "mkdir -p %s",FOLDER_MEDIA);
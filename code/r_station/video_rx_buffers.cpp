@@ -34,9 +34,164 @@
 #include "shared_vars.h"
 #include "timers.h"
 #include "packets_utils.h"
+#include "video_trace.h"
 #include "../radio/fec.h"
+#include "../base/hw_procs.h"
+#include "../base/latency_stats.h"
+#include <pthread.h>
+#include <sys/mman.h>
+
+// Damaged video blocks can be reconstructed (EC decoded) on a pool of worker threads,
+// so that a burst of damaged blocks does not stall the router thread.
+// The pool is shared by all video rx buffers. The worker threads only touch the
+// video data of the block packets; the router thread queues the jobs, collects the
+// results (checkCompletedECDecodes) and updates the blocks state. Blocks are still
+// outputed in order, as the output stops at a block that has a decode in progress.
+// Packets received for a block while it is decoded are kept aside and added to the block
+// once the decode is done (a received data packet replaces the reconstructed one).
+// Single core CPUs (or a controller setting of 0) decode inline, on the router thread.
+// The worker threads are stopped and joined when the last video rx buffer is deleted.
+
+#define MAX_VIDEO_RX_FEC_WORKERS 4
+#define MAX_VIDEO_RX_FEC_JOBS 32
+
+#define VIDEO_RX_FEC_JOB_FREE 0
+#define VIDEO_RX_FEC_JOB_QUEUED 1
+#define VIDEO_RX_FEC_JOB_RUNNING 2
+#define VIDEO_RX_FEC_JOB_DONE 3
+
+typedef struct
+{
+   int iState;
+   u32 uQueueOrder;
+   u32 uVideoBlockIndex;
+   int iBlockDataSize;
+   int iBlockDataPackets;
+   int iPacketIndexGood;
+   int iDecodeResult;
+   type_fec_info fecInfo;
+}
+type_video_rx_fec_job;
+
+static pthread_mutex_t s_MutexVideoRxFECJobs = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_CondVideoRxFECJobQueued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t s_CondVideoRxFECJobDone = PTHREAD_COND_INITIALIZER;
+static type_video_rx_fec_job s_VideoRxFECJobs[MAX_VIDEO_RX_FEC_JOBS];
+static u32 s_uVideoRxFECJobsQueueCounter = 0;
+static int s_iVideoRxFECWorkersCount = -1; // -1: not started yet
+static bool s_bVideoRxFECWorkersStop = false;
+static pthread_t s_pThreadsVideoRxFECWorkers[MAX_VIDEO_RX_FEC_WORKERS];
+
+static void* _thread_video_rx_fec_worker(void* pParam)
+{
+   int iWorkerIndex = (int)(long)pParam;
+   log_line("[VideoRXBuffer] Started FEC decode worker thread %d.", iWorkerIndex+1);
+   // Do not stay on the router thread's core, if it is pinned
+   hw_reset_current_thread_affinity("[VideoRXBuffer] FEC decode worker:");
+
+   pthread_mutex_lock(&s_MutexVideoRxFECJobs);
+   while ( ! s_bVideoRxFECWorkersStop )
+   {
+      // Pick the oldest queued job, so blocks get decoded in the order they completed
+      type_video_rx_fec_job* pJob = NULL;
+      for( int i=0; i<MAX_VIDEO_RX_FEC_JOBS; i++ )
+      {
+         if ( s_VideoRxFECJobs[i].iState != VIDEO_RX_FEC_JOB_QUEUED )
+            continue;
+         if ( (NULL == pJob) || ((int)(s_VideoRxFECJobs[i].uQueueOrder - pJob->uQueueOrder) < 0) )
+            pJob = &(s_VideoRxFECJobs[i]);
+      }
+      if ( NULL == pJob )
+      {
+         pthread_cond_wait(&s_CondVideoRxFECJobQueued, &s_MutexVideoRxFECJobs);
+         continue;
+      }
+      pJob->iState = VIDEO_RX_FEC_JOB_RUNNING;
+      pthread_mutex_unlock(&s_MutexVideoRxFECJobs);
+
+      u32 uTimeStartDecode = latency_stats_start();
+      int iRes = fec_decode(pJob->iBlockDataSize, pJob->fecInfo.p_decode_data_packets_pointers, pJob->iBlockDataPackets, pJob->fecInfo.p_decode_ec_packets_pointers, pJob->fecInfo.decode_ec_packets_indexes, pJob->fecInfo.decode_missing_packets_indexes, pJob->fecInfo.missing_packets_count);
+      latency_stats_end(LATENCY_STAGE_FEC_DECODE, uTimeStartDecode);
+
+      pthread_mutex_lock(&s_MutexVideoRxFECJobs);
+      pJob->iDecodeResult = iRes;
+      pJob->iState = VIDEO_RX_FEC_JOB_DONE;
+      pthread_cond_broadcast(&s_CondVideoRxFECJobDone);
+   }
+   pthread_mutex_unlock(&s_MutexVideoRxFECJobs);
+   log_line("[VideoRXBuffer] Stopped FEC decode worker thread %d.", iWorkerIndex+1);
+   return NULL;
+}
+
+static void _video_rx_fec_workers_start()
+{
+   if ( s_iVideoRxFECWorkersCount >= 0 )
+      return;
+
+   int iCPUCores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+   int iWorkers = iCPUCores/2;
+   if ( (NULL != g_pControllerSettings) && (g_pControllerSettings->iVideoRxFECWorkers >= 0) )
+      iWorkers = g_pControllerSettings->iVideoRxFECWorkers;
+   if ( iCPUCores <= 1 )
+      iWorkers = 0;
+   if ( iWorkers > MAX_VIDEO_RX_FEC_WORKERS )
+      iWorkers = MAX_VIDEO_RX_FEC_WORKERS;
+
+   for( int i=0; i<MAX_VIDEO_RX_FEC_JOBS; i++ )
+      s_VideoRxFECJobs[i].iState = VIDEO_RX_FEC_JOB_FREE;
+
+   // FEC tables must be ready before any concurrent decode
+   fec_init();
+
+   s_iVideoRxFECWorkersCount = 0;
+   for( int i=0; i<iWorkers; i++ )
+   {
+      pthread_attr_t attr;
+      hw_init_worker_thread_attrs(&attr);
+      if ( 0 != pthread_create(&s_pThreadsVideoRxFECWorkers[i], &attr, &_thread_video_rx_fec_worker, (void*)(long)i) )
+      {
+         log_softerror_and_alarm("[VideoRXBuffer] Failed to create FEC decode worker thread %d.", i+1);
+         pthread_attr_destroy(&attr);
+         break;
+      }
+      pthread_attr_destroy(&attr);
+      s_iVideoRxFECWorkersCount++;
+   }
+   if ( 0 == s_iVideoRxFECWorkersCount )
+      log_line("[VideoRXBuffer] CPU cores: %d, EC decoding is done inline, on router thread.", iCPUCores);
+   else
+      log_line("[VideoRXBuffer] CPU cores: %d, EC decoding is done on %d worker threads.", iCPUCores, s_iVideoRxFECWorkersCount);
+}
+
+// Called when no video rx buffer is left, so no job is queued or running
+static void _video_rx_fec_workers_stop()
+{
+   if ( s_iVideoRxFECWorkersCount <= 0 )
+   {
+      s_iVideoRxFECWorkersCount = -1;
+      return;
+   }
+
+   pthread_mutex_lock(&s_MutexVideoRxFECJobs);
+   s_bVideoRxFECWorkersStop = true;
+   pthread_cond_broadcast(&s_CondVideoRxFECJobQueued);
+   pthread_mutex_unlock(&s_MutexVideoRxFECJobs);
+
+   for( int i=0; i<s_iVideoRxFECWorkersCount; i++ )
+      pthread_join(s_pThreadsVideoRxFECWorkers[i], NULL);
+
+   log_line("[VideoRXBuffer] Stopped %d FEC decode worker threads.", s_iVideoRxFECWorkersCount);
+   s_iVideoRxFECWorkersCount = -1;
+   s_bVideoRxFECWorkersStop = false;
+}
 
 int VideoRxPacketsBuffer::m_siVideoBuffersInstancesCount = 0;
+bool VideoRxPacketsBuffer::m_sbDisableSlabAllocation = false;
+
+void VideoRxPacketsBuffer::disableSlabAllocation()
+{
+   m_sbDisableSlabAllocation = true;
+}
 
 VideoRxPacketsBuffer::VideoRxPacketsBuffer(int iVideoStreamIndex, int iCameraIndex)
 :m_bInitialized(false)
@@ -49,6 +204,7 @@ VideoRxPacketsBuffer::VideoRxPacketsBuffer(int iVideoStreamIndex, int iCameraInd
 
    for( int i=0; i<MAX_RXTX_BLOCKS_BUFFER; i++ )
    {
+      m_VideoBlocks[i].iECDecodeJobIndex = -1;
       _empty_block_buffer_index(i);
       for( int k=0; k<MAX_TOTAL_PACKETS_IN_BLOCK; k++ )
       {
@@ -59,20 +215,28 @@ VideoRxPacketsBuffer::VideoRxPacketsBuffer(int iVideoStreamIndex, int iCameraInd
          m_VideoBlocks[i].packets[k].pPHVSImp = NULL;
       }
    }
+   m_pSlab = NULL;
+   m_uSlabSize = 0;
+   m_bSlabAllocationFailed = false;
    m_iTopBufferIndex = 0;
    m_iBottomBufferIndexToOutput = 0;
    m_iBottomPacketIndexToOutput = 0;
    m_iCountBlocksPresent = 0;
+   m_iCountECDecodesPending = 0;
+   m_iCountLatePackets = 0;
 }
 
 VideoRxPacketsBuffer::~VideoRxPacketsBuffer()
 {
    uninit();
 
+   for( int i=0; i<MAX_RXTX_BLOCKS_BUFFER; i++ )
+      _wait_ec_decode_for_video_block(i);
+
    for( int i=0; i<MAX_RXTX_BLOCKS_BUFFER; i++ )
    for( int k=0; k<MAX_TOTAL_PACKETS_IN_BLOCK; k++ )
    {
-      if ( NULL != m_VideoBlocks[i].packets[k].pRawData )
+      if ( (NULL == m_pSlab) && (NULL != m_VideoBlocks[i].packets[k].pRawData) )
          free(m_VideoBlocks[i].packets[k].pRawData);
 
       m_VideoBlocks[i].packets[k].pRawData = NULL;
@@ -81,8 +245,11 @@ VideoRxPacketsBuffer::~VideoRxPacketsBuffer()
       m_VideoBlocks[i].packets[k].pPHVS = NULL;
       m_VideoBlocks[i].packets[k].pPHVSImp = NULL;
    }
+   _free_slab();
 
    m_siVideoBuffersInstancesCount--;
+   if ( 0 == m_siVideoBuffersInstancesCount )
+      _video_rx_fec_workers_stop();
 }
 
 bool VideoRxPacketsBuffer::init(Model* pModel)
@@ -96,6 +263,7 @@ bool VideoRxPacketsBuffer::init(Model* pModel)
       return false;
    }
    log_line("[VideoRXBuffer] Initialize video Rx buffer instance number %d.", m_iInstanceIndex+1);
+   _video_rx_fec_workers_start();
    _empty_buffers("init", NULL, NULL);
    m_bInitialized = true;
    log_line("[VideoRXBuffer] Initialized video Tx buffer instance number %d.", m_iInstanceIndex+1);
@@ -118,10 +286,71 @@ void VideoRxPacketsBuffer::emptyBuffers(const char* szReason)
    _empty_buffers(szReason, NULL, NULL);
 }
 
+void VideoRxPacketsBuffer::_allocate_slab()
+{
+   // Round up to 2MB, the usual huge page size
+   u32 uSize = MAX_RXTX_BLOCKS_BUFFER * MAX_TOTAL_PACKETS_IN_BLOCK * VIDEO_RX_SLAB_PACKET_STRIDE;
+   uSize = (uSize + 2*1024*1024 - 1) & (~(2*1024*1024 - 1));
+
+   const char* szType = "huge pages";
+   void* pSlab = mmap(NULL, uSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+   if ( MAP_FAILED == pSlab )
+   {
+      // No reserved huge pages; use regular pages, transparent huge pages if the kernel has them
+      szType = "regular pages";
+      pSlab = mmap(NULL, uSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if ( MAP_FAILED == pSlab )
+      {
+         log_softerror_and_alarm("[VideoRXBuffer] Failed to allocate the packets slab (%u bytes), using separate packets allocations.", uSize);
+         m_bSlabAllocationFailed = true;
+         return;
+      }
+      #ifdef MADV_HUGEPAGE
+      if ( 0 == madvise(pSlab, uSize, MADV_HUGEPAGE) )
+         szType = "regular pages, transparent huge pages";
+      #endif
+      // Not faulted in here: this runs on the router thread on the first received video block;
+      // the pages get faulted in as the blocks ring fills up the first time.
+   }
+   m_pSlab = (u8*)pSlab;
+   m_uSlabSize = uSize;
+
+   for( int i=0; i<MAX_RXTX_BLOCKS_BUFFER; i++ )
+   for( int k=0; k<MAX_TOTAL_PACKETS_IN_BLOCK; k++ )
+   {
+      u8* pRawData = m_pSlab + (i * MAX_TOTAL_PACKETS_IN_BLOCK + k) * VIDEO_RX_SLAB_PACKET_STRIDE;
+      m_VideoBlocks[i].packets[k].pRawData = pRawData;
+      m_VideoBlocks[i].packets[k].pVideoData = pRawData + sizeof(t_packet_header) + sizeof(t_packet_header_video_segment);
+      m_VideoBlocks[i].packets[k].pPH = (t_packet_header*)pRawData;
+      m_VideoBlocks[i].packets[k].pPHVS = (t_packet_header_video_segment*)(pRawData + sizeof(t_packet_header));
+      m_VideoBlocks[i].packets[k].pPHVSImp = (t_packet_header_video_segment_important*)(pRawData + sizeof(t_packet_header) + sizeof(t_packet_header_video_segment));
+   }
+   log_line("[VideoRXBuffer] Allocated packets slab: %u bytes (%s), %d blocks of %d packets.", m_uSlabSize, szType, MAX_RXTX_BLOCKS_BUFFER, MAX_TOTAL_PACKETS_IN_BLOCK);
+}
+
+void VideoRxPacketsBuffer::_free_slab()
+{
+   if ( NULL != m_pSlab )
+      munmap(m_pSlab, m_uSlabSize);
+   m_pSlab = NULL;
+   m_uSlabSize = 0;
+}
+
 bool VideoRxPacketsBuffer::_check_allocate_video_block_in_buffer(int iBufferIndex)
 {
    if ( (iBufferIndex < 0) || (iBufferIndex >= MAX_RXTX_BLOCKS_BUFFER) )
       return false;
+   // All packets are already in the slab
+   if ( NULL != m_pSlab )
+      return true;
+
+   // First use: no packets were allocated separately yet, so switch all of them to the slab
+   if ( (! m_sbDisableSlabAllocation) && (! m_bSlabAllocationFailed) )
+   {
+      _allocate_slab();
+      if ( NULL != m_pSlab )
+         return true;
+   }
 
    for( int i=0; i<m_VideoBlocks[iBufferIndex].iBlockDataPackets + m_VideoBlocks[iBufferIndex].iBlockECPackets; i++ )
    {
@@ -155,6 +384,7 @@ void VideoRxPacketsBuffer::_empty_block_buffer_packet_index(int iBufferIndex, in
 
 void VideoRxPacketsBuffer::_empty_block_buffer_index(int iBufferIndex)
 {
+   _wait_ec_decode_for_video_block(iBufferIndex);
    m_VideoBlocks[iBufferIndex].uVideoBlockIndex = 0;
    m_VideoBlocks[iBufferIndex].bEmpty = true;
    m_VideoBlocks[iBufferIndex].uReceivedTime = 0;
@@ -224,6 +454,9 @@ void VideoRxPacketsBuffer::_check_do_ec_for_video_block(int iBufferIndex)
    if ( (iBufferIndex < 0) || (iBufferIndex >= MAX_RXTX_BLOCKS_BUFFER) )
       return;
 
+   if ( -1 != m_VideoBlocks[iBufferIndex].iECDecodeJobIndex )
+      return;
+
    if ( m_VideoBlocks[iBufferIndex].iRecvDataPackets >= m_VideoBlocks[iBufferIndex].iBlockDataPackets )
       return;
 
@@ -235,8 +468,6 @@ void VideoRxPacketsBuffer::_check_do_ec_for_video_block(int iBufferIndex)
 
    m_VideoBlocks[iBufferIndex].iReconstructedECUsed = m_VideoBlocks[iBufferIndex].iBlockDataPackets - m_VideoBlocks[iBufferIndex].iRecvDataPackets;
 
-   t_packet_header* pPHGood = NULL;
-   t_packet_header_video_segment* pPHVSGood = NULL;
    int iPacketIndexGood = -1;
 
    // Add existing data packets, mark and count the ones that are missing
@@ -261,11 +492,7 @@ void VideoRxPacketsBuffer::_check_do_ec_for_video_block(int iBufferIndex)
          m_ECRxInfo.missing_packets_count++;
       }
       else
-      {
-         pPHGood = m_VideoBlocks[iBufferIndex].packets[i].pPH;
-         pPHVSGood = m_VideoBlocks[iBufferIndex].packets[i].pPHVS;
          iPacketIndexGood = i;
-      }
    }
 
    if ( -1 == iPacketIndexGood )
@@ -286,8 +513,45 @@ void VideoRxPacketsBuffer::_check_do_ec_for_video_block(int iBufferIndex)
       }
    }
 
+   // Hand over the decode to the worker threads, if any and if there is a free job slot
+   if ( s_iVideoRxFECWorkersCount > 0 )
+   {
+      pthread_mutex_lock(&s_MutexVideoRxFECJobs);
+      for( int i=0; i<MAX_VIDEO_RX_FEC_JOBS; i++ )
+      {
+         if ( s_VideoRxFECJobs[i].iState != VIDEO_RX_FEC_JOB_FREE )
+            continue;
+         s_VideoRxFECJobs[i].uQueueOrder = s_uVideoRxFECJobsQueueCounter++;
+         s_VideoRxFECJobs[i].uVideoBlockIndex = m_VideoBlocks[iBufferIndex].uVideoBlockIndex;
+         s_VideoRxFECJobs[i].iBlockDataSize = m_VideoBlocks[iBufferIndex].iBlockDataSize;
+         s_VideoRxFECJobs[i].iBlockDataPackets = m_VideoBlocks[iBufferIndex].iBlockDataPackets;
+         s_VideoRxFECJobs[i].iPacketIndexGood = iPacketIndexGood;
+         s_VideoRxFECJobs[i].iDecodeResult = 0;
+         memcpy(&(s_VideoRxFECJobs[i].fecInfo), &m_ECRxInfo, sizeof(type_fec_info));
+         s_VideoRxFECJobs[i].iState = VIDEO_RX_FEC_JOB_QUEUED;
+         m_VideoBlocks[iBufferIndex].iECDecodeJobIndex = i;
+         m_iCountECDecodesPending++;
+         break;
+      }
+      if ( -1 != m_VideoBlocks[iBufferIndex].iECDecodeJobIndex )
+         pthread_cond_signal(&s_CondVideoRxFECJobQueued);
+      pthread_mutex_unlock(&s_MutexVideoRxFECJobs);
+      if ( -1 != m_VideoBlocks[iBufferIndex].iECDecodeJobIndex )
+         return;
+   }
+
+   u32 uTimeStartDecode = latency_stats_start();
    int iRes = fec_decode(m_VideoBlocks[iBufferIndex].iBlockDataSize, m_ECRxInfo.p_decode_data_packets_pointers, m_VideoBlocks[iBufferIndex].iBlockDataPackets, m_ECRxInfo.p_decode_ec_packets_pointers, m_ECRxInfo.decode_ec_packets_indexes, m_ECRxInfo.decode_missing_packets_indexes, m_ECRxInfo.missing_packets_count);
-   if ( iRes < 0 )
+   latency_stats_end(LATENCY_STAGE_FEC_DECODE, uTimeStartDecode);
+   _finish_ec_for_video_block(iBufferIndex, &m_ECRxInfo, iPacketIndexGood, iRes);
+}
+
+void VideoRxPacketsBuffer::_finish_ec_for_video_block(int iBufferIndex, type_fec_info* pFECInfo, int iPacketIndexGood, int iDecodeResult)
+{
+   t_packet_header* pPHGood = m_VideoBlocks[iBufferIndex].packets[iPacketIndexGood].pPH;
+   t_packet_header_video_segment* pPHVSGood = m_VideoBlocks[iBufferIndex].packets[iPacketIndexGood].pPHVS;
+
+   if ( iDecodeResult < 0 )
    {
       log_softerror_and_alarm("[VideoRXBuffer] Failed to decode video block [%u], type %d/%d/%d bytes; max data recv index: %d, max data/ec received index: %d, eoframe-index: %d; recv: %d/%d packets, missing count: %d",
         m_VideoBlocks[iBufferIndex].uVideoBlockIndex,
@@ -297,13 +561,13 @@ void VideoRxPacketsBuffer::_check_do_ec_for_video_block(int iBufferIndex)
         m_VideoBlocks[iBufferIndex].iMaxReceivedDataOrECPacketIndex,
         m_VideoBlocks[iBufferIndex].iEndOfFrameDetectedAtPacketIndex,
         m_VideoBlocks[iBufferIndex].iRecvDataPackets, m_VideoBlocks[iBufferIndex].iRecvECPackets,
-        m_ECRxInfo.missing_packets_count);
+        pFECInfo->missing_packets_count);
    }
 
    // Mark all data packets reconstructed as received, set the right info in them (packet header info and video packet header info)
-   for( int i=0; i<(int)(m_ECRxInfo.missing_packets_count); i++ )
+   for( int i=0; i<(int)(pFECInfo->missing_packets_count); i++ )
    {
-      int iPacketIndexToFix = m_ECRxInfo.decode_missing_packets_indexes[i];
+      int iPacketIndexToFix = pFECInfo->decode_missing_packets_indexes[i];
       m_VideoBlocks[iBufferIndex].packets[iPacketIndexToFix].bEmpty = false;
       m_VideoBlocks[iBufferIndex].packets[iPacketIndexToFix].bReconstructed = true;
       m_VideoBlocks[iBufferIndex].packets[iPacketIndexToFix].bOutputed = false;
@@ -331,6 +595,109 @@ void VideoRxPacketsBuffer::_check_do_ec_for_video_block(int iBufferIndex)
    }
 }
 
+// Waits for (or cancels, if not started yet) the EC decode job of a block, if any.
+// The decoded result is discarded, the block is about to be emptied or reused.
+void VideoRxPacketsBuffer::_wait_ec_decode_for_video_block(int iBufferIndex)
+{
+   int iJobIndex = m_VideoBlocks[iBufferIndex].iECDecodeJobIndex;
+   if ( -1 == iJobIndex )
+      return;
+
+   pthread_mutex_lock(&s_MutexVideoRxFECJobs);
+   while ( (s_VideoRxFECJobs[iJobIndex].iState != VIDEO_RX_FEC_JOB_QUEUED) && (s_VideoRxFECJobs[iJobIndex].iState != VIDEO_RX_FEC_JOB_DONE) )
+      pthread_cond_wait(&s_CondVideoRxFECJobDone, &s_MutexVideoRxFECJobs);
+   s_VideoRxFECJobs[iJobIndex].iState = VIDEO_RX_FEC_JOB_FREE;
+   pthread_mutex_unlock(&s_MutexVideoRxFECJobs);
+
+   m_VideoBlocks[iBufferIndex].iECDecodeJobIndex = -1;
+   m_iCountECDecodesPending--;
+   _discard_late_packets(iBufferIndex);
+}
+
+// Keeps aside a packet received for a block that is being EC decoded on the worker threads
+void VideoRxPacketsBuffer::_add_late_packet(int iBufferIndex, u8* pPacket, int iPacketLength)
+{
+   if ( (m_iCountLatePackets >= MAX_VIDEO_RX_LATE_PACKETS) || (iPacketLength > MAX_PACKET_TOTAL_SIZE) )
+      return;
+   m_LatePackets[m_iCountLatePackets].iBufferIndex = iBufferIndex;
+   m_LatePackets[m_iCountLatePackets].iPacketLength = iPacketLength;
+   memcpy(m_LatePackets[m_iCountLatePackets].uPacket, pPacket, iPacketLength);
+   m_iCountLatePackets++;
+}
+
+void VideoRxPacketsBuffer::_discard_late_packets(int iBufferIndex)
+{
+   int iCount = 0;
+   for( int i=0; i<m_iCountLatePackets; i++ )
+   {
+      if ( m_LatePackets[i].iBufferIndex == iBufferIndex )
+         continue;
+      if ( i != iCount )
+         memcpy(&(m_LatePackets[iCount]), &(m_LatePackets[i]), sizeof(type_rx_video_late_packet));
+      iCount++;
+   }
+   m_iCountLatePackets = iCount;
+}
+
+// Adds to the block the packets received while it was EC decoded
+void VideoRxPacketsBuffer::_add_late_packets_to_block(int iBufferIndex)
+{
+   for( int i=0; i<m_iCountLatePackets; i++ )
+   {
+      if ( m_LatePackets[i].iBufferIndex != iBufferIndex )
+         continue;
+      t_packet_header_video_segment* pPHVS = (t_packet_header_video_segment*)(m_LatePackets[i].uPacket + sizeof(t_packet_header));
+      if ( pPHVS->uCurrentBlockIndex != m_VideoBlocks[iBufferIndex].uVideoBlockIndex )
+         continue;
+      if ( pPHVS->uCurrentBlockPacketIndex >= MAX_TOTAL_PACKETS_IN_BLOCK )
+         continue;
+
+      // A received data packet replaces the reconstructed one, if not outputed yet
+      type_rx_video_packet_info* pPacketInfo = &(m_VideoBlocks[iBufferIndex].packets[pPHVS->uCurrentBlockPacketIndex]);
+      if ( pPacketInfo->bReconstructed && (! pPacketInfo->bEmpty) && (! pPacketInfo->bOutputed) )
+      {
+         pPacketInfo->bEmpty = true;
+         pPacketInfo->bReconstructed = false;
+         m_VideoBlocks[iBufferIndex].iRecvDataPackets--;
+      }
+      _add_video_packet_to_buffer(iBufferIndex, m_LatePackets[i].uPacket, m_LatePackets[i].iPacketLength);
+   }
+   _discard_late_packets(iBufferIndex);
+}
+
+int VideoRxPacketsBuffer::checkCompletedECDecodes()
+{
+   if ( 0 == m_iCountECDecodesPending )
+      return 0;
+
+   int iCountDone = 0;
+   int iBuffersDone[MAX_RXTX_BLOCKS_BUFFER];
+   int iBufferIndex = m_iBottomBufferIndexToOutput;
+   pthread_mutex_lock(&s_MutexVideoRxFECJobs);
+   for( int i=0; i<MAX_RXTX_BLOCKS_BUFFER; i++ )
+   {
+      int iJobIndex = m_VideoBlocks[iBufferIndex].iECDecodeJobIndex;
+      if ( (-1 != iJobIndex) && (s_VideoRxFECJobs[iJobIndex].iState == VIDEO_RX_FEC_JOB_DONE) )
+      {
+         m_VideoBlocks[iBufferIndex].iECDecodeJobIndex = -1;
+         m_iCountECDecodesPending--;
+         _finish_ec_for_video_block(iBufferIndex, &(s_VideoRxFECJobs[iJobIndex].fecInfo), s_VideoRxFECJobs[iJobIndex].iPacketIndexGood, s_VideoRxFECJobs[iJobIndex].iDecodeResult);
+         s_VideoRxFECJobs[iJobIndex].iState = VIDEO_RX_FEC_JOB_FREE;
+         iBuffersDone[iCountDone] = iBufferIndex;
+         iCountDone++;
+      }
+      iBufferIndex++;
+      if ( iBufferIndex >= MAX_RXTX_BLOCKS_BUFFER )
+         iBufferIndex = 0;
+   }
+   pthread_mutex_unlock(&s_MutexVideoRxFECJobs);
+
+   if ( m_iCountLatePackets > 0 )
+   for( int i=0; i<iCountDone; i++ )
+      _add_late_packets_to_block(iBuffersDone[i]);
+   return iCountDone;
+}
+
 void VideoRxPacketsBuffer::_add_video_packet_to_buffer(int iBufferIndex, u8* pPacket, int iPacketLength)
 {
    if ( (NULL == pPacket) || (iPacketLength < (int)(sizeof(t_packet_header)+sizeof(t_packet_header_video_segment) + sizeof(t_packet_header_video_segment_important))) || (iBufferIndex < 0) || (iBufferIndex >= MAX_RXTX_BLOCKS_BUFFER) )
@@ -340,6 +707,15 @@ void VideoRxPacketsBuffer::_add_video_packet_to_buffer(int iBufferIndex, u8* pPa
    t_packet_header_video_segment* pPHVS = (t_packet_header_video_segment*)(pPacket + sizeof(t_packet_header));
    t_packet_header_video_segment_important* pPHVSImp = (t_packet_header_video_segment_important*)(pPacket + sizeof(t_packet_header) + sizeof(t_packet_header_video_segment));
 
+   // Block is being reconstructed on the FEC worker threads: add the packet when the decode is done
+   if ( -1 != m_VideoBlocks[iBufferIndex].iECDecodeJobIndex )
+   {
+      if ( pPHVS->uCurrentBlockPacketIndex < MAX_TOTAL_PACKETS_IN_BLOCK )
+      if ( m_VideoBlocks[iBufferIndex].packets[pPHVS->uCurrentBlockPacketIndex].bEmpty )
+         _add_late_packet(iBufferIndex, pPacket, iPacketLength);
+      return;
+   }
+
    if ( NULL != m_VideoBlocks[iBufferIndex].packets[pPHVS->uCurrentBlockPacketIndex].pRawData )
    if ( ! m_VideoBlocks[iBufferIndex].packets[pPHVS->uCurrentBlockPacketIndex].bEmpty )
       return;
@@ -449,12 +825,16 @@ void VideoRxPacketsBuffer::_add_video_packet_to_buffer(int iBufferIndex, u8* pPa
    memcpy(m_VideoBlocks[iBufferIndex].packets[pPHVS->uCurrentBlockPacketIndex].pRawData, pPacket, iPacketLength);
    
    // Set remaining empty space to 0 as EC uses the good video data packets too.
+   // Only up to the block packet size, that is all the EC decode reads.
    if ( pPHVS->uCurrentBlockPacketIndex < pPHVS->uCurrentBlockDataPackets )
    {
       u8* pVideoSource = m_VideoBlocks[iBufferIndex].packets[pPHVS->uCurrentBlockPacketIndex].pVideoData;
       pVideoSource += sizeof(t_packet_header_video_segment_important);
       pVideoSource += pPHVSImp->uVideoDataLength;
       int iSizeToZero = MAX_PACKET_TOTAL_SIZE - sizeof(t_packet_header) - sizeof(t_packet_header_video_segment) - sizeof(t_packet_header_video_segment_important) - pPHVSImp->uVideoDataLength;
+      int iSizeToBlockEnd = (int)pPHVS->uCurrentBlockPacketSize - (int)sizeof(t_packet_header_video_segment_important) - (int)pPHVSImp->uVideoDataLength;
+      if ( iSizeToBlockEnd < iSizeToZero )
+         iSizeToZero = iSizeToBlockEnd;
       if ( iSizeToZero > 0 )
          memset(pVideoSource, 0, iSizeToZero);
    }
@@ -469,6 +849,8 @@ bool VideoRxPacketsBuffer::checkAddVideoPacket(u8* pPacket, int iPacketLength)
 
    t_packet_header* pPH = (t_packet_header*)pPacket;
    t_packet_header_video_segment* pPHVS = (t_packet_header_video_segment*)(pPacket + sizeof(t_packet_header));
+   if ( 0 != pPHVS->uTraceId )
+      video_trace_on_packet_added(pPH->vehicle_id_src, pPHVS);
   
    // Empty buffers?
    if ( m_VideoBlocks[m_iTopBufferIndex].bEmpty )
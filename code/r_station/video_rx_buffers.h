@@ -11,6 +11,16 @@
 //  | pRawData ptr                       | pVideoData ptr
 //                                       [    <- video block packet size ->          ]
 //                                                                   [-vid size-]
+//
+// All the packets of all the buffer blocks are in a single slab (hugepages if available),
+// allocated when the first video block is received, so idle rx video processors don't hold it:
+// block buffer index i, packet index k is at (i * MAX_TOTAL_PACKETS_IN_BLOCK + k) * VIDEO_RX_SLAB_PACKET_STRIDE,
+// so the data and EC packets of a block are contiguous, each one cache line aligned.
+
+#define VIDEO_RX_SLAB_PACKET_STRIDE ((MAX_PACKET_TOTAL_SIZE + 63) & (~63))
+
+// Packets received for blocks that are being EC decoded on the worker threads
+#define MAX_VIDEO_RX_LATE_PACKETS 16
 
 typedef struct
 {
@@ -42,6 +52,7 @@ typedef struct
    int iRecvDataPackets;
    int iRecvECPackets;
    int iReconstructedECUsed;
+   int iECDecodeJobIndex; // -1 if no EC decode is in progress for this block on the FEC worker threads
 }
 type_rx_video_block_info;
 
@@ -54,6 +65,13 @@ typedef struct
    unsigned int missing_packets_count;
 } type_fec_info;
 
+typedef struct
+{
+   int iBufferIndex;
+   int iPacketLength;
+   u8 uPacket[MAX_PACKET_TOTAL_SIZE];
+} type_rx_video_late_packet;
+
 
 class VideoRxPacketsBuffer
 {
@@ -76,21 +94,34 @@ class VideoRxPacketsBuffer
       type_rx_video_block_info* getVideoBlockInBuffer(int iStartPosition);
       type_rx_video_packet_info* getFirstPacketInBuffer(type_rx_video_block_info** ppOutputBlock);
       void goToNextPacketInBuffer();
+      // Returns the number of video blocks reconstructed by the FEC worker threads since last call
+      int checkCompletedECDecodes();
       int discardOldBlocks(u32 uCutOffTime);
       void resetFrameEndDetectedFlag();
       bool isFrameEndDetected();
       u32 getFrameEndDetectionTime();
 
+      // Use a separate allocation for each packet instead of the slab (for tests and benchmarks); call before creating buffers
+      static void disableSlabAllocation();
+
    protected:
 
+      void _allocate_slab();
+      void _free_slab();
       bool _check_allocate_video_block_in_buffer(int iBufferIndex);
       void _empty_block_buffer_packet_index(int iBufferIndex, int iPacketIndex);
       void _empty_block_buffer_index(int iBufferIndex);
       void _empty_buffers(const char* szReason, t_packet_header* pPH, t_packet_header_video_segment* pPHVS);
       void _check_do_ec_for_video_block(int iBufferIndex);
+      void _finish_ec_for_video_block(int iBufferIndex, type_fec_info* pFECInfo, int iPacketIndexGood, int iDecodeResult);
+      void _wait_ec_decode_for_video_block(int iBufferIndex);
+      void _add_late_packet(int iBufferIndex, u8* pPacket, int iPacketLength);
+      void _discard_late_packets(int iBufferIndex);
+      void _add_late_packets_to_block(int iBufferIndex);
       void _add_video_packet_to_buffer(int iBufferIndex, u8* pPacket, int iPacketLength);
 
       static int m_siVideoBuffersInstancesCount;
+      static bool m_sbDisableSlabAllocation;
       bool m_bInitialized;
       int m_iInstanceIndex;
       int m_iVideoStreamIndex;
@@ -100,11 +131,17 @@ class VideoRxPacketsBuffer
 
       // Buffers state
       type_rx_video_block_info m_VideoBlocks[MAX_RXTX_BLOCKS_BUFFER];
+      u8* m_pSlab;
+      u32 m_uSlabSize;
+      bool m_bSlabAllocationFailed;
       u8 m_TempVideoBuffer[MAX_PACKET_TOTAL_SIZE];
       int m_iCountBlocksPresent;
       int m_iTopBufferIndex;
       int m_iBottomBufferIndexToOutput;
       int m_iBottomPacketIndexToOutput;
+      int m_iCountECDecodesPending;
+      type_rx_video_late_packet m_LatePackets[MAX_VIDEO_RX_LATE_PACKETS];
+      int m_iCountLatePackets;
 
       type_fec_info m_ECRxInfo;
 };
@@ -0,0 +1,323 @@
+/*
+    Ruby Licence
+    Copyright (c) 2025 Petru Soroaga
+    All rights reserved.
+
+    Redistribution and/or use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions and/or use of the source code (partially or complete) must retain
+        the above copyright notice, this list of conditions and the following disclaimer
+        in the documentation and/or other materials provided with the distribution.
+        * Redistributions in binary form (partially or complete) must reproduce
+        the above copyright notice, this list of conditions and the following disclaimer
+        in the documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permitted.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../radio/radiolink.h"
+#include "video_trace.h"
+#include "shared_vars_state.h"
+#include "timers.h"
+
+#define VIDEO_TRACE_MAX_FRAMES 64
+#define VIDEO_TRACE_FRAME_TIMEOUT_MS 500
+#define VIDEO_TRACE_SUMMARY_INTERVAL_MS 1000
+#define VIDEO_TRACE_MAX_LOG_FILE_SIZE (4*1024*1024)
+
+// All times are station local times, in microseconds
+
+typedef struct
+{
+   bool bUsed;
+   u32 uVehicleId;
+   u16 uTraceId;
+   int iRecvPackets;
+   int iOutputPackets;
+   u32 uLastActivityTimeMs;
+   u32 uTimeCapture;
+   u32 uTimeEncoded;
+   u32 uTimeInjected;
+   u32 uTimeRxFirst;
+   u32 uTimeRxLast;
+   u32 uTimeAddedLast;
+   u32 uTimeOutputLast;
+} t_video_trace_frame;
+
+typedef struct
+{
+   u32 uVehicleId;
+   u32 uFrames;
+   long long llSumCaptureToEncoded;
+   long long llSumEncodedToInject;
+   long long llSumAir;
+   long long llSumStation;
+   long long llSumTotal;
+   int iMaxTotal;
+   type_video_trace_summary summary;
+} t_video_trace_vehicle_stats;
+
+static t_video_trace_frame s_VideoTraceFrames[VIDEO_TRACE_MAX_FRAMES];
+static t_video_trace_vehicle_stats s_VideoTraceVehiclesStats[MAX_CONCURENT_VEHICLES];
+static u32 s_uVideoTraceLastSummaryTime = 0;
+static FILE* s_pVideoTraceLogFile = NULL;
+static int s_iVideoTraceLogFileSize = 0;
+
+static t_video_trace_vehicle_stats* _video_trace_get_vehicle_stats(u32 uVehicleId, bool bCreate)
+{
+   for( int i=0; i<MAX_CONCURENT_VEHICLES; i++ )
+   {
+      if ( s_VideoTraceVehiclesStats[i].uVehicleId == uVehicleId )
+         return &s_VideoTraceVehiclesStats[i];
+   }
+   if ( ! bCreate )
+      return NULL;
+   for( int i=0; i<MAX_CONCURENT_VEHICLES; i++ )
+   {
+      if ( 0 == s_VideoTraceVehiclesStats[i].uVehicleId )
+      {
+         memset(&s_VideoTraceVehiclesStats[i], 0, sizeof(t_video_trace_vehicle_stats));
+         s_VideoTraceVehiclesStats[i].uVehicleId = uVehicleId;
+         return &s_VideoTraceVehiclesStats[i];
+      }
+   }
+   return NULL;
+}
+
+static void _video_trace_write_frame_timeline(t_video_trace_frame* pFrame)
+{
+   if ( NULL == s_pVideoTraceLogFile )
+   {
+      char szFile[MAX_FILE_PATH_SIZE];
+      strcpy(szFile, FOLDER_LOGS);
+      strcat(szFile, LOG_FILE_VIDEO_TRACE);
+      s_pVideoTraceLogFile = fopen(szFile, "w");
+      if ( NULL == s_pVideoTraceLogFile )
+         return;
+      log_line("[VideoTrace] Started video latency trace log file: %s", szFile);
+      s_iVideoTraceLogFileSize = fprintf(s_pVideoTraceLogFile, "# Times in ms, relative to the vehicle camera read (station clock)\n# time_ms vehicle_id trace_id frame recv_pkts/out_pkts encoded injected rx_first rx_last buffered output\n");
+   }
+
+   int iLen = fprintf(s_pVideoTraceLogFile, "%u %u %04X %u %d/%d %.1f %.1f %.1f %.1f %.1f %.1f\n",
+      g_TimeNow, pFrame->uVehicleId, pFrame->uTraceId, (u32)(pFrame->uTraceId & 0x7FFF),
+      pFrame->iRecvPackets, pFrame->iOutputPackets,
+      (float)((int)(pFrame->uTimeEncoded - pFrame->uTimeCapture))/1000.0,
+      (float)((int)(pFrame->uTimeInjected - pFrame->uTimeCapture))/1000.0,
+      (float)((int)(pFrame->uTimeRxFirst - pFrame->uTimeCapture))/1000.0,
+      (float)((int)(pFrame->uTimeRxLast - pFrame->uTimeCapture))/1000.0,
+      (float)((int)(pFrame->uTimeAddedLast - pFrame->uTimeCapture))/1000.0,
+      (float)((int)(pFrame->uTimeOutputLast - pFrame->uTimeCapture))/1000.0);
+   if ( iLen > 0 )
+      s_iVideoTraceLogFileSize += iLen;
+
+   // Keep only the latest traces
+   if ( s_iVideoTraceLogFileSize > VIDEO_TRACE_MAX_LOG_FILE_SIZE )
+   {
+      fclose(s_pVideoTraceLogFile);
+      s_pVideoTraceLogFile = NULL;
+   }
+}
+
+static void _video_trace_finalize_frame(t_video_trace_frame* pFrame)
+{
+   if ( ! pFrame->bUsed )
+      return;
+   pFrame->bUsed = false;
+
+   // Lost or not fully received frames are not part of the stats
+   if ( 0 == pFrame->iOutputPackets )
+      return;
+
+   _video_trace_write_frame_timeline(pFrame);
+
+   t_video_trace_vehicle_stats* pStats = _video_trace_get_vehicle_stats(pFrame->uVehicleId, true);
+   if ( NULL == pStats )
+      return;
+
+   int iTotal = (int)(pFrame->uTimeOutputLast - pFrame->uTimeCapture);
+   pStats->uFrames++;
+   pStats->llSumCaptureToEncoded += (int)(pFrame->uTimeEncoded - pFrame->uTimeCapture);
+   pStats->llSumEncodedToInject += (int)(pFrame->uTimeInjected - pFrame->uTimeEncoded);
+   pStats->llSumAir += (int)(pFrame->uTimeRxFirst - pFrame->uTimeInjected);
+   pStats->llSumStation += (int)(pFrame->uTimeOutputLast - pFrame->uTimeRxFirst);
+   pStats->llSumTotal += iTotal;
+   if ( iTotal > pStats->iMaxTotal )
+      pStats->iMaxTotal = iTotal;
+}
+
+static t_video_trace_frame* _video_trace_get_frame(u32 uVehicleId, u16 uTraceId, bool bCreate)
+{
+   t_video_trace_frame* pFrame = &s_VideoTraceFrames[uTraceId % VIDEO_TRACE_MAX_FRAMES];
+   if ( pFrame->bUsed && (pFrame->uVehicleId == uVehicleId) && (pFrame->uTraceId == uTraceId) )
+      return pFrame;
+   if ( ! bCreate )
+      return NULL;
+
+   _video_trace_finalize_frame(pFrame);
+   memset(pFrame, 0, sizeof(t_video_trace_frame));
+   pFrame->bUsed = true;
+   pFrame->uVehicleId = uVehicleId;
+   pFrame->uTraceId = uTraceId;
+   return pFrame;
+}
+
+static u16 _video_trace_average_ms(long long llSumMicros, u32 uCount)
+{
+   if ( (0 == uCount) || (llSumMicros <= 0) )
+      return 0;
+   long long llAvg = (llSumMicros / (long long)uCount + 500) / 1000;
+   if ( llAvg > 0xFFFF )
+      llAvg = 0xFFFF;
+   return (u16)llAvg;
+}
+
+void video_trace_init()
+{
+   memset(s_VideoTraceFrames, 0, sizeof(s_VideoTraceFrames));
+   memset(s_VideoTraceVehiclesStats, 0, sizeof(s_VideoTraceVehiclesStats));
+   s_uVideoTraceLastSummaryTime = 0;
+}
+
+void video_trace_uninit()
+{
+   for( int i=0; i<VIDEO_TRACE_MAX_FRAMES; i++ )
+      _video_trace_finalize_frame(&s_VideoTraceFrames[i]);
+   if ( NULL != s_pVideoTraceLogFile )
+      fclose(s_pVideoTraceLogFile);
+   s_pVideoTraceLogFile = NULL;
+}
+
+void video_trace_on_radio_packet(t_packet_header* pPH, t_packet_header_video_segment* pPHVS, u32 uRxTimeMicros)
+{
+   if ( (NULL == pPH) || (NULL == pPHVS) || (0 == pPHVS->uTraceId) )
+      return;
+
+   u32 uTimeNowMicros = get_current_timestamp_micros();
+   if ( 0 == uRxTimeMicros )
+      uRxTimeMicros = uTimeNowMicros;
+
+   t_video_trace_frame* pFrame = _video_trace_get_frame(pPH->vehicle_id_src, pPHVS->uTraceId, true);
+   pFrame->iRecvPackets++;
+   pFrame->uLastActivityTimeMs = g_TimeNow;
+   pFrame->uTimeRxLast = uRxTimeMicros;
+   if ( pFrame->iRecvPackets > 1 )
+      return;
+
+   // Vehicle times to station clock, using the first packet of the frame
+   // Vehicle clock is ahead of station clock by the link clock delta
+
+   int iClockDeltaMs = radio_get_link_clock_delta();
+   type_global_state_vehicle_runtime_info* pRuntimeInfo = getVehicleRuntimeInfo(pPH->vehicle_id_src);
+   if ( NULL != pRuntimeInfo )
+      iClockDeltaMs = pRuntimeInfo->iVehicleClockDeltaMilisec;
+
+   // Clock delta not computed yet: can't place the vehicle side times
+   if ( (iClockDeltaMs > 100000000) || (iClockDeltaMs < -100000000) )
+   {
+      pFrame->uTimeCapture = uRxTimeMicros;
+      pFrame->uTimeEncoded = uRxTimeMicros;
+      pFrame->uTimeInjected = uRxTimeMicros;
+      pFrame->uTimeRxFirst = uRxTimeMicros;
+      return;
+   }
+
+   u32 uTraceTimes = pPHVS->uTraceTimes;
+   u32 uVehicleTimeNowMs = get_current_timestamp_ms() + (u32)iClockDeltaMs;
+   int iCaptureAgeMs = (int)((uVehicleTimeNowMs - VIDEO_TRACE_GET_CAPTURE_TIME(uTraceTimes)) & VIDEO_TRACE_TIME_MASK);
+   // Capture read is in the future: link clock delta is not accurate
+   if ( iCaptureAgeMs >= (int)(VIDEO_TRACE_TIME_MASK/2) )
+      iCaptureAgeMs -= (int)VIDEO_TRACE_TIME_MASK + 1;
+
+   pFrame->uTimeCapture = uTimeNowMicros - (u32)(iCaptureAgeMs*1000);
+   pFrame->uTimeEncoded = pFrame->uTimeCapture + VIDEO_TRACE_GET_ENCODE_DELTA(uTraceTimes)*1000;
+   pFrame->uTimeInjected = pFrame->uTimeEncoded + VIDEO_TRACE_GET_INJECT_DELTA(uTraceTimes)*1000;
+   pFrame->uTimeRxFirst = uRxTimeMicros;
+}
+
+void video_trace_on_packet_added(u32 uVehicleId, t_packet_header_video_segment* pPHVS)
+{
+   if ( (NULL == pPHVS) || (0 == pPHVS->uTraceId) )
+      return;
+   t_video_trace_frame* pFrame = _video_trace_get_frame(uVehicleId, pPHVS->uTraceId, false);
+   if ( NULL != pFrame )
+      pFrame->uTimeAddedLast = get_current_timestamp_micros();
+}
+
+void video_trace_on_packet_output(u32 uVehicleId, t_packet_header_video_segment* pPHVS)
+{
+   if ( (NULL == pPHVS) || (0 == pPHVS->uTraceId) )
+      return;
+   t_video_trace_frame* pFrame = _video_trace_get_frame(uVehicleId, pPHVS->uTraceId, false);
+   if ( NULL == pFrame )
+      return;
+   pFrame->uTimeOutputLast = get_current_timestamp_micros();
+   pFrame->uLastActivityTimeMs = g_TimeNow;
+   pFrame->iOutputPackets++;
+}
+
+void video_trace_periodic_loop()
+{
+   for( int i=0; i<VIDEO_TRACE_MAX_FRAMES; i++ )
+   {
+      if ( s_VideoTraceFrames[i].bUsed )
+      if ( g_TimeNow >= s_VideoTraceFrames[i].uLastActivityTimeMs + VIDEO_TRACE_FRAME_TIMEOUT_MS )
+         _video_trace_finalize_frame(&s_VideoTraceFrames[i]);
+   }
+
+   if ( g_TimeNow < s_uVideoTraceLastSummaryTime + VIDEO_TRACE_SUMMARY_INTERVAL_MS )
+      return;
+   s_uVideoTraceLastSummaryTime = g_TimeNow;
+
+   for( int i=0; i<MAX_CONCURENT_VEHICLES; i++ )
+   {
+      t_video_trace_vehicle_stats* pStats = &s_VideoTraceVehiclesStats[i];
+      if ( 0 == pStats->uVehicleId )
+         continue;
+      pStats->summary.uFramesTraced = pStats->uFrames;
+      pStats->summary.uAvgCaptureToEncodedMs = _video_trace_average_ms(pStats->llSumCaptureToEncoded, pStats->uFrames);
+      pStats->summary.uAvgEncodedToInjectMs = _video_trace_average_ms(pStats->llSumEncodedToInject, pStats->uFrames);
+      pStats->summary.uAvgAirMs = _video_trace_average_ms(pStats->llSumAir, pStats->uFrames);
+      pStats->summary.uAvgStationMs = _video_trace_average_ms(pStats->llSumStation, pStats->uFrames);
+      pStats->summary.uAvgTotalMs = _video_trace_average_ms(pStats->llSumTotal, pStats->uFrames);
+      pStats->summary.uMaxTotalMs = _video_trace_average_ms(pStats->iMaxTotal, 1);
+
+      u32 uVehicleId = pStats->uVehicleId;
+      type_video_trace_summary summary = pStats->summary;
+      memset(pStats, 0, sizeof(t_video_trace_vehicle_stats));
+      pStats->uVehicleId = uVehicleId;
+      pStats->summary = summary;
+   }
+
+   if ( NULL != s_pVideoTraceLogFile )
+      fflush(s_pVideoTraceLogFile);
+}
+
+void video_trace_get_summary(u32 uVehicleId, type_video_trace_summary* pSummary)
+{
+   if ( NULL == pSummary )
+      return;
+   t_video_trace_vehicle_stats* pStats = NULL;
+   if ( 0 != uVehicleId )
+      pStats = _video_trace_get_vehicle_stats(uVehicleId, false);
+   if ( NULL == pStats )
+      memset(pSummary, 0, sizeof(type_video_trace_summary));
+   else
+      memcpy(pSummary, &pStats->summary, sizeof(type_video_trace_summary));
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "../base/base.h"
+#include "../base/shared_mem_controller_only.h"
+#include "../radio/radiopackets2.h"
+
+// Video latency trace: per frame timeline, from the vehicle camera read to the station video output.
+// Vehicle stamps the traced video packets (uTraceId, uTraceTimes in video segment header);
+// station adds its own stamps, writes a line per frame to the video trace log file and
+// computes a per second summary for the OSD.
+
+void video_trace_init();
+void video_trace_uninit();
+
+void video_trace_on_radio_packet(t_packet_header* pPH, t_packet_header_video_segment* pPHVS, u32 uRxTimeMicros);
+void video_trace_on_packet_added(u32 uVehicleId, t_packet_header_video_segment* pPHVS);
+void video_trace_on_packet_output(u32 uVehicleId, t_packet_header_video_segment* pPHVS);
+
+void video_trace_periodic_loop();
+void video_trace_get_summary(u32 uVehicleId, type_video_trace_summary* pSummary);
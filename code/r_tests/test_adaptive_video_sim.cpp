@@ -0,0 +1,584 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/models.h"
+#include "../base/utils.h"
+#include "../common/string_utils.h"
+#include "../r_station/adaptive_video_controller.h"
+
+#include <math.h>
+
+// Adaptive video controllers offline simulator.
+// Runs each adaptive video controller against the same radio link: a recorded slices trace
+// (log_adaptive_video_trace.txt, written by the router when in developer mode) or a synthetic
+// scenario (clean link, fade, deep fade, recovery, interference bursts, clean link).
+// Simulates the video blocks of the video profile the controller selects (bitrate, EC scheme,
+// radio datarate, keyframe interval, retransmissions) and compares the delivered video bitrate,
+// skipped blocks, video stalls, block latency and profile switches.
+//
+// Link model: synthetic scenarios give the radio signal, the packet loss of each radio datarate
+// comes from its sensitivity. Traces give the measured packet loss at the traced profile radio
+// datarate, scaled with the radio datarate for the other profiles.
+
+#define SIM_SLICE_MS SYSTEM_RT_INFO_UPDATE_INTERVAL_MS
+#define SIM_DEFAULT_RTT_MS 20
+#define SIM_MAX_LATENCY_SAMPLES 500000
+
+bool g_bVerbose = false;
+u32 g_uSimRTTMs = SIM_DEFAULT_RTT_MS;
+
+typedef struct
+{
+   float fDbm; // ADAPTIVE_VIDEO_NO_DBM: no signal info
+   float fInterferenceLoss; // extra loss, for all radio datarates
+   float fTraceLoss; // -1: not from a trace
+   u32 uTraceRadioRate;
+} t_sim_link_slice;
+
+typedef struct
+{
+   int iController;
+   type_adaptive_video_controller_state state;
+
+   int iVideoProfile;
+   int iPendingVideoProfile;
+   u32 uPendingVideoProfileTime;
+   u32 uLastTimeSentVideoProfileRequest;
+   u32 uLastTimeRecvVideoProfileAck;
+   u32 uKeyframeMs;
+   u32 uPendingKeyframeMs;
+   u32 uPendingKeyframeTime;
+
+   double dPacketsCredit;
+   int iBlockData;
+   int iBlockEC;
+   int iBlockSentPackets;
+   int iBlockLostData;
+   int iBlockLostTotal;
+   u32 uBlockStartTime;
+   u32 uFrozenUntil;
+
+   // Stats
+   u32 uBlocks;
+   u32 uSkippedBlocks;
+   u32 uRetransmittedBlocks;
+   double dDeliveredBits;
+   double dKeyframeEfficiencySum;
+   u32 uStallMs;
+   int iSwitchesLower;
+   int iSwitchesHigher;
+   int iKeyframeChanges;
+   u32 uTimeInProfile[MAX_VIDEO_LINK_PROFILES];
+   u32 uCountSwitchesLowerInFade;
+   float* pLatencies;
+   int iCountLatencies;
+} t_sim_run;
+
+static int s_iSimSeed = 1;
+static unsigned int s_uSimRandomState = 1;
+
+static float _sim_random()
+{
+   s_uSimRandomState = s_uSimRandomState * 1103515245 + 12345;
+   return (float)((s_uSimRandomState >> 8) & 0xFFFF) / 65536.0;
+}
+
+// Packet loss for a radio datarate at a signal level: about -86 dBm sensitivity at 6 Mbps,
+// 5.4 dB more for each doubling of the datarate.
+static float _sim_get_loss_for_dbm(float fDbm, u32 uRadioRate)
+{
+   if ( fDbm >= ADAPTIVE_VIDEO_NO_DBM )
+      return 0.0;
+   float fSensitivity = -86.0 + 5.4 * log2((float)uRadioRate / 6000000.0);
+   return 1.0 / (1.0 + exp((fDbm - fSensitivity) / 3.0));
+}
+
+static float _sim_get_slice_loss(t_sim_link_slice* pLinkSlice, u32 uRadioRate)
+{
+   float fLoss = 0.0;
+   if ( pLinkSlice->fTraceLoss >= 0.0 )
+   {
+      fLoss = pLinkSlice->fTraceLoss;
+      if ( (pLinkSlice->uTraceRadioRate > 0) && (uRadioRate > 0) )
+         fLoss = fLoss * (float)uRadioRate / (float)pLinkSlice->uTraceRadioRate;
+   }
+   else
+      fLoss = _sim_get_loss_for_dbm(pLinkSlice->fDbm, uRadioRate);
+   fLoss = 1.0 - (1.0 - fLoss) * (1.0 - pLinkSlice->fInterferenceLoss);
+   if ( fLoss > 1.0 )
+      fLoss = 1.0;
+   return fLoss;
+}
+
+// 60 seconds: clean, fade, deep fade, recovery, interference bursts, clean
+static int _sim_build_synthetic_link(t_sim_link_slice** ppLink, int* piFadeStartSlice, int* piFadeEndSlice)
+{
+   int iCount = 60000 / SIM_SLICE_MS;
+   t_sim_link_slice* pLink = (t_sim_link_slice*)malloc(iCount * sizeof(t_sim_link_slice));
+   int iBurstSlicesLeft = 0;
+   for( int i=0; i<iCount; i++ )
+   {
+      float fSec = (float)(i * SIM_SLICE_MS) / 1000.0;
+      float fDbm = -55.0;
+      if ( fSec < 10.0 )
+         fDbm = -55.0;
+      else if ( fSec < 20.0 )
+         fDbm = -55.0 - 21.0 * (fSec - 10.0) / 10.0;
+      else if ( fSec < 30.0 )
+         fDbm = -76.0 + 2.0 * sin(fSec * 3.0);
+      else if ( fSec < 40.0 )
+         fDbm = -76.0 + 16.0 * (fSec - 30.0) / 10.0;
+      else
+         fDbm = -60.0;
+      if ( fSec < 50.0 )
+         fDbm += (_sim_random() - 0.5) * 2.0;
+
+      pLink[i].fDbm = fDbm;
+      pLink[i].fTraceLoss = -1.0;
+      pLink[i].uTraceRadioRate = 0;
+      pLink[i].fInterferenceLoss = 0.0;
+
+      // Interference bursts: 30 to 80 ms at 40% loss, about every 400 ms
+      if ( (fSec >= 40.0) && (fSec < 50.0) )
+      {
+         if ( (0 == iBurstSlicesLeft) && (_sim_random() < (float)SIM_SLICE_MS / 400.0) )
+            iBurstSlicesLeft = (30 + (int)(_sim_random() * 50.0)) / SIM_SLICE_MS;
+         if ( iBurstSlicesLeft > 0 )
+         {
+            pLink[i].fInterferenceLoss = 0.4;
+            iBurstSlicesLeft--;
+         }
+      }
+   }
+   *ppLink = pLink;
+   *piFadeStartSlice = 10000 / SIM_SLICE_MS;
+   *piFadeEndSlice = 30000 / SIM_SLICE_MS;
+   return iCount;
+}
+
+static int _sim_load_trace(const char* szFile, Model* pModel, t_sim_link_slice** ppLink)
+{
+   FILE* fd = fopen(szFile, "r");
+   if ( NULL == fd )
+   {
+      printf("Failed to open trace file: %s\n", szFile);
+      return 0;
+   }
+   int iMaxCount = 1024;
+   int iCount = 0;
+   t_sim_link_slice* pLink = (t_sim_link_slice*)malloc(iMaxCount * sizeof(t_sim_link_slice));
+   u32 uFirstVehicleId = 0;
+   float fLastLoss = 0.0;
+   char szLine[256];
+   while ( NULL != fgets(szLine, sizeof(szLine), fd) )
+   {
+      type_adaptive_video_slice slice;
+      u32 uVehicleId = 0;
+      if ( ! adaptive_video_controller_parse_trace_slice(szLine, &uVehicleId, &slice) )
+         continue;
+      if ( 0 == uFirstVehicleId )
+         uFirstVehicleId = uVehicleId;
+      if ( uVehicleId != uFirstVehicleId )
+         continue;
+      if ( iCount >= iMaxCount )
+      {
+         iMaxCount *= 2;
+         pLink = (t_sim_link_slice*)realloc(pLink, iMaxCount * sizeof(t_sim_link_slice));
+      }
+      int iTotal = (int)slice.uRxPackets + (int)slice.uRxMissingPackets;
+      if ( iTotal > 0 )
+         fLastLoss = (float)slice.uRxMissingPackets / (float)iTotal;
+      pLink[iCount].fDbm = slice.iDbm;
+      pLink[iCount].fInterferenceLoss = 0.0;
+      pLink[iCount].fTraceLoss = fLastLoss;
+      pLink[iCount].uTraceRadioRate = 0;
+      if ( slice.uVideoProfile < MAX_VIDEO_LINK_PROFILES )
+         pLink[iCount].uTraceRadioRate = utils_get_max_radio_datarate_for_profile(pModel, slice.uVideoProfile);
+      iCount++;
+   }
+   fclose(fd);
+   printf("Loaded %d slices (%.1f seconds) of vehicle %u from trace file %s\n", iCount, (float)(iCount*SIM_SLICE_MS)/1000.0, uFirstVehicleId, szFile);
+   *ppLink = pLink;
+   return iCount;
+}
+
+static void _sim_finish_block(t_sim_run* pRun, Model* pModel, u32 uTimeNow, float fLoss, u32 uRadioRate, float fVideoBitrate, int iPacketBits, type_adaptive_video_slice* pSlice)
+{
+   pRun->uBlocks++;
+   bool bOk = true;
+   float fExtraLatencyMs = 0.0;
+   int iUserProfile = pModel->video_params.user_selected_video_link_profile;
+   float fRetransmissionWindowMs = 5.0 * (float)((pModel->video_link_profiles[iUserProfile].uProfileEncodingFlags & VIDEO_PROFILE_ENCODING_FLAG_MAX_RETRANSMISSION_WINDOW_MASK) >> 8);
+
+   if ( pRun->iBlockLostTotal > pRun->iBlockEC )
+   {
+      bOk = false;
+      if ( pModel->video_link_profiles[iUserProfile].uProfileEncodingFlags & VIDEO_PROFILE_ENCODING_FLAG_ENABLE_RETRANSMISSIONS )
+      if ( (float)g_uSimRTTMs < fRetransmissionWindowMs )
+      {
+         int iNeeded = pRun->iBlockLostTotal - pRun->iBlockEC;
+         if ( pSlice->uReqRetransmissions < 255 )
+            pSlice->uReqRetransmissions++;
+         pSlice->uAckTimeMs = (u8)((g_uSimRTTMs < 255)?g_uSimRTTMs:255);
+         bOk = true;
+         for( int i=0; i<iNeeded; i++ )
+         {
+            if ( _sim_random() < fLoss )
+               bOk = false;
+         }
+         if ( bOk )
+         {
+            pRun->uRetransmittedBlocks++;
+            fExtraLatencyMs = g_uSimRTTMs;
+         }
+      }
+   }
+
+   if ( ! bOk )
+   {
+      pRun->uSkippedBlocks++;
+      if ( pSlice->uSkippedBlocks < 255 )
+         pSlice->uSkippedBlocks++;
+      // Video is frozen until the next keyframe
+      u32 uNextKeyframe = ((uTimeNow / pRun->uKeyframeMs) + 1) * pRun->uKeyframeMs;
+      u32 uFrozenFrom = (pRun->uFrozenUntil > uTimeNow)?pRun->uFrozenUntil:uTimeNow;
+      if ( uNextKeyframe > uFrozenFrom )
+         pRun->uStallMs += uNextKeyframe - uFrozenFrom;
+      if ( uNextKeyframe > pRun->uFrozenUntil )
+         pRun->uFrozenUntil = uNextKeyframe;
+   }
+   else
+   {
+      int iECUsed = pRun->iBlockLostData;
+      if ( iECUsed > pRun->iBlockEC )
+         iECUsed = pRun->iBlockEC;
+      if ( iECUsed > pSlice->uMaxECUsed )
+         pSlice->uMaxECUsed = iECUsed;
+      if ( (int)pSlice->uOutputedVideoPackets + pRun->iBlockData <= 255 )
+         pSlice->uOutputedVideoPackets += pRun->iBlockData;
+      pRun->dDeliveredBits += (double)(pRun->iBlockData * iPacketBits);
+
+      // Block latency: block fill time (from the first video packet) + air time + retransmissions
+      float fLatencyMs = 1000.0 * (float)(pRun->iBlockData * iPacketBits) / fVideoBitrate;
+      if ( uRadioRate > 0 )
+         fLatencyMs += 1000.0 * (float)((pRun->iBlockData + pRun->iBlockEC) * iPacketBits) / (float)uRadioRate;
+      fLatencyMs += fExtraLatencyMs;
+      if ( pRun->iCountLatencies < SIM_MAX_LATENCY_SAMPLES )
+         pRun->pLatencies[pRun->iCountLatencies++] = fLatencyMs;
+   }
+   pRun->iBlockSentPackets = 0;
+   pRun->iBlockLostData = 0;
+   pRun->iBlockLostTotal = 0;
+   pRun->uBlockStartTime = uTimeNow;
+}
+
+static int _sim_compare_floats(const void* a, const void* b)
+{
+   float fa = *(const float*)a;
+   float fb = *(const float*)b;
+   return (fa < fb)?-1:((fa > fb)?1:0);
+}
+
+static void _sim_run(t_sim_run* pRun, int iController, Model* pModel, t_sim_link_slice* pLink, int iCountSlices, int iFadeStartSlice, int iFadeEndSlice)
+{
+   memset(pRun, 0, sizeof(t_sim_run));
+   pRun->iController = iController;
+   pRun->pLatencies = (float*)malloc(SIM_MAX_LATENCY_SAMPLES * sizeof(float));
+   adaptive_video_controller_reset(&pRun->state, pModel->uVehicleId, SIM_SLICE_MS);
+   s_uSimRandomState = (unsigned int)s_iSimSeed;
+
+   int iUserProfile = pModel->video_params.user_selected_video_link_profile;
+   pRun->iVideoProfile = iUserProfile;
+   pRun->iPendingVideoProfile = 0xFF;
+   pRun->uKeyframeMs = DEFAULT_VIDEO_AUTO_INITIAL_KEYFRAME_INTERVAL;
+   pModel->get_video_profile_ec_scheme(pRun->iVideoProfile, &pRun->iBlockData, &pRun->iBlockEC);
+
+   // Simulated time starts as the router does, with a few seconds of uptime
+   u32 uTimeStart = 1000;
+   u32 uTime = uTimeStart + 5000;
+   for( int iSlice=0; iSlice<iCountSlices; iSlice++, uTime += SIM_SLICE_MS )
+   {
+      if ( (0xFF != pRun->iPendingVideoProfile) && (uTime >= pRun->uPendingVideoProfileTime) )
+      {
+         pRun->iVideoProfile = pRun->iPendingVideoProfile;
+         pRun->iPendingVideoProfile = 0xFF;
+         pRun->uLastTimeRecvVideoProfileAck = uTime;
+      }
+      if ( (0 != pRun->uPendingKeyframeMs) && (uTime >= pRun->uPendingKeyframeTime) )
+      {
+         pRun->uKeyframeMs = pRun->uPendingKeyframeMs;
+         pRun->uPendingKeyframeMs = 0;
+      }
+      pRun->uTimeInProfile[pRun->iVideoProfile] += SIM_SLICE_MS;
+      pRun->dKeyframeEfficiencySum += 1.0 / (1.0 + 3.0 * 1000.0 / (30.0 * (float)pRun->uKeyframeMs));
+
+      float fVideoBitrate = (float)utils_get_max_allowed_video_bitrate_for_profile_or_user_video_bitrate(pModel, pRun->iVideoProfile);
+      u32 uRadioRate = utils_get_max_radio_datarate_for_profile(pModel, pRun->iVideoProfile);
+      int iPacketBits = 8 * pModel->video_link_profiles[pRun->iVideoProfile].video_data_length;
+      if ( iPacketBits <= 0 )
+         iPacketBits = 8 * DEFAULT_VIDEO_DATA_LENGTH;
+      float fLoss = _sim_get_slice_loss(&pLink[iSlice], uRadioRate);
+
+      // Radio link overload: the packets above the usable radio throughput are lost
+      float fAirBitrate = fVideoBitrate * (float)(pRun->iBlockData + pRun->iBlockEC) / (float)pRun->iBlockData;
+      float fMaxAirBitrate = (float)uRadioRate * (float)DEFAULT_VIDEO_LINK_MAX_LOAD_PERCENT / 100.0;
+      if ( fAirBitrate > fMaxAirBitrate )
+         fLoss = 1.0 - (1.0 - fLoss) * fMaxAirBitrate / fAirBitrate;
+
+      type_adaptive_video_slice slice;
+      memset(&slice, 0, sizeof(type_adaptive_video_slice));
+      slice.uTime = uTime;
+      slice.uVideoProfile = (u8)pRun->iVideoProfile;
+      slice.uECScheme = (u8)pModel->video_link_profiles[pRun->iVideoProfile].iBlockECs;
+      slice.iDbm = (pLink[iSlice].fDbm < ADAPTIVE_VIDEO_NO_DBM)?(int)pLink[iSlice].fDbm:ADAPTIVE_VIDEO_NO_DBM;
+
+      pRun->dPacketsCredit += (double)fAirBitrate / (double)iPacketBits * (double)SIM_SLICE_MS / 1000.0;
+      int iRx = 0, iMissing = 0;
+      while ( pRun->dPacketsCredit >= 1.0 )
+      {
+         pRun->dPacketsCredit -= 1.0;
+         if ( _sim_random() < fLoss )
+         {
+            iMissing++;
+            pRun->iBlockLostTotal++;
+            if ( pRun->iBlockSentPackets < pRun->iBlockData )
+               pRun->iBlockLostData++;
+         }
+         else
+            iRx++;
+         pRun->iBlockSentPackets++;
+         if ( pRun->iBlockSentPackets >= pRun->iBlockData + pRun->iBlockEC )
+         {
+            _sim_finish_block(pRun, pModel, uTime, fLoss, uRadioRate, fVideoBitrate, iPacketBits, &slice);
+            // A new block uses the current video profile EC scheme
+            pModel->get_video_profile_ec_scheme(pRun->iVideoProfile, &pRun->iBlockData, &pRun->iBlockEC);
+         }
+      }
+      slice.uRxPackets = (u8)((iRx < 255)?iRx:255);
+      slice.uRxMissingPackets = (u8)((iMissing < 255)?iMissing:255);
+      if ( pRun->uLastTimeRecvVideoProfileAck == uTime )
+         slice.uAckTimeMs = (u8)((g_uSimRTTMs < 255)?g_uSimRTTMs:255);
+
+      adaptive_video_controller_add_slice(&pRun->state, &slice);
+
+      type_adaptive_video_controller_input input;
+      input.uTimeNow = uTime;
+      input.uTimeStart = uTimeStart;
+      input.iCurrentVideoProfile = pRun->iVideoProfile;
+      input.iPendingVideoProfile = pRun->iPendingVideoProfile;
+      input.uLastTimeSentVideoProfileRequest = pRun->uLastTimeSentVideoProfileRequest;
+      input.uLastTimeRecvVideoProfileAck = pRun->uLastTimeRecvVideoProfileAck;
+      input.uCurrentKeyframeMs = pRun->uKeyframeMs;
+      input.bAdaptiveKeyframe = (pModel->video_link_profiles[iUserProfile].uProfileEncodingFlags & VIDEO_PROFILE_ENCODING_FLAG_ENABLE_ADAPTIVE_VIDEO_KEYFRAME)?true:false;
+
+      type_adaptive_video_controller_decision decision;
+      adaptive_video_controller_decide(iController, &pRun->state, pModel, &input, &decision);
+      if ( (-1 != decision.iVideoProfile) && (decision.iVideoProfile != pRun->iVideoProfile) )
+      {
+         if ( decision.uRequestedBy == CTRL_RT_INFO_FLAG_VIDEO_PROF_SWITCH_REQ_BY_ADAPTIVE_LOWER )
+         {
+            pRun->iSwitchesLower++;
+            if ( (iSlice >= iFadeStartSlice) && (iSlice < iFadeEndSlice) )
+               pRun->uCountSwitchesLowerInFade++;
+         }
+         else
+            pRun->iSwitchesHigher++;
+         if ( g_bVerbose )
+            printf("%s: %6.2f s: switch to profile %d (%s)\n", adaptive_video_controller_get_name(iController),
+               (float)(iSlice * SIM_SLICE_MS)/1000.0, decision.iVideoProfile, str_get_video_profile_name(decision.iVideoProfile));
+         pRun->iPendingVideoProfile = decision.iVideoProfile;
+         pRun->uPendingVideoProfileTime = uTime + g_uSimRTTMs;
+         pRun->uLastTimeSentVideoProfileRequest = uTime;
+      }
+      if ( 0 != decision.uKeyframeMs )
+      {
+         pRun->iKeyframeChanges++;
+         pRun->uPendingKeyframeMs = decision.uKeyframeMs;
+         pRun->uPendingKeyframeTime = uTime + g_uSimRTTMs;
+         if ( g_bVerbose )
+            printf("%s: %6.2f s: keyframe %u ms\n", adaptive_video_controller_get_name(iController), (float)(iSlice * SIM_SLICE_MS)/1000.0, decision.uKeyframeMs);
+      }
+   }
+}
+
+static void _sim_print_run(t_sim_run* pRun, int iCountSlices)
+{
+   float fSeconds = (float)(iCountSlices * SIM_SLICE_MS) / 1000.0;
+   float fDeliveredMbps = (float)(pRun->dDeliveredBits / 1000000.0) / fSeconds;
+   float fKeyframeEfficiency = (float)(pRun->dKeyframeEfficiencySum / (double)iCountSlices);
+   float fStallMsPerSec = (float)pRun->uStallMs / fSeconds;
+   // Useful bitrate: delivered, minus the keyframes overhead, minus the frozen video time
+   float fUsefulMbps = fDeliveredMbps * fKeyframeEfficiency * (1.0 - fStallMsPerSec / 1000.0);
+
+   float fAvgLatency = 0.0, fP95Latency = 0.0;
+   if ( pRun->iCountLatencies > 0 )
+   {
+      double dSum = 0.0;
+      for( int i=0; i<pRun->iCountLatencies; i++ )
+         dSum += pRun->pLatencies[i];
+      fAvgLatency = (float)(dSum / (double)pRun->iCountLatencies);
+      qsort(pRun->pLatencies, pRun->iCountLatencies, sizeof(float), _sim_compare_floats);
+      fP95Latency = pRun->pLatencies[(pRun->iCountLatencies * 95) / 100];
+   }
+
+   printf("%-10s | %6.2f | %6.2f | %6u (%5.2f%%) | %6u | %7.1f | %5.1f / %5.1f | %3d / %3d | %3d |",
+      adaptive_video_controller_get_name(pRun->iController), fDeliveredMbps, fUsefulMbps,
+      pRun->uSkippedBlocks, (pRun->uBlocks > 0)?(100.0 * (float)pRun->uSkippedBlocks / (float)pRun->uBlocks):0.0,
+      pRun->uRetransmittedBlocks, fStallMsPerSec, fAvgLatency, fP95Latency,
+      pRun->iSwitchesLower, pRun->iSwitchesHigher, pRun->iKeyframeChanges);
+   for( int i=0; i<MAX_VIDEO_LINK_PROFILES; i++ )
+   {
+      if ( pRun->uTimeInProfile[i] > 0 )
+         printf(" %s %.0f%%", str_get_video_profile_name(i), 100.0 * (float)pRun->uTimeInProfile[i] / (fSeconds * 1000.0));
+   }
+   printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+   const char* szTraceFile = NULL;
+   int iController = -1;
+   int iStrength = -1;
+   int iRadioDatarate = 18000000;
+   bool bNoRetransmissions = false;
+
+   for( int i=1; i<argc; i++ )
+   {
+      if ( 0 == strcmp(argv[i], "-v") )
+         g_bVerbose = true;
+      else if ( 0 == strcmp(argv[i], "-noretr") )
+         bNoRetransmissions = true;
+      else if ( (0 == strcmp(argv[i], "-trace")) && (i < argc-1) )
+         szTraceFile = argv[++i];
+      else if ( (0 == strcmp(argv[i], "-controller")) && (i < argc-1) )
+         iController = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-strength")) && (i < argc-1) )
+         iStrength = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-datarate")) && (i < argc-1) )
+         iRadioDatarate = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-rtt")) && (i < argc-1) )
+         g_uSimRTTMs = (u32)atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-seed")) && (i < argc-1) )
+         s_iSimSeed = atoi(argv[++i]);
+      else
+      {
+         printf("\ntest_adaptive_video_sim [-trace log_adaptive_video_trace.txt] [-controller n] [-strength 1..10] [-datarate bps] [-rtt ms] [-noretr] [-seed n] [-v]\n");
+         printf("   -controller: %d: %s, %d: %s (default: all)\n",
+            ADAPTIVE_VIDEO_CONTROLLER_THRESHOLDS, adaptive_video_controller_get_name(ADAPTIVE_VIDEO_CONTROLLER_THRESHOLDS),
+            ADAPTIVE_VIDEO_CONTROLLER_MODEL, adaptive_video_controller_get_name(ADAPTIVE_VIDEO_CONTROLLER_MODEL));
+         printf("   -datarate: radio link video datarate, in bps (negative: MCS index + 1)\n");
+         printf("   no trace file: runs the synthetic link scenario\n");
+         return -1;
+      }
+   }
+   if ( s_iSimSeed < 1 )
+      s_iSimSeed = 1;
+
+   log_init("TestAdaptiveVideoSim");
+   if ( ! g_bVerbose )
+      log_disable();
+
+   Model model;
+   model.resetToDefaults(false);
+   model.uVehicleId = 1;
+   model.is_spectator = false;
+   model.radioLinksParams.links_count = 1;
+   model.radioLinksParams.link_capabilities_flags[0] = RADIO_HW_CAPABILITY_FLAG_CAN_RX | RADIO_HW_CAPABILITY_FLAG_CAN_TX |
+      RADIO_HW_CAPABILITY_FLAG_CAN_USE_FOR_VIDEO | RADIO_HW_CAPABILITY_FLAG_CAN_USE_FOR_DATA | RADIO_HW_CAPABILITY_FLAG_HIGH_CAPACITY;
+   model.radioLinksParams.link_radio_flags[0] = 0;
+   model.radioLinksParams.link_datarate_video_bps[0] = iRadioDatarate;
+   int iUserProfile = model.video_params.user_selected_video_link_profile;
+   model.video_link_profiles[iUserProfile].uProfileEncodingFlags |= VIDEO_PROFILE_ENCODING_FLAG_ENABLE_ADAPTIVE_VIDEO_LINK;
+   if ( bNoRetransmissions )
+      model.video_link_profiles[iUserProfile].uProfileEncodingFlags &= ~VIDEO_PROFILE_ENCODING_FLAG_ENABLE_RETRANSMISSIONS;
+   if ( iStrength > 0 )
+      model.video_params.videoAdjustmentStrength = iStrength;
+
+   s_uSimRandomState = (unsigned int)s_iSimSeed;
+   t_sim_link_slice* pLink = NULL;
+   int iFadeStartSlice = -1;
+   int iFadeEndSlice = -1;
+   int iCountSlices = 0;
+   if ( NULL != szTraceFile )
+      iCountSlices = _sim_load_trace(szTraceFile, &model, &pLink);
+   else
+      iCountSlices = _sim_build_synthetic_link(&pLink, &iFadeStartSlice, &iFadeEndSlice);
+   if ( iCountSlices <= 0 )
+   {
+      printf("No link slices to simulate.\n");
+      return -1;
+   }
+
+   printf("\nAdaptive video simulator: %s, %.1f seconds, RTT %u ms, retransmissions %s, adjustment strength %d\n",
+      (NULL != szTraceFile)?"trace":"synthetic scenario", (float)(iCountSlices * SIM_SLICE_MS)/1000.0, g_uSimRTTMs,
+      (model.video_link_profiles[iUserProfile].uProfileEncodingFlags & VIDEO_PROFILE_ENCODING_FLAG_ENABLE_RETRANSMISSIONS)?"on":"off",
+      model.video_params.videoAdjustmentStrength);
+
+   int iProfiles[] = { iUserProfile, VIDEO_PROFILE_MQ, VIDEO_PROFILE_LQ };
+   for( int i=0; i<(int)(sizeof(iProfiles)/sizeof(iProfiles[0])); i++ )
+   {
+      int iData = 0, iEC = 0;
+      model.get_video_profile_ec_scheme(iProfiles[i], &iData, &iEC);
+      printf("Profile %s: video %.2f Mbps, EC %d/%d, radio %.1f Mbps\n", str_get_video_profile_name(iProfiles[i]),
+         (float)utils_get_max_allowed_video_bitrate_for_profile_or_user_video_bitrate(&model, iProfiles[i]) / 1000000.0,
+         iData, iEC, (float)utils_get_max_radio_datarate_for_profile(&model, iProfiles[i]) / 1000000.0);
+   }
+
+   printf("\ncontroller |  Mbps  | useful | skipped blocks    | retr'd | stall   | latency ms    | down / up | kf  | time in profiles\n");
+   printf("           |        |  Mbps  |                   | blocks | ms/sec  | avg / p95     | switches  |     |\n");
+
+   int iFailed = 0;
+   for( int iCtrl=0; iCtrl<ADAPTIVE_VIDEO_CONTROLLERS_COUNT; iCtrl++ )
+   {
+      if ( (iController >= 0) && (iController != iCtrl) )
+         continue;
+      t_sim_run run;
+      _sim_run(&run, iCtrl, &model, pLink, iCountSlices, iFadeStartSlice, iFadeEndSlice);
+      _sim_print_run(&run, iCountSlices);
+
+      // Synthetic scenario: each controller must go lower in the fade and be back on the user profile at the end
+      if ( NULL == szTraceFile )
+      {
+         if ( 0 == run.uCountSwitchesLowerInFade )
+         {
+            printf("%s: did not switch to a lower video profile during the fade.\n", adaptive_video_controller_get_name(iCtrl));
+            iFailed++;
+         }
+         if ( run.iVideoProfile != iUserProfile )
+         {
+            printf("%s: did not return to the user video profile at the end.\n", adaptive_video_controller_get_name(iCtrl));
+            iFailed++;
+         }
+      }
+      free(run.pLatencies);
+   }
+
+   // User profile LQ: there is no lower profile to switch to, the controllers must stay on it
+   if ( NULL == szTraceFile )
+   {
+      model.video_params.user_selected_video_link_profile = VIDEO_PROFILE_LQ;
+      model.video_link_profiles[VIDEO_PROFILE_LQ].uProfileEncodingFlags |= VIDEO_PROFILE_ENCODING_FLAG_ENABLE_ADAPTIVE_VIDEO_LINK;
+      for( int iCtrl=0; iCtrl<ADAPTIVE_VIDEO_CONTROLLERS_COUNT; iCtrl++ )
+      {
+         if ( (iController >= 0) && (iController != iCtrl) )
+            continue;
+         t_sim_run run;
+         _sim_run(&run, iCtrl, &model, pLink, iCountSlices, iFadeStartSlice, iFadeEndSlice);
+         if ( run.uTimeInProfile[VIDEO_PROFILE_LQ] != (u32)(iCountSlices * SIM_SLICE_MS) )
+         {
+            printf("%s: switched away from the LQ user video profile.\n", adaptive_video_controller_get_name(iCtrl));
+            iFailed++;
+         }
+         free(run.pLatencies);
+      }
+      model.video_params.user_selected_video_link_profile = iUserProfile;
+   }
+   free(pLink);
+
+   if ( 0 != iFailed )
+   {
+      printf("\nAdaptive video simulator FAILED.\n");
+      return 1;
+   }
+   printf("\nAdaptive video simulator passed.\n");
+   return 0;
+}
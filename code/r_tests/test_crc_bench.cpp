@@ -0,0 +1,136 @@
+#include "../base/base.h"
+#include "../base/config.h"
+
+#include <time.h>
+
+// CRC32 benchmark and correctness check.
+// Checks all the CRC32 implementations available on this CPU against the byte table
+// one (random lengths and alignments), then measures the throughput of each one.
+
+int g_iIterations = 20000;
+bool g_bVerbose = false;
+
+#define TEST_CRC_BUFFER_SIZE 8192
+
+static unsigned long long _get_time_ns()
+{
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return (unsigned long long)t.tv_sec * 1000000000LL + (unsigned long long)t.tv_nsec;
+}
+
+static double _mb_per_sec(unsigned long long uBytes, unsigned long long uTimeNs)
+{
+   if ( 0 == uTimeNs )
+      return 0.0;
+   return ((double)uBytes / (1024.0*1024.0)) / ((double)uTimeNs / 1000000000.0);
+}
+
+// Returns the number of mismatches
+
+static int _check_implementation(int iImplementation, u8* pBuffer)
+{
+   int iFailed = 0;
+   for( int i=0; i<g_iIterations; i++ )
+   {
+      int iOffset = rand() % 16;
+      int iLength = rand() % (TEST_CRC_BUFFER_SIZE - 16);
+      if ( i < 256 )
+         iLength = i;
+
+      base_crc32_select_implementation(BASE_CRC32_IMPL_TABLE);
+      u32 uExpected = base_compute_crc32(pBuffer + iOffset, iLength);
+      base_crc32_select_implementation(iImplementation);
+      u32 uCRC = base_compute_crc32(pBuffer + iOffset, iLength);
+      if ( uCRC != uExpected )
+      {
+         iFailed++;
+         if ( g_bVerbose )
+            printf("Mismatch (%s): offset %d, length %d: %08X, expected %08X\n", base_crc32_get_implementation_name(), iOffset, iLength, uCRC, uExpected);
+      }
+   }
+   return iFailed;
+}
+
+static void _bench_implementation(u8* pBuffer)
+{
+   int iSizes[] = { 16, 24, 64, 256, 1024, 1500, 4096 };
+
+   printf("%-10s |", base_crc32_get_implementation_name());
+   for( int k=0; k<(int)(sizeof(iSizes)/sizeof(iSizes[0])); k++ )
+   {
+      volatile u32 uSum = 0;
+      int iCount = (g_iIterations * 64) / iSizes[k] + 100;
+      unsigned long long uTime = _get_time_ns();
+      for( int i=0; i<iCount; i++ )
+         uSum += base_compute_crc32(pBuffer + (i & 7), iSizes[k]);
+      uTime = _get_time_ns() - uTime;
+      printf(" %4d b: %8.1f MB/s |", iSizes[k], _mb_per_sec((unsigned long long)iCount * iSizes[k], uTime));
+   }
+   printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+   int iSeed = 1;
+
+   for( int i=1; i<argc; i++ )
+   {
+      if ( 0 == strcmp(argv[i], "-v") )
+         g_bVerbose = true;
+      else if ( (0 == strcmp(argv[i], "-iterations")) && (i < argc-1) )
+         g_iIterations = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-seed")) && (i < argc-1) )
+         iSeed = atoi(argv[++i]);
+      else
+      {
+         printf("\ntest_crc_bench [-iterations n] [-seed n] [-v]\n");
+         return -1;
+      }
+   }
+   if ( g_iIterations < 1 )
+      g_iIterations = 1;
+
+   srand(iSeed);
+
+   printf("\nCRC32 benchmark: default implementation: %s, %d iterations\n\n", base_crc32_get_implementation_name(), g_iIterations);
+
+   u8* pBuffer = (u8*)malloc(TEST_CRC_BUFFER_SIZE);
+   for( int i=0; i<TEST_CRC_BUFFER_SIZE; i++ )
+      pBuffer[i] = rand() % 256;
+
+   // Known value: CRC32 of "123456789" is CBF43926
+
+   int iTotalFailed = 0;
+   if ( 0xCBF43926 != base_compute_crc32((u8*)"123456789", 9) )
+   {
+      printf("Default implementation (%s) failed the check value.\n", base_crc32_get_implementation_name());
+      iTotalFailed++;
+   }
+
+   int iImplementations[] = { BASE_CRC32_IMPL_TABLE, BASE_CRC32_IMPL_SLICE8, BASE_CRC32_IMPL_HARDWARE };
+   for( int i=0; i<(int)(sizeof(iImplementations)/sizeof(iImplementations[0])); i++ )
+   {
+      if ( ! base_crc32_select_implementation(iImplementations[i]) )
+      {
+         printf("Implementation %d is not supported on this CPU.\n", iImplementations[i]);
+         continue;
+      }
+      int iFailed = 0;
+      if ( iImplementations[i] != BASE_CRC32_IMPL_TABLE )
+         iFailed = _check_implementation(iImplementations[i], pBuffer);
+      iTotalFailed += iFailed;
+      _bench_implementation(pBuffer);
+      if ( 0 != iFailed )
+         printf("%s: %d mismatches\n", base_crc32_get_implementation_name(), iFailed);
+   }
+   free(pBuffer);
+
+   if ( 0 != iTotalFailed )
+   {
+      printf("\nCRC32 test FAILED.\n");
+      return 1;
+   }
+   printf("\nCRC32 test passed.\n");
+   return 0;
+}
@@ -0,0 +1,165 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/encr.h"
+
+#include <time.h>
+
+// Packets encryption (epp/dpp) check and benchmark.
+// Checks that epp/dpp give the same output as the per byte pass phrase XOR
+// (random pass phrases, packet lengths and alignments), then measures the throughput.
+
+int g_iIterations = 20000;
+bool g_bVerbose = false;
+
+#define TEST_ENCR_BUFFER_SIZE 8192
+
+static unsigned long long _get_time_ns()
+{
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return (unsigned long long)t.tv_sec * 1000000000LL + (unsigned long long)t.tv_nsec;
+}
+
+static double _mb_per_sec(unsigned long long uBytes, unsigned long long uTimeNs)
+{
+   if ( 0 == uTimeNs )
+      return 0.0;
+   return ((double)uBytes / (1024.0*1024.0)) / ((double)uTimeNs / 1000000000.0);
+}
+
+static void _reference_xor(u8* pData, int iLength, const u8* pPass, int iPassLength)
+{
+   for( int pos=0; pos<iLength; pos++ )
+      pData[pos] ^= pPass[pos % iPassLength];
+}
+
+// Returns the number of mismatches
+
+static int _check_encryption(u8* pInput, u8* pExpected, u8* pOutput)
+{
+   int iFailed = 0;
+   u8 uPass[MAX_PASS_LENGTH];
+
+   for( int i=0; i<g_iIterations; i++ )
+   {
+      int iPassLength = 1 + rand() % MAX_PASS_LENGTH;
+      // Change the pass phrase only from time to time, as in real use
+      if ( (0 == (i % 100)) || (i < 64) )
+      {
+         if ( i < 64 )
+            iPassLength = i+1;
+         for( int k=0; k<iPassLength; k++ )
+            uPass[k] = 1 + rand() % 255;
+         upp(uPass, iPassLength);
+      }
+      int iCurrentPassLength = 0;
+      u8* pCurrentPass = gpp(&iCurrentPassLength);
+
+      int iOffset = rand() % 16;
+      int iLength = 1 + rand() % (TEST_ENCR_BUFFER_SIZE - 16 - 1);
+      if ( i < 256 )
+         iLength = i+1;
+
+      memcpy(pExpected, pInput + iOffset, iLength);
+      _reference_xor(pExpected, iLength, pCurrentPass, iCurrentPassLength);
+
+      memcpy(pOutput + iOffset, pInput + iOffset, iLength);
+      epp(pOutput + iOffset, iLength);
+      bool bOk = (0 == memcmp(pOutput + iOffset, pExpected, iLength));
+      dpp(pOutput + iOffset, iLength);
+      if ( 0 != memcmp(pOutput + iOffset, pInput + iOffset, iLength) )
+         bOk = false;
+
+      if ( ! bOk )
+      {
+         iFailed++;
+         if ( g_bVerbose )
+            printf("Mismatch: pass length %d, offset %d, length %d\n", iCurrentPassLength, iOffset, iLength);
+      }
+   }
+   return iFailed;
+}
+
+static void _bench_encryption(u8* pBuffer)
+{
+   int iSizes[] = { 64, 256, 1024, 1250 };
+   int iPassLengths[] = { 7, 16, 33 };
+   u8 uPass[MAX_PASS_LENGTH];
+
+   for( int p=0; p<(int)(sizeof(iPassLengths)/sizeof(iPassLengths[0])); p++ )
+   {
+      for( int k=0; k<iPassLengths[p]; k++ )
+         uPass[k] = 'a' + k;
+      upp(uPass, iPassLengths[p]);
+      int iPassLength = 0;
+      u8* pPass = gpp(&iPassLength);
+
+      printf("pass %2d |", iPassLengths[p]);
+      for( int k=0; k<(int)(sizeof(iSizes)/sizeof(iSizes[0])); k++ )
+      {
+         int iCount = (g_iIterations * 64) / iSizes[k] + 100;
+         unsigned long long uTime = _get_time_ns();
+         for( int i=0; i<iCount; i++ )
+            _reference_xor(pBuffer, iSizes[k], pPass, iPassLength);
+         unsigned long long uTimeRef = _get_time_ns() - uTime;
+
+         uTime = _get_time_ns();
+         for( int i=0; i<iCount; i++ )
+            epp(pBuffer, iSizes[k]);
+         uTime = _get_time_ns() - uTime;
+         printf(" %4d b: %7.1f / %7.1f MB/s |", iSizes[k],
+            _mb_per_sec((unsigned long long)iCount * iSizes[k], uTimeRef),
+            _mb_per_sec((unsigned long long)iCount * iSizes[k], uTime));
+      }
+      printf("\n");
+   }
+   printf("(per byte loop / epp)\n");
+}
+
+int main(int argc, char *argv[])
+{
+   int iSeed = 1;
+
+   for( int i=1; i<argc; i++ )
+   {
+      if ( 0 == strcmp(argv[i], "-v") )
+         g_bVerbose = true;
+      else if ( (0 == strcmp(argv[i], "-iterations")) && (i < argc-1) )
+         g_iIterations = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-seed")) && (i < argc-1) )
+         iSeed = atoi(argv[++i]);
+      else
+      {
+         printf("\ntest_encr [-iterations n] [-seed n] [-v]\n");
+         return -1;
+      }
+   }
+   if ( g_iIterations < 1 )
+      g_iIterations = 1;
+
+   srand(iSeed);
+
+   printf("\nPackets encryption test: %d iterations\n\n", g_iIterations);
+
+   u8* pInput = (u8*)malloc(TEST_ENCR_BUFFER_SIZE);
+   u8* pExpected = (u8*)malloc(TEST_ENCR_BUFFER_SIZE);
+   u8* pOutput = (u8*)malloc(TEST_ENCR_BUFFER_SIZE);
+   for( int i=0; i<TEST_ENCR_BUFFER_SIZE; i++ )
+      pInput[i] = rand() % 256;
+
+   int iFailed = _check_encryption(pInput, pExpected, pOutput);
+   _bench_encryption(pOutput);
+
+   free(pInput);
+   free(pExpected);
+   free(pOutput);
+   rpp();
+
+   if ( 0 != iFailed )
+   {
+      printf("\nEncryption test FAILED: %d mismatches.\n", iFailed);
+      return 1;
+   }
+   printf("\nEncryption test passed.\n");
+   return 0;
+}
@@ -0,0 +1,273 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../radio/radiopackets2.h"
+#include "../radio/fec.h"
+
+#include <time.h>
+
+// FEC encode/decode benchmark and correctness check.
+// Sweeps data/EC schemes and packet sizes, erases random packets from each
+// block (data and EC), decodes and checks the reconstructed data.
+
+int g_iIterations = 200;
+int g_iOnlyPacketSize = 0;
+bool g_bVerbose = false;
+
+u8* g_pDataPackets[MAX_TOTAL_PACKETS_IN_BLOCK];
+u8* g_pECPackets[MAX_TOTAL_PACKETS_IN_BLOCK];
+u8* g_pOriginalPackets[MAX_TOTAL_PACKETS_IN_BLOCK];
+
+u32* g_pEncodeTimes = NULL;
+u32* g_pDecodeTimes = NULL;
+
+typedef struct
+{
+   u32 uP50;
+   u32 uP90;
+   u32 uP99;
+   u32 uMax;
+   unsigned long long uTotal;
+} t_bench_percentiles;
+
+static unsigned long long _get_time_ns()
+{
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return (unsigned long long)t.tv_sec * 1000000000LL + (unsigned long long)t.tv_nsec;
+}
+
+static int _compare_u32(const void* p1, const void* p2)
+{
+   u32 u1 = *(const u32*)p1;
+   u32 u2 = *(const u32*)p2;
+   if ( u1 < u2 )
+      return -1;
+   if ( u1 > u2 )
+      return 1;
+   return 0;
+}
+
+static void _compute_percentiles(u32* pTimes, int iCount, t_bench_percentiles* pResult)
+{
+   memset(pResult, 0, sizeof(t_bench_percentiles));
+   if ( iCount <= 0 )
+      return;
+   for( int i=0; i<iCount; i++ )
+      pResult->uTotal += pTimes[i];
+   qsort(pTimes, iCount, sizeof(u32), _compare_u32);
+   pResult->uP50 = pTimes[(iCount*50)/100];
+   pResult->uP90 = pTimes[(iCount*90)/100];
+   pResult->uP99 = pTimes[(iCount*99)/100];
+   pResult->uMax = pTimes[iCount-1];
+}
+
+static double _mb_per_sec(unsigned long long uBytes, unsigned long long uTimeNs)
+{
+   if ( 0 == uTimeNs )
+      return 0.0;
+   return ((double)uBytes / (1024.0*1024.0)) / ((double)uTimeNs / 1000000000.0);
+}
+
+// Returns number of blocks that failed to decode correctly
+
+static int _bench_scheme(int iDataPackets, int iECPackets, int iPacketSize)
+{
+   int iFailed = 0;
+   int iDecodes = 0;
+
+   for( int iBlock=0; iBlock<g_iIterations; iBlock++ )
+   {
+      for( int i=0; i<iDataPackets; i++ )
+      for( int k=0; k<iPacketSize; k++ )
+         g_pDataPackets[i][k] = rand() % 256;
+
+      unsigned long long uTime = _get_time_ns();
+      fec_encode(iPacketSize, g_pDataPackets, iDataPackets, g_pECPackets, iECPackets);
+      g_pEncodeTimes[iBlock] = (u32)(_get_time_ns() - uTime);
+
+      // Lose up to iECPackets packets from the whole block (data and EC)
+
+      bool bLost[MAX_TOTAL_PACKETS_IN_BLOCK];
+      memset(bLost, 0, sizeof(bLost));
+      int iLost = rand() % (iECPackets+1);
+      for( int i=0; i<iLost; i++ )
+      {
+         int iIndex = rand() % (iDataPackets + iECPackets);
+         while ( bLost[iIndex] )
+            iIndex = (iIndex+1) % (iDataPackets + iECPackets);
+         bLost[iIndex] = true;
+      }
+
+      unsigned int uMissingIndexes[MAX_TOTAL_PACKETS_IN_BLOCK];
+      unsigned int uECIndexes[MAX_TOTAL_PACKETS_IN_BLOCK];
+      u8* pECForDecode[MAX_TOTAL_PACKETS_IN_BLOCK];
+      int iMissing = 0;
+
+      for( int i=0; i<iDataPackets; i++ )
+      {
+         if ( ! bLost[i] )
+            continue;
+         memcpy(g_pOriginalPackets[iMissing], g_pDataPackets[i], iPacketSize);
+         memset(g_pDataPackets[i], 0, iPacketSize);
+         uMissingIndexes[iMissing] = i;
+         iMissing++;
+      }
+      if ( 0 == iMissing )
+         continue;
+
+      int iECUsed = 0;
+      for( int i=0; i<iECPackets; i++ )
+      {
+         if ( bLost[iDataPackets+i] )
+            continue;
+         uECIndexes[iECUsed] = i;
+         pECForDecode[iECUsed] = g_pECPackets[i];
+         iECUsed++;
+         if ( iECUsed == iMissing )
+            break;
+      }
+
+      uTime = _get_time_ns();
+      int iRes = fec_decode(iPacketSize, g_pDataPackets, iDataPackets, pECForDecode, uECIndexes, uMissingIndexes, iMissing);
+      g_pDecodeTimes[iDecodes] = (u32)(_get_time_ns() - uTime);
+      iDecodes++;
+
+      bool bOk = (iRes == 0);
+      for( int i=0; i<iMissing; i++ )
+      {
+         if ( 0 != memcmp(g_pOriginalPackets[i], g_pDataPackets[uMissingIndexes[i]], iPacketSize) )
+            bOk = false;
+      }
+      if ( ! bOk )
+      {
+         iFailed++;
+         if ( g_bVerbose )
+            printf("Failed to decode block %d (%d/%d, %d bytes), %d missing packets.\n", iBlock, iDataPackets, iECPackets, iPacketSize, iMissing);
+      }
+   }
+
+   t_bench_percentiles encPerc, decPerc;
+   _compute_percentiles(g_pEncodeTimes, g_iIterations, &encPerc);
+   _compute_percentiles(g_pDecodeTimes, iDecodes, &decPerc);
+
+   unsigned long long uBlockBytes = (unsigned long long)iDataPackets * (unsigned long long)iPacketSize;
+   printf("%2d/%2d %4d b | enc %8.1f MB/s p50 %6.1f p90 %6.1f p99 %6.1f max %7.1f us | dec %8.1f MB/s p50 %6.1f p90 %6.1f p99 %6.1f max %7.1f us | %s\n",
+      iDataPackets, iECPackets, iPacketSize,
+      _mb_per_sec(uBlockBytes * g_iIterations, encPerc.uTotal),
+      encPerc.uP50/1000.0, encPerc.uP90/1000.0, encPerc.uP99/1000.0, encPerc.uMax/1000.0,
+      _mb_per_sec(uBlockBytes * iDecodes, decPerc.uTotal),
+      decPerc.uP50/1000.0, decPerc.uP90/1000.0, decPerc.uP99/1000.0, decPerc.uMax/1000.0,
+      (0 == iFailed)?"OK":"FAILED");
+   return iFailed;
+}
+
+int main(int argc, char *argv[])
+{
+   bool bScalar = false;
+   bool bNoCache = false;
+   int iSeed = 1;
+
+   for( int i=1; i<argc; i++ )
+   {
+      if ( 0 == strcmp(argv[i], "-scalar") )
+         bScalar = true;
+      else if ( 0 == strcmp(argv[i], "-nocache") )
+         bNoCache = true;
+      else if ( 0 == strcmp(argv[i], "-v") )
+         g_bVerbose = true;
+      else if ( (0 == strcmp(argv[i], "-iterations")) && (i < argc-1) )
+         g_iIterations = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-size")) && (i < argc-1) )
+         g_iOnlyPacketSize = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-seed")) && (i < argc-1) )
+         iSeed = atoi(argv[++i]);
+      else
+      {
+         printf("\ntest_fec_bench [-iterations n] [-size packet_bytes] [-seed n] [-scalar] [-nocache] [-v]\n");
+         return -1;
+      }
+   }
+   if ( g_iIterations < 1 )
+      g_iIterations = 1;
+   if ( (g_iOnlyPacketSize < 0) || (g_iOnlyPacketSize > MAX_PACKET_TOTAL_SIZE) )
+      g_iOnlyPacketSize = MAX_PACKET_TOTAL_SIZE;
+
+   srand(iSeed);
+   fec_init();
+   fec_use_simd_kernels(bScalar?0:1);
+   fec_enable_decode_cache(bNoCache?0:1);
+
+   printf("\nFEC benchmark: kernel: %s, %d blocks per scheme, max %d data + %d EC packets, max packet size %d bytes\n\n",
+      fec_get_kernel_name(), g_iIterations, MAX_DATA_PACKETS_IN_BLOCK, MAX_FECS_PACKETS_IN_BLOCK, MAX_PACKET_TOTAL_SIZE);
+
+   for( int i=0; i<MAX_TOTAL_PACKETS_IN_BLOCK; i++ )
+   {
+      g_pDataPackets[i] = (u8*)malloc(MAX_PACKET_TOTAL_SIZE);
+      g_pECPackets[i] = (u8*)malloc(MAX_PACKET_TOTAL_SIZE);
+      g_pOriginalPackets[i] = (u8*)malloc(MAX_PACKET_TOTAL_SIZE);
+   }
+   g_pEncodeTimes = (u32*)malloc(g_iIterations * sizeof(u32));
+   g_pDecodeTimes = (u32*)malloc(g_iIterations * sizeof(u32));
+
+   int iDataCounts[] = { 1, 2, 4, 6, 8, 12, 16, 24, 32 };
+   int iPacketSizes[] = { 64, 256, 1024, 1400, MAX_PACKET_TOTAL_SIZE };
+   int iTotalFailed = 0;
+
+   for( int iSize=0; iSize<(int)(sizeof(iPacketSizes)/sizeof(iPacketSizes[0])); iSize++ )
+   {
+      int iPacketSize = iPacketSizes[iSize];
+      if ( (0 != g_iOnlyPacketSize) && (iPacketSize != g_iOnlyPacketSize) )
+         continue;
+      for( int iData=0; iData<(int)(sizeof(iDataCounts)/sizeof(iDataCounts[0])); iData++ )
+      {
+         int iDataPackets = iDataCounts[iData];
+         if ( iDataPackets > MAX_DATA_PACKETS_IN_BLOCK )
+            continue;
+         int iECCounts[3] = { 1, iDataPackets/2, iDataPackets };
+         for( int iEC=0; iEC<3; iEC++ )
+         {
+            int iECPackets = iECCounts[iEC];
+            if ( (iECPackets < 1) || (iECPackets > MAX_FECS_PACKETS_IN_BLOCK) )
+               continue;
+            if ( (iEC > 0) && (iECPackets == iECCounts[iEC-1]) )
+               continue;
+            if ( (iEC > 1) && (iECPackets == iECCounts[iEC-2]) )
+               continue;
+            iTotalFailed += _bench_scheme(iDataPackets, iECPackets, iPacketSize);
+         }
+      }
+      printf("\n");
+   }
+
+   // A custom packet size, not in the list above
+   if ( 0 != g_iOnlyPacketSize )
+   {
+      bool bInList = false;
+      for( int iSize=0; iSize<(int)(sizeof(iPacketSizes)/sizeof(iPacketSizes[0])); iSize++ )
+         if ( iPacketSizes[iSize] == g_iOnlyPacketSize )
+            bInList = true;
+      if ( ! bInList )
+         iTotalFailed += _bench_scheme(MAX_DATA_PACKETS_IN_BLOCK, MAX_FECS_PACKETS_IN_BLOCK, g_iOnlyPacketSize);
+   }
+
+   for( int i=0; i<MAX_TOTAL_PACKETS_IN_BLOCK; i++ )
+   {
+      free(g_pDataPackets[i]);
+      free(g_pECPackets[i]);
+      free(g_pOriginalPackets[i]);
+   }
+   free(g_pEncodeTimes);
+   free(g_pDecodeTimes);
+
+   unsigned int uCacheHits = 0, uCacheMisses = 0;
+   fec_get_decode_cache_stats(&uCacheHits, &uCacheMisses);
+   printf("Decode matrix cache: %u hits, %u misses\n", uCacheHits, uCacheMisses);
+
+   if ( 0 != iTotalFailed )
+   {
+      printf("FEC test FAILED: %d blocks were not reconstructed correctly.\n", iTotalFailed);
+      return 1;
+   }
+   printf("FEC test passed.\n");
+   return 0;
+}
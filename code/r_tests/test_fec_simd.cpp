@@ -0,0 +1,220 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../radio/radiopackets2.h"
+#include "../radio/fec.h"
+
+// Checks the SIMD FEC kernels against the scalar reference:
+// encodes and decodes the same random blocks with both and compares the output byte for byte.
+// Packet sizes and buffer alignments are random, including sizes shorter than the vector width
+// and sizes that end with a partial vector (tails handled by the narrower kernels).
+
+#define TEST_MAX_ALIGN_OFFSET 64
+
+int g_iIterations = 2000;
+bool g_bVerbose = false;
+
+u8* g_pDataAlloc[MAX_TOTAL_PACKETS_IN_BLOCK];
+u8* g_pECSIMDAlloc[MAX_TOTAL_PACKETS_IN_BLOCK];
+u8* g_pECScalarAlloc[MAX_TOTAL_PACKETS_IN_BLOCK];
+u8* g_pDecodedSIMDAlloc[MAX_TOTAL_PACKETS_IN_BLOCK];
+u8* g_pDecodedScalarAlloc[MAX_TOTAL_PACKETS_IN_BLOCK];
+
+static int _random_packet_size()
+{
+   // Half of the time, sizes around the vector widths (16 and 32 bytes)
+   if ( rand() % 2 )
+      return 1 + rand() % 80;
+   return 1 + rand() % MAX_PACKET_TOTAL_SIZE;
+}
+
+static void _set_pointers(u8** pAlloc, u8** pPointers, int iCount)
+{
+   for( int i=0; i<iCount; i++ )
+      pPointers[i] = pAlloc[i] + (rand() % TEST_MAX_ALIGN_OFFSET);
+}
+
+// Returns true if the SIMD and scalar outputs match (and the decoded data matches the original)
+
+static bool _test_block(int iIteration)
+{
+   int iDataPackets = 1 + rand() % MAX_DATA_PACKETS_IN_BLOCK;
+   int iMaxEC = (iDataPackets < MAX_FECS_PACKETS_IN_BLOCK)?iDataPackets:MAX_FECS_PACKETS_IN_BLOCK;
+   int iECPackets = 1 + rand() % iMaxEC;
+   int iPacketSize = _random_packet_size();
+
+   u8* pData[MAX_TOTAL_PACKETS_IN_BLOCK];
+   u8* pECSIMD[MAX_TOTAL_PACKETS_IN_BLOCK];
+   u8* pECScalar[MAX_TOTAL_PACKETS_IN_BLOCK];
+   _set_pointers(g_pDataAlloc, pData, iDataPackets);
+   _set_pointers(g_pECSIMDAlloc, pECSIMD, iECPackets);
+   _set_pointers(g_pECScalarAlloc, pECScalar, iECPackets);
+
+   for( int i=0; i<iDataPackets; i++ )
+   for( int k=0; k<iPacketSize; k++ )
+      pData[i][k] = rand() % 256;
+
+   // Encode
+
+   fec_use_simd_kernels(1);
+   fec_encode(iPacketSize, pData, iDataPackets, pECSIMD, iECPackets);
+   fec_use_simd_kernels(0);
+   fec_encode(iPacketSize, pData, iDataPackets, pECScalar, iECPackets);
+
+   for( int i=0; i<iECPackets; i++ )
+   {
+      if ( 0 != memcmp(pECSIMD[i], pECScalar[i], iPacketSize) )
+      {
+         printf("Iteration %d: encode output differs (%d/%d, %d bytes), EC packet %d.\n", iIteration, iDataPackets, iECPackets, iPacketSize, i);
+         return false;
+      }
+   }
+
+   // Lose some data packets, decode them from a random subset of the EC packets
+
+   int iMissing = 1 + rand() % iECPackets;
+   unsigned int uMissingIndexes[MAX_TOTAL_PACKETS_IN_BLOCK];
+   bool bLost[MAX_TOTAL_PACKETS_IN_BLOCK];
+   memset(bLost, 0, sizeof(bLost));
+   for( int i=0; i<iMissing; i++ )
+   {
+      int iIndex = rand() % iDataPackets;
+      while ( bLost[iIndex] )
+         iIndex = (iIndex+1) % iDataPackets;
+      bLost[iIndex] = true;
+   }
+   int iCount = 0;
+   for( int i=0; i<iDataPackets; i++ )
+      if ( bLost[i] )
+         uMissingIndexes[iCount++] = i;
+
+   unsigned int uECIndexes[MAX_TOTAL_PACKETS_IN_BLOCK];
+   bool bECUsed[MAX_TOTAL_PACKETS_IN_BLOCK];
+   memset(bECUsed, 0, sizeof(bECUsed));
+   for( int i=0; i<iMissing; i++ )
+   {
+      int iIndex = rand() % iECPackets;
+      while ( bECUsed[iIndex] )
+         iIndex = (iIndex+1) % iECPackets;
+      bECUsed[iIndex] = true;
+      uECIndexes[i] = iIndex;
+   }
+
+   u8* pDecodedSIMD[MAX_TOTAL_PACKETS_IN_BLOCK];
+   u8* pDecodedScalar[MAX_TOTAL_PACKETS_IN_BLOCK];
+   u8* pECForDecode[MAX_TOTAL_PACKETS_IN_BLOCK];
+   _set_pointers(g_pDecodedSIMDAlloc, pDecodedSIMD, iDataPackets);
+   _set_pointers(g_pDecodedScalarAlloc, pDecodedScalar, iDataPackets);
+
+   for( int i=0; i<iDataPackets; i++ )
+   {
+      if ( bLost[i] )
+      {
+         memset(pDecodedSIMD[i], 0, iPacketSize);
+         memset(pDecodedScalar[i], 0, iPacketSize);
+      }
+      else
+      {
+         memcpy(pDecodedSIMD[i], pData[i], iPacketSize);
+         memcpy(pDecodedScalar[i], pData[i], iPacketSize);
+      }
+   }
+
+   fec_use_simd_kernels(1);
+   for( int i=0; i<iMissing; i++ )
+      pECForDecode[i] = pECSIMD[uECIndexes[i]];
+   int iResSIMD = fec_decode(iPacketSize, pDecodedSIMD, iDataPackets, pECForDecode, uECIndexes, uMissingIndexes, iMissing);
+
+   fec_use_simd_kernels(0);
+   for( int i=0; i<iMissing; i++ )
+      pECForDecode[i] = pECScalar[uECIndexes[i]];
+   int iResScalar = fec_decode(iPacketSize, pDecodedScalar, iDataPackets, pECForDecode, uECIndexes, uMissingIndexes, iMissing);
+
+   if ( (0 != iResSIMD) || (0 != iResScalar) )
+   {
+      printf("Iteration %d: decode failed (%d/%d, %d bytes, %d missing), result SIMD: %d, scalar: %d.\n", iIteration, iDataPackets, iECPackets, iPacketSize, iMissing, iResSIMD, iResScalar);
+      return false;
+   }
+
+   for( int i=0; i<iMissing; i++ )
+   {
+      int iIndex = uMissingIndexes[i];
+      if ( 0 != memcmp(pDecodedSIMD[iIndex], pDecodedScalar[iIndex], iPacketSize) )
+      {
+         printf("Iteration %d: decode output differs (%d/%d, %d bytes, %d missing), data packet %d.\n", iIteration, iDataPackets, iECPackets, iPacketSize, iMissing, iIndex);
+         return false;
+      }
+      if ( 0 != memcmp(pDecodedSIMD[iIndex], pData[iIndex], iPacketSize) )
+      {
+         printf("Iteration %d: decoded data packet %d does not match the original (%d/%d, %d bytes, %d missing).\n", iIteration, iIndex, iDataPackets, iECPackets, iPacketSize, iMissing);
+         return false;
+      }
+   }
+
+   if ( g_bVerbose )
+      printf("Iteration %d: %d/%d, %d bytes, %d missing: ok\n", iIteration, iDataPackets, iECPackets, iPacketSize, iMissing);
+   return true;
+}
+
+int main(int argc, char *argv[])
+{
+   int iSeed = 1;
+
+   for( int i=1; i<argc; i++ )
+   {
+      if ( 0 == strcmp(argv[i], "-v") )
+         g_bVerbose = true;
+      else if ( (0 == strcmp(argv[i], "-iterations")) && (i < argc-1) )
+         g_iIterations = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-seed")) && (i < argc-1) )
+         iSeed = atoi(argv[++i]);
+      else
+      {
+         printf("\ntest_fec_simd [-iterations n] [-seed n] [-v]\n");
+         return -1;
+      }
+   }
+   if ( g_iIterations < 1 )
+      g_iIterations = 1;
+
+   srand(iSeed);
+   fec_init();
+   // Cached decode matrices are the same for both kernels; compute them each time
+   fec_enable_decode_cache(0);
+   fec_use_simd_kernels(1);
+   printf("\nFEC SIMD kernels check: kernel: %s, %d random blocks\n", fec_get_kernel_name(), g_iIterations);
+   if ( 0 == strcmp(fec_get_kernel_name(), "scalar") )
+      printf("No SIMD kernel is available on this CPU, only the scalar path is checked.\n");
+
+   for( int i=0; i<MAX_TOTAL_PACKETS_IN_BLOCK; i++ )
+   {
+      g_pDataAlloc[i] = (u8*)malloc(MAX_PACKET_TOTAL_SIZE + TEST_MAX_ALIGN_OFFSET);
+      g_pECSIMDAlloc[i] = (u8*)malloc(MAX_PACKET_TOTAL_SIZE + TEST_MAX_ALIGN_OFFSET);
+      g_pECScalarAlloc[i] = (u8*)malloc(MAX_PACKET_TOTAL_SIZE + TEST_MAX_ALIGN_OFFSET);
+      g_pDecodedSIMDAlloc[i] = (u8*)malloc(MAX_PACKET_TOTAL_SIZE + TEST_MAX_ALIGN_OFFSET);
+      g_pDecodedScalarAlloc[i] = (u8*)malloc(MAX_PACKET_TOTAL_SIZE + TEST_MAX_ALIGN_OFFSET);
+   }
+
+   int iFailed = 0;
+   for( int i=0; i<g_iIterations; i++ )
+   {
+      if ( ! _test_block(i) )
+         iFailed++;
+   }
+
+   for( int i=0; i<MAX_TOTAL_PACKETS_IN_BLOCK; i++ )
+   {
+      free(g_pDataAlloc[i]);
+      free(g_pECSIMDAlloc[i]);
+      free(g_pECScalarAlloc[i]);
+      free(g_pDecodedSIMDAlloc[i]);
+      free(g_pDecodedScalarAlloc[i]);
+   }
+
+   if ( 0 != iFailed )
+   {
+      printf("FEC SIMD check FAILED: %d of %d blocks differ from the scalar reference.\n", iFailed, g_iIterations);
+      return 1;
+   }
+   printf("FEC SIMD check passed: SIMD and scalar outputs are identical.\n");
+   return 0;
+}
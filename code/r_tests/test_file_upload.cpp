@@ -0,0 +1,390 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/commands.h"
+#include "../base/file_upload.h"
+#include "../radio/radiopackets2.h"
+#include "upload_test_link.h"
+
+// Windowed file upload check over a simulated link (see upload_test_link.h).
+// Uploads a random file over a simulated link (bandwidth, latency, tx queue, random or burst
+// packet loss, both ways) with the same sender/receiver code the controller and the vehicle use,
+// checks that the received file matches, then compares the upload time with the one segment per
+// command upload (at most one segment every 100 ms, then waits for its command response):
+// the windowed upload has to be at least SIM_MIN_SPEEDUP times faster.
+// Also checks the command responses routing (segment acks vs other responses) and the no acks
+// fallback/abort timeouts the controller uses.
+
+#define SIM_SEGMENT_SIZE 800
+#define SIM_MAX_TIME_MS 1200000
+#define SIM_RX_FILE "test_file_upload_rx.bin"
+#define SIM_MIN_SPEEDUP 3.0
+
+bool g_bVerbose = false;
+u32 g_uLoopMs = 10;
+
+typedef struct
+{
+   const char* szName;
+   u32 uBytesPerSec;
+   u32 uLatencyMs;
+   float fLoss;
+   bool bBurstLoss;
+} t_sim_scenario;
+
+typedef struct
+{
+   u32 uTimeMs;
+   bool bComplete;
+   bool bFileOk;
+   u32 uSentSegments;
+   u32 uResentSegments;
+} t_sim_result;
+
+static type_upload_test_link s_LinkUp;
+static type_upload_test_link s_LinkDown;
+
+static int _sim_segment_size(u32 uSegmentIndex, u32 uTotalSegments, u32 uFileSize)
+{
+   if ( uSegmentIndex == uTotalSegments-1 )
+      return uFileSize - uSegmentIndex * SIM_SEGMENT_SIZE;
+   return SIM_SEGMENT_SIZE;
+}
+
+// Builds the command response the vehicle sends for a segment (radio headers and the ack).
+// Returns its length.
+
+static int _sim_build_response(u8* pBuffer, u16 uOriginCommandType, command_packet_upload_file_segment_ack* pAck)
+{
+   int iLength = sizeof(t_packet_header) + sizeof(t_packet_header_command_response);
+   memset(pBuffer, 0, iLength);
+   t_packet_header* pPH = (t_packet_header*)pBuffer;
+   t_packet_header_command_response* pPHCR = (t_packet_header_command_response*)(pBuffer + sizeof(t_packet_header));
+   pPHCR->origin_command_type = uOriginCommandType;
+   if ( NULL != pAck )
+   {
+      memcpy(pBuffer + iLength, (u8*)pAck, sizeof(command_packet_upload_file_segment_ack));
+      iLength += sizeof(command_packet_upload_file_segment_ack);
+   }
+   pPH->total_length = iLength;
+   return iLength;
+}
+
+// Vehicle side: writes the segment, answers with the selective ack
+
+static void _sim_vehicle_on_segment(type_file_upload_receiver* pReceiver, u8* pFile, u32 uFileSize, u32 uTotalSegments, u32 uSegmentIndex, u32 uTimeNow)
+{
+   int iSize = _sim_segment_size(uSegmentIndex, uTotalSegments, uFileSize);
+   if ( file_upload_receiver_add_segment(pReceiver, uSegmentIndex, pFile + uSegmentIndex * SIM_SEGMENT_SIZE, iSize) < 0 )
+      printf("Failed to write segment %u\n", uSegmentIndex);
+   int iAckLength = sizeof(t_packet_header) + sizeof(t_packet_header_command_response) + sizeof(command_packet_upload_file_segment_ack);
+   type_upload_test_packet* pPacket = upload_test_link_send(&s_LinkDown, 0, iAckLength, uTimeNow);
+   if ( NULL != pPacket )
+   {
+      command_packet_upload_file_segment_ack ack;
+      file_upload_receiver_get_ack(pReceiver, uSegmentIndex, &ack);
+      pPacket->uIndex = uSegmentIndex;
+      pPacket->iLength = _sim_build_response(pPacket->uData, COMMAND_ID_UPLOAD_FILE_SEGMENT, &ack);
+   }
+}
+
+static int _sim_segment_packet_length(u32 uSegmentIndex, u32 uTotalSegments, u32 uFileSize)
+{
+   return sizeof(t_packet_header) + sizeof(t_packet_header_command) + sizeof(command_packet_upload_file_segment) + _sim_segment_size(uSegmentIndex, uTotalSegments, uFileSize);
+}
+
+static void _sim_run_windowed(t_sim_scenario* pScenario, u8* pFile, u32 uFileSize, t_sim_result* pResult)
+{
+   u32 uTotalSegments = (uFileSize + SIM_SEGMENT_SIZE - 1) / SIM_SEGMENT_SIZE;
+   memset(pResult, 0, sizeof(t_sim_result));
+   upload_test_link_init(&s_LinkUp, pScenario->uBytesPerSec, pScenario->uLatencyMs, pScenario->fLoss, pScenario->bBurstLoss, 48 * SIM_SEGMENT_SIZE);
+   upload_test_link_init(&s_LinkDown, pScenario->uBytesPerSec, pScenario->uLatencyMs, pScenario->fLoss, pScenario->bBurstLoss, 48 * SIM_SEGMENT_SIZE);
+
+   type_file_upload_sender sender;
+   type_file_upload_receiver receiver;
+   memset(&sender, 0, sizeof(sender));
+   file_upload_receiver_init(&receiver);
+   file_upload_sender_init(&sender, uTotalSegments, 0);
+   file_upload_receiver_start(&receiver, 1, uTotalSegments, uFileSize, SIM_RX_FILE);
+
+   type_upload_test_packet packet;
+   u32 uCountAcksNotUsed = 0;
+   u32 uCountAcksTimeouts = 0;
+   u32 uTime = 0;
+   for( uTime=0; uTime<SIM_MAX_TIME_MS; uTime++ )
+   {
+      while ( upload_test_link_receive(&s_LinkUp, uTime, &packet) )
+         _sim_vehicle_on_segment(&receiver, pFile, uFileSize, uTotalSegments, packet.uIndex, uTime);
+
+      // The controller processes the responses and sends only on its loop iterations
+      if ( 0 != (uTime % g_uLoopMs) )
+         continue;
+      while ( upload_test_link_receive(&s_LinkDown, uTime, &packet) )
+      {
+         if ( FILE_UPLOAD_RESPONSE_ACK_USED != file_upload_sender_on_response(&sender, 1, packet.uData, packet.iLength, uTime) )
+            uCountAcksNotUsed++;
+      }
+      if ( FILE_UPLOAD_SENDER_ACKS_OK != file_upload_sender_check_acks(&sender, uTime) )
+         uCountAcksTimeouts++;
+      if ( file_upload_sender_is_complete(&sender) )
+      {
+         pResult->bComplete = true;
+         break;
+      }
+      int iSegment = -1;
+      while ( (iSegment = file_upload_sender_get_segment_to_send(&sender, uTime)) >= 0 )
+      {
+         type_upload_test_packet* pPacket = upload_test_link_send(&s_LinkUp, 0, _sim_segment_packet_length(iSegment, uTotalSegments, uFileSize), uTime);
+         if ( NULL != pPacket )
+            pPacket->uIndex = iSegment;
+         file_upload_sender_on_segment_sent(&sender, iSegment, uTime);
+      }
+   }
+   if ( g_bVerbose )
+      printf("   window: %.1f (max %.1f), RTT: %u ms (min %u ms), RTO: %u ms, lost: %u, timed out: %u\n",
+         sender.fWindow, sender.fMaxWindow, sender.uSRTTMs, sender.uMinRTTMs, sender.uRTOMs, sender.uCountLost, sender.uCountTimeouts);
+   file_upload_receiver_close(&receiver);
+   pResult->uTimeMs = uTime;
+   pResult->uSentSegments = sender.uCountSent;
+   pResult->uResentSegments = sender.uCountResent;
+   pResult->bFileOk = pResult->bComplete && file_upload_receiver_is_complete(&receiver) && upload_test_check_file(SIM_RX_FILE, pFile, uFileSize);
+   if ( (0 != uCountAcksNotUsed) || (0 != uCountAcksTimeouts) )
+   {
+      printf("   %u acks not used, %u no acks timeouts\n", uCountAcksNotUsed, uCountAcksTimeouts);
+      pResult->bFileOk = false;
+   }
+   file_upload_sender_close(&sender);
+   if ( NULL != receiver.pReceived )
+      free(receiver.pReceived);
+}
+
+// One segment per command: a segment every 100 ms at most, 50 ms after the last response,
+// resent on command timeout (50 ms, growing by 10 ms on each retry)
+
+static void _sim_run_stop_and_wait(t_sim_scenario* pScenario, u8* pFile, u32 uFileSize, t_sim_result* pResult)
+{
+   u32 uTotalSegments = (uFileSize + SIM_SEGMENT_SIZE - 1) / SIM_SEGMENT_SIZE;
+   memset(pResult, 0, sizeof(t_sim_result));
+   upload_test_link_init(&s_LinkUp, pScenario->uBytesPerSec, pScenario->uLatencyMs, pScenario->fLoss, pScenario->bBurstLoss, 48 * SIM_SEGMENT_SIZE);
+   upload_test_link_init(&s_LinkDown, pScenario->uBytesPerSec, pScenario->uLatencyMs, pScenario->fLoss, pScenario->bBurstLoss, 48 * SIM_SEGMENT_SIZE);
+
+   type_file_upload_receiver receiver;
+   file_upload_receiver_init(&receiver);
+   file_upload_receiver_start(&receiver, 1, uTotalSegments, uFileSize, SIM_RX_FILE);
+
+   u32 uCurrentSegment = 0;
+   bool bWaitingResponse = false;
+   u32 uTimeCommandSent = 0;
+   u32 uCommandTimeout = 50;
+   u32 uTimeLastSegment = 0;
+   u32 uTimeLastResponse = 0;
+   type_upload_test_packet packet;
+   u32 uTime = 0;
+   for( uTime=0; uTime<SIM_MAX_TIME_MS; uTime++ )
+   {
+      while ( upload_test_link_receive(&s_LinkUp, uTime, &packet) )
+         _sim_vehicle_on_segment(&receiver, pFile, uFileSize, uTotalSegments, packet.uIndex, uTime);
+
+      if ( 0 != (uTime % g_uLoopMs) )
+         continue;
+      while ( upload_test_link_receive(&s_LinkDown, uTime, &packet) )
+      {
+         if ( (! bWaitingResponse) || (packet.uIndex != uCurrentSegment) )
+            continue;
+         bWaitingResponse = false;
+         uTimeLastResponse = uTime;
+         uCurrentSegment++;
+      }
+      if ( uCurrentSegment >= uTotalSegments )
+      {
+         pResult->bComplete = true;
+         break;
+      }
+      if ( bWaitingResponse && (uTime > uTimeCommandSent + uCommandTimeout) )
+      {
+         if ( uCommandTimeout < 300 )
+            uCommandTimeout += 10;
+         uTimeCommandSent = uTime;
+         pResult->uSentSegments++;
+         pResult->uResentSegments++;
+         type_upload_test_packet* pPacket = upload_test_link_send(&s_LinkUp, 0, _sim_segment_packet_length(uCurrentSegment, uTotalSegments, uFileSize), uTime);
+         if ( NULL != pPacket )
+            pPacket->uIndex = uCurrentSegment;
+      }
+      if ( bWaitingResponse || (uTime < uTimeLastSegment + 100) || (uTime < uTimeLastResponse + 50) )
+         continue;
+      bWaitingResponse = true;
+      uTimeCommandSent = uTime;
+      uCommandTimeout = 50;
+      uTimeLastSegment = uTime;
+      pResult->uSentSegments++;
+      type_upload_test_packet* pPacket = upload_test_link_send(&s_LinkUp, 0, _sim_segment_packet_length(uCurrentSegment, uTotalSegments, uFileSize), uTime);
+      if ( NULL != pPacket )
+         pPacket->uIndex = uCurrentSegment;
+   }
+   file_upload_receiver_close(&receiver);
+   pResult->uTimeMs = uTime;
+   pResult->bFileOk = pResult->bComplete && file_upload_receiver_is_complete(&receiver) && upload_test_check_file(SIM_RX_FILE, pFile, uFileSize);
+   if ( NULL != receiver.pReceived )
+      free(receiver.pReceived);
+}
+
+// Controller side checks, as used by handle_commands: which command responses are segment acks,
+// and when an upload falls back to one segment per command or is abandoned.
+// Returns the number of failed checks.
+
+static int _test_responses_and_timeouts()
+{
+   int iFailed = 0;
+   u8 uBuffer[MAX_PACKET_TOTAL_SIZE];
+   command_packet_upload_file_segment_ack ack;
+   type_file_upload_sender sender;
+   memset(&sender, 0, sizeof(sender));
+
+   file_upload_sender_init(&sender, 10, 1000);
+   file_upload_sender_on_segment_sent(&sender, 0, 1000);
+
+   memset(&ack, 0, sizeof(ack));
+   ack.uFileId = 7;
+   ack.uSegmentIndex = 0;
+   ack.uNextMissingSegment = 1;
+
+   struct
+   {
+      const char* szName;
+      int iResult;
+      int iExpected;
+   } checks[8];
+   int iChecks = 0;
+
+   int iLength = _sim_build_response(uBuffer, COMMAND_ID_UPLOAD_FILE_SEGMENT+1, &ack);
+   checks[iChecks++] = { "other command response", file_upload_sender_on_response(&sender, 7, uBuffer, iLength, 1010), FILE_UPLOAD_RESPONSE_NOT_AN_ACK };
+   iLength = _sim_build_response(uBuffer, COMMAND_ID_UPLOAD_FILE_SEGMENT, NULL);
+   checks[iChecks++] = { "short ack", file_upload_sender_on_response(&sender, 7, uBuffer, iLength, 1010), FILE_UPLOAD_RESPONSE_ACK_IGNORED };
+   iLength = _sim_build_response(uBuffer, COMMAND_ID_UPLOAD_FILE_SEGMENT, &ack);
+   checks[iChecks++] = { "ack, other file", file_upload_sender_on_response(&sender, 8, uBuffer, iLength, 1010), FILE_UPLOAD_RESPONSE_ACK_IGNORED };
+   checks[iChecks++] = { "ack, no upload", file_upload_sender_on_response(NULL, 7, uBuffer, iLength, 1010), FILE_UPLOAD_RESPONSE_ACK_IGNORED };
+   checks[iChecks++] = { "no acks for 3 s", file_upload_sender_check_acks(&sender, 1000 + FILE_UPLOAD_NO_ACK_FALLBACK_MS), FILE_UPLOAD_SENDER_ACKS_OK };
+   checks[iChecks++] = { "ack", file_upload_sender_on_response(&sender, 7, uBuffer, iLength, 1020), FILE_UPLOAD_RESPONSE_ACK_USED };
+   ack.uFlags = UPLOAD_FILE_SEGMENT_ACK_FLAG_FAILED;
+   iLength = _sim_build_response(uBuffer, COMMAND_ID_UPLOAD_FILE_SEGMENT, &ack);
+   checks[iChecks++] = { "ack, vehicle failed", file_upload_sender_on_response(&sender, 7, uBuffer, iLength, 1030), FILE_UPLOAD_RESPONSE_ACK_FAILED };
+   checks[iChecks++] = { "acks stopped for 15 s", file_upload_sender_check_acks(&sender, 1020 + FILE_UPLOAD_NO_ACK_ABORT_MS), FILE_UPLOAD_SENDER_ACKS_OK };
+
+   for( int i=0; i<iChecks; i++ )
+   {
+      if ( checks[i].iResult == checks[i].iExpected )
+         continue;
+      printf("Controller check [%s] FAILED: result %d, expected %d\n", checks[i].szName, checks[i].iResult, checks[i].iExpected);
+      iFailed++;
+   }
+   if ( 1 != sender.uCountAcks )
+   {
+      printf("Controller check [acks used] FAILED: %u acks used, expected 1\n", sender.uCountAcks);
+      iFailed++;
+   }
+   if ( FILE_UPLOAD_SENDER_NO_ACKS_ABORT != file_upload_sender_check_acks(&sender, 1020 + FILE_UPLOAD_NO_ACK_ABORT_MS + 1) )
+   {
+      printf("Controller check [abort after 15 s with no acks] FAILED\n");
+      iFailed++;
+   }
+
+   // Vehicle that never acks: fallback after 3 s
+   file_upload_sender_init(&sender, 10, 1000);
+   file_upload_sender_on_segment_sent(&sender, 0, 1000);
+   if ( FILE_UPLOAD_SENDER_NO_ACKS_FALLBACK != file_upload_sender_check_acks(&sender, 1000 + FILE_UPLOAD_NO_ACK_FALLBACK_MS + 1) )
+   {
+      printf("Controller check [fallback after 3 s with no acks] FAILED\n");
+      iFailed++;
+   }
+   file_upload_sender_close(&sender);
+
+   printf("Controller responses and timeouts checks: %s\n", (0 == iFailed)?"ok":"FAILED");
+   return iFailed;
+}
+
+int main(int argc, char *argv[])
+{
+   int iSeed = 1;
+   int iFileSizeKb = 256;
+   bool bCompare = true;
+
+   for( int i=1; i<argc; i++ )
+   {
+      if ( 0 == strcmp(argv[i], "-v") )
+         g_bVerbose = true;
+      else if ( 0 == strcmp(argv[i], "-nocompare") )
+         bCompare = false;
+      else if ( (0 == strcmp(argv[i], "-size")) && (i < argc-1) )
+         iFileSizeKb = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-loop")) && (i < argc-1) )
+         g_uLoopMs = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-seed")) && (i < argc-1) )
+         iSeed = atoi(argv[++i]);
+      else
+      {
+         printf("\ntest_file_upload [-size kb] [-loop ms] [-seed n] [-nocompare] [-v]\n");
+         return -1;
+      }
+   }
+   if ( iFileSizeKb < 1 )
+      iFileSizeKb = 1;
+   if ( g_uLoopMs < 1 )
+      g_uLoopMs = 1;
+
+   srand(iSeed);
+   // Not a multiple of the segment size, so the last segment is a short one
+   u32 uFileSize = iFileSizeKb * 1024 + 123;
+   u8* pFile = (u8*)malloc(uFileSize);
+   for( u32 u=0; u<uFileSize; u++ )
+      pFile[u] = rand() % 256;
+
+   t_sim_scenario scenarios[] =
+   {
+      { "clean",           100000,  5, 0.0,  false },
+      { "loss 10%",        100000,  5, 0.1,  false },
+      { "loss 30%",        100000,  5, 0.3,  false },
+      { "burst loss",      100000,  5, 0.02, true },
+      { "slow, far",        20000, 60, 0.05, false }
+   };
+
+   printf("\nFile upload over a simulated link: %u bytes, %d byte segments, controller loop %u ms\n\n", uFileSize, SIM_SEGMENT_SIZE, g_uLoopMs);
+   int iFailed = _test_responses_and_timeouts();
+   printf("\n");
+   for( int i=0; i<(int)(sizeof(scenarios)/sizeof(scenarios[0])); i++ )
+   {
+      t_sim_result resultWindowed;
+      t_sim_result resultStopAndWait;
+      _sim_run_windowed(&scenarios[i], pFile, uFileSize, &resultWindowed);
+      printf("%-12s windowed: %s, %7u ms, %7.1f KB/s, %5u segments sent (%u resent)\n", scenarios[i].szName,
+         resultWindowed.bFileOk?"ok    ":"FAILED", resultWindowed.uTimeMs, upload_test_kb_per_sec(uFileSize, resultWindowed.uTimeMs),
+         resultWindowed.uSentSegments, resultWindowed.uResentSegments);
+      if ( ! resultWindowed.bFileOk )
+         iFailed++;
+      if ( ! bCompare )
+         continue;
+      _sim_run_stop_and_wait(&scenarios[i], pFile, uFileSize, &resultStopAndWait);
+      printf("%-12s one/cmd:  %s, %7u ms, %7.1f KB/s, %5u segments sent (%u resent)\n", "",
+         resultStopAndWait.bComplete?"done  ":"timeout", resultStopAndWait.uTimeMs, upload_test_kb_per_sec(uFileSize, resultStopAndWait.uTimeMs),
+         resultStopAndWait.uSentSegments, resultStopAndWait.uResentSegments);
+
+      // The one per command upload is the baseline; a timeout there is slower than any windowed time
+      if ( resultStopAndWait.bComplete && ((float)resultWindowed.uTimeMs * SIM_MIN_SPEEDUP > (float)resultStopAndWait.uTimeMs) )
+      {
+         printf("%-12s windowed upload is only %.1fx faster (at least %.1fx expected)\n", "",
+            (float)resultStopAndWait.uTimeMs / (float)((resultWindowed.uTimeMs > 0)?resultWindowed.uTimeMs:1), SIM_MIN_SPEEDUP);
+         iFailed++;
+      }
+   }
+   unlink(SIM_RX_FILE);
+   upload_test_link_free(&s_LinkUp);
+   upload_test_link_free(&s_LinkDown);
+   free(pFile);
+
+   if ( 0 != iFailed )
+   {
+      printf("\nFile upload test FAILED: %d checks.\n", iFailed);
+      return 1;
+   }
+   printf("\nFile upload test passed.\n");
+   return 0;
+}
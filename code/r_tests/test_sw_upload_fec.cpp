@@ -0,0 +1,386 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/commands.h"
+#include "../base/sw_upload_fec.h"
+#include "../radio/radiopackets2.h"
+#include "upload_test_link.h"
+
+
+#define SIM_LEGACY_BLOCK_SIZE 1100
+#define SIM_MAX_TIME_MS 1200000
+#define SIM_RX_FILE "test_sw_upload_fec_rx.bin"
+
+#define SIM_PACKET_FEC_BLOCK 0
+#define SIM_PACKET_FEC_STATUS_REQUEST 1
+#define SIM_PACKET_FEC_STATUS 2
+#define SIM_PACKET_LEGACY_BLOCK 3
+#define SIM_PACKET_LEGACY_RESPONSE 4
+
+bool g_bVerbose = false;
+
+typedef struct
+{
+   const char* szName;
+   u32 uBytesPerSec;
+   u32 uLatencyMs;
+   float fLoss;
+   bool bBurstLoss;
+} t_sim_scenario;
+
+typedef struct
+{
+   u32 uTimeMs;
+   bool bComplete;
+   bool bFileOk;
+   u32 uSentBlocks;
+   int iPasses;
+} t_sim_result;
+
+static type_upload_test_link s_LinkUp;
+static type_upload_test_link s_LinkDown;
+
+static int s_iCommandHeadersLength = sizeof(t_packet_header) + sizeof(t_packet_header_command);
+static int s_iResponseHeadersLength = sizeof(t_packet_header) + sizeof(t_packet_header_command_response);
+
+// Vehicle side, FEC transfer: writes the blocks, answers the status requests
+
+static void _sim_vehicle_on_fec_packet(type_sw_upload_fec_receiver* pReceiver, type_upload_test_packet* pPacket, u32 uTimeNow)
+{
+   command_packet_sw_package_fec* pHeader = (command_packet_sw_package_fec*)pPacket->uData;
+   if ( ! sw_upload_fec_receiver_is_current_transfer(pReceiver, pHeader) )
+   if ( ! sw_upload_fec_receiver_start(pReceiver, pHeader, SIM_RX_FILE) )
+      printf("Failed to start receiving the archive\n");
+
+   if ( pPacket->iType == SIM_PACKET_FEC_BLOCK )
+   {
+      if ( sw_upload_fec_receiver_add_block(pReceiver, pHeader, pPacket->uData + sizeof(command_packet_sw_package_fec), pPacket->iLength - sizeof(command_packet_sw_package_fec)) < 0 )
+         printf("Failed to add block %d of generation %u\n", pHeader->uBlockIndex, pHeader->uGenerationIndex);
+      return;
+   }
+   type_upload_test_packet* pResponse = upload_test_link_send(&s_LinkDown, SIM_PACKET_FEC_STATUS, s_iResponseHeadersLength + sizeof(command_packet_sw_package_fec_status), uTimeNow);
+   if ( NULL == pResponse )
+      return;
+   sw_upload_fec_receiver_get_status(pReceiver, (command_packet_sw_package_fec_status*)pResponse->uData);
+   pResponse->iLength = sizeof(command_packet_sw_package_fec_status);
+}
+
+// Controller side, same flow as the update upload menu: a status request (with retries) before
+// the first pass and after each pass, blocks sent as one way commands during a pass
+
+static void _sim_run_fec(t_sim_scenario* pScenario, u8* pFile, u32 uFileSize, t_sim_result* pResult)
+{
+   memset(pResult, 0, sizeof(t_sim_result));
+   upload_test_link_init(&s_LinkUp, pScenario->uBytesPerSec, pScenario->uLatencyMs, pScenario->fLoss, pScenario->bBurstLoss, 48 * SIM_LEGACY_BLOCK_SIZE);
+   upload_test_link_init(&s_LinkDown, pScenario->uBytesPerSec, pScenario->uLatencyMs, pScenario->fLoss, pScenario->bBurstLoss, 48 * SIM_LEGACY_BLOCK_SIZE);
+
+   type_sw_upload_fec_sender sender;
+   type_sw_upload_fec_receiver receiver;
+   sw_upload_fec_receiver_init(&receiver);
+   if ( ! sw_upload_fec_sender_init(&sender, 1, 1, pFile, uFileSize) )
+   {
+      printf("Failed to init the sender\n");
+      return;
+   }
+   command_packet_sw_package_fec header;
+   sw_upload_fec_sender_get_header(&sender, &header);
+
+   bool bSending = false;
+   bool bWaitingStatus = false;
+   bool bFirstPass = true;
+   u32 uStatusRetries = 0;
+   u32 uWaitReplyTime = 100;
+   u32 uTimeStatusSent = 0;
+   u32 uTimeNextBlock = 0;
+   u8 uBlock[UPLOAD_TEST_LINK_MAX_PACKET_SIZE];
+   type_upload_test_packet packet;
+   u32 uTime = 0;
+   for( uTime=0; uTime<SIM_MAX_TIME_MS; uTime++ )
+   {
+      while ( upload_test_link_receive(&s_LinkUp, uTime, &packet) )
+         _sim_vehicle_on_fec_packet(&receiver, &packet, uTime);
+
+      bool bGotStatus = false;
+      command_packet_sw_package_fec_status status;
+      while ( upload_test_link_receive(&s_LinkDown, uTime, &packet) )
+      {
+         if ( (! bWaitingStatus) || (packet.iType != SIM_PACKET_FEC_STATUS) )
+            continue;
+         memcpy(&status, packet.uData, sizeof(command_packet_sw_package_fec_status));
+         if ( status.uTransferId == header.uTransferId )
+            bGotStatus = true;
+      }
+
+      if ( bGotStatus )
+      {
+         bWaitingStatus = false;
+         if ( status.uFlags & SW_UPLOAD_FEC_STATUS_FLAG_COMPLETE )
+         {
+            pResult->bComplete = true;
+            break;
+         }
+         if ( status.uFlags & SW_UPLOAD_FEC_STATUS_FLAG_FAILED )
+            break;
+         sw_upload_fec_sender_start_pass(&sender, bFirstPass?NULL:&status);
+         bFirstPass = false;
+         bSending = true;
+         uTimeNextBlock = uTime;
+      }
+
+      if ( bSending )
+      {
+         if ( uTime < uTimeNextBlock )
+            continue;
+         int iLength = sw_upload_fec_sender_get_next_block(&sender, uBlock, sizeof(uBlock));
+         if ( iLength > 0 )
+         {
+            type_upload_test_packet* pPacket = upload_test_link_send(&s_LinkUp, SIM_PACKET_FEC_BLOCK, s_iCommandHeadersLength + iLength, uTime);
+            if ( NULL != pPacket )
+            {
+               memcpy(pPacket->uData, uBlock, iLength);
+               pPacket->iLength = iLength;
+            }
+            uTimeNextBlock = uTime + sender.uBlockIntervalMs;
+            continue;
+         }
+         bSending = false;
+         uStatusRetries = 0;
+         uWaitReplyTime = 100;
+      }
+
+      if ( bWaitingStatus && (uTime < uTimeStatusSent + uWaitReplyTime) )
+         continue;
+      if ( bWaitingStatus )
+      {
+         uWaitReplyTime += 50;
+         if ( uWaitReplyTime > 500 )
+            uWaitReplyTime = 500;
+         if ( uStatusRetries >= SW_UPLOAD_FEC_STATUS_MAX_RETRIES )
+            break;
+      }
+      uStatusRetries++;
+      bWaitingStatus = true;
+      uTimeStatusSent = uTime;
+      type_upload_test_packet* pPacket = upload_test_link_send(&s_LinkUp, SIM_PACKET_FEC_STATUS_REQUEST, s_iCommandHeadersLength + sizeof(command_packet_sw_package_fec), uTime);
+      if ( NULL != pPacket )
+      {
+         memcpy(pPacket->uData, &header, sizeof(command_packet_sw_package_fec));
+         pPacket->iLength = sizeof(command_packet_sw_package_fec);
+      }
+   }
+   if ( g_bVerbose )
+   {
+      printf("   loss: %.1f%%, block interval: %u ms, EC blocks sent: %u, generations rebuilt with EC blocks: %u of %u, blocks not needed: %u, dropped up/down: %u/%u\n",
+         100.0*sender.fLoss, sender.uBlockIntervalMs, sender.uCountECBlocksSent, receiver.uCountGenerationsDecoded, receiver.uGenerations,
+         receiver.uCountBlocksNotNeeded, s_LinkUp.uCountDropped, s_LinkDown.uCountDropped);
+   }
+   pResult->uTimeMs = uTime;
+   pResult->uSentBlocks = sender.uCountBlocksSent;
+   pResult->iPasses = sender.iPassIndex;
+   pResult->bFileOk = pResult->bComplete && sw_upload_fec_receiver_is_complete(&receiver);
+   sw_upload_fec_receiver_close(&receiver);
+   pResult->bFileOk = pResult->bFileOk && upload_test_check_file(SIM_RX_FILE, pFile, uFileSize);
+   sw_upload_fec_sender_close(&sender);
+}
+
+// Upload method 6.3: each block sent twice, 2 ms apart; every DEFAULT_UPLOAD_PACKET_CONFIRMATION_FREQUENCY
+// blocks (and the last one) a block waits for the vehicle response (100 ms, growing by 50 ms up to
+// 500 ms, 15 retries); the vehicle answers failed if any of the blocks before it is missing and the
+// controller starts again from the last confirmed block
+
+static void _sim_run_legacy(t_sim_scenario* pScenario, u32 uFileSize, t_sim_result* pResult)
+{
+   memset(pResult, 0, sizeof(t_sim_result));
+   upload_test_link_init(&s_LinkUp, pScenario->uBytesPerSec, pScenario->uLatencyMs, pScenario->fLoss, pScenario->bBurstLoss, 48 * SIM_LEGACY_BLOCK_SIZE);
+   upload_test_link_init(&s_LinkDown, pScenario->uBytesPerSec, pScenario->uLatencyMs, pScenario->fLoss, pScenario->bBurstLoss, 48 * SIM_LEGACY_BLOCK_SIZE);
+
+   int iTotalBlocks = (uFileSize + SIM_LEGACY_BLOCK_SIZE - 1) / SIM_LEGACY_BLOCK_SIZE;
+   u8* pReceived = (u8*) malloc(iTotalBlocks);
+   memset(pReceived, 0, iTotalBlocks);
+   int iBlockLength = s_iCommandHeadersLength + sizeof(command_packet_sw_package) + SIM_LEGACY_BLOCK_SIZE;
+
+   int iBlockToSend = 0;
+   int iLastAcknowledged = -1;
+   bool bWaitingAck = false;
+   int iResendCounter = 0;
+   u32 uWaitReplyTime = 100;
+   u32 uTimeSent = 0;
+   u32 uTimeNextSend = 0;
+   type_upload_test_packet packet;
+   u32 uTime = 0;
+   for( uTime=0; uTime<SIM_MAX_TIME_MS; uTime++ )
+   {
+      while ( upload_test_link_receive(&s_LinkUp, uTime, &packet) )
+      {
+         int iIndex = (int)packet.uIndex;
+         pReceived[iIndex] = 1;
+         if ( ! packet.bFlag )
+            continue;
+         bool bAllPrevOk = true;
+         int iRepeat = 2;
+         if ( iIndex == iTotalBlocks-1 )
+         {
+            iRepeat = 10;
+            for( int i=0; i<iTotalBlocks; i++ )
+               if ( 0 == pReceived[i] )
+                  bAllPrevOk = false;
+         }
+         else
+         {
+            for( int i=iIndex, iCount=DEFAULT_UPLOAD_PACKET_CONFIRMATION_FREQUENCY; (i >= 0) && (iCount >= 0); i--, iCount-- )
+               if ( 0 == pReceived[i] )
+                  bAllPrevOk = false;
+         }
+         for( int k=0; k<iRepeat; k++ )
+         {
+            type_upload_test_packet* pResponse = upload_test_link_send(&s_LinkDown, SIM_PACKET_LEGACY_RESPONSE, s_iResponseHeadersLength, uTime);
+            if ( NULL != pResponse )
+            {
+               pResponse->uIndex = iIndex;
+               pResponse->bFlag = bAllPrevOk;
+            }
+         }
+      }
+
+      bool bGotResponse = false;
+      bool bResponseOk = false;
+      while ( upload_test_link_receive(&s_LinkDown, uTime, &packet) )
+      {
+         if ( bWaitingAck && (packet.uIndex == (u32)iBlockToSend) )
+         {
+            bGotResponse = true;
+            bResponseOk = packet.bFlag;
+         }
+      }
+
+      if ( bWaitingAck )
+      {
+         if ( bGotResponse )
+         {
+            bWaitingAck = false;
+            if ( bResponseOk )
+               iLastAcknowledged = iBlockToSend;
+            else
+               iBlockToSend = iLastAcknowledged;
+            iBlockToSend++;
+            if ( iBlockToSend >= iTotalBlocks )
+            {
+               pResult->bComplete = true;
+               break;
+            }
+            continue;
+         }
+         if ( uTime < uTimeSent + uWaitReplyTime )
+            continue;
+         if ( iResendCounter >= 15 )
+            break;
+         uWaitReplyTime += 50;
+         if ( uWaitReplyTime > 500 )
+            uWaitReplyTime = 500;
+      }
+      else if ( uTime < uTimeNextSend )
+         continue;
+
+      bool bWaitAck = ((iBlockToSend % DEFAULT_UPLOAD_PACKET_CONFIRMATION_FREQUENCY) == 0) || (iBlockToSend == iTotalBlocks-1);
+      int iCopies = bWaitAck?1:2;
+      for( int k=0; k<iCopies; k++ )
+      {
+         pResult->uSentBlocks++;
+         type_upload_test_packet* pPacket = upload_test_link_send(&s_LinkUp, SIM_PACKET_LEGACY_BLOCK, iBlockLength, uTime);
+         if ( NULL != pPacket )
+         {
+            pPacket->uIndex = iBlockToSend;
+            pPacket->bFlag = bWaitAck;
+         }
+      }
+      if ( ! bWaitAck )
+      {
+         iBlockToSend++;
+         uTimeNextSend = uTime + 2;
+         continue;
+      }
+      if ( ! bWaitingAck )
+      {
+         bWaitingAck = true;
+         iResendCounter = 0;
+         uWaitReplyTime = 100;
+      }
+      iResendCounter++;
+      uTimeSent = uTime;
+   }
+   pResult->uTimeMs = uTime;
+   free(pReceived);
+}
+
+int main(int argc, char *argv[])
+{
+   int iSeed = 1;
+   int iFileSizeKb = 512;
+   bool bCompare = true;
+
+   for( int i=1; i<argc; i++ )
+   {
+      if ( 0 == strcmp(argv[i], "-v") )
+         g_bVerbose = true;
+      else if ( 0 == strcmp(argv[i], "-nocompare") )
+         bCompare = false;
+      else if ( (0 == strcmp(argv[i], "-size")) && (i < argc-1) )
+         iFileSizeKb = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-seed")) && (i < argc-1) )
+         iSeed = atoi(argv[++i]);
+      else
+      {
+         printf("\ntest_sw_upload_fec [-size kb] [-seed n] [-nocompare] [-v]\n");
+         return -1;
+      }
+   }
+   if ( iFileSizeKb < 1 )
+      iFileSizeKb = 1;
+
+   srand(iSeed);
+   // Not a multiple of the generation size, so the last generation is a short one
+   u32 uFileSize = iFileSizeKb * 1024 + 3333;
+   u8* pFile = (u8*)malloc(uFileSize);
+   for( u32 u=0; u<uFileSize; u++ )
+      pFile[u] = rand() % 256;
+
+   t_sim_scenario scenarios[] =
+   {
+      { "clean",           500000,  5, 0.0,  false },
+      { "loss 10%",        500000,  5, 0.1,  false },
+      { "loss 30%",        500000,  5, 0.3,  false },
+      { "burst loss",      500000,  5, 0.02, true },
+      { "slow, far",       100000, 60, 0.05, false }
+   };
+
+   printf("\nSoftware update upload over a simulated link: %u bytes, generations of %d x %d byte blocks\n\n", uFileSize, SW_UPLOAD_FEC_DATA_BLOCKS, SW_UPLOAD_FEC_BLOCK_SIZE);
+   int iFailed = 0;
+   for( int i=0; i<(int)(sizeof(scenarios)/sizeof(scenarios[0])); i++ )
+   {
+      t_sim_result resultFEC;
+      t_sim_result resultLegacy;
+      _sim_run_fec(&scenarios[i], pFile, uFileSize, &resultFEC);
+      printf("%-12s FEC:     %s, %7u ms, %7.1f KB/s, %5u blocks sent in %d passes\n", scenarios[i].szName,
+         resultFEC.bFileOk?"ok    ":"FAILED", resultFEC.uTimeMs, upload_test_kb_per_sec(uFileSize, resultFEC.uTimeMs),
+         resultFEC.uSentBlocks, resultFEC.iPasses);
+      if ( ! resultFEC.bFileOk )
+         iFailed++;
+      if ( ! bCompare )
+         continue;
+      _sim_run_legacy(&scenarios[i], uFileSize, &resultLegacy);
+      printf("%-12s 6.3:     %s, %7u ms, %7.1f KB/s, %5u blocks sent\n", "",
+         resultLegacy.bComplete?"done  ":"FAILED", resultLegacy.uTimeMs, upload_test_kb_per_sec(uFileSize, resultLegacy.uTimeMs),
+         resultLegacy.uSentBlocks);
+   }
+   unlink(SIM_RX_FILE);
+   upload_test_link_free(&s_LinkUp);
+   upload_test_link_free(&s_LinkDown);
+   free(pFile);
+
+   if ( 0 != iFailed )
+   {
+      printf("\nSoftware update upload test FAILED: %d scenarios.\n", iFailed);
+      return 1;
+   }
+   printf("\nSoftware update upload test passed.\n");
+   return 0;
+}
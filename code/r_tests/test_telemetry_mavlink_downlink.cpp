@@ -0,0 +1,359 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/models.h"
+#include "../base/hardware_radio.h"
+#include "../radio/radiolink.h"
+#include "../radio/radiopackets2.h"
+#include "../../mavlink/common/mavlink.h"
+#include "../r_vehicle/telemetry_mavlink_downlink.h"
+
+// Checks the MAVLink aware telemetry downlink used on slow radio links, on a vehicle with one SiK link:
+// priority order (critical, reliable, state), state messages coalescing, the per packet byte budget
+// and send interval, and that frames are forwarded byte for byte as received from the FC
+// (including frames of message ids not in our dialect, and no frames with a bad CRC).
+
+#define TEST_SYS_ID 1
+#define TEST_COMP_ID 1
+#define TEST_UNKNOWN_MSG_ID 42999
+
+Model* g_pCurrentModel = NULL;
+bool g_bVerbose = false;
+
+static Model s_Model;
+static u32 s_uTimeNow = 10000;
+static int s_iFailed = 0;
+
+typedef struct
+{
+   u8 uData[MAVLINK_MAX_PACKET_LEN];
+   int iLength;
+} t_test_frame;
+
+static void _check(bool bCondition, const char* szTest, const char* szWhat)
+{
+   if ( bCondition )
+   {
+      if ( g_bVerbose )
+         printf("%s: %s: ok\n", szTest, szWhat);
+      return;
+   }
+   printf("%s: FAILED: %s\n", szTest, szWhat);
+   s_iFailed++;
+}
+
+static void _frame_from_message(mavlink_message_t* pMsg, t_test_frame* pFrame)
+{
+   pFrame->iLength = mavlink_msg_to_send_buffer(pFrame->uData, pMsg);
+}
+
+static void _build_attitude(t_test_frame* pFrame, u32 uTimeBootMs)
+{
+   mavlink_message_t msg;
+   mavlink_msg_attitude_pack_chan(TEST_SYS_ID, TEST_COMP_ID, MAVLINK_COMM_0, &msg, uTimeBootMs, 0.1, 0.2, 0.3, 0.01, 0.02, 0.03);
+   _frame_from_message(&msg, pFrame);
+}
+
+static void _build_heartbeat(t_test_frame* pFrame)
+{
+   mavlink_message_t msg;
+   mavlink_msg_heartbeat_pack_chan(TEST_SYS_ID, TEST_COMP_ID, MAVLINK_COMM_0, &msg, MAV_TYPE_QUADROTOR, MAV_AUTOPILOT_ARDUPILOTMEGA, 0, 0, MAV_STATE_ACTIVE);
+   _frame_from_message(&msg, pFrame);
+}
+
+static void _build_gps_raw(t_test_frame* pFrame, u32 uTimeBootMs)
+{
+   mavlink_message_t msg;
+   mavlink_msg_gps_raw_int_pack_chan(TEST_SYS_ID, TEST_COMP_ID, MAVLINK_COMM_0, &msg, (uint64_t)uTimeBootMs*1000, 3, 450000000, 260000000, 100000, 100, 100, 500, 9000, 12, 0, 0, 0, 0, 0);
+   _frame_from_message(&msg, pFrame);
+}
+
+static void _build_statustext(t_test_frame* pFrame, const char* szText)
+{
+   mavlink_message_t msg;
+   mavlink_msg_statustext_pack_chan(TEST_SYS_ID, TEST_COMP_ID, MAVLINK_COMM_0, &msg, MAV_SEVERITY_WARNING, szText);
+   _frame_from_message(&msg, pFrame);
+}
+
+static void _build_param_value(t_test_frame* pFrame, const char* szName, u16 uIndex)
+{
+   mavlink_message_t msg;
+   mavlink_msg_param_value_pack_chan(TEST_SYS_ID, TEST_COMP_ID, MAVLINK_COMM_0, &msg, szName, 1.0, MAV_PARAM_TYPE_REAL32, 500, uIndex);
+   _frame_from_message(&msg, pFrame);
+}
+
+// A message id that is not in our dialect: the downlink can't check its CRC
+static void _build_unknown(t_test_frame* pFrame)
+{
+   mavlink_message_t msg;
+   memset(&msg, 0, sizeof(msg));
+   msg.msgid = TEST_UNKNOWN_MSG_ID;
+   for( int i=0; i<12; i++ )
+      _MAV_PAYLOAD_NON_CONST(&msg)[i] = (char)(i+1);
+   mavlink_finalize_message_chan(&msg, TEST_SYS_ID, TEST_COMP_ID, MAVLINK_COMM_0, 12, 12, 77);
+   _frame_from_message(&msg, pFrame);
+}
+
+// MAVLink 2 frame with the payload not truncated (trailing zero bytes), as some FCs send it;
+// re-serializing it would truncate the payload
+static void _build_attitude_untruncated(t_test_frame* pFrame, u32 uTimeBootMs)
+{
+   mavlink_attitude_t attitude;
+   memset(&attitude, 0, sizeof(attitude));
+   attitude.time_boot_ms = uTimeBootMs;
+   attitude.roll = 0.5;
+
+   u8* pData = pFrame->uData;
+   int iPayload = MAVLINK_MSG_ID_ATTITUDE_LEN;
+   pData[0] = MAVLINK_STX;
+   pData[1] = (u8)iPayload;
+   pData[2] = 0;
+   pData[3] = 0;
+   pData[4] = 7;
+   pData[5] = TEST_SYS_ID;
+   pData[6] = TEST_COMP_ID;
+   pData[7] = MAVLINK_MSG_ID_ATTITUDE & 0xFF;
+   pData[8] = (MAVLINK_MSG_ID_ATTITUDE >> 8) & 0xFF;
+   pData[9] = (MAVLINK_MSG_ID_ATTITUDE >> 16) & 0xFF;
+   memcpy(pData+10, &attitude, iPayload);
+   uint16_t uCRC = crc_calculate(pData+1, 9 + iPayload);
+   crc_accumulate(MAVLINK_MSG_ID_ATTITUDE_CRC, &uCRC);
+   pData[10+iPayload] = uCRC & 0xFF;
+   pData[11+iPayload] = uCRC >> 8;
+   pFrame->iLength = 12 + iPayload;
+}
+
+static void _add_frame(t_test_frame* pFrame)
+{
+   telemetry_mavlink_downlink_add_serial_data(pFrame->uData, pFrame->iLength, s_uTimeNow*1000);
+}
+
+// Appends the frame to the expected output
+static void _expect(u8* pExpected, int* piExpectedLength, t_test_frame* pFrame)
+{
+   memcpy(pExpected + *piExpectedLength, pFrame->uData, pFrame->iLength);
+   *piExpectedLength += pFrame->iLength;
+}
+
+static int _get_packet(u8* pOutput)
+{
+   u32 uOldest = 0;
+   return telemetry_mavlink_downlink_get_packet_to_send(s_uTimeNow, pOutput, RAW_TELEMETRY_MAX_BUFFER, &uOldest);
+}
+
+// Starts from empty queues and lets the next packet be sent right away
+static void _reset_downlink()
+{
+   s_Model.telemetry_params.fc_telemetry_type = TELEMETRY_TYPE_NONE;
+   telemetry_mavlink_downlink_init();
+   s_Model.telemetry_params.fc_telemetry_type = TELEMETRY_TYPE_MAVLINK;
+   telemetry_mavlink_downlink_init();
+   s_uTimeNow += 10000;
+}
+
+static void _test_priority()
+{
+   const char* szTest = "priority";
+   _reset_downlink();
+
+   t_test_frame attitude, statusText, param1, param2, heartbeat;
+   _build_attitude(&attitude, 100);
+   _build_heartbeat(&heartbeat);
+   _build_statustext(&statusText, "Low battery");
+   _build_param_value(&param1, "RC1_MIN", 1);
+   _build_param_value(&param2, "RC1_MAX", 2);
+
+   _add_frame(&attitude);
+   _add_frame(&param1);
+   _add_frame(&heartbeat);
+   _add_frame(&statusText);
+   _add_frame(&param2);
+
+   // Critical, then reliable in order, then state with the heartbeat first;
+   // the attitude does not fit in the packet budget anymore, it goes in the next packet
+   u8 uExpected[RAW_TELEMETRY_MAX_BUFFER*2];
+   int iExpectedLength = 0;
+   _expect(uExpected, &iExpectedLength, &statusText);
+   _expect(uExpected, &iExpectedLength, &param1);
+   _expect(uExpected, &iExpectedLength, &param2);
+   _expect(uExpected, &iExpectedLength, &heartbeat);
+
+   u8 uOutput[RAW_TELEMETRY_MAX_BUFFER];
+   int iLength = _get_packet(uOutput);
+   _check((iLength == iExpectedLength) && (0 == memcmp(uOutput, uExpected, iLength)), szTest, "critical, reliable, then state messages");
+
+   s_uTimeNow += telemetry_mavlink_downlink_get_time_to_next_send_ms(s_uTimeNow);
+   iLength = _get_packet(uOutput);
+   _check((iLength == attitude.iLength) && (0 == memcmp(uOutput, attitude.uData, iLength)), szTest, "state message left for the next packet");
+   _check(-1 == telemetry_mavlink_downlink_get_time_to_next_send_ms(s_uTimeNow), szTest, "nothing pending after the packets");
+}
+
+static void _test_coalescing()
+{
+   const char* szTest = "coalescing";
+   _reset_downlink();
+
+   t_test_frame attitude, gps;
+   for( int i=0; i<5; i++ )
+   {
+      _build_attitude(&attitude, 1000 + i*20);
+      _add_frame(&attitude);
+   }
+   _build_gps_raw(&gps, 1100);
+   _add_frame(&gps);
+
+   // Only the latest attitude is sent
+   u8 uExpected[RAW_TELEMETRY_MAX_BUFFER*2];
+   int iExpectedLength = 0;
+   _expect(uExpected, &iExpectedLength, &attitude);
+   _expect(uExpected, &iExpectedLength, &gps);
+
+   u8 uOutput[RAW_TELEMETRY_MAX_BUFFER];
+   int iLength = _get_packet(uOutput);
+   _check((iLength == iExpectedLength) && (0 == memcmp(uOutput, uExpected, iLength)), szTest, "latest instance of each state message");
+
+   // Next time, the least recently sent state message goes first
+   s_uTimeNow += 1000;
+   _build_attitude(&attitude, 2000);
+   _add_frame(&attitude);
+   s_uTimeNow += 1000;
+   _build_gps_raw(&gps, 2100);
+   _add_frame(&gps);
+   iLength = _get_packet(uOutput);
+   iExpectedLength = 0;
+   _expect(uExpected, &iExpectedLength, &attitude);
+   _expect(uExpected, &iExpectedLength, &gps);
+   _check((iLength == iExpectedLength) && (0 == memcmp(uOutput, uExpected, iLength)), szTest, "least recently sent first");
+}
+
+static void _test_budget()
+{
+   const char* szTest = "budget";
+   _reset_downlink();
+
+   int iMaxBytes = RADIO_SLOW_LINK_MAX_PACKET_LENGTH - sizeof(t_packet_header) - sizeof(t_packet_header_telemetry_raw);
+   t_test_frame params[10];
+   int iTotal = 0;
+   for( int i=0; i<10; i++ )
+   {
+      char szName[16];
+      snprintf(szName, sizeof(szName), "PARAM_%d", i);
+      _build_param_value(&params[i], szName, (u16)i);
+      _add_frame(&params[i]);
+      iTotal += params[i].iLength;
+   }
+
+   // Each packet: whole messages, in order, within the budget, then wait for the send interval
+   u8 uOutput[RAW_TELEMETRY_MAX_BUFFER];
+   u8 uReceived[RAW_TELEMETRY_MAX_BUFFER*4];
+   int iReceived = 0;
+   int iPackets = 0;
+   bool bOk = true;
+   while ( iPackets < 20 )
+   {
+      int iLength = _get_packet(uOutput);
+      if ( 0 == iLength )
+         break;
+      iPackets++;
+      if ( iLength > iMaxBytes )
+         bOk = false;
+      memcpy(uReceived + iReceived, uOutput, iLength);
+      iReceived += iLength;
+
+      _check(0 == _get_packet(uOutput), szTest, "no packet before the send interval");
+      int iWait = telemetry_mavlink_downlink_get_time_to_next_send_ms(s_uTimeNow);
+      if ( iWait < 0 )
+         break;
+      _check(iWait > 0, szTest, "time to next send");
+      s_uTimeNow += iWait;
+   }
+   _check(bOk, szTest, "packets within the slow link byte budget");
+   _check(iPackets > 1, szTest, "messages split over several packets");
+
+   u8 uExpected[RAW_TELEMETRY_MAX_BUFFER*4];
+   int iExpectedLength = 0;
+   for( int i=0; i<10; i++ )
+      _expect(uExpected, &iExpectedLength, &params[i]);
+   _check((iReceived == iTotal) && (0 == memcmp(uReceived, uExpected, iReceived)), szTest, "all messages sent, in order");
+}
+
+static void _test_original_frames()
+{
+   const char* szTest = "frames";
+   _reset_downlink();
+
+   t_test_frame unknown, badCRC, untruncated, statusText;
+   _build_unknown(&unknown);
+   _build_param_value(&badCRC, "BAD_CRC", 3);
+   badCRC.uData[badCRC.iLength-1] ^= 0x55;
+   _build_attitude_untruncated(&untruncated, 3000);
+   _build_statustext(&statusText, "Armed");
+
+   // Some noise bytes in between the frames
+   u8 uNoise[5] = { 0x00, 0x11, 0x22, 0x33, 0x44 };
+   telemetry_mavlink_downlink_add_serial_data(uNoise, sizeof(uNoise), s_uTimeNow*1000);
+   _add_frame(&untruncated);
+   _add_frame(&badCRC);
+   _add_frame(&unknown);
+   telemetry_mavlink_downlink_add_serial_data(uNoise, sizeof(uNoise), s_uTimeNow*1000);
+   _add_frame(&statusText);
+
+   // The frame with a bad CRC is dropped, the unknown one goes with the reliable messages
+   u8 uExpected[RAW_TELEMETRY_MAX_BUFFER*2];
+   int iExpectedLength = 0;
+   _expect(uExpected, &iExpectedLength, &statusText);
+   _expect(uExpected, &iExpectedLength, &unknown);
+   _expect(uExpected, &iExpectedLength, &untruncated);
+
+   u8 uOutput[RAW_TELEMETRY_MAX_BUFFER];
+   int iLength = _get_packet(uOutput);
+   _check((iLength == iExpectedLength) && (0 == memcmp(uOutput, uExpected, iLength)), szTest, "frames forwarded as received");
+}
+
+int main(int argc, char *argv[])
+{
+   for( int i=1; i<argc; i++ )
+   {
+      if ( 0 == strcmp(argv[i], "-v") )
+         g_bVerbose = true;
+      else
+      {
+         printf("\ntest_telemetry_mavlink_downlink [-v]\n");
+         return -1;
+      }
+   }
+
+   log_init("TestTelemMAVDown");
+   if ( ! g_bVerbose )
+      log_disable();
+
+   // A vehicle with only a SiK radio link
+   s_Model.resetToDefaults(false);
+   s_Model.radioLinksParams.links_count = 1;
+   s_Model.radioLinksParams.link_capabilities_flags[0] = RADIO_HW_CAPABILITY_FLAG_CAN_RX | RADIO_HW_CAPABILITY_FLAG_CAN_TX | RADIO_HW_CAPABILITY_FLAG_CAN_USE_FOR_DATA;
+   s_Model.radioLinksParams.link_datarate_data_bps[0] = 57600;
+   s_Model.radioInterfacesParams.interfaces_count = 1;
+   s_Model.radioInterfacesParams.interface_link_id[0] = 0;
+   s_Model.radioInterfacesParams.interface_radiotype_and_driver[0] = RADIO_TYPE_SIK;
+   g_pCurrentModel = &s_Model;
+
+   _reset_downlink();
+   if ( ! telemetry_mavlink_downlink_is_enabled() )
+   {
+      printf("MAVLink downlink is not enabled for a vehicle with only a SiK radio link.\n");
+      return 1;
+   }
+
+   printf("\nMAVLink telemetry downlink test\n");
+   _test_priority();
+   _test_coalescing();
+   _test_budget();
+   _test_original_frames();
+
+   if ( 0 != s_iFailed )
+   {
+      printf("MAVLink telemetry downlink test FAILED: %d checks failed.\n", s_iFailed);
+      return 1;
+   }
+   printf("MAVLink telemetry downlink test passed.\n");
+   return 0;
+}
@@ -0,0 +1,313 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/models.h"
+#include "../base/ctrl_settings.h"
+#include "../base/controller_rt_info.h"
+#include "../radio/radiopackets2.h"
+#include "../radio/fec.h"
+#include "../r_station/video_rx_buffers.h"
+#include "video_rx_test_stream.h"
+
+#include <time.h>
+
+// Video rx buffer benchmark.
+// Replays a video packets stream (generated or from a dump file) through
+// VideoRxPacketsBuffer::checkAddVideoPacket, with random packets lost, outputs the
+// video packets the same way the video rx processor does and checks the output.
+// Runs once with the packets slab and once with separate packets allocations.
+
+// Station globals used by the video rx buffer
+u32 g_TimeNow = 0;
+u32 g_TimeStart = 0;
+u32 g_TimeLastVideoParametersOrProfileChanged = 0;
+ControllerSettings* g_pControllerSettings = NULL;
+controller_runtime_info g_SMControllerRTInfo;
+
+int g_iIterations = 20;
+int g_iLossPercent = 5;
+int g_iSeed = 1;
+bool g_bVerbose = false;
+
+u32* g_pPacketsTimes = NULL;
+
+typedef struct
+{
+   u32 uP50;
+   u32 uP90;
+   u32 uP99;
+   u32 uMax;
+   unsigned long long uTotal;
+} t_bench_percentiles;
+
+typedef struct
+{
+   int iCountOutput;
+   int iCountReconstructed;
+   int iCountMismatches;
+   int iCountOutOfOrder;
+   unsigned long long uOutputBytes;
+   u32 uLastBlockIndex;
+   int iLastPacketIndex;
+} t_bench_output;
+
+static unsigned long long _get_time_ns()
+{
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return (unsigned long long)t.tv_sec * 1000000000LL + (unsigned long long)t.tv_nsec;
+}
+
+static int _compare_u32(const void* p1, const void* p2)
+{
+   u32 u1 = *(const u32*)p1;
+   u32 u2 = *(const u32*)p2;
+   if ( u1 < u2 )
+      return -1;
+   if ( u1 > u2 )
+      return 1;
+   return 0;
+}
+
+static void _compute_percentiles(u32* pTimes, int iCount, t_bench_percentiles* pResult)
+{
+   memset(pResult, 0, sizeof(t_bench_percentiles));
+   if ( iCount <= 0 )
+      return;
+   for( int i=0; i<iCount; i++ )
+      pResult->uTotal += pTimes[i];
+   qsort(pTimes, iCount, sizeof(u32), _compare_u32);
+   pResult->uP50 = pTimes[(iCount*50)/100];
+   pResult->uP90 = pTimes[(iCount*90)/100];
+   pResult->uP99 = pTimes[(iCount*99)/100];
+   pResult->uMax = pTimes[iCount-1];
+}
+
+static void _output_packet(type_rx_video_packet_info* pVideoPacket, bool bCheckPayload, t_bench_output* pOutput)
+{
+   u32 uBlockIndex = pVideoPacket->pPHVS->uCurrentBlockIndex;
+   int iPacketIndex = pVideoPacket->pPHVS->uCurrentBlockPacketIndex;
+   u8* pVideoData = pVideoPacket->pVideoData + sizeof(t_packet_header_video_segment_important);
+   int iLength = pVideoPacket->pPHVSImp->uVideoDataLength;
+
+   if ( (uBlockIndex < pOutput->uLastBlockIndex) || ((uBlockIndex == pOutput->uLastBlockIndex) && (iPacketIndex <= pOutput->iLastPacketIndex)) )
+   {
+      pOutput->iCountOutOfOrder++;
+      if ( g_bVerbose )
+         printf("Out of order output: [%u/%d] after [%u/%d]\n", uBlockIndex, iPacketIndex, pOutput->uLastBlockIndex, pOutput->iLastPacketIndex);
+   }
+   pOutput->uLastBlockIndex = uBlockIndex;
+   pOutput->iLastPacketIndex = iPacketIndex;
+
+   if ( bCheckPayload && (! video_test_stream_check_payload(uBlockIndex, iPacketIndex, pVideoData, iLength)) )
+   {
+      pOutput->iCountMismatches++;
+      if ( g_bVerbose )
+         printf("Invalid output packet [%u/%d] (%d bytes, reconstructed: %s)\n", uBlockIndex, iPacketIndex, iLength, pVideoPacket->bReconstructed?"yes":"no");
+   }
+   pOutput->iCountOutput++;
+   if ( pVideoPacket->bReconstructed )
+      pOutput->iCountReconstructed++;
+   pOutput->uOutputBytes += iLength;
+}
+
+// Same as ProcessorRxVideo::outputAvailableVideoPackets, skipping incomplete blocks
+
+static void _output_available_packets(VideoRxPacketsBuffer* pBuffer, bool bCheckPayload, t_bench_output* pOutput)
+{
+   type_rx_video_block_info* pVideoBlock = NULL;
+   type_rx_video_packet_info* pVideoPacket = pBuffer->getFirstPacketInBuffer(&pVideoBlock);
+   type_rx_video_packet_info* pPrevVideoPacket = NULL;
+
+   while ( (NULL != pVideoPacket) && (pPrevVideoPacket != pVideoPacket) && (NULL != pVideoBlock) && (NULL != pVideoPacket->pRawData) )
+   {
+      if ( (! pVideoPacket->bEmpty) && (! pVideoPacket->bOutputed) )
+      {
+         _output_packet(pVideoPacket, bCheckPayload, pOutput);
+         pVideoPacket->bOutputed = true;
+      }
+      else if ( ! pVideoPacket->bOutputed )
+      {
+         // Block is still being reconstructed on the FEC worker threads
+         if ( -1 != pVideoBlock->iECDecodeJobIndex )
+            break;
+         if ( pBuffer->getBufferTopReceivedVideoBlockIndex() == pVideoBlock->uVideoBlockIndex )
+         {
+            int iLeftToReceiveInBlock = pVideoBlock->iBlockDataPackets + pVideoBlock->iBlockECPackets - pVideoBlock->iMaxReceivedDataOrECPacketIndex - 1;
+            if ( iLeftToReceiveInBlock >= (pVideoBlock->iBlockDataPackets - pVideoBlock->iRecvDataPackets - pVideoBlock->iRecvECPackets) )
+               break;
+         }
+      }
+      pBuffer->goToNextPacketInBuffer();
+      pPrevVideoPacket = pVideoPacket;
+      pVideoPacket = pBuffer->getFirstPacketInBuffer(&pVideoBlock);
+   }
+}
+
+// Returns the number of errors
+
+static int _bench_replay(type_video_test_stream* pStream, bool bSlab)
+{
+   if ( ! bSlab )
+      VideoRxPacketsBuffer::disableSlabAllocation();
+
+   Model model;
+   VideoRxPacketsBuffer* pBuffer = new VideoRxPacketsBuffer(0, 0);
+   pBuffer->init(&model);
+
+   t_bench_output output;
+   memset(&output, 0, sizeof(t_bench_output));
+   int iCountLost = 0;
+   int iCountTimes = 0;
+   int iCountAdded = 0;
+
+   // Same packets are lost on each run
+   srand(g_iSeed);
+
+   unsigned long long uTimeStart = _get_time_ns();
+   for( int iLoop=0; iLoop<g_iIterations; iLoop++ )
+   {
+      // The buffer can only add packets with increasing block indexes, so replay the stream once per buffer
+      if ( iLoop > 0 )
+      {
+         pBuffer->emptyBuffers("replay");
+         output.uLastBlockIndex = 0;
+         output.iLastPacketIndex = 0;
+      }
+      for( int i=0; i<pStream->iCountPackets; i++ )
+      {
+         int iLength = 0;
+         u8* pPacket = video_test_stream_get_packet(pStream, i, &iLength);
+         // Do not lose packets from the first block, the buffer waits for a block start
+         if ( (i >= MAX_TOTAL_PACKETS_IN_BLOCK) && ((rand() % 100) < g_iLossPercent) )
+         {
+            iCountLost++;
+            continue;
+         }
+         g_TimeNow = get_current_timestamp_ms();
+         unsigned long long uTime = _get_time_ns();
+         pBuffer->checkAddVideoPacket(pPacket, iLength);
+         pBuffer->checkCompletedECDecodes();
+         _output_available_packets(pBuffer, pStream->bGenerated, &output);
+         g_pPacketsTimes[iCountTimes++] = (u32)(_get_time_ns() - uTime);
+         iCountAdded++;
+      }
+      // Let the FEC worker threads finish the last blocks
+      unsigned long long uTimeWait = _get_time_ns();
+      while ( _get_time_ns() < uTimeWait + 20000000LL )
+      {
+         if ( 0 == pBuffer->checkCompletedECDecodes() )
+            hardware_sleep_micros(200);
+         _output_available_packets(pBuffer, pStream->bGenerated, &output);
+      }
+   }
+   unsigned long long uTimeTotal = _get_time_ns() - uTimeStart;
+
+   pBuffer->uninit();
+   delete pBuffer;
+
+   t_bench_percentiles perc;
+   _compute_percentiles(g_pPacketsTimes, iCountTimes, &perc);
+   printf("%-7s | %9.0f packets/s | add+output p50 %6.2f p90 %6.2f p99 %6.2f max %8.2f us | output %d packets (%d reconstructed), %.1f MB, lost %d | %s\n",
+      bSlab?"slab":"malloc",
+      (double)iCountAdded * 1000000000.0 / (double)perc.uTotal,
+      perc.uP50/1000.0, perc.uP90/1000.0, perc.uP99/1000.0, perc.uMax/1000.0,
+      output.iCountOutput, output.iCountReconstructed, (double)output.uOutputBytes/(1024.0*1024.0), iCountLost,
+      ((0 == output.iCountMismatches) && (0 == output.iCountOutOfOrder))?"OK":"FAILED");
+   if ( g_bVerbose )
+      printf("Total run time: %.1f ms\n", (double)uTimeTotal/1000000.0);
+   if ( 0 != output.iCountMismatches )
+      printf("%d output packets have invalid video data.\n", output.iCountMismatches);
+   if ( 0 != output.iCountOutOfOrder )
+      printf("%d output packets are out of order.\n", output.iCountOutOfOrder);
+   return output.iCountMismatches + output.iCountOutOfOrder;
+}
+
+int main(int argc, char *argv[])
+{
+   int iBlocks = 150;
+   int iDataPackets = MAX_DATA_PACKETS_IN_BLOCK/2;
+   int iECPackets = MAX_FECS_PACKETS_IN_BLOCK/4;
+   int iPacketSize = 1200;
+   bool bOnlyMalloc = false;
+   const char* szLoadFile = NULL;
+   const char* szSaveFile = NULL;
+
+   for( int i=1; i<argc; i++ )
+   {
+      if ( 0 == strcmp(argv[i], "-noslab") )
+         bOnlyMalloc = true;
+      else if ( 0 == strcmp(argv[i], "-v") )
+         g_bVerbose = true;
+      else if ( (0 == strcmp(argv[i], "-iterations")) && (i < argc-1) )
+         g_iIterations = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-blocks")) && (i < argc-1) )
+         iBlocks = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-scheme")) && (i < argc-2) )
+      {
+         iDataPackets = atoi(argv[++i]);
+         iECPackets = atoi(argv[++i]);
+      }
+      else if ( (0 == strcmp(argv[i], "-size")) && (i < argc-1) )
+         iPacketSize = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-loss")) && (i < argc-1) )
+         g_iLossPercent = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-file")) && (i < argc-1) )
+         szLoadFile = argv[++i];
+      else if ( (0 == strcmp(argv[i], "-save")) && (i < argc-1) )
+         szSaveFile = argv[++i];
+      else if ( (0 == strcmp(argv[i], "-seed")) && (i < argc-1) )
+         g_iSeed = atoi(argv[++i]);
+      else
+      {
+         printf("\ntest_video_rx_bench [-iterations n] [-blocks n] [-scheme data ec] [-size block_packet_bytes] [-loss percent] [-file dump] [-save dump] [-seed n] [-noslab] [-v]\n");
+         return -1;
+      }
+   }
+   if ( g_iIterations < 1 )
+      g_iIterations = 1;
+   if ( g_iIterations > 1000 )
+      g_iIterations = 1000;
+
+   log_init("TestVideoRxBench");
+   log_disable();
+   memset(&g_SMControllerRTInfo, 0, sizeof(controller_runtime_info));
+   g_TimeStart = get_current_timestamp_ms();
+   fec_init();
+
+   type_video_test_stream stream;
+   if ( NULL != szLoadFile )
+   {
+      if ( ! video_test_stream_load(&stream, szLoadFile) )
+      {
+         printf("Failed to load the video stream dump file %s\n", szLoadFile);
+         return -1;
+      }
+   }
+   else if ( ! video_test_stream_generate(&stream, iBlocks, iDataPackets, iECPackets, iPacketSize) )
+   {
+      printf("Invalid video stream parameters.\n");
+      return -1;
+   }
+   if ( (NULL != szSaveFile) && (! video_test_stream_save(&stream, szSaveFile)) )
+      printf("Failed to save the video stream to %s\n", szSaveFile);
+
+   printf("\nVideo rx buffer benchmark: %d packets (%s), %d replays, %d%% packets lost, %d blocks buffer, %d bytes slab stride\n\n",
+      stream.iCountPackets, (NULL != szLoadFile)?szLoadFile:"generated", g_iIterations, g_iLossPercent, MAX_RXTX_BLOCKS_BUFFER, VIDEO_RX_SLAB_PACKET_STRIDE);
+
+   g_pPacketsTimes = (u32*)malloc((size_t)stream.iCountPackets * (size_t)g_iIterations * sizeof(u32));
+   int iFailed = 0;
+   if ( ! bOnlyMalloc )
+      iFailed += _bench_replay(&stream, true);
+   iFailed += _bench_replay(&stream, false);
+
+   free(g_pPacketsTimes);
+   video_test_stream_free(&stream);
+
+   if ( 0 != iFailed )
+   {
+      printf("\nVideo rx buffer test FAILED.\n");
+      return 1;
+   }
+   printf("\nVideo rx buffer test passed.\n");
+   return 0;
+}
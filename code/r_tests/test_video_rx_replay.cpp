@@ -0,0 +1,540 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/models.h"
+#include "../base/models_list.h"
+#include "../base/ctrl_settings.h"
+#include "../base/latency_stats.h"
+#include "../radio/radiopackets2.h"
+#include "../radio/radiopacketsqueue.h"
+#include "../radio/fec.h"
+#include "../r_station/shared_vars.h"
+#include "../r_station/shared_vars_state.h"
+#include "../r_station/timers.h"
+#include "../r_station/processor_rx_video.h"
+#include "../r_station/rx_video_output.h"
+#include "video_rx_test_stream.h"
+
+#include <time.h>
+
+// Offline replay of the station video pipeline.
+// Feeds a radio capture (pcap), a packets dump or a generated stream, as fast as possible,
+// through ProcessorRxVideo::handleReceivedVideoPacket (video rx buffer, FEC, output), with
+// optional random or bursty packets loss, and reports the throughput and the per stage timings.
+// With -retr, retransmissions are enabled and the requested packets are sent back after a
+// simulated round trip; use -rate to replay on a simulated clock (packets per second) instead
+// of as fast as possible, so the round trip and the retransmission window are meaningful.
+
+// Station router globals the video pipeline uses and that live in the router main file
+t_packet_queue s_QueueRadioPacketsHighPrio;
+
+void send_alarm_to_central(u32 uAlarm, u32 uFlags1, u32 uFlags2)
+{
+}
+
+bool test_link_is_in_progress()
+{
+   return false;
+}
+
+int g_iIterations = 1;
+int g_iLossPercent = 0;
+int g_iLossBurst = 1;
+bool g_bVerbose = false;
+
+u32* g_pPacketsTimes = NULL;
+
+// Retransmitted packets waiting for their simulated round trip
+
+#define REPLAY_MAX_PENDING_RETRANSMISSIONS 2048
+
+typedef struct
+{
+   u32 uTimeDue;
+   int iStreamIndex;
+   u32 uRetransmissionId;
+} t_replay_pending_retransmission;
+
+t_replay_pending_retransmission g_PendingRetransmissions[REPLAY_MAX_PENDING_RETRANSMISSIONS];
+int g_iCountPendingRetransmissions = 0;
+u32 g_uSimulatedRTTMs = 20;
+
+typedef struct
+{
+   int iCountRequests;
+   int iCountPacketsRequested;
+   int iCountPacketsRequestedAgain;
+   int iCountPacketsNotFound;
+   int iCountPacketsResent;
+} t_replay_retransmissions_stats;
+
+t_replay_retransmissions_stats g_RetransmissionsStats;
+u8* g_pPacketsRequestCount = NULL;
+
+typedef struct
+{
+   u32 uP50;
+   u32 uP90;
+   u32 uP99;
+   u32 uMax;
+   unsigned long long uTotal;
+} t_replay_percentiles;
+
+static unsigned long long _get_time_ns()
+{
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return (unsigned long long)t.tv_sec * 1000000000LL + (unsigned long long)t.tv_nsec;
+}
+
+static int _compare_u32(const void* p1, const void* p2)
+{
+   u32 u1 = *(const u32*)p1;
+   u32 u2 = *(const u32*)p2;
+   if ( u1 < u2 )
+      return -1;
+   if ( u1 > u2 )
+      return 1;
+   return 0;
+}
+
+static void _compute_percentiles(u32* pTimes, int iCount, t_replay_percentiles* pResult)
+{
+   memset(pResult, 0, sizeof(t_replay_percentiles));
+   if ( iCount <= 0 )
+      return;
+   for( int i=0; i<iCount; i++ )
+      pResult->uTotal += pTimes[i];
+   qsort(pTimes, iCount, sizeof(u32), _compare_u32);
+   pResult->uP50 = pTimes[(iCount*50)/100];
+   pResult->uP90 = pTimes[(iCount*90)/100];
+   pResult->uP99 = pTimes[(iCount*99)/100];
+   pResult->uMax = pTimes[iCount-1];
+}
+
+static bool _is_video_data_packet(u8* pPacket, int iLength)
+{
+   if ( iLength < (int)(sizeof(t_packet_header) + sizeof(t_packet_header_video_segment)) )
+      return false;
+   t_packet_header* pPH = (t_packet_header*)pPacket;
+   if ( (pPH->packet_flags & PACKET_FLAGS_MASK_MODULE) != PACKET_COMPONENT_VIDEO )
+      return false;
+   return (pPH->packet_type == PACKET_TYPE_VIDEO_DATA);
+}
+
+// Video data the vehicle sent in the stream (data packets only)
+
+static unsigned long long _get_stream_video_bytes(type_video_test_stream* pStream)
+{
+   unsigned long long uBytes = 0;
+   for( int i=0; i<pStream->iCountPackets; i++ )
+   {
+      int iLength = 0;
+      u8* pPacket = video_test_stream_get_packet(pStream, i, &iLength);
+      if ( ! _is_video_data_packet(pPacket, iLength) )
+         continue;
+      t_packet_header_video_segment* pPHVS = (t_packet_header_video_segment*)(pPacket + sizeof(t_packet_header));
+      if ( pPHVS->uCurrentBlockPacketIndex >= pPHVS->uCurrentBlockDataPackets )
+         continue;
+      t_packet_header_video_segment_important* pPHVSImp = (t_packet_header_video_segment_important*)(pPacket + sizeof(t_packet_header) + sizeof(t_packet_header_video_segment));
+      uBytes += pPHVSImp->uVideoDataLength;
+   }
+   return uBytes;
+}
+
+// Finds the stream packet for a requested video block/packet, searching back from the current replay position
+
+static int _find_stream_packet(type_video_test_stream* pStream, int* pVideoPackets, int iCurrentPos, u32 uBlockIndex, int iPacketIndex)
+{
+   int iMinPos = iCurrentPos - MAX_RXTX_BLOCKS_BUFFER * MAX_TOTAL_PACKETS_IN_BLOCK;
+   if ( iMinPos < 0 )
+      iMinPos = 0;
+   for( int i=iCurrentPos; i>=iMinPos; i-- )
+   {
+      u8* pPacket = video_test_stream_get_packet(pStream, pVideoPackets[i], NULL);
+      t_packet_header_video_segment* pPHVS = (t_packet_header_video_segment*)(pPacket + sizeof(t_packet_header));
+      if ( (pPHVS->uCurrentBlockIndex == uBlockIndex) && ((int)pPHVS->uCurrentBlockPacketIndex == iPacketIndex) )
+         return i;
+   }
+   return -1;
+}
+
+// Takes the retransmission requests the video processor queued and schedules the answers
+
+static void _process_retransmission_requests(type_video_test_stream* pStream, int* pVideoPackets, int iCurrentPos)
+{
+   while ( packets_queue_has_packets(&s_QueueRadioPacketsHighPrio) )
+   {
+      int iLength = 0;
+      u8* pRequest = packets_queue_pop_packet(&s_QueueRadioPacketsHighPrio, &iLength);
+      if ( NULL == pRequest )
+         break;
+      t_packet_header* pPH = (t_packet_header*)pRequest;
+      if ( pPH->packet_type != PACKET_TYPE_VIDEO_REQ_MULTIPLE_PACKETS )
+         continue;
+      g_RetransmissionsStats.iCountRequests++;
+
+      u32 uRetransmissionId = 0;
+      memcpy(&uRetransmissionId, pRequest + sizeof(t_packet_header), sizeof(u32));
+      int iCount = pRequest[sizeof(t_packet_header) + sizeof(u32) + sizeof(u8)];
+      u8* pData = pRequest + sizeof(t_packet_header) + sizeof(u32) + 2*sizeof(u8);
+      for( int i=0; i<iCount; i++ )
+      {
+         u32 uBlockIndex = 0;
+         memcpy(&uBlockIndex, pData, sizeof(u32));
+         int iPacketIndex = pData[sizeof(u32)];
+         pData += sizeof(u32) + sizeof(u8);
+         g_RetransmissionsStats.iCountPacketsRequested++;
+
+         int iPos = _find_stream_packet(pStream, pVideoPackets, iCurrentPos, uBlockIndex, iPacketIndex);
+         if ( -1 == iPos )
+         {
+            g_RetransmissionsStats.iCountPacketsNotFound++;
+            continue;
+         }
+         if ( g_pPacketsRequestCount[iPos] > 0 )
+            g_RetransmissionsStats.iCountPacketsRequestedAgain++;
+         if ( g_pPacketsRequestCount[iPos] < 255 )
+            g_pPacketsRequestCount[iPos]++;
+         if ( g_iCountPendingRetransmissions >= REPLAY_MAX_PENDING_RETRANSMISSIONS )
+            continue;
+         g_PendingRetransmissions[g_iCountPendingRetransmissions].uTimeDue = g_TimeNow + g_uSimulatedRTTMs;
+         g_PendingRetransmissions[g_iCountPendingRetransmissions].iStreamIndex = pVideoPackets[iPos];
+         g_PendingRetransmissions[g_iCountPendingRetransmissions].uRetransmissionId = uRetransmissionId;
+         g_iCountPendingRetransmissions++;
+      }
+   }
+}
+
+// Sends to the video processor the retransmitted packets that are due, the same way the vehicle marks them
+
+static void _send_due_retransmissions(type_video_test_stream* pStream)
+{
+   u8 uPacket[MAX_PACKET_TOTAL_SIZE];
+   int i = 0;
+   while ( i < g_iCountPendingRetransmissions )
+   {
+      if ( g_PendingRetransmissions[i].uTimeDue > g_TimeNow )
+      {
+         i++;
+         continue;
+      }
+      int iLength = 0;
+      u8* pPacket = video_test_stream_get_packet(pStream, g_PendingRetransmissions[i].iStreamIndex, &iLength);
+      memcpy(uPacket, pPacket, iLength);
+      t_packet_header* pPH = (t_packet_header*)uPacket;
+      t_packet_header_video_segment* pPHVS = (t_packet_header_video_segment*)(uPacket + sizeof(t_packet_header));
+      pPH->packet_flags |= PACKET_FLAGS_BIT_RETRANSMITED;
+      pPHVS->uStreamInfoFlags = VIDEO_STREAM_INFO_FLAG_RETRANSMISSION_ID;
+      pPHVS->uStreamInfo = g_PendingRetransmissions[i].uRetransmissionId;
+      g_pVideoProcessorRxList[0]->handleReceivedVideoPacket(0, uPacket, iLength);
+      g_RetransmissionsStats.iCountPacketsResent++;
+
+      g_iCountPendingRetransmissions--;
+      g_PendingRetransmissions[i] = g_PendingRetransmissions[g_iCountPendingRetransmissions];
+   }
+}
+
+static void _print_stage(type_latency_stats* pStats, int iStage)
+{
+   type_latency_stage_histogram* pHist = &(pStats->stages[iStage]);
+   if ( 0 == pHist->uCount )
+   {
+      printf("%-14s | no samples\n", latency_stats_get_stage_name(iStage));
+      return;
+   }
+   printf("%-14s | %8u samples | avg %7.1f p50 %6u p99 %6u max %7u us\n",
+      latency_stats_get_stage_name(iStage), pHist->uCount,
+      (double)pHist->uSumMicros / (double)pHist->uCount,
+      latency_stats_get_percentile(pHist, 500), latency_stats_get_percentile(pHist, 990), pHist->uMaxMicros);
+}
+
+int main(int argc, char *argv[])
+{
+   int iBlocks = 300;
+   int iDataPackets = MAX_DATA_PACKETS_IN_BLOCK/2;
+   int iECPackets = MAX_FECS_PACKETS_IN_BLOCK/4;
+   int iPacketSize = 1200;
+   int iFECWorkers = 0;
+   int iSeed = 1;
+   int iSimulatedRate = 0;
+   bool bRetransmissions = false;
+   const char* szDumpFile = NULL;
+   const char* szPcapFile = NULL;
+   const char* szOutputFile = NULL;
+
+   for( int i=1; i<argc; i++ )
+   {
+      if ( 0 == strcmp(argv[i], "-v") )
+         g_bVerbose = true;
+      else if ( 0 == strcmp(argv[i], "-retr") )
+         bRetransmissions = true;
+      else if ( (0 == strcmp(argv[i], "-iterations")) && (i < argc-1) )
+         g_iIterations = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-blocks")) && (i < argc-1) )
+         iBlocks = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-scheme")) && (i < argc-2) )
+      {
+         iDataPackets = atoi(argv[++i]);
+         iECPackets = atoi(argv[++i]);
+      }
+      else if ( (0 == strcmp(argv[i], "-size")) && (i < argc-1) )
+         iPacketSize = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-loss")) && (i < argc-1) )
+         g_iLossPercent = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-burst")) && (i < argc-1) )
+         g_iLossBurst = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-rate")) && (i < argc-1) )
+         iSimulatedRate = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-rtt")) && (i < argc-1) )
+         g_uSimulatedRTTMs = (u32)atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-workers")) && (i < argc-1) )
+         iFECWorkers = atoi(argv[++i]);
+      else if ( (0 == strcmp(argv[i], "-file")) && (i < argc-1) )
+         szDumpFile = argv[++i];
+      else if ( (0 == strcmp(argv[i], "-pcap")) && (i < argc-1) )
+         szPcapFile = argv[++i];
+      else if ( (0 == strcmp(argv[i], "-out")) && (i < argc-1) )
+         szOutputFile = argv[++i];
+      else if ( (0 == strcmp(argv[i], "-seed")) && (i < argc-1) )
+         iSeed = atoi(argv[++i]);
+      else
+      {
+         printf("\ntest_video_rx_replay [-pcap capture | -file dump] [-blocks n] [-scheme data ec] [-size block_packet_bytes] [-iterations n] [-loss percent] [-burst packets] [-workers n] [-retr] [-rtt ms] [-rate packets_per_sec] [-out video_file] [-seed n] [-v]\n");
+         printf("   -loss: percent of the packets lost; -burst: lost packets come in bursts of this many packets\n");
+         printf("   -workers: FEC decode worker threads (-1: auto, 0: inline)\n");
+         printf("   -retr: enable retransmissions, answered after -rtt ms; -rate: simulated clock, packets per second\n");
+         return -1;
+      }
+   }
+   if ( g_iIterations < 1 )
+      g_iIterations = 1;
+   if ( g_iLossBurst < 1 )
+      g_iLossBurst = 1;
+
+   log_init("TestVideoRxReplay");
+   if ( ! g_bVerbose )
+      log_disable();
+   srand(iSeed);
+   fec_init();
+   g_TimeStart = get_current_timestamp_ms();
+   g_TimeNow = g_TimeStart;
+
+   // Use the controller settings from this box, if any, with the requested FEC workers
+
+   load_ControllerSettings();
+   ControllerSettings localSettings;
+   memset(&localSettings, 0, sizeof(ControllerSettings));
+   if ( NULL != get_ControllerSettings() )
+      memcpy(&localSettings, get_ControllerSettings(), sizeof(ControllerSettings));
+   else
+   {
+      localSettings.nRetryRetransmissionAfterTimeoutMS = DEFAULT_VIDEO_RETRANS_MINIMUM_RETRY_INTERVAL;
+      localSettings.nRequestRetransmissionsOnVideoSilenceMs = DEFAULT_VIDEO_RETRANS_REQUEST_ON_VIDEO_SILENCE_MS;
+   }
+   localSettings.iVideoRxFECWorkers = iFECWorkers;
+   localSettings.iDeveloperMode = 0;
+   g_pControllerSettings = &localSettings;
+
+   memset(&g_SMControllerRTInfo, 0, sizeof(controller_runtime_info));
+   latency_stats_init_local(LATENCY_STATS_PROCESS_ROUTER_STATION);
+
+   type_video_test_stream stream;
+   bool bLoaded = false;
+   if ( NULL != szPcapFile )
+      bLoaded = video_test_stream_load_pcap(&stream, szPcapFile);
+   else if ( NULL != szDumpFile )
+      bLoaded = video_test_stream_load(&stream, szDumpFile);
+   else
+      bLoaded = video_test_stream_generate(&stream, iBlocks, iDataPackets, iECPackets, iPacketSize);
+   if ( ! bLoaded )
+   {
+      printf("Failed to load or generate the video stream.\n");
+      return -1;
+   }
+
+   // Only the video data packets go to the video processor, from the first vehicle seen
+
+   int* pVideoPackets = (int*)malloc(sizeof(int) * (stream.iCountPackets + 1));
+   int iCountVideoPackets = 0;
+   u32 uVehicleId = 0;
+   for( int i=0; i<stream.iCountPackets; i++ )
+   {
+      int iLength = 0;
+      u8* pPacket = video_test_stream_get_packet(&stream, i, &iLength);
+      if ( ! _is_video_data_packet(pPacket, iLength) )
+         continue;
+      t_packet_header* pPH = (t_packet_header*)pPacket;
+      if ( 0 == uVehicleId )
+         uVehicleId = pPH->vehicle_id_src;
+      if ( pPH->vehicle_id_src == uVehicleId )
+         pVideoPackets[iCountVideoPackets++] = i;
+   }
+   if ( 0 == iCountVideoPackets )
+   {
+      printf("No video packets in the stream (%d packets).\n", stream.iCountPackets);
+      free(pVideoPackets);
+      video_test_stream_free(&stream);
+      return -1;
+   }
+
+   loadAllModels();
+   g_pCurrentModel = getCurrentModel();
+   g_pCurrentModel->uVehicleId = uVehicleId;
+   if ( bRetransmissions )
+   {
+      g_pCurrentModel->is_spectator = false;
+      for( int i=0; i<MAX_VIDEO_LINK_PROFILES; i++ )
+         g_pCurrentModel->video_link_profiles[i].uProfileEncodingFlags |= VIDEO_PROFILE_ENCODING_FLAG_ENABLE_RETRANSMISSIONS;
+   }
+
+   resetVehicleRuntimeInfo(0);
+   g_State.vehiclesRuntimeInfo[0].uVehicleId = uVehicleId;
+   g_State.vehiclesRuntimeInfo[0].bIsPairingDone = true;
+   g_State.vehiclesRuntimeInfo[0].bIsDoingRetransmissions = bRetransmissions;
+   g_State.vehiclesRuntimeInfo[0].bIsVehicleFastUplinkFromControllerLost = false;
+   g_State.vehiclesRuntimeInfo[0].uPairingRequestTime = 0;
+   packets_queue_init(&s_QueueRadioPacketsHighPrio);
+
+   // Retransmissions are requested only when the video is consumed by some output
+   if ( bRetransmissions && (NULL == szOutputFile) )
+      szOutputFile = "/dev/null";
+   if ( (NULL != szOutputFile) && (! rx_video_output_enable_file_output(szOutputFile)) )
+      printf("Failed to create the video output file %s\n", szOutputFile);
+
+   ProcessorRxVideo::oneTimeInit();
+   g_pVideoProcessorRxList[0] = new ProcessorRxVideo(uVehicleId, 0);
+   g_pVideoProcessorRxList[0]->init();
+
+   printf("\nVideo rx replay: %d video packets of %d packets (%s), VID %u, %d replays, %d%% packets lost in bursts of %d, FEC workers: %d, retransmissions: %s\n\n",
+      iCountVideoPackets, stream.iCountPackets,
+      (NULL != szPcapFile)?szPcapFile:((NULL != szDumpFile)?szDumpFile:"generated"),
+      uVehicleId, g_iIterations, g_iLossPercent, g_iLossBurst, iFECWorkers, bRetransmissions?"yes":"no");
+
+   g_pPacketsTimes = (u32*)malloc((size_t)iCountVideoPackets * (size_t)g_iIterations * sizeof(u32));
+   g_pPacketsRequestCount = (u8*)malloc(iCountVideoPackets);
+   memset(&g_RetransmissionsStats, 0, sizeof(g_RetransmissionsStats));
+   u32 uSimulatedTimeStart = g_TimeNow;
+   unsigned long long uSimulatedPackets = 0;
+   int iCountTimes = 0;
+   int iCountLost = 0;
+   int iLossBurstLeft = 0;
+
+   unsigned long long uTimeStart = _get_time_ns();
+   for( int iLoop=0; iLoop<g_iIterations; iLoop++ )
+   {
+      // Block indexes restart on each replay, as after a vehicle restart
+      if ( iLoop > 0 )
+         g_pVideoProcessorRxList[0]->resetStateOnVehicleRestart();
+      memset(g_pPacketsRequestCount, 0, iCountVideoPackets);
+      g_iCountPendingRetransmissions = 0;
+
+      for( int i=0; i<iCountVideoPackets; i++ )
+      {
+         int iLength = 0;
+         u8* pPacket = video_test_stream_get_packet(&stream, pVideoPackets[i], &iLength);
+         uSimulatedPackets++;
+
+         // Do not lose packets from the first block, the video buffer waits for a block start
+         if ( (0 == iLossBurstLeft) && (i >= MAX_TOTAL_PACKETS_IN_BLOCK) && (g_iLossPercent > 0) )
+         if ( (rand() % (100 * g_iLossBurst)) < g_iLossPercent )
+            iLossBurstLeft = g_iLossBurst;
+         if ( iLossBurstLeft > 0 )
+         {
+            iLossBurstLeft--;
+            iCountLost++;
+            continue;
+         }
+
+         u32 uTimeNow = get_current_timestamp_ms();
+         if ( iSimulatedRate > 0 )
+            uTimeNow = uSimulatedTimeStart + (u32)((uSimulatedPackets * 1000) / (unsigned long long)iSimulatedRate);
+         if ( uTimeNow != g_TimeNow )
+         {
+            g_TimeNow = uTimeNow;
+            // The vehicle link is up as far as the video processor is concerned
+            g_State.vehiclesRuntimeInfo[0].uLastTimeReceivedAckFromVehicle = g_TimeNow;
+            _send_due_retransmissions(&stream);
+            g_pVideoProcessorRxList[0]->periodicLoop(g_TimeNow, false);
+            _process_retransmission_requests(&stream, pVideoPackets, i-1);
+         }
+         unsigned long long uTime = _get_time_ns();
+         g_pVideoProcessorRxList[0]->handleReceivedVideoPacket(0, pPacket, iLength);
+         g_pPacketsTimes[iCountTimes++] = (u32)(_get_time_ns() - uTime);
+         _process_retransmission_requests(&stream, pVideoPackets, i);
+      }
+
+      // Let the FEC worker threads finish the last blocks
+      unsigned long long uTimeWait = _get_time_ns();
+      while ( _get_time_ns() < uTimeWait + 20000000LL )
+      {
+         hardware_sleep_micros(500);
+         if ( iSimulatedRate > 0 )
+            g_TimeNow++;
+         else
+            g_TimeNow = get_current_timestamp_ms();
+         g_State.vehiclesRuntimeInfo[0].uLastTimeReceivedAckFromVehicle = g_TimeNow;
+         _send_due_retransmissions(&stream);
+         g_pVideoProcessorRxList[0]->periodicLoop(g_TimeNow, false);
+         _process_retransmission_requests(&stream, pVideoPackets, iCountVideoPackets-1);
+      }
+   }
+   unsigned long long uTimeTotal = _get_time_ns() - uTimeStart;
+
+   u32 uOutputPackets = 0;
+   unsigned long long uOutputBytes = 0;
+   rx_video_output_get_output_counters(&uOutputPackets, &uOutputBytes);
+   rx_video_output_disable_file_output();
+
+   t_replay_percentiles perc;
+   _compute_percentiles(g_pPacketsTimes, iCountTimes, &perc);
+   type_latency_stats* pStats = latency_stats_get_current();
+
+   printf("Replayed %d packets (%d lost) in %.1f ms: %.0f packets/s (%.0f packets/s wall clock, with the final FEC waits)\n",
+      iCountTimes, iCountLost, (double)perc.uTotal/1000000.0,
+      (double)iCountTimes * 1000000000.0 / (double)perc.uTotal,
+      (double)iCountTimes * 1000000000.0 / (double)uTimeTotal);
+   printf("Per packet     | p50 %6.2f p90 %6.2f p99 %6.2f max %8.2f us\n",
+      perc.uP50/1000.0, perc.uP90/1000.0, perc.uP99/1000.0, perc.uMax/1000.0);
+   if ( NULL != pStats )
+   {
+      _print_stage(pStats, LATENCY_STAGE_FEC_DECODE);
+      _print_stage(pStats, LATENCY_STAGE_VIDEO_OUTPUT);
+   }
+   printf("Output: %u video packets, %.2f MB, blocks reconstructed: %u, blocks skipped: %u\n",
+      uOutputPackets, (double)uOutputBytes/(1024.0*1024.0),
+      (NULL != pStats)?pStats->stages[LATENCY_STAGE_FEC_DECODE].uCount:0,
+      g_SMControllerRTInfo.uTotalCountOutputSkippedBlocks);
+   if ( bRetransmissions )
+      printf("Retransmissions: %d requests, %d packets requested (%d requested again, %d not found), %d packets resent\n",
+         g_RetransmissionsStats.iCountRequests, g_RetransmissionsStats.iCountPacketsRequested,
+         g_RetransmissionsStats.iCountPacketsRequestedAgain, g_RetransmissionsStats.iCountPacketsNotFound,
+         g_RetransmissionsStats.iCountPacketsResent);
+
+   int iFailed = 0;
+   if ( stream.bGenerated && (0 == g_iLossPercent) )
+   {
+      unsigned long long uExpectedBytes = _get_stream_video_bytes(&stream) * (unsigned long long)g_iIterations;
+      if ( uExpectedBytes != uOutputBytes )
+      {
+         printf("Output %llu video bytes, expected %llu.\n", uOutputBytes, uExpectedBytes);
+         iFailed++;
+      }
+   }
+
+   g_pVideoProcessorRxList[0]->uninit();
+   delete g_pVideoProcessorRxList[0];
+   g_pVideoProcessorRxList[0] = NULL;
+   latency_stats_close();
+   free(g_pPacketsTimes);
+   free(g_pPacketsRequestCount);
+   free(pVideoPackets);
+   video_test_stream_free(&stream);
+
+   if ( 0 != iFailed )
+   {
+      printf("\nVideo rx replay test FAILED.\n");
+      return 1;
+   }
+   printf("\nVideo rx replay test passed.\n");
+   return 0;
+}
@@ -0,0 +1,132 @@
+/*
+    Ruby Licence
+    Copyright (c) 2025 Petru Soroaga
+    All rights reserved.
+
+    Redistribution and/or use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions and/or use of the source code (partially or complete) must retain
+        the above copyright notice, this list of conditions and the following disclaimer
+        in the documentation and/or other materials provided with the distribution.
+        * Redistributions in binary form (partially or complete) must reproduce
+        the above copyright notice, this list of conditions and the following disclaimer
+        in the documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permitted.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "upload_test_link.h"
+
+float upload_test_random()
+{
+   return (float)(rand() % 100000) / 100000.0;
+}
+
+void upload_test_link_init(type_upload_test_link* pLink, u32 uBytesPerSec, u32 uLatencyMs, float fLoss, bool bBurstLoss, u32 uMaxQueuedBytes)
+{
+   type_upload_test_packet* pPackets = pLink->pPackets;
+   memset(pLink, 0, sizeof(type_upload_test_link));
+   pLink->uBytesPerSec = uBytesPerSec;
+   pLink->uLatencyMs = uLatencyMs;
+   pLink->fLoss = fLoss;
+   pLink->bBurstLoss = bBurstLoss;
+   pLink->uMaxQueuedBytes = uMaxQueuedBytes;
+   if ( NULL == pPackets )
+      pPackets = (type_upload_test_packet*)malloc(UPLOAD_TEST_LINK_MAX_PACKETS * sizeof(type_upload_test_packet));
+   pLink->pPackets = pPackets;
+}
+
+void upload_test_link_free(type_upload_test_link* pLink)
+{
+   if ( NULL != pLink->pPackets )
+      free(pLink->pPackets);
+   pLink->pPackets = NULL;
+   pLink->iCount = 0;
+}
+
+type_upload_test_packet* upload_test_link_send(type_upload_test_link* pLink, int iType, int iLength, u32 uTimeNow)
+{
+   if ( pLink->uTimeLinkFree < uTimeNow )
+      pLink->uTimeLinkFree = uTimeNow;
+   u32 uQueuedBytes = ((pLink->uTimeLinkFree - uTimeNow) * pLink->uBytesPerSec) / 1000;
+   if ( uQueuedBytes > pLink->uMaxQueuedBytes )
+   {
+      pLink->uCountDropped++;
+      return NULL;
+   }
+   pLink->uTimeLinkFree += 1 + (iLength * 1000) / pLink->uBytesPerSec;
+
+   float fLoss = pLink->fLoss;
+   if ( pLink->bBurstLoss )
+   {
+      if ( pLink->bInBurst && (upload_test_random() < 0.1) )
+         pLink->bInBurst = false;
+      else if ( (! pLink->bInBurst) && (upload_test_random() < 0.02) )
+         pLink->bInBurst = true;
+      if ( pLink->bInBurst )
+         fLoss = 0.9;
+   }
+   if ( (upload_test_random() < fLoss) || (pLink->iCount >= UPLOAD_TEST_LINK_MAX_PACKETS) )
+   {
+      pLink->uCountDropped++;
+      return NULL;
+   }
+   type_upload_test_packet* pPacket = &pLink->pPackets[pLink->iCount];
+   pPacket->uDeliverTime = pLink->uTimeLinkFree + pLink->uLatencyMs;
+   pPacket->iType = iType;
+   pPacket->uIndex = 0;
+   pPacket->bFlag = false;
+   pPacket->iLength = 0;
+   pLink->iCount++;
+   return pPacket;
+}
+
+bool upload_test_link_receive(type_upload_test_link* pLink, u32 uTimeNow, type_upload_test_packet* pOutput)
+{
+   for( int i=0; i<pLink->iCount; i++ )
+   {
+      if ( pLink->pPackets[i].uDeliverTime > uTimeNow )
+         continue;
+      memcpy(pOutput, &pLink->pPackets[i], sizeof(type_upload_test_packet));
+      if ( i < pLink->iCount-1 )
+         memmove(&pLink->pPackets[i], &pLink->pPackets[i+1], (pLink->iCount-1-i) * sizeof(type_upload_test_packet));
+      pLink->iCount--;
+      return true;
+   }
+   return false;
+}
+
+bool upload_test_check_file(const char* szFile, u8* pFile, u32 uFileSize)
+{
+   FILE* fd = fopen(szFile, "rb");
+   if ( NULL == fd )
+      return false;
+   u8* pRead = (u8*)malloc(uFileSize+1);
+   int iRead = fread(pRead, 1, uFileSize+1, fd);
+   fclose(fd);
+   bool bOk = ((iRead == (int)uFileSize) && (0 == memcmp(pRead, pFile, uFileSize)));
+   free(pRead);
+   return bOk;
+}
+
+float upload_test_kb_per_sec(u32 uBytes, u32 uTimeMs)
+{
+   if ( 0 == uTimeMs )
+      return 0.0;
+   return ((float)uBytes / 1024.0) / ((float)uTimeMs / 1000.0);
+}
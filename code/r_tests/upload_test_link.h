@@ -0,0 +1,51 @@
+#pragma once
+
+#include "../base/base.h"
+#include "../base/config.h"
+
+// A simulated one way radio link, used by the upload tests (file upload, software upload):
+// bandwidth, latency, tx queue and random or burst packet loss.
+// A packet uses link airtime even when it is lost. Packets that do not fit in the tx queue are dropped.
+
+#define UPLOAD_TEST_LINK_MAX_PACKETS 4096
+#define UPLOAD_TEST_LINK_MAX_PACKET_SIZE 1200
+
+typedef struct
+{
+   u32 uDeliverTime;
+   int iType; // set by the test
+   u32 uIndex; // segment/block index
+   bool bFlag;
+   int iLength; // bytes used in uData
+   u8 uData[UPLOAD_TEST_LINK_MAX_PACKET_SIZE];
+} type_upload_test_packet;
+
+typedef struct
+{
+   u32 uBytesPerSec;
+   u32 uLatencyMs;
+   float fLoss;
+   bool bBurstLoss;
+   bool bInBurst;
+   u32 uMaxQueuedBytes;
+   u32 uTimeLinkFree;
+   type_upload_test_packet* pPackets;
+   int iCount;
+   u32 uCountDropped;
+} type_upload_test_link;
+
+float upload_test_random();
+
+// pLink must be zeroed before its first init (the packets buffer is reused by the next inits)
+void upload_test_link_init(type_upload_test_link* pLink, u32 uBytesPerSec, u32 uLatencyMs, float fLoss, bool bBurstLoss, u32 uMaxQueuedBytes);
+void upload_test_link_free(type_upload_test_link* pLink);
+
+// Returns the packet to fill in, or NULL if it was lost. iLength is the airtime length of the packet.
+type_upload_test_packet* upload_test_link_send(type_upload_test_link* pLink, int iType, int iLength, u32 uTimeNow);
+
+// Returns true and removes the first packet due at uTimeNow
+bool upload_test_link_receive(type_upload_test_link* pLink, u32 uTimeNow, type_upload_test_packet* pOutput);
+
+// Checks the received file against the uploaded one
+bool upload_test_check_file(const char* szFile, u8* pFile, u32 uFileSize);
+float upload_test_kb_per_sec(u32 uBytes, u32 uTimeMs);
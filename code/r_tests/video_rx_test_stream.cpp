@@ -0,0 +1,419 @@
+/*
+    Ruby Licence
+    Copyright (c) 2025 Petru Soroaga
+    All rights reserved.
+
+    Redistribution and/or use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions and/or use of the source code (partially or complete) must retain
+        the above copyright notice, this list of conditions and the following disclaimer
+        in the documentation and/or other materials provided with the distribution.
+        * Redistributions in binary form (partially or complete) must reproduce
+        the above copyright notice, this list of conditions and the following disclaimer
+        in the documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permitted.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "video_rx_test_stream.h"
+#include "../radio/fec.h"
+
+#define PCAP_LINKTYPE_IEEE802_11 105
+#define PCAP_LINKTYPE_IEEE802_11_RADIOTAP 127
+#define PCAP_IEEE_HEADER_LENGTH 24
+
+static u8 _get_payload_byte(u32 uBlockIndex, int iPacketIndex, int iOffset)
+{
+   return (u8)((uBlockIndex * 31) + (u32)(iPacketIndex * 7) + (u32)iOffset);
+}
+
+static int _get_video_data_length(u32 uBlockIndex, int iPacketIndex, int iMaxLength)
+{
+   int iLength = iMaxLength - (int)((uBlockIndex * 13 + (u32)iPacketIndex * 29) % 97);
+   if ( iLength < 1 )
+      iLength = 1;
+   return iLength;
+}
+
+static bool _video_test_stream_index_packets(type_video_test_stream* pStream)
+{
+   pStream->iCountPackets = 0;
+   int iPos = 0;
+   while ( iPos + (int)sizeof(u32) <= pStream->iDataSize )
+   {
+      u32 uLength = 0;
+      memcpy(&uLength, pStream->pData + iPos, sizeof(u32));
+      if ( (uLength < sizeof(t_packet_header)) || (uLength > MAX_PACKET_TOTAL_SIZE) || (iPos + (int)sizeof(u32) + (int)uLength > pStream->iDataSize) )
+      {
+         log_softerror_and_alarm("[VideoTestStream] Invalid packet length (%u) at offset %d.", uLength, iPos);
+         return false;
+      }
+      iPos += sizeof(u32) + uLength;
+      pStream->iCountPackets++;
+   }
+
+   pStream->pPacketsOffsets = (int*)malloc(sizeof(int) * (pStream->iCountPackets + 1));
+   if ( NULL == pStream->pPacketsOffsets )
+      return false;
+   iPos = 0;
+   for( int i=0; i<pStream->iCountPackets; i++ )
+   {
+      u32 uLength = 0;
+      memcpy(&uLength, pStream->pData + iPos, sizeof(u32));
+      pStream->pPacketsOffsets[i] = iPos + sizeof(u32);
+      iPos += sizeof(u32) + uLength;
+   }
+   return true;
+}
+
+bool video_test_stream_generate(type_video_test_stream* pStream, int iBlocks, int iDataPackets, int iECPackets, int iBlockPacketSize)
+{
+   if ( NULL == pStream )
+      return false;
+   memset(pStream, 0, sizeof(type_video_test_stream));
+
+   int iHeadersSize = sizeof(t_packet_header) + sizeof(t_packet_header_video_segment);
+   if ( iBlockPacketSize > MAX_PACKET_TOTAL_SIZE - iHeadersSize )
+      iBlockPacketSize = MAX_PACKET_TOTAL_SIZE - iHeadersSize;
+   if ( (iBlocks < 1) || (iDataPackets < 1) || (iECPackets < 0) ||
+        (iDataPackets + iECPackets > MAX_TOTAL_PACKETS_IN_BLOCK) ||
+        (iBlockPacketSize <= (int)sizeof(t_packet_header_video_segment_important)) )
+      return false;
+
+   int iMaxVideoDataLength = iBlockPacketSize - sizeof(t_packet_header_video_segment_important);
+   int iPacketsPerBlock = iDataPackets + iECPackets;
+   pStream->iDataSize = 0;
+   pStream->pData = (u8*)malloc(iBlocks * iPacketsPerBlock * (sizeof(u32) + MAX_PACKET_TOTAL_SIZE));
+   if ( NULL == pStream->pData )
+      return false;
+
+   u8 uPackets[MAX_TOTAL_PACKETS_IN_BLOCK][MAX_PACKET_TOTAL_SIZE];
+   u8* pDataPointers[MAX_TOTAL_PACKETS_IN_BLOCK];
+   u8* pECPointers[MAX_TOTAL_PACKETS_IN_BLOCK];
+   u32 uStreamPacketIndex = 0;
+   u16 uRadioLinkPacketIndex = 0;
+
+   for( int iBlock=0; iBlock<iBlocks; iBlock++ )
+   {
+      u32 uBlockIndex = (u32)iBlock + 1;
+      for( int k=0; k<iPacketsPerBlock; k++ )
+      {
+         u8* pPacket = uPackets[k];
+         memset(pPacket, 0, MAX_PACKET_TOTAL_SIZE);
+         t_packet_header* pPH = (t_packet_header*)pPacket;
+         t_packet_header_video_segment* pPHVS = (t_packet_header_video_segment*)(pPacket + sizeof(t_packet_header));
+         t_packet_header_video_segment_important* pPHVSImp = (t_packet_header_video_segment_important*)(pPacket + iHeadersSize);
+
+         radio_packet_init(pPH, PACKET_COMPONENT_VIDEO, PACKET_TYPE_VIDEO_DATA, STREAM_ID_VIDEO_1);
+         pPH->stream_packet_idx |= (uStreamPacketIndex++) & PACKET_FLAGS_MASK_STREAM_PACKET_IDX;
+         pPH->radio_link_packet_index = uRadioLinkPacketIndex++;
+         pPH->vehicle_id_src = 1;
+         pPH->vehicle_id_dest = 0;
+
+         pPHVS->uVideoStreamIndexAndType = (VIDEO_TYPE_H264 << 4);
+         pPHVS->uCurrentBlockIndex = uBlockIndex;
+         pPHVS->uCurrentBlockPacketIndex = k;
+         pPHVS->uCurrentBlockPacketSize = iBlockPacketSize;
+         pPHVS->uCurrentBlockDataPackets = iDataPackets;
+         pPHVS->uCurrentBlockECPackets = iECPackets;
+         pPHVS->uH264FrameIndex = (u16)(iBlock/2);
+         pPHVS->uH264NALIndex = (u16)(iBlock/2);
+         pDataPointers[k] = pPacket + iHeadersSize;
+
+         if ( k >= iDataPackets )
+         {
+            pECPointers[k-iDataPackets] = pPacket + iHeadersSize;
+            pPH->total_length = iHeadersSize + iBlockPacketSize;
+            continue;
+         }
+         int iLength = _get_video_data_length(uBlockIndex, k, iMaxVideoDataLength);
+         pPHVSImp->uVideoDataLength = iLength;
+         if ( k == iDataPackets-1 )
+            pPHVSImp->uFrameAndNALFlags = VIDEO_PACKET_FLAGS_IS_END_OF_TRANSMISSION_FRAME;
+         u8* pVideoData = pPacket + iHeadersSize + sizeof(t_packet_header_video_segment_important);
+         for( int i=0; i<iLength; i++ )
+            pVideoData[i] = _get_payload_byte(uBlockIndex, k, i);
+         pPH->total_length = iHeadersSize + sizeof(t_packet_header_video_segment_important) + iLength;
+      }
+
+      if ( iECPackets > 0 )
+         fec_encode(iBlockPacketSize, pDataPointers, iDataPackets, pECPointers, iECPackets);
+
+      for( int k=0; k<iPacketsPerBlock; k++ )
+      {
+         t_packet_header* pPH = (t_packet_header*)uPackets[k];
+         radio_packet_compute_crc(uPackets[k], pPH->total_length);
+         u32 uLength = pPH->total_length;
+         memcpy(pStream->pData + pStream->iDataSize, &uLength, sizeof(u32));
+         memcpy(pStream->pData + pStream->iDataSize + sizeof(u32), uPackets[k], uLength);
+         pStream->iDataSize += sizeof(u32) + uLength;
+      }
+   }
+
+   pStream->bGenerated = true;
+   if ( ! _video_test_stream_index_packets(pStream) )
+   {
+      video_test_stream_free(pStream);
+      return false;
+   }
+   return true;
+}
+
+bool video_test_stream_load(type_video_test_stream* pStream, const char* szFile)
+{
+   if ( (NULL == pStream) || (NULL == szFile) )
+      return false;
+   memset(pStream, 0, sizeof(type_video_test_stream));
+
+   FILE* fd = fopen(szFile, "rb");
+   if ( NULL == fd )
+   {
+      log_softerror_and_alarm("[VideoTestStream] Failed to open dump file (%s).", szFile);
+      return false;
+   }
+   fseek(fd, 0, SEEK_END);
+   long lSize = ftell(fd);
+   fseek(fd, 0, SEEK_SET);
+   if ( lSize <= 0 )
+   {
+      fclose(fd);
+      return false;
+   }
+   pStream->pData = (u8*)malloc(lSize);
+   if ( (NULL == pStream->pData) || (1 != fread(pStream->pData, lSize, 1, fd)) )
+   {
+      fclose(fd);
+      video_test_stream_free(pStream);
+      return false;
+   }
+   fclose(fd);
+   pStream->iDataSize = (int)lSize;
+
+   if ( ! _video_test_stream_index_packets(pStream) )
+   {
+      video_test_stream_free(pStream);
+      return false;
+   }
+
+   // Generated streams can be checked; find a data packet and check it
+   for( int i=0; i<pStream->iCountPackets; i++ )
+   {
+      int iLength = 0;
+      u8* pPacket = video_test_stream_get_packet(pStream, i, &iLength);
+      if ( iLength < (int)(sizeof(t_packet_header) + sizeof(t_packet_header_video_segment) + sizeof(t_packet_header_video_segment_important)) )
+         continue;
+      t_packet_header_video_segment* pPHVS = (t_packet_header_video_segment*)(pPacket + sizeof(t_packet_header));
+      if ( pPHVS->uCurrentBlockPacketIndex >= pPHVS->uCurrentBlockDataPackets )
+         continue;
+      t_packet_header_video_segment_important* pPHVSImp = (t_packet_header_video_segment_important*)(pPacket + sizeof(t_packet_header) + sizeof(t_packet_header_video_segment));
+      u8* pVideoData = (u8*)pPHVSImp + sizeof(t_packet_header_video_segment_important);
+      pStream->bGenerated = video_test_stream_check_payload(pPHVS->uCurrentBlockIndex, pPHVS->uCurrentBlockPacketIndex, pVideoData, pPHVSImp->uVideoDataLength);
+      break;
+   }
+   log_line("[VideoTestStream] Loaded %d packets from dump file (%s), generated stream: %s", pStream->iCountPackets, szFile, pStream->bGenerated?"yes":"no");
+   return true;
+}
+
+static u32 _pcap_u32(u8* pData, bool bSwapped)
+{
+   u32 uValue = 0;
+   memcpy(&uValue, pData, sizeof(u32));
+   if ( bSwapped )
+      uValue = ((uValue & 0xFF) << 24) | ((uValue & 0xFF00) << 8) | ((uValue >> 8) & 0xFF00) | (uValue >> 24);
+   return uValue;
+}
+
+// Appends all the Ruby packets from a captured radio frame (the packets are chained
+// in the frame, each one sized by its header total_length). Returns the packets added.
+
+static int _video_test_stream_add_radio_frame(type_video_test_stream* pStream, u8* pFrame, int iFrameLength, int* piSkippedPackets)
+{
+   int iAdded = 0;
+   while ( iFrameLength >= (int)sizeof(t_packet_header) )
+   {
+      t_packet_header* pPH = (t_packet_header*)pFrame;
+      int iLength = pPH->total_length;
+      if ( (iLength < (int)sizeof(t_packet_header)) || (iLength > iFrameLength) || (iLength > MAX_PACKET_TOTAL_SIZE) )
+         break;
+      // Same CRC check as the radio link does on receive
+      u32 uCRC = 0;
+      if ( pPH->packet_flags & PACKET_FLAGS_BIT_HEADERS_ONLY_CRC )
+         uCRC = base_compute_crc32(pFrame + sizeof(u32), sizeof(t_packet_header) - sizeof(u32));
+      else
+         uCRC = base_compute_crc32(pFrame + sizeof(u32), iLength - sizeof(u32));
+      if ( (pPH->packet_flags & PACKET_FLAGS_BIT_HAS_ENCRYPTION) || ((uCRC & 0x00FFFFFF) != (pPH->uCRC & 0x00FFFFFF)) )
+         (*piSkippedPackets)++;
+      else
+      {
+         u32 uLength = (u32)iLength;
+         memcpy(pStream->pData + pStream->iDataSize, &uLength, sizeof(u32));
+         memcpy(pStream->pData + pStream->iDataSize + sizeof(u32), pFrame, iLength);
+         pStream->iDataSize += sizeof(u32) + iLength;
+         iAdded++;
+      }
+      pFrame += iLength;
+      iFrameLength -= iLength;
+   }
+   return iAdded;
+}
+
+bool video_test_stream_load_pcap(type_video_test_stream* pStream, const char* szFile)
+{
+   if ( (NULL == pStream) || (NULL == szFile) )
+      return false;
+   memset(pStream, 0, sizeof(type_video_test_stream));
+
+   FILE* fd = fopen(szFile, "rb");
+   if ( NULL == fd )
+   {
+      log_softerror_and_alarm("[VideoTestStream] Failed to open capture file (%s).", szFile);
+      return false;
+   }
+   fseek(fd, 0, SEEK_END);
+   long lSize = ftell(fd);
+   fseek(fd, 0, SEEK_SET);
+   u8* pFile = NULL;
+   if ( lSize > 24 )
+      pFile = (u8*)malloc(lSize);
+   if ( (NULL == pFile) || (1 != fread(pFile, lSize, 1, fd)) )
+   {
+      fclose(fd);
+      if ( NULL != pFile )
+         free(pFile);
+      log_softerror_and_alarm("[VideoTestStream] Failed to read capture file (%s).", szFile);
+      return false;
+   }
+   fclose(fd);
+
+   // Microseconds or nanoseconds pcap, any byte order
+
+   u32 uMagic = _pcap_u32(pFile, false);
+   bool bSwapped = false;
+   if ( (uMagic == 0xd4c3b2a1) || (uMagic == 0x4d3cb2a1) )
+      bSwapped = true;
+   else if ( (uMagic != 0xa1b2c3d4) && (uMagic != 0xa1b23c4d) )
+   {
+      free(pFile);
+      log_softerror_and_alarm("[VideoTestStream] Capture file (%s) is not a pcap file (magic: %08X).", szFile, uMagic);
+      return false;
+   }
+   u32 uLinkType = _pcap_u32(pFile + 20, bSwapped) & 0xFFFF;
+   if ( (uLinkType != PCAP_LINKTYPE_IEEE802_11_RADIOTAP) && (uLinkType != PCAP_LINKTYPE_IEEE802_11) )
+   {
+      free(pFile);
+      log_softerror_and_alarm("[VideoTestStream] Unsupported pcap link type: %u", uLinkType);
+      return false;
+   }
+
+   // The Ruby packets are never bigger than the captured frames
+   pStream->pData = (u8*)malloc(lSize);
+   if ( NULL == pStream->pData )
+   {
+      free(pFile);
+      return false;
+   }
+
+   int iFrames = 0;
+   int iSkippedPackets = 0;
+   long lPos = 24;
+   while ( lPos + 16 <= lSize )
+   {
+      u32 uCapturedLength = _pcap_u32(pFile + lPos + 8, bSwapped);
+      lPos += 16;
+      if ( (long)uCapturedLength > lSize - lPos )
+         break;
+      u8* pFrame = pFile + lPos;
+      int iFrameLength = (int)uCapturedLength;
+      lPos += uCapturedLength;
+      iFrames++;
+
+      if ( uLinkType == PCAP_LINKTYPE_IEEE802_11_RADIOTAP )
+      {
+         if ( iFrameLength < 4 )
+            continue;
+         int iRadiotapLength = pFrame[2] | (((int)pFrame[3]) << 8);
+         pFrame += iRadiotapLength;
+         iFrameLength -= iRadiotapLength;
+      }
+      // A trailing FCS, if present, is smaller than a packet header and gets ignored
+      if ( iFrameLength <= PCAP_IEEE_HEADER_LENGTH )
+         continue;
+      _video_test_stream_add_radio_frame(pStream, pFrame + PCAP_IEEE_HEADER_LENGTH, iFrameLength - PCAP_IEEE_HEADER_LENGTH, &iSkippedPackets);
+   }
+   free(pFile);
+
+   if ( ! _video_test_stream_index_packets(pStream) )
+   {
+      video_test_stream_free(pStream);
+      return false;
+   }
+   log_line("[VideoTestStream] Loaded %d packets from %d captured frames (%s), skipped %d encrypted or invalid packets.",
+      pStream->iCountPackets, iFrames, szFile, iSkippedPackets);
+   return true;
+}
+
+bool video_test_stream_save(type_video_test_stream* pStream, const char* szFile)
+{
+   if ( (NULL == pStream) || (NULL == pStream->pData) || (NULL == szFile) )
+      return false;
+
+   FILE* fd = fopen(szFile, "wb");
+   if ( NULL == fd )
+   {
+      log_softerror_and_alarm("[VideoTestStream] Failed to create dump file (%s).", szFile);
+      return false;
+   }
+   bool bOk = (1 == fwrite(pStream->pData, pStream->iDataSize, 1, fd));
+   fclose(fd);
+   return bOk;
+}
+
+void video_test_stream_free(type_video_test_stream* pStream)
+{
+   if ( NULL == pStream )
+      return;
+   if ( NULL != pStream->pData )
+      free(pStream->pData);
+   if ( NULL != pStream->pPacketsOffsets )
+      free(pStream->pPacketsOffsets);
+   memset(pStream, 0, sizeof(type_video_test_stream));
+}
+
+u8* video_test_stream_get_packet(type_video_test_stream* pStream, int iIndex, int* piLength)
+{
+   if ( (NULL == pStream) || (iIndex < 0) || (iIndex >= pStream->iCountPackets) )
+      return NULL;
+   u8* pPacket = pStream->pData + pStream->pPacketsOffsets[iIndex];
+   if ( NULL != piLength )
+   {
+      u32 uLength = 0;
+      memcpy(&uLength, pPacket - sizeof(u32), sizeof(u32));
+      *piLength = (int)uLength;
+   }
+   return pPacket;
+}
+
+bool video_test_stream_check_payload(u32 uBlockIndex, int iPacketIndex, u8* pVideoData, int iVideoDataLength)
+{
+   if ( (NULL == pVideoData) || (iVideoDataLength < 1) )
+      return false;
+   for( int i=0; i<iVideoDataLength; i++ )
+      if ( pVideoData[i] != _get_payload_byte(uBlockIndex, iPacketIndex, i) )
+         return false;
+   return true;
+}
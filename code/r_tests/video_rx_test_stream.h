@@ -0,0 +1,32 @@
+#pragma once
+
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../radio/radiopackets2.h"
+
+// A stream of received video radio packets, used by the video rx tests and benchmarks.
+// Either generated (the same way the vehicle builds the video blocks: data packets, then
+// the EC packets of the block) or loaded from a dump file.
+// Dump file format: for each packet: [u32 packet length][packet bytes]
+// Radio captures (pcap, radiotap or plain 802.11 link type) can be loaded too.
+
+typedef struct
+{
+   u8* pData; // all the packets, in the dump file format
+   int iDataSize;
+   int* pPacketsOffsets; // offset of each packet in pData
+   int iCountPackets;
+   bool bGenerated; // payloads can be checked using video_test_stream_check_payload
+}
+type_video_test_stream;
+
+bool video_test_stream_generate(type_video_test_stream* pStream, int iBlocks, int iDataPackets, int iECPackets, int iBlockPacketSize);
+bool video_test_stream_load(type_video_test_stream* pStream, const char* szFile);
+bool video_test_stream_load_pcap(type_video_test_stream* pStream, const char* szFile);
+bool video_test_stream_save(type_video_test_stream* pStream, const char* szFile);
+void video_test_stream_free(type_video_test_stream* pStream);
+
+u8* video_test_stream_get_packet(type_video_test_stream* pStream, int iIndex, int* piLength);
+
+// Checks the video data of an output data packet against the generated one
+bool video_test_stream_check_payload(u32 uBlockIndex, int iPacketIndex, u8* pVideoData, int iVideoDataLength);
@@ -0,0 +1,161 @@
+/*
+    Ruby Licence
+    Copyright (c) 2025 Petru Soroaga
+    All rights reserved.
+
+    Redistribution and/or use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions and/or use of the source code (partially or complete) must retain
+        the above copyright notice, this list of conditions and the following disclaimer
+        in the documentation and/or other materials provided with the distribution.
+        * Redistributions in binary form (partially or complete) must reproduce
+        the above copyright notice, this list of conditions and the following disclaimer
+        in the documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permitted.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <signal.h>
+#include <string.h>
+
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/latency_stats.h"
+
+// Prints the per stage latency histograms published by the station or vehicle router (or the vehicle telemetry process).
+// In watch mode, prints the percentiles for each interval (delta between two snapshots).
+
+bool gbQuit = false;
+bool g_bShowBuckets = false;
+
+void handle_sigint(int sig) 
+{ 
+   gbQuit = true;
+}
+
+void _print_header()
+{
+   printf("%-14s %10s %8s %8s %8s %8s %8s %8s %8s %9s\n", "Stage", "Count", "Avg", "Min", "p50", "p90", "p99", "p99.9", "Max", "(micros)");
+}
+
+void _print_stage(int iStage, type_latency_stage_histogram* pHistogram)
+{
+   u32 uAvg = 0;
+   if ( pHistogram->uCount > 0 )
+      uAvg = (u32)(pHistogram->uSumMicros / pHistogram->uCount);
+   printf("%-14s %10u %8u %8u %8u %8u %8u %8u %8u\n", latency_stats_get_stage_name(iStage),
+      pHistogram->uCount, uAvg, pHistogram->uMinMicros,
+      latency_stats_get_percentile(pHistogram, 500),
+      latency_stats_get_percentile(pHistogram, 900),
+      latency_stats_get_percentile(pHistogram, 990),
+      latency_stats_get_percentile(pHistogram, 999),
+      pHistogram->uMaxMicros);
+
+   if ( ! g_bShowBuckets )
+      return;
+   for( int i=0; i<LATENCY_HISTOGRAM_BUCKETS; i++ )
+   {
+      if ( 0 == pHistogram->uBuckets[i] )
+         continue;
+      u32 uLow = (i > 0)?(latency_stats_get_bucket_max_value(i-1)+1):0;
+      printf("      %8u - %8u us: %u\n", uLow, latency_stats_get_bucket_max_value(i), pHistogram->uBuckets[i]);
+   }
+}
+
+int main(int argc, char *argv[])
+{
+   signal(SIGINT, handle_sigint);
+   signal(SIGTERM, handle_sigint);
+   signal(SIGQUIT, handle_sigint);
+
+   int iProcessType = LATENCY_STATS_PROCESS_ROUTER_STATION;
+   #ifdef HW_PLATFORM_OPENIPC_CAMERA
+   iProcessType = LATENCY_STATS_PROCESS_ROUTER_VEHICLE;
+   #endif
+   int iWatchSeconds = 0;
+
+   for( int i=1; i<argc; i++ )
+   {
+      if ( 0 == strcmp(argv[i], "-station") )
+         iProcessType = LATENCY_STATS_PROCESS_ROUTER_STATION;
+      else if ( 0 == strcmp(argv[i], "-vehicle") )
+         iProcessType = LATENCY_STATS_PROCESS_ROUTER_VEHICLE;
+      else if ( 0 == strcmp(argv[i], "-telemetry") )
+         iProcessType = LATENCY_STATS_PROCESS_TELEMETRY_VEHICLE;
+      else if ( 0 == strcmp(argv[i], "-buckets") )
+         g_bShowBuckets = true;
+      else if ( (0 == strcmp(argv[i], "-watch")) && (i < argc-1) )
+         iWatchSeconds = atoi(argv[++i]);
+      else
+      {
+         printf("\nruby_latency_stats [-station|-vehicle|-telemetry] [-watch seconds] [-buckets]\n");
+         return -1;
+      }
+   }
+
+   const char* szProcess = "station router";
+   if ( iProcessType == LATENCY_STATS_PROCESS_ROUTER_VEHICLE )
+      szProcess = "vehicle router";
+   if ( iProcessType == LATENCY_STATS_PROCESS_TELEMETRY_VEHICLE )
+      szProcess = "vehicle telemetry";
+
+   type_latency_stats* pStats = latency_stats_open_for_read(iProcessType);
+   if ( NULL == pStats )
+   {
+      printf("The %s is not running or has no latency stats.\n", szProcess);
+      return -1;
+   }
+
+   printf("Latency stats for %s (PID %u), running for %u seconds.\n",
+      szProcess, pStats->uProcessId, (u32)time(NULL) - pStats->uTimeStartSeconds);
+
+   type_latency_stage_histogram* pSnapshot = (type_latency_stage_histogram*) malloc(LATENCY_STAGES_COUNT * sizeof(type_latency_stage_histogram));
+   type_latency_stage_histogram histogramDelta;
+   memcpy(pSnapshot, pStats->stages, LATENCY_STAGES_COUNT * sizeof(type_latency_stage_histogram));
+
+   if ( iWatchSeconds <= 0 )
+   {
+      _print_header();
+      for( int i=0; i<LATENCY_STAGES_COUNT; i++ )
+         _print_stage(i, &pSnapshot[i]);
+   }
+
+   while ( (iWatchSeconds > 0) && (! gbQuit) )
+   {
+      for( int i=0; (i<iWatchSeconds*10) && (! gbQuit); i++ )
+         hardware_sleep_ms(100);
+      if ( gbQuit )
+         break;
+
+      printf("\nLast %d seconds:\n", iWatchSeconds);
+      _print_header();
+      for( int i=0; i<LATENCY_STAGES_COUNT; i++ )
+      {
+         latency_stats_compute_delta(&pStats->stages[i], &pSnapshot[i], &histogramDelta);
+         memcpy(&pSnapshot[i], &pStats->stages[i], sizeof(type_latency_stage_histogram));
+         _print_stage(i, &histogramDelta);
+      }
+   }
+
+   free(pSnapshot);
+   latency_stats_close_read(pStats);
+   return 0;
+}
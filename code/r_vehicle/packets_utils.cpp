@@ -48,6 +48,7 @@
 #include "../radio/radiopackets2.h"
 #include "../radio/radiolink.h"
 #include "../radio/radio_tx.h"
+#include "../radio/radio_tx_batch.h"
 
 u8 s_RadioRawPacket[MAX_PACKET_TOTAL_SIZE];
 
@@ -57,6 +58,22 @@ int s_VideoAdaptiveTxDatarateBPS = 0; // Positive: bps, negative (-1 or less): M
 int s_LastTxDataRatesVideo[MAX_RADIO_INTERFACES];
 int s_LastTxDataRatesData[MAX_RADIO_INTERFACES];
 
+// Radio stats of the packets queued in a radio tx batch, updated when the batch is sent.
+// At most RADIO_TX_BATCH_MAX_PACKETS packets are queued on each interface, so the ring never overwrites a pending entry.
+typedef struct
+{
+   int iLocalRadioLinkId;
+   int iPacketLength;
+   int iDataRate;
+   int iStreamId;
+   u8  uPacketType;
+   bool bIsVideoPacket;
+   bool bIsAudioPacket;
+} type_radio_tx_pending_stats;
+
+type_radio_tx_pending_stats s_RadioTxPendingStats[MAX_RADIO_INTERFACES * RADIO_TX_BATCH_MAX_PACKETS];
+int s_iRadioTxPendingStatsIndex = 0;
+
 u32 s_VehicleLogSegmentIndex = 0;
 
 
@@ -77,8 +94,34 @@ int s_AlarmsPendingInQueue = 0;
 u32 s_uAlarmsIndex = 0;
 u32 s_uTimeLastAlarmSentToRouter = 0;
 
+void _update_radio_tx_stats(int iRadioInterfaceIndex, type_radio_tx_pending_stats* pStats, u32 uTxTimeMicros)
+{
+   g_RadioTxTimers.aTmpInterfacesTxTotalTimeMicros[iRadioInterfaceIndex] += uTxTimeMicros;
+   if ( pStats->bIsVideoPacket )
+      g_RadioTxTimers.aTmpInterfacesTxVideoTimeMicros[iRadioInterfaceIndex] += uTxTimeMicros;
+   radio_stats_update_on_packet_sent_on_radio_interface(&g_SM_RadioStats, g_TimeNow, iRadioInterfaceIndex, pStats->iPacketLength);
+   radio_stats_set_tx_radio_datarate_for_packet(&g_SM_RadioStats, iRadioInterfaceIndex, pStats->iLocalRadioLinkId, pStats->iDataRate, (pStats->bIsVideoPacket || pStats->bIsAudioPacket)?1:0);
+
+   radio_stats_update_on_packet_sent_on_radio_link(&g_SM_RadioStats, g_TimeNow, pStats->iLocalRadioLinkId, pStats->iStreamId, pStats->iPacketLength);
+}
+
+void _on_radio_tx_batch_result(int iInterfaceIndex, void* pContext, int iSent, u32 uTxTimeMicros)
+{
+   type_radio_tx_pending_stats* pStats = (type_radio_tx_pending_stats*)pContext;
+   if ( NULL == pStats )
+      return;
+   if ( iSent )
+   {
+      _update_radio_tx_stats(iInterfaceIndex, pStats, uTxTimeMicros);
+      return;
+   }
+   log_softerror_and_alarm("Failed to write batched packet to radio interface %d (type %s, size: %d bytes)",
+      iInterfaceIndex+1, str_get_packet_type(pStats->uPacketType), pStats->iPacketLength);
+}
+
 void packet_utils_init()
 {
+   radio_tx_batch_set_result_callback(_on_radio_tx_batch_result);
    for( int i=0; i<MAX_RADIO_STREAMS; i++ )
       s_StreamsTxPacketIndex[i] = 0;
    for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
@@ -266,7 +309,7 @@ bool _send_packet_to_serial_radio_interface(int iLocalRadioLinkId, int iRadioInt
    if ( ! radio_can_send_packet_on_slow_link(iLocalRadioLinkId, pPH->packet_type, 0, g_TimeNow) )
       return false;
 
-   if ( pPH->total_length > 200 )
+   if ( pPH->total_length > RADIO_SLOW_LINK_MAX_PACKET_LENGTH )
       return false;
 
    if ( iAirRate > 0 )
@@ -323,7 +366,7 @@ bool _send_packet_to_serial_radio_interface(int iLocalRadioLinkId, int iRadioInt
    return false;
 }
 
-bool _send_packet_to_wifi_radio_interface(int iLocalRadioLinkId, int iRadioInterfaceIndex, u8* pPacketData, int nPacketLength)
+bool _send_packet_to_wifi_radio_interface(int iLocalRadioLinkId, int iRadioInterfaceIndex, u8* pPacketData, int nPacketLength, bool bHasRadioHeadroom)
 {
    if ( (NULL == pPacketData) || (nPacketLength <= 0) || (NULL == g_pCurrentModel) )
       return false;
@@ -408,7 +451,19 @@ bool _send_packet_to_wifi_radio_interface(int iLocalRadioLinkId, int iRadioInter
    }
   */ 
 
-   int totalLength = radio_build_new_raw_ieee_packet(iLocalRadioLinkId, s_RadioRawPacket, pPacketData, nPacketLength, RADIO_PORT_ROUTER_DOWNLINK, be);
+   // Build the radio headers in front of the packet if there is room for them, instead of copying the packet.
+   // The packet can still be queued for another radio interface: send that one first, as the headers are rebuilt.
+   u8* pRawPacket = s_RadioRawPacket;
+   int totalLength = 0;
+   bool bInPlace = false;
+   if ( bHasRadioHeadroom && (! be) )
+   {
+      radio_tx_batch_flush_buffer(pPacketData - MAX_PACKET_RADIO_HEADERS, nPacketLength + MAX_PACKET_RADIO_HEADERS);
+      totalLength = radio_build_new_raw_ieee_packet_in_place(iLocalRadioLinkId, pPacketData, nPacketLength, RADIO_PORT_ROUTER_DOWNLINK, &pRawPacket);
+      bInPlace = true;
+   }
+   else
+      totalLength = radio_build_new_raw_ieee_packet(iLocalRadioLinkId, s_RadioRawPacket, pPacketData, nPacketLength, RADIO_PORT_ROUTER_DOWNLINK, be);
    u32 microT1 = get_current_timestamp_micros();
 
    if ( iDidSetTempFlags )
@@ -424,19 +479,34 @@ bool _send_packet_to_wifi_radio_interface(int iLocalRadioLinkId, int iRadioInter
         (pPH->packet_type == PACKET_TYPE_VIDEO_SWITCH_TO_ADAPTIVE_VIDEO_LEVEL_ACK) )
       iRepeatCount++;
 
-   if ( radio_write_raw_ieee_packet(iRadioInterfaceIndex, s_RadioRawPacket, totalLength, iRepeatCount) )
+   type_radio_tx_pending_stats* pStats = &s_RadioTxPendingStats[s_iRadioTxPendingStatsIndex];
+   pStats->iLocalRadioLinkId = iLocalRadioLinkId;
+   pStats->iPacketLength = nPacketLength;
+   pStats->iDataRate = nRateTx;
+   pStats->iStreamId = (int)uStreamId;
+   pStats->uPacketType = pPH->packet_type;
+   pStats->bIsVideoPacket = bIsVideoPacket;
+   pStats->bIsAudioPacket = bIsAudioPacket;
+
+   // Only packets built in place can be queued in a tx batch: the others are built in the shared s_RadioRawPacket buffer
+   int iResult = 0;
+   if ( bInPlace && (0 == iRepeatCount) )
+      iResult = radio_write_raw_ieee_packet_batched(iRadioInterfaceIndex, pRawPacket, totalLength, pStats);
+   else
+      iResult = radio_write_raw_ieee_packet(iRadioInterfaceIndex, pRawPacket, totalLength, iRepeatCount);
+
+   if ( 2 == iResult )
+   {
+      // Queued; the radio stats are updated when the batch is sent
+      s_iRadioTxPendingStatsIndex++;
+      if ( s_iRadioTxPendingStatsIndex >= MAX_RADIO_INTERFACES * RADIO_TX_BATCH_MAX_PACKETS )
+         s_iRadioTxPendingStatsIndex = 0;
+      return true;
+   }
+   if ( 1 == iResult )
    {       
       u32 microT2 = get_current_timestamp_micros();
-      if ( microT2 > microT1 )
-      {
-         g_RadioTxTimers.aTmpInterfacesTxTotalTimeMicros[iRadioInterfaceIndex] += microT2 - microT1;
-         if ( bIsVideoPacket )
-            g_RadioTxTimers.aTmpInterfacesTxVideoTimeMicros[iRadioInterfaceIndex] += microT2 - microT1;
-      }
-      radio_stats_update_on_packet_sent_on_radio_interface(&g_SM_RadioStats, g_TimeNow, iRadioInterfaceIndex, nPacketLength);
-      radio_stats_set_tx_radio_datarate_for_packet(&g_SM_RadioStats, iRadioInterfaceIndex, iLocalRadioLinkId, nRateTx, (bIsVideoPacket || bIsAudioPacket)?1:0);
-
-      radio_stats_update_on_packet_sent_on_radio_link(&g_SM_RadioStats, g_TimeNow, iLocalRadioLinkId, (int)uStreamId, nPacketLength);
+      _update_radio_tx_stats(iRadioInterfaceIndex, pStats, (microT2 > microT1)?(microT2 - microT1):0);
       return true;
    }
 
@@ -447,8 +517,11 @@ bool _send_packet_to_wifi_radio_interface(int iLocalRadioLinkId, int iRadioInter
 }
 
 // Sends a radio packet to all posible radio interfaces or just to a single radio link
+// bHasRadioHeadroom: the packet has MAX_PACKET_RADIO_HEADERS free bytes reserved in front of it; the radio
+// headers are written there, so the packet is not copied before the radio write. The packet header
+// (indexes, CRC) is updated in place.
 
-int send_packet_to_radio_interfaces(u8* pPacketData, int nPacketLength, int iSendToSingleRadioLink)
+int send_packet_to_radio_interfaces(u8* pPacketData, int nPacketLength, int iSendToSingleRadioLink, bool bHasRadioHeadroom)
 {
    if ( nPacketLength <= 0 )
       return -1;
@@ -638,7 +711,7 @@ int send_packet_to_radio_interfaces(u8* pPacketData, int nPacketLength, int iSen
       {
          if ( bIsLowCapacityLinkOnlyPacket )
             continue;
-         if ( _send_packet_to_wifi_radio_interface(iRadioLinkId, iRadioInterfaceIndex, pPacketData, nPacketLength) )
+         if ( _send_packet_to_wifi_radio_interface(iRadioLinkId, iRadioInterfaceIndex, pPacketData, nPacketLength, bHasRadioHeadroom) )
          {
             bPacketSent = true;
             if ( bHasCommandParamsZipResponse )
@@ -909,7 +982,7 @@ void send_alarm_to_controller_now(u32 uAlarm, u32 uFlags1, u32 uFlags2, u32 uRep
       memcpy(packet+sizeof(t_packet_header)+sizeof(u32), &uAlarm, sizeof(u32));
       memcpy(packet+sizeof(t_packet_header)+2*sizeof(u32), &uFlags1, sizeof(u32));
       memcpy(packet+sizeof(t_packet_header)+3*sizeof(u32), &uFlags2, sizeof(u32));
-      send_packet_to_radio_interfaces(packet, PH.total_length, -1);
+      send_packet_to_radio_interfaces(packet, PH.total_length, -1, false);
 
       alarms_to_string(uAlarm, uFlags1, uFlags2, szBuff);
       log_line("Sent alarm packet to radio: %s, alarm index: %u, repeat count: %u", szBuff, s_uAlarmsIndex, uRepeatCount);
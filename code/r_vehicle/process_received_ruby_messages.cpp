@@ -89,7 +89,7 @@ int _process_received_ping_messages(int iInterfaceIndex, u8* pPacketBuffer)
       memcpy(packet+sizeof(t_packet_header)+2*sizeof(u8)+sizeof(u32), &uLocalRadioLinkId, sizeof(u8));
 
       if ( radio_packet_type_is_high_priority(PH.packet_flags, PH.packet_type) )
-         send_packet_to_radio_interfaces(packet, PH.total_length, -1);
+         send_packet_to_radio_interfaces(packet, PH.total_length, -1, false);
       else
          packets_queue_inject_packet_first(&g_QueueRadioPacketsOut, packet);
 
@@ -38,6 +38,7 @@
 #include "../base/hardware_radio.h"
 #include "../base/hw_procs.h"
 #include "../base/ruby_ipc.h"
+#include "../base/sw_upload_fec.h"
 
 #include <pthread.h>
 #include "launchers_vehicle.h"
@@ -68,6 +69,8 @@ u32* s_pSWPacketsSize = NULL;
 u32 s_uSWPacketsCount = 0;
 u32 s_uSWPacketsMaxSize = 0;
 
+type_sw_upload_fec_receiver s_SWUploadFECReceiver;
+
 pthread_t s_pThreadProcessUpload;
 bool s_bUpdateInProgress = false;
 bool s_bProcessUploadInProgress = false;
@@ -77,6 +80,8 @@ char s_szProcessUploadArchiveCommand[256];
 
 void _sw_update_close_remove_temp_files()
 {
+   sw_upload_fec_receiver_close(&s_SWUploadFECReceiver);
+
    if ( NULL != s_pFileSoftware )
        fclose(s_pFileSoftware);
    s_pFileSoftware = NULL;
@@ -139,6 +144,8 @@ void process_sw_upload_init()
    s_pSWPacketsSize = NULL;
    s_uSWPacketsCount = 0;
    s_uSWPacketsMaxSize = 0;
+
+   sw_upload_fec_receiver_init(&s_SWUploadFECReceiver);
 }
 
 void _process_upload_send_status_to_controller(u8 uStatus, int iRepeatCount)
@@ -426,6 +433,43 @@ static void * _thread_process_upload(void *argument)
 }
 
 
+static void _sw_update_on_upload_started()
+{
+   if ( s_bSoftwareUpdateStoppedVideoPipeline )
+      return;
+
+   char szComm[256];
+   sprintf(szComm, "touch %s%s", FOLDER_RUBY_TEMP, FILE_TEMP_UPDATE_IN_PROGRESS);
+   hw_execute_bash_command(szComm, NULL);
+   s_bSoftwareUpdateStoppedVideoPipeline = true;
+   sendControlMessage(PACKET_TYPE_LOCAL_CONTROL_PAUSE_VIDEO, 0);
+
+   sprintf(szComm, "rm -rf %slog_system_*", FOLDER_LOGS);
+   hw_execute_bash_command(szComm, NULL);
+   sprintf(szComm, "rm -rf %slog_errors_*", FOLDER_LOGS);
+   hw_execute_bash_command(szComm, NULL);
+   sprintf(szComm, "rm -rf %slog_video_*", FOLDER_LOGS);
+   hw_execute_bash_command(szComm, NULL);
+   int iFreeSpaceKb = hardware_get_free_space_kb();
+   log_line("Free space on disk: %d Mb", iFreeSpaceKb/1000);
+}
+
+static void _sw_update_apply_received_archive(const char* szMethod)
+{
+   sync();
+
+   log_line("Received software package correctly (%s method). Update file: [%s]. Applying it.", szMethod, s_szUpdateArchiveFile);
+
+   if ( 0 != pthread_create(&s_pThreadProcessUpload, NULL, &_thread_process_upload, NULL) )
+   {
+      log_softerror_and_alarm("Failed to create worker thread to process upload.");
+      s_bUpdateInProgress = false;
+      s_bProcessUploadInProgress = false;
+      _process_upload_send_status_to_controller(OTA_UPDATE_STATUS_FAILED, 10);
+      return;
+   }
+}
+
 void process_sw_upload_new(u32 command_param, u8* pBuffer, int length)
 {
    if ( (NULL == pBuffer) || (length < (int)(sizeof(t_packet_header) + sizeof(t_packet_header_command) + sizeof(command_packet_sw_package))) )
@@ -468,22 +512,7 @@ void process_sw_upload_new(u32 command_param, u8* pBuffer, int length)
       return;             
    }
 
-   if ( ! s_bSoftwareUpdateStoppedVideoPipeline )
-   {
-      sprintf(szComm, "touch %s%s", FOLDER_RUBY_TEMP, FILE_TEMP_UPDATE_IN_PROGRESS);
-      hw_execute_bash_command(szComm, NULL);
-      s_bSoftwareUpdateStoppedVideoPipeline = true;
-      sendControlMessage(PACKET_TYPE_LOCAL_CONTROL_PAUSE_VIDEO, 0);
-
-      sprintf(szComm, "rm -rf %slog_system_*", FOLDER_LOGS);
-      hw_execute_bash_command(szComm, NULL);
-      sprintf(szComm, "rm -rf %slog_errors_*", FOLDER_LOGS);
-      hw_execute_bash_command(szComm, NULL);
-      sprintf(szComm, "rm -rf %slog_video_*", FOLDER_LOGS);
-      hw_execute_bash_command(szComm, NULL);
-      int iFreeSpaceKb = hardware_get_free_space_kb();
-      log_line("Free space on disk: %d Mb", iFreeSpaceKb/1000);
-   }
+   _sw_update_on_upload_started();
 
    if ( NULL == s_pSWPackets )
    {
@@ -648,18 +677,103 @@ void process_sw_upload_new(u32 command_param, u8* pBuffer, int length)
    if ( fileSize != params->total_size )
       log_softerror_and_alarm("Missmatch between expected file size (%u) and created file size (%u)!", params->total_size, fileSize);
 
-   sync();
+   _sw_update_apply_received_archive("6.3");
+}
 
-   log_line("Received software package correctly (6.3 method). Update file: [%s]. Applying it.", s_szUpdateArchiveFile);
+void process_sw_upload_fec(u32 command_param, u8* pBuffer, int length)
+{
+   int iHeadersLength = sizeof(t_packet_header) + sizeof(t_packet_header_command) + sizeof(command_packet_sw_package_fec);
+   if ( (NULL == pBuffer) || (length < iHeadersLength) )
+   {
+      log_softerror_and_alarm("Received SW Upload FEC packet of invalid minimum size: %d bytes", length);
+      setCommandReplyBuffer(NULL, 0);
+      sendCommandReply(COMMAND_RESPONSE_FLAGS_FAILED_INVALID_PARAMS, 0, 0);
+      return;
+   }
 
-   if ( 0 != pthread_create(&s_pThreadProcessUpload, NULL, &_thread_process_upload, NULL) )
+   command_packet_sw_package_fec header;
+   memcpy((u8*)&header, pBuffer + sizeof(t_packet_header) + sizeof(t_packet_header_command), sizeof(command_packet_sw_package_fec));
+
+   if ( NULL != g_pProcessStats )
+      g_pProcessStats->lastActiveTime = g_TimeNow;
+   s_uLastTimeReceivedAnySoftwareBlock = g_TimeNow;
+
+   if ( SW_UPLOAD_FEC_PARAM_CANCEL == command_param )
    {
-      log_softerror_and_alarm("Failed to create worker thread to process upload.");
-      s_bUpdateInProgress = false;
-      s_bProcessUploadInProgress = false;
-      _process_upload_send_status_to_controller(OTA_UPDATE_STATUS_FAILED, 10);
+      log_line("SW Upload FEC: upload canceled (transfer id %u)", header.uTransferId);
+      setCommandReplyBuffer(NULL, 0);
+      sendCommandReply(COMMAND_RESPONSE_FLAGS_OK, 0, 0);
+      if ( ! s_bUpdateInProgress )
+         _sw_update_close_remove_temp_files();
       return;
    }
+
+   // Once the archive is complete the receiver is closed; keep answering status requests for it
+   bool bCompletedTransfer = s_bUpdateInProgress && (header.uTransferId == s_SWUploadFECReceiver.uTransferId) && s_SWUploadFECReceiver.bVerified;
+
+   if ( (! bCompletedTransfer) && (! sw_upload_fec_receiver_is_current_transfer(&s_SWUploadFECReceiver, &header)) )
+   {
+      if ( s_bUpdateInProgress )
+      {
+         log_line("Update is in progress, ignore sw package packets.");
+         return;
+      }
+      _sw_update_on_upload_started();
+
+      char szComm[256];
+      sprintf(szComm, "mkdir -p %s", FOLDER_UPDATES);
+      hw_execute_bash_command(szComm, NULL);
+      sprintf(szComm, "chmod 777 %s", FOLDER_UPDATES);
+      hw_execute_bash_command(szComm, NULL);
+      if ( header.uType == 0 )
+         sprintf(s_szUpdateArchiveFile, "%s%s", FOLDER_UPDATES, "ruby_update.zip");
+      else
+         sprintf(s_szUpdateArchiveFile, "%s%s", FOLDER_UPDATES, "ruby_update.tar");
+
+      if ( ! sw_upload_fec_receiver_start(&s_SWUploadFECReceiver, &header, s_szUpdateArchiveFile) )
+      {
+         log_softerror_and_alarm("SW Upload FEC: failed to start receiving the update archive (%u bytes, transfer id %u).", header.uTotalSize, header.uTransferId);
+         _sw_update_close_remove_temp_files();
+         setCommandReplyBuffer(NULL, 0);
+         sendCommandReply(COMMAND_RESPONSE_FLAGS_FAILED, 0, 0);
+         _process_upload_send_status_to_controller(OTA_UPDATE_STATUS_FAILED_DISK_SPACE, 10);
+         return;
+      }
+   }
+
+   if ( SW_UPLOAD_FEC_PARAM_STATUS == command_param )
+   {
+      command_packet_sw_package_fec_status status;
+      sw_upload_fec_receiver_get_status(&s_SWUploadFECReceiver, &status);
+      if ( bCompletedTransfer )
+         status.uFlags |= SW_UPLOAD_FEC_STATUS_FLAG_COMPLETE;
+      log_line("SW Upload FEC: status request, %u of %u generations complete, %u blocks received.", status.uGenerationsComplete, s_SWUploadFECReceiver.uGenerations, status.uBlocksReceived);
+      setCommandReplyBuffer((u8*)&status, sizeof(command_packet_sw_package_fec_status));
+      sendCommandReply(COMMAND_RESPONSE_FLAGS_OK, 0, 0);
+      return;
+   }
+
+   if ( bCompletedTransfer )
+      return;
+
+   int iRes = sw_upload_fec_receiver_add_block(&s_SWUploadFECReceiver, &header, pBuffer + iHeadersLength, length - iHeadersLength);
+   if ( (iRes < 0) && sw_upload_fec_receiver_has_failed(&s_SWUploadFECReceiver) )
+   {
+      log_softerror_and_alarm("SW Upload FEC: failed to write the update archive [%s].", s_szUpdateArchiveFile);
+      sw_upload_fec_receiver_log_stats(&s_SWUploadFECReceiver);
+      _sw_update_close_remove_temp_files();
+      _process_upload_send_status_to_controller(OTA_UPDATE_STATUS_FAILED_DISK_SPACE, 10);
+      return;
+   }
+   if ( ! sw_upload_fec_receiver_is_complete(&s_SWUploadFECReceiver) )
+      return;
+
+   log_enable_full();
+   log_line("Received entire SW upload (%u bytes, transfer id %u).", s_SWUploadFECReceiver.uTotalSize, s_SWUploadFECReceiver.uTransferId);
+   sw_upload_fec_receiver_log_stats(&s_SWUploadFECReceiver);
+   sw_upload_fec_receiver_close(&s_SWUploadFECReceiver);
+   s_bUpdateInProgress = true;
+   _sw_update_apply_received_archive("FEC");
 }
 
 bool process_sw_upload_is_started()
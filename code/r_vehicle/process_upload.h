@@ -3,6 +3,8 @@
 
 void process_sw_upload_init();
 void process_sw_upload_new(u32 command_param, u8* pBuffer, int length);
+// Update archive sent as FEC protected generations (COMMAND_ID_UPLOAD_SW_TO_VEHICLE_FEC)
+void process_sw_upload_fec(u32 command_param, u8* pBuffer, int length);
 
 bool process_sw_upload_is_started();
 void process_sw_upload_check_timeout(u32 uTimeNow);
\ No newline at end of file
@@ -418,7 +418,7 @@ void ProcessorTxAudio::_sendAudioPacket(u8* pBuffer, int iLength, u32 uAudioPack
    memcpy(packet+sizeof(t_packet_header), (u8*)&uAudioPacketIndex, sizeof(u32));
    memcpy(packet+sizeof(t_packet_header)+sizeof(u32), pBuffer, iLength);
 
-   send_packet_to_radio_interfaces(packet, PH.total_length, -1);
+   send_packet_to_radio_interfaces(packet, PH.total_length, -1, false);
 }
 
 void ProcessorTxAudio::sendAudioPackets()
@@ -315,7 +315,7 @@ bool process_data_tx_video_command(int iRadioInterface, u8* pPacketBuffer)
       memcpy(packet+sizeof(t_packet_header), &uRequestId, sizeof(u32));
       memcpy(packet+sizeof(t_packet_header) + sizeof(u32), &uVideoProfile, sizeof(u8));
       if ( radio_packet_type_is_high_priority(PH.packet_flags, PH.packet_type) )
-         send_packet_to_radio_interfaces(packet, PH.total_length, -1);
+         send_packet_to_radio_interfaces(packet, PH.total_length, -1, false);
       else
          packets_queue_add_packet(&g_QueueRadioPacketsOut, packet);
 
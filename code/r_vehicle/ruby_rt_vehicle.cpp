@@ -66,6 +66,8 @@
 #include "../base/vehicle_settings.h"
 #include "../base/vehicle_rt_info.h"
 #include "../base/hardware_radio_serial.h"
+#include "../base/event_loop.h"
+#include "../base/latency_stats.h"
 #include "../common/string_utils.h"
 #include "../common/radio_stats.h"
 #include "../common/relay_utils.h"
@@ -134,6 +136,16 @@ extern u32 s_uLastAlarmsCount;
 
 u32 s_uTimeLastTryReadIPCMessages = 0;
 
+static type_event_loop s_MainEventLoop;
+static bool s_bUseMainEventLoop = false;
+static int s_iMainEventLoopSourceRxHighPrio = -1;
+static int s_iMainEventLoopSourceRxRegPrio = -1;
+static int s_iMainEventLoopSourceCamera = -1;
+static int s_iMainEventLoopSourceIPC = -1;
+static bool s_bMainEventLoopCameraReady = true;
+static u32 s_uMainLoopIPCCheckLastTime = 0;
+static u32 s_uMainLoopPeriodicCheckLastTime = 0;
+
 bool links_set_cards_frequencies_and_params(int iLinkId)
 {
    if ( NULL == g_pCurrentModel )
@@ -332,7 +344,7 @@ void send_radio_reinitialized_message()
    u8 packet[MAX_PACKET_TOTAL_SIZE];
    memcpy(packet, (u8*)&PH, sizeof(t_packet_header));
 
-   send_packet_to_radio_interfaces(packet, PH.total_length, -1);
+   send_packet_to_radio_interfaces(packet, PH.total_length, -1, false);
 }
 
 
@@ -880,7 +892,7 @@ int process_and_send_packets()
       if ( pPH->packet_type == PACKET_TYPE_RUBY_PAIRING_CONFIRMATION )
          log_line("Sending pairing request confirmation to controller (from VID %u to CID %u)", pPH->vehicle_id_src, pPH->vehicle_id_dest);
 
-      send_packet_to_radio_interfaces(pPacketBuffer, iPacketLength, -1);
+      send_packet_to_radio_interfaces(pPacketBuffer, iPacketLength, -1, false);
       iCountSent++;
       if ( bMustInjectVideoDevStats )
          _inject_video_link_dev_stats_packet();
@@ -1215,7 +1227,7 @@ void _check_compute_send_rt_debug_info()
       u8 packet[MAX_PACKET_TOTAL_SIZE];
       memcpy(packet, (u8*)&PH, sizeof(t_packet_header));
       memcpy(packet + sizeof(t_packet_header), (u8*)&(g_VehicleRuntimeInfo), sizeof(vehicle_runtime_info));
-      send_packet_to_radio_interfaces(packet, PH.total_length, -1);
+      send_packet_to_radio_interfaces(packet, PH.total_length, -1, false);
    }
 }
 
@@ -1231,6 +1243,95 @@ void handle_sigint(int sig)
 
 void _main_loop();
 
+static int _main_loop_get_camera_fd()
+{
+   if ( ! g_pCurrentModel->hasCamera() )
+      return -1;
+   if ( g_pCurrentModel->isActiveCameraCSICompatible() || g_pCurrentModel->isActiveCameraVeye() )
+      return video_source_csi_get_pipe_fd();
+   if ( g_pCurrentModel->isActiveCameraOpenIPC() )
+      return video_source_majestic_get_socket_fd();
+   return -1;
+}
+
+static void _main_loop_init_event_loop()
+{
+   s_bUseMainEventLoop = false;
+   if ( ! get_VehicleSettings()->iRouterUseEventLoop )
+   {
+      log_line("Main loop: event loop is disabled, using polling main loop.");
+      return;
+   }
+   if ( ! event_loop_init(&s_MainEventLoop) )
+   {
+      log_softerror_and_alarm("Main loop: failed to create event loop, using polling main loop.");
+      return;
+   }
+   s_iMainEventLoopSourceRxHighPrio = event_loop_add_source(&s_MainEventLoop, "rx-high-prio", radio_rx_get_queue_event_fd(1), 0);
+   s_iMainEventLoopSourceRxRegPrio = event_loop_add_source(&s_MainEventLoop, "rx-reg-prio", radio_rx_get_queue_event_fd(0), 0);
+   s_iMainEventLoopSourceCamera = event_loop_add_source(&s_MainEventLoop, "camera", _main_loop_get_camera_fd(), 0);
+   // IPC channels have no fd to wait on, they are checked on the 10 ms cadence. Used just for the counters.
+   s_iMainEventLoopSourceIPC = event_loop_add_source(&s_MainEventLoop, "ipc", -1, 0);
+   s_bUseMainEventLoop = true;
+   log_line("Main loop: using event loop.");
+}
+
+// Blocks until radio rx packets, camera data or the next periodic/IPC check is due
+// Returns the time spent waiting, in miliseconds
+
+static u32 _main_loop_wait_for_events()
+{
+   bool bCameraWasReady = s_bMainEventLoopCameraReady;
+   s_bMainEventLoopCameraReady = true;
+   if ( ! s_bUseMainEventLoop )
+      return 0;
+
+   // Fds can change while running (radio interfaces reopened, camera restarted)
+   event_loop_set_source_fd(&s_MainEventLoop, s_iMainEventLoopSourceRxHighPrio, radio_rx_get_queue_event_fd(1));
+   event_loop_set_source_fd(&s_MainEventLoop, s_iMainEventLoopSourceRxRegPrio, radio_rx_get_queue_event_fd(0));
+   int iCameraFd = _main_loop_get_camera_fd();
+   event_loop_set_source_fd(&s_MainEventLoop, s_iMainEventLoopSourceCamera, iCameraFd);
+
+   u32 uTimeNow = get_current_timestamp_ms();
+   u32 uNextCheckTime = s_uMainLoopIPCCheckLastTime + 10;
+   if ( s_uMainLoopPeriodicCheckLastTime + 10 < uNextCheckTime )
+      uNextCheckTime = s_uMainLoopPeriodicCheckLastTime + 10;
+   int iTimeoutMs = 0;
+   if ( uNextCheckTime > uTimeNow )
+      iTimeoutMs = (int)(uNextCheckTime - uTimeNow);
+   if ( iTimeoutMs > 10 )
+      iTimeoutMs = 10;
+   if ( (iTimeoutMs > 1) && packets_queue_has_packets(&g_QueueRadioPacketsOut) )
+      iTimeoutMs = 1;
+   // Pending video packets are sent from the camera read, that runs only when the camera is ready:
+   // do not spin on them while waiting for the camera
+   if ( g_pVideoTxBuffers->hasPendingPacketsToSend() )
+   if ( bCameraWasReady && (iCameraFd >= 0) )
+      iTimeoutMs = 0;
+   // Camera with no fd (not opened yet or restarting): keep polling it
+   if ( g_pCurrentModel->hasCamera() && (iCameraFd < 0) && (iTimeoutMs > 1) )
+      iTimeoutMs = 1;
+
+   if ( radio_rx_begin_wait_on_queues() )
+      iTimeoutMs = 0;
+
+   int iResult = event_loop_wait(&s_MainEventLoop, iTimeoutMs);
+   radio_rx_end_wait_on_queues();
+
+   if ( (iResult >= 0) && (iCameraFd >= 0) )
+      s_bMainEventLoopCameraReady = (0 != event_loop_source_is_ready(&s_MainEventLoop, s_iMainEventLoopSourceCamera));
+
+   static u32 s_uTimeLastMainEventLoopStats = 0;
+   u32 uTimeAfterWait = get_current_timestamp_ms();
+   if ( uTimeAfterWait >= s_uTimeLastMainEventLoopStats + 60000 )
+   {
+      if ( 0 != s_uTimeLastMainEventLoopStats )
+         event_loop_log_and_reset_stats(&s_MainEventLoop, "Router main loop");
+      s_uTimeLastMainEventLoopStats = uTimeAfterWait;
+   }
+   return uTimeAfterWait - uTimeNow;
+}
+
 int main(int argc, char *argv[])
 {
    signal(SIGINT, handle_sigint);
@@ -1244,7 +1345,9 @@ int main(int argc, char *argv[])
    }
 
    log_init("Router");
+   log_enable_async_writes();
    log_arguments(argc, argv);
+   latency_stats_init_for_write(LATENCY_STATS_PROCESS_ROUTER_VEHICLE);
 
    if ( strcmp(argv[argc-1], "test_maj") == 0 )
    {
@@ -1540,6 +1643,7 @@ int main(int argc, char *argv[])
 
    radio_duplicate_detection_init();
    radio_rx_start_rx_thread(&g_SM_RadioStats, 0, g_pCurrentModel->getVehicleFirmwareType());
+   _main_loop_init_event_loop();
    
    send_radio_config_to_controller();
 
@@ -1622,6 +1726,8 @@ int main(int argc, char *argv[])
 
    while ( !g_bQuit )
    {
+      // Time spent idle waiting for events is not part of the loop processing time
+      uLastLoopTime += _main_loop_wait_for_events();
       g_TimeNow = get_current_timestamp_ms();
       g_pProcessStats->lastActiveTime = g_TimeNow;
       g_pProcessStats->uLoopSubStep = 0;
@@ -1656,6 +1762,8 @@ int main(int argc, char *argv[])
 
    radio_rx_stop_rx_thread();
    radio_link_cleanup();
+   if ( s_bUseMainEventLoop )
+      event_loop_close(&s_MainEventLoop);
 
    radio_links_close_rxtx_radio_interfaces();
 
@@ -1671,6 +1779,7 @@ int main(int argc, char *argv[])
    //shared_mem_video_frames_stats_close(g_pSM_VideoInfoStatsCameraOutput);
    //shared_mem_video_frames_stats_radio_out_close(g_pSM_VideoInfoStatsRadioOut);
    shared_mem_process_stats_close(SHARED_MEM_WATCHDOG_ROUTER_TX, g_pProcessStats);
+   latency_stats_close();
    log_line("Stopped.Exit now. (PID %d)", getpid());
    log_line("---------------------\n");
    return 0;
@@ -1762,10 +1871,13 @@ int _main_loop_try_read_camera()
       if ( g_pCurrentModel->isActiveCameraCSICompatible() || g_pCurrentModel->isActiveCameraVeye() )
       {
          g_pProcessStats->uLoopSubStep = 98;
+         u32 uTimeStartRead = latency_stats_start();
          pVideoData = video_source_csi_read(&iReadSize);
          g_pProcessStats->uLoopSubStep = 5;
          if ( iReadSize > 0 )
          {
+            latency_stats_end(LATENCY_STAGE_CAMERA_READ, uTimeStartRead);
+            g_pVideoTxBuffers->setTraceCaptureTime(g_bDeveloperMode?get_current_timestamp_ms():0);
             bDidReadVideoData = true;
             int iBuffSize = video_source_csi_get_buffer_size();
             bIsEndOfFrame = (iReadSize < iBuffSize)?true:false;
@@ -1784,10 +1896,13 @@ int _main_loop_try_read_camera()
          for( int k=0; k<4; k++ )
          {
             g_pProcessStats->uLoopSubStep = 99;
+            u32 uTimeStartRead = latency_stats_start();
             pVideoData = video_source_majestic_read(&iReadSize, true);
             g_pProcessStats->uLoopSubStep = 5;
             if ( iReadSize > 0 )
             {
+               latency_stats_end(LATENCY_STAGE_CAMERA_READ, uTimeStartRead);
+               g_pVideoTxBuffers->setTraceCaptureTime(g_bDeveloperMode?get_current_timestamp_ms():0);
                bDidReadVideoData = true;
                bool bSingle = video_source_majestic_last_read_is_single_nal();
                bool bEnd = video_source_majestic_last_read_is_end_nal();
@@ -1848,6 +1963,7 @@ int _main_loop_try_read_camera()
 
             process_received_single_radio_packet(iRadioInterfaceIndex, pPacket, iPacketLength);      
             shared_mem_radio_stats_rx_hist_update(&g_SM_HistoryRxStats, iRadioInterfaceIndex, pPacket, g_TimeNow);
+            radio_rx_release_high_prio_packet();
 
             g_pProcessStats->uLoopSubStep = 13;
          }
@@ -1904,7 +2020,10 @@ void _main_loop()
 
       process_received_single_radio_packet(iRadioInterfaceIndex, pPacket, iPacketLength);      
       shared_mem_radio_stats_rx_hist_update(&g_SM_HistoryRxStats, iRadioInterfaceIndex, pPacket, g_TimeNow);
+      radio_rx_release_high_prio_packet();
    }
+   if ( s_bUseMainEventLoop )
+      event_loop_on_source_processed(&s_MainEventLoop, s_iMainEventLoopSourceRxHighPrio, iCountConsumedHighPrio, 10);
 
    g_pProcessStats->uLoopSubStep = 3;
 
@@ -1913,6 +2032,7 @@ void _main_loop()
    //--------------------------------------------
    // Video/camera read
    if ( g_pCurrentModel->hasCamera() )
+   if ( s_bMainEventLoopCameraReady )
       iCountConsumedHighPrio += _main_loop_try_read_camera();
 
    //------------------------------------------
@@ -1925,7 +2045,8 @@ void _main_loop()
    while ( (iCountConsumedRegPrio < 50) && (!g_bQuit) )
    {
       g_pProcessStats->uLoopSubStep = 21;
-      pPacket = radio_rx_wait_get_next_received_reg_prio_packet(200, &iPacketLength, &iPacketIsShort, &iRadioInterfaceIndex);
+      // The event loop already waited for packets, so do not block here too
+      pPacket = radio_rx_wait_get_next_received_reg_prio_packet(s_bUseMainEventLoop?0:200, &iPacketLength, &iPacketIsShort, &iRadioInterfaceIndex);
       if ( (NULL == pPacket) || g_bQuit )
          break;
 
@@ -1935,6 +2056,7 @@ void _main_loop()
 
       shared_mem_radio_stats_rx_hist_update(&g_SM_HistoryRxStats, iRadioInterfaceIndex, pPacket, g_TimeNow);
       process_received_single_radio_packet(iRadioInterfaceIndex, pPacket, iPacketLength);
+      radio_rx_release_reg_prio_packet();
    
       g_pProcessStats->uLoopSubStep = 23;
 
@@ -1953,6 +2075,8 @@ void _main_loop()
       }
       g_pProcessStats->uLoopSubStep = 24;
    }
+   if ( s_bUseMainEventLoop )
+      event_loop_on_source_processed(&s_MainEventLoop, s_iMainEventLoopSourceRxRegPrio, iCountConsumedRegPrio, 50);
 
    g_pProcessStats->uLoopSubStep = 25;
 
@@ -1999,7 +2123,6 @@ void _main_loop()
    //-------------------------------------------
    // Process IPCs
 
-   static u32 s_uMainLoopIPCCheckLastTime = 0;
    if ( g_TimeNow >= s_uMainLoopIPCCheckLastTime + 10 )
    {
       s_uMainLoopIPCCheckLastTime = g_TimeNow;
@@ -2007,7 +2130,9 @@ void _main_loop()
       _read_ipc_pipes(g_TimeNow);
       g_pProcessStats->uLoopSubStep = 28;
 
-      _consume_ipc_messages();
+      int iCountIPCConsumed = _consume_ipc_messages();
+      if ( s_bUseMainEventLoop )
+         event_loop_on_source_processed(&s_MainEventLoop, s_iMainEventLoopSourceIPC, iCountIPCConsumed, 20);
       g_pProcessStats->uLoopSubStep = 29;
    }
 
@@ -2044,7 +2169,6 @@ void _main_loop()
       _check_compute_send_rt_debug_info();
 
    g_pProcessStats->uLoopSubStep = 41;
-   static u32 s_uMainLoopPeriodicCheckLastTime = 0;
    if ( g_TimeNow < s_uMainLoopPeriodicCheckLastTime + 10 )
       return;
 
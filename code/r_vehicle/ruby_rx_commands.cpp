@@ -49,6 +49,7 @@
 #include "../base/ruby_ipc.h"
 #include "../base/core_plugins_settings.h"
 #include "../base/vehicle_settings.h"
+#include "../base/file_upload.h"
 #include "../common/string_utils.h"
 #include "../common/relay_utils.h"
 
@@ -104,16 +105,14 @@ static int s_ZIPParams_Model_BufferLength = 0;
 
 
 #define MAX_SEGMENTS_FILE_UPLOAD 10000 // About 10 Mbytes of data maximum
+// Segments of a completed file are acked as duplicates for this long, then the same file can be uploaded again
+#define FILE_UPLOAD_COMPLETED_KEEP_MS 10000
 
+// The uploaded file segments are written directly to the target file
 typedef struct
 {
-   u32 uLastFileId;
-   char szFileName[128];
-   u32 uFileSize;
-   u32 uTotalSegments;
-   u8* pSegments[MAX_SEGMENTS_FILE_UPLOAD];
-   u32 uSegmentsSize[MAX_SEGMENTS_FILE_UPLOAD];
-   bool bSegmentsReceived[MAX_SEGMENTS_FILE_UPLOAD];
+   type_file_upload_receiver receiver;
+   u32 uTimeCompleted; // 0: not completed
    u32 uLastCommandIdForThisFile;
 } ALIGN_STRUCT_SPEC_INFO t_structure_file_upload_info;
 
@@ -634,41 +633,26 @@ bool _process_file_segment_download_request( u8* pBuffer, int length)
    return true;
 }
 
-void _process_received_uploaded_file()
+static void _get_uploaded_file_path(u32 uFileId, char* szFile)
 {
-   if ( s_InfoLastFileUploaded.uLastFileId == FILE_ID_CORE_PLUGINS_ARCHIVE )
-   {
-      log_line("Processing received core plugins archive (%u bytes)...", s_InfoLastFileUploaded.uFileSize);
-      char szComm[128];
-      sprintf(szComm, "rm -rf %s/core_plugins.zip 2>&1", FOLDER_RUBY_TEMP);
-      hw_execute_bash_command(szComm, NULL);
-      
-      char szFile[MAX_FILE_PATH_SIZE];
-      strcpy(szFile, FOLDER_RUBY_TEMP);
+   strcpy(szFile, FOLDER_RUBY_TEMP);
+   if ( uFileId == FILE_ID_CORE_PLUGINS_ARCHIVE )
       strcat(szFile, "core_plugins.zip");
-      FILE* fd = fopen(szFile, "wb");
-      if ( NULL == fd )
-      {
-         log_softerror_and_alarm("Failed to create file on disk for uploaded plugins: [%s]", szFile);
-         return;
-      }
-      for( u32 u=0; u<s_InfoLastFileUploaded.uTotalSegments; u++ )
-      {
-          int nRes = fwrite(s_InfoLastFileUploaded.pSegments[u], 1, s_InfoLastFileUploaded.uSegmentsSize[u], fd );
-          if ( nRes != (int)s_InfoLastFileUploaded.uSegmentsSize[u] )
-          {
-             log_softerror_and_alarm("Failed to write file on disk for uploaded plugins.");
-             return;
-          }
-      }
+   else
+      sprintf(szFile + strlen(szFile), "upload_%u.bin", uFileId);
+}
 
-      fflush(fd);
-      fclose(fd);
+void _process_received_uploaded_file()
+{
+   if ( s_InfoLastFileUploaded.receiver.uFileId == FILE_ID_CORE_PLUGINS_ARCHIVE )
+   {
+      log_line("Processing received core plugins archive (%u bytes)...", s_InfoLastFileUploaded.receiver.uFileSize);
+      char szComm[256];
       char szOutput[4096];
-      sprintf(szComm, "chmod 777 %s/core_plugins.zip 2>&1", FOLDER_RUBY_TEMP);
+      sprintf(szComm, "chmod 777 %s 2>&1", s_InfoLastFileUploaded.receiver.szFileName);
       hw_execute_bash_command(szComm, NULL);
       hardware_sleep_ms(100);
-      sprintf(szComm, "unzip %s/core_plugins.zip -d %s 2>&1", FOLDER_RUBY_TEMP, FOLDER_CORE_PLUGINS);
+      sprintf(szComm, "unzip %s -d %s 2>&1", s_InfoLastFileUploaded.receiver.szFileName, FOLDER_CORE_PLUGINS);
       hw_execute_bash_command(szComm, szOutput);
       log_line("Result: [%s]", szOutput);
       sprintf(szComm, "chmod 777 %s/*", FOLDER_CORE_PLUGINS);
@@ -677,100 +661,96 @@ void _process_received_uploaded_file()
    }
 }
 
+static void _send_file_segment_upload_reply(u32 uSegmentIndex, bool bFailed)
+{
+   command_packet_upload_file_segment_ack ack;
+   file_upload_receiver_get_ack(&s_InfoLastFileUploaded.receiver, uSegmentIndex, &ack);
+   if ( bFailed )
+      ack.uFlags |= UPLOAD_FILE_SEGMENT_ACK_FLAG_FAILED;
+   setCommandReplyBuffer((u8*)&ack, sizeof(command_packet_upload_file_segment_ack));
+   sendCommandReply(bFailed?COMMAND_RESPONSE_FLAGS_FAILED:COMMAND_RESPONSE_FLAGS_OK, 0, 0);
+}
+
+// Returns true if it was updated
+
 bool _process_file_segment_upload_request( u8* pBuffer, int length)
 {
-   //t_packet_header_command* pPHC = (t_packet_header_command*)(pBuffer + sizeof(t_packet_header));
+   // Windowed uploads send the segments as one way commands and need an ack for each one
+   bool bWindowed = (lastRecvCommandType & COMMAND_TYPE_FLAG_NO_RESPONSE_NEEDED)?true:false;
+   lastRecvCommandType &= ~COMMAND_TYPE_FLAG_NO_RESPONSE_NEEDED;
+
+   int iHeadersLength = sizeof(t_packet_header) + sizeof(t_packet_header_command) + sizeof(command_packet_upload_file_segment);
+   if ( length < iHeadersLength )
+   {
+      setCommandReplyBuffer(NULL, 0);
+      sendCommandReply(COMMAND_RESPONSE_FLAGS_FAILED_INVALID_PARAMS, 0, 0);
+      return true;
+   }
 
    // Discard duplicate segments/commands for last file if already completed
 
+   if ( ! bWindowed )
    if ( s_InfoLastFileUploaded.uLastCommandIdForThisFile != 0 )
    if ( lastRecvCommandNumber <= s_InfoLastFileUploaded.uLastCommandIdForThisFile )
    {
-      setCommandReplyBuffer(NULL, 0);
-      sendCommandReply(COMMAND_RESPONSE_FLAGS_OK, 0, 0);
+      _send_file_segment_upload_reply(MAX_U32, false);
       return true;
    }
 
    command_packet_upload_file_segment segmentData;
    memcpy((u8*)&segmentData, pBuffer + sizeof(t_packet_header) + sizeof(t_packet_header_command), sizeof(command_packet_upload_file_segment));
+   segmentData.szFileName[sizeof(segmentData.szFileName)-1] = 0;
 
-   log_line("Received request to upload file segment %u of %u (%d bytes) for file [%s], file id: %u", segmentData.uSegmentIndex+1, segmentData.uTotalSegments, segmentData.uSegmentSize, segmentData.szFileName, segmentData.uFileId);
-
-
-   if ( (s_InfoLastFileUploaded.uLastFileId != segmentData.uFileId) ||
-        (s_InfoLastFileUploaded.uTotalSegments != segmentData.uTotalSegments) ||
-        (s_InfoLastFileUploaded.uFileSize != segmentData.uTotalFileSize) )
+   if ( (segmentData.uSegmentSize > (u32)(length - iHeadersLength)) || (0 == segmentData.uTotalSegments) || (segmentData.uTotalSegments > MAX_SEGMENTS_FILE_UPLOAD) )
    {
-      for( u32 u=0; u<s_InfoLastFileUploaded.uTotalSegments; u++ )
-      {
-         if ( NULL != s_InfoLastFileUploaded.pSegments[u] )
-            free(s_InfoLastFileUploaded.pSegments[u]);
-         s_InfoLastFileUploaded.pSegments[u] = NULL;
-      }
+      log_softerror_and_alarm("Received invalid file segment %u of %u (%u bytes) for file [%s], file id: %u", segmentData.uSegmentIndex+1, segmentData.uTotalSegments, segmentData.uSegmentSize, segmentData.szFileName, segmentData.uFileId);
+      _send_file_segment_upload_reply(segmentData.uSegmentIndex, true);
+      return true;
+   }
 
-      s_InfoLastFileUploaded.uLastFileId = segmentData.uFileId;
-      strncpy(s_InfoLastFileUploaded.szFileName, segmentData.szFileName, 128);
-      s_InfoLastFileUploaded.uTotalSegments = segmentData.uTotalSegments;
-      s_InfoLastFileUploaded.uFileSize = segmentData.uTotalFileSize;
+   bool bCurrentFile = file_upload_receiver_is_current_file(&s_InfoLastFileUploaded.receiver, segmentData.uFileId, segmentData.uTotalSegments, segmentData.uTotalFileSize);
+   if ( bCurrentFile && (0 != s_InfoLastFileUploaded.uTimeCompleted) && (g_TimeNow > s_InfoLastFileUploaded.uTimeCompleted + FILE_UPLOAD_COMPLETED_KEEP_MS) )
+      bCurrentFile = false;
 
-      for( u32 u=0; u<s_InfoLastFileUploaded.uTotalSegments; u++ )
+   if ( ! bCurrentFile )
+   {
+      log_line("Received request to upload file [%s], file id: %u, %u bytes, %u segments (%s)", segmentData.szFileName, segmentData.uFileId, segmentData.uTotalFileSize, segmentData.uTotalSegments, bWindowed?"windowed":"one segment per command");
+      char szFile[MAX_FILE_PATH_SIZE];
+      _get_uploaded_file_path(segmentData.uFileId, szFile);
+      s_InfoLastFileUploaded.uTimeCompleted = 0;
+      if ( ! file_upload_receiver_start(&s_InfoLastFileUploaded.receiver, segmentData.uFileId, segmentData.uTotalSegments, segmentData.uTotalFileSize, szFile) )
       {
-         s_InfoLastFileUploaded.pSegments[u] = (u8*)malloc(MAX_PACKET_TOTAL_SIZE);
-         if ( NULL == s_InfoLastFileUploaded.pSegments[u] )
-         {
-            s_InfoLastFileUploaded.uLastFileId = MAX_U32;
-            setCommandReplyBuffer(NULL, 0);
-            sendCommandReply(COMMAND_RESPONSE_FLAGS_FAILED, 0, 0);
-            return true;
-         }
-
-         s_InfoLastFileUploaded.uSegmentsSize[u] = 0;
-         s_InfoLastFileUploaded.bSegmentsReceived[u] = false;
+         _send_file_segment_upload_reply(segmentData.uSegmentIndex, true);
+         return true;
       }
    }
 
-   if ( segmentData.uSegmentIndex >= segmentData.uTotalSegments )
+   // Duplicate segment of a completed file
+   if ( 0 != s_InfoLastFileUploaded.uTimeCompleted )
    {
-      s_InfoLastFileUploaded.uLastFileId = MAX_U32;
-      setCommandReplyBuffer(NULL, 0);
-      sendCommandReply(COMMAND_RESPONSE_FLAGS_FAILED, 0, 0);
+      _send_file_segment_upload_reply(segmentData.uSegmentIndex, false);
       return true;
    }
 
-   s_InfoLastFileUploaded.uSegmentsSize[segmentData.uSegmentIndex] = segmentData.uSegmentSize;
-   memcpy(s_InfoLastFileUploaded.pSegments[segmentData.uSegmentIndex],
-       pBuffer + sizeof(t_packet_header) + sizeof(t_packet_header_command) + sizeof(command_packet_upload_file_segment),
-       segmentData.uSegmentSize);
-
-   s_InfoLastFileUploaded.bSegmentsReceived[segmentData.uSegmentIndex] = true;
-
-   bool bReceivedAll = true;
-
-   for( u32 u=0; u<s_InfoLastFileUploaded.uTotalSegments; u++ )
-      if ( ! s_InfoLastFileUploaded.bSegmentsReceived[u] )
-      {
-         bReceivedAll = false;
-         break;
-      }
-
-   if ( bReceivedAll )
+   if ( file_upload_receiver_add_segment(&s_InfoLastFileUploaded.receiver, segmentData.uSegmentIndex, pBuffer + iHeadersLength, segmentData.uSegmentSize) < 0 )
    {
-      log_line("Received entire file [%s], %u bytes", s_InfoLastFileUploaded.szFileName, s_InfoLastFileUploaded.uFileSize);
-      _process_received_uploaded_file();
+      log_softerror_and_alarm("Failed to store uploaded file segment %u of %u (%u bytes) for file [%s]", segmentData.uSegmentIndex+1, segmentData.uTotalSegments, segmentData.uSegmentSize, segmentData.szFileName);
+      _send_file_segment_upload_reply(segmentData.uSegmentIndex, true);
+      return true;
+   }
 
-      for( u32 u=0; u<s_InfoLastFileUploaded.uTotalSegments; u++ )
-      {
-         if ( NULL != s_InfoLastFileUploaded.pSegments[u] )
-            free(s_InfoLastFileUploaded.pSegments[u]);
-         s_InfoLastFileUploaded.pSegments[u] = NULL;
-      }
-      s_InfoLastFileUploaded.uLastFileId = MAX_U32;
-      s_InfoLastFileUploaded.uTotalSegments = 0;
+   if ( file_upload_receiver_is_complete(&s_InfoLastFileUploaded.receiver) )
+   {
+      file_upload_receiver_close(&s_InfoLastFileUploaded.receiver);
+      s_InfoLastFileUploaded.uTimeCompleted = g_TimeNow;
+      if ( 0 == s_InfoLastFileUploaded.uTimeCompleted )
+         s_InfoLastFileUploaded.uTimeCompleted = 1;
       s_InfoLastFileUploaded.uLastCommandIdForThisFile = lastRecvCommandNumber;
+      log_line("Received entire file [%s], %u bytes", segmentData.szFileName, s_InfoLastFileUploaded.receiver.uFileSize);
+      _process_received_uploaded_file();
    }
 
-   setCommandReplyBuffer(NULL, 0);
-   sendCommandReply(COMMAND_RESPONSE_FLAGS_OK, 0, 0);
+   _send_file_segment_upload_reply(segmentData.uSegmentIndex, false);
    return true;
 }
 
@@ -3501,6 +3481,12 @@ bool process_command(u8* pBuffer, int length)
       return true;
    }
 
+   if ( uCommandType == COMMAND_ID_UPLOAD_SW_TO_VEHICLE_FEC )
+   {
+      process_sw_upload_fec(pPHC->command_param, pBuffer, length);
+      return true;
+   }
+
    if ( uCommandType == COMMAND_ID_RESET_ALL_DEVELOPER_FLAGS )
    {
       for( int i=0; i<20; i++ )
@@ -3553,7 +3539,7 @@ void on_received_command(u8* pBuffer, int length)
    if ( pPH->vehicle_id_dest != g_pCurrentModel->uVehicleId )
       return;
 
-   if ( ! radio_packet_check_crc(pBuffer, pPH->total_length) )
+   if ( ! ruby_ipc_message_crc_is_valid(pBuffer, pPH->total_length) )
    {
       log_line_commands("Received a invalid command (invalid CRC). Ignoring.");
       return;
@@ -3698,10 +3684,8 @@ int r_start_commands_rx(int argc, char* argv[])
 
    process_sw_upload_init();
 
-   s_InfoLastFileUploaded.uLastFileId = MAX_U32;
-   s_InfoLastFileUploaded.szFileName[0] = 0;
-   s_InfoLastFileUploaded.uFileSize = 0;
-   s_InfoLastFileUploaded.uTotalSegments = 0;
+   file_upload_receiver_init(&s_InfoLastFileUploaded.receiver);
+   s_InfoLastFileUploaded.uTimeCompleted = 0;
    s_InfoLastFileUploaded.uLastCommandIdForThisFile = 0;
 
    char szFileStop[MAX_FILE_PATH_SIZE];
@@ -49,7 +49,9 @@
 
 #include <time.h>
 #include <sys/resource.h>
+#include <sys/stat.h>
 #include <semaphore.h>
+#include <signal.h>
 
 Model sModelVehicle; 
 
@@ -62,6 +64,7 @@ int s_PipeTmpBufferRCFromRouterPos = 0;
 t_packet_header_rc_full_frame_upstream s_LastReceivedRCFrame;
 
 t_packet_header_rc_info_downstream* s_pPHDownstreamInfoRC = NULL; // Info to send back to telemetry process and then (optionally) to ground
+shared_mem_rc_last_frame_info* s_pSMRCLastFrameInfo = NULL; // Last received frame, for the telemetry process only
 
 int s_LastHistorySlice = 0;
 u8 s_LastReceivedRCFrameIndex = 0;
@@ -71,6 +74,40 @@ u8 s_QualityRecvIndex = 0;
 
 sem_t* s_pSemaphoreStop = NULL;
 
+// Wakes up the telemetry process (that writes the RC frames to the FC) on each received RC frame
+int s_iFdRCFramesNotify = -1;
+u32 s_uTimeLastTryOpenRCFramesNotify = 0;
+
+// The loop waits for messages from router; this bounds the wait, for the RC history slices and failsafe checks
+#define RX_RC_MAIN_LOOP_MAX_WAIT_MS 50
+
+void _notify_rc_frame_received()
+{
+   if ( s_iFdRCFramesNotify < 0 )
+   {
+      if ( (0 != s_uTimeLastTryOpenRCFramesNotify) && (g_TimeNow < s_uTimeLastTryOpenRCFramesNotify + 1000) )
+         return;
+      s_uTimeLastTryOpenRCFramesNotify = g_TimeNow;
+      if ( (0 != mkfifo(FIFO_RUBY_RC_FRAMES_NOTIFY, 0666)) && (errno != EEXIST) )
+         return;
+      // Fails (ENXIO) while the telemetry process has not opened it yet
+      s_iFdRCFramesNotify = open(FIFO_RUBY_RC_FRAMES_NOTIFY, O_WRONLY | O_NONBLOCK);
+      if ( s_iFdRCFramesNotify < 0 )
+         return;
+      log_line("Opened RC frames notification pipe to telemetry process.");
+   }
+
+   u8 uByte = 1;
+   if ( write(s_iFdRCFramesNotify, &uByte, 1) == 1 )
+      return;
+   // Full: the telemetry process has not read the previous notifications yet, it will see this frame too
+   if ( (errno == EAGAIN) || (errno == EWOULDBLOCK) )
+      return;
+   log_line("RC frames notification pipe to telemetry process was closed (error: %d).", errno);
+   close(s_iFdRCFramesNotify);
+   s_iFdRCFramesNotify = -1;
+}
+
 void process_data_rc_full_frame(u8* pBuffer, int length)
 {
    if ( NULL == s_pPHDownstreamInfoRC )
@@ -80,6 +117,14 @@ void process_data_rc_full_frame(u8* pBuffer, int length)
    memcpy(&s_LastReceivedRCFrame, pPHRCF, sizeof(t_packet_header_rc_full_frame_upstream));
 
    g_TimeLastFrameReceived = g_TimeNow;
+   if ( NULL != s_pSMRCLastFrameInfo )
+   {
+      s_pSMRCLastFrameInfo->uLastFrameRecvTimeMicros = get_current_timestamp_micros();
+      s_pSMRCLastFrameInfo->uLastFrameIndex = pPHRCF->rc_frame_index;
+      s_pSMRCLastFrameInfo->uLastFrameInputAge = RC_FULL_FRAME_INPUT_AGE_NONE;
+      if ( pPHRCF->flags & RC_FULL_FRAME_FLAGS_HAS_INPUT_AGE )
+         s_pSMRCLastFrameInfo->uLastFrameInputAge = pPHRCF->extra_info1;
+   }
    s_pPHDownstreamInfoRC->recv_packets++;
    s_QualityRecvCount[s_QualityRecvIndex]++;
 
@@ -114,6 +159,8 @@ void process_data_rc_full_frame(u8* pBuffer, int length)
    if ( gap > cGap )
       cGap = gap;
    s_pPHDownstreamInfoRC->history[s_LastHistorySlice] = (cReceived & 0x0F) | ((cGap & 0x0F) << 4);
+
+   _notify_rc_frame_received();
 }
 
 void on_failsafe_triggered()
@@ -166,6 +213,9 @@ int r_start_rx_rc(int argc, char *argv[])
    if ( sModelVehicle.uDeveloperFlags & DEVELOPER_FLAGS_BIT_LOG_ONLY_ERRORS )
       log_only_errors();
 
+   // Writing to the RC frames notification pipe after the telemetry process closed it must not stop us
+   signal(SIGPIPE, SIG_IGN);
+
    #ifdef HW_PLATFORM_RASPBERRY
    hw_set_priority_current_proc(sModelVehicle.processesPriorities.iNiceRC);   
    #endif
@@ -178,6 +228,12 @@ int r_start_rx_rc(int argc, char *argv[])
    if ( NULL != s_pPHDownstreamInfoRC )
       memset((u8*)s_pPHDownstreamInfoRC, 0, sizeof(t_packet_header_rc_info_downstream));
 
+   s_pSMRCLastFrameInfo = shared_mem_rc_last_frame_info_open_write();
+   if ( NULL == s_pSMRCLastFrameInfo )
+      log_softerror_and_alarm("Failed to open RC last frame info shared memory for write.");
+   else
+      memset((u8*)s_pSMRCLastFrameInfo, 0, sizeof(shared_mem_rc_last_frame_info));
+
    g_pProcessStats = shared_mem_process_stats_open_write(SHARED_MEM_WATCHDOG_RC_RX);
    if ( NULL == g_pProcessStats )
       log_softerror_and_alarm("Failed to open shared mem for RC Rx process watchdog for writing: %s", SHARED_MEM_WATCHDOG_RC_RX);
@@ -212,13 +268,24 @@ int r_start_rx_rc(int argc, char *argv[])
 
    g_TimeStart = get_current_timestamp_ms();
 
-   int iSleepIntervalMS = 50;
+   int iSleepIntervalMS = RX_RC_MAIN_LOOP_MAX_WAIT_MS;
 
    while (!g_bQuit) 
    {
-      hardware_sleep_ms(iSleepIntervalMS);
-      if ( iSleepIntervalMS < 50 )
-         iSleepIntervalMS += 10;
+      // Wake up as soon as the router sends a RC frame, or when the next history slice/failsafe check is due
+      g_TimeNow = get_current_timestamp_ms();
+      u32 uWaitMs = RX_RC_MAIN_LOOP_MAX_WAIT_MS - (g_TimeNow % 50);
+      if ( sModelVehicle.rc_params.rc_enabled && (0 != g_TimeLastFrameReceived) && (NULL != s_pPHDownstreamInfoRC) && (0 == s_pPHDownstreamInfoRC->is_failsafe) )
+      if ( g_TimeLastFrameReceived + sModelVehicle.rc_params.rc_failsafe_timeout_ms > g_TimeNow )
+      if ( g_TimeLastFrameReceived + sModelVehicle.rc_params.rc_failsafe_timeout_ms - g_TimeNow < uWaitMs )
+         uWaitMs = g_TimeLastFrameReceived + sModelVehicle.rc_params.rc_failsafe_timeout_ms - g_TimeNow;
+      // No wait support on this channel type (msgqueue): poll, faster right after traffic
+      if ( ruby_ipc_wait_for_message(s_fIPC_FromRouter, uWaitMs) < 0 )
+      {
+         hardware_sleep_ms(((u32)iSleepIntervalMS < uWaitMs)?(u32)iSleepIntervalMS:uWaitMs);
+         if ( iSleepIntervalMS < RX_RC_MAIN_LOOP_MAX_WAIT_MS )
+            iSleepIntervalMS += 10;
+      }
 
       int val = 0;
       if ( NULL != s_pSemaphoreStop )
@@ -251,6 +318,13 @@ int r_start_rx_rc(int argc, char *argv[])
             memset((u8*)s_pPHDownstreamInfoRC, 0, sizeof(t_packet_header_rc_info_downstream)); 
       }
 
+      if ( NULL == s_pSMRCLastFrameInfo )
+      {
+         s_pSMRCLastFrameInfo = shared_mem_rc_last_frame_info_open_write();
+         if ( NULL != s_pSMRCLastFrameInfo )
+            memset((u8*)s_pSMRCLastFrameInfo, 0, sizeof(shared_mem_rc_last_frame_info));
+      }
+
       if ( NULL != s_pPHDownstreamInfoRC )
       if ( g_TimeNow >= g_TimeLastQualityMeasurement + 500 )
       {
@@ -291,10 +365,10 @@ int r_start_rx_rc(int argc, char *argv[])
       int maxMsgToRead = 5;
       while ( (maxMsgToRead > 0) && (NULL != ruby_ipc_try_read_message(s_fIPC_FromRouter, s_PipeTmpBufferRCFromRouter, &s_PipeTmpBufferRCFromRouterPos, s_BufferRCFromRouter)) )
       {
-         iSleepIntervalMS = 2;
          maxMsgToRead--;
+         iSleepIntervalMS = 2;
          t_packet_header* pPH = (t_packet_header*)&s_BufferRCFromRouter[0];
-         if ( ! radio_packet_check_crc(s_BufferRCFromRouter, pPH->total_length) )
+         if ( ! ruby_ipc_message_crc_is_valid(s_BufferRCFromRouter, pPH->total_length) )
             continue;
  
          if ( (pPH->packet_flags & PACKET_FLAGS_MASK_MODULE) == PACKET_COMPONENT_RUBY )
@@ -401,10 +475,15 @@ int r_start_rx_rc(int argc, char *argv[])
    log_line("Stopping...");
    
    shared_mem_rc_downstream_info_close(s_pPHDownstreamInfoRC);
+   shared_mem_rc_last_frame_info_close(s_pSMRCLastFrameInfo);
    shared_mem_process_stats_close(SHARED_MEM_WATCHDOG_RC_RX, g_pProcessStats);
 
    ruby_close_ipc_channel(s_fIPC_FromRouter);
    s_fIPC_FromRouter = -1;
+
+   if ( s_iFdRCFramesNotify >= 0 )
+      close(s_iFdRCFramesNotify);
+   s_iFdRCFramesNotify = -1;
  
    if ( NULL != s_pSemaphoreStop )
       sem_close(s_pSemaphoreStop);
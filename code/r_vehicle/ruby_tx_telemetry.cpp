@@ -37,6 +37,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <pcap.h>
 #include <pthread.h>
 #include <stdint.h>
@@ -61,6 +62,8 @@
 #include "../base/commands.h"
 #include "../base/utils.h"
 #include "../base/ruby_ipc.h"
+#include "../base/event_loop.h"
+#include "../base/latency_stats.h"
 #include "../base/vehicle_settings.h"
 #include "../common/string_utils.h"
 #include "../common/relay_utils.h"
@@ -71,6 +74,7 @@
 #include "timers.h"
 #include "telemetry.h"
 #include "telemetry_mavlink.h"
+#include "telemetry_mavlink_downlink.h"
 #include "telemetry_ltm.h"
 #include "telemetry_msp.h"
 #include "../utils/utils_vehicle.h"
@@ -112,6 +116,7 @@ u32 s_LastSendRubyTelemetryTime = 0;
 u32 s_uLastTotalPacketsReceived = 0;
 
 t_packet_header_rc_info_downstream* s_pPHDownstreamInfoRC = NULL; // Info to send back to ground
+shared_mem_rc_last_frame_info* s_pSMRCLastFrameInfo = NULL; // Last RC frame received by the RC rx process
 
 //shared_mem_video_frames_stats* s_pSM_VideoInfoStats = NULL;
 //shared_mem_video_frames_stats* s_pSM_VideoInfoStatsRadioOut = NULL;
@@ -130,6 +135,43 @@ static bool s_bRadioInterfacesReinitIsInProgress = false;
 
 u32 s_uTimeToAdjustBalanceInterupts = 0;
 
+// Main loop waits on the FC and data link serial ports, so serial data is forwarded as soon as it arrives.
+// IPC messages from router have no fd to wait on, they are checked on a fixed cadence.
+#define TELEMETRY_MAIN_LOOP_IPC_CHECK_INTERVAL_MS 5
+
+static type_event_loop s_MainEventLoop;
+static bool s_bUseMainEventLoop = false;
+static int s_iMainEventLoopSourceFCSerial = -1;
+static int s_iMainEventLoopSourceDataLinkSerial = -1;
+static int s_iMainEventLoopSourceIPC = -1;
+static u32 s_uMainEventLoopFCSerialOpenTime = 0;
+// A serial port in error (i.e. USB adapter removed) is always ready but has no data: stop waiting on it until it's reopened
+#define TELEMETRY_MAIN_LOOP_MAX_EMPTY_SERIAL_WAKEUPS 100
+static int s_iMainEventLoopFCSerialEmptyWakeups = 0;
+static int s_iMainEventLoopDataLinkSerialEmptyWakeups = 0;
+
+// RC output to FC: the RC rx process wakes up the main loop (through a fifo) on each RC frame it receives,
+// so the frame is written to the FC right away. Output that does not fit now in the FC serial port
+// tx buffer is kept and written as soon as the port is writable.
+static int s_iMainEventLoopSourceRCFrames = -1;
+static int s_iMainEventLoopSourceFCSerialWrite = -1;
+static int s_iRCFramesNotifyFd = -1;
+static int s_iFCSerialWriteFd = -1; // dup of the FC serial port fd, as the wait set can't have the same fd twice
+static u32 s_uFCSerialWriteFdOpenTime = 0;
+
+static u8 s_uRCOutputPending[MAVLINK_MAX_PACKET_LEN];
+static int s_iRCOutputPendingBytes = 0;
+static int s_iRCOutputPendingOffset = 0; // greater than 0: partially written, must be completed first
+static bool s_bRCOutputPendingIsRCFrame = false;
+static u32 s_uRCOutputPendingFrameRecvTimeMicros = 0;
+static u8 s_uRCOutputPendingFrameInputAge = RC_FULL_FRAME_INPUT_AGE_NONE;
+static u32 s_uRCLastFrameRecvTimeMicrosSentToFC = 0;
+static u32 s_uRCOutputCountDelayed = 0;
+static u32 s_uRCOutputCountReplaced = 0;
+
+// Latency histograms at the time of the last RC info sent to controller, for the percentiles since then
+static type_latency_stage_histogram s_RCLatencyHistogramsAtLastInfo[2];
+
 bool isRadioLinksInitInProgress()
 {
    return s_bRadioInterfacesReinitIsInProgress;
@@ -139,6 +181,10 @@ void check_open_datalink_serial_port();
 
 void close_datalink_serial_port()
 {
+   // The fd number can be reused when the port is opened again, so remove it from the wait set now
+   if ( s_bUseMainEventLoop )
+      event_loop_set_source_fd(&s_MainEventLoop, s_iMainEventLoopSourceDataLinkSerial, -1);
+   s_iMainEventLoopDataLinkSerialEmptyWakeups = 0;
    if ( -1 != s_iSerialDataLinkFileHandle )
       close(s_iSerialDataLinkFileHandle);
    s_iSerialDataLinkFileHandle = -1;
@@ -212,6 +258,9 @@ void _compute_telemetry_intervals()
    }
    else
       radio_reset_packets_default_frequencies(0);
+
+   // Uses the slow links packets frequencies set above
+   telemetry_mavlink_downlink_init();
 }
 
 
@@ -400,6 +449,124 @@ void _process_cached_reboot_info()
    broadcast_vehicle_stats();
 }
 
+static void _rc_output_on_frame_written(u32 uFrameRecvTimeMicros, u8 uFrameInputAge)
+{
+   if ( 0 != uFrameRecvTimeMicros )
+      latency_stats_add(LATENCY_STAGE_RC_RECV_TO_FC, get_current_timestamp_micros() - uFrameRecvTimeMicros);
+   if ( uFrameInputAge != RC_FULL_FRAME_INPUT_AGE_NONE )
+      latency_stats_add(LATENCY_STAGE_RC_INPUT_TO_SEND, (u32)uFrameInputAge * RC_FULL_FRAME_INPUT_AGE_UNIT_MICROS);
+}
+
+static void _rc_output_flush()
+{
+   if ( s_iRCOutputPendingBytes <= 0 )
+      return;
+   int iFd = telemetry_get_serial_port_file();
+   if ( iFd < 0 )
+   {
+      s_iRCOutputPendingBytes = 0;
+      s_iRCOutputPendingOffset = 0;
+      return;
+   }
+   int iWritten = write(iFd, &s_uRCOutputPending[s_iRCOutputPendingOffset], s_iRCOutputPendingBytes - s_iRCOutputPendingOffset);
+   if ( iWritten < 0 )
+   {
+      if ( (errno == EAGAIN) || (errno == EWOULDBLOCK) )
+         return;
+      log_softerror_and_alarm("Failed to write to serial port to FC");
+      s_iRCOutputPendingBytes = 0;
+      s_iRCOutputPendingOffset = 0;
+      return;
+   }
+   s_iRCOutputPendingOffset += iWritten;
+   if ( s_iRCOutputPendingOffset < s_iRCOutputPendingBytes )
+      return;
+   if ( s_bRCOutputPendingIsRCFrame )
+      _rc_output_on_frame_written(s_uRCOutputPendingFrameRecvTimeMicros, s_uRCOutputPendingFrameInputAge);
+   s_iRCOutputPendingBytes = 0;
+   s_iRCOutputPendingOffset = 0;
+}
+
+static void _rc_output_to_FC(u8* pData, int iLength, bool bIsRCFrame, u32 uFrameRecvTimeMicros, u8 uFrameInputAge)
+{
+   int iFd = telemetry_get_serial_port_file();
+   if ( (iFd < 0) || (iLength <= 0) || (iLength > (int)sizeof(s_uRCOutputPending)) )
+      return;
+
+   _rc_output_flush();
+   if ( s_iRCOutputPendingBytes > 0 )
+   {
+      // The FC serial port is still busy: a newer RC frame replaces the one waiting (if not started yet), anything else is skipped
+      if ( bIsRCFrame && s_bRCOutputPendingIsRCFrame && (0 == s_iRCOutputPendingOffset) )
+      {
+         memcpy(s_uRCOutputPending, pData, iLength);
+         s_iRCOutputPendingBytes = iLength;
+         s_uRCOutputPendingFrameRecvTimeMicros = uFrameRecvTimeMicros;
+         s_uRCOutputPendingFrameInputAge = uFrameInputAge;
+         s_uRCOutputCountReplaced++;
+      }
+      return;
+   }
+
+   int iWritten = write(iFd, pData, iLength);
+   if ( iWritten == iLength )
+   {
+      if ( bIsRCFrame )
+         _rc_output_on_frame_written(uFrameRecvTimeMicros, uFrameInputAge);
+      return;
+   }
+   if ( iWritten < 0 )
+   {
+      if ( (errno != EAGAIN) && (errno != EWOULDBLOCK) )
+      {
+         log_softerror_and_alarm("Failed to write to serial port to FC");
+         return;
+      }
+      iWritten = 0;
+   }
+   memcpy(s_uRCOutputPending, pData, iLength);
+   s_iRCOutputPendingBytes = iLength;
+   s_iRCOutputPendingOffset = iWritten;
+   s_bRCOutputPendingIsRCFrame = bIsRCFrame;
+   s_uRCOutputPendingFrameRecvTimeMicros = uFrameRecvTimeMicros;
+   s_uRCOutputPendingFrameInputAge = uFrameInputAge;
+   s_uRCOutputCountDelayed++;
+}
+
+// Adds the RC latency percentiles since the previous RC info packet
+
+static void _rc_info_add_latency_percentiles(t_packet_header_rc_info_downstream* pRCInfo)
+{
+   memset(pRCInfo->uLatencyInputToSend, 0, sizeof(pRCInfo->uLatencyInputToSend));
+   memset(pRCInfo->uLatencyRecvToFC, 0, sizeof(pRCInfo->uLatencyRecvToFC));
+   pRCInfo->uLatencySamples = 0;
+
+   type_latency_stats* pStats = latency_stats_get_current();
+   if ( NULL == pStats )
+      return;
+
+   static const int s_iPercentilesPerMille[RC_INFO_LATENCY_PERCENTILES] = { 500, 900, 990 };
+   int iStages[2] = { LATENCY_STAGE_RC_INPUT_TO_SEND, LATENCY_STAGE_RC_RECV_TO_FC };
+   u16* pOutputs[2] = { pRCInfo->uLatencyInputToSend, pRCInfo->uLatencyRecvToFC };
+   for( int k=0; k<2; k++ )
+   {
+      type_latency_stage_histogram histogramNow;
+      type_latency_stage_histogram histogramDelta;
+      memcpy(&histogramNow, &pStats->stages[iStages[k]], sizeof(type_latency_stage_histogram));
+      latency_stats_compute_delta(&histogramNow, &s_RCLatencyHistogramsAtLastInfo[k], &histogramDelta);
+      memcpy(&s_RCLatencyHistogramsAtLastInfo[k], &histogramNow, sizeof(type_latency_stage_histogram));
+      if ( iStages[k] == LATENCY_STAGE_RC_RECV_TO_FC )
+         pRCInfo->uLatencySamples = (histogramDelta.uCount > 0xFFFF)?0xFFFF:(u16)histogramDelta.uCount;
+      if ( 0 == histogramDelta.uCount )
+         continue;
+      for( int i=0; i<RC_INFO_LATENCY_PERCENTILES; i++ )
+      {
+         u32 uValue = latency_stats_get_percentile(&histogramDelta, s_iPercentilesPerMille[i]) / RC_INFO_LATENCY_UNIT_MICROS;
+         pOutputs[k][i] = (uValue > 0xFFFF)?0xFFFF:(u16)uValue;
+      }
+   }
+}
+
 void _send_rc_data_to_FC()
 {
    static u16 s_ch_last_values[18];
@@ -429,10 +596,27 @@ void _send_rc_data_to_FC()
       bSend = true;
    if ( g_TimeNow >= g_TimeLastRCSentToFC + 1000/g_pCurrentModel->rc_params.rc_frames_per_second )
       bSend = true;
+   // A new RC frame was received: write it now
+   bool bIsNewFrame = false;
+   if ( NULL != s_pSMRCLastFrameInfo )
+   if ( s_pSMRCLastFrameInfo->uLastFrameRecvTimeMicros != s_uRCLastFrameRecvTimeMicrosSentToFC )
+   {
+      bIsNewFrame = true;
+      bSend = true;
+   }
 
    if ( ! bSend )
       return;
 
+   u32 uFrameRecvTimeMicros = 0;
+   u8 uFrameInputAge = RC_FULL_FRAME_INPUT_AGE_NONE;
+   if ( bIsNewFrame )
+   {
+      uFrameRecvTimeMicros = s_pSMRCLastFrameInfo->uLastFrameRecvTimeMicros;
+      uFrameInputAge = s_pSMRCLastFrameInfo->uLastFrameInputAge;
+      s_uRCLastFrameRecvTimeMicrosSentToFC = uFrameRecvTimeMicros;
+   }
+
    int componentId = MAV_COMP_ID_MISSIONPLANNER;
    //int componentId = MAV_COMP_ID_AUTOPILOT1;
 
@@ -477,8 +661,7 @@ void _send_rc_data_to_FC()
 
       mavlink_msg_heartbeat_pack(g_pCurrentModel->telemetry_params.controller_mavlink_id, componentId, &msg, MAV_TYPE_GCS, MAV_AUTOPILOT_INVALID, 0,0,0);
       len = mavlink_msg_to_send_buffer(serialBufferOut, &msg);
-      if ( len != write(telemetry_get_serial_port_file(), serialBufferOut, len) )
-         log_softerror_and_alarm("Failed to write to serial port to FC");
+      _rc_output_to_FC(serialBufferOut, len, false, 0, RC_FULL_FRAME_INPUT_AGE_NONE);
    }
 
    mavlink_msg_rc_channels_override_pack(g_pCurrentModel->telemetry_params.controller_mavlink_id, componentId, &msg, g_pCurrentModel->telemetry_params.vehicle_mavlink_id, MAV_COMP_ID_ALL, s_ch_last_values[0], s_ch_last_values[1], s_ch_last_values[2], s_ch_last_values[3],
@@ -486,8 +669,7 @@ void _send_rc_data_to_FC()
          s_ch_last_values[13], s_ch_last_values[14], s_ch_last_values[15], s_ch_last_values[16], s_ch_last_values[17]);
 
    len = mavlink_msg_to_send_buffer(serialBufferOut, &msg);
-   if ( len != write(telemetry_get_serial_port_file(), serialBufferOut, len) )
-      log_softerror_and_alarm("Failed to write to serial port to FC");
+   _rc_output_to_FC(serialBufferOut, len, true, uFrameRecvTimeMicros, uFrameInputAge);
 }
 
 
@@ -759,7 +941,7 @@ bool try_read_messages_from_router()
    if ( (pPH->packet_flags & PACKET_FLAGS_MASK_MODULE) != PACKET_COMPONENT_TELEMETRY )
       return true;
 
-   if ( ! radio_packet_check_crc(s_BufferMessageFromRouter, pPH->total_length) )
+   if ( ! ruby_ipc_message_crc_is_valid(s_BufferMessageFromRouter, pPH->total_length) )
       return true;
 
    if ( pPH->vehicle_id_dest != g_pCurrentModel->uVehicleId )
@@ -879,14 +1061,17 @@ void send_datalink_data_packet_to_controller()
 }
 
 
-void try_read_serial_datalink()
+// Returns the number of bytes read
+
+int try_read_serial_datalink()
 {
    if ( -1 == s_iSerialDataLinkFileHandle )
-      return;
+      return 0;
 
+   // Do not wait here, the main loop waits for the serial data
    struct timeval to;
    to.tv_sec = 0;
-   to.tv_usec = 2000; // 2 ms
+   to.tv_usec = 0;
 
    fd_set readset;   
    FD_ZERO(&readset);
@@ -894,13 +1079,14 @@ void try_read_serial_datalink()
    
    int res = select(s_iSerialDataLinkFileHandle+1, &readset, NULL, NULL, &to);
    if ( res <= 0 )
-      return;
+      return 0;
    if ( ! FD_ISSET(s_iSerialDataLinkFileHandle, &readset) )
-      return;
+      return 0;
 
    int length = read(s_iSerialDataLinkFileHandle, serialBufferIn, 270);
    if ( length <= 0 )
-      return;
+      return 0;
+   int iReadBytes = length;
 
    char szBuff[2000];
    memcpy(szBuff, &serialBufferIn[0], length);
@@ -914,7 +1100,7 @@ void try_read_serial_datalink()
       {
          memcpy(&(dataLinkSerialBuffer[dataLinkSerialBufferCount]), pData, length);
          dataLinkSerialBufferCount += length;
-         return;
+         return iReadBytes;
       }
       int chunkSize = dataLinkSerialBufferMaxSize-dataLinkSerialBufferCount;
       memcpy(&(dataLinkSerialBuffer[dataLinkSerialBufferCount]), pData, chunkSize);
@@ -923,6 +1109,7 @@ void try_read_serial_datalink()
       length -= chunkSize;
       send_datalink_data_packet_to_controller();
    }
+   return iReadBytes;
 }
 
 void check_send_telemetry_to_controller()
@@ -1303,6 +1490,7 @@ void check_send_telemetry_to_controller()
 
       memcpy(buffer, &sPH, sizeof(t_packet_header));
       memcpy(buffer+sizeof(t_packet_header), (u8*)s_pPHDownstreamInfoRC, sizeof(t_packet_header_rc_info_downstream));
+      _rc_info_add_latency_percentiles((t_packet_header_rc_info_downstream*)(buffer+sizeof(t_packet_header)));
       
       if ( g_bRouterReady && (! s_bRadioInterfacesReinitIsInProgress) )
       {
@@ -1432,6 +1620,7 @@ void _init_telemetry_structures()
 }
 
 void _main_loop();
+static void _main_loop_close_event_loop();
 
 void handle_sigint(int sig) 
 { 
@@ -1561,10 +1750,15 @@ int main(int argc, char *argv[])
 
    broadcast_vehicle_stats();
 
+   latency_stats_init_for_write(LATENCY_STATS_PROCESS_TELEMETRY_VEHICLE);
+
    _main_loop();
 
 
    log_line("Stopping...");
+
+   _main_loop_close_event_loop();
+   latency_stats_close();
    
    //shared_mem_video_frames_stats_close(s_pSM_VideoInfoStats);
    //shared_mem_video_frames_stats_radio_out_close(s_pSM_VideoInfoStatsRadioOut);
@@ -1573,6 +1767,7 @@ int main(int argc, char *argv[])
 
    #ifdef FEATURE_ENABLE_RC
    shared_mem_rc_downstream_info_close(s_pPHDownstreamInfoRC);
+   shared_mem_rc_last_frame_info_close(s_pSMRCLastFrameInfo);
    #endif
    
    ruby_close_ipc_channel(s_fIPCToRouter);
@@ -1594,6 +1789,149 @@ int main(int argc, char *argv[])
    return 0;
 }
 
+static void _main_loop_init_event_loop()
+{
+   s_bUseMainEventLoop = false;
+   if ( ! event_loop_init(&s_MainEventLoop) )
+   {
+      log_softerror_and_alarm("Main loop: failed to create event loop, using polling main loop.");
+      return;
+   }
+   s_iMainEventLoopSourceFCSerial = event_loop_add_source(&s_MainEventLoop, "fc-serial", telemetry_get_serial_port_file(), 0);
+   s_iMainEventLoopSourceDataLinkSerial = event_loop_add_source(&s_MainEventLoop, "datalink-serial", s_iSerialDataLinkFileHandle, 0);
+   // Used just for the counters
+   s_iMainEventLoopSourceIPC = event_loop_add_source(&s_MainEventLoop, "ipc", -1, 0);
+   s_uMainEventLoopFCSerialOpenTime = telemetry_last_time_opened();
+
+   // Opened read-write, so it never reports hang up when the RC rx process closes its end
+   s_iRCFramesNotifyFd = -1;
+   if ( (0 == mkfifo(FIFO_RUBY_RC_FRAMES_NOTIFY, 0666)) || (errno == EEXIST) )
+      s_iRCFramesNotifyFd = open(FIFO_RUBY_RC_FRAMES_NOTIFY, O_RDWR | O_NONBLOCK);
+   if ( s_iRCFramesNotifyFd < 0 )
+      log_softerror_and_alarm("Main loop: failed to open RC frames notification pipe (error: %d), RC frames are polled.", errno);
+   s_iMainEventLoopSourceRCFrames = event_loop_add_source(&s_MainEventLoop, "rc-frames", s_iRCFramesNotifyFd, 0);
+   s_iMainEventLoopSourceFCSerialWrite = event_loop_add_source(&s_MainEventLoop, "fc-serial-write", -1, EVENT_LOOP_SOURCE_FLAG_WRITE);
+   s_bUseMainEventLoop = true;
+   log_line("Main loop: using event loop.");
+}
+
+static void _main_loop_close_event_loop()
+{
+   if ( ! s_bUseMainEventLoop )
+      return;
+   s_bUseMainEventLoop = false;
+   event_loop_close(&s_MainEventLoop);
+   if ( s_iRCFramesNotifyFd >= 0 )
+      close(s_iRCFramesNotifyFd);
+   s_iRCFramesNotifyFd = -1;
+   if ( s_iFCSerialWriteFd >= 0 )
+      close(s_iFCSerialWriteFd);
+   s_iFCSerialWriteFd = -1;
+}
+
+// Waits for the FC serial port to be writable only while there is RC output pending for it
+
+static void _main_loop_update_fc_serial_write_source()
+{
+   if ( (s_iFCSerialWriteFd >= 0) && ((s_uFCSerialWriteFdOpenTime != telemetry_last_time_opened()) || (s_iRCOutputPendingBytes <= 0)) )
+   {
+      event_loop_set_source_fd(&s_MainEventLoop, s_iMainEventLoopSourceFCSerialWrite, -1);
+      close(s_iFCSerialWriteFd);
+      s_iFCSerialWriteFd = -1;
+   }
+   if ( (s_iRCOutputPendingBytes <= 0) || (telemetry_get_serial_port_file() < 0) )
+      return;
+   if ( s_iFCSerialWriteFd < 0 )
+   {
+      s_iFCSerialWriteFd = dup(telemetry_get_serial_port_file());
+      s_uFCSerialWriteFdOpenTime = telemetry_last_time_opened();
+   }
+   if ( s_iFCSerialWriteFd >= 0 )
+      event_loop_set_source_fd(&s_MainEventLoop, s_iMainEventLoopSourceFCSerialWrite, s_iFCSerialWriteFd);
+}
+
+// Returns true if the RC rx process notified new RC frames
+
+static bool _main_loop_on_rc_frames_notify()
+{
+   if ( (! s_bUseMainEventLoop) || (s_iRCFramesNotifyFd < 0) || (! event_loop_source_is_ready(&s_MainEventLoop, s_iMainEventLoopSourceRCFrames)) )
+      return false;
+   u8 uBuffer[64];
+   int iCount = 0;
+   int iRead = 0;
+   while ( (iRead = read(s_iRCFramesNotifyFd, uBuffer, sizeof(uBuffer))) > 0 )
+      iCount += iRead;
+   event_loop_on_source_processed(&s_MainEventLoop, s_iMainEventLoopSourceRCFrames, iCount, 0);
+   return (iCount > 0);
+}
+
+// Blocks until there is data on the serial ports, or the next IPC check or raw telemetry send is due, at most iMaxWaitMs
+
+static void _main_loop_wait_for_events(int iMaxWaitMs)
+{
+   if ( ! s_bUseMainEventLoop )
+   {
+      hardware_sleep_ms(iMaxWaitMs);
+      return;
+   }
+
+   // The FC serial port is reopened when telemetry stops; the new fd can have the same number as the old one
+   if ( s_uMainEventLoopFCSerialOpenTime != telemetry_last_time_opened() )
+   {
+      s_uMainEventLoopFCSerialOpenTime = telemetry_last_time_opened();
+      s_iMainEventLoopFCSerialEmptyWakeups = 0;
+      event_loop_set_source_fd(&s_MainEventLoop, s_iMainEventLoopSourceFCSerial, -1);
+   }
+   if ( s_iMainEventLoopFCSerialEmptyWakeups < TELEMETRY_MAIN_LOOP_MAX_EMPTY_SERIAL_WAKEUPS )
+      event_loop_set_source_fd(&s_MainEventLoop, s_iMainEventLoopSourceFCSerial, telemetry_get_serial_port_file());
+   if ( s_iMainEventLoopDataLinkSerialEmptyWakeups < TELEMETRY_MAIN_LOOP_MAX_EMPTY_SERIAL_WAKEUPS )
+      event_loop_set_source_fd(&s_MainEventLoop, s_iMainEventLoopSourceDataLinkSerial, s_iSerialDataLinkFileHandle);
+   _main_loop_update_fc_serial_write_source();
+
+   int iTimeoutMs = iMaxWaitMs;
+   if ( g_pCurrentModel->telemetry_params.fc_telemetry_type != TELEMETRY_TYPE_NONE )
+   if ( iTimeoutMs > TELEMETRY_MAIN_LOOP_IPC_CHECK_INTERVAL_MS )
+      iTimeoutMs = TELEMETRY_MAIN_LOOP_IPC_CHECK_INTERVAL_MS;
+   int iTimeToRawSendMs = telemetry_get_time_to_next_raw_send_ms();
+   if ( (iTimeToRawSendMs >= 0) && (iTimeToRawSendMs < iTimeoutMs) )
+      iTimeoutMs = iTimeToRawSendMs;
+
+   event_loop_wait(&s_MainEventLoop, iTimeoutMs);
+
+   static u32 s_uTimeLastMainEventLoopStats = 0;
+   u32 uTimeNow = get_current_timestamp_ms();
+   if ( uTimeNow >= s_uTimeLastMainEventLoopStats + 60000 )
+   {
+      if ( 0 != s_uTimeLastMainEventLoopStats )
+      {
+         event_loop_log_and_reset_stats(&s_MainEventLoop, "Telemetry main loop");
+         telemetry_log_and_reset_latency_stats();
+         if ( (0 != s_uRCOutputCountDelayed) || (0 != s_uRCOutputCountReplaced) )
+            log_line("RC output to FC: %u writes delayed (FC serial port busy), %u RC frames replaced by newer ones while waiting", s_uRCOutputCountDelayed, s_uRCOutputCountReplaced);
+         s_uRCOutputCountDelayed = 0;
+         s_uRCOutputCountReplaced = 0;
+      }
+      s_uTimeLastMainEventLoopStats = uTimeNow;
+   }
+}
+
+static void _main_loop_on_serial_read(int iSourceId, int iReadBytes, int* piEmptyWakeups)
+{
+   if ( (! s_bUseMainEventLoop) || (! event_loop_source_is_ready(&s_MainEventLoop, iSourceId)) )
+      return;
+   if ( iReadBytes > 0 )
+   {
+      *piEmptyWakeups = 0;
+      event_loop_on_source_processed(&s_MainEventLoop, iSourceId, iReadBytes, 0);
+      return;
+   }
+   (*piEmptyWakeups)++;
+   if ( *piEmptyWakeups < TELEMETRY_MAIN_LOOP_MAX_EMPTY_SERIAL_WAKEUPS )
+      return;
+   log_softerror_and_alarm("Main loop: serial port source %s is ready but has no data (port error?). Polling it instead.", s_MainEventLoop.sources[iSourceId].szName);
+   event_loop_set_source_fd(&s_MainEventLoop, iSourceId, -1);
+}
+
 void _main_loop()
 {
    int iSleepTime = 15;
@@ -1601,9 +1939,11 @@ void _main_loop()
    if ( g_pCurrentModel->telemetry_params.fc_telemetry_type == TELEMETRY_TYPE_NONE )
       iSleepTime = 50;
 
+   _main_loop_init_event_loop();
+
    while ( !g_bQuit )
    {
-      hardware_sleep_ms(iSleepTime);
+      _main_loop_wait_for_events(iSleepTime);
       g_TimeNow = get_current_timestamp_ms();
       u32 tTime0 = g_TimeNow;
 
@@ -1629,8 +1969,10 @@ void _main_loop()
             s_uTimeToAdjustBalanceInterupts = g_TimeNow + 2000;
          }
          iSleepTime = 15;
-         if ( telemetry_try_read_serial_port() > 0 )
+         int iReadBytes = telemetry_try_read_serial_port();
+         if ( iReadBytes > 0 )
             iSleepTime = 5;
+         _main_loop_on_serial_read(s_iMainEventLoopSourceFCSerial, iReadBytes, &s_iMainEventLoopFCSerialEmptyWakeups);
          telemetry_periodic_loop();
 
          if ( (0 != s_uTimeToAdjustBalanceInterupts) && (g_TimeNow > s_uTimeToAdjustBalanceInterupts) )
@@ -1642,7 +1984,7 @@ void _main_loop()
          }
       }
       
-      try_read_serial_datalink();
+      _main_loop_on_serial_read(s_iMainEventLoopSourceDataLinkSerial, try_read_serial_datalink(), &s_iMainEventLoopDataLinkSerialEmptyWakeups);
 
       if ( g_pCurrentModel->rc_params.rc_enabled )
       if ( NULL == s_pPHDownstreamInfoRC )
@@ -1656,9 +1998,23 @@ void _main_loop()
          #endif
       }
 
+      if ( g_pCurrentModel->rc_params.rc_enabled )
+      if ( NULL == s_pSMRCLastFrameInfo )
+      {
+         #ifdef FEATURE_ENABLE_RC
+         s_pSMRCLastFrameInfo = shared_mem_rc_last_frame_info_open_read();
+         #endif
+      }
+
       int maxMsgToRead = 10;
       while ( (maxMsgToRead > 0) && try_read_messages_from_router() )
          maxMsgToRead--;
+      if ( s_bUseMainEventLoop )
+         event_loop_on_source_processed(&s_MainEventLoop, s_iMainEventLoopSourceIPC, 10 - maxMsgToRead, 10);
+
+      _main_loop_on_rc_frames_notify();
+      if ( s_bUseMainEventLoop && event_loop_source_is_ready(&s_MainEventLoop, s_iMainEventLoopSourceFCSerialWrite) )
+         _rc_output_flush();
 
       if ( g_pCurrentModel->telemetry_params.fc_telemetry_type == TELEMETRY_TYPE_MAVLINK )
       if ( g_pCurrentModel->rc_params.rc_enabled )
@@ -34,10 +34,13 @@
 #include "telemetry_mavlink.h"
 #include "telemetry_ltm.h"
 #include "telemetry_msp.h"
+#include "telemetry_mavlink_downlink.h"
 #include "shared_vars.h"
 #include "timers.h"
 #include "../base/ruby_ipc.h"
 #include "../base/parse_fc_telemetry.h"
+#include "../base/hardware_serial.h"
+#include "../base/latency_stats.h"
 #include "../radio/radiopackets2.h"
 #include "../common/string_utils.h"
 
@@ -60,7 +63,18 @@ int s_iFCSerialTelemetryReadBytesPerSecond = 0;
 u8  telemetryBufferFromFC[RAW_TELEMETRY_MAX_BUFFER];
 int telemetryBufferFromFCMaxSize = RAW_TELEMETRY_MIN_SEND_LENGTH;
 int telemetryBufferFromFCFilledBytes = 0;
+int telemetryBufferFromFCFrameEndBytes = 0; // buffered bytes up to the end of the last complete MAVLink/LTM frame
 u32 telemetryBufferFromFCLastSendTime = 0;
+u32 telemetryBufferFromFCFirstByteTimeMicros = 0; // when the oldest buffered byte was read from the serial port
+u32 telemetryBufferFromFCLastByteTimeMicros = 0;
+
+// Raw telemetry latency, from reading the bytes from the FC serial port to handing them to the router
+u32 s_uRawTelemetryLatencyCountPackets = 0;
+u32 s_uRawTelemetryLatencyCountOnFrameEnd = 0;
+u32 s_uRawTelemetryLatencyCountOnFull = 0;
+u32 s_uRawTelemetryLatencyCountOnTimeout = 0;
+u32 s_uRawTelemetryLatencyTotalMicros = 0;
+u32 s_uRawTelemetryLatencyMaxMicros = 0;
 
 u32 s_uRawTelemetryDownloadTotalSend = 0;
 u32 s_uRawTelemetryDownloadSegmentIndex = 0;
@@ -104,6 +118,7 @@ void telemetry_init()
    if ( telemetryBufferFromFCMaxSize > RAW_TELEMETRY_MAX_BUFFER )
       telemetryBufferFromFCMaxSize = RAW_TELEMETRY_MAX_BUFFER;
    telemetryBufferFromFCFilledBytes = 0;
+   telemetryBufferFromFCFrameEndBytes = 0;
    telemetryBufferFromFCLastSendTime = g_TimeNow;
    log_line("[Telem] Telemetry from FC chunk size: %d", telemetryBufferFromFCMaxSize);
 }
@@ -159,13 +174,17 @@ bool telemetry_detect_serial_port_to_use()
    return false;
 }
 
-void _send_raw_telemetry_packet_to_controller()
-{
-   if ( ! g_bRouterReady )
-      return;
+// Sends the first iCountBytes of the raw telemetry buffer and keeps the rest (an incomplete frame) in the buffer
 
-   if ( (NULL == g_pCurrentModel) || (g_pCurrentModel->telemetry_params.fc_telemetry_type == TELEMETRY_TYPE_NONE) )
+void _send_raw_telemetry_packet_to_controller(int iCountBytes)
+{
+   // Nowhere to send it: drop it, so the buffer does not stay full
+   if ( (! g_bRouterReady) || (NULL == g_pCurrentModel) || (g_pCurrentModel->telemetry_params.fc_telemetry_type == TELEMETRY_TYPE_NONE) )
+   {
+      telemetryBufferFromFCFilledBytes = 0;
+      telemetryBufferFromFCFrameEndBytes = 0;
       return;
+   }
 
    if ( telemetryBufferFromFCFilledBytes <= 0 )
       return;
@@ -175,8 +194,10 @@ void _send_raw_telemetry_packet_to_controller()
       log_softerror_and_alarm("[Telem] Trying to send more raw telemetry data than expected to downlink: %d bytes, max expected: %d bytes. Sending only max allowed.", telemetryBufferFromFCFilledBytes, RAW_TELEMETRY_MAX_BUFFER);
       telemetryBufferFromFCFilledBytes = RAW_TELEMETRY_MAX_BUFFER;
    }
+   if ( (iCountBytes <= 0) || (iCountBytes > telemetryBufferFromFCFilledBytes) )
+      iCountBytes = telemetryBufferFromFCFilledBytes;
 
-   s_uRawTelemetryDownloadTotalSend += telemetryBufferFromFCFilledBytes;
+   s_uRawTelemetryDownloadTotalSend += iCountBytes;
 
    t_packet_header PH;
    t_packet_header_telemetry_raw PHTR;
@@ -184,7 +205,7 @@ void _send_raw_telemetry_packet_to_controller()
    radio_packet_init(&PH, PACKET_COMPONENT_TELEMETRY, PACKET_TYPE_TELEMETRY_RAW_DOWNLOAD, STREAM_ID_TELEMETRY);
    PH.vehicle_id_src = g_pCurrentModel->uVehicleId;
    PH.vehicle_id_dest = 0;
-   PH.total_length = sizeof(t_packet_header)+sizeof(t_packet_header_telemetry_raw) + telemetryBufferFromFCFilledBytes;
+   PH.total_length = sizeof(t_packet_header)+sizeof(t_packet_header_telemetry_raw) + iCountBytes;
       
    PHTR.telem_segment_index = s_uRawTelemetryDownloadSegmentIndex;
    PHTR.telem_total_data = s_uRawTelemetryDownloadTotalSend;
@@ -193,7 +214,7 @@ void _send_raw_telemetry_packet_to_controller()
    u8 buffer[MAX_PACKET_TOTAL_SIZE];
    memcpy(buffer, (u8*)&PH, sizeof(t_packet_header));
    memcpy(buffer+sizeof(t_packet_header), (u8*)&PHTR, sizeof(t_packet_header_telemetry_raw));
-   memcpy(buffer+sizeof(t_packet_header)+sizeof(t_packet_header_telemetry_raw), telemetryBufferFromFC, telemetryBufferFromFCFilledBytes);
+   memcpy(buffer+sizeof(t_packet_header)+sizeof(t_packet_header_telemetry_raw), telemetryBufferFromFC, iCountBytes);
    
    if ( g_bRouterReady && (! isRadioLinksInitInProgress()) )
    {
@@ -201,18 +222,48 @@ void _send_raw_telemetry_packet_to_controller()
       if ( result != PH.total_length )
          log_softerror_and_alarm("[Telem] Failed to send data to router. Sent result: %d", result );
       #ifdef LOG_RAW_TELEMETRY
-      log_line("[Raw_Telem] Sent raw telemetry packet to router, index %u, %d / %d bytes", PHTR.telem_segment_index, telemetryBufferFromFCFilledBytes, PH.total_length);
+      log_line("[Raw_Telem] Sent raw telemetry packet to router, index %u, %d / %d bytes", PHTR.telem_segment_index, iCountBytes, PH.total_length);
       #endif
+
+      u32 uTimeNowMicros = get_current_timestamp_micros();
+      u32 uLatencyMicros = uTimeNowMicros - telemetryBufferFromFCFirstByteTimeMicros;
+      latency_stats_add(LATENCY_STAGE_FC_SERIAL_TO_ROUTER, uLatencyMicros);
+      latency_stats_add(LATENCY_STAGE_FC_FRAME_TO_ROUTER, uTimeNowMicros - telemetryBufferFromFCLastByteTimeMicros);
+      s_uRawTelemetryLatencyCountPackets++;
+      s_uRawTelemetryLatencyTotalMicros += uLatencyMicros;
+      if ( uLatencyMicros > s_uRawTelemetryLatencyMaxMicros )
+         s_uRawTelemetryLatencyMaxMicros = uLatencyMicros;
    }
 
    telemetryBufferFromFCLastSendTime = g_TimeNow;
-   telemetryBufferFromFCFilledBytes = 0;
+   telemetryBufferFromFCFilledBytes -= iCountBytes;
+   if ( telemetryBufferFromFCFilledBytes > 0 )
+      memmove(telemetryBufferFromFC, &telemetryBufferFromFC[iCountBytes], telemetryBufferFromFCFilledBytes);
+   // The kept bytes arrived last, their read time is not tracked: count them from now
+   telemetryBufferFromFCFirstByteTimeMicros = get_current_timestamp_micros();
+   telemetryBufferFromFCFrameEndBytes = 0;
    s_uRawTelemetryDownloadSegmentIndex++;
 
    if ( NULL != g_pProcessStats )
       g_pProcessStats->lastIPCOutgoingTime = g_TimeNow;
 }
 
+void telemetry_log_and_reset_latency_stats()
+{
+   telemetry_mavlink_downlink_log_and_reset_stats();
+   if ( 0 == s_uRawTelemetryLatencyCountPackets )
+      return;
+   log_line("[Telem] Raw telemetry from FC to router: %u packets (%u on frame end, %u on full buffer, %u on timeout), latency avg %u us, max %u us",
+      s_uRawTelemetryLatencyCountPackets, s_uRawTelemetryLatencyCountOnFrameEnd, s_uRawTelemetryLatencyCountOnFull, s_uRawTelemetryLatencyCountOnTimeout,
+      s_uRawTelemetryLatencyTotalMicros / s_uRawTelemetryLatencyCountPackets, s_uRawTelemetryLatencyMaxMicros);
+   s_uRawTelemetryLatencyCountPackets = 0;
+   s_uRawTelemetryLatencyCountOnFrameEnd = 0;
+   s_uRawTelemetryLatencyCountOnFull = 0;
+   s_uRawTelemetryLatencyCountOnTimeout = 0;
+   s_uRawTelemetryLatencyTotalMicros = 0;
+   s_uRawTelemetryLatencyMaxMicros = 0;
+}
+
 
 // Returns the file id
 int telemetry_open_serial_port()
@@ -259,7 +310,13 @@ int telemetry_open_serial_port()
    if ( -1 == s_iTelemetrySerialPortFile )
       log_softerror_and_alarm("Failed to open serial port %s (%s) to flight controller.", pPortInfo->szName, pPortInfo->szPortDeviceName);
    else
+   {
       log_line("Opened serial port %s (%s) to flight controller successfully at baudrate: %d.", pPortInfo->szName, pPortInfo->szPortDeviceName, s_iCurrentTelemetrySerialPortSpeed);
+      if ( hardware_serial_set_low_latency(s_iTelemetrySerialPortFile) )
+         log_line("[Telem] Serial port to flight controller set to low latency mode.");
+      else
+         log_line("[Telem] Serial port to flight controller does not support low latency mode.");
+   }
 
    if ( g_pCurrentModel->telemetry_params.fc_telemetry_type == TELEMETRY_TYPE_MAVLINK )
       telemetry_mavlink_on_open_port(s_iTelemetrySerialPortFile);
@@ -344,7 +401,10 @@ bool _telemetry_must_send_raw_telemetry_to_controller()
    return false;
 }
 
-void _telemetry_addSerialDataToFCTelemetryBuffer(u8* pData, int dataLength)
+// iFrameEnd: offset in pData right after the last complete frame in it, -1 if none
+// When the buffer gets full, sends it up to the last complete frame, so frames are not split across packets (if possible)
+
+void _telemetry_addSerialDataToFCTelemetryBuffer(u8* pData, int dataLength, int iFrameEnd, u32 uReadTimeMicros)
 {
    if ( NULL == g_pCurrentModel )
       return;
@@ -352,23 +412,120 @@ void _telemetry_addSerialDataToFCTelemetryBuffer(u8* pData, int dataLength)
    if ( ! _telemetry_must_send_raw_telemetry_to_controller() )
       return;
 
+   telemetryBufferFromFCLastByteTimeMicros = uReadTimeMicros;
    while ( dataLength > 0 )
    {
+      if ( 0 == telemetryBufferFromFCFilledBytes )
+         telemetryBufferFromFCFirstByteTimeMicros = uReadTimeMicros;
+
       if ( telemetryBufferFromFCFilledBytes + dataLength < telemetryBufferFromFCMaxSize )
       {
          memcpy(&(telemetryBufferFromFC[telemetryBufferFromFCFilledBytes]), pData, dataLength);
+         if ( iFrameEnd > 0 )
+            telemetryBufferFromFCFrameEndBytes = telemetryBufferFromFCFilledBytes + iFrameEnd;
          telemetryBufferFromFCFilledBytes += dataLength;
          return;
       }
+
+      if ( telemetryBufferFromFCFrameEndBytes > 0 )
+      {
+         s_uRawTelemetryLatencyCountOnFull++;
+         _send_raw_telemetry_packet_to_controller(telemetryBufferFromFCFrameEndBytes);
+         continue;
+      }
+
       int chunkSize = telemetryBufferFromFCMaxSize-telemetryBufferFromFCFilledBytes;
+      if ( chunkSize > dataLength )
+         chunkSize = dataLength;
       memcpy(&(telemetryBufferFromFC[telemetryBufferFromFCFilledBytes]), pData, chunkSize);
+      if ( (iFrameEnd > 0) && (iFrameEnd <= chunkSize) )
+         telemetryBufferFromFCFrameEndBytes = telemetryBufferFromFCFilledBytes + iFrameEnd;
       telemetryBufferFromFCFilledBytes += chunkSize;
       pData += chunkSize;
       dataLength -= chunkSize;
-      _send_raw_telemetry_packet_to_controller();
+      iFrameEnd -= chunkSize;
+      if ( telemetryBufferFromFCFilledBytes >= telemetryBufferFromFCMaxSize )
+      {
+         s_uRawTelemetryLatencyCountOnFull++;
+         _send_raw_telemetry_packet_to_controller(telemetryBufferFromFCFrameEndBytes);
+      }
+   }
+}
+
+// Sends the buffered raw telemetry as soon as it ends on a complete frame;
+// data with no frame boundaries (unknown protocol) is sent when large enough or on timeout, as before.
+
+void _telemetry_check_send_raw_telemetry()
+{
+   if ( ! _telemetry_must_send_raw_telemetry_to_controller() )
+      return;
+
+   // Slow links only: the MAVLink downlink fills each packet, at the rate the links allow
+   if ( telemetry_mavlink_downlink_is_enabled() )
+   {
+      u32 uOldestTimeMicros = 0;
+      int iLength = telemetry_mavlink_downlink_get_packet_to_send(get_current_timestamp_ms(), telemetryBufferFromFC, RAW_TELEMETRY_MAX_BUFFER, &uOldestTimeMicros);
+      if ( iLength <= 0 )
+         return;
+      telemetryBufferFromFCFilledBytes = iLength;
+      telemetryBufferFromFCFrameEndBytes = iLength;
+      telemetryBufferFromFCFirstByteTimeMicros = uOldestTimeMicros;
+      s_uRawTelemetryLatencyCountOnFrameEnd++;
+      _send_raw_telemetry_packet_to_controller(iLength);
+      return;
+   }
+
+   if ( telemetryBufferFromFCFilledBytes <= 0 )
+      return;
+
+   if ( telemetryBufferFromFCFilledBytes >= RAW_TELEMETRY_MIN_SEND_LENGTH )
+   {
+      s_uRawTelemetryLatencyCountOnFull++;
+      _send_raw_telemetry_packet_to_controller(telemetryBufferFromFCFrameEndBytes);
+      return;
+   }
+   if ( telemetryBufferFromFCFrameEndBytes == telemetryBufferFromFCFilledBytes )
+   if ( get_current_timestamp_micros() - telemetryBufferFromFCFirstByteTimeMicros >= RAW_TELEMETRY_FRAME_FLUSH_MS * 1000 )
+   {
+      s_uRawTelemetryLatencyCountOnFrameEnd++;
+      _send_raw_telemetry_packet_to_controller(telemetryBufferFromFCFilledBytes);
+      return;
+   }
+   if ( g_TimeNow >= telemetryBufferFromFCLastSendTime + RAW_TELEMETRY_SEND_TIMEOUT )
+   {
+      s_uRawTelemetryLatencyCountOnTimeout++;
+      _send_raw_telemetry_packet_to_controller(telemetryBufferFromFCFilledBytes);
+   }
+}
+
+// Returns the time (in miliseconds) until the buffered raw telemetry must be sent, or -1 if nothing is pending
+
+int telemetry_get_time_to_next_raw_send_ms()
+{
+   if ( telemetry_mavlink_downlink_is_enabled() )
+   {
+      if ( ! _telemetry_must_send_raw_telemetry_to_controller() )
+         return -1;
+      return telemetry_mavlink_downlink_get_time_to_next_send_ms(get_current_timestamp_ms());
+   }
+   if ( (telemetryBufferFromFCFilledBytes <= 0) || (! _telemetry_must_send_raw_telemetry_to_controller()) )
+      return -1;
+   if ( telemetryBufferFromFCFrameEndBytes == telemetryBufferFromFCFilledBytes )
+   {
+      u32 uWaitedMicros = get_current_timestamp_micros() - telemetryBufferFromFCFirstByteTimeMicros;
+      if ( uWaitedMicros >= RAW_TELEMETRY_FRAME_FLUSH_MS * 1000 )
+         return 0;
+      return (int)((RAW_TELEMETRY_FRAME_FLUSH_MS * 1000 - uWaitedMicros + 999) / 1000);
    }
+   u32 uTimeNow = get_current_timestamp_ms();
+   if ( uTimeNow >= telemetryBufferFromFCLastSendTime + RAW_TELEMETRY_SEND_TIMEOUT )
+      return 0;
+   return (int)(telemetryBufferFromFCLastSendTime + RAW_TELEMETRY_SEND_TIMEOUT - uTimeNow);
 }
 
+// Reads all the data available now on the FC serial port (it never blocks).
+// Returns the number of bytes read.
+
 int telemetry_try_read_serial_port()
 {
    if ( NULL == g_pCurrentModel )
@@ -379,41 +536,52 @@ int telemetry_try_read_serial_port()
    if ( s_iTelemetrySerialPortFile < 0 )
       return -1;
 
-   struct timeval to;
-   to.tv_sec = 0;
-   to.tv_usec = 2000; // 2 ms
-
-   fd_set readset;   
-   FD_ZERO(&readset);
-   FD_SET(s_iTelemetrySerialPortFile, &readset);
-   
-   int res = select(s_iTelemetrySerialPortFile+1, &readset, NULL, NULL, &to);
-   if ( res <= 0 )
-      return 0;
-   if ( ! FD_ISSET(s_iTelemetrySerialPortFile, &readset) )
-      return 0;
-
-   int length = read(s_iTelemetrySerialPortFile, s_uTelemetrySerialInBuffer, 1023);
-   if ( length <= 0 )
-      return 0;
+   int iTotalRead = 0;
+   // Bound the reads per call, so a flood from the FC can't starve the other work of the main loop
+   for( int iReads=0; iReads<8; iReads++ )
+   {
+      int length = read(s_iTelemetrySerialPortFile, s_uTelemetrySerialInBuffer, sizeof(s_uTelemetrySerialInBuffer));
+      if ( length <= 0 )
+         break;
+      u32 uReadTimeMicros = get_current_timestamp_micros();
+      iTotalRead += length;
+
+      s_uRawTelemetryDownloadTotalReadFromSerial += length;
+      s_iFCSerialTelemetryReadBytesTempLastSecond += length;
+
+      bool bNewFCMessage = false;
+      int iFrameEnd = -1;
+      if ( g_pCurrentModel->telemetry_params.fc_telemetry_type == TELEMETRY_TYPE_MAVLINK )
+         bNewFCMessage = telemetry_mavlink_on_new_serial_data(s_uTelemetrySerialInBuffer, length);
+      if ( g_pCurrentModel->telemetry_params.fc_telemetry_type == TELEMETRY_TYPE_LTM )
+         bNewFCMessage = telemetry_mavlink_on_new_serial_data(s_uTelemetrySerialInBuffer, length);
+      if ( g_pCurrentModel->telemetry_params.fc_telemetry_type == TELEMETRY_TYPE_MSP )
+         bNewFCMessage = telemetry_msp_on_new_serial_data(s_uTelemetrySerialInBuffer, length);
+      if ( (g_pCurrentModel->telemetry_params.fc_telemetry_type == TELEMETRY_TYPE_MAVLINK) ||
+           (g_pCurrentModel->telemetry_params.fc_telemetry_type == TELEMETRY_TYPE_LTM) )
+         iFrameEnd = parse_telemetry_get_last_frame_end();
 
-   s_uRawTelemetryDownloadTotalReadFromSerial += length;
-   s_iFCSerialTelemetryReadBytesTempLastSecond += length;
+      if ( _telemetry_must_send_raw_telemetry_to_controller() )
+      {
+         if ( telemetry_mavlink_downlink_is_enabled() )
+         {
+            telemetryBufferFromFCLastByteTimeMicros = uReadTimeMicros;
+            telemetry_mavlink_downlink_add_serial_data(s_uTelemetrySerialInBuffer, length, uReadTimeMicros);
+         }
+         else
+            _telemetry_addSerialDataToFCTelemetryBuffer(s_uTelemetrySerialInBuffer, length, iFrameEnd, uReadTimeMicros);
+      }
 
-   if ( _telemetry_must_send_raw_telemetry_to_controller() )
-      _telemetry_addSerialDataToFCTelemetryBuffer(s_uTelemetrySerialInBuffer, length);
+      if ( bNewFCMessage )
+         s_CountMessagesFromFCPerSecondTemp++;
 
-   bool bNewFCMessage = false;
-   if ( g_pCurrentModel->telemetry_params.fc_telemetry_type == TELEMETRY_TYPE_MAVLINK )
-      bNewFCMessage = telemetry_mavlink_on_new_serial_data(s_uTelemetrySerialInBuffer, length);
-   if ( g_pCurrentModel->telemetry_params.fc_telemetry_type == TELEMETRY_TYPE_LTM )
-      bNewFCMessage = telemetry_mavlink_on_new_serial_data(s_uTelemetrySerialInBuffer, length);
-   if ( g_pCurrentModel->telemetry_params.fc_telemetry_type == TELEMETRY_TYPE_MSP )
-      bNewFCMessage = telemetry_msp_on_new_serial_data(s_uTelemetrySerialInBuffer, length);
+      if ( length < (int)sizeof(s_uTelemetrySerialInBuffer) )
+         break;
+   }
 
-   if ( bNewFCMessage )
-      s_CountMessagesFromFCPerSecondTemp++;
-   return length;
+   if ( iTotalRead > 0 )
+      _telemetry_check_send_raw_telemetry();
+   return iTotalRead;
 }
 
 void telemetry_periodic_loop()
@@ -455,8 +623,5 @@ void telemetry_periodic_loop()
          telemetry_mavlink_on_second_lapse();
    }
 
-   if ( _telemetry_must_send_raw_telemetry_to_controller() )
-   if ( (telemetryBufferFromFCFilledBytes >= RAW_TELEMETRY_MIN_SEND_LENGTH) || 
-       ( (telemetryBufferFromFCFilledBytes > 0) && (g_TimeNow >= telemetryBufferFromFCLastSendTime + RAW_TELEMETRY_SEND_TIMEOUT) ) )
-      _send_raw_telemetry_packet_to_controller();
+   _telemetry_check_send_raw_telemetry();
 }
\ No newline at end of file
@@ -15,6 +15,8 @@ int telemetry_get_serial_port_file();
 
 int telemetry_try_read_serial_port();
 void telemetry_periodic_loop();
+int telemetry_get_time_to_next_raw_send_ms();
+void telemetry_log_and_reset_latency_stats();
 
 t_packet_header_fc_telemetry* telemetry_get_fc_telemetry_header();
 t_packet_header_fc_extra* telemetry_get_fc_extra_telemetry_header();
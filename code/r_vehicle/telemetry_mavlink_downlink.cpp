@@ -0,0 +1,451 @@
+/*
+    Ruby Licence
+    Copyright (c) 2025 Petru Soroaga
+    All rights reserved.
+
+    Redistribution and/or use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions and/or use of the source code (partially or complete) must retain
+        the above copyright notice, this list of conditions and the following disclaimer
+        in the documentation and/or other materials provided with the distribution.
+        * Redistributions in binary form (partially or complete) must reproduce
+        the above copyright notice, this list of conditions and the following disclaimer
+        in the documentation and/or other materials provided with the distribution.
+         * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+       * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permitted.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "telemetry_mavlink_downlink.h"
+#include "../base/models.h"
+#include "../base/hardware_radio.h"
+#include "../radio/radiolink.h"
+#include "../radio/radiopackets2.h"
+#include "../../mavlink/common/mavlink.h"
+#include "shared_vars.h"
+
+#define MAVLINK_DOWNLINK_CHANNEL MAVLINK_COMM_1
+#define MAVLINK_DOWNLINK_MAX_QUEUED_MESSAGES 16 // per in order priority queue
+#define MAVLINK_DOWNLINK_MAX_STATE_MESSAGES 64
+#define MAVLINK_DOWNLINK_SEND_INTERVAL_MARGIN 10 // percent added to the slow link packet interval
+
+#define MAVLINK_DOWNLINK_PRIORITY_CRITICAL 0
+#define MAVLINK_DOWNLINK_PRIORITY_RELIABLE 1
+#define MAVLINK_DOWNLINK_PRIORITY_STATE 2
+
+typedef struct
+{
+   u8 uData[MAVLINK_MAX_PACKET_LEN];
+   u16 uLength;
+   u8 uSysId;
+   u8 uCompId;
+   u32 uMsgId;
+   u32 uReadTimeMicros;
+   u32 uLastSentTime; // state messages only
+   bool bPending;
+} type_mavlink_downlink_message;
+
+typedef struct
+{
+   type_mavlink_downlink_message messages[MAVLINK_DOWNLINK_MAX_QUEUED_MESSAGES];
+   int iFirst;
+   int iCount;
+} type_mavlink_downlink_queue;
+
+static bool s_bMAVLinkDownlinkEnabled = false;
+static int s_iMAVLinkDownlinkMaxPacketBytes = 0;
+static u32 s_uMAVLinkDownlinkSendIntervalMs = 0;
+static u32 s_uMAVLinkDownlinkNextSendTime = 0;
+
+static mavlink_message_t s_MAVLinkDownlinkMessage;
+static mavlink_status_t s_MAVLinkDownlinkStatus;
+// Bytes of the frame being parsed, as received from the FC
+static u8 s_uMAVLinkDownlinkFrame[MAVLINK_MAX_PACKET_LEN];
+static int s_iMAVLinkDownlinkFrameLength = 0;
+
+static type_mavlink_downlink_queue s_MAVLinkDownlinkQueues[2]; // critical, reliable
+static type_mavlink_downlink_message s_MAVLinkDownlinkStateMessages[MAVLINK_DOWNLINK_MAX_STATE_MESSAGES];
+static int s_iMAVLinkDownlinkStateMessagesCount = 0;
+static int s_iMAVLinkDownlinkPendingStateMessages = 0;
+
+static u32 s_uMAVLinkDownlinkStatsMessagesIn = 0;
+static u32 s_uMAVLinkDownlinkStatsBytesIn = 0;
+static u32 s_uMAVLinkDownlinkStatsMessagesOut = 0;
+static u32 s_uMAVLinkDownlinkStatsBytesOut = 0;
+static u32 s_uMAVLinkDownlinkStatsPacketsOut = 0;
+static u32 s_uMAVLinkDownlinkStatsCoalesced = 0;
+static u32 s_uMAVLinkDownlinkStatsDroppedOverflow = 0;
+static u32 s_uMAVLinkDownlinkStatsDroppedOversize = 0;
+static u32 s_uMAVLinkDownlinkStatsDroppedBadCRC = 0;
+static u32 s_uMAVLinkDownlinkStatsUnknownMessages = 0;
+
+static int _mavlink_downlink_get_priority(u32 uMsgId)
+{
+   switch ( uMsgId )
+   {
+      case MAVLINK_MSG_ID_STATUSTEXT:
+      case MAVLINK_MSG_ID_COMMAND_ACK:
+      case MAVLINK_MSG_ID_MISSION_ACK:
+         return MAVLINK_DOWNLINK_PRIORITY_CRITICAL;
+
+      case MAVLINK_MSG_ID_PARAM_VALUE:
+      case MAVLINK_MSG_ID_MISSION_ITEM:
+      case MAVLINK_MSG_ID_MISSION_ITEM_INT:
+      case MAVLINK_MSG_ID_MISSION_REQUEST:
+      case MAVLINK_MSG_ID_MISSION_REQUEST_INT:
+      case MAVLINK_MSG_ID_MISSION_COUNT:
+      case MAVLINK_MSG_ID_MISSION_ITEM_REACHED:
+      case MAVLINK_MSG_ID_COMMAND_LONG:
+      case MAVLINK_MSG_ID_COMMAND_INT:
+      case MAVLINK_MSG_ID_FILE_TRANSFER_PROTOCOL:
+      case MAVLINK_MSG_ID_LOG_ENTRY:
+      case MAVLINK_MSG_ID_LOG_DATA:
+         return MAVLINK_DOWNLINK_PRIORITY_RELIABLE;
+   }
+   return MAVLINK_DOWNLINK_PRIORITY_STATE;
+}
+
+static void _mavlink_downlink_reset_queues()
+{
+   memset(s_MAVLinkDownlinkQueues, 0, sizeof(s_MAVLinkDownlinkQueues));
+   s_iMAVLinkDownlinkStateMessagesCount = 0;
+   s_iMAVLinkDownlinkPendingStateMessages = 0;
+   memset(&s_MAVLinkDownlinkStatus, 0, sizeof(s_MAVLinkDownlinkStatus));
+   mavlink_reset_channel_status(MAVLINK_DOWNLINK_CHANNEL);
+   s_iMAVLinkDownlinkFrameLength = 0;
+}
+
+void telemetry_mavlink_downlink_init()
+{
+   bool bWasEnabled = s_bMAVLinkDownlinkEnabled;
+   s_bMAVLinkDownlinkEnabled = false;
+   if ( NULL == g_pCurrentModel )
+      return;
+   if ( g_pCurrentModel->telemetry_params.fc_telemetry_type != TELEMETRY_TYPE_MAVLINK )
+      return;
+
+   int iCountSlowLinks = 0;
+   int iCountFastLinks = 0;
+   u32 uMaxBytesPerSec = MAX_U32;
+   for( int i=0; i<g_pCurrentModel->radioLinksParams.links_count; i++ )
+   {
+      u32 uFlags = g_pCurrentModel->radioLinksParams.link_capabilities_flags[i];
+      if ( uFlags & RADIO_HW_CAPABILITY_FLAG_DISABLED )
+         continue;
+      if ( !(uFlags & RADIO_HW_CAPABILITY_FLAG_CAN_TX) )
+         continue;
+      if ( !(uFlags & RADIO_HW_CAPABILITY_FLAG_CAN_USE_FOR_DATA) )
+         continue;
+      if ( ! (g_pCurrentModel->radioLinkIsSiKRadio(i) || g_pCurrentModel->radioLinkIsELRSRadio(i)) )
+      {
+         iCountFastLinks++;
+         continue;
+      }
+      iCountSlowLinks++;
+      // Raw telemetry gets at most half of the tx load allowed on the slow link by the router
+      int iAirRateBytes = g_pCurrentModel->radioLinksParams.link_datarate_data_bps[i]/8;
+      if ( iAirRateBytes > 0 )
+      {
+         u32 uBytesPerSec = ((u32)iAirRateBytes * DEFAULT_RADIO_SERIAL_MAX_TX_LOAD) / 200;
+         if ( uBytesPerSec < uMaxBytesPerSec )
+            uMaxBytesPerSec = uBytesPerSec;
+      }
+   }
+
+   if ( (0 == iCountSlowLinks) || (0 != iCountFastLinks) )
+   {
+      if ( bWasEnabled )
+         log_line("[TelemMAVDown] Disabled (%d slow links, %d high capacity links).", iCountSlowLinks, iCountFastLinks);
+      return;
+   }
+
+   u32 uIntervalMs = radio_get_slow_link_packet_interval(PACKET_TYPE_TELEMETRY_RAW_DOWNLOAD, 0);
+   if ( MAX_U32 == uIntervalMs )
+   {
+      log_line("[TelemMAVDown] Raw telemetry is not sent on slow links. Disabled.");
+      return;
+   }
+
+   s_iMAVLinkDownlinkMaxPacketBytes = RADIO_SLOW_LINK_MAX_PACKET_LENGTH - sizeof(t_packet_header) - sizeof(t_packet_header_telemetry_raw);
+   if ( s_iMAVLinkDownlinkMaxPacketBytes > RAW_TELEMETRY_MAX_BUFFER )
+      s_iMAVLinkDownlinkMaxPacketBytes = RAW_TELEMETRY_MAX_BUFFER;
+
+   // The router drops packets sent faster than the slow link interval: keep a margin over it
+   s_uMAVLinkDownlinkSendIntervalMs = uIntervalMs + (uIntervalMs * MAVLINK_DOWNLINK_SEND_INTERVAL_MARGIN) / 100;
+   if ( (MAX_U32 != uMaxBytesPerSec) && (uMaxBytesPerSec > 0) )
+   {
+      u32 uMinIntervalMs = (RADIO_SLOW_LINK_MAX_PACKET_LENGTH * 1000) / uMaxBytesPerSec;
+      if ( uMinIntervalMs > s_uMAVLinkDownlinkSendIntervalMs )
+         s_uMAVLinkDownlinkSendIntervalMs = uMinIntervalMs;
+   }
+   if ( s_uMAVLinkDownlinkSendIntervalMs < 1 )
+      s_uMAVLinkDownlinkSendIntervalMs = 1;
+
+   if ( ! bWasEnabled )
+   {
+      _mavlink_downlink_reset_queues();
+      s_uMAVLinkDownlinkNextSendTime = 0;
+   }
+   s_bMAVLinkDownlinkEnabled = true;
+   log_line("[TelemMAVDown] Enabled on %d slow links: up to %d bytes every %u ms (%u bytes/sec)",
+      iCountSlowLinks, s_iMAVLinkDownlinkMaxPacketBytes, s_uMAVLinkDownlinkSendIntervalMs,
+      ((u32)s_iMAVLinkDownlinkMaxPacketBytes * 1000) / s_uMAVLinkDownlinkSendIntervalMs);
+}
+
+bool telemetry_mavlink_downlink_is_enabled()
+{
+   return s_bMAVLinkDownlinkEnabled;
+}
+
+static void _mavlink_downlink_copy_message(type_mavlink_downlink_message* pMessage, u8* pData, int iLength, u32 uReadTimeMicros)
+{
+   memcpy(pMessage->uData, pData, iLength);
+   pMessage->uLength = (u16)iLength;
+   pMessage->uSysId = s_MAVLinkDownlinkMessage.sysid;
+   pMessage->uCompId = s_MAVLinkDownlinkMessage.compid;
+   pMessage->uMsgId = s_MAVLinkDownlinkMessage.msgid;
+   pMessage->uReadTimeMicros = uReadTimeMicros;
+}
+
+static void _mavlink_downlink_queue_message(type_mavlink_downlink_queue* pQueue, u8* pData, int iLength, u32 uReadTimeMicros)
+{
+   // Full: drop the oldest one, the newest ones are more relevant
+   if ( pQueue->iCount >= MAVLINK_DOWNLINK_MAX_QUEUED_MESSAGES )
+   {
+      pQueue->iFirst = (pQueue->iFirst + 1) % MAVLINK_DOWNLINK_MAX_QUEUED_MESSAGES;
+      pQueue->iCount--;
+      s_uMAVLinkDownlinkStatsDroppedOverflow++;
+   }
+   int iIndex = (pQueue->iFirst + pQueue->iCount) % MAVLINK_DOWNLINK_MAX_QUEUED_MESSAGES;
+   _mavlink_downlink_copy_message(&pQueue->messages[iIndex], pData, iLength, uReadTimeMicros);
+   pQueue->messages[iIndex].bPending = true;
+   pQueue->iCount++;
+}
+
+static void _mavlink_downlink_store_state_message(u8* pData, int iLength, u32 uReadTimeMicros)
+{
+   int iFreeIndex = -1;
+   for( int i=0; i<s_iMAVLinkDownlinkStateMessagesCount; i++ )
+   {
+      type_mavlink_downlink_message* pMessage = &s_MAVLinkDownlinkStateMessages[i];
+      if ( (pMessage->uMsgId != s_MAVLinkDownlinkMessage.msgid) ||
+           (pMessage->uSysId != s_MAVLinkDownlinkMessage.sysid) ||
+           (pMessage->uCompId != s_MAVLinkDownlinkMessage.compid) )
+      {
+         if ( (! pMessage->bPending) && ((-1 == iFreeIndex) || (pMessage->uLastSentTime < s_MAVLinkDownlinkStateMessages[iFreeIndex].uLastSentTime)) )
+            iFreeIndex = i;
+         continue;
+      }
+      if ( pMessage->bPending )
+         s_uMAVLinkDownlinkStatsCoalesced++;
+      else
+         s_iMAVLinkDownlinkPendingStateMessages++;
+      _mavlink_downlink_copy_message(pMessage, pData, iLength, uReadTimeMicros);
+      pMessage->bPending = true;
+      return;
+   }
+
+   // New message type: use a free slot, or the least recently sent one that has nothing pending
+   if ( s_iMAVLinkDownlinkStateMessagesCount < MAVLINK_DOWNLINK_MAX_STATE_MESSAGES )
+   {
+      iFreeIndex = s_iMAVLinkDownlinkStateMessagesCount;
+      s_iMAVLinkDownlinkStateMessagesCount++;
+      s_MAVLinkDownlinkStateMessages[iFreeIndex].uLastSentTime = 0;
+   }
+   if ( -1 == iFreeIndex )
+   {
+      s_uMAVLinkDownlinkStatsDroppedOverflow++;
+      return;
+   }
+   _mavlink_downlink_copy_message(&s_MAVLinkDownlinkStateMessages[iFreeIndex], pData, iLength, uReadTimeMicros);
+   s_MAVLinkDownlinkStateMessages[iFreeIndex].bPending = true;
+   s_iMAVLinkDownlinkPendingStateMessages++;
+}
+
+void telemetry_mavlink_downlink_add_serial_data(u8* pData, int iDataLength, u32 uReadTimeMicros)
+{
+   if ( (! s_bMAVLinkDownlinkEnabled) || (NULL == pData) || (iDataLength <= 0) )
+      return;
+
+   s_uMAVLinkDownlinkStatsBytesIn += iDataLength;
+   for( int i=0; i<iDataLength; i++ )
+   {
+      u8 uResult = mavlink_frame_char(MAVLINK_DOWNLINK_CHANNEL, pData[i], &s_MAVLinkDownlinkMessage, &s_MAVLinkDownlinkStatus);
+
+      // Keep the frame bytes as received, they are forwarded as they are
+      if ( MAVLINK_PARSE_STATE_GOT_STX == s_MAVLinkDownlinkStatus.parse_state )
+         s_iMAVLinkDownlinkFrameLength = 0;
+      if ( s_iMAVLinkDownlinkFrameLength < MAVLINK_MAX_PACKET_LEN )
+         s_uMAVLinkDownlinkFrame[s_iMAVLinkDownlinkFrameLength++] = pData[i];
+
+      if ( MAVLINK_FRAMING_INCOMPLETE == uResult )
+      {
+         if ( MAVLINK_PARSE_STATE_IDLE == s_MAVLinkDownlinkStatus.parse_state )
+            s_iMAVLinkDownlinkFrameLength = 0;
+         continue;
+      }
+
+      int iLength = s_iMAVLinkDownlinkFrameLength;
+      s_iMAVLinkDownlinkFrameLength = 0;
+      s_uMAVLinkDownlinkStatsMessagesIn++;
+
+      int iPriority = _mavlink_downlink_get_priority(s_MAVLinkDownlinkMessage.msgid);
+      if ( MAVLINK_FRAMING_BAD_CRC == uResult )
+      {
+         // A message id not in our dialect can't have its CRC checked (no CRC extra for it):
+         // pass it through as is, in order, as the GCS might know it
+         if ( NULL != mavlink_get_msg_entry(s_MAVLinkDownlinkMessage.msgid) )
+         {
+            s_uMAVLinkDownlinkStatsDroppedBadCRC++;
+            continue;
+         }
+         s_uMAVLinkDownlinkStatsUnknownMessages++;
+         iPriority = MAVLINK_DOWNLINK_PRIORITY_RELIABLE;
+      }
+
+      if ( iLength > s_iMAVLinkDownlinkMaxPacketBytes )
+      {
+         s_uMAVLinkDownlinkStatsDroppedOversize++;
+         continue;
+      }
+      if ( MAVLINK_DOWNLINK_PRIORITY_STATE == iPriority )
+         _mavlink_downlink_store_state_message(s_uMAVLinkDownlinkFrame, iLength, uReadTimeMicros);
+      else
+         _mavlink_downlink_queue_message(&s_MAVLinkDownlinkQueues[iPriority], s_uMAVLinkDownlinkFrame, iLength, uReadTimeMicros);
+   }
+}
+
+static bool _mavlink_downlink_has_pending()
+{
+   return (s_MAVLinkDownlinkQueues[0].iCount > 0) || (s_MAVLinkDownlinkQueues[1].iCount > 0) || (s_iMAVLinkDownlinkPendingStateMessages > 0);
+}
+
+static void _mavlink_downlink_output_message(type_mavlink_downlink_message* pMessage, u8* pOutput, int* piOutputLength, u32* puOldestTimeMicros)
+{
+   memcpy(pOutput + *piOutputLength, pMessage->uData, pMessage->uLength);
+   *piOutputLength += pMessage->uLength;
+   if ( (0 == *puOldestTimeMicros) || ((int)(pMessage->uReadTimeMicros - *puOldestTimeMicros) < 0) )
+      *puOldestTimeMicros = pMessage->uReadTimeMicros;
+   s_uMAVLinkDownlinkStatsMessagesOut++;
+   s_uMAVLinkDownlinkStatsBytesOut += pMessage->uLength;
+}
+
+int telemetry_mavlink_downlink_get_packet_to_send(u32 uTimeNow, u8* pOutput, int iMaxLength, u32* puOldestTimeMicros)
+{
+   if ( (! s_bMAVLinkDownlinkEnabled) || (NULL == pOutput) )
+      return 0;
+   if ( uTimeNow < s_uMAVLinkDownlinkNextSendTime )
+      return 0;
+   if ( ! _mavlink_downlink_has_pending() )
+      return 0;
+
+   if ( iMaxLength > s_iMAVLinkDownlinkMaxPacketBytes )
+      iMaxLength = s_iMAVLinkDownlinkMaxPacketBytes;
+
+   int iLength = 0;
+   u32 uOldestTimeMicros = 0;
+
+   // In order queues: stop at the first message that does not fit, to keep the order
+   for( int iPriority=0; iPriority<2; iPriority++ )
+   {
+      type_mavlink_downlink_queue* pQueue = &s_MAVLinkDownlinkQueues[iPriority];
+      while ( pQueue->iCount > 0 )
+      {
+         type_mavlink_downlink_message* pMessage = &pQueue->messages[pQueue->iFirst];
+         if ( iLength + pMessage->uLength > iMaxLength )
+            break;
+         _mavlink_downlink_output_message(pMessage, pOutput, &iLength, &uOldestTimeMicros);
+         pMessage->bPending = false;
+         pQueue->iFirst = (pQueue->iFirst + 1) % MAVLINK_DOWNLINK_MAX_QUEUED_MESSAGES;
+         pQueue->iCount--;
+      }
+   }
+
+   // State messages: least recently sent first, heartbeats before anything else
+   while ( s_iMAVLinkDownlinkPendingStateMessages > 0 )
+   {
+      int iBest = -1;
+      for( int i=0; i<s_iMAVLinkDownlinkStateMessagesCount; i++ )
+      {
+         type_mavlink_downlink_message* pMessage = &s_MAVLinkDownlinkStateMessages[i];
+         if ( ! pMessage->bPending )
+            continue;
+         if ( iLength + pMessage->uLength > iMaxLength )
+            continue;
+         if ( -1 == iBest )
+         {
+            iBest = i;
+            continue;
+         }
+         bool bIsHeartbeat = (MAVLINK_MSG_ID_HEARTBEAT == pMessage->uMsgId);
+         bool bBestIsHeartbeat = (MAVLINK_MSG_ID_HEARTBEAT == s_MAVLinkDownlinkStateMessages[iBest].uMsgId);
+         if ( bIsHeartbeat != bBestIsHeartbeat )
+         {
+            if ( bIsHeartbeat )
+               iBest = i;
+            continue;
+         }
+         if ( pMessage->uLastSentTime < s_MAVLinkDownlinkStateMessages[iBest].uLastSentTime )
+            iBest = i;
+      }
+      if ( -1 == iBest )
+         break;
+      type_mavlink_downlink_message* pMessage = &s_MAVLinkDownlinkStateMessages[iBest];
+      _mavlink_downlink_output_message(pMessage, pOutput, &iLength, &uOldestTimeMicros);
+      pMessage->bPending = false;
+      pMessage->uLastSentTime = uTimeNow;
+      s_iMAVLinkDownlinkPendingStateMessages--;
+   }
+
+   if ( 0 == iLength )
+      return 0;
+
+   s_uMAVLinkDownlinkStatsPacketsOut++;
+   s_uMAVLinkDownlinkNextSendTime = uTimeNow + s_uMAVLinkDownlinkSendIntervalMs;
+   if ( NULL != puOldestTimeMicros )
+      *puOldestTimeMicros = uOldestTimeMicros;
+   return iLength;
+}
+
+int telemetry_mavlink_downlink_get_time_to_next_send_ms(u32 uTimeNow)
+{
+   if ( (! s_bMAVLinkDownlinkEnabled) || (! _mavlink_downlink_has_pending()) )
+      return -1;
+   if ( uTimeNow >= s_uMAVLinkDownlinkNextSendTime )
+      return 0;
+   return (int)(s_uMAVLinkDownlinkNextSendTime - uTimeNow);
+}
+
+void telemetry_mavlink_downlink_log_and_reset_stats()
+{
+   if ( ! s_bMAVLinkDownlinkEnabled )
+      return;
+   log_line("[TelemMAVDown] In: %u msg (%u bytes, %u unknown), out: %u msg (%u bytes) in %u packets, coalesced: %u, dropped: %u on overflow, %u oversize, %u bad CRC",
+      s_uMAVLinkDownlinkStatsMessagesIn, s_uMAVLinkDownlinkStatsBytesIn, s_uMAVLinkDownlinkStatsUnknownMessages,
+      s_uMAVLinkDownlinkStatsMessagesOut, s_uMAVLinkDownlinkStatsBytesOut, s_uMAVLinkDownlinkStatsPacketsOut,
+      s_uMAVLinkDownlinkStatsCoalesced, s_uMAVLinkDownlinkStatsDroppedOverflow, s_uMAVLinkDownlinkStatsDroppedOversize,
+      s_uMAVLinkDownlinkStatsDroppedBadCRC);
+   s_uMAVLinkDownlinkStatsMessagesIn = 0;
+   s_uMAVLinkDownlinkStatsBytesIn = 0;
+   s_uMAVLinkDownlinkStatsMessagesOut = 0;
+   s_uMAVLinkDownlinkStatsBytesOut = 0;
+   s_uMAVLinkDownlinkStatsPacketsOut = 0;
+   s_uMAVLinkDownlinkStatsCoalesced = 0;
+   s_uMAVLinkDownlinkStatsDroppedOverflow = 0;
+   s_uMAVLinkDownlinkStatsDroppedOversize = 0;
+   s_uMAVLinkDownlinkStatsDroppedBadCRC = 0;
+   s_uMAVLinkDownlinkStatsUnknownMessages = 0;
+}
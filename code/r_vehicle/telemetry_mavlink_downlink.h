@@ -0,0 +1,28 @@
+#pragma once
+#include "../base/base.h"
+#include "../base/config.h"
+
+// MAVLink aware downlink for slow (SiK/ELRS) radio links.
+// Instead of forwarding the raw FC bytes in buffer sized chunks, the FC stream is split into
+// MAVLink messages and each raw telemetry packet is filled, up to the slow link byte budget, with:
+//  1. critical messages (status text, command/mission acks), in order;
+//  2. reliable messages (params, mission items, commands), in order;
+//  3. state messages (attitude, position, heartbeat, ...): only the latest instance of each
+//     (system, component, message id) is kept; the least recently sent ones go first.
+// Frames are forwarded byte for byte as received from the FC. Frames of message ids not in our
+// dialect (their CRC can't be checked) go in order with the reliable ones; frames with a bad CRC are dropped.
+// It is enabled only when all the vehicle data radio links are slow links, as otherwise the
+// same raw telemetry packets are sent on the high capacity links too.
+
+void telemetry_mavlink_downlink_init();
+bool telemetry_mavlink_downlink_is_enabled();
+
+void telemetry_mavlink_downlink_add_serial_data(u8* pData, int iDataLength, u32 uReadTimeMicros);
+
+// Returns the number of bytes put in pOutput (0 if it's not time yet to send or nothing is pending)
+// puOldestTimeMicros: read time of the oldest message put in pOutput
+int telemetry_mavlink_downlink_get_packet_to_send(u32 uTimeNow, u8* pOutput, int iMaxLength, u32* puOldestTimeMicros);
+// Returns the time (in miliseconds) until the next packet can be sent, or -1 if nothing is pending
+int telemetry_mavlink_downlink_get_time_to_next_send_ms(u32 uTimeNow);
+
+void telemetry_mavlink_downlink_log_and_reset_stats();
@@ -269,6 +269,11 @@ void video_source_csi_flush_discard()
    log_line("[VideoSourceCSI] Flushed video stream input buffer (pipe) in %d reads, total %d bytes", iCount, iBytes);
 }
 
+int video_source_csi_get_pipe_fd()
+{
+   return s_fInputVideoStreamCSIPipe;
+}
+
 int video_source_csi_get_buffer_size()
 {
    return sizeof(s_uInputVideoCSIPipeBuffer)/sizeof(s_uInputVideoCSIPipeBuffer[0]);
@@ -1035,6 +1040,7 @@ void vehicle_update_camera_params_csi(Model* pModel, int iCameraIndex)
 void video_source_csi_close() {}
 int video_source_csi_open(const char* szPipeName) {return 0;}
 void video_source_csi_flush_discard() {}
+int video_source_csi_get_pipe_fd() {return -1;}
 int video_source_csi_get_buffer_size() {return 0;}
 u8* video_source_csi_read(int* piReadSize)
 {
@@ -5,6 +5,7 @@ void video_source_csi_close();
 int video_source_csi_open(const char* szPipeName);
 
 void video_source_csi_flush_discard();
+int video_source_csi_get_pipe_fd();
 int video_source_csi_get_buffer_size();
 
 // Returns the buffer and number of bytes read
@@ -787,6 +787,11 @@ void video_source_majestic_clear_input_buffers()
    log_line("[VideoSourceMaj] Done clearing input buffers. Cleared %d packets, total %d bytes.", iCount, iBytes);
 }
 
+int video_source_majestic_get_socket_fd()
+{
+   return s_fInputVideoStreamUDPSocket;
+}
+
 bool video_source_majestic_last_read_is_single_nal()
 {
    return s_bLastReadIsSingleNAL;
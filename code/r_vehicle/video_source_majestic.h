@@ -9,6 +9,7 @@ void video_source_majestic_start_and_configure();
 void video_source_majestic_cleanup();
 void video_source_majestic_close();
 int video_source_majestic_open(int iUDPPort);
+int video_source_majestic_get_socket_fd();
 u32 video_source_majestic_get_program_start_time();
 bool video_source_majestic_is_restarting();
 
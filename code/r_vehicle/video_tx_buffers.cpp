@@ -38,6 +38,7 @@
 #include "../common/string_utils.h"
 #include "../base/hardware_cam_maj.h"
 #include "../radio/fec.h"
+#include "../radio/radio_tx_batch.h"
 #include "adaptive_video.h"
 #include "processor_tx_video.h"
 #include "processor_relay.h"
@@ -70,6 +71,11 @@ VideoTxPacketsBuffer::VideoTxPacketsBuffer(int iVideoStreamIndex, int iCameraInd
    m_iVideoStreamIndex = iVideoStreamIndex;
    m_iCameraIndex = iCameraIndex;
 
+   for( int i=0; i<MAX_RXTX_BLOCKS_BUFFER; i++ )
+   {
+      m_pBlocksSlabs[i] = NULL;
+      m_iBlocksSlabsPackets[i] = 0;
+   }
    for( int i=0; i<MAX_RXTX_BLOCKS_BUFFER; i++ )
    for( int k=0; k<MAX_TOTAL_PACKETS_IN_BLOCK; k++ )
    {
@@ -80,6 +86,7 @@ VideoTxPacketsBuffer::VideoTxPacketsBuffer(int iVideoStreamIndex, int iCameraInd
       m_VideoPackets[i][k].pPHVSImp = NULL;
       m_VideoPackets[i][k].bEmpty = true;
    }
+   m_iTempVideoBufferFilledBytes = 0;
    m_uCurrentH264FrameIndex = 0;
    m_uCurrentH264NALIndex = 0;
    m_uCurrenltyParsedNAL = 0;
@@ -93,6 +100,7 @@ VideoTxPacketsBuffer::VideoTxPacketsBuffer(int iVideoStreamIndex, int iCameraInd
    m_uNextVideoBlockIndexToGenerate = 0;
    m_uNextVideoBlockPacketIndexToGenerate = 0;
    m_uRadioStreamPacketIndex = 0;
+   m_uTraceCaptureTimeMs = 0;
    m_iVideoStreamInfoIndex = 0;
    m_iUsableRawVideoDataSize = 0;
    memset(&m_PacketHeaderVideo, 0, sizeof(t_packet_header_video_segment));
@@ -109,11 +117,16 @@ VideoTxPacketsBuffer::~VideoTxPacketsBuffer()
    uninit();
 
    for( int i=0; i<MAX_RXTX_BLOCKS_BUFFER; i++ )
-   for( int k=0; k<MAX_TOTAL_PACKETS_IN_BLOCK; k++ )
    {
-      if ( NULL != m_VideoPackets[i][k].pRawData )
-         free(m_VideoPackets[i][k].pRawData);
+      if ( NULL != m_pBlocksSlabs[i] )
+         free(m_pBlocksSlabs[i]);
+      m_pBlocksSlabs[i] = NULL;
+      m_iBlocksSlabsPackets[i] = 0;
+   }
 
+   for( int i=0; i<MAX_RXTX_BLOCKS_BUFFER; i++ )
+   for( int k=0; k<MAX_TOTAL_PACKETS_IN_BLOCK; k++ )
+   {
       m_VideoPackets[i][k].pRawData = NULL;
       m_VideoPackets[i][k].pVideoData = NULL;
       m_VideoPackets[i][k].pPH = NULL;
@@ -179,25 +192,73 @@ void VideoTxPacketsBuffer::discardBuffer()
 }
 
 
+// Makes sure the block slab has room for the packet; grows it to the packets count of the current EC scheme.
+// Growing keeps the content of the packets already in the slab.
+
 void VideoTxPacketsBuffer::_checkAllocatePacket(int iBufferIndex, int iPacketIndex)
 {
    if ( (iBufferIndex < 0) || (iBufferIndex >= MAX_RXTX_BLOCKS_BUFFER) || (iPacketIndex < 0) || (iPacketIndex >= MAX_TOTAL_PACKETS_IN_BLOCK) )
       return;
-   if ( NULL != m_VideoPackets[iBufferIndex][iPacketIndex].pRawData )
+   if ( iPacketIndex < m_iBlocksSlabsPackets[iBufferIndex] )
       return;
 
-   u8* pRawData = (u8*)malloc(MAX_PACKET_TOTAL_SIZE);
-   if ( NULL == pRawData )
+   int iPacketsCount = iPacketIndex + 1;
+   if ( iPacketsCount < (int)(m_PacketHeaderVideo.uCurrentBlockDataPackets + m_PacketHeaderVideo.uCurrentBlockECPackets) )
+      iPacketsCount = m_PacketHeaderVideo.uCurrentBlockDataPackets + m_PacketHeaderVideo.uCurrentBlockECPackets;
+   if ( iPacketsCount < (int)(m_uNextBlockDataPackets + m_uNextBlockECPackets) )
+      iPacketsCount = m_uNextBlockDataPackets + m_uNextBlockECPackets;
+   if ( iPacketsCount > MAX_TOTAL_PACKETS_IN_BLOCK )
+      iPacketsCount = MAX_TOTAL_PACKETS_IN_BLOCK;
+
+   // The last filled in headers can be inside this slab: keep their offsets to move them with the slab
+   u8* pOldSlab = m_pBlocksSlabs[iBufferIndex];
+   int iOldSlabSize = m_iBlocksSlabsPackets[iBufferIndex] * VIDEO_TX_SLAB_PACKET_STRIDE;
+   long lOffsetHeaderVideo = -1;
+   long lOffsetHeaderVideoImportant = -1;
+   if ( NULL != pOldSlab )
+   {
+      if ( ((u8*)m_pLastPacketHeaderVideoFilldedIn >= pOldSlab) && ((u8*)m_pLastPacketHeaderVideoFilldedIn < pOldSlab + iOldSlabSize) )
+         lOffsetHeaderVideo = (u8*)m_pLastPacketHeaderVideoFilldedIn - pOldSlab;
+      if ( ((u8*)m_pLastPacketHeaderVideoImportantFilledIn >= pOldSlab) && ((u8*)m_pLastPacketHeaderVideoImportantFilledIn < pOldSlab + iOldSlabSize) )
+         lOffsetHeaderVideoImportant = (u8*)m_pLastPacketHeaderVideoImportantFilledIn - pOldSlab;
+   }
+
+   u8* pSlab = (u8*)realloc(pOldSlab, iPacketsCount * VIDEO_TX_SLAB_PACKET_STRIDE);
+   if ( NULL == pSlab )
    {
       log_error_and_alarm("Failed to allocate video buffer at index: [%d/%d]", iPacketIndex, iBufferIndex);
       return;
    }
-   m_VideoPackets[iBufferIndex][iPacketIndex].pRawData = pRawData;
-   m_VideoPackets[iBufferIndex][iPacketIndex].pVideoData = pRawData + sizeof(t_packet_header) + sizeof(t_packet_header_video_segment);
-   m_VideoPackets[iBufferIndex][iPacketIndex].pPH = (t_packet_header*)pRawData;
-   m_VideoPackets[iBufferIndex][iPacketIndex].pPHVS = (t_packet_header_video_segment*)(pRawData + sizeof(t_packet_header));
-   m_VideoPackets[iBufferIndex][iPacketIndex].pPHVSImp = (t_packet_header_video_segment_important*)(pRawData + sizeof(t_packet_header) + sizeof(t_packet_header_video_segment));
-   m_VideoPackets[iBufferIndex][iPacketIndex].bEmpty = true;
+
+   if ( lOffsetHeaderVideo >= 0 )
+      m_pLastPacketHeaderVideoFilldedIn = (t_packet_header_video_segment*)(pSlab + lOffsetHeaderVideo);
+   if ( lOffsetHeaderVideoImportant >= 0 )
+      m_pLastPacketHeaderVideoImportantFilledIn = (t_packet_header_video_segment_important*)(pSlab + lOffsetHeaderVideoImportant);
+
+   for( int i=0; i<iPacketsCount; i++ )
+   {
+      u8* pRawData = pSlab + i * VIDEO_TX_SLAB_PACKET_STRIDE + MAX_PACKET_RADIO_HEADERS;
+      m_VideoPackets[iBufferIndex][i].pRawData = pRawData;
+      m_VideoPackets[iBufferIndex][i].pVideoData = pRawData + sizeof(t_packet_header) + sizeof(t_packet_header_video_segment);
+      m_VideoPackets[iBufferIndex][i].pPH = (t_packet_header*)pRawData;
+      m_VideoPackets[iBufferIndex][i].pPHVS = (t_packet_header_video_segment*)(pRawData + sizeof(t_packet_header));
+      m_VideoPackets[iBufferIndex][i].pPHVSImp = (t_packet_header_video_segment_important*)(pRawData + sizeof(t_packet_header) + sizeof(t_packet_header_video_segment));
+      if ( i >= m_iBlocksSlabsPackets[iBufferIndex] )
+         m_VideoPackets[iBufferIndex][i].bEmpty = true;
+   }
+   m_pBlocksSlabs[iBufferIndex] = pSlab;
+   m_iBlocksSlabsPackets[iBufferIndex] = iPacketsCount;
+}
+
+// Where the next video data goes: after the m_iTempVideoBufferFilledBytes already written in the next packet to fill
+
+u8* VideoTxPacketsBuffer::_getVideoDataToFill()
+{
+   _checkAllocatePacket(m_iNextBufferIndexToFill, m_iNextBufferPacketIndexToFill);
+   u8* pVideoData = m_VideoPackets[m_iNextBufferIndexToFill][m_iNextBufferPacketIndexToFill].pVideoData;
+   if ( NULL == pVideoData )
+      return NULL;
+   return pVideoData + sizeof(t_packet_header_video_segment_important) + m_iTempVideoBufferFilledBytes;
 }
 
 void VideoTxPacketsBuffer::_fillVideoPacketHeaders(int iBufferIndex, int iPacketIndex, bool bIsECPacket, int iRawVideoDataSize, u32 uNALPresenceFlags, bool bEndOfTransmissionFrame)
@@ -253,6 +314,17 @@ void VideoTxPacketsBuffer::_fillVideoPacketHeaders(int iBufferIndex, int iPacket
    m_pLastPacketHeaderVideoFilldedIn->uCurrentBlockIndex = m_uNextVideoBlockIndexToGenerate;
    m_pLastPacketHeaderVideoFilldedIn->uCurrentBlockPacketIndex = m_uNextVideoBlockPacketIndexToGenerate;
 
+   m_pLastPacketHeaderVideoFilldedIn->uTraceId = 0;
+   m_pLastPacketHeaderVideoFilldedIn->uTraceTimes = 0;
+   if ( 0 != m_uTraceCaptureTimeMs )
+   {
+      u32 uDeltaEncode = get_current_timestamp_ms() - m_uTraceCaptureTimeMs;
+      if ( uDeltaEncode > VIDEO_TRACE_DELTA_MAX )
+         uDeltaEncode = VIDEO_TRACE_DELTA_MAX;
+      m_pLastPacketHeaderVideoFilldedIn->uTraceId = VIDEO_TRACE_ID_FLAG | (m_uCurrentH264FrameIndex & 0x7FFF);
+      m_pLastPacketHeaderVideoFilldedIn->uTraceTimes = (m_uTraceCaptureTimeMs & VIDEO_TRACE_TIME_MASK) | (uDeltaEncode << 20);
+   }
+
    int iVideoProfile = adaptive_video_get_current_active_video_profile();
    m_pLastPacketHeaderVideoFilldedIn->uCurrentVideoLinkProfile = iVideoProfile;
    
@@ -445,7 +517,10 @@ void VideoTxPacketsBuffer::fillVideoPacketsFromCSI(u8* pVideoData, int iDataSize
          else
             m_uTempBufferNALPresenceFlags |= VIDEO_PACKET_FLAGS_CONTAINS_I_NAL;
       }
-      memcpy(&m_TempVideoBuffer[m_iTempVideoBufferFilledBytes], pVideoDataLeft, iParsed);
+      u8* pVideoDestination = _getVideoDataToFill();
+      if ( NULL == pVideoDestination )
+         return;
+      memcpy(pVideoDestination, pVideoDataLeft, iParsed);
       m_iTempVideoBufferFilledBytes += iParsed;
 
       iDataSizeLeft -= iParsed;
@@ -458,9 +533,9 @@ void VideoTxPacketsBuffer::fillVideoPacketsFromCSI(u8* pVideoData, int iDataSize
             m_uTempBufferNALPresenceFlags |= VIDEO_PACKET_FLAGS_IS_END_OF_TRANSMISSION_FRAME;
          
          if ( iDataSizeLeft > 0 )
-            _addNewVideoPacket(m_TempVideoBuffer, m_iTempVideoBufferFilledBytes, m_uTempBufferNALPresenceFlags, false);
+            _addNewVideoPacket(NULL, m_iTempVideoBufferFilledBytes, m_uTempBufferNALPresenceFlags, false);
          else
-            _addNewVideoPacket(m_TempVideoBuffer, m_iTempVideoBufferFilledBytes, m_uTempBufferNALPresenceFlags, bEndOfFrame);
+            _addNewVideoPacket(NULL, m_iTempVideoBufferFilledBytes, m_uTempBufferNALPresenceFlags, bEndOfFrame);
          
          m_iTempVideoBufferFilledBytes = 0;
          m_uTempBufferNALPresenceFlags = 0;
@@ -499,7 +574,7 @@ bool VideoTxPacketsBuffer::fillVideoPacketsFromRTSPPacket(u8* pVideoRawData, int
          iRawDataSize, uNALType, m_iUsableRawVideoDataSize, m_iTempVideoBufferFilledBytes );
    
       if ( m_iTempVideoBufferFilledBytes > 0 )
-         _addNewVideoPacket(m_TempVideoBuffer, m_iTempVideoBufferFilledBytes, m_uTempBufferNALPresenceFlags, false);
+         _addNewVideoPacket(NULL, m_iTempVideoBufferFilledBytes, m_uTempBufferNALPresenceFlags, false);
       m_iTempVideoBufferFilledBytes = 0;
 
       if ( iRawDataSize > m_iUsableRawVideoDataSize )
@@ -511,7 +586,10 @@ bool VideoTxPacketsBuffer::fillVideoPacketsFromRTSPPacket(u8* pVideoRawData, int
       }
    }
 
-   memcpy(&m_TempVideoBuffer[m_iTempVideoBufferFilledBytes], pVideoRawData, iRawDataSize);
+   u8* pVideoDestination = _getVideoDataToFill();
+   if ( NULL == pVideoDestination )
+      return false;
+   memcpy(pVideoDestination, pVideoRawData, iRawDataSize);
    m_iTempVideoBufferFilledBytes += iRawDataSize;
 
    if ( uNALType == 7 )
@@ -526,7 +604,7 @@ bool VideoTxPacketsBuffer::fillVideoPacketsFromRTSPPacket(u8* pVideoRawData, int
       bEndOfFrameDetected = true;
       m_uTempBufferNALPresenceFlags |= VIDEO_PACKET_FLAGS_IS_END_OF_TRANSMISSION_FRAME;
    }
-   _addNewVideoPacket(m_TempVideoBuffer, m_iTempVideoBufferFilledBytes, m_uTempBufferNALPresenceFlags, bEndOfFrameDetected);
+   _addNewVideoPacket(NULL, m_iTempVideoBufferFilledBytes, m_uTempBufferNALPresenceFlags, bEndOfFrameDetected);
    
    m_iTempVideoBufferFilledBytes = 0;
    m_uTempBufferNALPresenceFlags = 0;
@@ -537,9 +615,11 @@ bool VideoTxPacketsBuffer::fillVideoPacketsFromRTSPPacket(u8* pVideoRawData, int
    return bEndOfFrameDetected;
 }
 
+// pRawVideoData is NULL if the video data is already in the next packet to fill
+
 void VideoTxPacketsBuffer::_addNewVideoPacket(u8* pRawVideoData, int iRawVideoDataSize, u32 uNALPresenceFlags, bool bEndOfTransmissionFrame)
 {
-   if ( (! m_bInitialized) || (NULL == pRawVideoData) || (iRawVideoDataSize <= 0) || (iRawVideoDataSize > MAX_PACKET_PAYLOAD) )
+   if ( (! m_bInitialized) || (iRawVideoDataSize <= 0) || (iRawVideoDataSize > MAX_PACKET_PAYLOAD) )
       return;
 
    _checkAllocatePacket(m_iNextBufferIndexToFill, m_iNextBufferPacketIndexToFill);
@@ -585,11 +665,13 @@ void VideoTxPacketsBuffer::_addNewVideoPacket(u8* pRawVideoData, int iRawVideoDa
    u8* pVideoDestination = m_VideoPackets[m_iNextBufferIndexToFill][m_iNextBufferPacketIndexToFill].pVideoData;
    pVideoDestination += sizeof(t_packet_header_video_segment_important);
 
-   memcpy(pVideoDestination, pRawVideoData, iRawVideoDataSize);
+   if ( NULL != pRawVideoData )
+      memcpy(pVideoDestination, pRawVideoData, iRawVideoDataSize);
    
    // Set remaining empty space in packet to 0 as EC uses the good video data packets too.
+   // EC is computed only on the block packet size.
    pVideoDestination += iRawVideoDataSize;
-   int iSizeToZero = MAX_PACKET_TOTAL_SIZE - sizeof(t_packet_header) - sizeof(t_packet_header_video_segment) - sizeof(t_packet_header_video_segment_important);
+   int iSizeToZero = pCurrentVideoPacketHeader->uCurrentBlockPacketSize - sizeof(t_packet_header_video_segment_important);
    iSizeToZero -= iRawVideoDataSize;
    if ( iSizeToZero > 0 )
       memset(pVideoDestination, 0, iSizeToZero);
@@ -682,6 +764,9 @@ bool VideoTxPacketsBuffer::_sendPacket(int iBufferIndex, int iPacketIndex, u32 u
    if ( pCurrentPacketHeader->total_length < sizeof(t_packet_header) + sizeof(t_packet_header_video_segment) + sizeof(t_packet_header_video_segment_important))
       return false;
 
+   // The packet can still be queued in the radio tx batch (i.e. single packet blocks are sent twice): send it before changing it
+   radio_tx_batch_flush_buffer(((u8*)pCurrentPacketHeader) - MAX_PACKET_RADIO_HEADERS, pCurrentPacketHeader->total_length + MAX_PACKET_RADIO_HEADERS);
+
    // stream_packet_idx: high 4 bits: stream id (0..15), lower 28 bits: stream packet index
    pCurrentPacketHeader->stream_packet_idx = m_uRadioStreamPacketIndex;
    pCurrentPacketHeader->stream_packet_idx &= PACKET_FLAGS_MASK_STREAM_PACKET_IDX;
@@ -720,7 +805,17 @@ bool VideoTxPacketsBuffer::_sendPacket(int iBufferIndex, int iPacketIndex, u32 u
    //pVideoData += sizeof(t_packet_header_video_full_98_debug_info);
    //u32 crc = base_compute_crc32(pVideoData, pCurrentVideoPacketHeader->uCurrentBlockPacketSize);
 
-   send_packet_to_radio_interfaces((u8*)pCurrentPacketHeader, pCurrentPacketHeader->total_length, -1);
+   if ( 0 != pCurrentVideoPacketHeader->uTraceId )
+   {
+      u32 uTraces = pCurrentVideoPacketHeader->uTraceTimes;
+      u32 uDeltaInject = (get_current_timestamp_ms() - VIDEO_TRACE_GET_CAPTURE_TIME(uTraces)) & VIDEO_TRACE_TIME_MASK;
+      uDeltaInject -= VIDEO_TRACE_GET_ENCODE_DELTA(uTraces);
+      if ( uDeltaInject > VIDEO_TRACE_DELTA_MAX )
+         uDeltaInject = VIDEO_TRACE_DELTA_MAX;
+      pCurrentVideoPacketHeader->uTraceTimes = (uTraces & ~(((u32)0x3F) << 26)) | (uDeltaInject << 26);
+   }
+
+   send_packet_to_radio_interfaces((u8*)pCurrentPacketHeader, pCurrentPacketHeader->total_length, -1, true);
    return true;
 }
 
@@ -741,6 +836,9 @@ int VideoTxPacketsBuffer::sendAvailablePackets(int iMaxCountToSend)
    if ( iToSend > iMaxCountToSend )
       iToSend = iMaxCountToSend;
 
+   // Queue the packets and send them to the radio interfaces in one go
+   radio_tx_batch_begin();
+
    int iCountSent = 0;
    for( int i=0; i<iToSend; i++ )
    {
@@ -780,6 +878,8 @@ int VideoTxPacketsBuffer::sendAvailablePackets(int iMaxCountToSend)
       if ( m_iCurrentBufferPacketIndexToSend == m_iNextBufferPacketIndexToFill )
          break;
    }
+
+   radio_tx_batch_end();
    return iCountSent;
 }
 
@@ -846,6 +946,17 @@ void VideoTxPacketsBuffer::resendVideoPacket(u32 uRetransmissionId, u32 uVideoBl
 }
 
 
+// Camera read time for the video latency trace, or 0 to disable the trace
+
+void VideoTxPacketsBuffer::setTraceCaptureTime(u32 uTimeMs)
+{
+   if ( (0 != uTimeMs) && (0 == m_uTraceCaptureTimeMs) )
+      log_line("[VideoTXBuffer] Video latency trace enabled.");
+   if ( (0 == uTimeMs) && (0 != m_uTraceCaptureTimeMs) )
+      log_line("[VideoTXBuffer] Video latency trace disabled.");
+   m_uTraceCaptureTimeMs = uTimeMs;
+}
+
 u32 VideoTxPacketsBuffer::getCurrentOutputFrameIndex()
 {
    return m_uCurrentH264FrameIndex;
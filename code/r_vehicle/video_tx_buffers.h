@@ -6,11 +6,17 @@
 #include "../base/parser_h264.h"
 #include "../radio/radiopackets2.h"
 
-//  [packet header][video segment header][video seg header important][video data][000]
-//  | pPH          | pPHVS               | pPHVSImp                  |pActualVideoData
-//  | pRawData ptr                       | pVideoData ptr
-//                                       [  <- video block packet size ->            ]
-//                                                                   [-vid size-]
+//  [radio headers room][packet header][video segment header][video seg header important][video data][000]
+//                      | pPH          | pPHVS               | pPHVSImp                  |pActualVideoData
+//                      | pRawData ptr                       | pVideoData ptr
+//                                                           [  <- video block packet size ->            ]
+//                                                                                       [-vid size-]
+//
+// All the packets of a video block are in a single contiguous slab, one packet every VIDEO_TX_SLAB_PACKET_STRIDE bytes.
+// Video data is written directly in the next packet to fill, FEC is computed in place, and the radio headers
+// are built in the room in front of each packet, so the video data is not copied again until the radio write.
+
+#define VIDEO_TX_SLAB_PACKET_STRIDE (((MAX_PACKET_RADIO_HEADERS + MAX_PACKET_TOTAL_SIZE) + 63) & (~63))
 
 typedef struct
 {
@@ -40,6 +46,7 @@ class VideoTxPacketsBuffer
       int hasPendingPacketsToSend();
       int sendAvailablePackets(int iMaxCountToSend);
       void resendVideoPacket(u32 uRetransmissionId, u32 uVideoBlockIndex, u32 uVideoBlockPacketIndex);
+      void setTraceCaptureTime(u32 uTimeMs);
 
       u32 getCurrentOutputFrameIndex();
       u32 getCurrentOutputNALIndex();
@@ -50,6 +57,7 @@ class VideoTxPacketsBuffer
    protected:
 
       void _checkAllocatePacket(int iBufferIndex, int iPacketIndex);
+      u8* _getVideoDataToFill();
       void _fillVideoPacketHeaders(int iBufferIndex, int iPacketIndex, bool bIsECPacket, int iRawVideoDataSize, u32 uNALPresenceFlags, bool bEndOfTransmissionFrame);
       void _addNewVideoPacket(u8* pRawVideoData, int iRawVideoDataSize, u32 uNALPresenceFlags, bool bEndOfTransmissionFrame);
       bool _sendPacket(int iBufferIndex, int iPacketIndex, u32 uRetransmissionId);
@@ -82,12 +90,14 @@ class VideoTxPacketsBuffer
       int m_iNextBufferPacketIndexToFill;
       int m_iCurrentBufferIndexToSend;
       int m_iCurrentBufferPacketIndexToSend;
-      u8 m_TempVideoBuffer[MAX_PACKET_TOTAL_SIZE];
-      int m_iTempVideoBufferFilledBytes;
+      int m_iTempVideoBufferFilledBytes; // Video bytes already written in the next packet to fill
       u32 m_uTempBufferNALPresenceFlags;
       type_tx_video_packet_info m_VideoPackets[MAX_RXTX_BLOCKS_BUFFER][MAX_TOTAL_PACKETS_IN_BLOCK];
+      u8* m_pBlocksSlabs[MAX_RXTX_BLOCKS_BUFFER];
+      int m_iBlocksSlabsPackets[MAX_RXTX_BLOCKS_BUFFER];
       int m_iCountReadyToSend;
 
       u32 m_uRadioStreamPacketIndex;
+      u32 m_uTraceCaptureTimeMs; // 0 if video latency trace is off
 };
 
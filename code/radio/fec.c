@@ -169,7 +169,8 @@ static char *allPp[] = {    /* GF_BITS	polynomial		*/
  * In any case the macro gf_mul(x,y) takes care of multiplications.
  */
 
-static int s_iAssertion = 0;
+/* Per thread, as fec_decode() can run on several decode threads at once */
+static __thread int s_iAssertion = 0;
 
 static gf gf_exp[2*GF_SIZE];	/* index->poly form conversion table	*/
 static int gf_log[GF_SIZE + 1];	/* Poly->index form conversion table	*/
@@ -435,11 +436,6 @@ addmul1(gf *dst1, gf *src1, gf c, int sz)
 # define addmul1 slow_addmul1
 #endif
 
-static void addmul(gf *dst, gf *src, gf c, int sz) {
-    // fprintf(stderr, "Dst=%p Src=%p, gf=%02x sz=%d\n", dst, src, c, sz);
-    if (c != 0) addmul1(dst, src, c, sz);
-}
-
 /*
  * mul() computes dst[] = c * src[]
  * This is used often, so better optimize it! Currently the loop is
@@ -561,9 +557,233 @@ mul1(gf *dst1, gf *src1, gf c, int sz)
 # define mul1 slow_mul1
 #endif
 
+/*
+ * SIMD kernels for addmul1() / mul1(), using split-nibble tables.
+ *
+ * Multiplication by a constant c is linear over GF(2), so
+ *     c * x = c * (x & 0x0f) ^ c * (x & 0xf0)
+ * For each c we keep two 16 entries tables (products of c with all low
+ * nibbles and with all high nibbles). A 16 bytes table lookup instruction
+ * (PSHUFB on x86, TBL/VTBL on ARM) then multiplies 16 (or 32) bytes at once.
+ * The results are bit-identical with the gf_mul_table based loops above,
+ * which are kept as fallback and for the tail of each buffer.
+ *
+ * The kernel is selected once, at fec_init(), based on the CPU features
+ * detected at runtime.
+ */
+
+static gf gf_mul_lo[GF_SIZE + 1][16] __attribute__((aligned (32)));
+static gf gf_mul_hi[GF_SIZE + 1][16] __attribute__((aligned (32)));
+
+static void
+init_nibble_tables(void)
+{
+    int c, i;
+    for (c = 0; c < GF_SIZE+1; c++) {
+	for (i = 0; i < 16; i++) {
+	    gf_mul_lo[c][i] = gf_mul(c, i);
+	    gf_mul_hi[c][i] = gf_mul(c, (i << 4));
+	}
+    }
+}
+
+typedef void (*fec_kernel_t)(gf *dst, gf *src, gf c, int sz);
+
+static fec_kernel_t s_pfAddMul1 = addmul1;
+static fec_kernel_t s_pfMul1 = mul1;
+static const char* s_szFECKernelName = "scalar";
+static int s_iFECUseSIMDKernels = 1;
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+
+#include <immintrin.h>
+#define FEC_HAS_X86_KERNELS 1
+
+__attribute__((target("ssse3")))
+static inline __m128i
+ssse3_mul16(__m128i tlo, __m128i thi, __m128i mask, __m128i s)
+{
+    __m128i l = _mm_and_si128(s, mask);
+    __m128i h = _mm_and_si128(_mm_srli_epi64(s, 4), mask);
+    return _mm_xor_si128(_mm_shuffle_epi8(tlo, l), _mm_shuffle_epi8(thi, h));
+}
+
+__attribute__((target("ssse3")))
+static void
+ssse3_addmul1(gf *dst, gf *src, gf c, int sz)
+{
+    __m128i tlo = _mm_load_si128((const __m128i*)gf_mul_lo[c]);
+    __m128i thi = _mm_load_si128((const __m128i*)gf_mul_hi[c]);
+    __m128i mask = _mm_set1_epi8(0x0f);
+    int i = 0;
+
+    for (; i + 16 <= sz; i += 16) {
+	__m128i p = ssse3_mul16(tlo, thi, mask, _mm_loadu_si128((const __m128i*)(src + i)));
+	__m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+	_mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(d, p));
+    }
+    if (i < sz)
+	slow_addmul1(dst + i, src + i, c, sz - i);
+}
+
+__attribute__((target("ssse3")))
+static void
+ssse3_mul1(gf *dst, gf *src, gf c, int sz)
+{
+    __m128i tlo = _mm_load_si128((const __m128i*)gf_mul_lo[c]);
+    __m128i thi = _mm_load_si128((const __m128i*)gf_mul_hi[c]);
+    __m128i mask = _mm_set1_epi8(0x0f);
+    int i = 0;
+
+    for (; i + 16 <= sz; i += 16) {
+	__m128i p = ssse3_mul16(tlo, thi, mask, _mm_loadu_si128((const __m128i*)(src + i)));
+	_mm_storeu_si128((__m128i*)(dst + i), p);
+    }
+    if (i < sz)
+	slow_mul1(dst + i, src + i, c, sz - i);
+}
+
+/* VPSHUFB works on each 128 bits lane, so the tables are just duplicated */
+__attribute__((target("avx2")))
+static inline __m256i
+avx2_mul32(__m256i tlo, __m256i thi, __m256i mask, __m256i s)
+{
+    __m256i l = _mm256_and_si256(s, mask);
+    __m256i h = _mm256_and_si256(_mm256_srli_epi64(s, 4), mask);
+    return _mm256_xor_si256(_mm256_shuffle_epi8(tlo, l), _mm256_shuffle_epi8(thi, h));
+}
+
+__attribute__((target("avx2")))
+static void
+avx2_addmul1(gf *dst, gf *src, gf c, int sz)
+{
+    __m256i tlo = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)gf_mul_lo[c]));
+    __m256i thi = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)gf_mul_hi[c]));
+    __m256i mask = _mm256_set1_epi8(0x0f);
+    int i = 0;
+
+    for (; i + 32 <= sz; i += 32) {
+	__m256i p = avx2_mul32(tlo, thi, mask, _mm256_loadu_si256((const __m256i*)(src + i)));
+	__m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+	_mm256_storeu_si256((__m256i*)(dst + i), _mm256_xor_si256(d, p));
+    }
+    if (i < sz)
+	ssse3_addmul1(dst + i, src + i, c, sz - i);
+}
+
+__attribute__((target("avx2")))
+static void
+avx2_mul1(gf *dst, gf *src, gf c, int sz)
+{
+    __m256i tlo = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)gf_mul_lo[c]));
+    __m256i thi = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)gf_mul_hi[c]));
+    __m256i mask = _mm256_set1_epi8(0x0f);
+    int i = 0;
+
+    for (; i + 32 <= sz; i += 32) {
+	__m256i p = avx2_mul32(tlo, thi, mask, _mm256_loadu_si256((const __m256i*)(src + i)));
+	_mm256_storeu_si256((__m256i*)(dst + i), p);
+    }
+    if (i < sz)
+	ssse3_mul1(dst + i, src + i, c, sz - i);
+}
+
+#elif (defined(__aarch64__) || defined(__ARM_NEON__) || defined(__ARM_NEON)) && defined(__GNUC__)
+
+#include <arm_neon.h>
+#define FEC_HAS_NEON_KERNELS 1
+
+#if !defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+static inline uint8x16_t
+neon_mul16(uint8x16_t tlo, uint8x16_t thi, uint8x16_t s)
+{
+    uint8x16_t l = vandq_u8(s, vdupq_n_u8(0x0f));
+    uint8x16_t h = vshrq_n_u8(s, 4);
+#if defined(__aarch64__)
+    return veorq_u8(vqtbl1q_u8(tlo, l), vqtbl1q_u8(thi, h));
+#else
+    uint8x8x2_t lo = { { vget_low_u8(tlo), vget_high_u8(tlo) } };
+    uint8x8x2_t hi = { { vget_low_u8(thi), vget_high_u8(thi) } };
+    uint8x8_t rl = veor_u8(vtbl2_u8(lo, vget_low_u8(l)), vtbl2_u8(hi, vget_low_u8(h)));
+    uint8x8_t rh = veor_u8(vtbl2_u8(lo, vget_high_u8(l)), vtbl2_u8(hi, vget_high_u8(h)));
+    return vcombine_u8(rl, rh);
+#endif
+}
+
+static void
+neon_addmul1(gf *dst, gf *src, gf c, int sz)
+{
+    uint8x16_t tlo = vld1q_u8(gf_mul_lo[c]);
+    uint8x16_t thi = vld1q_u8(gf_mul_hi[c]);
+    int i = 0;
+
+    for (; i + 16 <= sz; i += 16) {
+	uint8x16_t p = neon_mul16(tlo, thi, vld1q_u8(src + i));
+	vst1q_u8(dst + i, veorq_u8(vld1q_u8(dst + i), p));
+    }
+    if (i < sz)
+	slow_addmul1(dst + i, src + i, c, sz - i);
+}
+
+static void
+neon_mul1(gf *dst, gf *src, gf c, int sz)
+{
+    uint8x16_t tlo = vld1q_u8(gf_mul_lo[c]);
+    uint8x16_t thi = vld1q_u8(gf_mul_hi[c]);
+    int i = 0;
+
+    for (; i + 16 <= sz; i += 16)
+	vst1q_u8(dst + i, neon_mul16(tlo, thi, vld1q_u8(src + i)));
+    if (i < sz)
+	slow_mul1(dst + i, src + i, c, sz - i);
+}
+
+#endif
+
+static void
+select_kernels(void)
+{
+    s_pfAddMul1 = addmul1;
+    s_pfMul1 = mul1;
+    s_szFECKernelName = "scalar";
+
+    if (!s_iFECUseSIMDKernels)
+	return;
+
+#if defined(FEC_HAS_X86_KERNELS)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+	s_pfAddMul1 = avx2_addmul1;
+	s_pfMul1 = avx2_mul1;
+	s_szFECKernelName = "avx2";
+    } else if (__builtin_cpu_supports("ssse3")) {
+	s_pfAddMul1 = ssse3_addmul1;
+	s_pfMul1 = ssse3_mul1;
+	s_szFECKernelName = "ssse3";
+    }
+#elif defined(FEC_HAS_NEON_KERNELS)
+#if !defined(__aarch64__)
+    if (!(getauxval(AT_HWCAP) & HWCAP_NEON))
+	return;
+#endif
+    s_pfAddMul1 = neon_addmul1;
+    s_pfMul1 = neon_mul1;
+    s_szFECKernelName = "neon";
+#endif
+}
+
+static void addmul(gf *dst, gf *src, gf c, int sz) {
+    // fprintf(stderr, "Dst=%p Src=%p, gf=%02x sz=%d\n", dst, src, c, sz);
+    if (c != 0) s_pfAddMul1(dst, src, c, sz);
+}
+
 static inline void mul(gf *dst, gf *src, gf c, int sz) {
     /*fprintf(stderr, "%p = %02x * %p\n", dst, c, src);*/
-    if (c != 0) mul1(dst, src, c, sz); else memset(dst, 0, sz);
+    if (c != 0) s_pfMul1(dst, src, c, sz); else memset(dst, 0, sz);
 }
 
 /*
@@ -706,6 +926,8 @@ void fec_init(void)
     init_mul_table();
     TOCK(ticks[0]);
     DDB(fprintf(stderr, "init_mul_table took %ldus\n", ticks[0]);)
+    init_nibble_tables();
+    select_kernels();
    	fec_initialized = 1 ;
 }
 
@@ -871,6 +1093,85 @@ static inline void reduce(unsigned int blockSize,
        s_iAssertion = -2;
 }
 
+/*
+ * Cache of inverted decode matrices.
+ *
+ * The decode matrix depends only on which data blocks are erased and which
+ * FEC blocks are used to recover them. Under steady interference the same
+ * few erasure patterns repeat block after block, so keep the last inverted
+ * matrices and reuse them (LRU). The cache is per thread, so no locking is
+ * needed if several threads decode at the same time.
+ */
+#define FEC_DECODE_CACHE_ENTRIES 16
+#define FEC_DECODE_CACHE_MAX_SIZE 32
+
+typedef struct {
+    unsigned short size; /* 0: unused entry */
+    unsigned int last_used;
+    unsigned char erased[FEC_DECODE_CACHE_MAX_SIZE];
+    unsigned char fec_nos[FEC_DECODE_CACHE_MAX_SIZE];
+    gf matrix[FEC_DECODE_CACHE_MAX_SIZE*FEC_DECODE_CACHE_MAX_SIZE];
+} fec_decode_cache_entry_t;
+
+static __thread fec_decode_cache_entry_t s_DecodeCache[FEC_DECODE_CACHE_ENTRIES];
+static __thread unsigned int s_uDecodeCacheCounter = 0;
+static __thread unsigned int s_uDecodeCacheHits = 0;
+static __thread unsigned int s_uDecodeCacheMisses = 0;
+static int s_iDecodeCacheEnabled = 1;
+
+static fec_decode_cache_entry_t*
+find_cached_matrix(unsigned int *fec_block_nos, unsigned int *erased_blocks, short nr_fec_blocks)
+{
+    int i, j;
+    for (i = 0; i < FEC_DECODE_CACHE_ENTRIES; i++) {
+	fec_decode_cache_entry_t* p = &s_DecodeCache[i];
+	if (p->size != nr_fec_blocks)
+	    continue;
+	for (j = 0; j < nr_fec_blocks; j++) {
+	    if (p->erased[j] != erased_blocks[j] || p->fec_nos[j] != fec_block_nos[j])
+		break;
+	}
+	if (j == nr_fec_blocks) {
+	    p->last_used = ++s_uDecodeCacheCounter;
+	    return p;
+	}
+    }
+    return NULL;
+}
+
+static void
+add_cached_matrix(gf *matrix, unsigned int *fec_block_nos, unsigned int *erased_blocks, short nr_fec_blocks)
+{
+    int i;
+    fec_decode_cache_entry_t* p = &s_DecodeCache[0];
+    for (i = 1; i < FEC_DECODE_CACHE_ENTRIES; i++) {
+	if (p->size == 0)
+	    break;
+	if (s_DecodeCache[i].size == 0 || s_DecodeCache[i].last_used < p->last_used)
+	    p = &s_DecodeCache[i];
+    }
+    for (i = 0; i < nr_fec_blocks; i++) {
+	p->erased[i] = erased_blocks[i];
+	p->fec_nos[i] = fec_block_nos[i];
+    }
+    memcpy(p->matrix, matrix, nr_fec_blocks*nr_fec_blocks);
+    p->size = nr_fec_blocks;
+    p->last_used = ++s_uDecodeCacheCounter;
+}
+
+void fec_enable_decode_cache(int iEnable)
+{
+    s_iDecodeCacheEnabled = iEnable;
+}
+
+void fec_get_decode_cache_stats(unsigned int* puHits, unsigned int* puMisses)
+{
+    if (NULL != puHits)
+	*puHits = s_uDecodeCacheHits;
+    if (NULL != puMisses)
+	*puMisses = s_uDecodeCacheMisses;
+}
+
 /**
  * Resolves reduced system. Constructs "mini" encoding matrix, inverts
  * it, and multiply reduced vector by it.
@@ -884,10 +1185,22 @@ static inline void resolve(int blockSize,
 {
     /* construct matrix */
     int row;
-    unsigned char matrix[nr_fec_blocks*nr_fec_blocks];
+    unsigned char matrix_buffer[nr_fec_blocks*nr_fec_blocks];
+    unsigned char *matrix = matrix_buffer;
     int ptr;
     int r;
+    int cacheable = s_iDecodeCacheEnabled && (nr_fec_blocks <= FEC_DECODE_CACHE_MAX_SIZE);
+    fec_decode_cache_entry_t* cached = NULL;
+
+    if (nr_fec_blocks <= 0)
+	return;
+    if (cacheable)
+	cached = find_cached_matrix(fec_block_nos, erased_blocks, nr_fec_blocks);
 
+    if (NULL != cached) {
+	s_uDecodeCacheHits++;
+	matrix = cached->matrix;
+    } else {
     /* we pick the submatrix of code that keeps colums corresponding to
      * the erased data blocks, and rows corresponding to the present FEC
      * blocks. This is the matrix by which we would need to multiply the
@@ -906,6 +1219,11 @@ static inline void resolve(int blockSize,
 
     if(r)
 	      s_iAssertion = -1;
+    else if (cacheable) {
+	s_uDecodeCacheMisses++;
+	add_cached_matrix(matrix, fec_block_nos, erased_blocks, nr_fec_blocks);
+    }
+    }
 
     /* do the multiplication with the reduced code vector */
     for(row = 0, ptr=0; row < nr_fec_blocks; row++) {
@@ -918,6 +1236,20 @@ static inline void resolve(int blockSize,
     }
 }
 
+void fec_use_simd_kernels(int iEnable)
+{
+   s_iFECUseSIMDKernels = iEnable;
+   if ( fec_initialized )
+      select_kernels();
+}
+
+const char* fec_get_kernel_name(void)
+{
+   if ( 0 == fec_initialized )
+      fec_init();
+   return s_szFECKernelName;
+}
+
 int fec_decode(unsigned int blockSize,
 		unsigned char **data_blocks,
 		unsigned int nr_data_blocks,
@@ -26,6 +26,16 @@ int fec_decode(unsigned int blockSize,
 		unsigned int *erased_blocks,
 		unsigned short nr_fec_blocks  /* how many blocks per stripe */);
 
+// SIMD kernels are used by default when the CPU supports them.
+// Disabling them falls back to the scalar table based loops (same output).
+void fec_use_simd_kernels(int iEnable);
+const char* fec_get_kernel_name(void);
+
+// Inverted decode matrices are cached (per thread) for repeating erasure patterns.
+// Stats are for the calling thread.
+void fec_enable_decode_cache(int iEnable);
+void fec_get_decode_cache_stats(unsigned int* puHits, unsigned int* puMisses);
+
 void fec_print(fec_code_t code, int width);
 
 void fec_license(void);
@@ -34,12 +34,15 @@
 #include "../base/encr.h"
 #include "../base/config_hw.h"
 #include "../base/hw_procs.h"
+#include "../base/latency_stats.h"
 #include "../common/radio_stats.h"
 #include "../common/string_utils.h"
 #include "radio_rx.h"
 #include "radiolink.h"
 #include "radio_duplicate_det.h"
+#include "radio_rx_ring.h"
 #include <poll.h>
+#include <sys/eventfd.h>
 
 int s_iRadioRxInitialized = 0;
 int s_iRadioRxSingalStop = 0;
@@ -48,6 +51,8 @@ int s_iRadioRxLoopTimeoutInterval = 60;
 int s_iRadioRxMarkedForQuit = 0;
 int s_iCurrentRxThreadPriority = -1;
 int s_iPendingRxThreadPriority = -1;
+int s_iCurrentRxThreadCPUCore = -1;
+int s_iPendingRxThreadCPUCore = -1;
 
 t_radio_rx_state s_RadioRxState;
 pthread_t s_pThreadRadioRx;
@@ -78,8 +83,6 @@ int s_iRadioRxCountFDs = 0;
 int s_iRadioRxMaxFD = 0;
 struct timeval s_iRadioRxReadTimeInterval;
 
-u8 s_tmpLastProcessedRadioRxPacket[MAX_PACKET_TOTAL_SIZE];
-
 u32 s_uLastRxShortPacketsVehicleIds[MAX_RADIO_INTERFACES];
 
 // Pointers to array of int-s (max radio cards, for each card)
@@ -250,48 +253,104 @@ void _radio_rx_update_fd_sets()
 
 
 
-u8* _radio_rx_wait_get_queue_packet(t_radio_rx_state_packets_queue* pQueue, int iHighPriorityQueue, u32 uTimeoutMicroSec, int* pLength, int* pIsShortPacket, int* pRadioInterfaceIndex)
+static int _radio_rx_queue_is_empty(t_radio_rx_state_packets_queue* pQueue)
 {
-   int iRes = -1;
+   return (pQueue->iCurrentPacketIndexToConsume == __atomic_load_n(&(pQueue->iCurrentPacketIndexToWrite), __ATOMIC_SEQ_CST))?1:0;
+}
+
+// Returns 1 if there are packets in the queue before the timeout expired
 
-   if ( 0 == uTimeoutMicroSec )
+static int _radio_rx_wait_queue_event(t_radio_rx_state_packets_queue* pQueue, u32 uTimeoutMicroSec)
+{
+   struct timespec tsEnd;
+   clock_gettime(CLOCK_MONOTONIC, &tsEnd);
+   long long lEndNs = (long long)tsEnd.tv_sec * 1000000000LL + (long long)tsEnd.tv_nsec + 1000LL*(long long)uTimeoutMicroSec;
+   int iHasPackets = 0;
+
+   while ( ! iHasPackets )
    {
-      iRes = sem_trywait(pQueue->pSemaphoreRead);
+      // Tell the producer to signal the eventfd, then check again to not miss a packet added meanwhile
+      __atomic_store_n(&(pQueue->iConsumerIsWaiting), 1, __ATOMIC_SEQ_CST);
+      if ( ! _radio_rx_queue_is_empty(pQueue) )
+      {
+         iHasPackets = 1;
+         break;
+      }
+
+      struct timespec tsNow;
+      clock_gettime(CLOCK_MONOTONIC, &tsNow);
+      long long lLeftNs = lEndNs - ((long long)tsNow.tv_sec * 1000000000LL + (long long)tsNow.tv_nsec);
+      if ( lLeftNs <= 0 )
+         break;
+
+      struct timespec tsWait;
+      tsWait.tv_sec = lLeftNs / 1000000000LL;
+      tsWait.tv_nsec = lLeftNs % 1000000000LL;
+      fd_set readSet;
+      FD_ZERO(&readSet);
+      FD_SET(pQueue->iEventFd, &readSet);
+      int iRes = pselect(pQueue->iEventFd+1, &readSet, NULL, NULL, &tsWait, NULL);
+      if ( (iRes > 0) && FD_ISSET(pQueue->iEventFd, &readSet) )
+      {
+         uint64_t uValue = 0;
+         if ( read(pQueue->iEventFd, &uValue, sizeof(uValue)) < 0 )
+            log_softerror_and_alarm("[RadioRx] Failed to read rx queue eventfd. Error: %d (%s)", errno, strerror(errno));
+      }
+      else if ( (iRes < 0) && (errno != EINTR) )
+         break;
+      iHasPackets = ! _radio_rx_queue_is_empty(pQueue);
    }
-   else
+   __atomic_store_n(&(pQueue->iConsumerIsWaiting), 0, __ATOMIC_RELAXED);
+   return iHasPackets;
+}
+
+static void _radio_rx_release_queue_packet(t_radio_rx_state_packets_queue* pQueue)
+{
+   if ( ! pQueue->iPacketLentToConsumer )
+      return;
+   pQueue->iPacketLentToConsumer = 0;
+
+   int iIndex = pQueue->iCurrentPacketIndexToConsume + 1;
+   if ( iIndex >= pQueue->iQueueSize )
+      iIndex = 0;
+   __atomic_store_n(&(pQueue->iCurrentPacketIndexToConsume), iIndex, __ATOMIC_RELEASE);
+}
+
+// Returns a pointer to the packet inside the queue. It's valid until released or until the next get from the same queue
+
+u8* _radio_rx_wait_get_queue_packet(t_radio_rx_state_packets_queue* pQueue, int iHighPriorityQueue, u32 uTimeoutMicroSec, int* pLength, int* pIsShortPacket, int* pRadioInterfaceIndex)
+{
+   _radio_rx_release_queue_packet(pQueue);
+
+   if ( pQueue->iCurrentPacketIndexToConsume == __atomic_load_n(&(pQueue->iCurrentPacketIndexToWrite), __ATOMIC_ACQUIRE) )
    {
-      struct timespec ts;
-      clock_gettime(CLOCK_REALTIME, &ts);
-      ts.tv_nsec += 1000LL*(long long)uTimeoutMicroSec;
-      iRes = sem_timedwait(pQueue->pSemaphoreRead, &ts);
+      if ( (0 == uTimeoutMicroSec) || (pQueue->iEventFd < 0) )
+         return NULL;
+      if ( ! _radio_rx_wait_queue_event(pQueue, uTimeoutMicroSec) )
+         return NULL;
    }
-   if ( 0 != iRes )
-      return NULL;
-
-   int iIndexToCopy = 0;
 
-   iIndexToCopy = pQueue->iCurrentPacketIndexToConsume;
-   if ( (iIndexToCopy < 0) || (iIndexToCopy >= pQueue->iQueueSize) )
+   int iIndexToConsume = pQueue->iCurrentPacketIndexToConsume;
+   if ( (iIndexToConsume < 0) || (iIndexToConsume >= pQueue->iQueueSize) )
       return NULL;
-   if ( (pQueue->iPacketsLengths[iIndexToCopy] <= 0) || (pQueue->iPacketsLengths[iIndexToCopy] > MAX_PACKET_TOTAL_SIZE) )
-      return NULL;
-   if ( NULL == pQueue->pPacketsBuffers[iIndexToCopy] )
+
+   // Lend the slot to the consumer; invalid packets are released right away
+   pQueue->iPacketLentToConsumer = 1;
+   if ( (pQueue->iPacketsLengths[iIndexToConsume] <= 0) || (pQueue->iPacketsLengths[iIndexToConsume] > MAX_PACKET_TOTAL_SIZE) || (NULL == pQueue->pPacketsBuffers[iIndexToConsume]) )
+   {
+      _radio_rx_release_queue_packet(pQueue);
       return NULL;
+   }
 
    if ( NULL != pLength )
-      *pLength = pQueue->iPacketsLengths[iIndexToCopy];
+      *pLength = pQueue->iPacketsLengths[iIndexToConsume];
    if ( NULL != pIsShortPacket )
-      *pIsShortPacket = pQueue->uPacketsAreShort[iIndexToCopy];
+      *pIsShortPacket = pQueue->uPacketsAreShort[iIndexToConsume];
    if ( NULL != pRadioInterfaceIndex )
-      *pRadioInterfaceIndex = pQueue->uPacketsRxInterface[iIndexToCopy];
-
-   memcpy(s_tmpLastProcessedRadioRxPacket, pQueue->pPacketsBuffers[iIndexToCopy], pQueue->iPacketsLengths[iIndexToCopy]);
+      *pRadioInterfaceIndex = pQueue->uPacketsRxInterface[iIndexToConsume];
 
-   pQueue->iCurrentPacketIndexToConsume++;
-   if ( pQueue->iCurrentPacketIndexToConsume >= pQueue->iQueueSize )
-      pQueue->iCurrentPacketIndexToConsume = 0;
-
-   return s_tmpLastProcessedRadioRxPacket;
+   latency_stats_end(LATENCY_STAGE_RX_QUEUE_WAIT, pQueue->uPacketsTimeAddedMicros[iIndexToConsume]);
+   return pQueue->pPacketsBuffers[iIndexToConsume];
 }
 
 u8* radio_rx_wait_get_next_received_high_prio_packet(u32 uTimeoutMicroSec, int* pLength, int* pIsShortPacket, int* pRadioInterfaceIndex)
@@ -322,6 +381,72 @@ u8* radio_rx_wait_get_next_received_reg_prio_packet(u32 uTimeoutMicroSec, int* p
    return _radio_rx_wait_get_queue_packet(&(s_RadioRxState.queue_reg_priority), 0, uTimeoutMicroSec, pLength, pIsShortPacket, pRadioInterfaceIndex);
 }
 
+void radio_rx_release_high_prio_packet()
+{
+   if ( 0 == s_iRadioRxInitialized )
+      return;
+   _radio_rx_release_queue_packet(&(s_RadioRxState.queue_high_priority));
+}
+
+void radio_rx_release_reg_prio_packet()
+{
+   if ( 0 == s_iRadioRxInitialized )
+      return;
+   _radio_rx_release_queue_packet(&(s_RadioRxState.queue_reg_priority));
+}
+
+u32 radio_rx_get_current_packet_rx_time_micros(int iHighPriorityQueue)
+{
+   if ( 0 == s_iRadioRxInitialized )
+      return 0;
+   t_radio_rx_state_packets_queue* pQueue = iHighPriorityQueue?&(s_RadioRxState.queue_high_priority):&(s_RadioRxState.queue_reg_priority);
+   if ( ! pQueue->iPacketLentToConsumer )
+      return 0;
+   return pQueue->uPacketsTimeAddedMicros[pQueue->iCurrentPacketIndexToConsume];
+}
+
+int radio_rx_get_queue_event_fd(int iHighPriorityQueue)
+{
+   if ( 0 == s_iRadioRxInitialized )
+      return -1;
+   if ( iHighPriorityQueue )
+      return s_RadioRxState.queue_high_priority.iEventFd;
+   return s_RadioRxState.queue_reg_priority.iEventFd;
+}
+
+// Used when the consumer waits on the queues eventfds from its own wait set (epoll).
+// Returns 1 if any queue has packets already, so the consumer should not wait.
+
+int radio_rx_begin_wait_on_queues()
+{
+   if ( 0 == s_iRadioRxInitialized )
+      return 0;
+   __atomic_store_n(&(s_RadioRxState.queue_high_priority.iConsumerIsWaiting), 1, __ATOMIC_SEQ_CST);
+   __atomic_store_n(&(s_RadioRxState.queue_reg_priority.iConsumerIsWaiting), 1, __ATOMIC_SEQ_CST);
+   if ( ! _radio_rx_queue_is_empty(&(s_RadioRxState.queue_high_priority)) )
+      return 1;
+   if ( ! _radio_rx_queue_is_empty(&(s_RadioRxState.queue_reg_priority)) )
+      return 1;
+   return 0;
+}
+
+void radio_rx_end_wait_on_queues()
+{
+   if ( 0 == s_iRadioRxInitialized )
+      return;
+   t_radio_rx_state_packets_queue* pQueues[2] = { &(s_RadioRxState.queue_high_priority), &(s_RadioRxState.queue_reg_priority) };
+   for( int i=0; i<2; i++ )
+   {
+      __atomic_store_n(&(pQueues[i]->iConsumerIsWaiting), 0, __ATOMIC_RELAXED);
+      // Reset the eventfd counter (nonblocking)
+      uint64_t uValue = 0;
+      if ( pQueues[i]->iEventFd >= 0 )
+      if ( read(pQueues[i]->iEventFd, &uValue, sizeof(uValue)) < 0 )
+      if ( errno != EAGAIN )
+         log_softerror_and_alarm("[RadioRx] Failed to read rx queue eventfd. Error: %d (%s)", errno, strerror(errno));
+   }
+}
+
 void _radio_rx_add_packet_to_rx_queue(u8* pPacket, int iLength, int iRadioInterface)
 {
    if ( (NULL == pPacket) || (iLength <= 0) || s_iRadioRxMarkedForQuit )
@@ -335,43 +460,53 @@ void _radio_rx_add_packet_to_rx_queue(u8* pPacket, int iLength, int iRadioInterf
    if ( radio_packet_type_is_high_priority(uPacketFlags, uPacketType) )
       pQueue = &s_RadioRxState.queue_high_priority;
 
+   int iIndexToWrite = pQueue->iCurrentPacketIndexToWrite;
+   int iNextIndexToWrite = iIndexToWrite + 1;
+   if ( iNextIndexToWrite >= pQueue->iQueueSize )
+      iNextIndexToWrite = 0;
+   int iIndexToConsume = __atomic_load_n(&(pQueue->iCurrentPacketIndexToConsume), __ATOMIC_ACQUIRE);
+
    // No more room? Discard it
-   if ( ((pQueue->iCurrentPacketIndexToWrite+1) % pQueue->iQueueSize) == (pQueue->iCurrentPacketIndexToConsume % pQueue->iQueueSize) )
+   if ( iNextIndexToWrite == iIndexToConsume )
    {
       //s_uRadioRxLastTimeQueue += get_current_timestamp_ms() - s_uRadioRxTimeNow;
       return;
    }
 
    // Add the packet to the queue
-   pQueue->uPacketsRxInterface[pQueue->iCurrentPacketIndexToWrite] = iRadioInterface;
-   pQueue->uPacketsAreShort[pQueue->iCurrentPacketIndexToWrite] = 0;
-   pQueue->iPacketsLengths[pQueue->iCurrentPacketIndexToWrite] = iLength;
-   memcpy(pQueue->pPacketsBuffers[pQueue->iCurrentPacketIndexToWrite], pPacket, iLength);
-      
-   pQueue->iCurrentPacketIndexToWrite++;
-   if ( pQueue->iCurrentPacketIndexToWrite >= pQueue->iQueueSize )
-      pQueue->iCurrentPacketIndexToWrite = 0;
+   pQueue->uPacketsRxInterface[iIndexToWrite] = iRadioInterface;
+   pQueue->uPacketsAreShort[iIndexToWrite] = 0;
+   pQueue->iPacketsLengths[iIndexToWrite] = iLength;
+   pQueue->uPacketsTimeAddedMicros[iIndexToWrite] = get_current_timestamp_micros();
+   memcpy(pQueue->pPacketsBuffers[iIndexToWrite], pPacket, iLength);
+
+   // Publish the packet, then wake up the consumer, only if it's blocked waiting for packets
+   __atomic_store_n(&(pQueue->iCurrentPacketIndexToWrite), iNextIndexToWrite, __ATOMIC_SEQ_CST);
+   if ( __atomic_load_n(&(pQueue->iConsumerIsWaiting), __ATOMIC_SEQ_CST) && (pQueue->iEventFd >= 0) )
+   {
+      uint64_t uValue = 1;
+      if ( sizeof(uValue) != write(pQueue->iEventFd, &uValue, sizeof(uValue)) )
+         log_softerror_and_alarm("Failed to signal rx queue for packet ready.");
+   }
 
-   int iCountPackets = pQueue->iCurrentPacketIndexToWrite - pQueue->iCurrentPacketIndexToConsume;
-   if ( pQueue->iCurrentPacketIndexToWrite < pQueue->iCurrentPacketIndexToConsume )
-      iCountPackets = pQueue->iCurrentPacketIndexToWrite + (pQueue->iQueueSize - pQueue->iCurrentPacketIndexToConsume);
+   int iCountPackets = iNextIndexToWrite - iIndexToConsume;
+   if ( iNextIndexToWrite < iIndexToConsume )
+      iCountPackets = iNextIndexToWrite + (pQueue->iQueueSize - iIndexToConsume);
 
    if ( iCountPackets > pQueue->iStatsMaxPacketsInQueueLastMinute )
       pQueue->iStatsMaxPacketsInQueueLastMinute = iCountPackets;
    if ( iCountPackets > pQueue->iStatsMaxPacketsInQueue )
       pQueue->iStatsMaxPacketsInQueue = iCountPackets;
 
-   if ( NULL != pQueue->pSemaphoreWrite )
-   {
-      if ( 0 != sem_post(pQueue->pSemaphoreWrite) )
-         log_softerror_and_alarm("Failed to set semaphore for packet ready.");
-   }
    //s_uRadioRxLastTimeQueue += get_current_timestamp_ms() - s_uRadioRxTimeNow;
 }
 
 void _radio_rx_check_add_packet_to_rx_queue(u8* pPacket, int iLength, int iRadioInterfaceIndex)
 {
-   if ( radio_dup_detection_is_duplicate_on_stream(iRadioInterfaceIndex, pPacket, iLength, s_uRadioRxTimeNow) )
+   u32 uTimeStartDedup = latency_stats_start();
+   int iIsDuplicate = radio_dup_detection_is_duplicate_on_stream(iRadioInterfaceIndex, pPacket, iLength, s_uRadioRxTimeNow);
+   latency_stats_end(LATENCY_STAGE_DEDUP, uTimeStartDedup);
+   if ( iIsDuplicate )
       return;
 
    if ( NULL != s_pSMRadioStats )
@@ -582,6 +717,7 @@ int _radio_rx_parse_received_wifi_radio_data(int iInterfaceIndex, int iMaxReads)
    for( int iCountReads=0; iCountReads<iMaxReads; iCountReads++ )
    {
       iBufferLength = 0;
+      u32 uTimeStartRead = latency_stats_start();
       pPacketBuffer = radio_process_wlan_data_in(iInterfaceIndex, &iBufferLength);
       if ( NULL == pPacketBuffer )
          break;
@@ -652,6 +788,7 @@ int _radio_rx_parse_received_wifi_radio_data(int iInterfaceIndex, int iMaxReads)
          continue;
       }
 
+      latency_stats_end(LATENCY_STAGE_RADIO_READ, uTimeStartRead);
       _radio_rx_check_add_packet_to_rx_queue(pPacketBuffer, iPacketLength, iInterfaceIndex);
     
       if ( NULL != s_pRxAirGapTracking )
@@ -794,6 +931,14 @@ void * _thread_radio_rx(void *argument)
       s_iCurrentRxThreadPriority = s_iPendingRxThreadPriority;
    }
 
+   // A new thread inherits the affinity of the thread that creates it, apply the requested core again
+   s_iCurrentRxThreadCPUCore = -1;
+   if ( s_iPendingRxThreadCPUCore >= 0 )
+   {
+      hw_set_current_thread_affinity("[RadioRxThread]", s_iPendingRxThreadCPUCore);
+      s_iCurrentRxThreadCPUCore = s_iPendingRxThreadCPUCore;
+   }
+
    for( int i=0; i<MAX_SPIKES_TO_LOG; i++ )
    {
       s_uRadioRxLoopLastSpikesTimes[i] = 0;
@@ -891,6 +1036,11 @@ void * _thread_radio_rx(void *argument)
             else
                hw_increase_current_thread_priority("[RadioRxThread]", 0);
          }
+         if ( (s_iPendingRxThreadCPUCore >= 0) && (s_iPendingRxThreadCPUCore != s_iCurrentRxThreadCPUCore) )
+         {
+            s_iCurrentRxThreadCPUCore = s_iPendingRxThreadCPUCore;
+            hw_set_current_thread_affinity("[RadioRxThread]", s_iPendingRxThreadCPUCore);
+         }
       }
 
       iLoopParsedPackets = 0;
@@ -987,7 +1137,9 @@ void * _thread_radio_rx(void *argument)
             }
             else
             {
-               iParsedPackets[iInterfaceIndex] = _radio_rx_parse_received_wifi_radio_data(iInterfaceIndex, 3);
+               // The mmap rx ring has no per frame syscall, so drain more frames on each wakeup
+               int iMaxReads = radio_rx_ring_is_opened(iInterfaceIndex)?RADIO_RX_RING_MAX_READS_PER_WAKEUP:3;
+               iParsedPackets[iInterfaceIndex] = _radio_rx_parse_received_wifi_radio_data(iInterfaceIndex, iMaxReads);
                if ( (iParsedPackets[iInterfaceIndex] < 0) || ( radio_get_last_read_error_code() == RADIO_READ_ERROR_INTERFACE_BROKEN ) )
                {
                   log_line("[RadioRx] Mark radio interface %d as broken", iInterfaceIndex+1);
@@ -995,7 +1147,7 @@ void * _thread_radio_rx(void *argument)
                   continue;
                }
                iLoopParsedPackets += iParsedPackets[iInterfaceIndex];
-               if ( iParsedPackets[iInterfaceIndex] >= 3 )
+               if ( iParsedPackets[iInterfaceIndex] >= iMaxReads )
                   iMaxedInterface = iInterfaceIndex;
             }
          }
@@ -1030,6 +1182,7 @@ int radio_rx_start_rx_thread(shared_mem_radio_stats* pSMRadioStats, int iSearchM
       s_RadioRxState.queue_reg_priority.iPacketsLengths[i] = 0;
       s_RadioRxState.queue_reg_priority.uPacketsAreShort[i] = 0;
       s_RadioRxState.queue_reg_priority.uPacketsRxInterface[i] = 0;
+      s_RadioRxState.queue_reg_priority.uPacketsTimeAddedMicros[i] = 0;
       s_RadioRxState.queue_reg_priority.pPacketsBuffers[i] = (u8*) malloc(MAX_PACKET_TOTAL_SIZE);
       if ( NULL == s_RadioRxState.queue_reg_priority.pPacketsBuffers[i] )
       {
@@ -1044,6 +1197,7 @@ int radio_rx_start_rx_thread(shared_mem_radio_stats* pSMRadioStats, int iSearchM
       s_RadioRxState.queue_high_priority.iPacketsLengths[i] = 0;
       s_RadioRxState.queue_high_priority.uPacketsAreShort[i] = 0;
       s_RadioRxState.queue_high_priority.uPacketsRxInterface[i] = 0;
+      s_RadioRxState.queue_high_priority.uPacketsTimeAddedMicros[i] = 0;
       s_RadioRxState.queue_high_priority.pPacketsBuffers[i] = (u8*) malloc(MAX_PACKET_TOTAL_SIZE);
       if ( NULL == s_RadioRxState.queue_high_priority.pPacketsBuffers[i] )
       {
@@ -1066,66 +1220,26 @@ int radio_rx_start_rx_thread(shared_mem_radio_stats* pSMRadioStats, int iSearchM
    s_RadioRxState.uTimeLastStatsUpdate = get_current_timestamp_ms();
    s_RadioRxState.uTimeLastMinuteStatsUpdate = get_current_timestamp_ms();
    
-   sem_unlink(RUBY_SEM_RX_RADIO_HIGH_PRIORITY);
-   sem_unlink(RUBY_SEM_RX_RADIO_REG_PRIORITY);
-
-   s_RadioRxState.queue_high_priority.pSemaphoreWrite = sem_open(RUBY_SEM_RX_RADIO_HIGH_PRIORITY, O_CREAT | O_RDWR, S_IWUSR | S_IRUSR, 0);
-   if ( (NULL == s_RadioRxState.queue_high_priority.pSemaphoreWrite) || (SEM_FAILED == s_RadioRxState.queue_high_priority.pSemaphoreWrite) )
-   {
-      log_error_and_alarm("[RadioRx] Failed to create write semaphore: %s, try alternative.", RUBY_SEM_RX_RADIO_HIGH_PRIORITY);
-      s_RadioRxState.queue_high_priority.pSemaphoreWrite = sem_open(RUBY_SEM_RX_RADIO_HIGH_PRIORITY, O_CREAT, S_IWUSR | S_IRUSR, 0); 
-      if ( (NULL == s_RadioRxState.queue_high_priority.pSemaphoreWrite) || (SEM_FAILED == s_RadioRxState.queue_high_priority.pSemaphoreWrite) )
-      {
-         log_error_and_alarm("[RadioRx] Failed to create write semaphore: %s", RUBY_SEM_RX_RADIO_HIGH_PRIORITY);
-         return 0;
-      }
-   }
-   s_RadioRxState.queue_high_priority.pSemaphoreRead = sem_open(RUBY_SEM_RX_RADIO_HIGH_PRIORITY, O_RDWR);
-   if ( (NULL == s_RadioRxState.queue_high_priority.pSemaphoreRead) || (SEM_FAILED == s_RadioRxState.queue_high_priority.pSemaphoreRead) )
-   {
-      log_error_and_alarm("[RadioRx] Failed to create read semaphore: %s, try alternative.", RUBY_SEM_RX_RADIO_HIGH_PRIORITY);
-      s_RadioRxState.queue_high_priority.pSemaphoreRead = sem_open(RUBY_SEM_RX_RADIO_HIGH_PRIORITY, O_CREAT, S_IWUSR | S_IRUSR, 0); 
-      if ( (NULL == s_RadioRxState.queue_high_priority.pSemaphoreRead) || (SEM_FAILED == s_RadioRxState.queue_high_priority.pSemaphoreRead) )
-      {
-         log_error_and_alarm("[RadioRx] Failed to create read semaphore: %s", RUBY_SEM_RX_RADIO_HIGH_PRIORITY);
-         return 0;
-      }
-   }
-   int iSemVal = 0;
-   if ( 0 == sem_getvalue(s_RadioRxState.queue_high_priority.pSemaphoreRead, &iSemVal) )
-      log_line("[RadioRx] High priority queue semaphore initial value: %d", iSemVal);
-   else
-      log_softerror_and_alarm("[RadioRx] Failed to get high priority queue sem value.");
+   s_RadioRxState.queue_high_priority.iPacketLentToConsumer = 0;
+   s_RadioRxState.queue_high_priority.iConsumerIsWaiting = 0;
+   s_RadioRxState.queue_reg_priority.iPacketLentToConsumer = 0;
+   s_RadioRxState.queue_reg_priority.iConsumerIsWaiting = 0;
 
-   s_RadioRxState.queue_reg_priority.pSemaphoreWrite = sem_open(RUBY_SEM_RX_RADIO_REG_PRIORITY, O_CREAT | O_RDWR, S_IWUSR | S_IRUSR, 0);
-   if ( (NULL == s_RadioRxState.queue_reg_priority.pSemaphoreWrite) || (SEM_FAILED == s_RadioRxState.queue_reg_priority.pSemaphoreWrite) )
+   s_RadioRxState.queue_high_priority.iEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   if ( s_RadioRxState.queue_high_priority.iEventFd < 0 )
    {
-      log_error_and_alarm("[RadioRx] Failed to create write semaphore: %s, try alternative.", RUBY_SEM_RX_RADIO_REG_PRIORITY);
-      s_RadioRxState.queue_reg_priority.pSemaphoreWrite = sem_open(RUBY_SEM_RX_RADIO_REG_PRIORITY, O_CREAT, S_IWUSR | S_IRUSR, 0); 
-      if ( (NULL == s_RadioRxState.queue_reg_priority.pSemaphoreWrite) || (SEM_FAILED == s_RadioRxState.queue_reg_priority.pSemaphoreWrite) )
-      {
-         log_error_and_alarm("[RadioRx] Failed to create write semaphore: %s", RUBY_SEM_RX_RADIO_REG_PRIORITY);
-         return 0;
-      }
+      log_error_and_alarm("[RadioRx] Failed to create high priority queue eventfd. Error: %d (%s)", errno, strerror(errno));
+      return 0;
    }
-   s_RadioRxState.queue_reg_priority.pSemaphoreRead = sem_open(RUBY_SEM_RX_RADIO_REG_PRIORITY, O_RDWR);
-   if ( (NULL == s_RadioRxState.queue_reg_priority.pSemaphoreRead) || (SEM_FAILED == s_RadioRxState.queue_reg_priority.pSemaphoreRead) )
+   s_RadioRxState.queue_reg_priority.iEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   if ( s_RadioRxState.queue_reg_priority.iEventFd < 0 )
    {
-      log_error_and_alarm("[RadioRx] Failed to create read semaphore: %s, try alternative", RUBY_SEM_RX_RADIO_REG_PRIORITY);
-      s_RadioRxState.queue_reg_priority.pSemaphoreRead = sem_open(RUBY_SEM_RX_RADIO_REG_PRIORITY, O_CREAT, S_IWUSR | S_IRUSR, 0); 
-      if ( (NULL == s_RadioRxState.queue_reg_priority.pSemaphoreRead) || (SEM_FAILED == s_RadioRxState.queue_reg_priority.pSemaphoreRead) )
-      {
-         log_error_and_alarm("[RadioRx] Failed to create read semaphore: %s", RUBY_SEM_RX_RADIO_REG_PRIORITY);
-         return 0;
-      }
+      log_error_and_alarm("[RadioRx] Failed to create reg priority queue eventfd. Error: %d (%s)", errno, strerror(errno));
+      close(s_RadioRxState.queue_high_priority.iEventFd);
+      s_RadioRxState.queue_high_priority.iEventFd = -1;
+      return 0;
    }
 
-   iSemVal = 0;
-   if ( 0 == sem_getvalue(s_RadioRxState.queue_reg_priority.pSemaphoreRead, &iSemVal) )
-      log_line("[RadioRx] Reg priority queue semaphore initial value: %d", iSemVal);
-   else
-      log_softerror_and_alarm("[RadioRx] Failed to get reg priority queue sem value.");
-
    for( int i=0; i<MAX_CONCURENT_VEHICLES; i++ )
    {
       s_RadioRxState.vehicles[i].uVehicleId = 0;
@@ -1167,21 +1281,12 @@ void radio_rx_stop_rx_thread()
 
    pthread_cancel(s_pThreadRadioRx);
 
-   if ( NULL != s_RadioRxState.queue_high_priority.pSemaphoreWrite )
-      sem_close(s_RadioRxState.queue_high_priority.pSemaphoreWrite);
-   if ( NULL != s_RadioRxState.queue_high_priority.pSemaphoreRead )
-      sem_close(s_RadioRxState.queue_high_priority.pSemaphoreRead);
-   if ( NULL != s_RadioRxState.queue_reg_priority.pSemaphoreWrite )
-      sem_close(s_RadioRxState.queue_reg_priority.pSemaphoreWrite);
-   if ( NULL != s_RadioRxState.queue_reg_priority.pSemaphoreRead )
-      sem_close(s_RadioRxState.queue_reg_priority.pSemaphoreRead);
-   s_RadioRxState.queue_high_priority.pSemaphoreWrite = NULL;
-   s_RadioRxState.queue_high_priority.pSemaphoreRead = NULL;
-   s_RadioRxState.queue_reg_priority.pSemaphoreWrite = NULL;
-   s_RadioRxState.queue_reg_priority.pSemaphoreRead = NULL;
-
-   sem_unlink(RUBY_SEM_RX_RADIO_HIGH_PRIORITY);
-   sem_unlink(RUBY_SEM_RX_RADIO_REG_PRIORITY);
+   if ( s_RadioRxState.queue_high_priority.iEventFd >= 0 )
+      close(s_RadioRxState.queue_high_priority.iEventFd);
+   if ( s_RadioRxState.queue_reg_priority.iEventFd >= 0 )
+      close(s_RadioRxState.queue_reg_priority.iEventFd);
+   s_RadioRxState.queue_high_priority.iEventFd = -1;
+   s_RadioRxState.queue_reg_priority.iEventFd = -1;
 }
 
 void radio_rx_set_custom_thread_priority(int iPriority)
@@ -1189,6 +1294,12 @@ void radio_rx_set_custom_thread_priority(int iPriority)
    s_iPendingRxThreadPriority = iPriority;
 }
 
+// Applied by the rx thread on its next stats update (zero based core index)
+void radio_rx_set_thread_cpu_core(int iCore)
+{
+   s_iPendingRxThreadCPUCore = iCore;
+}
+
 void radio_rx_set_timeout_interval(int iMiliSec)
 {
    s_iRadioRxLoopTimeoutInterval = iMiliSec;
@@ -27,20 +27,34 @@ typedef struct
 
 } ALIGN_STRUCT_SPEC_INFO t_radio_rx_state_vehicle;
 
+// Single producer (radio rx thread), single consumer (router thread) ring of received packets.
+// Producer and consumer indexes live on separate cache lines and are published with release/acquire.
+// The consumer gets the packets by pointer, directly from the ring slot. The slot is given back
+// to the producer on radio_rx_release_*_packet() or on the next get from the same queue.
+// A blocked consumer waits on the queue eventfd; the producer signals it only when the consumer waits.
+
+#define RADIO_RX_QUEUE_CACHE_LINE_SIZE 64
+
 typedef struct
 {
-   u8* pPacketsBuffers[MAX_RX_PACKETS_QUEUE];
+   // Owned by the producer
+   volatile int iCurrentPacketIndexToWrite __attribute__((aligned(RADIO_RX_QUEUE_CACHE_LINE_SIZE))); // Where next packet will be added
+   int iStatsMaxPacketsInQueue;
+   int iStatsMaxPacketsInQueueLastMinute;
+
+   // Owned by the consumer
+   volatile int iCurrentPacketIndexToConsume __attribute__((aligned(RADIO_RX_QUEUE_CACHE_LINE_SIZE))); // Where the first packet to read/consume is
+   int iPacketLentToConsumer; // 1 if the packet at iCurrentPacketIndexToConsume is in use by the consumer
+   volatile int iConsumerIsWaiting;
+
+   // Set on init only
+   u8* pPacketsBuffers[MAX_RX_PACKETS_QUEUE] __attribute__((aligned(RADIO_RX_QUEUE_CACHE_LINE_SIZE)));
    int iPacketsLengths[MAX_RX_PACKETS_QUEUE];
    u8  uPacketsAreShort[MAX_RX_PACKETS_QUEUE];
    u8  uPacketsRxInterface[MAX_RX_PACKETS_QUEUE];
+   u32 uPacketsTimeAddedMicros[MAX_RX_PACKETS_QUEUE]; // When the packet was read from the radio interface
    int iQueueSize;
-   volatile int iCurrentPacketIndexToWrite; // Where next packet will be added
-   volatile int iCurrentPacketIndexToConsume; // Where the first packet to read/consume is
-   int iStatsMaxPacketsInQueue;
-   int iStatsMaxPacketsInQueueLastMinute;
-
-   sem_t* pSemaphoreWrite;
-   sem_t* pSemaphoreRead;
+   int iEventFd;
 } ALIGN_STRUCT_SPEC_INFO t_radio_rx_state_packets_queue;
 
 typedef struct
@@ -76,6 +90,7 @@ int radio_rx_start_rx_thread(shared_mem_radio_stats* pSMRadioStats, int iSearchM
 void radio_rx_stop_rx_thread();
 
 void radio_rx_set_custom_thread_priority(int iPriority);
+void radio_rx_set_thread_cpu_core(int iCore);
 void radio_rx_set_timeout_interval(int iMiliSec);
 
 void radio_rx_pause_interface(int iInterfaceIndex, const char* szReason);
@@ -100,6 +115,15 @@ u32 radio_rx_get_and_reset_max_loop_time_queue();
 
 u8* radio_rx_wait_get_next_received_high_prio_packet(u32 uTimeoutMicroSec, int* pLength, int* pIsShortPacket, int* pRadioInterfaceIndex);
 u8* radio_rx_wait_get_next_received_reg_prio_packet(u32 uTimeoutMicroSec, int* pLength, int* pIsShortPacket, int* pRadioInterfaceIndex);
+// Give back to the rx thread the last packet returned by the functions above
+void radio_rx_release_high_prio_packet();
+void radio_rx_release_reg_prio_packet();
+// Time (micros) when the packet currently returned to the consumer was read from the radio interface
+u32 radio_rx_get_current_packet_rx_time_micros(int iHighPriorityQueue);
+
+int radio_rx_get_queue_event_fd(int iHighPriorityQueue);
+int radio_rx_begin_wait_on_queues();
+void radio_rx_end_wait_on_queues();
 
 #ifdef __cplusplus
 }  
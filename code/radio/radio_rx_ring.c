@@ -0,0 +1,293 @@
+/*
+    Ruby Licence
+    Copyright (c) 2025 Petru Soroaga petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and/or use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions and/or use of the source code (partially or complete) must retain
+        the above copyright notice, this list of conditions and the following disclaimer
+        in the documentation and/or other materials provided with the distribution.
+        * Redistributions in binary form (partially or complete) must reproduce
+        the above copyright notice, this list of conditions and the following disclaimer
+        in the documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permitted.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+#include "../base/base.h"
+#include "../base/config.h"
+#include "radio_rx_ring.h"
+
+// Per radio interface rx ring state. Kept here and not in radio_hw_info_t,
+// as that one is shared with other processes.
+
+typedef struct
+{
+   int iSocket;
+   u8* pRing;
+   u32 uRingSize;
+   u32 uBlockSize;
+   int iBlocksCount;
+   int iCurrentBlock;
+   int iCurrentBlockIsOwned;
+   int iFramesLeftInBlock;
+   struct tpacket3_hdr* pNextFrame;
+   u32 uTotalBlocks;
+   u32 uTotalFrames;
+} type_radio_rx_ring;
+
+static type_radio_rx_ring s_RadioRxRings[MAX_RADIO_INTERFACES];
+static int s_iRadioRxRingsInitialized = 0;
+
+static void _radio_rx_ring_init_states()
+{
+   if ( s_iRadioRxRingsInitialized )
+      return;
+   for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
+   {
+      memset(&s_RadioRxRings[i], 0, sizeof(type_radio_rx_ring));
+      s_RadioRxRings[i].iSocket = -1;
+   }
+   s_iRadioRxRingsInitialized = 1;
+}
+
+// Compiles the pcap filter expression to classic BPF and attaches it to the socket,
+// so that the kernel drops the frames not for us before they get in the ring.
+
+static int _radio_rx_ring_attach_filter(int iSocket, const char* szInterfaceName, const char* szFilter)
+{
+   pcap_t* pDead = pcap_open_dead(DLT_IEEE802_11_RADIO, MAX_PACKET_TOTAL_SIZE*10);
+   if ( NULL == pDead )
+   {
+      log_softerror_and_alarm("[RadioRxRing] Failed to create pcap handle for compiling filter for [%s].", szInterfaceName);
+      return -1;
+   }
+
+   struct bpf_program bpfprogram;
+   if ( pcap_compile(pDead, &bpfprogram, szFilter, 1, PCAP_NETMASK_UNKNOWN) == -1 )
+   {
+      log_softerror_and_alarm("[RadioRxRing] Failed to compile filter [%s] for [%s]: %s", szFilter, szInterfaceName, pcap_geterr(pDead));
+      pcap_close(pDead);
+      return -1;
+   }
+
+   struct sock_fprog filterProgram;
+   filterProgram.len = bpfprogram.bf_len;
+   filterProgram.filter = (struct sock_filter*) bpfprogram.bf_insns;
+
+   int iRes = setsockopt(iSocket, SOL_SOCKET, SO_ATTACH_FILTER, &filterProgram, sizeof(filterProgram));
+   if ( iRes < 0 )
+      log_softerror_and_alarm("[RadioRxRing] Failed to attach filter to [%s], error: %d, %s", szInterfaceName, errno, strerror(errno));
+
+   pcap_freecode(&bpfprogram);
+   pcap_close(pDead);
+   return (iRes < 0)?-1:0;
+}
+
+int radio_rx_ring_open(int iInterfaceIndex, const char* szInterfaceName, const char* szFilter)
+{
+   _radio_rx_ring_init_states();
+
+   if ( (iInterfaceIndex < 0) || (iInterfaceIndex >= MAX_RADIO_INTERFACES) || (NULL == szInterfaceName) || (NULL == szFilter) )
+      return -1;
+
+   type_radio_rx_ring* pRing = &s_RadioRxRings[iInterfaceIndex];
+   if ( pRing->iSocket >= 0 )
+      radio_rx_ring_close(iInterfaceIndex);
+
+   int iIfIndex = if_nametoindex(szInterfaceName);
+   if ( 0 == iIfIndex )
+   {
+      log_softerror_and_alarm("[RadioRxRing] Can't find interface [%s].", szInterfaceName);
+      return -1;
+   }
+
+   int iSocket = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, 0);
+   if ( iSocket < 0 )
+   {
+      log_softerror_and_alarm("[RadioRxRing] Failed to create packet socket for [%s], error: %d, %s", szInterfaceName, errno, strerror(errno));
+      return -1;
+   }
+
+   // Only radiotap interfaces are handled here, the rest (i.e. prism headers) are read using pcap
+
+   struct ifreq ifr;
+   memset(&ifr, 0, sizeof(ifr));
+   strncpy(ifr.ifr_name, szInterfaceName, IFNAMSIZ-1);
+   if ( (ioctl(iSocket, SIOCGIFHWADDR, &ifr) < 0) || (ifr.ifr_hwaddr.sa_family != ARPHRD_IEEE80211_RADIOTAP) )
+   {
+      log_line("[RadioRxRing] Interface [%s] is not a radiotap monitor interface (type %d). Can't use rx ring on it.", szInterfaceName, (int)ifr.ifr_hwaddr.sa_family);
+      close(iSocket);
+      return -1;
+   }
+
+   // The filter is attached before binding, so no unfiltered frames get queued
+
+   if ( _radio_rx_ring_attach_filter(iSocket, szInterfaceName, szFilter) < 0 )
+   {
+      close(iSocket);
+      return -1;
+   }
+
+   int iVersion = TPACKET_V3;
+   if ( setsockopt(iSocket, SOL_PACKET, PACKET_VERSION, &iVersion, sizeof(iVersion)) < 0 )
+   {
+      log_softerror_and_alarm("[RadioRxRing] TPACKET_V3 is not supported on [%s], error: %d, %s", szInterfaceName, errno, strerror(errno));
+      close(iSocket);
+      return -1;
+   }
+
+   struct tpacket_req3 req;
+   memset(&req, 0, sizeof(req));
+   req.tp_block_size = RADIO_RX_RING_BLOCK_SIZE;
+   req.tp_block_nr = RADIO_RX_RING_BLOCKS;
+   req.tp_frame_size = RADIO_RX_RING_FRAME_SIZE;
+   req.tp_frame_nr = (RADIO_RX_RING_BLOCK_SIZE / RADIO_RX_RING_FRAME_SIZE) * RADIO_RX_RING_BLOCKS;
+   req.tp_retire_blk_tov = RADIO_RX_RING_BLOCK_TIMEOUT_MS;
+   req.tp_sizeof_priv = 0;
+   req.tp_feature_req_word = 0;
+
+   if ( setsockopt(iSocket, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0 )
+   {
+      log_softerror_and_alarm("[RadioRxRing] Failed to setup rx ring on [%s], error: %d, %s", szInterfaceName, errno, strerror(errno));
+      close(iSocket);
+      return -1;
+   }
+
+   u32 uRingSize = req.tp_block_size * req.tp_block_nr;
+   u8* pMap = (u8*) mmap(NULL, uRingSize, PROT_READ | PROT_WRITE, MAP_SHARED, iSocket, 0);
+   if ( MAP_FAILED == pMap )
+   {
+      log_softerror_and_alarm("[RadioRxRing] Failed to map rx ring for [%s], error: %d, %s", szInterfaceName, errno, strerror(errno));
+      close(iSocket);
+      return -1;
+   }
+
+   struct sockaddr_ll addr;
+   memset(&addr, 0, sizeof(addr));
+   addr.sll_family = AF_PACKET;
+   addr.sll_protocol = htons(ETH_P_ALL);
+   addr.sll_ifindex = iIfIndex;
+   if ( bind(iSocket, (struct sockaddr*)&addr, sizeof(addr)) < 0 )
+   {
+      log_softerror_and_alarm("[RadioRxRing] Failed to bind packet socket to [%s], error: %d, %s", szInterfaceName, errno, strerror(errno));
+      munmap(pMap, uRingSize);
+      close(iSocket);
+      return -1;
+   }
+
+   struct packet_mreq mreq;
+   memset(&mreq, 0, sizeof(mreq));
+   mreq.mr_ifindex = iIfIndex;
+   mreq.mr_type = PACKET_MR_PROMISC;
+   if ( setsockopt(iSocket, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0 )
+      log_softerror_and_alarm("[RadioRxRing] Failed to set [%s] to promiscous mode, error: %d, %s", szInterfaceName, errno, strerror(errno));
+
+   memset(pRing, 0, sizeof(type_radio_rx_ring));
+   pRing->iSocket = iSocket;
+   pRing->pRing = pMap;
+   pRing->uRingSize = uRingSize;
+   pRing->uBlockSize = req.tp_block_size;
+   pRing->iBlocksCount = req.tp_block_nr;
+
+   log_line("[RadioRxRing] Opened rx ring on interface %d [%s]: %d blocks of %u bytes, block timeout: %d ms, fd: %d",
+      iInterfaceIndex+1, szInterfaceName, pRing->iBlocksCount, pRing->uBlockSize, RADIO_RX_RING_BLOCK_TIMEOUT_MS, iSocket);
+   return iSocket;
+}
+
+void radio_rx_ring_close(int iInterfaceIndex)
+{
+   _radio_rx_ring_init_states();
+
+   if ( (iInterfaceIndex < 0) || (iInterfaceIndex >= MAX_RADIO_INTERFACES) )
+      return;
+
+   type_radio_rx_ring* pRing = &s_RadioRxRings[iInterfaceIndex];
+   if ( pRing->iSocket < 0 )
+      return;
+
+   log_line("[RadioRxRing] Closing rx ring on interface %d, fd: %d, read %u frames in %u blocks.",
+      iInterfaceIndex+1, pRing->iSocket, pRing->uTotalFrames, pRing->uTotalBlocks);
+
+   if ( NULL != pRing->pRing )
+      munmap(pRing->pRing, pRing->uRingSize);
+   close(pRing->iSocket);
+
+   memset(pRing, 0, sizeof(type_radio_rx_ring));
+   pRing->iSocket = -1;
+}
+
+int radio_rx_ring_is_opened(int iInterfaceIndex)
+{
+   if ( (! s_iRadioRxRingsInitialized) || (iInterfaceIndex < 0) || (iInterfaceIndex >= MAX_RADIO_INTERFACES) )
+      return 0;
+   return (s_RadioRxRings[iInterfaceIndex].iSocket >= 0)?1:0;
+}
+
+u8* radio_rx_ring_get_next_frame(int iInterfaceIndex, int* pFrameLength)
+{
+   if ( NULL != pFrameLength )
+      *pFrameLength = 0;
+   if ( ! radio_rx_ring_is_opened(iInterfaceIndex) )
+      return NULL;
+
+   type_radio_rx_ring* pRing = &s_RadioRxRings[iInterfaceIndex];
+
+   while ( 1 )
+   {
+      if ( pRing->iCurrentBlockIsOwned && (pRing->iFramesLeftInBlock > 0) )
+      {
+         struct tpacket3_hdr* pFrame = pRing->pNextFrame;
+         pRing->iFramesLeftInBlock--;
+         pRing->pNextFrame = (struct tpacket3_hdr*)(((u8*)pFrame) + pFrame->tp_next_offset);
+         pRing->uTotalFrames++;
+         if ( NULL != pFrameLength )
+            *pFrameLength = (int) pFrame->tp_snaplen;
+         return ((u8*)pFrame) + pFrame->tp_mac;
+      }
+
+      // Done with the current block (the last returned frame is not used anymore), give it back to the kernel
+
+      struct tpacket_block_desc* pBlock = (struct tpacket_block_desc*)(pRing->pRing + pRing->iCurrentBlock * pRing->uBlockSize);
+      if ( pRing->iCurrentBlockIsOwned )
+      {
+         __atomic_store_n(&pBlock->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+         pRing->iCurrentBlockIsOwned = 0;
+         pRing->iCurrentBlock = (pRing->iCurrentBlock + 1) % pRing->iBlocksCount;
+         pBlock = (struct tpacket_block_desc*)(pRing->pRing + pRing->iCurrentBlock * pRing->uBlockSize);
+      }
+
+      if ( 0 == (__atomic_load_n(&pBlock->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) )
+         return NULL;
+
+      pRing->iCurrentBlockIsOwned = 1;
+      pRing->iFramesLeftInBlock = (int) pBlock->hdr.bh1.num_pkts;
+      pRing->pNextFrame = (struct tpacket3_hdr*)(((u8*)pBlock) + pBlock->hdr.bh1.offset_to_first_pkt);
+      pRing->uTotalBlocks++;
+   }
+   return NULL;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/hardware.h"
+
+// Alternative to pcap for reading wifi radio interfaces: an AF_PACKET socket with a
+// TPACKET_V3 mmap ring. The kernel fills whole blocks of frames that are then read
+// without any syscall, so one poll wakeup drains many frames.
+// A block is handed to user space when full or after RADIO_RX_RING_BLOCK_TIMEOUT_MS.
+
+#define RADIO_RX_RING_BLOCK_SIZE (1<<16)
+#define RADIO_RX_RING_BLOCKS 16
+#define RADIO_RX_RING_FRAME_SIZE 2048
+#define RADIO_RX_RING_BLOCK_TIMEOUT_MS 1
+#define RADIO_RX_RING_MAX_READS_PER_WAKEUP 32
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns the selectable fd or -1 if the ring can't be used on this interface (caller should use pcap then)
+int radio_rx_ring_open(int iInterfaceIndex, const char* szInterfaceName, const char* szFilter);
+void radio_rx_ring_close(int iInterfaceIndex);
+int radio_rx_ring_is_opened(int iInterfaceIndex);
+
+// Returns the next received frame (starting with the radiotap header) or NULL if no more frames are ready.
+// The returned buffer is valid until the next call for the same interface.
+u8* radio_rx_ring_get_next_frame(int iInterfaceIndex, int* pFrameLength);
+
+#ifdef __cplusplus
+}  
+#endif
@@ -0,0 +1,269 @@
+/*
+    Ruby Licence
+    Copyright (c) 2025 Petru Soroaga petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and/or use in source and/or binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions and/or use of the source code (partially or complete) must retain
+        the above copyright notice, this list of conditions and the following disclaimer
+        in the documentation and/or other materials provided with the distribution.
+        * Redistributions in binary form (partially or complete) must reproduce
+        the above copyright notice, this list of conditions and the following disclaimer
+        in the documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permitted.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR (PETRU SOROAGA) BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// For sendmmsg()
+#define _GNU_SOURCE
+#include <sys/socket.h>
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/hardware_radio.h"
+#include "../base/latency_stats.h"
+#include "radio_tx_batch.h"
+
+typedef struct
+{
+   int iCountPackets;
+   u8* pPackets[RADIO_TX_BATCH_MAX_PACKETS];
+   int iPacketsLengths[RADIO_TX_BATCH_MAX_PACKETS];
+   void* pPacketsContexts[RADIO_TX_BATCH_MAX_PACKETS];
+   type_radio_tx_batch_stats stats;
+} type_radio_tx_batch;
+
+static type_radio_tx_batch* s_pRadioTxBatches[MAX_RADIO_INTERFACES];
+static radio_tx_batch_result_callback s_pRadioTxBatchResultCallback = NULL;
+
+// Batching is started/ended by one thread (the one sending the video blocks).
+// Packets sent from other threads, while a batch is active, are not queued.
+static __thread int s_iRadioTxBatchActive = 0;
+
+void radio_tx_batch_begin()
+{
+   s_iRadioTxBatchActive = 1;
+}
+
+void radio_tx_batch_end()
+{
+   for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
+   {
+      if ( (NULL != s_pRadioTxBatches[i]) && (s_pRadioTxBatches[i]->iCountPackets > 0) )
+         radio_tx_batch_flush_interface(i);
+   }
+   s_iRadioTxBatchActive = 0;
+}
+
+int radio_tx_batch_is_active()
+{
+   return s_iRadioTxBatchActive;
+}
+
+void radio_tx_batch_set_result_callback(radio_tx_batch_result_callback pCallback)
+{
+   s_pRadioTxBatchResultCallback = pCallback;
+}
+
+static void _radio_tx_batch_report_results(int iInterfaceIndex, type_radio_tx_batch* pBatch, int iCount, int iSent, u32 uTxTimeMicros)
+{
+   if ( NULL == s_pRadioTxBatchResultCallback )
+      return;
+   u32 uTxTimePerPacket = 0;
+   if ( iSent > 0 )
+      uTxTimePerPacket = uTxTimeMicros / (u32)iSent;
+   for( int i=0; i<iCount; i++ )
+      (*s_pRadioTxBatchResultCallback)(iInterfaceIndex, pBatch->pPacketsContexts[i], (i < iSent)?1:0, (i < iSent)?uTxTimePerPacket:0);
+}
+
+// Returns 1 if the packet was queued, 0 if it must be sent right away by the caller.
+// pData must stay unchanged until the packet is sent (see radio_tx_batch_flush_buffer)
+
+int radio_tx_batch_add_packet(int iInterfaceIndex, u8* pData, int iDataLength, void* pContext)
+{
+   if ( (! s_iRadioTxBatchActive) || (iInterfaceIndex < 0) || (iInterfaceIndex >= MAX_RADIO_INTERFACES) )
+      return 0;
+   if ( (NULL == pData) || (iDataLength <= 0) || (iDataLength > MAX_PACKET_TOTAL_SIZE) )
+   {
+      radio_tx_batch_flush_interface(iInterfaceIndex);
+      return 0;
+   }
+
+   if ( NULL == s_pRadioTxBatches[iInterfaceIndex] )
+   {
+      s_pRadioTxBatches[iInterfaceIndex] = (type_radio_tx_batch*) malloc(sizeof(type_radio_tx_batch));
+      if ( NULL == s_pRadioTxBatches[iInterfaceIndex] )
+      {
+         log_softerror_and_alarm("[RadioTxBatch] Failed to allocate tx batch for radio interface %d.", iInterfaceIndex+1);
+         return 0;
+      }
+      memset(s_pRadioTxBatches[iInterfaceIndex], 0, sizeof(type_radio_tx_batch));
+      log_line("[RadioTxBatch] Allocated tx batch for radio interface %d (%d packets max).", iInterfaceIndex+1, RADIO_TX_BATCH_MAX_PACKETS);
+   }
+
+   type_radio_tx_batch* pBatch = s_pRadioTxBatches[iInterfaceIndex];
+   if ( pBatch->iCountPackets >= RADIO_TX_BATCH_MAX_PACKETS )
+      radio_tx_batch_flush_interface(iInterfaceIndex);
+
+   pBatch->pPackets[pBatch->iCountPackets] = pData;
+   pBatch->iPacketsLengths[pBatch->iCountPackets] = iDataLength;
+   pBatch->pPacketsContexts[pBatch->iCountPackets] = pContext;
+   pBatch->iCountPackets++;
+   return 1;
+}
+
+// Returns the number of packets sent
+
+int radio_tx_batch_flush_interface(int iInterfaceIndex)
+{
+   if ( (iInterfaceIndex < 0) || (iInterfaceIndex >= MAX_RADIO_INTERFACES) )
+      return 0;
+   type_radio_tx_batch* pBatch = s_pRadioTxBatches[iInterfaceIndex];
+   if ( (NULL == pBatch) || (0 == pBatch->iCountPackets) )
+      return 0;
+
+   int iCount = pBatch->iCountPackets;
+   pBatch->iCountPackets = 0;
+
+   radio_hw_info_t* pRadioHWInfo = hardware_get_radio_info(iInterfaceIndex);
+   if ( (NULL == pRadioHWInfo) || (0 == pRadioHWInfo->openedForWrite) || (pRadioHWInfo->runtimeInterfaceInfoTx.selectable_fd < 0) )
+   {
+      log_softerror_and_alarm("[RadioTxBatch] Tried to send a batch of %d radio packets to an invalid interface (%d).", iCount, iInterfaceIndex+1);
+      pBatch->stats.uSendErrors++;
+      _radio_tx_batch_report_results(iInterfaceIndex, pBatch, iCount, 0, 0);
+      return 0;
+   }
+
+   struct mmsghdr messages[RADIO_TX_BATCH_MAX_PACKETS];
+   struct iovec iovecs[RADIO_TX_BATCH_MAX_PACKETS];
+   memset(messages, 0, iCount * sizeof(struct mmsghdr));
+   for( int i=0; i<iCount; i++ )
+   {
+      iovecs[i].iov_base = pBatch->pPackets[i];
+      iovecs[i].iov_len = pBatch->iPacketsLengths[i];
+      messages[i].msg_hdr.msg_iov = &iovecs[i];
+      messages[i].msg_hdr.msg_iovlen = 1;
+   }
+
+   // sendmmsg can stop early (i.e. socket buffer full); retry the remaining packets once
+
+   int iSent = 0;
+   u32 uTimeStartInject = latency_stats_start();
+   u32 uTimeStartMicros = get_current_timestamp_micros();
+   for( int iRetry=0; (iRetry < 2) && (iSent < iCount); iRetry++ )
+   {
+      int iRes = sendmmsg(pRadioHWInfo->runtimeInterfaceInfoTx.selectable_fd, &messages[iSent], iCount - iSent, 0);
+      if ( iRes <= 0 )
+      {
+         log_softerror_and_alarm("[RadioTxBatch] Failed to send radio packets on radio interface %d, fd=%d (%d of %d packets sent), error: %d, %s",
+            iInterfaceIndex+1, pRadioHWInfo->runtimeInterfaceInfoTx.selectable_fd, iSent, iCount, errno, strerror(errno));
+         break;
+      }
+      iSent += iRes;
+   }
+   latency_stats_end(LATENCY_STAGE_TX_INJECT, uTimeStartInject);
+   u32 uTimeEndMicros = get_current_timestamp_micros();
+
+   if ( iSent < iCount )
+   {
+      pBatch->stats.uSendErrors++;
+      pRadioHWInfo->runtimeInterfaceInfoTx.iErrorCount++;
+   }
+   else
+      pRadioHWInfo->runtimeInterfaceInfoTx.iErrorCount = 0;
+
+   pBatch->stats.uBatches++;
+   pBatch->stats.uPackets += iSent;
+   if ( (u32)iCount > pBatch->stats.uMaxBatchSize )
+      pBatch->stats.uMaxBatchSize = iCount;
+   if ( iCount < RADIO_TX_BATCH_SIZE_HISTOGRAM_SLOTS )
+      pBatch->stats.uBatchSizeHistogram[iCount]++;
+   else
+      pBatch->stats.uBatchSizeHistogram[RADIO_TX_BATCH_SIZE_HISTOGRAM_SLOTS-1]++;
+
+   _radio_tx_batch_report_results(iInterfaceIndex, pBatch, iCount, iSent, (uTimeEndMicros > uTimeStartMicros)?(uTimeEndMicros - uTimeStartMicros):0);
+   return iSent;
+}
+
+// Sends the queues that point to any part of the given buffer, so that it can be modified
+
+void radio_tx_batch_flush_buffer(u8* pBuffer, int iLength)
+{
+   if ( (NULL == pBuffer) || (iLength <= 0) )
+      return;
+   for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
+   {
+      type_radio_tx_batch* pBatch = s_pRadioTxBatches[i];
+      if ( (NULL == pBatch) || (0 == pBatch->iCountPackets) )
+         continue;
+      for( int k=0; k<pBatch->iCountPackets; k++ )
+      {
+         if ( (pBatch->pPackets[k] < pBuffer + iLength) && (pBatch->pPackets[k] + pBatch->iPacketsLengths[k] > pBuffer) )
+         {
+            radio_tx_batch_flush_interface(i);
+            break;
+         }
+      }
+   }
+}
+
+void radio_tx_batch_discard_interface(int iInterfaceIndex)
+{
+   if ( (iInterfaceIndex < 0) || (iInterfaceIndex >= MAX_RADIO_INTERFACES) )
+      return;
+   type_radio_tx_batch* pBatch = s_pRadioTxBatches[iInterfaceIndex];
+   if ( NULL == pBatch )
+      return;
+   if ( pBatch->iCountPackets > 0 )
+      log_line("[RadioTxBatch] Discarded %d queued packets on radio interface %d.", pBatch->iCountPackets, iInterfaceIndex+1);
+   pBatch->iCountPackets = 0;
+}
+
+int radio_tx_batch_get_stats(int iInterfaceIndex, type_radio_tx_batch_stats* pStats)
+{
+   if ( NULL == pStats )
+      return 0;
+   memset(pStats, 0, sizeof(type_radio_tx_batch_stats));
+   if ( (iInterfaceIndex < 0) || (iInterfaceIndex >= MAX_RADIO_INTERFACES) || (NULL == s_pRadioTxBatches[iInterfaceIndex]) )
+      return 0;
+   memcpy(pStats, &(s_pRadioTxBatches[iInterfaceIndex]->stats), sizeof(type_radio_tx_batch_stats));
+   return 1;
+}
+
+void radio_tx_batch_log_stats(int iInterfaceIndex)
+{
+   type_radio_tx_batch_stats stats;
+   if ( ! radio_tx_batch_get_stats(iInterfaceIndex, &stats) )
+      return;
+   if ( 0 == stats.uBatches )
+      return;
+
+   char szHistogram[256];
+   szHistogram[0] = 0;
+   for( int i=1; i<RADIO_TX_BATCH_SIZE_HISTOGRAM_SLOTS; i++ )
+   {
+      if ( 0 == stats.uBatchSizeHistogram[i] )
+         continue;
+      char szTmp[32];
+      snprintf(szTmp, sizeof(szTmp), " %d%s:%u", i, (i == RADIO_TX_BATCH_SIZE_HISTOGRAM_SLOTS-1)?"+":"", stats.uBatchSizeHistogram[i]);
+      if ( strlen(szHistogram) + strlen(szTmp) < sizeof(szHistogram) )
+         strcat(szHistogram, szTmp);
+   }
+   log_line("[RadioTxBatch] Radio interface %d: %u batches, %u packets (avg %.1f, max %u per batch), %u send errors. Batch sizes:%s",
+      iInterfaceIndex+1, stats.uBatches, stats.uPackets, (float)stats.uPackets/(float)stats.uBatches, stats.uMaxBatchSize, stats.uSendErrors, szHistogram);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/hardware.h"
+
+// Batched radio tx (socket tx mode only, not ppcap).
+// Between radio_tx_batch_begin() and radio_tx_batch_end(), radio_write_raw_ieee_packet_batched() adds the
+// packets to a per interface queue instead of writing them; the queue is sent with a single
+// sendmmsg() call when it fills up and at radio_tx_batch_end().
+// The packets are not copied: the queue points to the caller's buffers, so a queued buffer must not change
+// until it is sent. Call radio_tx_batch_flush_buffer() before modifying or reusing a buffer that could be queued.
+// The result of each queued packet is reported to the callback set with radio_tx_batch_set_result_callback(),
+// when the queue is sent.
+
+#define RADIO_TX_BATCH_MAX_PACKETS 40
+#define RADIO_TX_BATCH_SIZE_HISTOGRAM_SLOTS 17
+
+typedef struct
+{
+   u32 uBatches;
+   u32 uPackets;
+   u32 uMaxBatchSize;
+   u32 uSendErrors;
+   u32 uBatchSizeHistogram[RADIO_TX_BATCH_SIZE_HISTOGRAM_SLOTS]; // index is batch size, last one is for larger batches
+} type_radio_tx_batch_stats;
+
+// iSent: 1 if the packet was sent, 0 if the send failed; uTxTimeMicros: the packet's share of the send time
+typedef void (*radio_tx_batch_result_callback)(int iInterfaceIndex, void* pContext, int iSent, u32 uTxTimeMicros);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void radio_tx_batch_begin();
+void radio_tx_batch_end();
+int radio_tx_batch_is_active();
+
+void radio_tx_batch_set_result_callback(radio_tx_batch_result_callback pCallback);
+
+int radio_tx_batch_add_packet(int iInterfaceIndex, u8* pData, int iDataLength, void* pContext);
+int radio_tx_batch_flush_interface(int iInterfaceIndex);
+void radio_tx_batch_flush_buffer(u8* pBuffer, int iLength);
+void radio_tx_batch_discard_interface(int iInterfaceIndex);
+
+int radio_tx_batch_get_stats(int iInterfaceIndex, type_radio_tx_batch_stats* pStats);
+void radio_tx_batch_log_stats(int iInterfaceIndex);
+
+#ifdef __cplusplus
+}  
+#endif
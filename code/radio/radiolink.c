@@ -43,6 +43,7 @@
 #include "../base/hardware_radio.h"
 #include "../base/hardware_radio_serial.h"
 #include "../base/hw_procs.h"
+#include "../base/latency_stats.h"
 #include "../common/string_utils.h"
 #include "radiotap.h"
 #include <time.h>
@@ -50,6 +51,8 @@
 #include "radiolink.h"
 #include "radiopackets2.h"
 #include "radio_rx.h"
+#include "radio_rx_ring.h"
+#include "radio_tx_batch.h"
 
 //#define DEBUG_PACKET_RECEIVED
 //#define DEBUG_PACKET_SENT
@@ -57,6 +60,7 @@
 int s_bRadioDebugFlag = 0;
 int s_iUsePCAPForTx = DEFAULT_USE_PPCAP_FOR_TX;
 int s_iBypassSocketBuffers = DEFAULT_BYPASS_SOCKET_BUFFERS;
+int s_iUseRxRing = DEFAULT_USE_RX_RING;
 int s_iRadioInterfacesBroken = 0;
 int s_iRadioLastReadErrorCode = RADIO_READ_ERROR_NO_ERROR;
 int s_iVehicleBehindMilisec = 0;
@@ -238,6 +242,8 @@ void radio_reset_packets_default_frequencies(int iRCEnabled)
    s_uFrequencyRadioPacketsOnSlowLinkVehicleToController[PACKET_TYPE_RUBY_TELEMETRY_VEHICLE_RX_CARDS_STATS] = 400;
    s_uFrequencyRadioPacketsOnSlowLinkVehicleToController[PACKET_TYPE_RUBY_TELEMETRY_VEHICLE_TX_HISTORY] = 400;
    s_uFrequencyRadioPacketsOnSlowLinkVehicleToController[PACKET_TYPE_RUBY_TELEMETRY_RADIO_RX_HISTORY] = 400;
+   // Compacted by the vehicle telemetry process to fit the slow links (see telemetry_mavlink_downlink)
+   s_uFrequencyRadioPacketsOnSlowLinkVehicleToController[PACKET_TYPE_TELEMETRY_RAW_DOWNLOAD] = 250;
    
    s_uFrequencyRadioPacketsOnSlowLinkVehicleToController[PACKET_TYPE_RUBY_ALARM] = 100;
 
@@ -303,6 +309,15 @@ void radio_set_bypass_socket_buffers(int iBypass)
       log_line("[Radio] Unset bypass radio sockets buffers.");
 }
 
+void radio_set_use_rx_ring(int iUseRxRing)
+{
+   s_iUseRxRing = iUseRxRing;
+   if ( s_iUseRxRing )
+      log_line("[Radio] Set using mmap packet ring for radio rx (if supported by interfaces).");
+   else
+      log_line("[Radio] Set using ppcap for radio rx");
+}
+
 // Returns 0 if the packet can't be sent (right now or ever)
 
 int radio_can_send_packet_on_slow_link(int iLinkId, int iPacketType, int iFromController, u32 uTimeNow)
@@ -340,6 +355,15 @@ int radio_can_send_packet_on_slow_link(int iLinkId, int iPacketType, int iFromCo
    return 0;
 }
 
+u32 radio_get_slow_link_packet_interval(int iPacketType, int iFromController)
+{
+   if ( (iPacketType < 1) || (iPacketType > 254) )
+      return MAX_U32;
+   if ( iFromController )
+      return s_uFrequencyRadioPacketsOnSlowLinkControllerToVehicle[iPacketType];
+   return s_uFrequencyRadioPacketsOnSlowLinkVehicleToController[iPacketType];
+}
+
 int radio_get_last_second_sent_bps_for_radio_interface(int iInterfaceIndex, u32 uTimeNow)
 {
    if ( (iInterfaceIndex < 0) || (iInterfaceIndex >= MAX_RADIO_INTERFACES) )
@@ -625,6 +649,21 @@ int _radio_open_interface_for_read_with_filter(int interfaceIndex, char* szFilte
    pRadioHWInfo->runtimeInterfaceInfoRx.selectable_fd = -1;
    pRadioHWInfo->runtimeInterfaceInfoRx.iErrorCount = 0;
 
+   if ( s_iUseRxRing )
+   {
+      int iRingFd = radio_rx_ring_open(interfaceIndex, pRadioHWInfo->szName, szFilter);
+      if ( iRingFd >= 0 )
+      {
+         pRadioHWInfo->runtimeInterfaceInfoRx.ppcap = NULL;
+         pRadioHWInfo->runtimeInterfaceInfoRx.selectable_fd = iRingFd;
+         reset_runtime_radio_rx_info(&(pRadioHWInfo->runtimeInterfaceInfoRx.radioHwRxInfo));
+         pRadioHWInfo->openedForRead = 1;
+         log_line("Opened radio interface %d (%s) for reading using rx ring on %s, filter: [%s]. Returned fd=%d", interfaceIndex+1, pRadioHWInfo->szName, str_format_frequency(pRadioHWInfo->uCurrentFrequencyKhz), szFilter, iRingFd);
+         return iRingFd;
+      }
+      log_line("Can't use rx ring on radio interface %d (%s), using ppcap for read.", interfaceIndex+1, pRadioHWInfo->szName);
+   }
+
    szErrbuf[0] = '\0';
    //pRadioHWInfo->runtimeInterfaceInfoRx.ppcap = pcap_open_live(pRadioHWInfo->szName, 4096, 1, 1, szErrbuf);
    pRadioHWInfo->runtimeInterfaceInfoRx.ppcap = pcap_create(pRadioHWInfo->szName, szErrbuf);
@@ -852,7 +891,12 @@ void radio_close_interface_for_read(int interfaceIndex)
 
    radio_rx_pause_interface(interfaceIndex, "Close radio interface");
    
-   if ( NULL != pRadioHWInfo->runtimeInterfaceInfoRx.ppcap )
+   if ( radio_rx_ring_is_opened(interfaceIndex) )
+   {
+      log_line("Closed radio interface %d [%s] that was used for read, selectable read fd was: %d (rx ring)", interfaceIndex+1, pRadioHWInfo->szName, pRadioHWInfo->runtimeInterfaceInfoRx.selectable_fd);
+      radio_rx_ring_close(interfaceIndex);
+   }
+   else if ( NULL != pRadioHWInfo->runtimeInterfaceInfoRx.ppcap )
    {
       log_line("Closed radio interface %d [%s] that was used for read, selectable read fd was: %d, ppcap was: %d", interfaceIndex+1, pRadioHWInfo->szName, pRadioHWInfo->runtimeInterfaceInfoRx.selectable_fd, pRadioHWInfo->runtimeInterfaceInfoRx.ppcap);
       pcap_close(pRadioHWInfo->runtimeInterfaceInfoRx.ppcap);
@@ -890,6 +934,12 @@ void radio_close_interface_for_write(int interfaceIndex)
 
    log_line("Closed radio interface %d (%s) that was used for write. Selectable write fd was: %d, ppcap was: %d", interfaceIndex+1, pRadioHWInfo->szName, pRadioHWInfo->runtimeInterfaceInfoTx.selectable_fd, pRadioHWInfo->runtimeInterfaceInfoTx.ppcap);
 
+   if ( radio_tx_batch_is_active() )
+      radio_tx_batch_flush_interface(interfaceIndex);
+   else
+      radio_tx_batch_discard_interface(interfaceIndex);
+   radio_tx_batch_log_stats(interfaceIndex);
+
    if ( s_iUsePCAPForTx )
    {
       if ( NULL != pRadioHWInfo->runtimeInterfaceInfoTx.ppcap )
@@ -1000,7 +1050,15 @@ u8* radio_process_wlan_data_in(int interfaceNumber, int* outPacketLength)
    */
    struct pcap_pkthdr pcapHeader;
    ppcapPacketHeader = &pcapHeader;
-   pRadioPayload = (u8*) pcap_next(pRadioHWInfo->runtimeInterfaceInfoRx.ppcap, ppcapPacketHeader); 
+   if ( radio_rx_ring_is_opened(interfaceNumber) )
+   {
+      int iFrameLength = 0;
+      pRadioPayload = radio_rx_ring_get_next_frame(interfaceNumber, &iFrameLength);
+      pcapHeader.caplen = iFrameLength;
+      pcapHeader.len = iFrameLength;
+   }
+   else
+      pRadioPayload = (u8*) pcap_next(pRadioHWInfo->runtimeInterfaceInfoRx.ppcap, ppcapPacketHeader); 
    if ( NULL == pRadioPayload )
       return NULL;
    #ifdef DEBUG_PACKET_RECEIVED
@@ -1277,7 +1335,9 @@ u32 radio_get_next_radio_link_packet_index(int iLocalRadioLinkId)
    return uRadioLinkPacketIndex;
 }
 
-int radio_build_new_raw_ieee_packet(int iLocalRadioLinkId, u8* pRawPacket, u8* pPacketData, int nInputLength, int portNb, int bEncrypt)
+// Writes the radiotap and IEEE headers; returns the headers length
+
+static int _radio_build_raw_ieee_headers(u8* pRawPacket, int portNb)
 {
    int totalRadioLength = 0;
 
@@ -1333,17 +1393,20 @@ int radio_build_new_raw_ieee_packet(int iLocalRadioLinkId, u8* pRawPacket, u8* p
       s_uLastPacketSentIEEEHeaderLength = sizeof(s_uIEEEHeaderData);
    }
    */
+   return totalRadioLength;
+}
 
-   memcpy(pRawPacket, pPacketData, nInputLength);
-   totalRadioLength += nInputLength;
+static int _radio_get_raw_ieee_headers_length()
+{
+   if ( (sRadioFrameFlags & RADIO_FLAGS_USE_MCS_DATARATES) || (sRadioDataRate_bps < 0) )
+      return sizeof(s_uRadiotapHeaderMCS) + sizeof(s_uIEEEHeaderData);
+   return sizeof(s_uRadiotapHeaderLegacy) + sizeof(s_uIEEEHeaderData);
+}
 
-   if ( s_bRadioDebugFlag )
-      memcpy(s_uLastPacketBuilt, pPacketData, nInputLength);
-   
-   #ifdef DEBUG_PACKET_SENT
-   log_line("Building a composed packet of total size: %d, extra data: %d", nInputLength + iExtraData, iExtraData);
-   #endif
+// Sets the radio link packet index, computes the CRC and encrypts the packet (pRawPacket points to the Ruby packet header)
 
+static void _radio_finalize_raw_ieee_packet(int iLocalRadioLinkId, u8* pRawPacket, int bEncrypt)
+{
    if ( (iLocalRadioLinkId < 0) || (iLocalRadioLinkId >= MAX_RADIO_INTERFACES) )
       iLocalRadioLinkId = 0;
    u16 uRadioLinkPacketIndex = radio_get_next_radio_link_packet_index(iLocalRadioLinkId);
@@ -1365,6 +1428,45 @@ int radio_build_new_raw_ieee_packet(int iLocalRadioLinkId, u8* pRawPacket, u8* p
       int dx = sizeof(t_packet_header);
       epp(pRawPacket+dx, pPH->total_length-dx);
    }
+}
+
+int radio_build_new_raw_ieee_packet(int iLocalRadioLinkId, u8* pRawPacket, u8* pPacketData, int nInputLength, int portNb, int bEncrypt)
+{
+   int totalRadioLength = _radio_build_raw_ieee_headers(pRawPacket, portNb);
+   pRawPacket += totalRadioLength;
+
+   memcpy(pRawPacket, pPacketData, nInputLength);
+   totalRadioLength += nInputLength;
+
+   if ( s_bRadioDebugFlag )
+      memcpy(s_uLastPacketBuilt, pPacketData, nInputLength);
+   
+   #ifdef DEBUG_PACKET_SENT
+   log_line("Building a composed packet of total size: %d, extra data: %d", nInputLength + iExtraData, iExtraData);
+   #endif
+
+   _radio_finalize_raw_ieee_packet(iLocalRadioLinkId, pRawPacket, bEncrypt);
+   return totalRadioLength;
+}
+
+// Same as above, but the radio headers are written in the MAX_PACKET_RADIO_HEADERS bytes reserved before pPacketData,
+// so the packet data is not copied. No encryption, as the packet data is modified in place.
+// Sets the start of the raw radio packet in ppRawPacket.
+
+int radio_build_new_raw_ieee_packet_in_place(int iLocalRadioLinkId, u8* pPacketData, int nInputLength, int portNb, u8** ppRawPacket)
+{
+   if ( (NULL == pPacketData) || (NULL == ppRawPacket) )
+      return 0;
+
+   u8* pRawPacket = pPacketData - _radio_get_raw_ieee_headers_length();
+   int totalRadioLength = _radio_build_raw_ieee_headers(pRawPacket, portNb);
+   totalRadioLength += nInputLength;
+
+   if ( s_bRadioDebugFlag )
+      memcpy(s_uLastPacketBuilt, pPacketData, nInputLength);
+
+   _radio_finalize_raw_ieee_packet(iLocalRadioLinkId, pPacketData, 0);
+   *ppRawPacket = pRawPacket;
    return totalRadioLength;
 }
 
@@ -1413,10 +1515,15 @@ int radio_write_raw_ieee_packet(int interfaceIndex, u8* pData, int dataLength, i
    s_uPacketsSentUsingCurrent_RadioRate++;
    s_uPacketsSentUsingCurrent_RadioFlags++;
 
+   // Keep packets order on air
+   if ( (! s_iUsePCAPForTx) && radio_tx_batch_is_active() )
+      radio_tx_batch_flush_interface(interfaceIndex);
+
    int len = 0;
 
    for( int k=0; k<=iRepeatCount; k++ )
    {
+      u32 uTimeStartInject = latency_stats_start();
       if ( s_iUsePCAPForTx )
       {
          len = pcap_inject(pRadioHWInfo->runtimeInterfaceInfoTx.ppcap, pData, dataLength);
@@ -1450,6 +1557,7 @@ int radio_write_raw_ieee_packet(int interfaceIndex, u8* pData, int dataLength, i
          else
             pRadioHWInfo->runtimeInterfaceInfoTx.iErrorCount = 0;
       }
+      latency_stats_end(LATENCY_STAGE_TX_INJECT, uTimeStartInject);
       if ( k < iRepeatCount )
          hardware_sleep_ms(1);
    }
@@ -1470,6 +1578,42 @@ int radio_write_raw_ieee_packet(int interfaceIndex, u8* pData, int dataLength, i
    return 1;
 }
 
+// Same as radio_write_raw_ieee_packet, but while a tx batch is active (see radio_tx_batch.h) the packet is queued
+// instead of written. The buffer is not copied: it must stay unchanged until the batch is sent.
+// Returns 1 if the packet was sent, 0 on error, 2 if it was queued: the send result is reported later,
+// with pContext, to the tx batch result callback.
+
+int radio_write_raw_ieee_packet_batched(int interfaceIndex, u8* pData, int dataLength, void* pContext)
+{
+   if ( s_iUsePCAPForTx || (! radio_tx_batch_is_active()) )
+      return radio_write_raw_ieee_packet(interfaceIndex, pData, dataLength, 0);
+
+   radio_hw_info_t* pRadioHWInfo = hardware_get_radio_info(interfaceIndex);
+   if ( NULL == pRadioHWInfo || ( 0 == pRadioHWInfo->openedForWrite) || (pRadioHWInfo->runtimeInterfaceInfoTx.selectable_fd < 0 ) )
+   {
+      log_softerror_and_alarm("RadioError: Tried to write a radio message to an invalid interface (%d).", interfaceIndex+1);
+      return 0;
+   }
+
+   #ifdef FEATURE_RADIO_SYNCHRONIZE_RXTX_THREADS
+   if ( 1 == s_iMutexRadioSyncRxTxThreadsInitialized )
+      pthread_mutex_lock(&s_pMutexRadioSyncRxTxThreads);
+   #endif
+
+   int iQueued = radio_tx_batch_add_packet(interfaceIndex, pData, dataLength, pContext);
+
+   #ifdef FEATURE_RADIO_SYNCHRONIZE_RXTX_THREADS
+   if ( 1 == s_iMutexRadioSyncRxTxThreadsInitialized )
+      pthread_mutex_unlock(&s_pMutexRadioSyncRxTxThreads);
+   #endif
+
+   if ( ! iQueued )
+      return radio_write_raw_ieee_packet(interfaceIndex, pData, dataLength, 0);
+
+   s_uPacketsSentUsingCurrent_RadioRate++;
+   s_uPacketsSentUsingCurrent_RadioFlags++;
+   return 2;
+}
 
 // Returns the number of bytes written or -1 for error, -2 for write error
 
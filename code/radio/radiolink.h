@@ -66,6 +66,7 @@ void radio_set_link_clock_delta(int iVehicleBehindMilisec);
 int  radio_get_link_clock_delta();
 void radio_set_use_pcap_for_tx(int iEnablePCAPTx);
 void radio_set_bypass_socket_buffers(int iBypass);
+void radio_set_use_rx_ring(int iUseRxRing);
 int  radio_set_out_datarate(int rate_bps); // positive: classic in bps, negative: MCS; returns 1 if it was changed
 u32  radio_get_current_frames_flags();
 u32  radio_get_current_frames_flags_datarate();
@@ -76,8 +77,13 @@ void radio_set_temporary_frames_flags(u32 uFrameFlags);
 void radio_remove_temporary_frames_flags();
 u32 radio_get_received_frames_type();
 
+// Max total length of a packet sent on a slow (serial) radio link
+#define RADIO_SLOW_LINK_MAX_PACKET_LENGTH 200
+
 void radio_reset_packets_default_frequencies(int iRCEnabled);
 int radio_can_send_packet_on_slow_link(int iLinkId, int iPacketType, int iFromController, u32 uTimeNow);
+// How often (in miliseconds) a packet of this type can be sent on a slow link; MAX_U32: never, 0: any rate
+u32 radio_get_slow_link_packet_interval(int iPacketType, int iFromController);
 int radio_get_last_second_sent_bps_for_radio_interface(int iInterfaceIndex, u32 uTimeNow);
 int radio_get_last_500ms_sent_bps_for_radio_interface(int iInterfaceIndex, u32 uTimeNow);
 
@@ -99,7 +105,9 @@ int get_last_processing_error_code();
 
 u32 radio_get_next_radio_link_packet_index(int iLocalRadioLinkId);
 int radio_build_new_raw_ieee_packet(int iLocalRadioLinkId, u8* pRawPacket, u8* pPacketData, int nInputLength, int portNb, int bEncrypt);
+int radio_build_new_raw_ieee_packet_in_place(int iLocalRadioLinkId, u8* pPacketData, int nInputLength, int portNb, u8** ppRawPacket);
 int radio_write_raw_ieee_packet(int interfaceIndex, u8* pData, int dataLength, int iRepeatCount);
+int radio_write_raw_ieee_packet_batched(int interfaceIndex, u8* pData, int dataLength, void* pContext);
 int radio_write_serial_packet(int interfaceIndex, u8* pData, int dataLength, u32 uTimeNow);
 int radio_write_sik_packet(int interfaceIndex, u8* pData, int dataLength, u32 uTimeNow);
 
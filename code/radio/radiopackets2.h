@@ -264,6 +264,17 @@ typedef struct
 #define VIDEO_STREAM_INFO_FLAG_VIDEO_PROFILE_FLAGS 4
 #define VIDEO_STREAM_INFO_FLAG_RETRANSMISSION_ID 5
 
+// Video latency trace (uTraceTimes in video segment header), in miliseconds:
+//    bits 0..19:  vehicle local time of the camera read (lower 20 bits)
+//    bits 20..25: from camera read to packet ready to send (FEC encoded), saturated to 63
+//    bits 26..31: from packet ready to radio inject, saturated to 63
+#define VIDEO_TRACE_ID_FLAG ((u16)0x8000)
+#define VIDEO_TRACE_TIME_MASK ((u32)0x000FFFFF)
+#define VIDEO_TRACE_DELTA_MAX 63
+#define VIDEO_TRACE_GET_CAPTURE_TIME(t) ((t) & VIDEO_TRACE_TIME_MASK)
+#define VIDEO_TRACE_GET_ENCODE_DELTA(t) (((t) >> 20) & 0x3F)
+#define VIDEO_TRACE_GET_INJECT_DELTA(t) (((t) >> 26) & 0x3F)
+
 //  [packet header][video segment header][video seg header important][video data][000]
 //  | pPH          | pPHVS               | pPHVSImp                  |pActualVideoData
 //                                       [     <- video block packet size            ]
@@ -308,9 +319,8 @@ typedef struct
    u16 uH264FrameIndex; // H264/H265 frame index (monotonically increasing)
    u16 uH264NALIndex; // H264/H265 nal index (monotonically increasing. a frame can have multiple NALs)
 
-   // Future
-   u16 uDummy1;
-   u32 uDummy2;
+   u16 uTraceId; // 0: packet is not traced; otherwise: video latency trace id (bit 15 set, H264/H265 frame index on lower 15 bits)
+   u32 uTraceTimes; // Only if uTraceId is not 0. Vehicle side times, see VIDEO_TRACE_* above
    // After video header comes the importad video header, part of error reconstruction as video data
 } __attribute__((packed)) t_packet_header_video_segment;
 
@@ -11,14 +11,20 @@
 // packet_header_rc_full_frame_upstream
 //
 #define RC_FULL_FRAME_FLAGS_HAS_INPUT 0x01
+#define RC_FULL_FRAME_FLAGS_HAS_INPUT_AGE 0x02 // extra_info1 is the input age; not set by older controllers (extra_info1 is 0 there)
+
+// extra_info1: time from reading the oldest stick input in the frame to sending the frame, in RC_FULL_FRAME_INPUT_AGE_UNIT_MICROS units
+#define RC_FULL_FRAME_INPUT_AGE_UNIT_MICROS 250
+#define RC_FULL_FRAME_INPUT_AGE_MAX 0xFE
+#define RC_FULL_FRAME_INPUT_AGE_NONE 0xFF // no new stick input in this frame
 
 typedef struct
 {
    u8 rc_frame_index;
    u8 ch_lowBits[MAX_RC_CHANNELS]; // Channels lower part, values from 0 to 255.
    u8 ch_highBits[MAX_RC_CHANNELS/2];  // 4 extra most significant bits for each channel, channel 0 are the lowest bits,  making the channel final range from 0 to 4096, 1000 to 2000 used
-   u8 flags; // bit 0 - has input (on the controller side)
-   u8 extra_info1; // not used, for future use
+   u8 flags; // bit 0 - has input (on the controller side), bit 1 - extra_info1 is the input age
+   u8 extra_info1; // input age, see RC_FULL_FRAME_INPUT_AGE_UNIT_MICROS
    u8 extra_info2; // not used, for future use
    u8 extra_info3; // not used, for future use
 } ALIGN_STRUCT_SPEC_INFO t_packet_header_rc_full_frame_upstream;
@@ -26,6 +32,9 @@ typedef struct
 
 #define RC_INFO_HISTORY_SIZE 50 // every 50ms
 
+#define RC_INFO_LATENCY_PERCENTILES 3 // p50, p90, p99
+#define RC_INFO_LATENCY_UNIT_MICROS 100
+
 //----------------------------------------------
 // packet_header_rc_info_downstream
 //
@@ -40,6 +49,11 @@ typedef struct
    u8 last_history_slice;
    u8 rc_rssi;
    u32 extra_flags; // not used now. for future use
+
+   // RC latency percentiles (p50, p90, p99) over the RC frames since the previous RC info packet, in RC_INFO_LATENCY_UNIT_MICROS units
+   u16 uLatencyInputToSend[RC_INFO_LATENCY_PERCENTILES]; // on controller: from reading the stick input to sending the RC frame
+   u16 uLatencyRecvToFC[RC_INFO_LATENCY_PERCENTILES]; // on vehicle: from receiving the RC frame from the router to writing it to the FC
+   u16 uLatencySamples; // RC frames written to the FC since the previous RC info packet
 } ALIGN_STRUCT_SPEC_INFO t_packet_header_rc_info_downstream;
 
 